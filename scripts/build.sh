@@ -38,6 +38,7 @@ output_directory=$root_dir/out
 build_unittests=false
 declare -a static_analysis_tools=()
 log_lib="zlog"
+log_file_format="text"
 install_prefix=/usr/local
 install_adu=false
 work_folder=/tmp
@@ -64,6 +65,9 @@ print_help() {
     echo "--log-lib <log_lib>                   Specify the logging library to build/use. Default is zlog."
     echo "                                      Options: zlog xlog"
     echo ""
+    echo "--log-file-format <format>            Specify the format of zlog log files. Default is text."
+    echo "                                      Options: text binary. Binary logs are read with zlog-decode."
+    echo ""
     echo "-l, --log-dir <log_dir>               Specify the directory where the ADU Agent will write logs."
     echo "                                      Only valid for logging libraries that support file logging."
     echo ""
@@ -242,6 +246,14 @@ while [[ $1 != "" ]]; do
         fi
         log_lib=$1
         ;;
+    --log-file-format)
+        shift
+        if [[ -z $1 || $1 == -* ]]; then
+            error "--log-file-format parameter is mandatory."
+            $ret 1
+        fi
+        log_file_format=$1
+        ;;
     -l | --log-dir)
         shift
         if [[ -z $1 || $1 == -* ]]; then
@@ -314,6 +326,7 @@ bullet "Content handlers: $content_handlers"
 bullet "Build type: $build_type"
 bullet "Log directory: $adu_log_dir"
 bullet "Logging library: $log_lib"
+bullet "Log file format: $log_file_format"
 bullet "Output directory: $output_directory"
 bullet "Build unit tests: $build_unittests"
 bullet "Build packages: $build_packages"
@@ -336,6 +349,7 @@ CMAKE_OPTIONS=(
     "-DADUC_CONTENT_HANDLERS:STRING=$content_handlers"
     "-DADUC_LOG_FOLDER:STRING=$adu_log_dir"
     "-DADUC_LOGGING_LIBRARY:STRING=$log_lib"
+    "-DADUC_LOG_FILE_FORMAT:STRING=$log_file_format"
     "-DADUC_PLATFORM_LAYER:STRING=$platform_layer"
     "-DADUC_TRACE_TARGET_DEPS=$trace_target_deps"
     "-DCMAKE_BUILD_TYPE:STRING=$build_type"
@@ -29,6 +29,7 @@ typedef struct tagADUShell_LaunchArguments
     std::vector<char*> targetOptions; /**< Additional options to pass to target command */
     char* logFile; /**< Custom log file path */
     bool showVersion; /**< Show an agent version */
+    int brokerFd; /**< Socket to serve broker requests on, or -1 to run a single action */
 } ADUShell_LaunchArguments;
 
 /**
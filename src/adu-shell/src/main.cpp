@@ -5,8 +5,11 @@
  * @copyright Copyright (c) Microsoft Corporation.
  * Licensed under the MIT License.
  */
+#include <fcntl.h>
 #include <getopt.h>
+#include <limits.h> // for INT_MAX
 #include <string.h>
+#include <sys/socket.h> // for getsockopt, SO_PEERCRED
 #include <unistd.h> // for getegid, geteuid, and setuid.
 #include <unordered_map>
 #include <vector>
@@ -14,6 +17,7 @@
 #include "aduc/c_utils.h"
 #include "aduc/config_utils.h"
 #include "aduc/logging.h"
+#include "aduc/process_broker.hpp"
 #include "aduc/process_utils.hpp"
 #include "aduc/string_utils.hpp"
 
@@ -62,6 +66,7 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
     launchArgs->targetData = nullptr;
     launchArgs->logFile = nullptr;
     launchArgs->showVersion = false;
+    launchArgs->brokerFd = -1;
 
 #if _ADU_DEBUG
     launchArgs->logLevel = ADUC_LOG_DEBUG;
@@ -94,6 +99,9 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
         //
         // "--log-level"         |   Log verbosity level.
         //
+        // "--broker-fd"         |   Serve requests from the caller on this socket, instead of running one action.
+        //                             Each request holds the other options of a single action.
+        //
         static struct option long_options[] =
         {
             { "version",           no_argument,       nullptr, 'v' },
@@ -103,6 +111,7 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
             { "target-options",    required_argument, nullptr, 'o' },
             { "target-log-folder", required_argument, nullptr, 'f' },
             { "log-level",         required_argument, nullptr, 'l' },
+            { "broker-fd",         required_argument, nullptr, 'b' },
             { nullptr, 0, nullptr, 0 }
         };
 
@@ -110,7 +119,7 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
 
         /* getopt_long stores the option index here. */
         int option_index = 0;
-        int option = getopt_long(argc, argv, "vt:a:d:o:f:l:", long_options, &option_index);
+        int option = getopt_long(argc, argv, "vt:a:d:o:f:l:b:", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (option == -1)
@@ -163,6 +172,24 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
             break;
         }
 
+        case 'b':
+        {
+            char* endptr;
+            errno = 0; /* To distinguish success/failure after call */
+            const long brokerFd = strtol(optarg, &endptr, 10);
+            if (errno != 0 || endptr == optarg || *endptr != '\0' || brokerFd < 0 || brokerFd > INT_MAX)
+            {
+                printf("Invalid socket after '--broker-fd' option.\n");
+                result = -1;
+            }
+            else
+            {
+                launchArgs->brokerFd = static_cast<int>(brokerFd);
+            }
+
+            break;
+        }
+
         case '?':
             switch (optopt)
             {
@@ -194,6 +221,12 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
         }
     }
 
+    // A broker gets the update type and action with each request.
+    if (launchArgs->brokerFd != -1)
+    {
+        return result;
+    }
+
     if (launchArgs->updateType == nullptr)
     {
         printf("Missing --update-type option.\n");
@@ -254,6 +287,97 @@ int ADUShell_Dowork(const ADUShell_LaunchArguments& launchArgs)
     return taskResult.ExitStatus();
 }
 
+/**
+ * @brief Logs the options of a single action.
+ */
+void LogLaunchArguments(const ADUShell_LaunchArguments& launchArgs)
+{
+    Log_Debug("Update type: %s", launchArgs.updateType);
+    Log_Debug("Update action: %s", launchArgs.updateAction);
+    Log_Debug("Target data: %s", launchArgs.targetData);
+    for (const std::string& option : launchArgs.targetOptions)
+    {
+        Log_Debug("Target options: %s", option.c_str());
+    }
+    Log_Debug("Log level: %d", launchArgs.logLevel);
+}
+
+/**
+ * @brief Runs one broker request. The request holds the options of a single action, and is parsed and run as if
+ * adu-shell was started with them, except that the log level of the broker is kept.
+ *
+ * @param args The options.
+ * @return The exit status adu-shell would have exited with.
+ */
+int ADUShell_DoBrokerRequest(const std::vector<std::string>& args)
+{
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 2);
+    argv.emplace_back(const_cast<char*>("adu-shell")); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    for (const std::string& arg : args)
+    {
+        argv.emplace_back(const_cast<char*>(arg.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    }
+    argv.emplace_back(nullptr);
+
+    ADUShell_LaunchArguments launchArgs;
+
+    // Parse from the first option again.
+    optind = 0;
+    int ret = ParseLaunchArguments(static_cast<int>(argv.size() - 1), &argv[0], &launchArgs);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    if (launchArgs.brokerFd != -1)
+    {
+        printf("'--broker-fd' is not allowed in a broker request.\n");
+        return -1;
+    }
+
+    if (launchArgs.showVersion)
+    {
+        printf("%s\n", ADUC_VERSION);
+        return 0;
+    }
+
+    LogLaunchArguments(launchArgs);
+
+    return ADUShell_Dowork(launchArgs);
+}
+
+/**
+ * @brief Serves broker requests until the process that started adu-shell closes the socket.
+ *
+ * @param brokerFd The socket, one end of a socketpair made by the caller.
+ * @param defaultUserId The real user id adu-shell was started with.
+ * @return 0 when the socket was closed.
+ */
+int ADUShell_ServeBroker(int brokerFd, uid_t defaultUserId)
+{
+    // Only serve the caller that started adu-shell, or root.
+    struct ucred peer = {};
+    socklen_t peerSize = sizeof(peer);
+    if (getsockopt(brokerFd, SOL_SOCKET, SO_PEERCRED, &peer, &peerSize) != 0)
+    {
+        Log_Error("Broker fd %d is not a socket. (errno: %d)", brokerFd, errno);
+        return EXIT_FAILURE;
+    }
+
+    if (peer.uid != defaultUserId && peer.uid != 0)
+    {
+        Log_Error("Broker socket peer uid(%d) is not the caller uid(%d).", peer.uid, defaultUserId);
+        return EPERM;
+    }
+
+    // The child processes of the tasks must not inherit the socket.
+    fcntl(brokerFd, F_SETFD, FD_CLOEXEC);
+
+    Log_Info("Serving broker requests from pid %d.", peer.pid);
+    return ADUC_Broker_Serve(brokerFd, ADUShell_DoBrokerRequest) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 /**
  * @brief Checking if the process has permission to run the adu shell operations
  *
@@ -265,16 +389,16 @@ bool ADUShell_PermissionCheck()
     bool isTrusted = false;
 
     // If config file is provided, check if user is in trusted user list.
-    ADUC_ConfigInfo config = {};
-    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config != nullptr)
     {
-        VECTOR_HANDLE aduShellTrustedUsers = ADUC_ConfigInfo_GetAduShellTrustedUsers(&config);
+        VECTOR_HANDLE aduShellTrustedUsers = ADUC_ConfigInfo_GetAduShellTrustedUsers(config);
 
         isTrusted = VerifyProcessEffectiveUser(aduShellTrustedUsers);
 
         ADUC_ConfigInfo_FreeAduShellTrustedUsers(aduShellTrustedUsers);
         aduShellTrustedUsers = nullptr;
-        ADUC_ConfigInfo_UnInit(&config);
+        ADUC_ConfigInfo_ReleaseInstance(config);
     }
 
     // If config file not provided or user not in the trusted users list, then
@@ -323,14 +447,10 @@ int main(int argc, char** argv)
 
     ADUC_Logging_Init(launchArgs.logLevel, "adu-shell");
 
-    Log_Debug("Update type: %s", launchArgs.updateType);
-    Log_Debug("Update action: %s", launchArgs.updateAction);
-    Log_Debug("Target data: %s", launchArgs.targetData);
-    for (const std::string& option : launchArgs.targetOptions)
+    if (launchArgs.brokerFd == -1)
     {
-        Log_Debug("Target options: %s", option.c_str());
+        LogLaunchArguments(launchArgs);
     }
-    Log_Debug("Log level: %d", launchArgs.logLevel);
 
     // Run as 'root'.
     // Note: this requires the file owner to be 'root'.
@@ -346,7 +466,14 @@ int main(int argc, char** argv)
             effectiveUserId,
             getegid());
 
-        ret = ADUShell_Dowork(launchArgs);
+        if (launchArgs.brokerFd != -1)
+        {
+            ret = ADUShell_ServeBroker(launchArgs.brokerFd, defaultUserId);
+        }
+        else
+        {
+            ret = ADUShell_Dowork(launchArgs);
+        }
 
         ADUC_Logging_Uninit();
 
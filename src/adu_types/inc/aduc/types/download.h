@@ -8,7 +8,9 @@
 #ifndef ADUC_TYPES_DOWNLOAD_H
 #define ADUC_TYPES_DOWNLOAD_H
 
-#include <stdint.h> // uint64_t
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint64_t
 
 /**
  * @brief Defines download progress state for download progress callback.
@@ -32,4 +34,25 @@ typedef void (*ADUC_DownloadProgressCallback)(
     uint64_t bytesTransferred,
     uint64_t bytesTotal);
 
+/**
+ * @brief Receives payload content, in file order, as a V2 content downloader writes it.
+ * @details Lets the agent hash the payload while it downloads instead of re-reading the file afterwards.
+ */
+typedef struct tagADUC_DownloadDataSink
+{
+    void* context; /**< Opaque context passed back to the callbacks. */
+
+    /**
+     * @brief Consumes the next @p length bytes of the payload.
+     * @details A downloader may write zero bytes to ask whether to keep going, e.g. while it waits to retry.
+     * @return false to ask the downloader to abort.
+     */
+    bool (*write)(void* context, const uint8_t* data, size_t length);
+
+    /**
+     * @brief Discards all content written so far because the downloader restarts the payload from byte zero.
+     */
+    void (*reset)(void* context);
+} ADUC_DownloadDataSink;
+
 #endif // ADUC_TYPES_DOWNLOAD_H
@@ -15,15 +15,16 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h> // PRIu64
 #include <stdlib.h>
+#include <string.h> // strcmp
 
 #include <time.h>
 
 #include "aduc/adu_core_export_helpers.h" // ADUC_MethodCall_RestartAgent
 #include "aduc/agent_orchestration.h"
+#include "aduc/content_store.h" // ADUC_ContentStore_Sweep
 #include "aduc/download_handler_factory.h" // ADUC_DownloadHandlerFactory_LoadDownloadHandler
 #include "aduc/download_handler_plugin.h" // ADUC_DownloadHandlerPlugin_OnUpdateWorkflowCompleted
 #include "aduc/logging.h"
-#include "aduc/parser_utils.h" // ADUC_FileEntity_Uninit
 #include "aduc/result.h"
 #include "aduc/string_c_utils.h"
 #include "aduc/system_utils.h"
@@ -101,6 +102,22 @@ static const char* ADUCITF_WorkflowStepToString(ADUCITF_WorkflowStep workflowSte
     return "<Unknown>";
 }
 
+/**
+ * @brief Destroys the sandbox of @p workflowId, then releases its content store references.
+ *
+ * @param updateActionCallbacks The update action callbacks of the platform layer.
+ * @param workflowId The workflow id.
+ * @param workFolder The sandbox of the workflow.
+ */
+static void DestroySandbox(
+    const ADUC_UpdateActionCallbacks* updateActionCallbacks, const char* workflowId, const char* workFolder)
+{
+    updateActionCallbacks->SandboxDestroyCallback(updateActionCallbacks->PlatformLayerHandle, workflowId, workFolder);
+
+    // Runs on success, failure and cancellation alike, as each of them ends by removing the sandbox.
+    (void)ADUC_ContentStore_Sweep(workFolder);
+}
+
 /**
  * @brief Cleans up previously created sandboxes, excluding the current workflowId.
  *
@@ -122,10 +139,7 @@ static void CleanupSandbox(void* context, const char* baseDir, const char* workf
         }
         else
         {
-            const ADUC_UpdateActionCallbacks* updateActionCallbacks = &(workflowData->UpdateActionCallbacks);
-
-            updateActionCallbacks->SandboxDestroyCallback(
-                updateActionCallbacks->PlatformLayerHandle, workflowId, workDirPath);
+            DestroySandbox(&(workflowData->UpdateActionCallbacks), workflowId, workDirPath);
 
             free(workDirPath);
         }
@@ -951,11 +965,7 @@ void ADUC_Workflow_WorkCompletionCallback(const void* workCompletionToken, ADUC_
                     {
                         Log_Info("Cleanup sandbox before replacement workflow");
 
-                        const ADUC_UpdateActionCallbacks* updateActionCallbacks =
-                            &(workflowData->UpdateActionCallbacks);
-
-                        updateActionCallbacks->SandboxDestroyCallback(
-                            updateActionCallbacks->PlatformLayerHandle, workflowId, workFolder);
+                        DestroySandbox(&(workflowData->UpdateActionCallbacks), workflowId, workFolder);
                     }
 
                     workflow_free_string(workflowId);
@@ -1158,7 +1168,7 @@ static void ADUC_Workflow_SetUpdateStateHelper(
 }
 
 /**
- * @brief For each update payload that has a DownloadHandlerId, load the handler and call OnUpdateWorkflowCompleted.
+ * @brief For each download handler of the update payloads, load the handler and call OnUpdateWorkflowCompleted once.
  *
  * @param workflowHandle The workflow handle.
  * @details This function will not fail but if a download handler's OnUpdateWorkflowCompleted fails, side effects include logging the error result codes and saving the extended result code that can be reported along with a successful workflow deployment.
@@ -1166,24 +1176,39 @@ static void ADUC_Workflow_SetUpdateStateHelper(
 static void CallDownloadHandlerOnUpdateWorkflowCompleted(const ADUC_WorkflowHandle workflowHandle)
 {
     size_t payloadCount = workflow_get_update_files_count(workflowHandle);
+
+    // Ids of the handlers already called, borrowed from the workflow. If NULL, handlers are called per payload.
+    const char** calledIds = payloadCount == 0 ? NULL : calloc(payloadCount, sizeof(*calledIds));
+    size_t calledCount = 0;
+
     for (size_t i = 0; i < payloadCount; ++i)
     {
         ADUC_Result result = {};
-        ADUC_FileEntity fileEntity;
-        memset(&fileEntity, 0, sizeof(fileEntity));
-        if (!workflow_get_update_file(workflowHandle, i, &fileEntity))
+        const char* downloadHandlerId = workflow_peek_update_file_download_handler_id(workflowHandle, i);
+        if (IsNullOrEmpty(downloadHandlerId))
         {
             continue;
         }
 
-        if (IsNullOrEmpty(fileEntity.DownloadHandlerId))
+        // The handler completes the whole workflow, e.g. moves all its payloads, so call it once.
+        bool called = false;
+        for (size_t j = 0; j < calledCount && !called; ++j)
+        {
+            called = strcmp(calledIds[j], downloadHandlerId) == 0;
+        }
+
+        if (called)
         {
-            ADUC_FileEntity_Uninit(&fileEntity);
             continue;
         }
 
+        if (calledIds != NULL)
+        {
+            calledIds[calledCount++] = downloadHandlerId;
+        }
+
         // NOTE: do not free the handle as it is owned by the DownloadHandlerFactory.
-        DownloadHandlerHandle* handle = ADUC_DownloadHandlerFactory_LoadDownloadHandler(fileEntity.DownloadHandlerId);
+        DownloadHandlerHandle* handle = ADUC_DownloadHandlerFactory_LoadDownloadHandler(downloadHandlerId);
         if (handle == NULL)
         {
             Log_Error("Failed to load download handler.");
@@ -1201,9 +1226,9 @@ static void CallDownloadHandlerOnUpdateWorkflowCompleted(const ADUC_WorkflowHand
                 workflow_set_success_erc(workflowHandle, result.ExtendedResultCode);
             }
         }
-
-        ADUC_FileEntity_Uninit(&fileEntity);
     }
+
+    free(calledIds);
 }
 
 /**
@@ -1295,8 +1320,7 @@ void ADUC_Workflow_MethodCall_Idle(ADUC_WorkflowData* workflowData)
         {
             Log_Info("Calling SandboxDestroyCallback");
 
-            updateActionCallbacks->SandboxDestroyCallback(
-                updateActionCallbacks->PlatformLayerHandle, workflowId, workFolder);
+            DestroySandbox(updateActionCallbacks, workflowId, workFolder);
         }
     }
     else
@@ -41,6 +41,9 @@ static const char g_aduPnPComponentAgentPropertyName[] = "agent";
 // ADU Management send an 'Update Action' to this device by setting this property on IoTHub.
 static const char g_aduPnPComponentServicePropertyName[] = "service";
 
+// How long an update state report waits for the states that follow it, so they reach the twin in one update.
+#define UPDATE_RESULT_COALESCING_WINDOW_MS 200
+
 /**
  * @brief Handle for Device Update Agent component to communication to service.
  */
@@ -184,6 +187,8 @@ bool ReportStartupMsg(ADUC_WorkflowData* workflowData)
 
     char* jsonString = NULL;
 
+    const ADUC_ConfigInfo* config = NULL;
+
     JSON_Value* startupMsgValue = json_value_init_object();
 
     if (startupMsgValue == NULL)
@@ -198,14 +203,14 @@ bool ReportStartupMsg(ADUC_WorkflowData* workflowData)
         goto done;
     }
 
-    ADUC_ConfigInfo config = {};
+    config = ADUC_ConfigInfo_GetInstance();
 
-    if (!ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    if (config == NULL)
     {
         goto done;
     }
 
-    const ADUC_AgentInfo* agent = ADUC_ConfigInfo_GetAgent(&config, 0);
+    const ADUC_AgentInfo* agent = ADUC_ConfigInfo_GetAgent(config, 0);
 
     if (!StartupMsg_AddDeviceProperties(startupMsgObj, agent))
     {
@@ -213,7 +218,7 @@ bool ReportStartupMsg(ADUC_WorkflowData* workflowData)
         goto done;
     }
 
-    if (!StartupMsg_AddCompatPropertyNames(startupMsgObj, &config))
+    if (!StartupMsg_AddCompatPropertyNames(startupMsgObj, config))
     {
         Log_Error("Could not add compatPropertyNames to the startup message");
         goto done;
@@ -234,7 +239,7 @@ done:
     json_value_free(startupMsgValue);
     json_free_serialized_string(jsonString);
 
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
     return success;
 }
 
@@ -260,6 +265,9 @@ bool AzureDeviceUpdateCoreInterface_Create(void** context, int argc, char** argv
         goto done;
     }
 
+    ADUC_D2C_Messaging_Set_Coalescing_Window(
+        ADUC_D2C_Message_Type_Device_Update_Result, UPDATE_RESULT_COALESCING_WINDOW_MS);
+
     succeeded = true;
 
 done:
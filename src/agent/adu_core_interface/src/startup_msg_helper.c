@@ -95,7 +95,7 @@ done:
  * @param config the ADUC_ConfigInfo that contains the config info
  * @returns true on successful addition, false on failure
  */
-bool StartupMsg_AddCompatPropertyNames(JSON_Object* startupObj, ADUC_ConfigInfo* config)
+bool StartupMsg_AddCompatPropertyNames(JSON_Object* startupObj, const ADUC_ConfigInfo* config)
 {
     if (startupObj == NULL)
     {
@@ -29,7 +29,7 @@ bool StartupMsg_AddDeviceProperties(JSON_Object* startupObj, const ADUC_AgentInf
  * @param config the ADUC_ConfigInfo that contains the config info
  * @returns true on successful addition, false on failure
  */
-bool StartupMsg_AddCompatPropertyNames(JSON_Object* startupObj, ADUC_ConfigInfo* config);
+bool StartupMsg_AddCompatPropertyNames(JSON_Object* startupObj, const ADUC_ConfigInfo* config);
 
 EXTERN_C_END
 #endif // STARTUP_MSG_HELPER_H
@@ -69,7 +69,7 @@ bool GetConnectionInfoFromConnectionString(ADUC_ConnectionInfo* info, const char
  *
  * @return true if connection string can be obtained.
  */
-bool IsConnectionInfoValid(const ADUC_LaunchArguments* launchArgs, ADUC_ConfigInfo* config)
+bool IsConnectionInfoValid(const ADUC_LaunchArguments* launchArgs, const ADUC_ConfigInfo* config)
 {
     bool validInfo = false;
 
@@ -572,14 +572,14 @@ bool HealthCheck(const ADUC_LaunchArguments* launchArgs)
 {
     bool isHealthy = false;
 
-    ADUC_ConfigInfo config = {};
-    if (!ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config == NULL)
     {
         Log_Error("Failed to initialize from config file: %s", ADUC_CONF_FILE_PATH);
         goto done;
     }
 
-    if (!IsConnectionInfoValid(launchArgs, &config))
+    if (!IsConnectionInfoValid(launchArgs, config))
     {
         Log_Error("Invalid connection info.");
         goto done;
@@ -594,7 +594,7 @@ bool HealthCheck(const ADUC_LaunchArguments* launchArgs)
 
 done:
     Log_Info("Health check %s.", isHealthy ? "passed" : "failed");
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
 
     return isHealthy;
 }
@@ -16,6 +16,7 @@
 #include "aduc/connection_string_utils.h"
 #include "aduc/d2c_messaging.h"
 #include "aduc/device_info_interface.h"
+#include "aduc/event_loop_utils.h"
 #include "aduc/extension_manager.h"
 #include "aduc/extension_utils.h"
 #include "aduc/health_management.h"
@@ -26,7 +27,6 @@
 #include "aduc/string_c_utils.h"
 #include "aduc/system_utils.h"
 #include <azure_c_shared_utility/shared_util_options.h>
-#include <azure_c_shared_utility/threadapi.h> // ThreadAPI_Sleep
 #include <ctype.h>
 #include <do_config.h>
 #include <diagnostics_devicename.h>
@@ -69,6 +69,18 @@
  */
 #define RET_COLON_FOR_MISSING_OPTIONARG ":"
 
+/**
+ * @brief The longest the main loop waits between passes while the IoT Hub client must be polled, in milliseconds.
+ * @remark That is while connecting, or while a D2C message waits for its response.
+ */
+#define MAIN_LOOP_BUSY_WAIT_MS 100
+
+/**
+ * @brief The longest the main loop waits between passes otherwise, in milliseconds.
+ * @remark Incoming twin updates are only read by ClientHandle_DoWork(), so this bounds how late they are noticed.
+ */
+#define MAIN_LOOP_IDLE_WAIT_MS 1000
+
 // Name of ADU Agent subcomponent that this device implements.
 static const char g_aduPnPComponentName[] = "deviceUpdate";
 
@@ -466,6 +478,9 @@ static void ADUC_PnP_Components_HandleRefresh(ADUC_ClientHandle clientHandle)
 {
     Log_Info("Refreshing the handle for the PnP channels.");
 
+    // The new connection may report to another twin, so send the next messages in full.
+    ADUC_D2C_Messaging_Reset_Reported_Properties();
+
     const size_t componentCount = ARRAY_SIZE(componentList);
 
     for (size_t index = 0; index < componentCount; ++index)
@@ -699,9 +714,7 @@ ADUC_ConnType GetConnTypeFromConnectionString(const char* connectionString)
 bool GetConnectionInfoFromConnectionString(ADUC_ConnectionInfo* info, const char* connectionString)
 {
     bool succeeded = false;
-
-    ADUC_ConfigInfo config;
-    memset(&config, 0, sizeof(config));
+    const ADUC_ConfigInfo* config = NULL;
 
     if (info == NULL)
     {
@@ -732,11 +745,12 @@ bool GetConnectionInfoFromConnectionString(ADUC_ConnectionInfo* info, const char
     info->authType = ADUC_AuthType_SASToken;
 
     // Optional: The certificate string is needed for Edge Gateway connection.
-    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH) && config.edgegatewayCertPath != NULL)
+    config = ADUC_ConfigInfo_GetInstance();
+    if (config != NULL && config->edgegatewayCertPath != NULL)
     {
-        if (!LoadBufferWithFileContents(config.edgegatewayCertPath, certificateString, ARRAY_SIZE(certificateString)))
+        if (!LoadBufferWithFileContents(config->edgegatewayCertPath, certificateString, ARRAY_SIZE(certificateString)))
         {
-            Log_Error("Failed to read the certificate from path: %s", config.edgegatewayCertPath);
+            Log_Error("Failed to read the certificate from path: %s", config->edgegatewayCertPath);
             goto done;
         }
 
@@ -752,7 +766,7 @@ bool GetConnectionInfoFromConnectionString(ADUC_ConnectionInfo* info, const char
     succeeded = true;
 
 done:
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
     return succeeded;
 }
 
@@ -821,19 +835,20 @@ ADUC_Command redoUpdateCommand = { "retry-update", RetryUpdateCommandHandler };
 bool GetAgentConfigInfo(ADUC_ConnectionInfo* info)
 {
     bool success = false;
-    ADUC_ConfigInfo config = {};
+    const ADUC_ConfigInfo* config = NULL;
     if (info == NULL)
     {
         return false;
     }
 
-    if (!ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    config = ADUC_ConfigInfo_GetInstance();
+    if (config == NULL)
     {
         Log_Error("No connection string set from launch arguments or configuration file");
         goto done;
     }
 
-    const ADUC_AgentInfo* agent = ADUC_ConfigInfo_GetAgent(&config, 0);
+    const ADUC_AgentInfo* agent = ADUC_ConfigInfo_GetAgent(config, 0);
     if (agent == NULL)
     {
         Log_Error("ADUC_ConfigInfo_GetAgent failed to get the agent information.");
@@ -869,11 +884,38 @@ done:
         ADUC_ConnectionInfo_DeAlloc(info);
     }
 
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
 
     return success;
 }
 
+/**
+ * @brief Keeps D2C messages in an outbox file if du-config.json has "enableD2COutbox": true, so that messages not
+ * delivered before the agent restarts, e.g. for a reboot, are sent by the next run.
+ */
+static void EnableD2COutboxIfConfigured()
+{
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+
+    if (config != NULL && config->enableD2COutbox)
+    {
+        void* cloudServiceHandles[ADUC_D2C_Message_Type_Max] = {};
+        cloudServiceHandles[ADUC_D2C_Message_Type_Device_Update_Result] = &g_iotHubClientHandleForADUComponent;
+        cloudServiceHandles[ADUC_D2C_Message_Type_Device_Update_ACK] = &g_iotHubClientHandleForADUComponent;
+        cloudServiceHandles[ADUC_D2C_Message_Type_Device_Properties] = &g_iotHubClientHandleForADUComponent;
+        cloudServiceHandles[ADUC_D2C_Message_Type_Device_Information] = &g_iotHubClientHandleForDeviceInfoComponent;
+        cloudServiceHandles[ADUC_D2C_Message_Type_Diagnostics] = &g_iotHubClientHandleForDiagnosticsComponent;
+        cloudServiceHandles[ADUC_D2C_Message_Type_Diagnostics_ACK] = &g_iotHubClientHandleForDiagnosticsComponent;
+
+        if (!ADUC_D2C_Messaging_Enable_Outbox(ADUC_D2C_OUTBOX_FILE_PATH, cloudServiceHandles))
+        {
+            Log_Warn("D2C outbox unavailable. Messages not yet delivered are lost when the agent stops.");
+        }
+    }
+
+    ADUC_ConfigInfo_ReleaseInstance(config);
+}
+
 /**
  * @brief Handles the startup of the agent
  * @details Provisions the connection string with the CLI or either
@@ -887,11 +929,18 @@ bool StartupAgent(const ADUC_LaunchArguments* launchArgs)
 
     ADUC_ConnectionInfo info = {};
 
+    if (!ADUC_EventLoop_Init())
+    {
+        Log_Warn("Event loop unavailable. Main loop will poll every %d ms.", MAIN_LOOP_IDLE_WAIT_MS);
+    }
+
     if (!ADUC_D2C_Messaging_Init())
     {
         goto done;
     }
 
+    EnableD2COutboxIfConfigured();
+
     if (launchArgs->connectionString != NULL)
     {
         ADUC_ConnType connType = GetConnTypeFromConnectionString(launchArgs->connectionString);
@@ -1000,6 +1049,7 @@ void ShutdownAgent()
 {
     Log_Info("Agent is shutting down with signal %d.", g_shutdownSignal);
     ADUC_D2C_Messaging_Uninit();
+    ADUC_EventLoop_Uninit();
     UninitializeCommandListenerThread();
     ADUC_PnP_Components_Destroy();
     IoTHub_CommunicationManager_Deinit();
@@ -1044,8 +1094,8 @@ void OnRestartSignal(int sig)
 bool RunAsDesiredUser()
 {
     bool success = false;
-    ADUC_ConfigInfo config = {};
-    if (!ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config == NULL)
     {
         Log_Error("Cannot read configuration file.");
         return false;
@@ -1057,15 +1107,15 @@ bool RunAsDesiredUser()
         goto done;
     }
 
-    if (!PermissionUtils_SetProcessEffectiveUID(config.agents[0].runas))
+    if (!PermissionUtils_SetProcessEffectiveUID(config->agents[0].runas))
     {
-        Log_Error("Failed to set process effective user to '%s'. (errno:%d)", config.agents[0].runas, errno);
+        Log_Error("Failed to set process effective user to '%s'. (errno:%d)", config->agents[0].runas, errno);
         goto done;
     }
 
     success = true;
 done:
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
     return success;
 }
 
@@ -1240,6 +1290,10 @@ int main(int argc, char** argv)
     //
     signal(SIGUSR1, OnRestartSignal);
 
+    // Hash the registered extensions up front, and in parallel, rather than one by one as each is first loaded.
+    // The verified hash cache lives in the data folder, so unchanged extensions are not hashed again on restart.
+    ExtensionManager_PreloadExtensions();
+
     if (!StartupAgent(&launchArgs))
     {
         goto done;
@@ -1271,8 +1325,14 @@ int main(int argc, char** argv)
         // See: https://github.com/Azure/azure-iot-sdk-c/tree/master/iothub_client/samples
         // NOTE: For this example the above has been wrapped to support module and device client methods using
         // the client_handle_helper.h function ClientHandle_DoWork()
-
-        ThreadAPI_Sleep(100);
+        //
+        // The SDK does not expose its socket or its next deadline, so poll it that often only while it has work in
+        // flight. Otherwise sleep until a worker thread queues a D2C message, a D2C retry is due, or the idle
+        // timeout elapses.
+        const bool busy =
+            !IoTHub_CommunicationManager_IsAuthenticated() || ADUC_D2C_Messaging_IsWaitingForResponse();
+
+        ADUC_EventLoop_Wait(busy ? MAIN_LOOP_BUSY_WAIT_MS : MAIN_LOOP_IDLE_WAIT_MS);
     };
 
     ret = 0; // Success.
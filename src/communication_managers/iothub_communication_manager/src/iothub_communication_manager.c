@@ -240,17 +240,17 @@ static IOTHUB_CLIENT_TRANSPORT_PROVIDER GetIotHubProtocolFromConfig()
 #ifdef ADUC_GET_IOTHUB_PROTOCOL_FROM_CONFIG
     IOTHUB_CLIENT_TRANSPORT_PROVIDER transportProvider = NULL;
 
-    ADUC_ConfigInfo config;
-    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config != NULL)
     {
-        if (config.iotHubProtocol != NULL)
+        if (config->iotHubProtocol != NULL)
         {
-            if (strcmp(config.iotHubProtocol, "mqtt") == 0)
+            if (strcmp(config->iotHubProtocol, "mqtt") == 0)
             {
                 transportProvider = MQTT_Protocol;
                 Log_Info("IotHub Protocol: MQTT");
             }
-            else if (strcmp(config.iotHubProtocol, "mqtt/ws") == 0)
+            else if (strcmp(config->iotHubProtocol, "mqtt/ws") == 0)
             {
                 transportProvider = MQTT_WebSocket_Protocol;
                 Log_Info("IotHub Protocol: MQTT/WS");
@@ -259,7 +259,7 @@ static IOTHUB_CLIENT_TRANSPORT_PROVIDER GetIotHubProtocolFromConfig()
             {
                 Log_Error(
                     "Unsupported 'iotHubProtocol' value of '%s' from '" ADUC_CONF_FILE_PATH "'.",
-                    config.iotHubProtocol);
+                    config->iotHubProtocol);
             }
         }
         else
@@ -269,7 +269,7 @@ static IOTHUB_CLIENT_TRANSPORT_PROVIDER GetIotHubProtocolFromConfig()
             Log_Info("IotHub Protocol: MQTT");
         }
 
-        ADUC_ConfigInfo_UnInit(&config);
+        ADUC_ConfigInfo_ReleaseInstance(config);
     }
     else
     {
@@ -477,6 +477,7 @@ static ADUC_ConnType GetConnTypeFromConnectionString(const char* connectionStrin
 static bool GetConnectionInfoFromConnectionString(ADUC_ConnectionInfo* info, const char* connectionString)
 {
     bool succeeded = false;
+    const ADUC_ConfigInfo* config = NULL;
     if (info == NULL)
     {
         goto done;
@@ -506,12 +507,12 @@ static bool GetConnectionInfoFromConnectionString(ADUC_ConnectionInfo* info, con
     info->authType = ADUC_AuthType_SASToken;
 
     // Optional: The certificate string is needed for Edge Gateway connection.
-    ADUC_ConfigInfo config = {};
-    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH) && config.edgegatewayCertPath != NULL)
+    config = ADUC_ConfigInfo_GetInstance();
+    if (config != NULL && config->edgegatewayCertPath != NULL)
     {
-        if (!LoadBufferWithFileContents(config.edgegatewayCertPath, certificateString, ARRAY_SIZE(certificateString)))
+        if (!LoadBufferWithFileContents(config->edgegatewayCertPath, certificateString, ARRAY_SIZE(certificateString)))
         {
-            Log_Error("Failed to read the certificate from path: %s", config.edgegatewayCertPath);
+            Log_Error("Failed to read the certificate from path: %s", config->edgegatewayCertPath);
             goto done;
         }
 
@@ -527,7 +528,7 @@ static bool GetConnectionInfoFromConnectionString(ADUC_ConnectionInfo* info, con
     succeeded = true;
 
 done:
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
     return succeeded;
 }
 
@@ -574,19 +575,20 @@ done:
 static bool GetAgentConfigInfo(ADUC_ConnectionInfo* info)
 {
     bool success = false;
-    ADUC_ConfigInfo config = {};
+    const ADUC_ConfigInfo* config = NULL;
     if (info == NULL)
     {
         return false;
     }
 
-    if (!ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH))
+    config = ADUC_ConfigInfo_GetInstance();
+    if (config == NULL)
     {
         Log_Error("No connection string set from launch arguments or configuration file");
         goto done;
     }
 
-    const ADUC_AgentInfo* agent = ADUC_ConfigInfo_GetAgent(&config, 0);
+    const ADUC_AgentInfo* agent = ADUC_ConfigInfo_GetAgent(config, 0);
     if (agent == NULL)
     {
         Log_Error("ADUC_ConfigInfo_GetAgent failed to get the agent information.");
@@ -622,7 +624,7 @@ done:
         ADUC_ConnectionInfo_DeAlloc(info);
     }
 
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
 
     return success;
 }
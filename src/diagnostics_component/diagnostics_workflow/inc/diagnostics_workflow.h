@@ -9,10 +9,30 @@
 #define DIAGNOSTICS_WORKFLOW_H
 
 #include <aduc/c_utils.h>
+#include <azure_c_shared_utility/vector.h>
 #include <diagnostics_config_utils.h>
+#include <stdbool.h>
 
 EXTERN_C_BEGIN
 
+/**
+ * @brief Uploads @p fileNames, found in @p directoryPath, to the folder @p virtualDirectoryPath of a storage container
+ * @param storageSasUrl credential for the storage container
+ * @param virtualDirectoryPath the folder within the container to upload to, ending in '/'
+ * @param fileNames vector of STRING_HANDLE names of the files to be uploaded
+ * @param directoryPath the directory holding the files
+ * @returns true on success; false on failure
+ */
+typedef bool (*DiagnosticsWorkflow_UploadFilesFunc)(
+    const char* storageSasUrl, const char* virtualDirectoryPath, VECTOR_HANDLE fileNames, const char* directoryPath);
+
+/**
+ * @brief Replaces the function that uploads the log files, e.g. with a local stand-in for tests
+ * @details Must not be called while a DiagnosticsWorkflow is running
+ * @param uploadFilesFunc the function to upload with; NULL restores the Azure Blob Storage upload
+ */
+void DiagnosticsWorkflow_SetUploadFilesFunc(DiagnosticsWorkflow_UploadFilesFunc uploadFilesFunc);
+
 /**
  * @brief Uploads the diagnostic logs described by @p workflowData
  * @param workflowData the workflowData structure describing the log components
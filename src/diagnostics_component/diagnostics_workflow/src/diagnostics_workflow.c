@@ -10,16 +10,49 @@
 
 #include <aduc/logging.h>
 #include <aduc/string_c_utils.h>
+#include <aduc/system_utils.h>
 #include <azure_blob_storage_file_upload_utility.h>
 #include <diagnostics_config_utils.h>
 #include <diagnostics_devicename.h>
 #include <diagnostics_interface.h>
 #include <file_info_utils.h>
+#include <log_compression_utils.h>
 #include <operation_id_utils.h>
 #include <parson_json_utils.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+/**
+ * @brief Maximum number of log components uploaded at the same time
+ */
+#define DIAGNOSTICS_MAX_CONCURRENT_UPLOADS 4
+
+/**
+ * @brief The files to upload for one log component
+ */
+typedef struct tagDiagnosticsComponentUpload
+{
+    const DiagnosticsLogComponent* logComponent; //!< The component the files belong to
+    VECTOR_HANDLE fileNames; //!< Vector of STRING_HANDLE names of the files to upload, found in directoryPath
+    STRING_HANDLE directoryPath; //!< The component's log path, or the staging folder holding compressed copies
+} DiagnosticsComponentUpload;
+
+/**
+ * @brief State shared by the threads uploading the log components
+ */
+typedef struct tagDiagnosticsUploadContext
+{
+    pthread_mutex_t mutex; //!< Guards nextUpload and result
+    const DiagnosticsComponentUpload* uploads; //!< The log components to upload
+    size_t uploadCount; //!< The number of @p uploads
+    size_t nextUpload; //!< Index of the next log component to upload
+    Diagnostics_Result result; //!< Result of the first failed upload, or Diagnostics_Result_Success
+    const char* deviceName; //!< Name of the device
+    const char* operationId; //!< The id of the upload request
+    const char* storageSasUrl; //!< Credential for the Azure Blob Storage upload
+} DiagnosticsUploadContext;
+
 /**
  * @brief Sets the memory in @p memory which points to the storage location in @p sasCredential to 0 before calling STRING_delete() on sasCredential
  * @param sasCredential credential to be deleted
@@ -112,10 +145,71 @@ done:
     return result;
 }
 
+/**
+ * @brief Uploads @p fileNames, found in @p directoryPath, to the Azure Blob Storage folder @p virtualDirectoryPath
+ * @details The default DiagnosticsWorkflow_UploadFilesFunc
+ * @param storageSasUrl credential to be used for the Azure Blob Storage upload
+ * @param virtualDirectoryPath the folder within the container to upload to
+ * @param fileNames vector of STRING_HANDLE names of the files to be uploaded
+ * @param directoryPath the directory holding the files
+ * @returns true on success; false on failure
+ */
+static bool DiagnosticsWorkflow_UploadFilesToBlobStorage(
+    const char* storageSasUrl, const char* virtualDirectoryPath, VECTOR_HANDLE fileNames, const char* directoryPath)
+{
+    bool succeeded = false;
+    char* storageSasCredentialMemory = NULL;
+
+    BlobStorageInfo blobInfo = {};
+
+    blobInfo.storageSasCredential =
+        DiagnosticsComponent_CreateSasCredential(storageSasUrl, &storageSasCredentialMemory);
+
+    if (blobInfo.storageSasCredential == NULL)
+    {
+        goto done;
+    }
+
+    blobInfo.virtualDirectoryPath = STRING_construct(virtualDirectoryPath);
+
+    if (blobInfo.virtualDirectoryPath == NULL)
+    {
+        goto done;
+    }
+
+    succeeded = AzureBlobStorageFileUploadUtility_UploadFilesToContainer(&blobInfo, 1, fileNames, directoryPath);
+
+done:
+
+    STRING_delete(blobInfo.virtualDirectoryPath);
+    blobInfo.virtualDirectoryPath = NULL;
+
+    DiagnosticsComponent_SecurelyFreeSasCredential(&blobInfo.storageSasCredential, &storageSasCredentialMemory);
+
+    return succeeded;
+}
+
+/**
+ * @brief The function that uploads the log files
+ */
+static DiagnosticsWorkflow_UploadFilesFunc s_uploadFilesFunc = DiagnosticsWorkflow_UploadFilesToBlobStorage;
+
+/**
+ * @brief Replaces the function that uploads the log files, e.g. with a local stand-in for tests
+ * @details Must not be called while a DiagnosticsWorkflow is running
+ * @param uploadFilesFunc the function to upload with; NULL restores the Azure Blob Storage upload
+ */
+void DiagnosticsWorkflow_SetUploadFilesFunc(DiagnosticsWorkflow_UploadFilesFunc uploadFilesFunc)
+{
+    s_uploadFilesFunc =
+        (uploadFilesFunc == NULL) ? DiagnosticsWorkflow_UploadFilesToBlobStorage : uploadFilesFunc;
+}
+
 /**
  * @brief Uploads the logs held within @p fileNames described by @p logComponent
  * @param fileNames vector of files to be uploaded for @p logComponent
  * @param logComponent descriptor for the component for which we're going to upload logs
+ * @param directoryPath the directory holding the files, the component's log path unless they were compressed
  * @param deviceName name of the device the DiagnosticsWorkflow is running on
  * @param operationId the id associated with this upload request sent down by Diagnostics Service
  * @param storageSasUrl credential to be used for the Azure Blob Storage upload
@@ -124,20 +218,20 @@ done:
 Diagnostics_Result DiagnosticsWorkflow_UploadFilesForComponent(
     VECTOR_HANDLE fileNames,
     const DiagnosticsLogComponent* logComponent,
+    const char* directoryPath,
     const char* deviceName,
     const char* operationId,
     const char* storageSasUrl)
 {
-    if (fileNames == NULL || logComponent == NULL || deviceName == NULL || operationId == NULL
-        || storageSasUrl == NULL)
+    if (fileNames == NULL || logComponent == NULL || directoryPath == NULL || deviceName == NULL
+        || operationId == NULL || storageSasUrl == NULL)
     {
         return Diagnostics_Result_Failure;
     }
 
-    char* storageSasCredentialMemory = NULL;
     Diagnostics_Result result = Diagnostics_Result_Failure;
 
-    BlobStorageInfo blobInfo = {};
+    STRING_HANDLE virtualDirectoryPath = NULL;
 
     if (logComponent->componentName == NULL || logComponent->logPath == NULL)
     {
@@ -145,29 +239,16 @@ Diagnostics_Result DiagnosticsWorkflow_UploadFilesForComponent(
         goto done;
     }
 
-    blobInfo.storageSasCredential =
-        DiagnosticsComponent_CreateSasCredential(storageSasUrl, &storageSasCredentialMemory);
-
-    if (blobInfo.storageSasCredential == NULL)
-    {
-        goto done;
-    }
-
-    blobInfo.virtualDirectoryPath = STRING_new();
     // Virtual Directory path: <device-name>/<operation-id>/<component-name>/<files>
-    if (STRING_sprintf(
-            blobInfo.virtualDirectoryPath,
-            "%s/%s/%s/",
-            deviceName,
-            operationId,
-            STRING_c_str(logComponent->componentName))
-        != 0)
+    virtualDirectoryPath = STRING_construct_sprintf(
+        "%s/%s/%s/", deviceName, operationId, STRING_c_str(logComponent->componentName));
+
+    if (virtualDirectoryPath == NULL)
     {
         goto done;
     }
 
-    if (!AzureBlobStorageFileUploadUtility_UploadFilesToContainer(
-            &blobInfo, 1, fileNames, STRING_c_str(logComponent->logPath)))
+    if (!s_uploadFilesFunc(storageSasUrl, STRING_c_str(virtualDirectoryPath), fileNames, directoryPath))
     {
         result = Diagnostics_Result_UploadFailed;
         Log_Warn(
@@ -179,43 +260,219 @@ Diagnostics_Result DiagnosticsWorkflow_UploadFilesForComponent(
     result = Diagnostics_Result_Success;
 done:
 
-    STRING_delete(blobInfo.virtualDirectoryPath);
-    blobInfo.virtualDirectoryPath = NULL;
-
-    DiagnosticsComponent_SecurelyFreeSasCredential(&blobInfo.storageSasCredential, &storageSasCredentialMemory);
+    STRING_delete(virtualDirectoryPath);
 
     return result;
 }
 
 /**
- * @brief Helper function for freeing the contents of a vector of vectors of STRING_HANDLE type
- * @details Does not free @p logComponentFileNames itself just its contents
- * @param logComponentFileNames a vector of vectors of STRING_HANDLE type
+ * @brief Helper function for freeing the contents of an array of DiagnosticsComponentUpload
+ * @details Does not free @p uploads itself just its contents
+ * @param uploads the array of DiagnosticsComponentUpload
+ * @param uploadCount the number of elements in @p uploads
  */
-void DiagnosticsWorkflow_UnInitLogComponentFileNames(VECTOR_HANDLE logComponentFileNames)
+static void DiagnosticsWorkflow_UnInitComponentUploads(DiagnosticsComponentUpload* uploads, size_t uploadCount)
 {
-    if (logComponentFileNames == NULL)
+    if (uploads == NULL)
     {
         return;
     }
 
-    const size_t logComponentFileNamesSize = VECTOR_size(logComponentFileNames);
+    for (size_t i = 0; i < uploadCount; ++i)
+    {
+        const size_t fileNamesSize = VECTOR_size(uploads[i].fileNames);
+
+        for (size_t j = 0; j < fileNamesSize; ++j)
+        {
+            STRING_HANDLE* fileName = VECTOR_element(uploads[i].fileNames, j);
+
+            STRING_delete(*fileName);
+        }
 
-    for (int i = 0; i < logComponentFileNamesSize; ++i)
+        VECTOR_destroy(uploads[i].fileNames);
+        STRING_delete(uploads[i].directoryPath);
+
+        memset(&uploads[i], 0, sizeof(uploads[i]));
+    }
+}
+
+/**
+ * @brief Discovers the logs of @p logComponent and, if @p compression is set, compresses them into a staging folder
+ * @param upload the upload to be initialized
+ * @param logComponent descriptor for the component for which we're going to discover logs
+ * @param componentIndex index of @p logComponent, naming its staging folder
+ * @param compression how the logs are compressed
+ * @param maxUploadSize maximum number of bytes of logs allowed to be uploaded, after compression
+ * @returns a value of Diagnostics_Result indicating the status of this component's discovery
+ */
+static Diagnostics_Result DiagnosticsWorkflow_PrepareComponentUpload(
+    DiagnosticsComponentUpload* upload,
+    const DiagnosticsLogComponent* logComponent,
+    size_t componentIndex,
+    DiagnosticsCompression compression,
+    const unsigned int maxUploadSize)
+{
+    Diagnostics_Result result = Diagnostics_Result_Failure;
+
+    upload->logComponent = logComponent;
+
+    if (compression == DiagnosticsCompression_None)
     {
-        VECTOR_HANDLE* fileNames = VECTOR_element(logComponentFileNames, i);
+        result = DiagnosticsWorkflow_GetFilesForComponent(&upload->fileNames, logComponent, maxUploadSize);
 
-        const size_t fileNamesSize = VECTOR_size(*fileNames);
+        if (result != Diagnostics_Result_Success)
+        {
+            goto done;
+        }
+
+        result = Diagnostics_Result_Failure;
+        upload->directoryPath = STRING_clone(logComponent->logPath);
 
-        for (int j = 0; j < fileNamesSize; ++j)
+        if (upload->directoryPath == NULL)
         {
-            STRING_HANDLE* fileName = VECTOR_element(*fileNames, j);
+            goto done;
+        }
+    }
+    else
+    {
+        upload->directoryPath =
+            STRING_construct_sprintf("%s/%zu", DIAGNOSTICS_STAGING_FOLDER, componentIndex);
 
-            STRING_delete(*fileName);
+        if (upload->directoryPath == NULL)
+        {
+            goto done;
+        }
+
+        if (ADUC_SystemUtils_MkDirRecursiveDefault(STRING_c_str(upload->directoryPath)) != 0)
+        {
+            Log_Error("DiagnosticsWorkflow cannot create staging folder %s", STRING_c_str(upload->directoryPath));
+            goto done;
+        }
+
+        if (!LogCompressionUtils_GzipNewestFilesInDirUnderSize(
+                &upload->fileNames,
+                STRING_c_str(logComponent->logPath),
+                STRING_c_str(upload->directoryPath),
+                maxUploadSize))
+        {
+            result = Diagnostics_Result_NoLogsFound;
+            Log_Debug(
+                "DiagnosticsWorkflow_PrepareComponentUpload No files found for logComponent: %s",
+                STRING_c_str(logComponent->componentName));
+            goto done;
+        }
+    }
+
+    result = Diagnostics_Result_Success;
+
+done:
+
+    return result;
+}
+
+/**
+ * @brief Uploads log components from @p arg, a DiagnosticsUploadContext, until none are left or an upload failed
+ * @param arg the DiagnosticsUploadContext
+ * @returns NULL
+ */
+static void* DiagnosticsWorkflow_UploadWorker(void* arg)
+{
+    DiagnosticsUploadContext* context = (DiagnosticsUploadContext*)arg;
+
+    while (true)
+    {
+        pthread_mutex_lock(&context->mutex);
+
+        if (context->result != Diagnostics_Result_Success || context->nextUpload >= context->uploadCount)
+        {
+            pthread_mutex_unlock(&context->mutex);
+            break;
+        }
+
+        const DiagnosticsComponentUpload* upload = &context->uploads[context->nextUpload++];
+
+        pthread_mutex_unlock(&context->mutex);
+
+        const Diagnostics_Result result = DiagnosticsWorkflow_UploadFilesForComponent(
+            upload->fileNames,
+            upload->logComponent,
+            STRING_c_str(upload->directoryPath),
+            context->deviceName,
+            context->operationId,
+            context->storageSasUrl);
+
+        if (result != Diagnostics_Result_Success)
+        {
+            pthread_mutex_lock(&context->mutex);
+
+            if (context->result == Diagnostics_Result_Success)
+            {
+                context->result = result;
+            }
+
+            pthread_mutex_unlock(&context->mutex);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Uploads @p uploads on up to DIAGNOSTICS_MAX_CONCURRENT_UPLOADS threads, including the calling one
+ * @details Once an upload fails no further components are started
+ * @param uploads the log components to upload
+ * @param uploadCount the number of @p uploads
+ * @param deviceName name of the device the DiagnosticsWorkflow is running on
+ * @param operationId the id associated with this upload request sent down by Diagnostics Service
+ * @param storageSasUrl credential to be used for the Azure Blob Storage upload
+ * @returns the result of the first failed upload, or Diagnostics_Result_Success
+ */
+static Diagnostics_Result DiagnosticsWorkflow_UploadComponents(
+    const DiagnosticsComponentUpload* uploads,
+    size_t uploadCount,
+    const char* deviceName,
+    const char* operationId,
+    const char* storageSasUrl)
+{
+    DiagnosticsUploadContext context = {};
+    pthread_t threads[DIAGNOSTICS_MAX_CONCURRENT_UPLOADS - 1];
+    size_t threadCount = 0;
+
+    if (pthread_mutex_init(&context.mutex, NULL) != 0)
+    {
+        return Diagnostics_Result_Failure;
+    }
+
+    context.uploads = uploads;
+    context.uploadCount = uploadCount;
+    context.nextUpload = 0;
+    context.result = Diagnostics_Result_Success;
+    context.deviceName = deviceName;
+    context.operationId = operationId;
+    context.storageSasUrl = storageSasUrl;
+
+    while (threadCount < ARRAY_SIZE(threads) && threadCount + 1 < uploadCount)
+    {
+        if (pthread_create(&threads[threadCount], NULL, DiagnosticsWorkflow_UploadWorker, &context) != 0)
+        {
+            // Carry on with the threads we have; the calling thread uploads too.
+            Log_Warn("DiagnosticsWorkflow cannot start upload thread #%zu", threadCount);
+            break;
         }
 
-        VECTOR_destroy(*fileNames);
+        ++threadCount;
+    }
+
+    DiagnosticsWorkflow_UploadWorker(&context);
+
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        pthread_join(threads[i], NULL);
     }
+
+    pthread_mutex_destroy(&context.mutex);
+
+    return context.result;
 }
 
 /**
@@ -236,7 +493,8 @@ void DiagnosticsWorkflow_DiscoverAndUploadLogs(const DiagnosticsWorkflowData* wo
     STRING_HANDLE storageSasCredential = NULL;
     char* storageSasCredentialMemory = NULL;
 
-    VECTOR_HANDLE logComponentFileNames = NULL;
+    DiagnosticsComponentUpload* uploads = NULL;
+    size_t uploadCount = 0;
 
     if (jsonString == NULL)
     {
@@ -300,13 +558,19 @@ void DiagnosticsWorkflow_DiscoverAndUploadLogs(const DiagnosticsWorkflowData* wo
         goto done;
     }
 
-    logComponentFileNames = VECTOR_create(sizeof(VECTOR_HANDLE));
+    uploads = calloc(numComponents, sizeof(*uploads));
 
-    if (logComponentFileNames == NULL)
+    if (uploads == NULL)
     {
         goto done;
     }
 
+    if (workflowData->compression != DiagnosticsCompression_None)
+    {
+        // Drop compressed copies left behind by an interrupted upload.
+        (void)ADUC_SystemUtils_RmDirRecursive(DIAGNOSTICS_STAGING_FOLDER);
+    }
+
     //
     // Perform Discovery
     //
@@ -320,16 +584,12 @@ void DiagnosticsWorkflow_DiscoverAndUploadLogs(const DiagnosticsWorkflowData* wo
             goto done;
         }
 
-        VECTOR_HANDLE discoveredFileNames = NULL;
-
-        result = DiagnosticsWorkflow_GetFilesForComponent(&discoveredFileNames, logComponent, uploadSizePerComponent);
+        ++uploadCount;
 
-        if (result != Diagnostics_Result_Success || discoveredFileNames == NULL)
-        {
-            goto done;
-        }
+        result = DiagnosticsWorkflow_PrepareComponentUpload(
+            &uploads[i], logComponent, i, workflowData->compression, uploadSizePerComponent);
 
-        if (VECTOR_push_back(logComponentFileNames, &discoveredFileNames, 1) != 0)
+        if (result != Diagnostics_Result_Success)
         {
             goto done;
         }
@@ -338,34 +598,12 @@ void DiagnosticsWorkflow_DiscoverAndUploadLogs(const DiagnosticsWorkflowData* wo
     //
     // Perform Upload
     //
-    for (size_t i = 0; i < numComponents; ++i)
-    {
-        const DiagnosticsLogComponent* logComponent = DiagnosticsConfigUtils_GetLogComponentElem(workflowData, i);
-
-        if (logComponent == NULL || logComponent->componentName == NULL || logComponent->logPath == NULL)
-        {
-            Log_Error("DiagnosticsWorkflow_UploadLogs WorkflowData has uninitialized components");
-            goto done;
-        }
-
-        const VECTOR_HANDLE* discoveredLogFileNames = VECTOR_element(logComponentFileNames, i);
+    result = DiagnosticsWorkflow_UploadComponents(
+        uploads, uploadCount, deviceName, STRING_c_str(operationId), STRING_c_str(storageSasCredential));
 
-        if (discoveredLogFileNames == NULL)
-        {
-            goto done;
-        }
-
-        result = DiagnosticsWorkflow_UploadFilesForComponent(
-            *discoveredLogFileNames,
-            logComponent,
-            deviceName,
-            STRING_c_str(operationId),
-            STRING_c_str(storageSasCredential));
-
-        if (result != Diagnostics_Result_Success)
-        {
-            goto done;
-        }
+    if (result != Diagnostics_Result_Success)
+    {
+        goto done;
     }
 
     result = Diagnostics_Result_Success;
@@ -393,10 +631,12 @@ done:
         }
     }
 
-    if (logComponentFileNames != NULL)
+    DiagnosticsWorkflow_UnInitComponentUploads(uploads, uploadCount);
+    free(uploads);
+
+    if (workflowData != NULL && workflowData->compression != DiagnosticsCompression_None)
     {
-        DiagnosticsWorkflow_UnInitLogComponentFileNames(logComponentFileNames);
-        VECTOR_destroy(logComponentFileNames);
+        (void)ADUC_SystemUtils_RmDirRecursive(DIAGNOSTICS_STAGING_FOLDER);
     }
 
     free(deviceName);
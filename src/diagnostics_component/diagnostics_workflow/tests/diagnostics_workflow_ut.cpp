@@ -0,0 +1,452 @@
+/**
+ * @file diagnostics_workflow_ut.cpp
+ * @brief Unit Tests for the Diagnostics Log Upload workflow
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "diagnostics_result.h"
+#include "diagnostics_workflow.h"
+
+#include <aduc/system_utils.h>
+#include <algorithm>
+#include <azure_c_shared_utility/strings.h>
+#include <azure_c_shared_utility/vector.h>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <diagnostics_config_utils.h>
+#include <diagnostics_devicename.h>
+#include <fstream>
+#include <log_compression_utils.h>
+#include <map>
+#include <mutex>
+#include <parson.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+/**
+ * @brief Stands in for the diagnostics interface, which would report @p result to the IoT Hub
+ */
+extern "C" void
+DiagnosticsInterface_ReportStateAndResultAsync(const Diagnostics_Result result, const char* operationId);
+
+namespace
+{
+// The maximum number of log components diagnostics_workflow.c uploads at the same time.
+constexpr size_t maxConcurrentUploads = 4;
+
+const std::string operationId{ "op-1" };
+const std::string storageSasUrl{ "https://contoso.blob.core.windows.net/logs?sig=secret" };
+
+Diagnostics_Result s_reportedResult = Diagnostics_Result_Failure;
+std::string s_reportedOperationId;
+
+/**
+ * @brief One call of the upload function, with the files it was given as they were at the time
+ */
+struct UploadCall
+{
+    std::string storageSasUrl;
+    std::string virtualDirectoryPath;
+    std::string directoryPath;
+    std::map<std::string, std::string> files; //!< Content of each file, decompressed if it was gzip compressed
+    bool gzipped = true; //!< Whether every file was gzip compressed
+};
+
+// Guards the state of the stand-in upload below, which is called from several threads.
+std::mutex s_mutex;
+std::condition_variable s_inFlightChanged;
+std::vector<UploadCall> s_calls;
+size_t s_inFlight = 0;
+size_t s_maxInFlight = 0;
+
+// How the stand-in upload behaves.
+bool s_waitForConcurrentUploads = false;
+std::string s_failingVirtualDirectoryPath;
+std::chrono::milliseconds s_uploadLatency{ 0 };
+
+/**
+ * @brief Returns the content of the file at @p path, decompressed if it is gzip compressed
+ * @details Does not use Catch2 assertions, since it is called from the upload threads.
+ */
+std::string ReadLogFile(const std::string& path, bool* gzipped)
+{
+    std::string content;
+
+    std::ifstream file{ path, std::ios::binary };
+    char magic[2] = {};
+    file.read(magic, sizeof(magic));
+    *gzipped = file.gcount() == 2 && static_cast<unsigned char>(magic[0]) == 0x1f
+        && static_cast<unsigned char>(magic[1]) == 0x8b;
+
+    // gzread reads files that are not gzip compressed as they are.
+    gzFile gz = gzopen(path.c_str(), "rb");
+    if (gz == nullptr)
+    {
+        return content;
+    }
+
+    char buffer[4096];
+    int read = 0;
+    while ((read = gzread(gz, buffer, sizeof(buffer))) > 0)
+    {
+        content.append(buffer, static_cast<size_t>(read));
+    }
+
+    gzclose(gz);
+    return content;
+}
+
+/**
+ * @brief Records the call and the files it was given, then succeeds unless it uploads s_failingVirtualDirectoryPath
+ */
+bool RecordingUploadFiles(
+    const char* storageSasUrl, const char* virtualDirectoryPath, VECTOR_HANDLE fileNames, const char* directoryPath)
+{
+    UploadCall call;
+    call.storageSasUrl = storageSasUrl;
+    call.virtualDirectoryPath = virtualDirectoryPath;
+    call.directoryPath = directoryPath;
+
+    for (size_t i = 0; i < VECTOR_size(fileNames); ++i)
+    {
+        const auto* fileName = static_cast<const STRING_HANDLE*>(VECTOR_element(fileNames, i));
+        bool gzipped = false;
+        call.files[STRING_c_str(*fileName)] =
+            ReadLogFile(call.directoryPath + "/" + STRING_c_str(*fileName), &gzipped);
+        call.gzipped = call.gzipped && gzipped;
+    }
+
+    const bool fail = call.virtualDirectoryPath == s_failingVirtualDirectoryPath;
+
+    std::unique_lock<std::mutex> lock{ s_mutex };
+    s_calls.push_back(call);
+    s_maxInFlight = std::max(s_maxInFlight, ++s_inFlight);
+    s_inFlightChanged.notify_all();
+
+    if (s_waitForConcurrentUploads)
+    {
+        // Hold the upload until as many run at once as ever will, so that the count cannot depend on timing.
+        s_inFlightChanged.wait_for(
+            lock, std::chrono::seconds{ 5 }, [] { return s_maxInFlight >= maxConcurrentUploads; });
+    }
+
+    lock.unlock();
+
+    if (!fail)
+    {
+        std::this_thread::sleep_for(s_uploadLatency);
+    }
+
+    lock.lock();
+    --s_inFlight;
+
+    return !fail;
+}
+
+/**
+ * @brief Returns @p count lines of log text for the log file @p name
+ */
+std::string MakeLogText(const std::string& name, int count)
+{
+    std::ostringstream text;
+    for (int i = 0; i < count; ++i)
+    {
+        text << "2022-01-27T13:45:05.899Z [I] " << name << " processing update action " << (i % 7) << "\n";
+    }
+    return text.str();
+}
+
+/**
+ * @brief Log components with log files in a temporary folder, and the workflow data that describes them
+ */
+class DiagnosticsWorkflowFixture
+{
+public:
+    DiagnosticsWorkflowFixture(const DiagnosticsWorkflowFixture&) = delete;
+    DiagnosticsWorkflowFixture& operator=(const DiagnosticsWorkflowFixture&) = delete;
+    DiagnosticsWorkflowFixture(DiagnosticsWorkflowFixture&&) = delete;
+    DiagnosticsWorkflowFixture& operator=(DiagnosticsWorkflowFixture&&) = delete;
+
+    DiagnosticsWorkflowFixture()
+    {
+        char rootTemplate[] = "/tmp/diagworkflowXXXXXX";
+        REQUIRE(mkdtemp(rootTemplate) != nullptr);
+        _root = rootTemplate;
+
+        s_reportedResult = Diagnostics_Result_Failure;
+        s_reportedOperationId.clear();
+        s_calls.clear();
+        s_inFlight = 0;
+        s_maxInFlight = 0;
+        s_waitForConcurrentUploads = false;
+        s_failingVirtualDirectoryPath.clear();
+        s_uploadLatency = std::chrono::milliseconds{ 0 };
+
+        (void)ADUC_SystemUtils_RmDirRecursive(DIAGNOSTICS_STAGING_FOLDER);
+
+        REQUIRE(DiagnosticsComponent_SetDeviceName("device", nullptr));
+        DiagnosticsWorkflow_SetUploadFilesFunc(RecordingUploadFiles);
+    }
+
+    ~DiagnosticsWorkflowFixture()
+    {
+        DiagnosticsWorkflow_SetUploadFilesFunc(nullptr);
+        DiagnosticsComponent_DestroyDeviceName();
+        DiagnosticsConfigUtils_UnInit(&_workflowData);
+        (void)ADUC_SystemUtils_RmDirRecursive(_root.c_str());
+        (void)ADUC_SystemUtils_RmDirRecursive(DIAGNOSTICS_STAGING_FOLDER);
+    }
+
+    /**
+     * @brief Adds a log component with @p logCount log files
+     * @returns the name of the component
+     */
+    std::string AddComponent(int logCount)
+    {
+        const std::string name = "c" + std::to_string(_logs.size());
+        const std::string logPath = LogPath(name);
+        REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(logPath.c_str()) == 0);
+
+        std::map<std::string, std::string>& logs = _logs[name];
+        for (int i = 0; i < logCount; ++i)
+        {
+            const std::string fileName = name + "-" + std::to_string(i) + ".log";
+            logs[fileName] = MakeLogText(fileName, 200);
+            std::ofstream{ logPath + "/" + fileName, std::ios::binary } << logs[fileName];
+        }
+
+        return name;
+    }
+
+    /**
+     * @brief Describes the components added so far with @p compression, and uploads their logs
+     */
+    void DiscoverAndUploadLogs(const char* compression)
+    {
+        JSON_Value* configValue = json_value_init_object();
+        JSON_Object* config = json_object(configValue);
+        JSON_Value* componentsValue = json_value_init_array();
+
+        for (const auto& component : _logs)
+        {
+            JSON_Value* componentValue = json_value_init_object();
+            json_object_set_string(json_object(componentValue), "componentName", component.first.c_str());
+            json_object_set_string(json_object(componentValue), "logPath", LogPath(component.first).c_str());
+            json_array_append_value(json_array(componentsValue), componentValue);
+        }
+
+        json_object_set_value(config, "logComponents", componentsValue);
+        json_object_set_number(config, "maxKilobytesToUploadPerLogPath", 1024);
+        json_object_set_string(config, "compression", compression);
+
+        const bool initialized = DiagnosticsConfigUtils_InitFromJSON(&_workflowData, configValue);
+        json_value_free(configValue);
+        REQUIRE(initialized);
+
+        const std::string request =
+            R"({"operationId":")" + operationId + R"(","storageSasUrl":")" + storageSasUrl + R"("})";
+        DiagnosticsWorkflow_DiscoverAndUploadLogs(&_workflowData, request.c_str());
+    }
+
+    /**
+     * @brief Checks that @p call uploaded all the logs of its component, as they are, from the component's log path
+     * @returns the name of the component
+     */
+    std::string CheckUncompressedUpload(const UploadCall& call) const
+    {
+        const std::string name = ComponentName(call);
+        CHECK(call.storageSasUrl == storageSasUrl);
+        CHECK(call.directoryPath == LogPath(name));
+        CHECK_FALSE(call.gzipped);
+        CHECK(call.files == _logs.at(name));
+        return name;
+    }
+
+    /**
+     * @brief Checks that @p call uploaded gzip compressed copies of all the logs of its component from the staging
+     * folder
+     * @returns the name of the component
+     */
+    std::string CheckCompressedUpload(const UploadCall& call) const
+    {
+        const std::string name = ComponentName(call);
+        CHECK(call.storageSasUrl == storageSasUrl);
+        CHECK(call.directoryPath.find(DIAGNOSTICS_STAGING_FOLDER "/") == 0);
+        CHECK(call.gzipped);
+
+        std::map<std::string, std::string> expected;
+        for (const auto& log : _logs.at(name))
+        {
+            expected[log.first + LOG_COMPRESSION_UTILS_GZIP_SUFFIX] = log.second;
+        }
+        CHECK(call.files == expected);
+        return name;
+    }
+
+    /**
+     * @brief Returns the virtual directory path that the logs of component @p name are uploaded to
+     */
+    static std::string VirtualDirectoryPath(const std::string& name)
+    {
+        return "device/" + operationId + "/" + name + "/";
+    }
+
+    size_t ComponentCount() const
+    {
+        return _logs.size();
+    }
+
+private:
+    std::string LogPath(const std::string& name) const
+    {
+        return _root + "/" + name;
+    }
+
+    std::string ComponentName(const UploadCall& call) const
+    {
+        for (const auto& component : _logs)
+        {
+            if (call.virtualDirectoryPath == VirtualDirectoryPath(component.first))
+            {
+                return component.first;
+            }
+        }
+
+        FAIL("Unexpected virtual directory path " << call.virtualDirectoryPath);
+        return "";
+    }
+
+    std::string _root;
+    std::map<std::string, std::map<std::string, std::string>> _logs;
+    DiagnosticsWorkflowData _workflowData = {};
+};
+} // namespace
+
+void DiagnosticsInterface_ReportStateAndResultAsync(const Diagnostics_Result result, const char* operationId)
+{
+    s_reportedResult = result;
+    s_reportedOperationId = operationId;
+}
+
+TEST_CASE_METHOD(DiagnosticsWorkflowFixture, "DiagnosticsWorkflow uploads log components on four threads")
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        AddComponent(2);
+    }
+    s_waitForConcurrentUploads = true;
+
+    DiscoverAndUploadLogs("none");
+
+    CHECK(s_reportedResult == Diagnostics_Result_Success);
+    CHECK(s_reportedOperationId == operationId);
+    CHECK(s_maxInFlight == maxConcurrentUploads);
+
+    std::set<std::string> uploaded;
+    for (const UploadCall& call : s_calls)
+    {
+        CHECK(uploaded.insert(CheckUncompressedUpload(call)).second);
+    }
+    CHECK(uploaded.size() == ComponentCount());
+}
+
+TEST_CASE_METHOD(DiagnosticsWorkflowFixture, "DiagnosticsWorkflow starts no upload after the first failure")
+{
+    for (int i = 0; i < 12; ++i)
+    {
+        AddComponent(1);
+    }
+
+    // c0 is started first and fails at once, while the uploads started alongside it are still running. Each thread
+    // then sees the failure and starts no other component.
+    s_failingVirtualDirectoryPath = VirtualDirectoryPath("c0");
+    s_uploadLatency = std::chrono::milliseconds{ 200 };
+
+    DiscoverAndUploadLogs("none");
+
+    CHECK(s_reportedResult == Diagnostics_Result_UploadFailed);
+    REQUIRE_FALSE(s_calls.empty());
+    CHECK(s_calls.size() <= maxConcurrentUploads);
+    CHECK(std::any_of(s_calls.begin(), s_calls.end(), [](const UploadCall& call) {
+        return call.virtualDirectoryPath == VirtualDirectoryPath("c0");
+    }));
+}
+
+TEST_CASE_METHOD(DiagnosticsWorkflowFixture, "DiagnosticsWorkflow uploads gzip compressed copies of the logs")
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        AddComponent(3);
+    }
+
+    DiscoverAndUploadLogs("gzip");
+
+    CHECK(s_reportedResult == Diagnostics_Result_Success);
+
+    std::set<std::string> uploaded;
+    std::set<std::string> stagingFolders;
+    for (const UploadCall& call : s_calls)
+    {
+        CHECK(uploaded.insert(CheckCompressedUpload(call)).second);
+        stagingFolders.insert(call.directoryPath);
+    }
+    CHECK(uploaded.size() == ComponentCount());
+
+    // Each component is staged in its own folder.
+    CHECK(stagingFolders.size() == ComponentCount());
+
+    CHECK_FALSE(SystemUtils_IsDir(DIAGNOSTICS_STAGING_FOLDER, nullptr));
+}
+
+TEST_CASE_METHOD(DiagnosticsWorkflowFixture, "DiagnosticsWorkflow removes the staging folder")
+{
+    SECTION("After a failed upload")
+    {
+        AddComponent(2);
+        AddComponent(2);
+        s_failingVirtualDirectoryPath = VirtualDirectoryPath("c1");
+
+        DiscoverAndUploadLogs("gzip");
+
+        CHECK(s_reportedResult == Diagnostics_Result_UploadFailed);
+        REQUIRE_FALSE(s_calls.empty());
+        for (const UploadCall& call : s_calls)
+        {
+            CheckCompressedUpload(call);
+        }
+    }
+
+    SECTION("After a component without logs")
+    {
+        AddComponent(2);
+        AddComponent(0);
+
+        DiscoverAndUploadLogs("gzip");
+
+        CHECK(s_reportedResult == Diagnostics_Result_NoLogsFound);
+        CHECK(s_calls.empty());
+    }
+
+    SECTION("Left behind by an interrupted upload")
+    {
+        const std::string staleFolder{ DIAGNOSTICS_STAGING_FOLDER "/0" };
+        REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(staleFolder.c_str()) == 0);
+        std::ofstream{ staleFolder + "/stale.log" LOG_COMPRESSION_UTILS_GZIP_SUFFIX } << "stale";
+
+        AddComponent(2);
+
+        DiscoverAndUploadLogs("gzip");
+
+        CHECK(s_reportedResult == Diagnostics_Result_Success);
+        REQUIRE(s_calls.size() == 1);
+        CheckCompressedUpload(s_calls.front());
+    }
+
+    CHECK_FALSE(SystemUtils_IsDir(DIAGNOSTICS_STAGING_FOLDER, nullptr));
+}
@@ -22,6 +22,15 @@ typedef struct tagDiagnosticLogComponent
     STRING_HANDLE logPath; //!< Absolute path to the directory where the logs are stored
 } DiagnosticsLogComponent;
 
+/**
+ * @brief How log files are compressed before they are uploaded
+ */
+typedef enum tagDiagnosticsCompression
+{
+    DiagnosticsCompression_None = 0, //!< Log files are uploaded as they are
+    DiagnosticsCompression_Gzip = 1, //!< Log files are uploaded as gzip compressed copies
+} DiagnosticsCompression;
+
 /**
  * @brief Data structure representing the data needed for the Diagnostics Workflow
  */
@@ -29,6 +38,7 @@ typedef struct tagDiagnosticWorkflowData
 {
     VECTOR_HANDLE components; //!< Vector of DiagnosticLogComponent pointers for which to collect logs
     unsigned int maxBytesToUploadPerLogPath; //!< The maximum number of bytes to upload per log file path
+    DiagnosticsCompression compression; //!< How log files are compressed; the limit above applies to the result
 } DiagnosticsWorkflowData;
 
 /**
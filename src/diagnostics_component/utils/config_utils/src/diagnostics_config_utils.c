@@ -10,6 +10,7 @@
 #include <aduc/logging.h>
 #include <parson_json_utils.h> // for ADUC_JSON_GetUnsignedIntegerField
 #include <stdlib.h> // for free
+#include <string.h> // for strcmp
 
 /**
  * @brief Fieldname for the array of log components in the Diagnostics JSON Config File
@@ -31,6 +32,21 @@
  */
 #define DIAGNOSTICS_CONFIG_FILE_FIELDNAME_MAXKILOBYTESTOUPLOADPERLOGPATH "maxKilobytesToUploadPerLogPath"
 
+/**
+ * @brief Optional fieldname for how log files are compressed before they are uploaded
+ */
+#define DIAGNOSTICS_CONFIG_FILE_FIELDNAME_COMPRESSION "compression"
+
+/**
+ * @brief Value of the compression field selecting gzip compression
+ */
+#define DIAGNOSTICS_CONFIG_FILE_COMPRESSION_GZIP "gzip"
+
+/**
+ * @brief Value of the compression field selecting no compression
+ */
+#define DIAGNOSTICS_CONFIG_FILE_COMPRESSION_NONE "none"
+
 /**
  * @brief Maximum number of kilobytes allowed to be uploaded per log path
  */
@@ -50,8 +66,10 @@
             },
             ...
         ],
-        "maxKilobytesToUploadPerLogPath":5
+        "maxKilobytesToUploadPerLogPath":5,
+        "compression":"gzip"
     }
+ * "compression" is optional, and is one of "none" (the default) or "gzip".
  */
 
 /**
@@ -164,6 +182,23 @@ bool DiagnosticsConfigUtils_InitFromJSON(DiagnosticsWorkflowData* workflowData,
 
     workflowData->maxBytesToUploadPerLogPath = maxKilobytesToUploadPerLogPath * 1024;
 
+    const char* compression = json_object_get_string(fileJsonObj, DIAGNOSTICS_CONFIG_FILE_FIELDNAME_COMPRESSION);
+
+    if (compression == NULL || strcmp(compression, DIAGNOSTICS_CONFIG_FILE_COMPRESSION_NONE) == 0)
+    {
+        workflowData->compression = DiagnosticsCompression_None;
+    }
+    else if (strcmp(compression, DIAGNOSTICS_CONFIG_FILE_COMPRESSION_GZIP) == 0)
+    {
+        workflowData->compression = DiagnosticsCompression_Gzip;
+    }
+    else
+    {
+        // Uncompressed logs are still useful, so an unknown value does not fail the whole configuration.
+        Log_Warn("DiagnosticsConfigUtils_Init unsupported compression '%s', logs are not compressed", compression);
+        workflowData->compression = DiagnosticsCompression_None;
+    }
+
     JSON_Array* componentArray = json_object_get_array(fileJsonObj, DIAGNOSTICS_CONFIG_FILE_LOG_COMPONENTS_FIELDNAME);
 
     if (componentArray == NULL)
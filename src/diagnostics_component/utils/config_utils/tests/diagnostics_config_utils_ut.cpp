@@ -90,6 +90,7 @@ TEST_CASE("DiagnosticsConfigUtils_Init")
         CHECK(strcmp(STRING_c_str(secondLogComponent->logPath), "/var/cache/do/") == 0);
 
         CHECK(testHelper.workflowData.maxBytesToUploadPerLogPath == (maxKilobytesToUploadPerLogPath * 1024));
+        CHECK(testHelper.workflowData.compression == DiagnosticsCompression_None);
     }
 
     SECTION("DiagnosticsConfigUtils_Init- No logComponents")
@@ -130,4 +131,30 @@ TEST_CASE("DiagnosticsConfigUtils_Init")
 
         CHECK(testHelper.workflowData.components == nullptr);
     }
+
+    SECTION("DiagnosticsConfigUtils_Init- Compression")
+    {
+        const std::string compression = GENERATE(as<std::string>{}, "gzip", "none", "lz4");
+
+        // clang-format off
+        const std::string compressionConfig = R"({)"
+                                                R"("logComponents":[)"
+                                                    R"({)"
+                                                        R"("componentName":"DU",)"
+                                                        R"("logPath":"/var/logs/adu/")"
+                                                    R"(})"
+                                                R"(],)"
+                                                R"("maxKilobytesToUploadPerLogPath":5,)"
+                                                R"("compression":")" + compression + R"(")"
+                                            R"(})";
+        // clang-format on
+
+        DiagnosticConfigUtilsUnitTestHelper testHelper(compressionConfig.c_str());
+
+        // An unsupported compression falls back to uncompressed logs.
+        REQUIRE(DiagnosticsConfigUtils_InitFromJSON(&testHelper.workflowData, testHelper.jsonValue));
+        CHECK(
+            testHelper.workflowData.compression
+            == (compression == "gzip" ? DiagnosticsCompression_Gzip : DiagnosticsCompression_None));
+    }
 }
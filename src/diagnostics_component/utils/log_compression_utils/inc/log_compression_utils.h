@@ -0,0 +1,43 @@
+/**
+ * @file log_compression_utils.h
+ * @brief Header file for utilities compressing log files before they are uploaded
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef LOG_COMPRESSION_UTILS_H
+#define LOG_COMPRESSION_UTILS_H
+
+#include <aduc/c_utils.h>
+#include <azure_c_shared_utility/vector.h>
+#include <stdbool.h>
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Suffix of the gzip compressed copy of a log file
+ */
+#define LOG_COMPRESSION_UTILS_GZIP_SUFFIX ".gz"
+
+/**
+ * @brief Result of compressing a single log file
+ */
+typedef enum tagLogCompressionUtils_Result
+{
+    LogCompressionUtils_Result_Failure = 0, //!< The file could not be read or the compressed copy written
+    LogCompressionUtils_Result_Success = 1, //!< The compressed copy was written
+    LogCompressionUtils_Result_TooLarge = 2, //!< The compressed copy would be larger than allowed, and was removed
+} LogCompressionUtils_Result;
+
+LogCompressionUtils_Result LogCompressionUtils_GzipFile(
+    const char* srcFilePath, const char* destFilePath, unsigned long maxCompressedSize, unsigned long* compressedSize);
+
+bool LogCompressionUtils_GzipNewestFilesInDirUnderSize(
+    VECTOR_HANDLE* fileNameVector,
+    const char* directoryPath,
+    const char* stagingPath,
+    const unsigned int maxCompressedSize);
+
+EXTERN_C_END
+
+#endif // LOG_COMPRESSION_UTILS_H
@@ -0,0 +1,321 @@
+/**
+ * @file log_compression_utils.c
+ * @brief Implementation file for utilities compressing log files before they are uploaded
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "log_compression_utils.h"
+
+#include <aduc/logging.h>
+#include <azure_c_shared_utility/strings.h>
+#include <file_info_utils.h>
+#include <limits.h> // for UINT_MAX
+#include <stdio.h>
+#include <stdlib.h> // for malloc, free
+#include <zlib.h>
+
+/**
+ * @brief Number of bytes read from a log file, and written to its compressed copy, at a time
+ */
+#define LOG_COMPRESSION_UTILS_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief deflateInit2 windowBits selecting the largest window with a gzip header and trailer
+ */
+#define LOG_COMPRESSION_UTILS_GZIP_WINDOW_BITS (15 + 16)
+
+/**
+ * @brief Writes a gzip compressed copy of @p srcFilePath to @p destFilePath, a chunk at a time
+ * @details Stops as soon as the output grows past @p maxCompressedSize, so a log that cannot fit is not compressed
+ * in full
+ * @param srcFilePath path to the file to compress
+ * @param destFilePath path to the compressed copy to be created or replaced
+ * @param maxCompressedSize the maximum size of the compressed copy in bytes
+ * @param[out] compressedSize the size of the compressed copy in bytes
+ * @returns LogCompressionUtils_Result_Success when the copy was written; on any other result @p destFilePath is
+ * removed
+ */
+LogCompressionUtils_Result LogCompressionUtils_GzipFile(
+    const char* srcFilePath, const char* destFilePath, unsigned long maxCompressedSize, unsigned long* compressedSize)
+{
+    LogCompressionUtils_Result result = LogCompressionUtils_Result_Failure;
+
+    FILE* src = NULL;
+    FILE* dest = NULL;
+    bool streamInitialized = false;
+    z_stream stream = {};
+    unsigned char* in = NULL;
+    unsigned char* out = NULL;
+    unsigned long written = 0;
+
+    if (srcFilePath == NULL || destFilePath == NULL || compressedSize == NULL)
+    {
+        return LogCompressionUtils_Result_Failure;
+    }
+
+    *compressedSize = 0;
+
+    in = malloc(LOG_COMPRESSION_UTILS_CHUNK_SIZE);
+    out = malloc(LOG_COMPRESSION_UTILS_CHUNK_SIZE);
+
+    if (in == NULL || out == NULL)
+    {
+        goto done;
+    }
+
+    src = fopen(srcFilePath, "rb");
+
+    if (src == NULL)
+    {
+        Log_Warn("LogCompressionUtils_GzipFile cannot open %s", srcFilePath);
+        goto done;
+    }
+
+    dest = fopen(destFilePath, "wb");
+
+    if (dest == NULL)
+    {
+        Log_Warn("LogCompressionUtils_GzipFile cannot create %s", destFilePath);
+        goto done;
+    }
+
+    if (deflateInit2(
+            &stream,
+            Z_DEFAULT_COMPRESSION,
+            Z_DEFLATED,
+            LOG_COMPRESSION_UTILS_GZIP_WINDOW_BITS,
+            8 /* memLevel */,
+            Z_DEFAULT_STRATEGY)
+        != Z_OK)
+    {
+        goto done;
+    }
+
+    streamInitialized = true;
+
+    int flush = Z_NO_FLUSH;
+    do
+    {
+        stream.avail_in = fread(in, 1, LOG_COMPRESSION_UTILS_CHUNK_SIZE, src);
+
+        if (ferror(src))
+        {
+            goto done;
+        }
+
+        flush = feof(src) ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = in;
+
+        do
+        {
+            stream.avail_out = LOG_COMPRESSION_UTILS_CHUNK_SIZE;
+            stream.next_out = out;
+
+            // Z_STREAM_ERROR is the only error possible here, and only with a corrupt stream state.
+            if (deflate(&stream, flush) == Z_STREAM_ERROR)
+            {
+                goto done;
+            }
+
+            const size_t have = LOG_COMPRESSION_UTILS_CHUNK_SIZE - stream.avail_out;
+
+            written += have;
+
+            if (written > maxCompressedSize)
+            {
+                result = LogCompressionUtils_Result_TooLarge;
+                goto done;
+            }
+
+            if (fwrite(out, 1, have, dest) != have)
+            {
+                goto done;
+            }
+        } while (stream.avail_out == 0);
+    } while (flush != Z_FINISH);
+
+    if (fclose(dest) != 0)
+    {
+        dest = NULL;
+        goto done;
+    }
+
+    dest = NULL;
+
+    *compressedSize = written;
+    result = LogCompressionUtils_Result_Success;
+
+done:
+
+    if (streamInitialized)
+    {
+        deflateEnd(&stream);
+    }
+
+    if (src != NULL)
+    {
+        fclose(src);
+    }
+
+    if (dest != NULL)
+    {
+        fclose(dest);
+    }
+
+    if (result != LogCompressionUtils_Result_Success && destFilePath != NULL)
+    {
+        (void)remove(destFilePath);
+    }
+
+    free(in);
+    free(out);
+
+    return result;
+}
+
+/**
+ * @brief Frees the STRING_HANDLEs held in @p fileNameVector and then the vector itself
+ * @param fileNameVector a vector of STRING_HANDLE, may be NULL
+ */
+static void LogCompressionUtils_DestroyFileNameVector(VECTOR_HANDLE fileNameVector)
+{
+    if (fileNameVector == NULL)
+    {
+        return;
+    }
+
+    const size_t fileNameVectorSize = VECTOR_size(fileNameVector);
+
+    for (size_t i = 0; i < fileNameVectorSize; ++i)
+    {
+        STRING_HANDLE* elem = (STRING_HANDLE*)VECTOR_element(fileNameVector, i);
+        STRING_delete(*elem);
+    }
+
+    VECTOR_destroy(fileNameVector);
+}
+
+/**
+ * @brief Writes gzip compressed copies of the newest files in @p directoryPath to @p stagingPath, newest first,
+ * for as long as their total compressed size stays within @p maxCompressedSize
+ * @details Considers the same files as FileInfoUtils_GetNewestFilesInDirUnderSize, but applies the size limit to the
+ * compressed copies, so more of the log history fits in the same number of uploaded bytes
+ * @param[out] fileNameVector a pointer to a VECTOR_HANDLE of STRING_HANDLEs to be populated with the names of the
+ * compressed copies in @p stagingPath - up to the caller to free with Vector_destroy()
+ * @param[in] directoryPath path to the directory to scan
+ * @param[in] stagingPath path to an existing directory to hold the compressed copies
+ * @param[in] maxCompressedSize the maximum total size of the compressed copies in bytes
+ * @returns true if at least the newest file fits once compressed; false otherwise
+ */
+bool LogCompressionUtils_GzipNewestFilesInDirUnderSize(
+    VECTOR_HANDLE* fileNameVector,
+    const char* directoryPath,
+    const char* stagingPath,
+    const unsigned int maxCompressedSize)
+{
+    bool succeeded = false;
+
+    VECTOR_HANDLE candidateFileNames = NULL;
+    VECTOR_HANDLE fileVector = NULL;
+    STRING_HANDLE srcFilePath = NULL;
+    STRING_HANDLE destFilePath = NULL;
+    STRING_HANDLE compressedFileName = NULL;
+
+    if (fileNameVector == NULL || directoryPath == NULL || stagingPath == NULL || maxCompressedSize == 0)
+    {
+        goto done;
+    }
+
+    // The size limit is applied below, once the compressed sizes are known.
+    if (!FileInfoUtils_GetNewestFilesInDirUnderSize(&candidateFileNames, directoryPath, UINT_MAX))
+    {
+        goto done;
+    }
+
+    fileVector = VECTOR_create(sizeof(STRING_HANDLE));
+
+    srcFilePath = STRING_new();
+    destFilePath = STRING_new();
+
+    if (fileVector == NULL || srcFilePath == NULL || destFilePath == NULL)
+    {
+        goto done;
+    }
+
+    unsigned long totalCompressedSize = 0;
+    const size_t candidateCount = VECTOR_size(candidateFileNames);
+
+    for (size_t i = 0; i < candidateCount; ++i)
+    {
+        const char* candidateFileName = STRING_c_str(*(STRING_HANDLE*)VECTOR_element(candidateFileNames, i));
+
+        compressedFileName = STRING_construct_sprintf("%s%s", candidateFileName, LOG_COMPRESSION_UTILS_GZIP_SUFFIX);
+
+        if (compressedFileName == NULL
+            || STRING_sprintf(srcFilePath, "%s/%s", directoryPath, candidateFileName) != 0
+            || STRING_sprintf(destFilePath, "%s/%s", stagingPath, STRING_c_str(compressedFileName)) != 0)
+        {
+            goto done;
+        }
+
+        unsigned long compressedSize = 0;
+        const LogCompressionUtils_Result result = LogCompressionUtils_GzipFile(
+            STRING_c_str(srcFilePath),
+            STRING_c_str(destFilePath),
+            maxCompressedSize - totalCompressedSize,
+            &compressedSize);
+
+        // STRING_sprintf appends, so start each path over.
+        STRING_empty(srcFilePath);
+        STRING_empty(destFilePath);
+
+        if (result == LogCompressionUtils_Result_TooLarge)
+        {
+            break;
+        }
+
+        if (result != LogCompressionUtils_Result_Success)
+        {
+            goto done;
+        }
+
+        if (VECTOR_push_back(fileVector, &compressedFileName, 1) != 0)
+        {
+            goto done;
+        }
+
+        compressedFileName = NULL;
+        totalCompressedSize += compressedSize;
+    }
+
+    if (VECTOR_size(fileVector) == 0)
+    {
+        Log_Warn("Newest log file in %s exceeds %u bytes when compressed", directoryPath, maxCompressedSize);
+        goto done;
+    }
+
+    succeeded = true;
+
+done:
+
+    STRING_delete(compressedFileName);
+    STRING_delete(srcFilePath);
+    STRING_delete(destFilePath);
+
+    LogCompressionUtils_DestroyFileNameVector(candidateFileNames);
+
+    if (!succeeded)
+    {
+        LogCompressionUtils_DestroyFileNameVector(fileVector);
+        fileVector = NULL;
+    }
+
+    if (fileNameVector != NULL)
+    {
+        *fileNameVector = fileVector;
+    }
+
+    return succeeded;
+}
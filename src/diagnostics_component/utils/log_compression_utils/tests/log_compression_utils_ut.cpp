@@ -0,0 +1,231 @@
+/**
+ * @file log_compression_utils_ut.cpp
+ * @brief Unit Tests for log_compression_utils library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "log_compression_utils.h"
+
+#include <azure_c_shared_utility/strings.h>
+#include <azure_c_shared_utility/vector.h>
+#include <catch2/catch.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+/**
+ * @brief A log directory and a staging directory, removed with their files on destruction.
+ */
+class LogDirs
+{
+public:
+    LogDirs(const LogDirs&) = delete;
+    LogDirs& operator=(const LogDirs&) = delete;
+    LogDirs(LogDirs&&) = delete;
+    LogDirs& operator=(LogDirs&&) = delete;
+
+    LogDirs()
+    {
+        char logTemplate[] = "/tmp/logcompressXXXXXX";
+        char stagingTemplate[] = "/tmp/logstagingXXXXXX";
+        REQUIRE(mkdtemp(logTemplate) != nullptr);
+        REQUIRE(mkdtemp(stagingTemplate) != nullptr);
+        _logDir = logTemplate;
+        _stagingDir = stagingTemplate;
+    }
+
+    ~LogDirs()
+    {
+        for (const std::string& path : _files)
+        {
+            (void)unlink(path.c_str());
+        }
+        rmdir(_logDir.c_str());
+        rmdir(_stagingDir.c_str());
+    }
+
+    const std::string& LogDir() const
+    {
+        return _logDir;
+    }
+
+    const std::string& StagingDir() const
+    {
+        return _stagingDir;
+    }
+
+    /**
+     * @brief Writes a log file @p ageSeconds old.
+     */
+    std::string WriteLog(const std::string& name, const std::string& content, time_t ageSeconds)
+    {
+        const std::string path = _logDir + "/" + name;
+        {
+            std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+            file << content;
+        }
+
+        const time_t when = time(nullptr) - ageSeconds;
+        struct utimbuf times = { when, when };
+        REQUIRE(utime(path.c_str(), &times) == 0);
+
+        _files.push_back(path);
+        _files.push_back(_stagingDir + "/" + name + LOG_COMPRESSION_UTILS_GZIP_SUFFIX);
+        return path;
+    }
+
+private:
+    std::string _logDir;
+    std::string _stagingDir;
+    std::vector<std::string> _files;
+};
+
+/**
+ * @brief Returns @p count lines of typical, very compressible, log text.
+ */
+std::string MakeLogText(int count)
+{
+    std::ostringstream text;
+    for (int i = 0; i < count; ++i)
+    {
+        text << "2022-01-27T13:45:05.899Z [I] Processing update action " << (i % 7) << " for workflow 1234\n";
+    }
+    return text.str();
+}
+
+/**
+ * @brief Returns the decompressed content of the gzip file at @p path.
+ */
+std::string Gunzip(const std::string& path)
+{
+    std::string content;
+    gzFile file = gzopen(path.c_str(), "rb");
+    REQUIRE(file != nullptr);
+
+    char buffer[4096];
+    int read = 0;
+    while ((read = gzread(file, buffer, sizeof(buffer))) > 0)
+    {
+        content.append(buffer, static_cast<size_t>(read));
+    }
+
+    gzclose(file);
+    return content;
+}
+
+/**
+ * @brief Returns the names held in @p fileNames, and frees it.
+ */
+std::vector<std::string> TakeFileNames(VECTOR_HANDLE fileNames)
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < VECTOR_size(fileNames); ++i)
+    {
+        STRING_HANDLE* name = static_cast<STRING_HANDLE*>(VECTOR_element(fileNames, i));
+        names.emplace_back(STRING_c_str(*name));
+        STRING_delete(*name);
+    }
+    VECTOR_destroy(fileNames);
+    return names;
+}
+} // namespace
+
+TEST_CASE("LogCompressionUtils_GzipFile")
+{
+    LogDirs dirs;
+    const std::string content = MakeLogText(2000);
+    const std::string srcPath = dirs.WriteLog("du-agent.log", content, 0);
+    const std::string destPath = dirs.StagingDir() + "/du-agent.log" + LOG_COMPRESSION_UTILS_GZIP_SUFFIX;
+
+    SECTION("Compressed copy holds the file")
+    {
+        unsigned long compressedSize = 0;
+        REQUIRE(
+            LogCompressionUtils_GzipFile(srcPath.c_str(), destPath.c_str(), content.size(), &compressedSize)
+            == LogCompressionUtils_Result_Success);
+
+        struct stat st = {};
+        REQUIRE(stat(destPath.c_str(), &st) == 0);
+        CHECK(static_cast<unsigned long>(st.st_size) == compressedSize);
+        CHECK(compressedSize < content.size() / 10);
+        CHECK(Gunzip(destPath) == content);
+    }
+
+    SECTION("Copy larger than allowed is removed")
+    {
+        unsigned long compressedSize = 0;
+        CHECK(
+            LogCompressionUtils_GzipFile(srcPath.c_str(), destPath.c_str(), 16, &compressedSize)
+            == LogCompressionUtils_Result_TooLarge);
+        CHECK(access(destPath.c_str(), F_OK) != 0);
+    }
+
+    SECTION("Missing file")
+    {
+        unsigned long compressedSize = 0;
+        CHECK(
+            LogCompressionUtils_GzipFile((srcPath + ".missing").c_str(), destPath.c_str(), 1024, &compressedSize)
+            == LogCompressionUtils_Result_Failure);
+    }
+}
+
+TEST_CASE("LogCompressionUtils_GzipNewestFilesInDirUnderSize")
+{
+    LogDirs dirs;
+    const std::string content = MakeLogText(2000);
+    dirs.WriteLog("du-agent.log", content, 10);
+    dirs.WriteLog("du-agent.log.1", content, 20);
+    dirs.WriteLog("du-agent.log.2", content, 30);
+
+    unsigned long compressedSize = 0;
+    const std::string probePath = dirs.StagingDir() + "/probe" + LOG_COMPRESSION_UTILS_GZIP_SUFFIX;
+    REQUIRE(
+        LogCompressionUtils_GzipFile(
+            (dirs.LogDir() + "/du-agent.log").c_str(), probePath.c_str(), content.size(), &compressedSize)
+        == LogCompressionUtils_Result_Success);
+    (void)unlink(probePath.c_str());
+
+    SECTION("Limit applies to the compressed size")
+    {
+        // All three files fit once compressed, though one alone is larger than the limit.
+        const auto limit = static_cast<unsigned int>(3 * compressedSize);
+        REQUIRE(content.size() > limit);
+
+        VECTOR_HANDLE fileNames = nullptr;
+        REQUIRE(LogCompressionUtils_GzipNewestFilesInDirUnderSize(
+            &fileNames, dirs.LogDir().c_str(), dirs.StagingDir().c_str(), limit));
+
+        const std::vector<std::string> names = TakeFileNames(fileNames);
+        CHECK(names == std::vector<std::string>{ "du-agent.log.gz", "du-agent.log.1.gz", "du-agent.log.2.gz" });
+        CHECK(Gunzip(dirs.StagingDir() + "/du-agent.log.2.gz") == content);
+    }
+
+    SECTION("Newest files are kept up to the limit")
+    {
+        VECTOR_HANDLE fileNames = nullptr;
+        REQUIRE(LogCompressionUtils_GzipNewestFilesInDirUnderSize(
+            &fileNames,
+            dirs.LogDir().c_str(),
+            dirs.StagingDir().c_str(),
+            static_cast<unsigned int>(2 * compressedSize + compressedSize / 2)));
+
+        CHECK(TakeFileNames(fileNames) == std::vector<std::string>{ "du-agent.log.gz", "du-agent.log.1.gz" });
+        CHECK(access((dirs.StagingDir() + "/du-agent.log.2.gz").c_str(), F_OK) != 0);
+    }
+
+    SECTION("Newest file alone is too large")
+    {
+        VECTOR_HANDLE fileNames = nullptr;
+        CHECK_FALSE(LogCompressionUtils_GzipNewestFilesInDirUnderSize(
+            &fileNames, dirs.LogDir().c_str(), dirs.StagingDir().c_str(), 16));
+        CHECK(fileNames == nullptr);
+    }
+}
@@ -9,7 +9,7 @@
 #include "curl_content_downloader.h" // for Download_curl
 #include <aduc/c_utils.h> // for EXTERN_C_BEGIN, EXTERN_C_END
 #include <aduc/contract_utils.h> // for ADUC_ExtensionContractInfo
-#include <aduc/types/download.h> // for ADUC_DownloadProgressCallback
+#include <aduc/types/download.h> // for ADUC_DownloadProgressCallback, ADUC_DownloadDataSink
 #include <aduc/types/update_content.h> // for ADUC_FileEntity
 
 EXTERN_C_BEGIN
@@ -31,10 +31,21 @@ ADUC_Result Download(
     return Download_curl(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
 }
 
+ADUC_Result DownloadV2(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    const ADUC_DownloadDataSink* dataSink)
+{
+    return Download_curl_V2(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback, dataSink);
+}
+
 ADUC_Result Initialize(const char* initializeData)
 {
     UNREFERENCED_PARAMETER(initializeData);
-    return { ADUC_GeneralResult_Success };
+    return Initialize_curl();
 }
 
 /**
@@ -45,8 +56,8 @@ ADUC_Result Initialize(const char* initializeData)
  */
 ADUC_Result GetContractInfo(ADUC_ExtensionContractInfo* contractInfo)
 {
-    contractInfo->majorVer = ADUC_V1_CONTRACT_MAJOR_VER;
-    contractInfo->minorVer = ADUC_V1_CONTRACT_MINOR_VER;
+    contractInfo->majorVer = ADUC_V2_CONTRACT_MAJOR_VER;
+    contractInfo->minorVer = ADUC_V2_CONTRACT_MINOR_VER;
     return ADUC_Result{ ADUC_GeneralResult_Success, 0 };
 }
 
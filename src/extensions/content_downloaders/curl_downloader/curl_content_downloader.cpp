@@ -1,20 +1,1374 @@
 /**
  * @file curl_content_downloader.cpp
- * @brief Content Downloader Extension using curl command.
+ * @brief Content Downloader Extension using libcurl.
  *
  * @copyright Copyright (c) Microsoft Corporation.
  * Licensed under the MIT License.
  */
 
+#include "curl_content_downloader.h"
+
+#include "aduc/config_utils.h"
 #include "aduc/content_downloader_extension.hpp"
 #include "aduc/contract_utils.h"
 #include "aduc/hash_utils.h"
 #include "aduc/logging.h"
-#include "aduc/process_utils.hpp" // for ADUC_LaunchChildProcess
+#include "aduc/verified_hash_cache.h"
+
+#include <algorithm> // for std::min
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring> // for strerror
+#include <fcntl.h> // for open
+#include <fstream>
+#include <memory> // for std::unique_ptr
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <strings.h> // for strncasecmp
+#include <sys/stat.h> // for fstat
+#include <thread>
+#include <unistd.h> // for pread, pwrite, write, ftruncate
+#include <utility> // for std::move
+#include <vector>
+
+#include <curl/curl.h>
+
+/**
+ * @brief The number of idle libcurl handles kept, with their open connections, for the next downloads.
+ */
+#define CURL_DOWNLOADER_MAX_IDLE_HANDLES 8
+
+/**
+ * @brief Abort a transfer that stays below 1 byte/s for this many seconds; it is then retried.
+ */
+#define CURL_DOWNLOADER_LOW_SPEED_TIME_SECONDS 60
+
+/**
+ * @brief The delay before the first retry. It doubles with each retry, up to the maximum.
+ */
+#define CURL_DOWNLOADER_INITIAL_RETRY_DELAY_SECONDS 2
+#define CURL_DOWNLOADER_MAX_RETRY_DELAY_SECONDS 60
+
+/**
+ * @brief Sets a libcurl option on the local @c curl handle, unless an earlier option of the local @c code failed.
+ */
+#define SET_OPTION(option, value)                     \
+    if (code == CURLE_OK)                             \
+    {                                                 \
+        code = curl_easy_setopt(curl, option, value); \
+    }
+
+/**
+ * @brief How often in-progress download progress is reported.
+ */
+#define CURL_DOWNLOADER_PROGRESS_INTERVAL_MS 1000
+
+/**
+ * @brief The most byte ranges a payload is downloaded in at once.
+ */
+#define CURL_DOWNLOADER_MAX_SEGMENTS 16
+
+/**
+ * @brief A payload is split into segments no smaller than this; smaller payloads are downloaded as a single stream.
+ */
+#define CURL_DOWNLOADER_MIN_SEGMENT_SIZE (16 * 1024 * 1024)
+
+/**
+ * @brief Idle libcurl handles. A handle keeps its connection cache when it is reset, so the payloads of a workflow,
+ * which usually come from the same host, reuse a kept-alive connection.
+ */
+static std::mutex s_idleHandlesMutex;
+static std::vector<CURL*> s_idleHandles;
+
+/**
+ * @brief The number of byte ranges to download a large payload in, from du-config.json, and the smallest range.
+ */
+static std::atomic<unsigned int> s_segmentCount{ ADUC_CONFIG_DEFAULT_DOWNLOAD_SEGMENT_COUNT };
+static std::atomic<uint64_t> s_minSegmentSize{ CURL_DOWNLOADER_MIN_SEGMENT_SIZE };
+
+/**
+ * @brief Initializes libcurl once per process.
+ * @return bool true if libcurl is usable.
+ */
+static bool EnsureCurlGlobalInit()
+{
+    static std::once_flag initOnce;
+    static CURLcode initResult = CURLE_FAILED_INIT;
+
+    std::call_once(initOnce, []() {
+        initResult = curl_global_init(CURL_GLOBAL_DEFAULT);
+        if (initResult != CURLE_OK)
+        {
+            Log_Error("curl_global_init failed: %s", curl_easy_strerror(initResult));
+        }
+    });
+
+    return initResult == CURLE_OK;
+}
+
+/**
+ * @brief Takes an idle libcurl handle, or creates one.
+ * @return CURL* The handle, or nullptr on failure.
+ */
+static CURL* AcquireCurlHandle()
+{
+    if (!EnsureCurlGlobalInit())
+    {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ s_idleHandlesMutex };
+        if (!s_idleHandles.empty())
+        {
+            CURL* curl = s_idleHandles.back();
+            s_idleHandles.pop_back();
+            return curl;
+        }
+    }
+
+    return curl_easy_init();
+}
+
+/**
+ * @brief Returns a handle so that its connections can be reused.
+ * @param curl The handle.
+ */
+static void ReleaseCurlHandle(CURL* curl)
+{
+    if (curl == nullptr)
+    {
+        return;
+    }
+
+    // Clears all options, but keeps open connections and the DNS and TLS session caches.
+    curl_easy_reset(curl);
+
+    {
+        std::lock_guard<std::mutex> lock{ s_idleHandlesMutex };
+        if (s_idleHandles.size() < CURL_DOWNLOADER_MAX_IDLE_HANDLES)
+        {
+            s_idleHandles.push_back(curl);
+            return;
+        }
+    }
+
+    curl_easy_cleanup(curl);
+}
+
+/**
+ * @brief Reads the validator (ETag or Last-Modified) of the content held by a partial download.
+ * @param resumeFilePath The resume file path.
+ * @return std::string The validator, or empty if the partial download cannot be resumed.
+ */
+static std::string ReadResumeValidator(const std::string& resumeFilePath)
+{
+    std::ifstream file{ resumeFilePath };
+    std::string validator;
+    std::getline(file, validator);
+    return validator;
+}
+
+/**
+ * @brief Records the validator of the content being downloaded, so that an interrupted download can be resumed.
+ * @param resumeFilePath The resume file path.
+ * @param validator The validator. If empty, the resume file is removed instead.
+ */
+static void WriteResumeValidator(const std::string& resumeFilePath, const std::string& validator)
+{
+    if (validator.empty())
+    {
+        unlink(resumeFilePath.c_str());
+        return;
+    }
+
+    std::ofstream file{ resumeFilePath, std::ios::trunc };
+    file << validator << "\n";
+}
+
+/**
+ * @brief Writes all of @p length bytes to @p fd, retrying on short writes.
+ * @return bool true on success.
+ */
+static bool WriteAll(int fd, const uint8_t* data, size_t length)
+{
+    while (length > 0)
+    {
+        const ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the value of an HTTP header line if it is the header @p name.
+ * @param line The header line, without the line ending.
+ * @param name The header name, without the colon.
+ * @param[out] value The trimmed value.
+ * @return bool true if @p line is the header @p name.
+ */
+static bool ParseHeader(const std::string& line, const char* name, std::string* value)
+{
+    const size_t nameLength = strlen(name);
+    if (line.size() <= nameLength || line[nameLength] != ':' || strncasecmp(line.c_str(), name, nameLength) != 0)
+    {
+        return false;
+    }
+
+    const size_t begin = line.find_first_not_of(" \t", nameLength + 1);
+    *value = (begin == std::string::npos) ? std::string{} : line.substr(begin);
+    return true;
+}
+
+/**
+ * @brief The state of one file download, shared with the libcurl callbacks.
+ */
+struct CurlTransfer
+{
+    CurlTransfer(
+        CURL* curlIn,
+        int fdIn,
+        const ADUC_FileEntity* entityIn,
+        const char* workflowIdIn,
+        ADUC_DownloadProgressCallback progressCallbackIn,
+        const ADUC_DownloadDataSink* dataSinkIn,
+        std::string resumeFilePathIn) :
+        curl(curlIn), fd(fdIn), entity(entityIn), workflowId(workflowIdIn), progressCallback(progressCallbackIn),
+        dataSink(dataSinkIn), resumeFilePath(std::move(resumeFilePathIn))
+    {
+    }
+
+    CURL* curl;
+    int fd; /**< The target file, positioned at offset. */
+    const ADUC_FileEntity* entity;
+    const char* workflowId;
+    ADUC_DownloadProgressCallback progressCallback;
+    const ADUC_DownloadDataSink* dataSink; /**< May be nullptr. */
+    std::string resumeFilePath;
+
+    uint64_t offset = 0; /**< The number of payload bytes in the target file. */
+    bool sinkHasFileContent = false; /**< Whether dataSink has seen bytes [0, offset). */
+    std::string validator; /**< The ETag or Last-Modified of the content in the target file. */
+
+    // Per-response state, reset when a response (including a redirect) begins.
+    bool responseStarted = false;
+    std::string responseEtag;
+    std::string responseLastModified;
+    std::string responseContentRange;
+
+    ADUC_Result_t writeErc = 0; /**< Why the write callback aborted the transfer. */
+    std::chrono::steady_clock::time_point lastProgressReport;
+};
+
+/**
+ * @brief Feeds the part of the payload already on disk to the data sink, before a resumed transfer appends to it.
+ * @param transfer The transfer.
+ * @return bool true on success.
+ */
+static bool FeedFileContentToSink(CurlTransfer* transfer)
+{
+    if (transfer->dataSink->reset != nullptr)
+    {
+        transfer->dataSink->reset(transfer->dataSink->context);
+    }
+
+    std::vector<uint8_t> buffer(1024 * 1024);
+    for (uint64_t position = 0; position < transfer->offset;)
+    {
+        const size_t toRead = static_cast<size_t>(std::min<uint64_t>(buffer.size(), transfer->offset - position));
+        const ssize_t count = pread(transfer->fd, buffer.data(), toRead, static_cast<off_t>(position));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            Log_Error("Cannot read partial download. %s (errno %d).", strerror(errno), errno);
+            transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE;
+            return false;
+        }
+
+        if (!transfer->dataSink->write(transfer->dataSink->context, buffer.data(), static_cast<size_t>(count)))
+        {
+            transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED;
+            return false;
+        }
+
+        position += static_cast<uint64_t>(count);
+    }
+
+    transfer->sinkHasFileContent = true;
+    return true;
+}
+
+/**
+ * @brief Prepares the target file for the body of the current response.
+ * @details A 206 response continues the file at offset. Any other response is the whole payload, so the file (and
+ * the data sink) start over.
+ *
+ * @param transfer The transfer.
+ * @return bool true to accept the body.
+ */
+static bool BeginResponseBody(CurlTransfer* transfer)
+{
+    long httpStatus = 0;
+    curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &httpStatus);
+
+    if (httpStatus == 206)
+    {
+        // "Content-Range: bytes <first>-<last>/<length>"
+        unsigned long long first = 0;
+        if (sscanf(transfer->responseContentRange.c_str(), "bytes %llu-", &first) != 1 || first != transfer->offset)
+        {
+            Log_Error(
+                "Range response '%s' does not continue at byte %llu.",
+                transfer->responseContentRange.c_str(),
+                static_cast<unsigned long long>(transfer->offset));
+            transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_RESUME_MISMATCH;
+            return false;
+        }
+
+        Log_Info("Resuming '%s' at byte %llu.", transfer->entity->FileId, first);
+
+        return transfer->dataSink == nullptr || transfer->sinkHasFileContent || FeedFileContentToSink(transfer);
+    }
+
+    if (transfer->offset > 0)
+    {
+        Log_Info("Content of '%s' changed or cannot be resumed. Restarting.", transfer->entity->FileId);
+    }
+
+    if (ftruncate(transfer->fd, 0) != 0 || lseek(transfer->fd, 0, SEEK_SET) != 0)
+    {
+        Log_Error("Cannot truncate target file. %s (errno %d).", strerror(errno), errno);
+        transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE;
+        return false;
+    }
+
+    transfer->offset = 0;
+
+    if (transfer->dataSink != nullptr)
+    {
+        if (transfer->dataSink->reset != nullptr)
+        {
+            transfer->dataSink->reset(transfer->dataSink->context);
+        }
+        transfer->sinkHasFileContent = true;
+    }
+
+    // Prefer the strong validator.
+    transfer->validator =
+        transfer->responseEtag.empty() ? transfer->responseLastModified : transfer->responseEtag;
+    WriteResumeValidator(transfer->resumeFilePath, transfer->validator);
+
+    return true;
+}
+
+/**
+ * @brief CURLOPT_HEADERFUNCTION callback. Collects the headers needed to resume.
+ */
+static size_t CurlTransfer_Header(char* buffer, size_t size, size_t count, void* userdata)
+{
+    auto* transfer = static_cast<CurlTransfer*>(userdata);
+    const size_t length = size * count;
+
+    std::string line{ buffer, length };
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n'))
+    {
+        line.pop_back();
+    }
+
+    if (line.compare(0, 5, "HTTP/") == 0)
+    {
+        // A new response, e.g. after a redirect.
+        transfer->responseStarted = false;
+        transfer->responseEtag.clear();
+        transfer->responseLastModified.clear();
+        transfer->responseContentRange.clear();
+    }
+    else if (!ParseHeader(line, "ETag", &transfer->responseEtag)
+             && !ParseHeader(line, "Last-Modified", &transfer->responseLastModified))
+    {
+        ParseHeader(line, "Content-Range", &transfer->responseContentRange);
+    }
+
+    return length;
+}
+
+/**
+ * @brief CURLOPT_WRITEFUNCTION callback. Appends the body to the target file and the data sink.
+ */
+static size_t CurlTransfer_Write(char* data, size_t size, size_t count, void* userdata)
+{
+    auto* transfer = static_cast<CurlTransfer*>(userdata);
+    const size_t length = size * count;
+
+    if (!transfer->responseStarted)
+    {
+        if (!BeginResponseBody(transfer))
+        {
+            return 0;
+        }
+        transfer->responseStarted = true;
+    }
+
+    if (!WriteAll(transfer->fd, reinterpret_cast<const uint8_t*>(data), length))
+    {
+        Log_Error("Cannot write to target file. %s (errno %d).", strerror(errno), errno);
+        transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE;
+        return 0;
+    }
+
+    if (transfer->dataSink != nullptr
+        && !transfer->dataSink->write(transfer->dataSink->context, reinterpret_cast<const uint8_t*>(data), length))
+    {
+        Log_Error("Data sink aborted the download.");
+        transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED;
+        return 0;
+    }
+
+    transfer->offset += length;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (transfer->progressCallback != nullptr
+        && now - transfer->lastProgressReport >= std::chrono::milliseconds(CURL_DOWNLOADER_PROGRESS_INTERVAL_MS))
+    {
+        transfer->lastProgressReport = now;
+        transfer->progressCallback(
+            transfer->workflowId,
+            transfer->entity->FileId,
+            ADUC_DownloadProgressState_InProgress,
+            transfer->offset,
+            transfer->entity->SizeInBytes);
+    }
+
+    return length;
+}
+
+/**
+ * @brief Whether a failed attempt may succeed if retried.
+ * @param code The libcurl result.
+ * @param httpStatus The HTTP status of the last response.
+ * @return bool true if transient.
+ */
+static bool IsTransientFailure(CURLcode code, long httpStatus)
+{
+    switch (code)
+    {
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_SSL_CONNECT_ERROR:
+    case CURLE_HTTP2:
+    case CURLE_HTTP2_STREAM:
+        return true;
+
+    case CURLE_HTTP_RETURNED_ERROR:
+        return httpStatus == 408 || httpStatus == 429 || httpStatus >= 500;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Waits before retrying, returning early if the data sink asks to abort.
+ * @param transfer The transfer.
+ * @param delay How long to wait.
+ * @return bool false if the download should be abandoned.
+ */
+static bool WaitToRetry(const CurlTransfer& transfer, std::chrono::seconds delay)
+{
+    const auto deadline = std::chrono::steady_clock::now() + delay;
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        // A zero-length write asks the sink whether to keep going.
+        if (transfer.dataSink != nullptr && !transfer.dataSink->write(transfer.dataSink->context, nullptr, 0))
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    return true;
+}
+
+/**
+ * @brief Sets the options that every request of the downloader uses.
+ * @param curl The handle.
+ * @param url The download URL.
+ * @return CURLcode The first setopt failure, or CURLE_OK.
+ */
+static CURLcode SetCommonOptions(CURL* curl, const char* url)
+{
+    CURLcode code = CURLE_OK;
+
+    SET_OPTION(CURLOPT_URL, url);
+#if LIBCURL_VERSION_NUM >= 0x075500
+    SET_OPTION(CURLOPT_PROTOCOLS_STR, "http,https");
+    SET_OPTION(CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+#else
+    SET_OPTION(CURLOPT_PROTOCOLS, static_cast<long>(CURLPROTO_HTTP | CURLPROTO_HTTPS));
+    SET_OPTION(CURLOPT_REDIR_PROTOCOLS, static_cast<long>(CURLPROTO_HTTP | CURLPROTO_HTTPS));
+#endif
+    SET_OPTION(CURLOPT_FOLLOWLOCATION, 1L);
+    SET_OPTION(CURLOPT_FAILONERROR, 1L);
+    SET_OPTION(CURLOPT_NOSIGNAL, 1L);
+    SET_OPTION(CURLOPT_TCP_KEEPALIVE, 1L);
+    SET_OPTION(CURLOPT_LOW_SPEED_LIMIT, 1L);
+    SET_OPTION(CURLOPT_LOW_SPEED_TIME, static_cast<long>(CURL_DOWNLOADER_LOW_SPEED_TIME_SECONDS));
+
+    return code;
+}
+
+/**
+ * @brief Sets the options of one attempt.
+ * @param transfer The transfer.
+ * @param url The download URL.
+ * @param[in,out] headers The request headers list; replaced.
+ * @return CURLcode The first setopt failure, or CURLE_OK.
+ */
+static CURLcode SetTransferOptions(CurlTransfer* transfer, const char* url, curl_slist** headers)
+{
+    CURL* curl = transfer->curl;
+    CURLcode code = CURLE_OK;
+    const std::string range = std::to_string(transfer->offset) + "-";
+
+    curl_slist_free_all(*headers);
+    *headers = nullptr;
+
+    const bool resume = transfer->offset > 0 && !transfer->validator.empty();
+    if (resume)
+    {
+        // If the content changed since the partial download, the server sends all of it with 200.
+        const std::string ifRange = "If-Range: " + transfer->validator;
+        *headers = curl_slist_append(nullptr, ifRange.c_str());
+    }
+
+    code = SetCommonOptions(curl, url);
+    SET_OPTION(CURLOPT_RANGE, resume ? range.c_str() : nullptr);
+    SET_OPTION(CURLOPT_HTTPHEADER, *headers);
+    SET_OPTION(CURLOPT_HEADERFUNCTION, CurlTransfer_Header);
+    SET_OPTION(CURLOPT_HEADERDATA, transfer);
+    SET_OPTION(CURLOPT_WRITEFUNCTION, CurlTransfer_Write);
+    SET_OPTION(CURLOPT_WRITEDATA, transfer);
+
+    return code;
+}
+
+/**
+ * @brief Reads the segmentation settings from du-config.json once per process.
+ */
+static void EnsureSegmentationConfig()
+{
+    static std::once_flag readConfigOnce;
+
+    std::call_once(readConfigOnce, []() {
+        const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+        if (config != nullptr)
+        {
+            s_segmentCount = config->downloadSegmentCount;
+        }
+        ADUC_ConfigInfo_ReleaseInstance(config);
+    });
+}
+
+void CurlDownloader_SetSegmentation(unsigned int segmentCount, uint64_t minSegmentSize)
+{
+    EnsureSegmentationConfig();
+    s_segmentCount = segmentCount;
+    s_minSegmentSize = minSegmentSize;
+}
+
+/**
+ * @brief The number of segments to download a payload of @p sizeInBytes bytes in.
+ * @return unsigned int The segment count; less than 2 means a single stream.
+ */
+static unsigned int GetSegmentCount(uint64_t sizeInBytes)
+{
+    EnsureSegmentationConfig();
+
+    const uint64_t minSegmentSize = std::max<uint64_t>(s_minSegmentSize, 1);
+    const uint64_t count = std::min<uint64_t>(
+        std::min<unsigned int>(s_segmentCount, CURL_DOWNLOADER_MAX_SEGMENTS), sizeInBytes / minSegmentSize);
+    return static_cast<unsigned int>(count);
+}
+
+/**
+ * @brief How a segmented download ended.
+ */
+typedef enum tagCurlSegmentedOutcome
+{
+    CurlSegmentedOutcome_Unsupported, /**< Not attempted, or the server can't serve it; use a single stream. */
+    CurlSegmentedOutcome_Completed,
+    CurlSegmentedOutcome_Failed,
+} CurlSegmentedOutcome;
+
+struct CurlSegmentedTransfer;
+
+/**
+ * @brief One byte range of a segmented download. Only its own worker thread touches it, except for received.
+ */
+struct CurlSegment
+{
+    CurlSegment(CurlSegmentedTransfer* ownerIn, uint64_t startIn, uint64_t lengthIn) :
+        owner(ownerIn), start(startIn), length(lengthIn)
+    {
+    }
+
+    CurlSegmentedTransfer* owner;
+    const uint64_t start; /**< The file offset of the segment. */
+    const uint64_t length;
+    std::atomic<uint64_t> received{ 0 }; /**< The number of bytes of the segment in the target file. */
+
+    CURL* curl = nullptr;
+    bool responseStarted = false;
+    std::string responseContentRange;
+    ADUC_Result_t writeErc = 0;
+};
+
+/**
+ * @brief The state shared by the worker threads of a segmented download and the thread that feeds the data sink.
+ */
+struct CurlSegmentedTransfer
+{
+    CurlSegmentedTransfer(int fdIn, const char* urlIn, std::string validatorIn) :
+        fd(fdIn), url(urlIn), validator(std::move(validatorIn))
+    {
+    }
+
+    const int fd;
+    const char* url;
+    const std::string validator; /**< Sent with If-Range, so that all segments are of the same content. */
+    std::chrono::steady_clock::time_point deadline;
+
+    std::atomic<bool> abort{ false };
+    std::atomic<ADUC_Result_t> failureErc{ 0 }; /**< The first segment failure. */
+    std::atomic<unsigned int> activeWorkers{ 0 };
+
+    std::mutex mutex;
+    std::condition_variable progressed; /**< Signalled when a segment receives data or a worker ends. */
+
+    std::vector<std::unique_ptr<CurlSegment>> segments;
+};
+
+/**
+ * @brief Wakes the thread that feeds the data sink.
+ */
+static void NotifyProgress(CurlSegmentedTransfer* transfer)
+{
+    std::lock_guard<std::mutex> lock{ transfer->mutex };
+    transfer->progressed.notify_one();
+}
+
+/**
+ * @brief CURLOPT_HEADERFUNCTION callback of a segment. Collects Content-Range.
+ */
+static size_t CurlSegment_Header(char* buffer, size_t size, size_t count, void* userdata)
+{
+    auto* segment = static_cast<CurlSegment*>(userdata);
+    const size_t length = size * count;
+
+    std::string line{ buffer, length };
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n'))
+    {
+        line.pop_back();
+    }
+
+    if (line.compare(0, 5, "HTTP/") == 0)
+    {
+        segment->responseStarted = false;
+        segment->responseContentRange.clear();
+    }
+    else
+    {
+        ParseHeader(line, "Content-Range", &segment->responseContentRange);
+    }
+
+    return length;
+}
+
+/**
+ * @brief CURLOPT_WRITEFUNCTION callback of a segment. Writes the body at its place in the target file.
+ */
+static size_t CurlSegment_Write(char* data, size_t size, size_t count, void* userdata)
+{
+    auto* segment = static_cast<CurlSegment*>(userdata);
+    size_t length = size * count;
+    uint64_t received = segment->received;
+
+    if (segment->owner->abort)
+    {
+        return 0;
+    }
+
+    if (!segment->responseStarted)
+    {
+        // Only the requested range of the same content will do; a 200 means the content changed.
+        long httpStatus = 0;
+        unsigned long long first = 0;
+        curl_easy_getinfo(segment->curl, CURLINFO_RESPONSE_CODE, &httpStatus);
+        if (httpStatus != 206 || sscanf(segment->responseContentRange.c_str(), "bytes %llu-", &first) != 1
+            || first != segment->start + received)
+        {
+            Log_Error(
+                "Segment response (HTTP %ld, '%s') does not continue at byte %llu.",
+                httpStatus,
+                segment->responseContentRange.c_str(),
+                static_cast<unsigned long long>(segment->start + received));
+            segment->writeErc = ADUC_ERROR_CURL_DOWNLOADER_RESUME_MISMATCH;
+            return 0;
+        }
+        segment->responseStarted = true;
+    }
+
+    if (received + length > segment->length)
+    {
+        Log_Error("Segment response is longer than the requested range.");
+        segment->writeErc = ADUC_ERROR_CURL_DOWNLOADER_RESUME_MISMATCH;
+        return 0;
+    }
+
+    for (const char* remaining = data; length > 0;)
+    {
+        const ssize_t written =
+            pwrite(segment->owner->fd, remaining, length, static_cast<off_t>(segment->start + received));
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            Log_Error("Cannot write to target file. %s (errno %d).", strerror(errno), errno);
+            segment->writeErc = ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE;
+            return 0;
+        }
+
+        remaining += written;
+        length -= static_cast<size_t>(written);
+        received += static_cast<uint64_t>(written);
+        segment->received = received;
+    }
+
+    NotifyProgress(segment->owner);
+    return size * count;
+}
+
+/**
+ * @brief CURLOPT_XFERINFOFUNCTION callback of a segment. Stops a stalled segment when the download is abandoned.
+ */
+static int CurlSegment_Progress(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+    return static_cast<CurlSegment*>(clientp)->owner->abort ? 1 : 0;
+}
+
+/**
+ * @brief Downloads one segment, retrying transient failures from where it stopped, until it completes, fails, or
+ * the download is abandoned.
+ * @param segment The segment.
+ */
+static void RunSegment(CurlSegment* segment)
+{
+    CurlSegmentedTransfer* transfer = segment->owner;
+    auto retryDelay = std::chrono::seconds(CURL_DOWNLOADER_INITIAL_RETRY_DELAY_SECONDS);
+    curl_slist* headers = nullptr;
+    ADUC_Result_t erc = 0;
+
+    if (!transfer->validator.empty())
+    {
+        const std::string ifRange = "If-Range: " + transfer->validator;
+        headers = curl_slist_append(nullptr, ifRange.c_str());
+    }
+
+    segment->curl = AcquireCurlHandle();
+    if (segment->curl == nullptr)
+    {
+        erc = ADUC_ERROR_CURL_DOWNLOADER_INIT_FAILURE;
+        goto done;
+    }
+
+    while (segment->received < segment->length && !transfer->abort)
+    {
+        CURL* curl = segment->curl;
+        const std::string range =
+            std::to_string(segment->start + segment->received) + "-" + std::to_string(segment->start + segment->length - 1);
+
+        segment->responseStarted = false;
+        segment->writeErc = 0;
+
+        CURLcode code = SetCommonOptions(curl, transfer->url);
+        SET_OPTION(CURLOPT_RANGE, range.c_str());
+        SET_OPTION(CURLOPT_HTTPHEADER, headers);
+        SET_OPTION(CURLOPT_HEADERFUNCTION, CurlSegment_Header);
+        SET_OPTION(CURLOPT_HEADERDATA, segment);
+        SET_OPTION(CURLOPT_WRITEFUNCTION, CurlSegment_Write);
+        SET_OPTION(CURLOPT_WRITEDATA, segment);
+        SET_OPTION(CURLOPT_XFERINFOFUNCTION, CurlSegment_Progress);
+        SET_OPTION(CURLOPT_XFERINFODATA, segment);
+        SET_OPTION(CURLOPT_NOPROGRESS, 0L);
+
+        if (code == CURLE_OK)
+        {
+            code = curl_easy_perform(curl);
+        }
+
+        if (transfer->abort)
+        {
+            break;
+        }
+
+        if (code == CURLE_OK)
+        {
+            if (segment->received == segment->length)
+            {
+                break;
+            }
+
+            // The response ended early without an error; retry it like a dropped connection.
+            code = CURLE_PARTIAL_FILE;
+        }
+
+        long httpStatus = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpStatus);
+
+        Log_Warn(
+            "Segment at byte %llu failed at byte %llu: %s (curl %d, HTTP %ld).",
+            static_cast<unsigned long long>(segment->start),
+            static_cast<unsigned long long>(segment->start + segment->received),
+            curl_easy_strerror(code),
+            code,
+            httpStatus);
+
+        if (segment->writeErc != 0)
+        {
+            erc = segment->writeErc;
+            goto done;
+        }
+
+        if (!IsTransientFailure(code, httpStatus)
+            || std::chrono::steady_clock::now() + retryDelay >= transfer->deadline)
+        {
+            erc = ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(code);
+            goto done;
+        }
+
+        const auto retryAt = std::chrono::steady_clock::now() + retryDelay;
+        while (!transfer->abort && std::chrono::steady_clock::now() < retryAt)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        retryDelay = std::min(retryDelay * 2, std::chrono::seconds(CURL_DOWNLOADER_MAX_RETRY_DELAY_SECONDS));
+    }
+
+done:
+    if (erc != 0)
+    {
+        ADUC_Result_t noFailure = 0;
+        transfer->failureErc.compare_exchange_strong(noFailure, erc);
+        transfer->abort = true;
+    }
+
+    curl_slist_free_all(headers);
+    ReleaseCurlHandle(segment->curl);
+    segment->curl = nullptr;
+
+    --transfer->activeWorkers;
+    NotifyProgress(transfer);
+}
+
+/**
+ * @brief CURLOPT_WRITEFUNCTION callback of the range probe. Discards the one byte, and refuses a whole payload.
+ */
+static size_t CurlProbe_Write(char*, size_t size, size_t count, void* userdata)
+{
+    long httpStatus = 0;
+    curl_easy_getinfo(static_cast<CurlTransfer*>(userdata)->curl, CURLINFO_RESPONSE_CODE, &httpStatus);
+    return httpStatus == 206 ? size * count : 0;
+}
+
+/**
+ * @brief Asks the server for the first byte of the payload, to learn whether it serves byte ranges of it.
+ * @param transfer The transfer. Receives the validator of the content.
+ * @return bool true if the server serves ranges of content of the expected size.
+ */
+static bool ProbeRangeSupport(CurlTransfer* transfer)
+{
+    CURL* curl = transfer->curl;
+    unsigned long long total = 0;
+    long httpStatus = 0;
+
+    transfer->responseEtag.clear();
+    transfer->responseLastModified.clear();
+    transfer->responseContentRange.clear();
+
+    CURLcode code = SetCommonOptions(curl, transfer->entity->DownloadUri);
+    SET_OPTION(CURLOPT_RANGE, "0-0");
+    SET_OPTION(CURLOPT_HTTPHEADER, static_cast<curl_slist*>(nullptr));
+    SET_OPTION(CURLOPT_HEADERFUNCTION, CurlTransfer_Header);
+    SET_OPTION(CURLOPT_HEADERDATA, transfer);
+    SET_OPTION(CURLOPT_WRITEFUNCTION, CurlProbe_Write);
+    SET_OPTION(CURLOPT_WRITEDATA, transfer);
+
+    if (code == CURLE_OK)
+    {
+        code = curl_easy_perform(curl);
+    }
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpStatus);
+
+    // "Content-Range: bytes 0-0/<length>"
+    if (code != CURLE_OK || httpStatus != 206
+        || sscanf(transfer->responseContentRange.c_str(), "bytes 0-0/%llu", &total) != 1
+        || total != transfer->entity->SizeInBytes)
+    {
+        Log_Info(
+            "Server does not serve byte ranges of '%s' (curl %d, HTTP %ld, '%s'). Using a single stream.",
+            transfer->entity->FileId,
+            code,
+            httpStatus,
+            transfer->responseContentRange.c_str());
+        return false;
+    }
+
+    transfer->validator = transfer->responseEtag.empty() ? transfer->responseLastModified : transfer->responseEtag;
+    return true;
+}
+
+/**
+ * @brief Sizes the target file for the whole payload up front, so that segments can be written in any order.
+ * @return bool true on success.
+ */
+static bool PreallocateTargetFile(int fd, uint64_t size)
+{
+    if (ftruncate(fd, 0) != 0)
+    {
+        return false;
+    }
 
-#include <sstream>
-#include <sys/stat.h> // for stat
-#include <vector>
+    if (fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0)
+    {
+        return true;
+    }
+
+    // Not every file system can reserve blocks; a sparse file works too.
+    return (errno == EOPNOTSUPP || errno == ENOSYS) && ftruncate(fd, static_cast<off_t>(size)) == 0;
+}
+
+/**
+ * @brief Feeds the data sink the part of the payload that all segments before the frontier have written.
+ * @param transfer The transfer.
+ * @param segmented The segmented download.
+ * @param[in,out] fed The number of bytes the sink has seen.
+ * @param buffer The read buffer.
+ * @return bool false if the sink refused the data or the file can't be read.
+ */
+static bool FeedSegmentsToSink(
+    CurlTransfer* transfer, const CurlSegmentedTransfer& segmented, uint64_t* fed, std::vector<uint8_t>* buffer)
+{
+    uint64_t frontier = transfer->entity->SizeInBytes;
+    for (const std::unique_ptr<CurlSegment>& segment : segmented.segments)
+    {
+        const uint64_t received = segment->received;
+        if (received < segment->length)
+        {
+            frontier = segment->start + received;
+            break;
+        }
+    }
+
+    while (*fed < frontier)
+    {
+        const size_t toRead = static_cast<size_t>(std::min<uint64_t>(buffer->size(), frontier - *fed));
+        const ssize_t count = pread(transfer->fd, buffer->data(), toRead, static_cast<off_t>(*fed));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            Log_Error("Cannot read downloaded segment. %s (errno %d).", strerror(errno), errno);
+            transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE;
+            return false;
+        }
+
+        if (transfer->dataSink != nullptr
+            && !transfer->dataSink->write(transfer->dataSink->context, buffer->data(), static_cast<size_t>(count)))
+        {
+            Log_Error("Data sink aborted the download.");
+            transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED;
+            return false;
+        }
+
+        *fed += static_cast<uint64_t>(count);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Downloads a large payload as several byte ranges at once, each on its own connection, into a preallocated
+ * target file. The data sink receives the payload in file order as the ranges complete.
+ *
+ * @details Each segment retries on its own. If a segment fails for good, or the sink aborts, the others are
+ * stopped. A segmented download isn't resumed by a later attempt; its target file is restarted.
+ *
+ * @param transfer The transfer, with nothing downloaded yet. Its handle is used for the probe.
+ * @param segmentCount The number of segments.
+ * @param deadline When retries stop.
+ * @return CurlSegmentedOutcome Unsupported if the caller should download the payload as a single stream instead.
+ */
+static CurlSegmentedOutcome TransferSegments(
+    CurlTransfer* transfer, unsigned int segmentCount, std::chrono::steady_clock::time_point deadline)
+{
+    const uint64_t size = transfer->entity->SizeInBytes;
+    const uint64_t segmentSize = size / segmentCount;
+    std::vector<std::thread> workers;
+    std::vector<uint8_t> buffer(1024 * 1024);
+    uint64_t fed = 0;
+    auto lastSinkProbe = std::chrono::steady_clock::now();
+    CurlSegmentedOutcome outcome = CurlSegmentedOutcome_Failed;
+
+    if (!ProbeRangeSupport(transfer))
+    {
+        return CurlSegmentedOutcome_Unsupported;
+    }
+
+    if (!PreallocateTargetFile(transfer->fd, size))
+    {
+        Log_Error("Cannot preallocate target file. %s (errno %d).", strerror(errno), errno);
+        transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE;
+        return CurlSegmentedOutcome_Failed;
+    }
+
+    // The preallocated file is not a resumable single-stream prefix.
+    WriteResumeValidator(transfer->resumeFilePath, "");
+
+    if (transfer->dataSink != nullptr && transfer->dataSink->reset != nullptr)
+    {
+        transfer->dataSink->reset(transfer->dataSink->context);
+    }
+
+    Log_Info("Downloading '%s' in %u segments.", transfer->entity->FileId, segmentCount);
+
+    CurlSegmentedTransfer segmented{ transfer->fd, transfer->entity->DownloadUri, transfer->validator };
+    segmented.deadline = deadline;
+    for (unsigned int i = 0; i < segmentCount; ++i)
+    {
+        const uint64_t start = i * segmentSize;
+        const uint64_t length = (i + 1 == segmentCount) ? size - start : segmentSize;
+        segmented.segments.emplace_back(new CurlSegment{ &segmented, start, length });
+    }
+
+    segmented.activeWorkers = segmentCount;
+    for (const std::unique_ptr<CurlSegment>& segment : segmented.segments)
+    {
+        workers.emplace_back(RunSegment, segment.get());
+    }
+
+    // Only this thread calls the data sink and the progress callback.
+    for (;;)
+    {
+        // Read before feeding, so that the feed sees everything the ended workers wrote.
+        const bool workersEnded = segmented.activeWorkers == 0;
+
+        if (!FeedSegmentsToSink(transfer, segmented, &fed, &buffer))
+        {
+            break;
+        }
+
+        if (fed == size)
+        {
+            outcome = CurlSegmentedOutcome_Completed;
+            break;
+        }
+
+        if (segmented.abort || workersEnded)
+        {
+            transfer->writeErc = segmented.failureErc;
+            break;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        // A zero-length write asks the sink whether to keep going.
+        if (transfer->dataSink != nullptr && now - lastSinkProbe >= std::chrono::milliseconds(500))
+        {
+            lastSinkProbe = now;
+            if (!transfer->dataSink->write(transfer->dataSink->context, nullptr, 0))
+            {
+                transfer->writeErc = ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED;
+                break;
+            }
+        }
+
+        if (transfer->progressCallback != nullptr
+            && now - transfer->lastProgressReport >= std::chrono::milliseconds(CURL_DOWNLOADER_PROGRESS_INTERVAL_MS))
+        {
+            uint64_t received = 0;
+            for (const std::unique_ptr<CurlSegment>& segment : segmented.segments)
+            {
+                received += segment->received;
+            }
+
+            transfer->lastProgressReport = now;
+            transfer->progressCallback(
+                transfer->workflowId, transfer->entity->FileId, ADUC_DownloadProgressState_InProgress, received, size);
+        }
+
+        std::unique_lock<std::mutex> lock{ segmented.mutex };
+        segmented.progressed.wait_for(lock, std::chrono::milliseconds(100));
+    }
+
+    segmented.abort = true;
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    transfer->offset = fed;
+
+    if (outcome != CurlSegmentedOutcome_Completed && transfer->writeErc == ADUC_ERROR_CURL_DOWNLOADER_RESUME_MISMATCH)
+    {
+        // The content changed under the segments; start over as a single stream.
+        Log_Info("Content of '%s' changed during the segmented download. Restarting.", transfer->entity->FileId);
+        transfer->writeErc = 0;
+        transfer->offset = 0;
+        transfer->validator.clear();
+        return CurlSegmentedOutcome_Unsupported;
+    }
+
+    return outcome;
+}
+
+/**
+ * @brief Downloads @p entity to @p filePath, resuming a partial download left by an earlier attempt, and retrying
+ * transient failures until @p retryTimeout elapses.
+ *
+ * @param entity The file entity.
+ * @param workflowId The workflow id, for progress reports.
+ * @param filePath The target file path.
+ * @param retryTimeout How long, in seconds, to keep retrying.
+ * @param downloadProgressCallback Optional. Receives ADUC_DownloadProgressState_InProgress reports.
+ * @param dataSink Optional. Receives the whole payload in file order.
+ * @param[out] bytesOnDisk The size of the target file.
+ * @return ADUC_Result ADUC_Result_Download_Success on success.
+ */
+static ADUC_Result TransferFile(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const std::string& filePath,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    const ADUC_DownloadDataSink* dataSink,
+    uint64_t* bytesOnDisk)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(retryTimeout);
+    auto retryDelay = std::chrono::seconds(CURL_DOWNLOADER_INITIAL_RETRY_DELAY_SECONDS);
+    curl_slist* headers = nullptr;
+    struct stat st = {};
+    int attempt = 0;
+    unsigned int segmentCount = 0;
+    CurlSegmentedOutcome outcome = CurlSegmentedOutcome_Unsupported;
+
+    const std::string resumeFilePath = filePath + ADUC_CONTENT_DOWNLOADER_RESUME_FILE_SUFFIX;
+    CurlTransfer transfer{
+        AcquireCurlHandle(), -1, entity, workflowId, downloadProgressCallback, dataSink, resumeFilePath
+    };
+
+    *bytesOnDisk = 0;
+
+    if (transfer.curl == nullptr)
+    {
+        result.ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_INIT_FAILURE;
+        goto done;
+    }
+
+    // Readable too, so that a resumed payload can be fed to the data sink from the start.
+    transfer.fd = open(filePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (transfer.fd == -1 || fstat(transfer.fd, &st) != 0)
+    {
+        Log_Error("Cannot open '%s'. %s (errno %d).", filePath.c_str(), strerror(errno), errno);
+        result.ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_CANNOT_OPEN_TARGET_FILE;
+        goto done;
+    }
+
+    // Resume only a partial download of known content; a leftover of unknown origin is replaced.
+    transfer.validator = ReadResumeValidator(transfer.resumeFilePath);
+    if (!transfer.validator.empty() && st.st_size > 0
+        && (entity->SizeInBytes == 0 || static_cast<uint64_t>(st.st_size) < entity->SizeInBytes)
+        && lseek(transfer.fd, st.st_size, SEEK_SET) == st.st_size)
+    {
+        transfer.offset = static_cast<uint64_t>(st.st_size);
+    }
+    else
+    {
+        transfer.validator.clear();
+    }
+
+    // A large payload may be downloaded in segments, unless a single-stream download of it can be resumed.
+    segmentCount = (transfer.offset == 0) ? GetSegmentCount(entity->SizeInBytes) : 0;
+    if (segmentCount > 1)
+    {
+        outcome = TransferSegments(&transfer, segmentCount, deadline);
+        if (outcome == CurlSegmentedOutcome_Failed)
+        {
+            result.ExtendedResultCode = transfer.writeErc;
+            goto done;
+        }
+    }
+
+    while (outcome != CurlSegmentedOutcome_Completed)
+    {
+        ++attempt;
+        transfer.responseStarted = false;
+        transfer.writeErc = 0;
+
+        CURLcode code = SetTransferOptions(&transfer, entity->DownloadUri, &headers);
+        if (code == CURLE_OK)
+        {
+            code = curl_easy_perform(transfer.curl);
+        }
+
+        if (code == CURLE_OK)
+        {
+            break;
+        }
+
+        long httpStatus = 0;
+        curl_easy_getinfo(transfer.curl, CURLINFO_RESPONSE_CODE, &httpStatus);
+
+        Log_Warn(
+            "Download attempt #%d of '%s' failed at byte %llu: %s (curl %d, HTTP %ld).",
+            attempt,
+            entity->FileId,
+            static_cast<unsigned long long>(transfer.offset),
+            curl_easy_strerror(code),
+            code,
+            httpStatus);
+
+        if (transfer.writeErc == ADUC_ERROR_CURL_DOWNLOADER_RESUME_MISMATCH
+            || (code == CURLE_HTTP_RETURNED_ERROR && httpStatus == 416 && transfer.offset > 0))
+        {
+            // The server cannot continue the partial download; start over right away.
+            transfer.validator.clear();
+            transfer.offset = 0;
+            continue;
+        }
+
+        if (transfer.writeErc != 0)
+        {
+            result.ExtendedResultCode = transfer.writeErc;
+            goto done;
+        }
+
+        if (!IsTransientFailure(code, httpStatus) || std::chrono::steady_clock::now() + retryDelay >= deadline
+            || !WaitToRetry(transfer, retryDelay))
+        {
+            result.ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(code);
+            goto done;
+        }
+
+        retryDelay = std::min(retryDelay * 2, std::chrono::seconds(CURL_DOWNLOADER_MAX_RETRY_DELAY_SECONDS));
+    }
+
+    if (outcome != CurlSegmentedOutcome_Completed && !transfer.responseStarted)
+    {
+        // An empty body; make sure a leftover partial file doesn't pass for the payload.
+        transfer.offset = 0;
+        if (ftruncate(transfer.fd, 0) != 0)
+        {
+            result.ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE;
+            goto done;
+        }
+
+        if (dataSink != nullptr && dataSink->reset != nullptr)
+        {
+            dataSink->reset(dataSink->context);
+        }
+    }
+
+    if (close(transfer.fd) != 0)
+    {
+        transfer.fd = -1;
+        Log_Error("Cannot close '%s'. %s (errno %d).", filePath.c_str(), strerror(errno), errno);
+        result.ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE;
+        goto done;
+    }
+    transfer.fd = -1;
+
+    // The payload is complete; there is nothing left to resume.
+    unlink(transfer.resumeFilePath.c_str());
+
+    result = { ADUC_Result_Download_Success };
+
+done:
+    *bytesOnDisk = transfer.offset;
+
+    if (transfer.fd != -1)
+    {
+        close(transfer.fd);
+    }
+
+    if (result.ExtendedResultCode == ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE
+        || transfer.writeErc == ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE)
+    {
+        // What is on disk may not be what was received; don't resume from it.
+        unlink(transfer.resumeFilePath.c_str());
+    }
+
+    curl_slist_free_all(headers);
+    ReleaseCurlHandle(transfer.curl);
+
+    return result;
+}
+
+/**
+ * @brief Reports the final state of a download.
+ */
+static void ReportFinalProgress(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const ADUC_Result& result,
+    uint64_t bytesTransferred,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    if (entity == nullptr || downloadProgressCallback == nullptr)
+    {
+        return;
+    }
+
+    ADUC_DownloadProgressState state = ADUC_DownloadProgressState_Completed;
+    if (result.ResultCode == ADUC_Result_Failure_Cancelled
+        || result.ExtendedResultCode == ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED)
+    {
+        state = ADUC_DownloadProgressState_Cancelled;
+    }
+    else if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        state = ADUC_DownloadProgressState_Error;
+    }
+
+    downloadProgressCallback(workflowId, entity->FileId, state, bytesTransferred, entity->SizeInBytes);
+}
 
 ADUC_Result Download_curl(
     const ADUC_FileEntity* entity,
@@ -23,15 +1377,10 @@ ADUC_Result Download_curl(
     unsigned int retryTimeout,
     ADUC_DownloadProgressCallback downloadProgressCallback)
 {
-    UNREFERENCED_PARAMETER(retryTimeout);
     ADUC_Result result = { ADUC_Result_Failure };
     SHAversion algVersion;
-    std::vector<std::string> args;
-    std::string output;
-    int exitCode = 1;
     std::stringstream fullFilePath;
-    bool isValidHash;
-    bool reportProgress = false;
+    uint64_t bytesOnDisk = 0;
 
     if (entity == nullptr)
     {
@@ -49,15 +1398,6 @@ ADUC_Result Download_curl(
     {
         Log_Error("File entity does not contain a file hash! Cannot validate cancelling download.");
         result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_IS_EMPTY;
-        if (downloadProgressCallback != nullptr)
-        {
-            downloadProgressCallback(
-                workflowId,
-                entity->FileId,
-                ADUC_DownloadProgressState_Error,
-                result.ResultCode,
-                result.ExtendedResultCode);
-        }
         goto done;
     }
 
@@ -71,31 +1411,19 @@ ADUC_Result Download_curl(
             fullFilePath.str().c_str(),
             ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0));
         result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED;
-
-        if (downloadProgressCallback != nullptr)
-        {
-            downloadProgressCallback(
-                workflowId,
-                entity->FileId,
-                ADUC_DownloadProgressState_Error,
-                result.ResultCode,
-                result.ExtendedResultCode);
-        }
         goto done;
     }
 
     // If target file exists, validate file hash.
-    // If file is valid, then skip the download.
-    isValidHash = ADUC_HashUtils_IsValidFileHash(
-        fullFilePath.str().c_str(),
-        ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
-        algVersion,
-        false /* suppressErrorLog */);
-
-    if (isValidHash)
+    // If file is valid, then skip the download. An unchanged, previously verified file is not re-hashed.
+    if (ADUC_VerifiedHashCache_IsValidFileHash(
+            fullFilePath.str().c_str(),
+            ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
+            algVersion,
+            false /* suppressErrorLog */))
     {
         result = { ADUC_Result_Download_Skipped_FileExists };
-        reportProgress = true;
+        bytesOnDisk = entity->SizeInBytes;
         goto done;
     }
 
@@ -105,76 +1433,83 @@ ADUC_Result Download_curl(
         entity->DownloadUri,
         fullFilePath.str().c_str());
 
-    args.emplace_back("-o");
-    args.emplace_back(fullFilePath.str().c_str());
-    args.emplace_back("-O");
-    args.emplace_back(entity->DownloadUri);
-
-    exitCode = ADUC_LaunchChildProcess("/usr/bin/curl", args, output);
-
-    if (exitCode == 0)
-    {
-        result = { ADUC_Result_Download_Success };
-    }
-    else
+    result = TransferFile(
+        entity, workflowId, fullFilePath.str(), retryTimeout, downloadProgressCallback, nullptr, &bytesOnDisk);
+    if (IsAducResultCodeFailure(result.ResultCode))
     {
-        result = { .ResultCode = ADUC_Result_Failure,
-                   .ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(exitCode) };
-        reportProgress = true;
         goto done;
     }
 
-    Log_Info("Download output:: \n%s", output.c_str());
-
-    // If we downloaded successfully, validate the file hash.
-    if (IsAducResultCodeSuccess(result.ResultCode))
-    {
-        // Note: Currently we expect there to be only one hash, but
-        // support for multiple hashes is already built in.
-        Log_Info("Validating file hash");
+    // Note: Currently we expect there to be only one hash, but
+    // support for multiple hashes is already built in.
+    Log_Info("Validating file hash");
 
-        const bool isValid = ADUC_HashUtils_IsValidFileHash(
+    if (!ADUC_HashUtils_IsValidFileHash(
             fullFilePath.str().c_str(),
             ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
             algVersion,
-            true /* suppressErrorLog */);
-
-        if (!isValid)
-        {
-            Log_Error("Hash for %s is not valid", entity->TargetFilename);
+            true /* suppressErrorLog */))
+    {
+        Log_Error("Hash for %s is not valid", entity->TargetFilename);
 
-            result = { .ResultCode = ADUC_Result_Failure,
-                       .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH };
-            reportProgress = true;
-            goto done;
-        }
+        result = { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH };
+        goto done;
     }
 
 done:
+    ReportFinalProgress(entity, workflowId, result, bytesOnDisk, downloadProgressCallback);
+
+    Log_Info(
+        "Download task end. resultCode: %d, extendedCode: %d (0x%X)",
+        result.ResultCode,
+        result.ExtendedResultCode,
+        result.ExtendedResultCode);
+    return result;
+}
+
+ADUC_Result Download_curl_V2(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    const ADUC_DownloadDataSink* dataSink)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    std::stringstream fullFilePath;
+    uint64_t bytesOnDisk = 0;
 
-    if (reportProgress && (downloadProgressCallback != nullptr))
+    if (dataSink == nullptr || dataSink->write == nullptr)
     {
-        if (IsAducResultCodeSuccess(result.ResultCode))
-        {
-            struct stat st
-            {
-            };
-            const off_t fileSize{ (stat(fullFilePath.str().c_str(), &st) == 0) ? st.st_size : 0 };
-            downloadProgressCallback(
-                workflowId, entity->FileId, ADUC_DownloadProgressState_Completed, fileSize, entity->SizeInBytes);
-        }
-        else
-        {
-            downloadProgressCallback(
-                workflowId,
-                entity->FileId,
-                (result.ResultCode == ADUC_Result_Failure_Cancelled) ? ADUC_DownloadProgressState_Cancelled
-                                                                     : ADUC_DownloadProgressState_Error,
-                0,
-                entity->SizeInBytes);
-        }
+        return Download_curl(entity, workflowId, workFolder, retryTimeout, downloadProgressCallback);
+    }
+
+    if (entity == nullptr)
+    {
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_ENTITY;
+        goto done;
+    }
+
+    if (entity->DownloadUri == nullptr || *entity->DownloadUri == 0)
+    {
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_DOWNLOAD_URI;
+        goto done;
     }
 
+    fullFilePath << workFolder << "/" << entity->TargetFilename;
+
+    Log_Info(
+        "Downloading File '%s' from '%s' to '%s'",
+        entity->TargetFilename,
+        entity->DownloadUri,
+        fullFilePath.str().c_str());
+
+    result = TransferFile(
+        entity, workflowId, fullFilePath.str(), retryTimeout, downloadProgressCallback, dataSink, &bytesOnDisk);
+
+done:
+    ReportFinalProgress(entity, workflowId, result, bytesOnDisk, downloadProgressCallback);
+
     Log_Info(
         "Download task end. resultCode: %d, extendedCode: %d (0x%X)",
         result.ResultCode,
@@ -182,3 +1517,13 @@ done:
         result.ExtendedResultCode);
     return result;
 }
+
+ADUC_Result Initialize_curl()
+{
+    if (!EnsureCurlGlobalInit())
+    {
+        return ADUC_Result{ ADUC_GeneralResult_Failure, ADUC_ERROR_CURL_DOWNLOADER_INIT_FAILURE };
+    }
+
+    return ADUC_Result{ ADUC_GeneralResult_Success, 0 };
+}
@@ -9,3 +9,20 @@ ADUC_Result Download_curl(
     const char* workFolder,
     unsigned int retryTimeout,
     ADUC_DownloadProgressCallback downloadProgressCallback);
+
+ADUC_Result Download_curl_V2(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    const ADUC_DownloadDataSink* dataSink);
+
+ADUC_Result Initialize_curl();
+
+/**
+ * @brief Overrides the du-config.json segmentation settings, e.g. for tests.
+ * @param segmentCount The number of byte ranges to download a large payload in. 1 downloads it as a single stream.
+ * @param minSegmentSize The smallest range, in bytes.
+ */
+void CurlDownloader_SetSegmentation(unsigned int segmentCount, uint64_t minSegmentSize);
@@ -0,0 +1,70 @@
+/**
+ * @file curl_content_downloader_perf.cpp
+ * @brief Benchmark for downloading a large payload in segments over throttled connections.
+ *
+ * Hidden from the default run. Use: curl_content_downloader_unit_test "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "../curl_content_downloader.h"
+#include "test_http_server.hpp"
+
+#include <aduc/types/adu_core.h> // ADUC_Result_*
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include <unistd.h> // for rmdir
+
+TEST_CASE("Download_curl_V2 segmented throughput", "[.][perf]")
+{
+    constexpr size_t payloadSize = 8 * 1024 * 1024;
+
+    // A per-connection limit, like a congested path or a per-flow shaped CDN edge.
+    constexpr size_t bytesPerSecondPerConnection = 4 * 1024 * 1024;
+
+    TestHttpServer server{ std::string(payloadSize, 'x'), "\"v1\"" };
+    server.SetThrottle(bytesPerSecondPerConnection);
+
+    char dirTemplate[] = "/tmp/curldownloaderperfXXXXXX";
+    REQUIRE(mkdtemp(dirTemplate) != nullptr);
+    const std::string workFolder = dirTemplate;
+    std::string url = server.Url();
+
+    ADUC_FileEntity entity = {};
+    entity.FileId = const_cast<char*>("f1");
+    entity.DownloadUri = &url[0];
+    entity.TargetFilename = const_cast<char*>("payload.bin");
+    entity.SizeInBytes = payloadSize;
+
+    size_t sinkBytes = 0;
+    const ADUC_DownloadDataSink dataSink = { &sinkBytes,
+                                             [](void* context, const uint8_t*, size_t length) {
+                                                 *static_cast<size_t*>(context) += length;
+                                                 return true;
+                                             },
+                                             [](void* context) { *static_cast<size_t*>(context) = 0; } };
+
+    for (unsigned int segments : { 1u, 4u, 8u })
+    {
+        CurlDownloader_SetSegmentation(segments, 512 * 1024);
+        std::remove((workFolder + "/payload.bin").c_str());
+
+        const auto start = std::chrono::steady_clock::now();
+        const ADUC_Result result = Download_curl_V2(&entity, "wf", workFolder.c_str(), 0, nullptr, &dataSink);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        REQUIRE(result.ResultCode == ADUC_Result_Download_Success);
+        REQUIRE(sinkBytes == payloadSize);
+        std::cout << "segments " << segments << "\t" << (elapsed.count() * 1000.0) << " ms" << std::endl;
+    }
+
+    CurlDownloader_SetSegmentation(1, 16 * 1024 * 1024);
+    std::remove((workFolder + "/payload.bin").c_str());
+    rmdir(workFolder.c_str());
+}
@@ -0,0 +1,454 @@
+/**
+ * @file curl_content_downloader_ut.cpp
+ * @brief Unit Tests for the libcurl content downloader.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "../curl_content_downloader.h"
+#include "test_http_server.hpp"
+
+#include <aduc/hash_utils.h>
+#include <aduc/types/adu_core.h> // ADUC_Result_*
+
+#include <catch2/catch.hpp>
+#include <curl/curl.h> // CURLE_*
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h> // for rmdir
+
+namespace
+{
+/**
+ * @brief A work folder, and a file entity for the payload downloaded into it.
+ */
+class DownloadFixture
+{
+public:
+    DownloadFixture(const DownloadFixture&) = delete;
+    DownloadFixture& operator=(const DownloadFixture&) = delete;
+    DownloadFixture(DownloadFixture&&) = delete;
+    DownloadFixture& operator=(DownloadFixture&&) = delete;
+
+    DownloadFixture(const std::string& url, size_t sizeInBytes) : _url(url)
+    {
+        char dirTemplate[] = "/tmp/curldownloaderXXXXXX";
+        REQUIRE(mkdtemp(dirTemplate) != nullptr);
+        _workFolder = dirTemplate;
+
+        entity.FileId = const_cast<char*>("f1");
+        entity.DownloadUri = &_url[0];
+        entity.TargetFilename = const_cast<char*>("payload.bin");
+        entity.SizeInBytes = sizeInBytes;
+    }
+
+    ~DownloadFixture()
+    {
+        std::remove(FilePath().c_str());
+        std::remove((FilePath() + ".resume").c_str());
+        rmdir(_workFolder.c_str());
+    }
+
+    const char* WorkFolder() const
+    {
+        return _workFolder.c_str();
+    }
+
+    std::string FilePath() const
+    {
+        return _workFolder + "/payload.bin";
+    }
+
+    std::string ReadFile() const
+    {
+        std::ifstream file{ FilePath(), std::ios::binary };
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    void WriteFile(const std::string& path, const std::string& content) const
+    {
+        std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+        file << content;
+    }
+
+    ADUC_FileEntity entity = {};
+
+private:
+    std::string _url;
+    std::string _workFolder;
+};
+
+/**
+ * @brief A data sink that collects what it is given.
+ */
+struct CollectingSink
+{
+    std::string content;
+    int resetCount = 0;
+    size_t abortAfter = SIZE_MAX;
+
+    ADUC_DownloadDataSink AsDataSink()
+    {
+        return ADUC_DownloadDataSink{ this, Write, Reset };
+    }
+
+    static bool Write(void* context, const uint8_t* data, size_t length)
+    {
+        auto* sink = static_cast<CollectingSink*>(context);
+        if (sink->content.size() + length > sink->abortAfter)
+        {
+            return false;
+        }
+        sink->content.append(reinterpret_cast<const char*>(data), length);
+        return true;
+    }
+
+    static void Reset(void* context)
+    {
+        auto* sink = static_cast<CollectingSink*>(context);
+        sink->content.clear();
+        ++sink->resetCount;
+    }
+};
+
+std::vector<ADUC_DownloadProgressState> g_progressStates;
+
+void RecordProgress(
+    const char* /*workflowId*/,
+    const char* /*fileId*/,
+    ADUC_DownloadProgressState state,
+    uint64_t /*bytesTransferred*/,
+    uint64_t /*bytesTotal*/)
+{
+    g_progressStates.push_back(state);
+}
+
+/**
+ * @brief Downloads large payloads in segments for the lifetime of the object.
+ */
+struct SegmentationOverride
+{
+    SegmentationOverride(unsigned int segmentCount, uint64_t minSegmentSize)
+    {
+        CurlDownloader_SetSegmentation(segmentCount, minSegmentSize);
+    }
+
+    ~SegmentationOverride()
+    {
+        CurlDownloader_SetSegmentation(1, 16 * 1024 * 1024);
+    }
+};
+
+std::string MakeContent(size_t size)
+{
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+    {
+        content[i] = static_cast<char>('a' + (i * 7) % 26);
+    }
+    return content;
+}
+
+} // namespace
+
+TEST_CASE("Download_curl_V2 - downloads into the file and the data sink")
+{
+    const std::string content = MakeContent(300 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+    g_progressStates.clear();
+
+    const ADUC_Result result =
+        Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 0, RecordProgress, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    CHECK(fixture.ReadFile() == content);
+    CHECK(sink.content == content);
+    REQUIRE_FALSE(g_progressStates.empty());
+    CHECK(g_progressStates.back() == ADUC_DownloadProgressState_Completed);
+}
+
+TEST_CASE("Download_curl_V2 - reuses the connection for the next payload")
+{
+    const std::string content = MakeContent(10 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    for (int i = 0; i < 3; ++i)
+    {
+        DownloadFixture fixture{ server.Url(), content.size() };
+        const ADUC_Result result =
+            Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr, &dataSink);
+        CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    }
+
+    CHECK(server.ConnectionCount() == 1);
+}
+
+TEST_CASE("Download_curl_V2 - resumes a partial download of the same content")
+{
+    const std::string content = MakeContent(200 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    // Left behind by an interrupted download of "v1".
+    fixture.WriteFile(fixture.FilePath(), content.substr(0, 1000));
+    fixture.WriteFile(fixture.FilePath() + ".resume", "\"v1\"\n");
+
+    SECTION("Unchanged content continues at the partial size")
+    {
+        const ADUC_Result result = Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr, &dataSink);
+
+        CHECK(result.ResultCode == ADUC_Result_Download_Success);
+        CHECK(server.RangeHeaders() == std::vector<std::string>{ "bytes=1000-" });
+        CHECK(fixture.ReadFile() == content);
+        CHECK(sink.content == content);
+    }
+
+    SECTION("Changed content starts over")
+    {
+        const std::string newContent = MakeContent(150 * 1024).replace(0, 3, "new");
+        server.SetContent(newContent, "\"v2\"");
+
+        const ADUC_Result result = Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr, &dataSink);
+
+        CHECK(result.ResultCode == ADUC_Result_Download_Success);
+        CHECK(fixture.ReadFile() == newContent);
+        CHECK(sink.content == newContent);
+    }
+
+    // Nothing is left to resume.
+    CHECK(access((fixture.FilePath() + ".resume").c_str(), F_OK) != 0);
+}
+
+TEST_CASE("Download_curl_V2 - partial file of unknown origin is replaced")
+{
+    const std::string content = MakeContent(20 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    fixture.WriteFile(fixture.FilePath(), "garbage");
+
+    const ADUC_Result result = Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    CHECK(server.RangeHeaders() == std::vector<std::string>{ "" });
+    CHECK(fixture.ReadFile() == content);
+}
+
+TEST_CASE("Download_curl_V2 - retries a dropped transfer from where it stopped")
+{
+    const std::string content = MakeContent(256 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    server.DropNextResponseAfter(100 * 1024);
+
+    const ADUC_Result result =
+        Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 60 /* retryTimeout */, nullptr, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    const std::vector<std::string> ranges = server.RangeHeaders();
+    REQUIRE(ranges.size() == 2);
+    CHECK(ranges[0].empty());
+    CHECK(ranges[1] == "bytes=102400-");
+    CHECK(fixture.ReadFile() == content);
+    CHECK(sink.content == content);
+    CHECK(sink.resetCount == 1);
+}
+
+TEST_CASE("Download_curl_V2 - dropped transfer fails without retry time")
+{
+    const std::string content = MakeContent(64 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    server.DropNextResponseAfter(1024);
+
+    const ADUC_Result result = Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Failure);
+    CHECK(result.ExtendedResultCode == ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(CURLE_PARTIAL_FILE));
+
+    // The partial download can be resumed by the next attempt.
+    CHECK(access((fixture.FilePath() + ".resume").c_str(), F_OK) == 0);
+}
+
+TEST_CASE("Download_curl_V2 - HTTP error is not retried")
+{
+    TestHttpServer server{ "content", "\"v1\"" };
+    DownloadFixture fixture{ server.Url("/missing"), 7 };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    const ADUC_Result result = Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 60, nullptr, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Failure);
+    CHECK(result.ExtendedResultCode == ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(CURLE_HTTP_RETURNED_ERROR));
+    CHECK(server.RangeHeaders().size() == 1);
+}
+
+TEST_CASE("Download_curl_V2 - data sink can abort")
+{
+    const std::string content = MakeContent(256 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    sink.abortAfter = 1024;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+    g_progressStates.clear();
+
+    const ADUC_Result result =
+        Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 60, RecordProgress, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Failure);
+    CHECK(result.ExtendedResultCode == ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED);
+    REQUIRE_FALSE(g_progressStates.empty());
+    CHECK(g_progressStates.back() == ADUC_DownloadProgressState_Cancelled);
+}
+
+TEST_CASE("Download_curl_V2 - downloads a large payload in segments")
+{
+    const SegmentationOverride segmentation{ 4, 64 * 1024 };
+    const std::string content = MakeContent(1024 * 1024 + 123);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+    g_progressStates.clear();
+
+    const ADUC_Result result =
+        Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 0, RecordProgress, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    CHECK(fixture.ReadFile() == content);
+    CHECK(sink.content == content);
+    REQUIRE_FALSE(g_progressStates.empty());
+    CHECK(g_progressStates.back() == ADUC_DownloadProgressState_Completed);
+
+    std::vector<std::string> ranges = server.RangeHeaders();
+    std::sort(ranges.begin(), ranges.end());
+    CHECK(
+        ranges
+        == std::vector<std::string>{
+            "bytes=0-0", "bytes=0-262173", "bytes=262174-524347", "bytes=524348-786521", "bytes=786522-1048698" });
+}
+
+TEST_CASE("Download_curl_V2 - server without range support gets a single stream")
+{
+    const SegmentationOverride segmentation{ 4, 64 * 1024 };
+    const std::string content = MakeContent(1024 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    server.SetRangeSupport(false);
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    const ADUC_Result result = Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    CHECK(fixture.ReadFile() == content);
+    CHECK(sink.content == content);
+    CHECK(server.RangeHeaders() == std::vector<std::string>{ "bytes=0-0", "" });
+}
+
+TEST_CASE("Download_curl_V2 - retries a dropped segment from where it stopped")
+{
+    const SegmentationOverride segmentation{ 2, 64 * 1024 };
+    const std::string content = MakeContent(512 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    server.DropNextResponseAfter(10 * 1024);
+
+    const ADUC_Result result =
+        Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 60 /* retryTimeout */, nullptr, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    CHECK(fixture.ReadFile() == content);
+    CHECK(sink.content == content);
+
+    // The probe, two segments, and the rest of the dropped one.
+    const std::vector<std::string> ranges = server.RangeHeaders();
+    REQUIRE(ranges.size() == 4);
+    CHECK((ranges[3] == "bytes=10240-262143" || ranges[3] == "bytes=272384-524287"));
+}
+
+TEST_CASE("Download_curl_V2 - data sink can abort a segmented download")
+{
+    const SegmentationOverride segmentation{ 4, 64 * 1024 };
+    const std::string content = MakeContent(1024 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+    CollectingSink sink;
+    sink.abortAfter = 1024;
+    const ADUC_DownloadDataSink dataSink = sink.AsDataSink();
+
+    const ADUC_Result result = Download_curl_V2(&fixture.entity, "wf", fixture.WorkFolder(), 60, nullptr, &dataSink);
+
+    CHECK(result.ResultCode == ADUC_Result_Failure);
+    CHECK(result.ExtendedResultCode == ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED);
+}
+
+TEST_CASE("Download_curl - validates the file hash")
+{
+    const std::string content = MakeContent(32 * 1024);
+    TestHttpServer server{ content, "\"v1\"" };
+    DownloadFixture fixture{ server.Url(), content.size() };
+
+    ADUC_HashUtils_DigestHandle digest = ADUC_HashUtils_DigestCreate(SHA256);
+    REQUIRE(digest != nullptr);
+    REQUIRE(ADUC_HashUtils_DigestUpdate(digest, reinterpret_cast<const uint8_t*>(content.data()), content.size()));
+    char* hash = nullptr;
+    REQUIRE(ADUC_HashUtils_DigestGetHash(digest, &hash));
+    ADUC_HashUtils_DigestFree(digest);
+    std::string expectedHash = hash;
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+    free(hash);
+
+    ADUC_Hash entityHash = { &expectedHash[0], const_cast<char*>("sha256") };
+    fixture.entity.Hash = &entityHash;
+    fixture.entity.HashCount = 1;
+
+    ADUC_Result result = Download_curl(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr);
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    CHECK(fixture.ReadFile() == content);
+
+    SECTION("Valid file is not downloaded again")
+    {
+        result = Download_curl(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr);
+        CHECK(result.ResultCode == ADUC_Result_Download_Skipped_FileExists);
+        CHECK(server.RangeHeaders().size() == 1);
+    }
+
+    SECTION("Wrong content fails validation")
+    {
+        server.SetContent(MakeContent(32 * 1024).replace(0, 1, "z"), "\"v2\"");
+        std::remove(fixture.FilePath().c_str());
+
+        result = Download_curl(&fixture.entity, "wf", fixture.WorkFolder(), 0, nullptr);
+        CHECK(result.ResultCode == ADUC_Result_Failure);
+        CHECK(result.ExtendedResultCode == ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH);
+    }
+}
@@ -0,0 +1,331 @@
+/**
+ * @file test_http_server.hpp
+ * @brief A minimal in-process HTTP/1.1 file server for content downloader tests.
+ *
+ * Serves one resource with an ETag, honours Range and If-Range, keeps connections alive, and can be told to drop
+ * a response part way through to simulate a network failure, or to throttle each connection to simulate a slow link.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef TEST_HTTP_SERVER_HPP
+#define TEST_HTTP_SERVER_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TestHttpServer
+{
+public:
+    TestHttpServer(const TestHttpServer&) = delete;
+    TestHttpServer& operator=(const TestHttpServer&) = delete;
+    TestHttpServer(TestHttpServer&&) = delete;
+    TestHttpServer& operator=(TestHttpServer&&) = delete;
+
+    /**
+     * @brief Starts serving @p content at /payload on an ephemeral loopback port.
+     */
+    TestHttpServer(std::string content, std::string etag) : _content(std::move(content)), _etag(std::move(etag))
+    {
+        _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        listen(_listenFd, 16);
+
+        socklen_t length = sizeof(addr);
+        getsockname(_listenFd, reinterpret_cast<sockaddr*>(&addr), &length);
+        _port = ntohs(addr.sin_port);
+
+        _acceptThread = std::thread{ &TestHttpServer::AcceptLoop, this };
+    }
+
+    ~TestHttpServer()
+    {
+        _stopping = true;
+        shutdown(_listenFd, SHUT_RDWR);
+        close(_listenFd);
+        _acceptThread.join();
+
+        // No connections are added once the accept thread is gone. Don't hold _mutex; connections take it.
+        for (int fd : _connectionFds)
+        {
+            shutdown(fd, SHUT_RDWR);
+        }
+        for (std::thread& thread : _connectionThreads)
+        {
+            thread.join();
+        }
+        for (int fd : _connectionFds)
+        {
+            close(fd);
+        }
+    }
+
+    std::string Url(const std::string& path = "/payload") const
+    {
+        return "http://127.0.0.1:" + std::to_string(_port) + path;
+    }
+
+    /**
+     * @brief Makes the next response with a body longer than @p bytes close the connection after @p bytes bytes.
+     */
+    void DropNextResponseAfter(size_t bytes)
+    {
+        _dropAfter = static_cast<long>(bytes);
+    }
+
+    /**
+     * @brief Delays each response by @p ms milliseconds, e.g. to simulate round-trip latency.
+     */
+    void SetResponseDelay(unsigned int ms)
+    {
+        _delayMs = ms;
+    }
+
+    /**
+     * @brief Limits each connection to @p bytesPerSecond bytes of body per second. 0 is unlimited.
+     */
+    void SetThrottle(size_t bytesPerSecond)
+    {
+        _bytesPerSecond = bytesPerSecond;
+    }
+
+    /**
+     * @brief Makes the server ignore Range headers and always send the whole resource.
+     */
+    void SetRangeSupport(bool supported)
+    {
+        _rangeSupport = supported;
+    }
+
+    void SetContent(std::string content, std::string etag)
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+        _content = std::move(content);
+        _etag = std::move(etag);
+    }
+
+    int ConnectionCount() const
+    {
+        return _connectionCount;
+    }
+
+    /**
+     * @brief The Range header of each request, or "" if it had none.
+     */
+    std::vector<std::string> RangeHeaders() const
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+        return _rangeHeaders;
+    }
+
+private:
+    void AcceptLoop()
+    {
+        while (!_stopping)
+        {
+            const int fd = accept(_listenFd, nullptr, nullptr);
+            if (fd < 0)
+            {
+                continue;
+            }
+
+            ++_connectionCount;
+            std::lock_guard<std::mutex> lock{ _mutex };
+            _connectionFds.push_back(fd);
+            _connectionThreads.emplace_back(&TestHttpServer::ServeConnection, this, fd);
+        }
+    }
+
+    static std::string HeaderValue(const std::string& request, const std::string& name)
+    {
+        std::string lower = request;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        std::string key = "\r\n" + name + ":";
+        std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+        const size_t pos = lower.find(key);
+        if (pos == std::string::npos)
+        {
+            return "";
+        }
+
+        const size_t begin = request.find_first_not_of(' ', pos + key.size());
+        return request.substr(begin, request.find("\r\n", begin) - begin);
+    }
+
+    static bool SendAll(int fd, const char* data, size_t length)
+    {
+        while (length > 0)
+        {
+            const ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            data += sent;
+            length -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool SendBody(int fd, const char* data, size_t length)
+    {
+        const size_t bytesPerSecond = _bytesPerSecond;
+        if (bytesPerSecond == 0)
+        {
+            return SendAll(fd, data, length);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const size_t chunkSize = std::max<size_t>(bytesPerSecond / 100, 1);
+        for (size_t sent = 0; sent < length;)
+        {
+            const size_t count = std::min(chunkSize, length - sent);
+            if (_stopping || !SendAll(fd, data + sent, count))
+            {
+                return false;
+            }
+            sent += count;
+            std::this_thread::sleep_until(start + std::chrono::microseconds(sent * 1000000 / bytesPerSecond));
+        }
+        return true;
+    }
+
+    void ServeConnection(int fd)
+    {
+        std::string buffer;
+        char chunk[4096];
+
+        for (;;)
+        {
+            size_t headerEnd;
+            while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+            {
+                const ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+                if (count <= 0)
+                {
+                    return;
+                }
+                buffer.append(chunk, static_cast<size_t>(count));
+            }
+
+            const std::string request = buffer.substr(0, headerEnd + 2);
+            buffer.erase(0, headerEnd + 4);
+
+            if (_delayMs > 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(_delayMs));
+            }
+
+            std::string content;
+            std::string etag;
+            {
+                std::lock_guard<std::mutex> lock{ _mutex };
+                content = _content;
+                etag = _etag;
+                _rangeHeaders.push_back(HeaderValue(request, "Range"));
+            }
+
+            const std::string path = request.substr(4, request.find(' ', 4) - 4);
+            std::string head;
+            size_t first = 0;
+            size_t last = content.size();
+
+            const std::string range = HeaderValue(request, "Range");
+            const std::string ifRange = HeaderValue(request, "If-Range");
+            unsigned long long rangeFirst = 0;
+            unsigned long long rangeLast = 0;
+            int rangeFields = 0;
+
+            if (path != "/payload")
+            {
+                head = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n";
+                last = 0;
+            }
+            else if (
+                _rangeSupport && !range.empty() && (ifRange.empty() || ifRange == etag)
+                && (rangeFields = sscanf(range.c_str(), "bytes=%llu-%llu", &rangeFirst, &rangeLast)) >= 1)
+            {
+                if (rangeFirst >= content.size())
+                {
+                    head = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n";
+                    last = 0;
+                }
+                else
+                {
+                    first = static_cast<size_t>(rangeFirst);
+                    if (rangeFields == 2 && rangeLast + 1 < content.size())
+                    {
+                        last = static_cast<size_t>(rangeLast + 1);
+                    }
+                    head = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-"
+                        + std::to_string(last - 1) + "/" + std::to_string(content.size()) + "\r\n";
+                }
+            }
+            else
+            {
+                head = "HTTP/1.1 200 OK\r\n";
+            }
+
+            if (last > first || head.compare(9, 3, "200") == 0)
+            {
+                head += "Content-Length: " + std::to_string(last - first) + "\r\nETag: " + etag
+                    + "\r\nAccept-Ranges: bytes\r\n";
+            }
+            head += "\r\n";
+
+            size_t bodyLength = last - first;
+            long dropAfter = _dropAfter;
+            if (dropAfter >= 0
+                && (bodyLength <= static_cast<size_t>(dropAfter) || !_dropAfter.compare_exchange_strong(dropAfter, -1)))
+            {
+                dropAfter = -1;
+            }
+            if (dropAfter >= 0)
+            {
+                bodyLength = static_cast<size_t>(dropAfter);
+            }
+
+            if (!SendAll(fd, head.data(), head.size()) || !SendBody(fd, content.data() + first, bodyLength)
+                || dropAfter >= 0)
+            {
+                shutdown(fd, SHUT_RDWR);
+                return;
+            }
+        }
+    }
+
+    std::string _content;
+    std::string _etag;
+    int _listenFd = -1;
+    unsigned short _port = 0;
+    std::atomic<bool> _stopping{ false };
+    std::atomic<long> _dropAfter{ -1 };
+    std::atomic<unsigned int> _delayMs{ 0 };
+    std::atomic<size_t> _bytesPerSecond{ 0 };
+    std::atomic<bool> _rangeSupport{ true };
+    std::atomic<int> _connectionCount{ 0 };
+
+    mutable std::mutex _mutex;
+    std::vector<std::string> _rangeHeaders;
+    std::vector<int> _connectionFds;
+    std::vector<std::thread> _connectionThreads;
+    std::thread _acceptThread;
+};
+
+#endif // TEST_HTTP_SERVER_HPP
@@ -10,11 +10,11 @@
 #include "aduc/download_handler_plugin.hpp" // DownloadHandlerPlugin
 #include <aduc/c_utils.h> // EXTERN_C_{BEGIN,END}
 #include <aduc/extension_utils.h> // GetDownloadHandlerFileEntity
-#include <aduc/hash_utils.h> // ADUC_HashUtils_VerifyWithStrongestHash
 #include <aduc/logging.h> // ADUC_Logging_GetLevel
 #include <aduc/parser_utils.h> // ADUC_FileEntity_Uninit
 #include <aduc/plugin_exception.hpp>
 #include <aduc/types/update_content.h> // ADUC_FileEntity
+#include <aduc/verified_hash_cache.h> // ADUC_VerifiedHashCache_VerifyWithStrongestHash
 #include <cstring> // memset
 #include <unordered_map>
 
@@ -80,7 +80,7 @@ DownloadHandlerPlugin* DownloadHandlerFactory::LoadDownloadHandler(const std::st
 
     FileEntityWrapper autoFileEntity(&downloadHandlerFileEntity);
 
-    if (!ADUC_HashUtils_VerifyWithStrongestHash(
+    if (!ADUC_VerifiedHashCache_VerifyWithStrongestHash(
             autoFileEntity->TargetFilename, autoFileEntity->Hash, autoFileEntity->HashCount))
     {
         Log_Error("verify hash failed for %s", autoFileEntity->TargetFilename);
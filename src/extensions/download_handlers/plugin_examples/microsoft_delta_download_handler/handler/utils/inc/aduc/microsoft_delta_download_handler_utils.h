@@ -23,6 +23,21 @@ typedef ADUC_Result (*ProcessDeltaUpdateFn)(
 typedef ADUC_Result (*DownloadDeltaUpdateFn)(
     const ADUC_WorkflowHandle workflowHandle, const ADUC_RelatedFile* relatedFile);
 
+/**
+ * @brief A source update being read ahead while its delta update downloads.
+ */
+typedef struct tagADUC_SourcePrefetch ADUC_SourcePrefetch;
+
+/**
+ * @brief The outcome of reading a source update ahead.
+ */
+typedef enum tagADUC_SourcePrefetchResult
+{
+    ADUC_SourcePrefetchResult_Incomplete = 0, /**< Stopped or failed before the end; nothing is known. */
+    ADUC_SourcePrefetchResult_Verified = 1, /**< The source update has the expected hash. */
+    ADUC_SourcePrefetchResult_Mismatch = 2, /**< The source update does not have the expected hash. */
+} ADUC_SourcePrefetchResult;
+
 /**
  * @brief Processes a related file of an update for delta download handling.
  *
@@ -102,6 +117,27 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_GetDeltaUpdateDownloadSandboxPath
 ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdate(
     const char* sourceUpdateFilePath, const char* deltaUpdateFilePath, const char* targetUpdateFilePath);
 
+/**
+ * @brief Starts reading and hashing a source update in the background.
+ *
+ * @param sourceUpdateFilePath The source update path.
+ * @param sourceHash The expected base64 encoded hash of the source update.
+ * @param sourceAlg The hash algorithm of @p sourceHash, e.g. "sha256".
+ * @return ADUC_SourcePrefetch* The prefetch, or NULL if it cannot be started. Pass it to
+ * MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch.
+ */
+ADUC_SourcePrefetch* MicrosoftDeltaDownloadHandlerUtils_StartSourcePrefetch(
+    const char* sourceUpdateFilePath, const char* sourceHash, const char* sourceAlg);
+
+/**
+ * @brief Stops a prefetch that is still reading, waits for it, and frees it.
+ * @details Never waits for the rest of the source update to be read, so a prefetch cannot delay applying the delta.
+ *
+ * @param prefetch The prefetch. May be NULL.
+ * @return ADUC_SourcePrefetchResult Whether the whole source update was read, and if so, whether it matched.
+ */
+ADUC_SourcePrefetchResult MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch(ADUC_SourcePrefetch* prefetch);
+
 EXTERN_C_END
 
 #endif // MICROSOFT_DELTA_DOWNLOAD_HANDLER_UTILS_H
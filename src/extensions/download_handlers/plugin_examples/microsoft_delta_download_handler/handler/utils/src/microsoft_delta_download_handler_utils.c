@@ -44,6 +44,9 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile(
     ADUC_Result result = { .ResultCode = ADUC_Result_Failure };
     STRING_HANDLE sourceUpdatePathHandle = NULL;
     STRING_HANDLE deltaUpdatePathHandle = NULL;
+    STRING_HANDLE sourceUpdateHash = NULL;
+    STRING_HANDLE sourceUpdateAlg = NULL;
+    ADUC_SourcePrefetch* sourcePrefetch = NULL;
 
     if (workflowHandle == NULL || relatedFile == NULL || payloadFilePath == NULL || processDeltaUpdateFn == NULL)
     {
@@ -68,6 +71,19 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile(
 
     Log_Debug("cached source update found at '%s'. Downloading delta update...", STRING_c_str(sourceUpdatePathHandle));
 
+    //
+    // Read the source update ahead while the delta update downloads.
+    //
+    result =
+        MicrosoftDeltaDownloadHandlerUtils_GetSourceUpdateProperties(relatedFile, &sourceUpdateHash, &sourceUpdateAlg);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
+    sourcePrefetch = MicrosoftDeltaDownloadHandlerUtils_StartSourcePrefetch(
+        STRING_c_str(sourceUpdatePathHandle), STRING_c_str(sourceUpdateHash), STRING_c_str(sourceUpdateAlg));
+
     //
     // Download the delta update file.
     //
@@ -78,6 +94,17 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile(
         goto done;
     }
 
+    // A source update that was fully read by now must match, or applying the delta to it is wasted work.
+    if (MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch(sourcePrefetch) == ADUC_SourcePrefetchResult_Mismatch)
+    {
+        Log_Error("cached source update '%s' has unexpected hash.", STRING_c_str(sourceUpdatePathHandle));
+        sourcePrefetch = NULL;
+        result.ResultCode = ADUC_Result_Failure;
+        result.ExtendedResultCode = ADUC_ERC_DDH_SOURCE_UPDATE_HASH_MISMATCH;
+        goto done;
+    }
+    sourcePrefetch = NULL;
+
     //
     // Get the path to the downloaded delta update file in the sandbox.
     //
@@ -107,6 +134,9 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile(
 
 done:
 
+    (void)MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch(sourcePrefetch);
+    STRING_delete(sourceUpdateAlg);
+    STRING_delete(sourceUpdateHash);
     STRING_delete(deltaUpdatePathHandle);
     STRING_delete(sourceUpdatePathHandle);
 
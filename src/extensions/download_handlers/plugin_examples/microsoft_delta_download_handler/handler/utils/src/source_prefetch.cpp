@@ -0,0 +1,164 @@
+/**
+ * @file source_prefetch.cpp
+ * @brief Reads and verifies a cached source update in the background while its delta update downloads.
+ *
+ * The diff processor applies a delta from whole files, so it cannot start before the delta has fully arrived.
+ * What can overlap with the download is reading the source update: that pulls it into the page cache, so that
+ * applying the delta is not bound by disk reads, and hashes it, so a corrupt source is found before it is used.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "aduc/microsoft_delta_download_handler_utils.h"
+#include "aduc/hash_utils.h" // ADUC_HashUtils_Digest*
+#include "aduc/logging.h"
+
+#include <atomic>
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h> // open, posix_fadvise
+#include <unistd.h> // read, close
+
+/**
+ * @brief The size of each read of the source update.
+ */
+static constexpr size_t SourcePrefetchChunkSize = 1024 * 1024;
+
+struct tagADUC_SourcePrefetch
+{
+    tagADUC_SourcePrefetch(std::string path, std::string hash, SHAversion algorithm) :
+        sourcePath(std::move(path)), sourceHash(std::move(hash)), algorithm(algorithm)
+    {
+    }
+
+    std::string sourcePath;
+    std::string sourceHash;
+    SHAversion algorithm;
+    std::atomic<bool> stopRequested{ false };
+    ADUC_SourcePrefetchResult result = ADUC_SourcePrefetchResult_Incomplete;
+    std::thread thread;
+};
+
+/**
+ * @brief Reads the whole source update, feeding a digest, unless asked to stop.
+ * @param prefetch The prefetch. Only its result is written.
+ */
+static void RunSourcePrefetch(ADUC_SourcePrefetch* prefetch)
+{
+    ADUC_HashUtils_DigestHandle digest = ADUC_HashUtils_DigestCreate(prefetch->algorithm);
+    std::vector<uint8_t> buffer(SourcePrefetchChunkSize);
+    bool reachedEnd = false;
+
+    const int fd = open(prefetch->sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || digest == nullptr)
+    {
+        goto done;
+    }
+
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (!prefetch->stopRequested)
+    {
+        const ssize_t count = read(fd, buffer.data(), buffer.size());
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if (count == 0)
+        {
+            reachedEnd = true;
+            break;
+        }
+
+        if (!ADUC_HashUtils_DigestUpdate(digest, buffer.data(), static_cast<size_t>(count)))
+        {
+            break;
+        }
+    }
+
+    if (reachedEnd)
+    {
+        const bool valid =
+            ADUC_HashUtils_DigestIsValid(digest, prefetch->sourceHash.c_str(), true /* suppressErrorLog */);
+        prefetch->result = valid ? ADUC_SourcePrefetchResult_Verified : ADUC_SourcePrefetchResult_Mismatch;
+    }
+
+done:
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    ADUC_HashUtils_DigestFree(digest);
+}
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Starts reading and hashing a source update in the background.
+ *
+ * @param sourceUpdateFilePath The source update path.
+ * @param sourceHash The expected base64 encoded hash of the source update.
+ * @param sourceAlg The hash algorithm of @p sourceHash, e.g. "sha256".
+ * @return ADUC_SourcePrefetch* The prefetch, or NULL if it cannot be started. Pass it to
+ * MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch.
+ */
+ADUC_SourcePrefetch* MicrosoftDeltaDownloadHandlerUtils_StartSourcePrefetch(
+    const char* sourceUpdateFilePath, const char* sourceHash, const char* sourceAlg)
+{
+    SHAversion algorithm;
+
+    if (sourceUpdateFilePath == nullptr || sourceHash == nullptr || sourceAlg == nullptr
+        || !ADUC_HashUtils_GetShaVersionForTypeString(sourceAlg, &algorithm))
+    {
+        return nullptr;
+    }
+
+    ADUC_SourcePrefetch* prefetch = nullptr;
+    try
+    {
+        prefetch = new ADUC_SourcePrefetch{ sourceUpdateFilePath, sourceHash, algorithm };
+        prefetch->thread = std::thread{ RunSourcePrefetch, prefetch };
+    }
+    catch (...)
+    {
+        Log_Warn("Cannot start reading source update '%s' ahead.", sourceUpdateFilePath);
+        delete prefetch;
+        return nullptr;
+    }
+
+    return prefetch;
+}
+
+/**
+ * @brief Stops a prefetch that is still reading, waits for it, and frees it.
+ * @details Never waits for the rest of the source update to be read, so a prefetch cannot delay applying the delta.
+ *
+ * @param prefetch The prefetch. May be NULL.
+ * @return ADUC_SourcePrefetchResult Whether the whole source update was read, and if so, whether it matched.
+ */
+ADUC_SourcePrefetchResult MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch(ADUC_SourcePrefetch* prefetch)
+{
+    if (prefetch == nullptr)
+    {
+        return ADUC_SourcePrefetchResult_Incomplete;
+    }
+
+    prefetch->stopRequested = true;
+    prefetch->thread.join();
+
+    const ADUC_SourcePrefetchResult result = prefetch->result;
+    delete prefetch;
+
+    return result;
+}
+
+EXTERN_C_END
@@ -0,0 +1,126 @@
+/**
+ * @file microsoft_delta_download_handler_utils_perf.cpp
+ * @brief Benchmark for reading the source update ahead while a delta update downloads.
+ *
+ * Hidden from the default run. Use: microsoft_delta_download_handler_util_unit_tests "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include <catch2/catch.hpp>
+
+#include "aduc/microsoft_delta_download_handler_utils.h"
+#include <aduc/auto_dir.hpp> // aduc::AutoDir
+#include <aduc/hash_utils.h> // ADUC_HashUtils_GetFileHash
+#include <aduc/system_utils.h> // ADUC_SystemUtils_MkDirRecursiveDefault
+
+#include <chrono>
+#include <cstdlib> // free
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h> // open, posix_fadvise
+#include <unistd.h> // read, write, fsync, close
+
+#define TEST_DIR "/tmp/adutest/microsoft_delta_download_handler_utils_perf"
+
+namespace
+{
+/**
+ * @brief Stands in for applying a delta: reads the whole source update and writes a target of the same size.
+ */
+void SimulateApplyDelta(const std::string& sourcePath, const std::string& targetPath)
+{
+    std::vector<char> buffer(1024 * 1024);
+    const int in = open(sourcePath.c_str(), O_RDONLY);
+    const int out = open(targetPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    REQUIRE(in >= 0);
+    REQUIRE(out >= 0);
+
+    ssize_t count;
+    while ((count = read(in, buffer.data(), buffer.size())) > 0)
+    {
+        REQUIRE(write(out, buffer.data(), static_cast<size_t>(count)) == count);
+    }
+
+    close(in);
+    close(out);
+}
+
+/**
+ * @brief Drops the file from the page cache, as after a reboot.
+ */
+void EvictFromPageCache(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    REQUIRE(fd >= 0);
+    fsync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+} // namespace
+
+TEST_CASE("Delta update with source update read ahead", "[.][perf]")
+{
+    constexpr size_t sourceSize = 256 * 1024 * 1024;
+
+    // Time to download a 10 MiB delta update at 80 Mbit/s.
+    constexpr std::chrono::milliseconds deltaDownloadTime{ 1000 };
+
+    aduc::AutoDir testDir{ TEST_DIR };
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(TEST_DIR) == 0);
+    const std::string sourcePath = TEST_DIR "/source.swu";
+    const std::string targetPath = TEST_DIR "/target.swu";
+
+    {
+        std::mt19937 random{ 42 };
+        std::vector<uint32_t> block(1024 * 1024 / sizeof(uint32_t));
+        std::ofstream file{ sourcePath, std::ios::binary | std::ios::trunc };
+        for (size_t written = 0; written < sourceSize; written += block.size() * sizeof(uint32_t))
+        {
+            for (uint32_t& word : block)
+            {
+                word = random();
+            }
+            file.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(uint32_t));
+        }
+    }
+
+    char* sourceHash = nullptr;
+    REQUIRE(ADUC_HashUtils_GetFileHash(sourcePath.c_str(), SHA256, &sourceHash));
+
+    for (bool readAhead : { false, true })
+    {
+        EvictFromPageCache(sourcePath);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        ADUC_SourcePrefetch* prefetch = nullptr;
+        if (readAhead)
+        {
+            prefetch = MicrosoftDeltaDownloadHandlerUtils_StartSourcePrefetch(sourcePath.c_str(), sourceHash, "sha256");
+            REQUIRE(prefetch != nullptr);
+        }
+
+        std::this_thread::sleep_for(deltaDownloadTime);
+
+        const ADUC_SourcePrefetchResult prefetchResult =
+            MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch(prefetch);
+
+        SimulateApplyDelta(sourcePath, targetPath);
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        CHECK(prefetchResult != ADUC_SourcePrefetchResult_Mismatch);
+        std::cout << (readAhead ? "read ahead" : "sequential") << "\t" << (elapsed.count() * 1000.0) << " ms"
+                  << (prefetchResult == ADUC_SourcePrefetchResult_Verified ? " (source verified)" : "") << std::endl;
+    }
+
+    free(sourceHash);
+}
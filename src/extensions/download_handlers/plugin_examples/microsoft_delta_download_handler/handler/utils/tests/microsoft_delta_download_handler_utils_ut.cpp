@@ -11,13 +11,20 @@
 using Catch::Matchers::Equals;
 
 #include "aduc/microsoft_delta_download_handler_utils.h"
+#include <aduc/auto_dir.hpp> // aduc::AutoDir
 #include <aduc/parser_utils.h>
 #include <aduc/result.h> // ADUC_Result_*
+#include <aduc/source_update_cache_utils.h> // ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath
+#include <aduc/system_utils.h> // ADUC_SystemUtils_MkDirRecursiveDefault
 #include <aduc/types/adu_core.h> // ADUC_Result_*
 #include <aduc/types/update_content.h> // ADUC_RelatedFile, ADUC_FileEntity
 #include <aduc/types/workflow.h> // ADUC_WorkflowHandle
 #include <aduc/workflow_utils.h>
+#include <chrono>
+#include <fstream>
+#include <libgen.h> // dirname
 #include <regex>
+#include <thread>
 
 #define TEST_WORKFLOW_ID "7e3e7d32de4db3ef1337bac7341ab347"
 #define TEST_PAYLOAD_FILE_ID "ac47d3bab772454283ae95f0bbb1a1de"
@@ -107,23 +114,30 @@ ADUC_Result MockDownloadDeltaUpdateFn(const ADUC_WorkflowHandle _workflowHandle,
     return result;
 }
 
-TEST_CASE("MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile Cache Miss")
-{
-    ADUC_Result result = {};
+// "hello" with SHA256.
+#define TEST_HELLO_HASH "LPJNul+wow4m6DsqxbninhsWHlwfp0JecwQzYpOLmCQ="
 
-    //
-    // Arrange
-    //
+#define TEST_DIR "/tmp/adutest/microsoft_delta_download_handler_utils_ut"
+
+/**
+ * @brief Creates a workflow for the test update manifest, whose delta relates to a source update with
+ * @p sourceUpdateHash.
+ */
+static ADUC_WorkflowHandle CreateTestWorkflow(const char* sourceUpdateHash = "SOURCE_UPDATE_HASH")
+{
     JSON_Value* updateManifestTemplate = json_parse_string(updateManifest.c_str());
     REQUIRE(updateManifestTemplate != nullptr);
 
     char* serialized = json_serialize_to_string(updateManifestTemplate);
+    json_value_free(updateManifestTemplate);
     REQUIRE(serialized != nullptr);
 
     std::string serializedUpdateManifest = serialized;
     json_free_serialized_string(serialized);
     serialized = nullptr;
     serializedUpdateManifest = std::regex_replace(serializedUpdateManifest, std::regex("\""), "\\\"");
+    serializedUpdateManifest =
+        std::regex_replace(serializedUpdateManifest, std::regex("SOURCE_UPDATE_HASH"), sourceUpdateHash);
 
     std::string desired = std::regex_replace(desiredTemplate, std::regex("UPDATE_MANIFEST"), serializedUpdateManifest);
 
@@ -132,9 +146,60 @@ TEST_CASE("MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile Cache Miss")
     desired = std::regex_replace(desired, std::regex("DELTA_FILE_ID"), TEST_DELTA_FILE_ID);
 
     ADUC_WorkflowHandle handle = nullptr;
-    result = workflow_init(desired.c_str(), false, &handle);
+    ADUC_Result result = workflow_init(desired.c_str(), false, &handle);
     REQUIRE(IsAducResultCodeSuccess(result.ResultCode));
 
+    return handle;
+}
+
+/**
+ * @brief Writes @p content as the source update with hash TEST_HELLO_HASH in the cache at @p cacheBasePath.
+ */
+static std::string WriteCachedSourceUpdate(const char* cacheBasePath, const std::string& content)
+{
+    STRING_HANDLE cachePath =
+        ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath("contoso", TEST_HELLO_HASH, "sha256", cacheBasePath);
+    REQUIRE(cachePath != nullptr);
+    std::string path = STRING_c_str(cachePath);
+    STRING_delete(cachePath);
+
+    std::string dir = path;
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(dirname(&dir[0])) == 0);
+
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    file << content;
+    return path;
+}
+
+static bool g_processDeltaUpdateCalled = false;
+
+ADUC_Result RecordingProcessDeltaUpdateFn(
+    const char* _sourceUpdateFilePath, const char* _deltaUpdateFilePath, const char* _targetUpdateFilePath)
+{
+    g_processDeltaUpdateCalled = true;
+    ADUC_Result result = { ADUC_Result_Success };
+    return result;
+}
+
+/**
+ * @brief Takes long enough for the source update to be read ahead.
+ */
+ADUC_Result SlowDownloadDeltaUpdateFn(const ADUC_WorkflowHandle _workflowHandle, const ADUC_RelatedFile* _relatedFile)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ADUC_Result result = { ADUC_Result_Success };
+    return result;
+}
+
+TEST_CASE("MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile Cache Miss")
+{
+    ADUC_Result result = {};
+
+    //
+    // Arrange
+    //
+    ADUC_WorkflowHandle handle = CreateTestWorkflow();
+
     ADUC_FileEntity fileEntity;
     memset(&fileEntity, 0, sizeof(fileEntity));
     REQUIRE(workflow_get_update_file(handle, 0, &fileEntity));
@@ -148,4 +213,93 @@ TEST_CASE("MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile Cache Miss")
     CHECK(result.ResultCode == ADUC_Result_Success_Cache_Miss);
 
     ADUC_FileEntity_Uninit(&fileEntity);
+    workflow_free(handle);
+}
+
+TEST_CASE("MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile Cache Hit")
+{
+    aduc::AutoDir testDir{ TEST_DIR };
+    ADUC_WorkflowHandle handle = CreateTestWorkflow(TEST_HELLO_HASH);
+
+    ADUC_FileEntity fileEntity;
+    memset(&fileEntity, 0, sizeof(fileEntity));
+    REQUIRE(workflow_get_update_file(handle, 0, &fileEntity));
+
+    g_processDeltaUpdateCalled = false;
+
+    SECTION("Valid source update is used")
+    {
+        WriteCachedSourceUpdate(TEST_DIR, "hello");
+
+        ADUC_Result result = MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile(
+            handle,
+            &fileEntity.RelatedFiles[0],
+            "/foo/",
+            TEST_DIR,
+            RecordingProcessDeltaUpdateFn,
+            SlowDownloadDeltaUpdateFn);
+
+        CHECK(result.ResultCode == ADUC_Result_Success);
+        CHECK(g_processDeltaUpdateCalled);
+    }
+
+    SECTION("Corrupt source update found while the delta downloads is not used")
+    {
+        WriteCachedSourceUpdate(TEST_DIR, "jello");
+
+        ADUC_Result result = MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile(
+            handle,
+            &fileEntity.RelatedFiles[0],
+            "/foo/",
+            TEST_DIR,
+            RecordingProcessDeltaUpdateFn,
+            SlowDownloadDeltaUpdateFn);
+
+        CHECK(result.ResultCode == ADUC_Result_Failure);
+        CHECK(result.ExtendedResultCode == ADUC_ERC_DDH_SOURCE_UPDATE_HASH_MISMATCH);
+        CHECK_FALSE(g_processDeltaUpdateCalled);
+    }
+
+    ADUC_FileEntity_Uninit(&fileEntity);
+    workflow_free(handle);
+}
+
+TEST_CASE("MicrosoftDeltaDownloadHandlerUtils source update prefetch")
+{
+    aduc::AutoDir testDir{ TEST_DIR };
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(TEST_DIR) == 0);
+    const std::string path = TEST_DIR "/source.swu";
+
+    SECTION("Unsupported algorithm")
+    {
+        CHECK(MicrosoftDeltaDownloadHandlerUtils_StartSourcePrefetch(path.c_str(), TEST_HELLO_HASH, "md5") == nullptr);
+    }
+
+    SECTION("Missing source update")
+    {
+        ADUC_SourcePrefetch* prefetch =
+            MicrosoftDeltaDownloadHandlerUtils_StartSourcePrefetch(path.c_str(), TEST_HELLO_HASH, "sha256");
+        REQUIRE(prefetch != nullptr);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CHECK(MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch(prefetch) == ADUC_SourcePrefetchResult_Incomplete);
+    }
+
+    SECTION("Read to the end")
+    {
+        const std::string content = GENERATE(std::string{ "hello" }, std::string{ "jello" });
+        {
+            std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+            file << content;
+        }
+
+        ADUC_SourcePrefetch* prefetch =
+            MicrosoftDeltaDownloadHandlerUtils_StartSourcePrefetch(path.c_str(), TEST_HELLO_HASH, "sha256");
+        REQUIRE(prefetch != nullptr);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CHECK(
+            MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch(prefetch)
+            == (content == "hello" ? ADUC_SourcePrefetchResult_Verified : ADUC_SourcePrefetchResult_Mismatch));
+    }
+
+    CHECK(MicrosoftDeltaDownloadHandlerUtils_FinishSourcePrefetch(nullptr) == ADUC_SourcePrefetchResult_Incomplete);
 }
@@ -9,10 +9,13 @@
 #ifndef __SOURCE_UPDATE_CACHE_H__
 #define __SOURCE_UPDATE_CACHE_H__
 
+#include <aduc/c_utils.h> // EXTERN_C_*
 #include <aduc/result.h> // ADUC_RESULT
 #include <aduc/types/workflow.h> // ADUC_WorkflowHandle
 #include <azure_c_shared_utility/strings.h> // STRING_HANDLE
 
+EXTERN_C_BEGIN
+
 /**
  * @brief Looks up a source update from the source update cache.
  *
@@ -39,4 +42,6 @@ ADUC_Result ADUC_SourceUpdateCache_Lookup(
  */
 ADUC_Result ADUC_SourceUpdateCache_Move(const ADUC_WorkflowHandle workflowHandle, const char* updateCacheBasePath);
 
+EXTERN_C_END
+
 #endif // __SOURCE_UPDATE_CACHE_H__
@@ -0,0 +1,105 @@
+/**
+ * @file source_update_cache_index.hpp
+ * @brief Usage and size accounting for the source update cache, used to evict the least recently used entries.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#ifndef SOURCE_UPDATE_CACHE_INDEX_HPP
+#define SOURCE_UPDATE_CACHE_INDEX_HPP
+
+#include "aduc/source_update_cache_utils.h" // ADUC_SourceUpdateCacheBudget
+#include <map>
+#include <set>
+#include <string>
+#include <time.h> // time_t
+
+namespace ADUC
+{
+/**
+ * @brief The index of the source update cache.
+ *
+ * @details The index lives in a small file at the base of the cache. The files in the cache are the truth for
+ * which entries exist and how large they are; the index adds when each was last used as a delta source, and how
+ * often. Files the index doesn't know, e.g. from before the index existed, count as last used when modified.
+ */
+class SourceUpdateCacheIndex
+{
+public:
+    struct Entry
+    {
+        time_t lastUsed; ///< When the entry was added or last used as a delta source.
+        unsigned int hits; ///< How often the entry was used as a delta source.
+        unsigned long long sizeInBytes;
+    };
+
+    explicit SourceUpdateCacheIndex(std::string basePath);
+
+    /**
+     * @brief Loads the index file and reconciles it with the files in the cache, and with the hits recorded since the
+     * index file was last saved.
+     * @details May throw.
+     */
+    void Load();
+
+    /**
+     * @brief Atomically replaces the index file. The recorded hits are in it from then on.
+     * @return bool true on success, or if the cache doesn't exist.
+     */
+    bool Save() const;
+
+    /**
+     * @brief Records in memory that a cache file was used as a delta source, without reading or writing the index
+     * file. The next Save persists it, e.g. when the cache is next added to or evicted from.
+     * @param filePath The path of the cache file.
+     * @param now The current time.
+     */
+    void RecordHit(const std::string& filePath, time_t now) const;
+
+    /**
+     * @brief Records that a cache file was added or used as a delta source.
+     * @param filePath The path of the cache file.
+     * @param now The current time.
+     * @param isHit true if the file was used as a delta source, false if it was added.
+     */
+    void Touch(const std::string& filePath, time_t now, bool isHit);
+
+    /**
+     * @brief Deletes the least recently used entries until the cache fits in @p budget.
+     * @details Ties are broken by evicting the less often used entry first.
+     * @param budget The budget.
+     * @param keep The paths of entries never to evict, e.g. the payloads of the current update.
+     * @param incomingBytes The bytes about to be added to the cache.
+     * @param freeBytes The free space on the cache's file system.
+     * @return bool false if an entry that had to go couldn't be deleted.
+     */
+    bool Evict(
+        const ADUC_SourceUpdateCacheBudget& budget,
+        const std::set<std::string>& keep,
+        unsigned long long incomingBytes,
+        unsigned long long freeBytes);
+
+    unsigned long long GetTotalBytes() const;
+
+    const std::map<std::string, Entry>& GetEntries() const
+    {
+        return _entries;
+    }
+
+    /**
+     * @brief The space available to unprivileged users on the file system of @p path.
+     * @return unsigned long long The free bytes, or ULLONG_MAX if unknown.
+     */
+    static unsigned long long GetFreeBytes(const std::string& path);
+
+private:
+    std::string IndexFilePath() const;
+
+    std::string _basePath;
+    std::map<std::string, Entry> _entries; ///< By absolute file path.
+};
+
+} // namespace ADUC
+
+#endif // SOURCE_UPDATE_CACHE_INDEX_HPP
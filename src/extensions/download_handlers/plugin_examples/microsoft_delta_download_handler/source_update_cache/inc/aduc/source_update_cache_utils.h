@@ -13,10 +13,20 @@
 #include <aduc/result.h> // ADUC_Result
 #include <aduc/types/workflow.h> // ADUC_WorkflowHandle
 #include <azure_c_shared_utility/strings.h> // STRING_HANDLE
+#include <stdbool.h>
 #include <sys/types.h> // off_t
 
 EXTERN_C_BEGIN
 
+/**
+ * @brief Limits on the space the source update cache may use.
+ */
+typedef struct tagADUC_SourceUpdateCacheBudget
+{
+    unsigned long long maxCacheBytes; /**< The most bytes of source updates to keep. 0 is unlimited. */
+    unsigned long long minFreeBytes; /**< The free space to leave on the cache's file system. 0 is none. */
+} ADUC_SourceUpdateCacheBudget;
+
 STRING_HANDLE ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath(
     const char* provider, const char* hash, const char* alg, const char* updateCacheBasePath);
 
@@ -26,6 +36,16 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
 int ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(
     const ADUC_WorkflowHandle workflowHandle, off_t totalSize, const char* updateCacheBasePath);
 
+bool ADUC_SourceUpdateCacheUtils_RecordCacheEntry(const char* cacheFilePath, const char* updateCacheBasePath);
+
+bool ADUC_SourceUpdateCacheUtils_TouchCacheEntry(const char* cacheFilePath, const char* updateCacheBasePath);
+
+int ADUC_SourceUpdateCacheUtils_EvictFromUpdateCache(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_SourceUpdateCacheBudget* budget,
+    off_t incomingSize,
+    const char* updateCacheBasePath);
+
 EXTERN_C_END
 
 #endif // SOURCE_UPDATE_CACHE_UTILS_H
@@ -9,15 +9,20 @@
 
 #include "aduc/source_update_cache.h"
 #include "aduc/source_update_cache_utils.h" // ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath
+#include <aduc/config_utils.h> // ADUC_ConfigInfo
+#include <aduc/logging.h>
+#include <aduc/parser_utils.h> // ADUC_FileEntity_Uninit
 #include <aduc/permission_utils.h> // PermissionUtils_VerifyFilemodeBitmask
 #include <aduc/system_utils.h> // SystemUtils_IsFile, ADUC_SystemUtils_MkDirRecursiveAduUser
 #include <aduc/types/adu_core.h> // ADUC_Result_Success_Cache_Miss
+#include <aduc/workflow_utils.h> // workflow_*
 #include <azure_c_shared_utility/crt_abstractions.h> // for mallocAndStrcpy_s
 #include <azure_c_shared_utility/strings.h>
 #include <libgen.h> // dirname
 #include <stdio.h> // rename
 #include <stdlib.h> // free
-#include <sys/stat.h> // S_IRUSR
+#include <string.h> // memset
+#include <sys/stat.h> // S_IRUSR, stat
 
 /**
  * @brief Looks up a source update from the source update cache.
@@ -54,6 +59,12 @@ ADUC_Result ADUC_SourceUpdateCache_Lookup(
         goto done;
     }
 
+    // A hit keeps the source update from being evicted soon.
+    if (!ADUC_SourceUpdateCacheUtils_TouchCacheEntry(STRING_c_str(filePath), updateCacheBasePath))
+    {
+        Log_Warn("Cannot record use of '%s' in the cache index.", STRING_c_str(filePath));
+    }
+
     *outSourceUpdatePath = filePath;
     filePath = NULL;
 
@@ -65,11 +76,61 @@ done:
     return result;
 }
 
-static ADUC_Result getPayloadTotalSize(const ADUC_WorkflowHandle workflowHandle, off_t* outSize)
+/**
+ * @brief Gets the total size of the current update's payloads in the download sandbox.
+ *
+ * @param workflowHandle The workflow handle.
+ * @param outSize The total size in bytes. Payloads not in the sandbox count as 0.
+ */
+static void getPayloadTotalSize(const ADUC_WorkflowHandle workflowHandle, off_t* outSize)
 {
-    ADUC_Result result = { .ResultCode = ADUC_Result_Failure };
+    ADUC_FileEntity fileEntity;
+    memset(&fileEntity, 0, sizeof(fileEntity));
+    STRING_HANDLE sandboxFilePath = NULL;
+    struct stat st;
+
     *outSize = 0;
-    return result;
+
+    size_t countPayloads = workflow_get_update_files_count(workflowHandle);
+    for (size_t index = 0; index < countPayloads; ++index)
+    {
+        if (!workflow_get_update_file(workflowHandle, index, &fileEntity))
+        {
+            continue;
+        }
+
+        if (workflow_get_entity_workfolder_filepath(workflowHandle, &fileEntity, &sandboxFilePath)
+            && stat(STRING_c_str(sandboxFilePath), &st) == 0)
+        {
+            *outSize += st.st_size;
+        }
+
+        STRING_delete(sandboxFilePath);
+        sandboxFilePath = NULL;
+        ADUC_FileEntity_Uninit(&fileEntity);
+    }
+}
+
+/**
+ * @brief Gets the cache budget from du-config.json.
+ *
+ * @param outBudget The budget. The defaults if the config cannot be read.
+ */
+static void getCacheBudget(ADUC_SourceUpdateCacheBudget* outBudget)
+{
+    const unsigned long long megabyte = 1024ULL * 1024ULL;
+
+    outBudget->maxCacheBytes = ADUC_CONFIG_DEFAULT_SOURCE_UPDATE_CACHE_MAX_MEGABYTES * megabyte;
+    outBudget->minFreeBytes = ADUC_CONFIG_DEFAULT_SOURCE_UPDATE_CACHE_MIN_FREE_MEGABYTES * megabyte;
+
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config != NULL)
+    {
+        outBudget->maxCacheBytes = config->sourceUpdateCacheMaxMegabytes * megabyte;
+        outBudget->minFreeBytes = config->sourceUpdateCacheMinFreeMegabytes * megabyte;
+    }
+
+    ADUC_ConfigInfo_ReleaseInstance(config);
 }
 
 /**
@@ -83,14 +144,18 @@ ADUC_Result ADUC_SourceUpdateCache_Move(const ADUC_WorkflowHandle workflowHandle
 {
     ADUC_Result result = { .ResultCode = ADUC_Result_Failure };
 
+    ADUC_SourceUpdateCacheBudget budget;
+    getCacheBudget(&budget);
+
     off_t spaceRequired = 0;
-    result = getPayloadTotalSize(workflowHandle, &spaceRequired);
+    getPayloadTotalSize(workflowHandle, &spaceRequired);
 
     int res = -1;
 
 #ifndef TWO_PHASE_COMMIT
-    // When NOT two-phase commit, proactively make space by pre-purging cache dir of oldest files upto size of sandboxFilePath.
-    res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(workflowHandle, spaceRequired, updateCacheBasePath);
+    // When NOT two-phase commit, proactively make space by pre-purging least recently used files, so that the cache
+    // plus the payloads in the sandbox fit the budget.
+    res = ADUC_SourceUpdateCacheUtils_EvictFromUpdateCache(workflowHandle, &budget, spaceRequired, updateCacheBasePath);
     if (res != 0)
     {
         Log_Error("pre-purge failed, res %d", res);
@@ -108,8 +173,8 @@ ADUC_Result ADUC_SourceUpdateCache_Move(const ADUC_WorkflowHandle workflowHandle
     }
 
 #ifdef TWO_PHASE_COMMIT
-    // In the case of two-phase commit, purge cache dir of oldest files upto size of sandboxFilePath AFTER move/copy.
-    res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(workflowHandle, spaceRequired, updateCacheBasePath);
+    // In the case of two-phase commit, purge least recently used files until the cache fits the budget AFTER move/copy.
+    res = ADUC_SourceUpdateCacheUtils_EvictFromUpdateCache(workflowHandle, &budget, 0, updateCacheBasePath);
     if (res != 0)
     {
         Log_Error("post-purge failed, res %d", res);
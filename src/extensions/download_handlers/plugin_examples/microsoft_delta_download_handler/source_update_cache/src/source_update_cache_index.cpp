@@ -0,0 +1,430 @@
+/**
+ * @file source_update_cache_index.cpp
+ * @brief Usage and size accounting for the source update cache, used to evict the least recently used entries.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "aduc/source_update_cache_index.hpp"
+#include "aduc/source_update_cache_utils.h"
+#include <aduc/file_utils.hpp> // aduc::findFilesInDir
+#include <aduc/logging.h>
+#include <aduc/parser_utils.h> // ADUC_FileEntity_Uninit
+#include <aduc/string_c_utils.h> // IsNullOrEmpty
+#include <aduc/system_utils.h> // SystemUtils_IsDir
+#include <aduc/types/update_content.h> // ADUC_FileEntity
+#include <aduc/workflow_utils.h> // workflow_*
+#include <algorithm> // std::max, std::sort
+#include <cerrno>
+#include <climits> // ULLONG_MAX
+#include <cstdio> // rename
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h> // stat
+#include <sys/statvfs.h> // statvfs
+#include <unistd.h> // fsync, unlink
+#include <utility> // std::move
+#include <vector>
+
+/**
+ * @brief The index file, at the base of the cache. findFilesInDir skips dot files, so it is never a cache entry.
+ */
+#define SOURCE_UPDATE_CACHE_INDEX_FILE_NAME ".cache_index"
+
+/**
+ * @brief Serializes updates of the index; delta download handlers may look up sources in parallel.
+ */
+static std::mutex s_indexMutex;
+
+/**
+ * @brief A use of a cache file as a delta source that is not in the index file yet.
+ */
+struct PendingHit
+{
+    time_t lastUsed;
+    unsigned int hits;
+};
+
+/**
+ * @brief The hits not saved yet, by cache base path, then by file path. Guarded by s_pendingHitsMutex.
+ */
+static std::map<std::string, std::map<std::string, PendingHit>> s_pendingHits;
+static std::mutex s_pendingHitsMutex;
+
+namespace ADUC
+{
+SourceUpdateCacheIndex::SourceUpdateCacheIndex(std::string basePath) : _basePath(std::move(basePath))
+{
+}
+
+std::string SourceUpdateCacheIndex::IndexFilePath() const
+{
+    return _basePath + "/" SOURCE_UPDATE_CACHE_INDEX_FILE_NAME;
+}
+
+void SourceUpdateCacheIndex::Load()
+{
+    _entries.clear();
+
+    if (!SystemUtils_IsDir(_basePath.c_str(), nullptr))
+    {
+        return;
+    }
+
+    // Line format: <lastUsed> <hits> <sizeInBytes> <path relative to the base>
+    std::map<std::string, Entry> recorded;
+    std::ifstream indexFile{ IndexFilePath() };
+    std::string line;
+    while (std::getline(indexFile, line))
+    {
+        std::istringstream fields{ line };
+        long long lastUsed = 0;
+        Entry entry = {};
+        std::string relativePath;
+        if (fields >> lastUsed >> entry.hits >> entry.sizeInBytes && fields.get() == ' '
+            && std::getline(fields, relativePath) && !relativePath.empty())
+        {
+            entry.lastUsed = static_cast<time_t>(lastUsed);
+            recorded[_basePath + "/" + relativePath] = entry;
+        }
+    }
+
+    std::vector<std::string> filesInCache;
+    aduc::findFilesInDir(_basePath, &filesInCache);
+
+    for (const std::string& filePath : filesInCache)
+    {
+        struct stat st = {};
+        if (stat(filePath.c_str(), &st) != 0)
+        {
+            continue;
+        }
+
+        auto found = recorded.find(filePath);
+        Entry entry = (found != recorded.end()) ? found->second : Entry{ st.st_mtime, 0, 0 };
+        entry.sizeInBytes = static_cast<unsigned long long>(st.st_size);
+        _entries[filePath] = entry;
+    }
+
+    std::lock_guard<std::mutex> lock{ s_pendingHitsMutex };
+    for (const auto& hit : s_pendingHits[_basePath])
+    {
+        auto entry = _entries.find(hit.first);
+        if (entry != _entries.end())
+        {
+            entry->second.lastUsed = std::max(entry->second.lastUsed, hit.second.lastUsed);
+            entry->second.hits += hit.second.hits;
+        }
+    }
+}
+
+bool SourceUpdateCacheIndex::Save() const
+{
+    if (!SystemUtils_IsDir(_basePath.c_str(), nullptr))
+    {
+        return true;
+    }
+
+    const std::string indexFilePath = IndexFilePath();
+    const std::string tempFilePath = indexFilePath + ".tmp";
+
+    FILE* file = fopen(tempFilePath.c_str(), "w");
+    if (file == nullptr)
+    {
+        Log_Error("open '%s', errno: %d", tempFilePath.c_str(), errno);
+        return false;
+    }
+
+    bool succeeded = true;
+    for (const auto& item : _entries)
+    {
+        if (fprintf(
+                file,
+                "%lld %u %llu %s\n",
+                static_cast<long long>(item.second.lastUsed),
+                item.second.hits,
+                item.second.sizeInBytes,
+                item.first.c_str() + _basePath.size() + 1)
+            < 0)
+        {
+            succeeded = false;
+            break;
+        }
+    }
+
+    // Flush to disk before the rename, so that a power loss leaves either the old or the new index.
+    succeeded = succeeded && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    succeeded = (fclose(file) == 0) && succeeded;
+
+    if (!succeeded || rename(tempFilePath.c_str(), indexFilePath.c_str()) != 0)
+    {
+        Log_Error("write '%s', errno: %d", indexFilePath.c_str(), errno);
+        unlink(tempFilePath.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock{ s_pendingHitsMutex };
+    s_pendingHits.erase(_basePath);
+    return true;
+}
+
+void SourceUpdateCacheIndex::RecordHit(const std::string& filePath, time_t now) const
+{
+    if (filePath.compare(0, _basePath.size() + 1, _basePath + "/") != 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{ s_pendingHitsMutex };
+    PendingHit& hit = s_pendingHits[_basePath][filePath];
+    hit.lastUsed = now;
+    ++hit.hits;
+}
+
+void SourceUpdateCacheIndex::Touch(const std::string& filePath, time_t now, bool isHit)
+{
+    if (filePath.compare(0, _basePath.size() + 1, _basePath + "/") != 0)
+    {
+        return;
+    }
+
+    struct stat st = {};
+    if (stat(filePath.c_str(), &st) != 0)
+    {
+        return;
+    }
+
+    Entry& entry = _entries[filePath];
+    entry.lastUsed = now;
+    entry.sizeInBytes = static_cast<unsigned long long>(st.st_size);
+    if (isHit)
+    {
+        ++entry.hits;
+    }
+}
+
+bool SourceUpdateCacheIndex::Evict(
+    const ADUC_SourceUpdateCacheBudget& budget,
+    const std::set<std::string>& keep,
+    unsigned long long incomingBytes,
+    unsigned long long freeBytes)
+{
+    bool succeeded = true;
+    unsigned long long totalBytes = GetTotalBytes();
+
+    using Candidate = std::map<std::string, Entry>::const_iterator;
+    std::vector<Candidate> candidates;
+    for (auto iter = _entries.cbegin(); iter != _entries.cend(); ++iter)
+    {
+        if (keep.find(iter->first) == keep.end())
+        {
+            candidates.push_back(iter);
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (a->second.lastUsed != b->second.lastUsed)
+        {
+            return a->second.lastUsed < b->second.lastUsed;
+        }
+        return a->second.hits < b->second.hits;
+    });
+
+    for (const Candidate& candidate : candidates)
+    {
+        const bool overBudget = budget.maxCacheBytes != 0 && totalBytes + incomingBytes > budget.maxCacheBytes;
+        const bool belowFloor = budget.minFreeBytes != 0 && freeBytes < budget.minFreeBytes + incomingBytes;
+        if (!overBudget && !belowFloor)
+        {
+            break;
+        }
+
+        const unsigned long long size = candidate->second.sizeInBytes;
+        if (unlink(candidate->first.c_str()) != 0 && errno != ENOENT)
+        {
+            Log_Error("unlink '%s' - errno: %d", candidate->first.c_str(), errno);
+            succeeded = false; // keep going to attempt to free up space.
+            continue;
+        }
+
+        Log_Info("Evicted '%s' (%llu bytes) from the source update cache.", candidate->first.c_str(), size);
+        totalBytes -= size;
+        freeBytes += size;
+        _entries.erase(candidate);
+    }
+
+    return succeeded;
+}
+
+unsigned long long SourceUpdateCacheIndex::GetTotalBytes() const
+{
+    unsigned long long totalBytes = 0;
+    for (const auto& item : _entries)
+    {
+        totalBytes += item.second.sizeInBytes;
+    }
+    return totalBytes;
+}
+
+unsigned long long SourceUpdateCacheIndex::GetFreeBytes(const std::string& path)
+{
+    struct statvfs st = {};
+    if (statvfs(path.c_str(), &st) != 0)
+    {
+        return ULLONG_MAX;
+    }
+    return static_cast<unsigned long long>(st.f_bavail) * st.f_frsize;
+}
+
+} // namespace ADUC
+
+/**
+ * @brief The base path of the cache.
+ */
+static std::string GetUpdateCacheBasePath(const char* updateCacheBasePath)
+{
+    return IsNullOrEmpty(updateCacheBasePath) ? ADUC_DELTA_DOWNLOAD_HANDLER_SOURCE_UPDATE_CACHE_DIR
+                                              : updateCacheBasePath;
+}
+
+/**
+ * @brief Records a use of a cache file in the index.
+ * @details A hit is only recorded in memory; a lookup must not rescan the cache and rewrite the index file.
+ */
+static bool TouchCacheEntry(const char* cacheFilePath, const char* updateCacheBasePath, bool isHit)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock{ s_indexMutex };
+
+        ADUC::SourceUpdateCacheIndex index{ GetUpdateCacheBasePath(updateCacheBasePath) };
+        if (isHit)
+        {
+            index.RecordHit(cacheFilePath, time(nullptr));
+            return true;
+        }
+
+        index.Load();
+        index.Touch(cacheFilePath, time(nullptr), isHit);
+        return index.Save();
+    }
+    catch (const std::exception& e)
+    {
+        Log_Error("Unhandled std exception: %s", e.what());
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+    }
+
+    return false;
+}
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Records in the cache index that a file was added to the update cache.
+ * @param cacheFilePath The path of the file in the update cache.
+ * @param updateCacheBasePath The path to the base of update cache. NULL for default.
+ * @return bool true on success.
+ */
+bool ADUC_SourceUpdateCacheUtils_RecordCacheEntry(const char* cacheFilePath, const char* updateCacheBasePath)
+{
+    return TouchCacheEntry(cacheFilePath, updateCacheBasePath, false /* isHit */);
+}
+
+/**
+ * @brief Records that a file in the update cache was used as a delta source. Kept in memory until the cache index is
+ * next saved.
+ * @param cacheFilePath The path of the file in the update cache.
+ * @param updateCacheBasePath The path to the base of update cache. NULL for default.
+ * @return bool true on success.
+ */
+bool ADUC_SourceUpdateCacheUtils_TouchCacheEntry(const char* cacheFilePath, const char* updateCacheBasePath)
+{
+    return TouchCacheEntry(cacheFilePath, updateCacheBasePath, true /* isHit */);
+}
+
+/**
+ * @brief Deletes the least recently used files from the update cache until it, plus incomingSize, fits the budget.
+ * Excludes payload files of the current update.
+ * @param workflowHandle The workflow handle.
+ * @param budget The cache budget.
+ * @param incomingSize The size in bytes of payloads about to be moved into the update cache.
+ * @param updateCacheBasePath The path to the base of update cache. NULL for default.
+ * @return int 0 on success.
+ */
+int ADUC_SourceUpdateCacheUtils_EvictFromUpdateCache(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_SourceUpdateCacheBudget* budget,
+    off_t incomingSize,
+    const char* updateCacheBasePath)
+{
+    int result = -1;
+    ADUC_FileEntity fileEntity = {};
+    ADUC_UpdateId* updateId = nullptr;
+
+    try
+    {
+        // The current update's payloads are the likeliest delta sources of the next update.
+        std::set<std::string> keep;
+        const ADUC_Result updateIdResult = workflow_get_expected_update_id(workflowHandle, &updateId);
+        const size_t countPayloads = workflow_get_update_files_count(workflowHandle);
+        for (size_t index = 0; IsAducResultCodeSuccess(updateIdResult.ResultCode) && index < countPayloads; ++index)
+        {
+            if (!workflow_get_update_file(workflowHandle, index, &fileEntity))
+            {
+                continue;
+            }
+
+            if (fileEntity.HashCount > 0)
+            {
+                STRING_HANDLE cacheFilePath = ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath(
+                    updateId->Provider, fileEntity.Hash[0].value, fileEntity.Hash[0].type, updateCacheBasePath);
+                if (cacheFilePath != nullptr)
+                {
+                    keep.insert(STRING_c_str(cacheFilePath));
+                    STRING_delete(cacheFilePath);
+                }
+            }
+
+            ADUC_FileEntity_Uninit(&fileEntity);
+        }
+
+        std::lock_guard<std::mutex> lock{ s_indexMutex };
+
+        const std::string basePath = GetUpdateCacheBasePath(updateCacheBasePath);
+        ADUC::SourceUpdateCacheIndex index{ basePath };
+        index.Load();
+
+        const bool evicted = index.Evict(
+            *budget,
+            keep,
+            incomingSize > 0 ? static_cast<unsigned long long>(incomingSize) : 0,
+            ADUC::SourceUpdateCacheIndex::GetFreeBytes(basePath));
+
+        Log_Info("Source update cache holds %llu bytes.", index.GetTotalBytes());
+
+        if (index.Save() && evicted)
+        {
+            result = 0;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        Log_Error("Unhandled std exception: %s", e.what());
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+    }
+
+    ADUC_FileEntity_Uninit(&fileEntity);
+    ADUC_UpdateId_UninitAndFree(updateId);
+
+    return result;
+}
+
+EXTERN_C_END
@@ -158,6 +158,17 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
     char dirPath[1024] = "";
 
     size_t countPayloads = workflow_get_update_files_count(workflowHandle);
+    if (countPayloads > 0)
+    {
+        // The same for all payloads; getting it parses the update manifest.
+        result = workflow_get_expected_update_id(workflowHandle, &updateId);
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            Log_Error("get updateId, erc 0x%08x", result.ExtendedResultCode);
+            goto done;
+        }
+    }
+
     for (size_t index = 0; index < countPayloads; ++index)
     {
         if (!workflow_get_update_file(workflowHandle, index, &fileEntity))
@@ -168,13 +179,6 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
 
         workflow_get_entity_workfolder_filepath(workflowHandle, &fileEntity, &sandboxUpdatePayloadFile);
 
-        result = workflow_get_expected_update_id(workflowHandle, &updateId);
-        if (IsAducResultCodeFailure(result.ResultCode))
-        {
-            Log_Error("get updateId, erc 0x%08x", result.ExtendedResultCode);
-            goto done;
-        }
-
         // When update is already installed, payloads would not be downloaded but it would still
         // attempt to move to cache with OnUpdateWorkflowCompleted contract call because overall
         // is it Apply Success result, so guard against non-existent sandbox file.
@@ -226,22 +230,27 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
         {
             Log_Warn("rename, errno %d", errno);
 
-            // fallback to copy
+            // fallback to copy, replacing any stale cache file as rename would have.
             //
-            if (ADUC_SystemUtils_CopyFileToDir(
-                    STRING_c_str(sandboxUpdatePayloadFile), dirPathCache, false /* overwriteExistingFile */)
+            if (ADUC_SystemUtils_CopyFile(
+                    STRING_c_str(sandboxUpdatePayloadFile),
+                    STRING_c_str(updateCacheFilePath),
+                    true /* overwriteExistingFile */)
                 != 0)
             {
-                Log_Error("Copy Failed");
+                Log_Error("Copy Failed, errno %d", errno);
                 result.ExtendedResultCode = ADUC_ERC_MOVE_COPYFALLBACK;
                 goto done;
             }
         }
 
-        ADUC_FileEntity_Uninit(&fileEntity);
+        // The index only orders eviction; the cache still works without it.
+        if (!ADUC_SourceUpdateCacheUtils_RecordCacheEntry(STRING_c_str(updateCacheFilePath), updateCacheBasePath))
+        {
+            Log_Warn("Cannot record '%s' in the cache index.", STRING_c_str(updateCacheFilePath));
+        }
 
-        ADUC_UpdateId_UninitAndFree(updateId);
-        updateId = NULL;
+        ADUC_FileEntity_Uninit(&fileEntity);
 
         STRING_delete(updateCacheFilePath);
         updateCacheFilePath = NULL;
@@ -0,0 +1,252 @@
+/**
+ * @file source_update_cache_index_ut.cpp
+ * @brief Unit Tests for the source update cache index and eviction.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "aduc/source_update_cache_index.hpp"
+#include "aduc/source_update_cache.h"
+
+#include <catch2/catch.hpp>
+#include <aduc/auto_dir.hpp> // aduc::AutoDir
+#include <aduc/system_utils.h> // SystemUtils_IsFile
+#include <aduc/types/adu_core.h> // ADUC_Result_*
+#include <climits> // ULLONG_MAX
+#include <fstream> // std::ofstream
+#include <string>
+#include <sys/stat.h> // stat
+#include <unistd.h> // unlink
+#include <utime.h> // utime
+
+#define TEST_DIR "/tmp/adutest/source_update_cache_index_ut"
+
+#define TEST_CACHE_BASE_PATH TEST_DIR "/test_cache"
+
+#define TEST_CACHE_PROVIDER_PATH TEST_CACHE_BASE_PATH "/TestProvider"
+
+using ADUC::SourceUpdateCacheIndex;
+
+namespace
+{
+/**
+ * @brief Writes a cache file of @p size bytes, last modified at @p mtime.
+ */
+std::string WriteCacheFile(const std::string& name, size_t size, time_t mtime = 1000)
+{
+    const std::string path = TEST_CACHE_PROVIDER_PATH "/" + name;
+    {
+        std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+        file << std::string(size, 'x');
+    }
+    struct utimbuf times = { mtime, mtime };
+    REQUIRE(utime(path.c_str(), &times) == 0);
+    return path;
+}
+
+unsigned long long SizeOnDisk(const SourceUpdateCacheIndex& index)
+{
+    unsigned long long total = 0;
+    for (const auto& item : index.GetEntries())
+    {
+        struct stat st = {};
+        REQUIRE(stat(item.first.c_str(), &st) == 0);
+        total += static_cast<unsigned long long>(st.st_size);
+    }
+    return total;
+}
+
+} // namespace
+
+TEST_CASE("SourceUpdateCacheIndex - Load reconciles the index with the files in the cache")
+{
+    aduc::AutoDir testBaseDir(TEST_DIR);
+    aduc::AutoDir testCache(TEST_CACHE_PROVIDER_PATH);
+    REQUIRE(testBaseDir.RemoveDir());
+    REQUIRE(testCache.CreateDir());
+
+    const std::string a = WriteCacheFile("sha256-a", 100, 1000);
+    const std::string b = WriteCacheFile("sha256-b", 200, 2000);
+
+    {
+        SourceUpdateCacheIndex index{ TEST_CACHE_BASE_PATH };
+        index.Load();
+
+        // Files unknown to the index count as last used when modified.
+        REQUIRE(index.GetEntries().size() == 2);
+        CHECK(index.GetEntries().at(a).lastUsed == 1000);
+        CHECK(index.GetEntries().at(b).lastUsed == 2000);
+        CHECK(index.GetTotalBytes() == 300);
+
+        index.Touch(a, 5000, true /* isHit */);
+        REQUIRE(index.Save());
+    }
+
+    CHECK(SystemUtils_IsFile(TEST_CACHE_BASE_PATH "/.cache_index", nullptr));
+    CHECK_FALSE(SystemUtils_IsFile(TEST_CACHE_BASE_PATH "/.cache_index.tmp", nullptr));
+
+    REQUIRE(unlink(b.c_str()) == 0);
+    const std::string c = WriteCacheFile("sha256-c", 50, 3000);
+
+    SourceUpdateCacheIndex index{ TEST_CACHE_BASE_PATH };
+    index.Load();
+
+    REQUIRE(index.GetEntries().size() == 2);
+    CHECK(index.GetEntries().at(a).lastUsed == 5000);
+    CHECK(index.GetEntries().at(a).hits == 1);
+    CHECK(index.GetEntries().at(c).lastUsed == 3000);
+    CHECK(index.GetEntries().count(b) == 0);
+    CHECK(index.GetTotalBytes() == 150);
+}
+
+TEST_CASE("SourceUpdateCacheIndex - Evict removes least recently used entries first")
+{
+    aduc::AutoDir testBaseDir(TEST_DIR);
+    aduc::AutoDir testCache(TEST_CACHE_PROVIDER_PATH);
+    REQUIRE(testBaseDir.RemoveDir());
+    REQUIRE(testCache.CreateDir());
+
+    const std::string oldest = WriteCacheFile("sha256-oldest", 100, 1000);
+    const std::string rarelyUsed = WriteCacheFile("sha256-rarely", 100, 2000);
+    const std::string oftenUsed = WriteCacheFile("sha256-often", 100, 2000);
+    const std::string kept = WriteCacheFile("sha256-kept", 100, 500);
+    const std::string newest = WriteCacheFile("sha256-newest", 100, 3000);
+
+    SourceUpdateCacheIndex index{ TEST_CACHE_BASE_PATH };
+    index.Load();
+    index.Touch(oftenUsed, 2000, true /* isHit */);
+
+    ADUC_SourceUpdateCacheBudget budget = {};
+
+    SECTION("Byte budget")
+    {
+        budget.maxCacheBytes = 300;
+        CHECK(index.Evict(budget, { kept }, 0 /* incomingBytes */, ULLONG_MAX /* freeBytes */));
+
+        CHECK_FALSE(SystemUtils_IsFile(oldest.c_str(), nullptr));
+        CHECK_FALSE(SystemUtils_IsFile(rarelyUsed.c_str(), nullptr));
+        CHECK(SystemUtils_IsFile(oftenUsed.c_str(), nullptr));
+        CHECK(SystemUtils_IsFile(kept.c_str(), nullptr));
+        CHECK(SystemUtils_IsFile(newest.c_str(), nullptr));
+        CHECK(index.GetTotalBytes() == 300);
+    }
+
+    SECTION("Byte budget makes room for incoming payloads")
+    {
+        budget.maxCacheBytes = 300;
+        CHECK(index.Evict(budget, { kept }, 150 /* incomingBytes */, ULLONG_MAX /* freeBytes */));
+        CHECK(index.GetTotalBytes() == 100);
+        CHECK(SystemUtils_IsFile(kept.c_str(), nullptr));
+    }
+
+    SECTION("Free space floor")
+    {
+        budget.minFreeBytes = 1000;
+        CHECK(index.Evict(budget, { kept }, 50 /* incomingBytes */, 880 /* freeBytes */));
+
+        // 170 bytes short, so two entries go.
+        CHECK_FALSE(SystemUtils_IsFile(oldest.c_str(), nullptr));
+        CHECK_FALSE(SystemUtils_IsFile(rarelyUsed.c_str(), nullptr));
+        CHECK(index.GetTotalBytes() == 300);
+    }
+
+    SECTION("Within budget evicts nothing")
+    {
+        budget.maxCacheBytes = 1000;
+        budget.minFreeBytes = 1000;
+        CHECK(index.Evict(budget, {}, 0 /* incomingBytes */, 5000 /* freeBytes */));
+        CHECK(index.GetEntries().size() == 5);
+    }
+}
+
+TEST_CASE("SourceUpdateCacheIndex - device filling over many updates")
+{
+    aduc::AutoDir testBaseDir(TEST_DIR);
+    aduc::AutoDir testCache(TEST_CACHE_PROVIDER_PATH);
+    REQUIRE(testBaseDir.RemoveDir());
+    REQUIRE(testCache.CreateDir());
+
+    // A 2 MiB data partition. The cache may use 1 MiB, and must leave 768 KiB free for downloads.
+    constexpr unsigned long long partitionBytes = 2 * 1024 * 1024;
+    constexpr unsigned long long otherDataBytes = 512 * 1024;
+    constexpr size_t payloadBytes = 96 * 1024;
+    const ADUC_SourceUpdateCacheBudget budget = { 1024 * 1024, 768 * 1024 };
+
+    // The factory image, which every third update is a delta against.
+    const std::string baseImage = WriteCacheFile("sha256-factory", payloadBytes, 100);
+
+    std::string previousPayload;
+    for (int update = 0; update < 60; ++update)
+    {
+        const time_t now = 1000 + update * 3600;
+
+        SourceUpdateCacheIndex index{ TEST_CACHE_BASE_PATH };
+        index.Load();
+
+        if (update % 3 == 0)
+        {
+            index.Touch(baseImage, now, true /* isHit */);
+        }
+
+        // Make room for the new payload, keeping the payload being installed.
+        const unsigned long long freeBytes = partitionBytes - otherDataBytes - index.GetTotalBytes();
+        REQUIRE(index.Evict(budget, { previousPayload }, payloadBytes, freeBytes));
+
+        const std::string payload = WriteCacheFile("sha256-update" + std::to_string(update), payloadBytes, now);
+        index.Touch(payload, now, false /* isHit */);
+        REQUIRE(index.Save());
+
+        // The accounting matches the disk, and the device never runs out of room.
+        SourceUpdateCacheIndex reloaded{ TEST_CACHE_BASE_PATH };
+        reloaded.Load();
+        CHECK(reloaded.GetTotalBytes() == SizeOnDisk(reloaded));
+        CHECK(reloaded.GetTotalBytes() <= budget.maxCacheBytes);
+        CHECK(partitionBytes - otherDataBytes - reloaded.GetTotalBytes() >= budget.minFreeBytes);
+
+        // The delta source in active use and the newest payloads survive; old payloads go.
+        CHECK(SystemUtils_IsFile(baseImage.c_str(), nullptr));
+        CHECK(SystemUtils_IsFile(payload.c_str(), nullptr));
+        if (update >= 7)
+        {
+            const std::string evicted = TEST_CACHE_PROVIDER_PATH "/sha256-update" + std::to_string(update - 7);
+            CHECK_FALSE(SystemUtils_IsFile(evicted.c_str(), nullptr));
+        }
+
+        previousPayload = payload;
+    }
+}
+
+TEST_CASE("ADUC_SourceUpdateCache_Lookup - hit is recorded in memory, and saved with the index")
+{
+    aduc::AutoDir testBaseDir(TEST_DIR);
+    aduc::AutoDir testCache(TEST_CACHE_PROVIDER_PATH);
+    REQUIRE(testBaseDir.RemoveDir());
+    REQUIRE(testCache.CreateDir());
+
+    const std::string cacheFile = WriteCacheFile("sha256-abc", 10, 1000);
+
+    STRING_HANDLE sourceUpdatePath = nullptr;
+    const ADUC_Result result =
+        ADUC_SourceUpdateCache_Lookup("TestProvider", "abc", "sha256", TEST_CACHE_BASE_PATH, &sourceUpdatePath);
+    REQUIRE(result.ResultCode == ADUC_Result_Success);
+    CHECK(std::string{ STRING_c_str(sourceUpdatePath) } == cacheFile);
+    STRING_delete(sourceUpdatePath);
+
+    // The lookup doesn't write the index file.
+    CHECK_FALSE(SystemUtils_IsFile(TEST_CACHE_BASE_PATH "/.cache_index", nullptr));
+
+    SourceUpdateCacheIndex index{ TEST_CACHE_BASE_PATH };
+    index.Load();
+    REQUIRE(index.GetEntries().count(cacheFile) == 1);
+    CHECK(index.GetEntries().at(cacheFile).hits == 1);
+    CHECK(index.GetEntries().at(cacheFile).lastUsed > 1000);
+    REQUIRE(index.Save());
+
+    // Saved once, not counted again.
+    SourceUpdateCacheIndex reloaded{ TEST_CACHE_BASE_PATH };
+    reloaded.Load();
+    REQUIRE(reloaded.GetEntries().count(cacheFile) == 1);
+    CHECK(reloaded.GetEntries().at(cacheFile).hits == 1);
+    CHECK(reloaded.GetEntries().at(cacheFile).lastUsed == index.GetEntries().at(cacheFile).lastUsed);
+}
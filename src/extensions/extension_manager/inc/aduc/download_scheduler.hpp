@@ -0,0 +1,92 @@
+/**
+ * @file download_scheduler.hpp
+ * @brief Downloads a set of independent payload files with bounded concurrency.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#ifndef ADUC_DOWNLOAD_SCHEDULER_HPP
+#define ADUC_DOWNLOAD_SCHEDULER_HPP
+
+#include <aduc/extension_manager_download_options.h>
+#include <aduc/result.h> // ADUC_Result
+#include <aduc/types/download.h> // ADUC_DownloadProgressCallback
+#include <aduc/types/update_content.h> // ADUC_FileEntity
+
+#include <functional>
+#include <vector>
+
+/**
+ * @brief The upper bound for the number of files downloaded in parallel.
+ */
+#define ADUC_DOWNLOAD_SCHEDULER_MAX_CONCURRENCY 16
+
+namespace ADUC
+{
+/**
+ * @brief A file to download, and the workflow whose work folder it is downloaded into.
+ */
+struct DownloadJob
+{
+    const ADUC_FileEntity* entity; /**< The file to download. */
+    void* workflowHandle; /**< The workflow that owns the file. */
+    const char* workflowId; /**< The workflow id reported to the progress callback. */
+};
+
+/**
+ * @brief Downloads one file. Must be safe to call from several threads at once.
+ * @details @p options is a per-file copy of the scheduler's options, with isCancelRequested set so that the
+ * scheduler can abandon this file.
+ */
+using DownloadFunction =
+    std::function<ADUC_Result(const DownloadJob& job, ExtensionManager_Download_Options* options)>;
+
+/**
+ * @brief Runs downloads on up to N worker threads, stops scheduling new files after the first failure,
+ * and cancels the files still in flight.
+ */
+class DownloadScheduler
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param maxConcurrency The number of files to download at once.
+     * Clamped to [1, ADUC_DOWNLOAD_SCHEDULER_MAX_CONCURRENCY].
+     */
+    explicit DownloadScheduler(unsigned int maxConcurrency);
+
+    /**
+     * @brief Downloads all @p jobs.
+     *
+     * @param jobs The files to download. Each file must have a distinct target path.
+     * @param options The download options passed to every file. Must not be nullptr. isCancelRequested, if set, is
+     * polled for the whole set.
+     * @param progressCallback Optional. Called once per finished file with that file's state and the bytes finished
+     * over the total bytes of all files (from ADUC_FileEntity::SizeInBytes). Calls are serialized.
+     * @param download The function that downloads one file.
+     * @return ADUC_Result ADUC_Result_Download_Success; ADUC_Result_Failure_Cancelled when cancelled; otherwise the
+     * failure of the lowest-numbered failed file.
+     */
+    ADUC_Result Run(
+        const std::vector<DownloadJob>& jobs,
+        const ExtensionManager_Download_Options* options,
+        ADUC_DownloadProgressCallback progressCallback,
+        const DownloadFunction& download);
+
+    /**
+     * @brief Gets the effective concurrency.
+     * @return unsigned int The number of files downloaded at once.
+     */
+    unsigned int GetMaxConcurrency() const
+    {
+        return _maxConcurrency;
+    }
+
+private:
+    unsigned int _maxConcurrency;
+};
+
+} // namespace ADUC
+
+#endif // ADUC_DOWNLOAD_SCHEDULER_HPP
@@ -40,6 +40,11 @@ ADUC_Result ExtensionManager_Download(
     ExtensionManager_Download_Options* options,
     ADUC_DownloadProgressCallback downloadProgressCallback);
 
+/**
+ * @brief Verifies the hashes of all registered extensions in parallel, so that loading them later is quick.
+ */
+void ExtensionManager_PreloadExtensions();
+
 /**
  * @brief Uninitializes the extension manager.
  */
@@ -11,6 +11,7 @@
 
 #include <aduc/component_enumerator_extension.hpp>
 #include <aduc/contract_utils.h>
+#include <aduc/download_scheduler.hpp> // ADUC::DownloadJob
 #include <aduc/extension_manager_download_options.h>
 #include <aduc/logging.h> // ADUC_LOG_SEVERITY
 #include <aduc/result.h> // ADUC_Result
@@ -18,8 +19,10 @@
 #include <aduc/types/update_content.h> // ADUC_FileEntity
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 // Default DO retry timeout is 24 hours.
 #define DO_RETRY_TIMEOUT_DEFAULT (60 * 60 * 24)
@@ -80,12 +83,42 @@ public:
         ExtensionManager_Download_Options* downloadOptions,
         ADUC_DownloadProgressCallback downloadProgressCallback);
 
+    /**
+     * @brief Downloads independent files in parallel, up to the maxConcurrentDownloads set in du-config.json.
+     * @details Stops at the first failure and cancels the downloads still in flight.
+     *
+     * @param jobs The files to download, each with the workflow whose work folder it goes to.
+     * @param downloadOptions The download options. Its isCancelRequested, if set, cancels all downloads.
+     * @param downloadProgressCallback Optional. Called as each file finishes, with bytes finished over bytes total for
+     * all @p jobs.
+     * @return ADUC_Result ADUC_Result_Download_Success if all files were downloaded.
+     */
+    static ADUC_Result DownloadFiles(
+        const std::vector<ADUC::DownloadJob>& jobs,
+        ExtensionManager_Download_Options* downloadOptions,
+        ADUC_DownloadProgressCallback downloadProgressCallback);
+
+    /**
+     * @brief Verifies the hashes of all registered extensions in parallel, recording them in the verified hash cache
+     * so that loading an unchanged extension later does not hash it again.
+     * @details Extensions that fail here are not rejected; they fail the same check when they are loaded.
+     */
+    static void PreloadExtensions();
+
 private:
+    static void ReadContentDownloaderContractVersion(void* contentDownloaderLibrary);
     static void UnloadAllUpdateContentHandlers();
     static void UnloadAllExtensions();
 
     static void _FreeComponentsDataString(char* componentsJson);
 
+    static ADUC_Result DownloadFile(
+        const ADUC_FileEntity* entity,
+        ADUC_WorkflowHandle workflowHandle,
+        ExtensionManager_Download_Options* downloadOptions,
+        ADUC_DownloadProgressCallback downloadProgressCallback,
+        ADUC_Result_t* successErc);
+
     static ADUC_Result LoadExtensionLibrary(
         const char* extensionName,
         const char* extensionPath,
@@ -98,6 +131,15 @@ private:
 
     static std::unordered_map<std::string, void*> _libs;
     static std::unordered_map<std::string, ContentHandler*> _contentHandlers;
+
+    // Guards the caches above, and the lazily loaded extensions below. Steps of a workflow are evaluated
+    // concurrently, and may load extensions. Recursive, as loading a handler loads its library.
+    static std::recursive_mutex _extensionsMutex;
+
+    // Serializes download handlers, which set the result of the workflow they are given. Recursive, as a handler
+    // may download its own files.
+    static std::recursive_mutex _downloadHandlersMutex;
+
     static void* _contentDownloader;
     static ADUC_ExtensionContractInfo _contentDownloaderContractVersion;
     static void* _componentEnumerator;
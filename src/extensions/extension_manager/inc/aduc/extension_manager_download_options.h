@@ -1,9 +1,19 @@
 #ifndef ADUC_EXTENSION_MANAGER_DOWNLOAD_OPTIONS_H
 #define ADUC_EXTENSION_MANAGER_DOWNLOAD_OPTIONS_H
 
+#include <stdbool.h>
+
 typedef struct tagADUC_ExtensionManager_Download_Options
 {
     unsigned int retryTimeout;
+
+    /**
+     * @brief Optional. Polled before and, with a V2 content downloader, during the download.
+     * Returning true abandons the download with ADUC_Result_Failure_Cancelled.
+     */
+    bool (*isCancelRequested)(void* cancelContext);
+
+    void* cancelContext; /**< Passed to isCancelRequested. */
 } ExtensionManager_Download_Options;
 
 #endif // #define ADUC_EXTENSION_MANAGER_DOWNLOAD_OPTIONS_H
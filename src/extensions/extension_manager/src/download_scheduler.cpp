@@ -0,0 +1,224 @@
+/**
+ * @file download_scheduler.cpp
+ * @brief Implements the bounded-concurrency payload download scheduler.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/download_scheduler.hpp"
+
+#include <aduc/logging.h>
+#include <aduc/types/adu_core.h> // ADUC_Result_*
+
+#include <algorithm> // std::min
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+namespace ADUC
+{
+/**
+ * @brief How often the caller's isCancelRequested is polled while downloads are in flight.
+ */
+static constexpr std::chrono::milliseconds CancelPollInterval{ 100 };
+
+/**
+ * @brief State shared by the worker threads of one DownloadScheduler::Run.
+ */
+struct DownloadSchedulerState
+{
+    DownloadSchedulerState(
+        const std::vector<DownloadJob>& jobsIn,
+        const ExtensionManager_Download_Options* optionsIn,
+        ADUC_DownloadProgressCallback progressCallbackIn,
+        const DownloadFunction& downloadIn) :
+        jobs(jobsIn), options(optionsIn), progressCallback(progressCallbackIn), download(downloadIn)
+    {
+    }
+
+    const std::vector<DownloadJob>& jobs;
+    const ExtensionManager_Download_Options* options;
+    ADUC_DownloadProgressCallback progressCallback;
+    const DownloadFunction& download;
+
+    std::vector<ADUC_Result> results;
+
+    std::atomic<size_t> nextJob{ 0 };
+    std::atomic<bool> cancelled{ false };
+
+    std::mutex mutex; // Guards the members below, and serializes progress callbacks.
+    std::condition_variable workerDone;
+    unsigned int runningWorkers = 0;
+    uint64_t bytesFinished = 0;
+    uint64_t bytesTotal = 0;
+};
+
+/**
+ * @brief ExtensionManager_Download_Options::isCancelRequested for a single file.
+ * @param cancelContext The DownloadSchedulerState.
+ * @return bool true once the set of downloads is being abandoned.
+ */
+static bool IsScheduledDownloadCancelRequested(void* cancelContext)
+{
+    return static_cast<DownloadSchedulerState*>(cancelContext)->cancelled.load();
+}
+
+/**
+ * @brief Downloads files until none are left or the set is cancelled.
+ * @param state The shared state.
+ */
+static void DownloadWorker(DownloadSchedulerState* state)
+{
+    for (;;)
+    {
+        const size_t index = state->nextJob++;
+        if (index >= state->jobs.size() || state->cancelled)
+        {
+            break;
+        }
+
+        const DownloadJob& job = state->jobs[index];
+
+        ExtensionManager_Download_Options fileOptions = *state->options;
+        fileOptions.isCancelRequested = IsScheduledDownloadCancelRequested;
+        fileOptions.cancelContext = state;
+
+        ADUC_Result result = { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
+        try
+        {
+            result = state->download(job, &fileOptions);
+        }
+        catch (...)
+        {
+            Log_Error("Exception while downloading '%s'.", job.entity->FileId);
+        }
+
+        ADUC_DownloadProgressState progressState = ADUC_DownloadProgressState_Completed;
+        if (result.ResultCode == ADUC_Result_Failure_Cancelled)
+        {
+            progressState = ADUC_DownloadProgressState_Cancelled;
+        }
+        else if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            progressState = ADUC_DownloadProgressState_Error;
+
+            if (!state->cancelled.exchange(true))
+            {
+                Log_Error(
+                    "Download of '%s' failed (0x%X). Cancelling the remaining downloads.",
+                    job.entity->FileId,
+                    result.ExtendedResultCode);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock{ state->mutex };
+        state->results[index] = result;
+
+        if (progressState == ADUC_DownloadProgressState_Completed)
+        {
+            state->bytesFinished += job.entity->SizeInBytes;
+        }
+
+        if (state->progressCallback != nullptr)
+        {
+            state->progressCallback(
+                job.workflowId, job.entity->FileId, progressState, state->bytesFinished, state->bytesTotal);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock{ state->mutex };
+    --state->runningWorkers;
+    state->workerDone.notify_all();
+}
+
+DownloadScheduler::DownloadScheduler(unsigned int maxConcurrency) :
+    _maxConcurrency{ std::min<unsigned int>(std::max(maxConcurrency, 1u), ADUC_DOWNLOAD_SCHEDULER_MAX_CONCURRENCY) }
+{
+}
+
+ADUC_Result DownloadScheduler::Run(
+    const std::vector<DownloadJob>& jobs,
+    const ExtensionManager_Download_Options* options,
+    ADUC_DownloadProgressCallback progressCallback,
+    const DownloadFunction& download)
+{
+    DownloadSchedulerState state{ jobs, options, progressCallback, download };
+
+    // Files that are never attempted keep this result.
+    state.results.assign(jobs.size(), ADUC_Result{ ADUC_Result_Failure_Cancelled, 0 });
+
+    for (const DownloadJob& job : jobs)
+    {
+        state.bytesTotal += job.entity->SizeInBytes;
+    }
+
+    const unsigned int workerCount = static_cast<unsigned int>(std::min<size_t>(_maxConcurrency, jobs.size()));
+    Log_Info("Downloading %zu file(s), %u at a time.", jobs.size(), workerCount);
+
+    std::vector<std::thread> workers;
+    workers.reserve(workerCount);
+
+    {
+        std::unique_lock<std::mutex> lock{ state.mutex };
+
+        for (unsigned int i = 0; i < workerCount; ++i)
+        {
+            try
+            {
+                workers.emplace_back(DownloadWorker, &state);
+                ++state.runningWorkers;
+            }
+            catch (const std::system_error& e)
+            {
+                // Carry on with the workers we have; fail only if there are none.
+                Log_Warn("Cannot start download worker #%u: %s", i, e.what());
+                break;
+            }
+        }
+
+        if (workers.empty())
+        {
+            state.runningWorkers = 1;
+            lock.unlock();
+            DownloadWorker(&state);
+            lock.lock();
+        }
+
+        while (state.runningWorkers > 0)
+        {
+            state.workerDone.wait_for(lock, CancelPollInterval);
+
+            if (!state.cancelled && options->isCancelRequested != nullptr
+                && options->isCancelRequested(options->cancelContext))
+            {
+                Log_Info("Download cancellation requested.");
+                state.cancelled = true;
+            }
+        }
+    }
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    for (const ADUC_Result& result : state.results)
+    {
+        if (IsAducResultCodeFailure(result.ResultCode) && result.ResultCode != ADUC_Result_Failure_Cancelled)
+        {
+            return result;
+        }
+    }
+
+    if (state.cancelled)
+    {
+        return ADUC_Result{ ADUC_Result_Failure_Cancelled, 0 };
+    }
+
+    return ADUC_Result{ ADUC_Result_Download_Success, 0 };
+}
+
+} // namespace ADUC
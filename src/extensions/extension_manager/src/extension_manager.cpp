@@ -11,15 +11,19 @@
 #include <aduc/c_utils.h>
 #include <aduc/calloc_wrapper.hpp> // ADUC::StringUtils::cstr_wrapper
 #include <aduc/component_enumerator_extension.hpp>
+#include <aduc/config_utils.h> // ADUC_ConfigInfo
 #include <aduc/content_downloader_extension.hpp>
+#include <aduc/content_store.h>
 #include <aduc/content_handler.hpp>
 #include <aduc/contract_utils.h>
+#include <aduc/download_handler_factory.hpp>
 #include <aduc/exceptions.hpp>
 #include <aduc/exports/extension_export_symbols.h>
 #include <aduc/extension_manager.hpp>
 #include <aduc/extension_manager_helper.hpp>
 #include <aduc/extension_utils.h>
 #include <aduc/hash_utils.h> // for SHAversion
+#include <aduc/verified_hash_cache.h>
 #include <aduc/logging.h>
 #include <aduc/parser_utils.h>
 #include <aduc/path_utils.h> // SanitizePathSegment
@@ -31,11 +35,21 @@
 #include <aduc/types/workflow.h> // ADUC_WorkflowHandle
 #include <aduc/workflow_utils.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstring>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 // Note: this requires ${CMAKE_DL_LIBS}
+#include <dirent.h> // for opendir, readdir
 #include <dlfcn.h>
+#include <sys/stat.h> // for stat
 #include <unistd.h>
 
 // type aliases
@@ -53,6 +67,8 @@ EXTERN_C_END
 // Static members.
 std::unordered_map<std::string, void*> ExtensionManager::_libs;
 std::unordered_map<std::string, ContentHandler*> ExtensionManager::_contentHandlers;
+std::recursive_mutex ExtensionManager::_extensionsMutex;
+std::recursive_mutex ExtensionManager::_downloadHandlersMutex;
 void* ExtensionManager::_contentDownloader;
 ADUC_ExtensionContractInfo ExtensionManager::_contentDownloaderContractVersion;
 void* ExtensionManager::_componentEnumerator;
@@ -80,6 +96,8 @@ ADUC_Result ExtensionManager::LoadExtensionLibrary(
     int componentCode,
     void** libHandle)
 {
+    std::lock_guard<std::recursive_mutex> lock{ _extensionsMutex };
+
     ADUC_Result result{ ADUC_GeneralResult_Failure };
     ADUC_FileEntity entity = {};
     SHAversion algVersion;
@@ -136,7 +154,7 @@ ADUC_Result ExtensionManager::LoadExtensionLibrary(
         goto done;
     }
 
-    if (!ADUC_HashUtils_IsValidFileHash(
+    if (!ADUC_VerifiedHashCache_IsValidFileHash(
             entity.TargetFilename,
             ADUC_HashUtils_GetHashValue(entity.Hash, entity.HashCount, 0),
             algVersion,
@@ -202,6 +220,8 @@ done:
 ADUC_Result
 ExtensionManager::LoadUpdateContentHandlerExtension(const std::string& updateType, ContentHandler** handler)
 {
+    std::lock_guard<std::recursive_mutex> lock{ _extensionsMutex };
+
     ADUC_Result result = { ADUC_Result_Failure };
 
     UPDATE_CONTENT_HANDLER_CREATE_PROC createUpdateContentHandlerExtensionFn = nullptr;
@@ -244,8 +264,9 @@ ExtensionManager::LoadUpdateContentHandlerExtension(const std::string& updateTyp
         }
     }
 
-    if (IsAducResultCodeSuccess(result.ResultCode) && *handler != nullptr)
+    if (*handler != nullptr)
     {
+        result = { ADUC_GeneralResult_Success };
         goto done;
     }
 
@@ -360,6 +381,8 @@ done:
  * */
 ADUC_Result ExtensionManager::SetUpdateContentHandlerExtension(const std::string& updateType, ContentHandler* handler)
 {
+    std::lock_guard<std::recursive_mutex> lock{ _extensionsMutex };
+
     ADUC_Result result = { ADUC_Result_Failure };
 
     Log_Info("Setting Content Handler for '%s'.", updateType.c_str());
@@ -385,6 +408,8 @@ done:
 
 void ExtensionManager::UnloadAllUpdateContentHandlers()
 {
+    std::lock_guard<std::recursive_mutex> lock{ _extensionsMutex };
+
     for (auto& contentHandler : _contentHandlers)
     {
         delete (contentHandler.second); // NOLINT(cppcoreguidelines-owning-memory)
@@ -399,6 +424,8 @@ void ExtensionManager::UnloadAllUpdateContentHandlers()
  */
 void ExtensionManager::UnloadAllExtensions()
 {
+    std::lock_guard<std::recursive_mutex> lock{ _extensionsMutex };
+
     // Make sure we unload every handlers first.
     UnloadAllUpdateContentHandlers();
 
@@ -415,13 +442,42 @@ void ExtensionManager::Uninit()
     ExtensionManager::UnloadAllExtensions();
 }
 
+/**
+ * @brief Sets _contentDownloaderContractVersion from the GetContractInfo export of @p contentDownloaderLibrary.
+ * @param contentDownloaderLibrary The content downloader library.
+ */
+void ExtensionManager::ReadContentDownloaderContractVersion(void* contentDownloaderLibrary)
+{
+    Log_Debug("Determining contract version for content downloader.");
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    auto getContractInfoFn = reinterpret_cast<GET_CONTRACT_INFO_PROC>(
+        dlsym(contentDownloaderLibrary, CONTENT_DOWNLOADER__GetContractInfo__EXPORT_SYMBOL));
+    if (getContractInfoFn == nullptr)
+    {
+        _contentDownloaderContractVersion.majorVer = ADUC_V1_CONTRACT_MAJOR_VER;
+        _contentDownloaderContractVersion.minorVer = ADUC_V1_CONTRACT_MINOR_VER;
+        Log_Debug("No " CONTENT_DOWNLOADER__GetContractInfo__EXPORT_SYMBOL
+                  "export. Defaulting to V1 contract for content downloader");
+    }
+    else
+    {
+        getContractInfoFn(&_contentDownloaderContractVersion);
+        Log_Debug(
+            "Got Contract %d.%d for content downloader",
+            _contentDownloaderContractVersion.majorVer,
+            _contentDownloaderContractVersion.minorVer);
+    }
+}
+
 ADUC_Result ExtensionManager::LoadContentDownloaderLibrary(void** contentDownloaderLibrary)
 {
+    std::lock_guard<std::recursive_mutex> lock{ _extensionsMutex };
+
     ADUC_Result result = { ADUC_Result_Failure };
     static const char* functionNames[] = { CONTENT_DOWNLOADER__Initialize__EXPORT_SYMBOL,
                                            CONTENT_DOWNLOADER__Download__EXPORT_SYMBOL };
     void* extensionLib = nullptr;
-    GET_CONTRACT_INFO_PROC getContractInfoFn = nullptr;
 
     if (_contentDownloader != nullptr)
     {
@@ -459,26 +515,7 @@ ADUC_Result ExtensionManager::LoadContentDownloaderLibrary(void** contentDownloa
         }
     }
 
-    Log_Debug("Determining contract version for content downloader.");
-
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    getContractInfoFn = reinterpret_cast<GET_CONTRACT_INFO_PROC>(
-        dlsym(extensionLib, CONTENT_DOWNLOADER__GetContractInfo__EXPORT_SYMBOL));
-    if (getContractInfoFn == nullptr)
-    {
-        _contentDownloaderContractVersion.majorVer = ADUC_V1_CONTRACT_MAJOR_VER;
-        _contentDownloaderContractVersion.minorVer = ADUC_V1_CONTRACT_MINOR_VER;
-        Log_Debug("No " CONTENT_DOWNLOADER__GetContractInfo__EXPORT_SYMBOL
-                  "export. Defaulting to V1 contract for content downloader");
-    }
-    else
-    {
-        result = getContractInfoFn(&_contentDownloaderContractVersion);
-        Log_Debug(
-            "Got Contract %d.%d for content downloader",
-            _contentDownloaderContractVersion.majorVer,
-            _contentDownloaderContractVersion.minorVer);
-    }
+    ReadContentDownloaderContractVersion(extensionLib);
 
     *contentDownloaderLibrary = _contentDownloader = extensionLib;
 
@@ -492,6 +529,10 @@ ADUC_Result ExtensionManager::SetContentDownloaderLibrary(void* contentDownloade
 {
     ADUC_Result result = { ADUC_Result_Success };
     _contentDownloader = contentDownloaderLibrary;
+    if (contentDownloaderLibrary != nullptr)
+    {
+        ReadContentDownloaderContractVersion(contentDownloaderLibrary);
+    }
     return result;
 }
 
@@ -517,6 +558,8 @@ bool ExtensionManager::IsComponentsEnumeratorRegistered()
 
 ADUC_Result ExtensionManager::LoadComponentEnumeratorLibrary(void** componentEnumerator)
 {
+    std::lock_guard<std::recursive_mutex> lock{ _extensionsMutex };
+
     ADUC_Result result = { ADUC_Result_Failure };
     void* mainFunc = nullptr;
     void* extensionLib = nullptr;
@@ -766,6 +809,126 @@ done:
     return result;
 }
 
+/**
+ * @brief Whether the content downloader contract is one the agent can drive (V1 or V2).
+ * @param contractInfo The content downloader contract info.
+ * @return bool true if supported.
+ */
+static bool IsSupportedContentDownloaderContract(ADUC_ExtensionContractInfo* contractInfo)
+{
+    return ADUC_ContractUtils_IsV1Contract(contractInfo) || ADUC_ContractUtils_IsV2Contract(contractInfo);
+}
+
+/**
+ * @brief Whether the caller of ExtensionManager::Download asked to abandon it.
+ * @param options The download options. May be nullptr.
+ * @return bool true if cancellation was requested.
+ */
+static bool IsDownloadCancelRequested(const ExtensionManager_Download_Options* options)
+{
+    return options != nullptr && options->isCancelRequested != nullptr
+        && options->isCancelRequested(options->cancelContext);
+}
+
+/**
+ * @brief The ADUC_DownloadDataSink context used by ExtensionManager::Download.
+ */
+struct DownloadDataSinkContext
+{
+    ADUC_HashUtils_DigestHandle digest; /**< The streaming digest. May be nullptr. */
+    const ExtensionManager_Download_Options* options; /**< Polled for cancellation. */
+};
+
+/**
+ * @brief ADUC_DownloadDataSink write callback that feeds a digest.
+ * @details Returning false also makes the content downloader abort the download when cancellation is requested.
+ * @param context The DownloadDataSinkContext.
+ * @param data The payload bytes.
+ * @param length The length of @p data.
+ * @return bool true on success.
+ */
+static bool DigestDataSink_Write(void* context, const uint8_t* data, size_t length)
+{
+    const auto* sinkContext = static_cast<DownloadDataSinkContext*>(context);
+    if (IsDownloadCancelRequested(sinkContext->options))
+    {
+        return false;
+    }
+
+    return sinkContext->digest == nullptr || ADUC_HashUtils_DigestUpdate(sinkContext->digest, data, length);
+}
+
+/**
+ * @brief ADUC_DownloadDataSink reset callback that restarts a digest.
+ * @param context The DownloadDataSinkContext.
+ */
+static void DigestDataSink_Reset(void* context)
+{
+    const auto* sinkContext = static_cast<DownloadDataSinkContext*>(context);
+    if (sinkContext->digest != nullptr && !ADUC_HashUtils_DigestReset(sinkContext->digest))
+    {
+        Log_Warn("Cannot reset streaming digest. Will re-hash the downloaded file.");
+    }
+}
+
+/**
+ * @brief Validates a downloaded file with the digest that was computed while it streamed in.
+ * @details Falls back to re-reading the file when there is no digest, or the digest did not see exactly the bytes
+ * that are in the file (e.g. the downloader skipped or resumed the download without replaying the content).
+ *
+ * @param filePath The downloaded file.
+ * @param digest The streaming digest. May be nullptr.
+ * @param hashValue The expected base64 encoded hash.
+ * @param algVersion The hash algorithm.
+ * @return bool true if the file content matches @p hashValue.
+ */
+static bool IsValidDownloadedFileHash(
+    const char* filePath, ADUC_HashUtils_DigestHandle digest, const char* hashValue, SHAversion algVersion)
+{
+    struct stat st
+    {
+    };
+
+    if (digest != nullptr && stat(filePath, &st) == 0
+        && ADUC_HashUtils_DigestGetBytesConsumed(digest) == static_cast<uint64_t>(st.st_size))
+    {
+        Log_Debug("Validating '%s' with streaming digest.", filePath);
+        if (!ADUC_HashUtils_DigestIsValid(digest, hashValue, false /* suppressErrorLog */))
+        {
+            return false;
+        }
+
+        (void)ADUC_VerifiedHashCache_Record(filePath, hashValue, algVersion);
+        return true;
+    }
+
+    return ADUC_VerifiedHashCache_IsValidFileHash(filePath, hashValue, algVersion, false /* suppressErrorLog */);
+}
+
+/**
+ * @brief Gets the path of the sidecar file that marks a target file as a partial download the content downloader can
+ * resume.
+ * @param targetFilePath The target file.
+ * @return std::string The sidecar file path.
+ */
+static std::string GetResumeFilePath(const char* targetFilePath)
+{
+    return std::string{ targetFilePath } + ADUC_CONTENT_DOWNLOADER_RESUME_FILE_SUFFIX;
+}
+
+/**
+ * @brief Removes the resume sidecar of a target file, so that the content downloader won't resume the file.
+ * @param targetFilePath The target file.
+ */
+static void RemoveResumeFile(const char* targetFilePath)
+{
+    const std::string resumeFilePath = GetResumeFilePath(targetFilePath);
+    if (unlink(resumeFilePath.c_str()) != 0 && errno != ENOENT)
+    {
+        Log_Warn("Cannot remove '%s'. errno %d", resumeFilePath.c_str(), errno);
+    }
+}
+
 ADUC_Result ExtensionManager::InitializeContentDownloader(const char* initializeData)
 {
     void* lib = nullptr;
@@ -778,7 +941,7 @@ ADUC_Result ExtensionManager::InitializeContentDownloader(const char* initialize
         goto done;
     }
 
-    if (!ADUC_ContractUtils_IsV1Contract(&ExtensionManager::_contentDownloaderContractVersion))
+    if (!IsSupportedContentDownloaderContract(&ExtensionManager::_contentDownloaderContractVersion))
     {
         Log_Error(
             "Unsupported contract version %d.%d",
@@ -818,14 +981,48 @@ ADUC_Result ExtensionManager::Download(
     WorkflowHandle workflowHandle,
     ExtensionManager_Download_Options* options,
     ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    ADUC_Result_t successErc = 0;
+
+    ADUC_Result result = DownloadFile(entity, workflowHandle, options, downloadProgressCallback, &successErc);
+    if (successErc != 0)
+    {
+        workflow_set_success_erc(workflowHandle, successErc);
+    }
+
+    return result;
+}
+
+/**
+ * @brief Downloads a file into the work folder of a workflow, without setting the workflow's success ERC.
+ *
+ * @param entity The file to download.
+ * @param workflowHandle The workflow that owns the file.
+ * @param options The download options.
+ * @param downloadProgressCallback A download progress reporting callback.
+ * @param[out] successErc Set to the ERC that the caller should set on the workflow, if any.
+ * @return ADUC_Result The result.
+ */
+ADUC_Result ExtensionManager::DownloadFile(
+    const ADUC_FileEntity* entity,
+    WorkflowHandle workflowHandle,
+    ExtensionManager_Download_Options* options,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_Result_t* successErc)
 {
     void* lib = nullptr;
     DownloadProc downloadProc = nullptr;
+    DownloadV2Proc downloadV2Proc = nullptr;
+    ADUC_HashUtils_DigestHandle digest = nullptr;
     char* components = nullptr;
+    char* hashValue = nullptr;
+    bool copiedFromStore = false;
     SHAversion algVersion;
 
     ADUC_Result result = { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
     ADUC::StringUtils::STRING_HANDLE_wrapper targetUpdateFilePath{ nullptr };
+    // The sandbox that holds the content store references of this download.
+    cstr_wrapper sandbox{ workflow_get_workfolder(workflowHandle) };
 
     if (!workflow_get_entity_workfolder_filepath(workflowHandle, entity, targetUpdateFilePath.address_of()))
     {
@@ -841,7 +1038,7 @@ ADUC_Result ExtensionManager::Download(
         goto done;
     }
 
-    if (!ADUC_ContractUtils_IsV1Contract(&ExtensionManager::_contentDownloaderContractVersion))
+    if (!IsSupportedContentDownloaderContract(&ExtensionManager::_contentDownloaderContractVersion))
     {
         Log_Error(
             "Unsupported contract version %d.%d",
@@ -861,6 +1058,17 @@ ADUC_Result ExtensionManager::Download(
         goto done;
     }
 
+    if (ADUC_ContractUtils_IsV2Contract(&ExtensionManager::_contentDownloaderContractVersion))
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        downloadV2Proc = reinterpret_cast<DownloadV2Proc>(dlsym(lib, CONTENT_DOWNLOADER__DownloadV2__EXPORT_SYMBOL));
+        if (downloadV2Proc == nullptr)
+        {
+            Log_Warn("V2 content downloader has no '" CONTENT_DOWNLOADER__DownloadV2__EXPORT_SYMBOL
+                     "' export. Using V1 download.");
+        }
+    }
+
     if (!ADUC_HashUtils_GetShaVersionForTypeString(
             ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0), &algVersion))
     {
@@ -872,37 +1080,68 @@ ADUC_Result ExtensionManager::Download(
         goto done;
     }
 
+    hashValue = ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0 /* index */);
+    if (hashValue == nullptr)
+    {
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_ENTITY_NO_HASHES };
+        goto done;
+    }
+
     // If file exists and has a valid hash, then skip download.
-    // Otherwise, delete an existing file, then download.
+    // Otherwise, delete an existing file, then download; unless it is a partial download the downloader can resume.
     Log_Debug("Check whether '%s' has already been download into the work folder.", targetUpdateFilePath.c_str());
 
-    if (access(targetUpdateFilePath.c_str(), F_OK) == 0)
+    // Before going to the network, reuse the content if an earlier workflow or the source update cache has it.
+    if (access(targetUpdateFilePath.c_str(), F_OK) != 0)
     {
-        char* hashValue = ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0 /* index */);
-        if (hashValue == nullptr)
+        copiedFromStore =
+            ADUC_ContentStore_CopyOut(hashValue, algVersion, targetUpdateFilePath.c_str(), sandbox.get());
+        if (copiedFromStore)
         {
-            result = { .ResultCode = ADUC_Result_Failure,
-                       .ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_ENTITY_NO_HASHES };
-            goto done;
+            RemoveResumeFile(targetUpdateFilePath.c_str());
         }
+    }
 
+    if (access(GetResumeFilePath(targetUpdateFilePath.c_str()).c_str(), F_OK) == 0)
+    {
+        // A partial download fails the hash check. The downloader resumes it, or discards it if it cannot.
+        Log_Info("Leaving partial download '%s' to the content downloader.", targetUpdateFilePath.c_str());
+    }
+    else if (access(targetUpdateFilePath.c_str(), F_OK) == 0)
+    {
         // If target file exists, validate file hash.
-        // If file is valid, then skip the download.
-        bool validHash = ADUC_HashUtils_IsValidFileHash(
+        // If file is valid, then skip the download. An unchanged, previously verified file is not re-hashed.
+        bool validHash = ADUC_VerifiedHashCache_IsValidFileHash(
             targetUpdateFilePath.c_str(), hashValue, algVersion, false /* suppressErrorLog */);
 
-        if (!validHash)
+        if (validHash)
         {
-            // Delete existing file.
-            if (remove(targetUpdateFilePath.c_str()) != 0)
+            if (!copiedFromStore)
             {
-                Log_Error("Cannot delete existing file that has invalid hash.");
-                result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_CANNOT_DELETE_EXISTING_FILE;
-                goto done;
+                (void)ADUC_ContentStore_Insert(targetUpdateFilePath.c_str(), hashValue, algVersion, sandbox.get());
             }
+            result = { .ResultCode = ADUC_Result_Success, .ExtendedResultCode = 0 };
+            goto done;
+        }
+
+        if (copiedFromStore)
+        {
+            ADUC_ContentStore_Remove(hashValue, algVersion);
         }
 
-        result = { .ResultCode = ADUC_Result_Success, .ExtendedResultCode = 0 };
+        // Delete existing file, then download it again below.
+        if (remove(targetUpdateFilePath.c_str()) != 0)
+        {
+            Log_Error("Cannot delete existing file that has invalid hash.");
+            result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_CANNOT_DELETE_EXISTING_FILE;
+            goto done;
+        }
+    }
+
+    if (IsDownloadCancelRequested(options))
+    {
+        result = { .ResultCode = ADUC_Result_Failure_Cancelled, .ExtendedResultCode = 0 };
         goto done;
     }
 
@@ -912,6 +1151,7 @@ ADUC_Result ExtensionManager::Download(
     // download handler exists in the entity (metadata).
     if (!IsNullOrEmpty(entity->DownloadHandlerId))
     {
+        std::lock_guard<std::recursive_mutex> lock{ _downloadHandlersMutex };
         result = ProcessDownloadHandlerExtensibility(workflowHandle, entity, targetUpdateFilePath.c_str());
     }
 
@@ -925,37 +1165,294 @@ ADUC_Result ExtensionManager::Download(
 
         Log_Info("Downloading full target update payload to '%s'", targetUpdateFilePath.c_str());
 
-        result = downloadProc(entity, workflowId, workFolder.get(), options->retryTimeout, downloadProgressCallback);
+        if (downloadV2Proc != nullptr)
+        {
+            // Hash the payload as it arrives so it need not be read back from disk.
+            digest = ADUC_HashUtils_DigestCreate(algVersion);
+
+            // Without a digest, the sink still lets the download be cancelled; the file is re-hashed below.
+            DownloadDataSinkContext sinkContext = { digest, options };
+            const ADUC_DownloadDataSink dataSink = { &sinkContext, DigestDataSink_Write, DigestDataSink_Reset };
+
+            result = downloadV2Proc(
+                entity, workflowId, workFolder.get(), options->retryTimeout, downloadProgressCallback, &dataSink);
+
+            if (IsAducResultCodeFailure(result.ResultCode) && IsDownloadCancelRequested(options))
+            {
+                result = { .ResultCode = ADUC_Result_Failure_Cancelled, .ExtendedResultCode = 0 };
+            }
+        }
+        else
+        {
+            result =
+                downloadProc(entity, workflowId, workFolder.get(), options->retryTimeout, downloadProgressCallback);
+        }
     }
 
-    if (IsAducResultCodeSuccess(result.ResultCode))
+    if (IsAducResultCodeFailure(result.ResultCode))
     {
-        if (!ADUC_HashUtils_IsValidFileHash(
-                targetUpdateFilePath.c_str(),
-                ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
-                algVersion,
-                false))
-        {
-            result.ResultCode = ADUC_Result_Failure;
-            result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_HASH;
+        goto done;
+    }
 
-            workflow_set_success_erc(workflowHandle, result.ExtendedResultCode);
-            Log_Error("Successful download of '%s' failed hash check.", targetUpdateFilePath.c_str());
+    if (!IsValidDownloadedFileHash(targetUpdateFilePath.c_str(), digest, hashValue, algVersion))
+    {
+        result.ResultCode = ADUC_Result_Failure;
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_HASH;
 
-            goto done;
-        }
+        *successErc = result.ExtendedResultCode;
+        Log_Error("Successful download of '%s' failed hash check.", targetUpdateFilePath.c_str());
+
+        // Don't resume the next download from bad content.
+        RemoveResumeFile(targetUpdateFilePath.c_str());
+
+        goto done;
     }
 
+    // A download handler may have produced the file in place of a partial download.
+    RemoveResumeFile(targetUpdateFilePath.c_str());
+
+    (void)ADUC_ContentStore_Insert(targetUpdateFilePath.c_str(), hashValue, algVersion, sandbox.get());
+
     result.ResultCode = ADUC_GeneralResult_Success;
     result.ExtendedResultCode = 0;
 
 done:
+    ADUC_HashUtils_DigestFree(digest);
 
     return result;
 }
 
+/**
+ * @brief Gets the number of files to download in parallel, as configured in du-config.json.
+ * @return unsigned int The configured value, or ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_DOWNLOADS.
+ */
+static unsigned int GetMaxConcurrentDownloads()
+{
+    unsigned int maxConcurrentDownloads = ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_DOWNLOADS;
+
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config != nullptr)
+    {
+        maxConcurrentDownloads = config->maxConcurrentDownloads;
+    }
+    ADUC_ConfigInfo_ReleaseInstance(config);
+
+    return maxConcurrentDownloads;
+}
+
+ADUC_Result ExtensionManager::DownloadFiles(
+    const std::vector<ADUC::DownloadJob>& jobs,
+    ExtensionManager_Download_Options* downloadOptions,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    void* lib = nullptr;
+
+    // Load the content downloader and download handlers before fanning out, so that workers don't race to load them.
+    ADUC_Result result = ExtensionManager::LoadContentDownloaderLibrary(&lib);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        return result;
+    }
+
+    for (const ADUC::DownloadJob& job : jobs)
+    {
+        if (!IsNullOrEmpty(job.entity->DownloadHandlerId))
+        {
+            // A handler that fails to load is reported by that file's download.
+            DownloadHandlerFactory::GetInstance()->LoadDownloadHandler(job.entity->DownloadHandlerId);
+        }
+    }
+
+    ADUC::DownloadScheduler scheduler{ GetMaxConcurrentDownloads() };
+
+    // Workflows are not thread-safe, so the workers collect the ERCs to set, one per job.
+    std::vector<ADUC_Result_t> successErcs(jobs.size(), 0);
+
+    result = scheduler.Run(
+        jobs,
+        downloadOptions,
+        downloadProgressCallback,
+        [&jobs, &successErcs](const ADUC::DownloadJob& job, ExtensionManager_Download_Options* fileOptions) {
+            // The scheduler hands out the elements of jobs.
+            const size_t index = static_cast<size_t>(&job - jobs.data());
+            return ExtensionManager::DownloadFile(
+                job.entity, job.workflowHandle, fileOptions, nullptr, &successErcs[index]);
+        });
+
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (successErcs[i] != 0)
+        {
+            workflow_set_success_erc(jobs[i].workflowHandle, successErcs[i]);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief The most threads that PreloadExtensions uses.
+ */
+static constexpr unsigned int MaxPreloadThreads = 4;
+
+/**
+ * @brief An extension registration file, and how its loader checks the extension's hash.
+ */
+struct ExtensionRegistration
+{
+    std::string regFilePath; /**< The registration file path. */
+    bool useStrongestHash; /**< True if the loader checks the strongest hash; otherwise it checks the first. */
+};
+
+/**
+ * @brief Adds the registration file of each extension sub-folder of @p folder to @p registrations.
+ * @param folder The folder with one sub-folder per registered extension.
+ * @param regFileName The registration file name.
+ * @param useStrongestHash Whether the loader checks the strongest hash.
+ * @param registrations The registrations to add to.
+ */
+static void AddExtensionRegistrations(
+    const char* folder,
+    const char* regFileName,
+    bool useStrongestHash,
+    std::vector<ExtensionRegistration>& registrations)
+{
+    DIR* dir = opendir(folder);
+    if (dir == nullptr)
+    {
+        return;
+    }
+
+    const struct dirent* entry = nullptr;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        std::string regFilePath = std::string{ folder } + "/" + entry->d_name + "/" + regFileName;
+
+        struct stat st = {};
+        if (stat(regFilePath.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+            registrations.push_back({ std::move(regFilePath), useStrongestHash });
+        }
+    }
+
+    closedir(dir);
+}
+
+/**
+ * @brief Verifies the extension of @p registration as its loader does, through the verified hash cache.
+ * @param registration The extension registration.
+ */
+static void PreloadExtension(const ExtensionRegistration& registration)
+{
+    ADUC_FileEntity entity = {};
+    SHAversion algVersion;
+    bool verified = false;
+
+    if (!GetExtensionFileEntity(registration.regFilePath.c_str(), &entity))
+    {
+        Log_Warn("Cannot read extension registration '%s'.", registration.regFilePath.c_str());
+        return;
+    }
+
+    if (registration.useStrongestHash)
+    {
+        verified =
+            ADUC_VerifiedHashCache_VerifyWithStrongestHash(entity.TargetFilename, entity.Hash, entity.HashCount);
+    }
+    else
+    {
+        verified = ADUC_HashUtils_GetShaVersionForTypeString(
+                       ADUC_HashUtils_GetHashType(entity.Hash, entity.HashCount, 0), &algVersion)
+            && ADUC_VerifiedHashCache_IsValidFileHash(
+                       entity.TargetFilename,
+                       ADUC_HashUtils_GetHashValue(entity.Hash, entity.HashCount, 0),
+                       algVersion,
+                       true /* suppressErrorLog */);
+    }
+
+    if (!verified)
+    {
+        Log_Warn("Hash for %s is not valid.", entity.TargetFilename);
+    }
+
+    ADUC_FileEntity_Uninit(&entity);
+}
+
+void ExtensionManager::PreloadExtensions()
+{
+    std::vector<ExtensionRegistration> registrations;
+
+    AddExtensionRegistrations(
+        ADUC_UPDATE_CONTENT_HANDLER_EXTENSION_DIR, ADUC_UPDATE_CONTENT_HANDLER_REG_FILENAME, false, registrations);
+    AddExtensionRegistrations(
+        ADUC_DOWNLOAD_HANDLER_EXTENSION_DIR, ADUC_DOWNLOAD_HANDLER_REG_FILENAME, true, registrations);
+
+    for (const char* subfolder :
+         { ADUC_EXTENSIONS_SUBDIR_CONTENT_DOWNLOADER, ADUC_EXTENSIONS_SUBDIR_COMPONENT_ENUMERATOR })
+    {
+        std::string regFilePath = std::string{ ADUC_EXTENSIONS_FOLDER } + "/" + subfolder + "/"
+            + ADUC_EXTENSION_REG_FILENAME;
+
+        struct stat st = {};
+        if (stat(regFilePath.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+            registrations.push_back({ std::move(regFilePath), false });
+        }
+    }
+
+    if (registrations.empty())
+    {
+        return;
+    }
+
+    const unsigned int threadCount = static_cast<unsigned int>(std::min<size_t>(
+        registrations.size(), std::max(1U, std::min(MaxPreloadThreads, std::thread::hardware_concurrency()))));
+    Log_Info("Verifying %zu extension(s), %u at a time.", registrations.size(), threadCount);
+
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&registrations, &next]() {
+        for (size_t i = next++; i < registrations.size(); i = next++)
+        {
+            PreloadExtension(registrations[i]);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (unsigned int i = 1; i < threadCount; ++i)
+    {
+        try
+        {
+            threads.emplace_back(worker);
+        }
+        catch (const std::system_error& e)
+        {
+            // The calling thread works through whatever is left.
+            Log_Warn("Cannot start extension verification thread #%u: %s", i, e.what());
+            break;
+        }
+    }
+
+    worker();
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
 EXTERN_C_BEGIN
 
+void ExtensionManager_PreloadExtensions()
+{
+    ExtensionManager::PreloadExtensions();
+}
+
 ADUC_Result ExtensionManager_InitializeContentDownloader(const char* initializeData)
 {
     return ExtensionManager::InitializeContentDownloader(initializeData);
@@ -0,0 +1,90 @@
+/**
+ * @file download_scheduler_perf.cpp
+ * @brief Benchmark for downloading a multi-file update with the curl downloader over a high-latency link.
+ *
+ * Hidden from the default run. Use: extension_manager_unit_test "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "../../content_downloaders/curl_downloader/curl_content_downloader.h"
+#include "test_http_server.hpp"
+
+#include <aduc/download_scheduler.hpp>
+#include <aduc/types/adu_core.h> // ADUC_Result_*
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h> // for stat
+#include <unistd.h> // for rmdir
+
+TEST_CASE("DownloadScheduler multi-file throughput", "[.][perf]")
+{
+    constexpr size_t fileCount = 16;
+    constexpr size_t fileSize = 256 * 1024;
+
+    // Time to first byte and per-connection bandwidth of a slow, high-latency link.
+    TestHttpServer server{ std::string(fileSize, 'x'), "\"v1\"" };
+    server.SetResponseDelay(150);
+    server.SetThrottle(2 * 1024 * 1024);
+
+    char dirTemplate[] = "/tmp/downloadschedulerperfXXXXXX";
+    REQUIRE(mkdtemp(dirTemplate) != nullptr);
+    const std::string workFolder = dirTemplate;
+    std::string url = server.Url();
+
+    std::vector<std::string> names(fileCount);
+    std::vector<ADUC_FileEntity> entities(fileCount);
+    std::vector<ADUC::DownloadJob> jobs;
+    for (size_t i = 0; i < fileCount; ++i)
+    {
+        names[i] = "file" + std::to_string(i);
+        entities[i] = {};
+        entities[i].FileId = &names[i][0];
+        entities[i].DownloadUri = &url[0];
+        entities[i].TargetFilename = &names[i][0];
+        entities[i].SizeInBytes = fileSize;
+        jobs.push_back(ADUC::DownloadJob{ &entities[i], nullptr, "workflow" });
+    }
+
+    const auto removeFiles = [&]() {
+        for (const std::string& name : names)
+        {
+            std::remove((workFolder + "/" + name).c_str());
+            std::remove((workFolder + "/" + name + ".resume").c_str());
+        }
+    };
+
+    ExtensionManager_Download_Options options = {};
+
+    for (unsigned int width : { 1u, 2u, 4u, 8u })
+    {
+        removeFiles();
+        ADUC::DownloadScheduler scheduler{ width };
+
+        const auto start = std::chrono::steady_clock::now();
+        ADUC_Result result = scheduler.Run(
+            jobs, &options, nullptr, [&](const ADUC::DownloadJob& job, ExtensionManager_Download_Options*) {
+                return Download_curl_V2(job.entity, job.workflowId, workFolder.c_str(), 0, nullptr, nullptr);
+            });
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        REQUIRE(result.ResultCode == ADUC_Result_Download_Success);
+        for (const std::string& name : names)
+        {
+            struct stat st = {};
+            REQUIRE(stat((workFolder + "/" + name).c_str(), &st) == 0);
+            REQUIRE(static_cast<size_t>(st.st_size) == fileSize);
+        }
+        std::cout << "width " << width << "\t" << (elapsed.count() * 1000.0) << " ms" << std::endl;
+    }
+
+    removeFiles();
+    rmdir(workFolder.c_str());
+}
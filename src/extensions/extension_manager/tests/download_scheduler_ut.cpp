@@ -0,0 +1,272 @@
+/**
+ * @file download_scheduler_ut.cpp
+ * @brief Unit Tests for the download scheduler.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/download_scheduler.hpp>
+#include <aduc/types/adu_core.h> // ADUC_Result_*
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using ADUC::DownloadJob;
+using ADUC::DownloadScheduler;
+
+namespace
+{
+/**
+ * @brief A set of files, each @p fileSize bytes, named "file0", "file1", ...
+ */
+class FileSet
+{
+public:
+    FileSet(size_t count, size_t fileSize) : _names(count), _entities(count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            _names[i] = "file" + std::to_string(i);
+            _entities[i] = {};
+            _entities[i].FileId = &_names[i][0];
+            _entities[i].SizeInBytes = fileSize;
+            _jobs.push_back(DownloadJob{ &_entities[i], nullptr, "workflow" });
+        }
+    }
+
+    const std::vector<DownloadJob>& Jobs() const
+    {
+        return _jobs;
+    }
+
+private:
+    std::vector<std::string> _names;
+    std::vector<ADUC_FileEntity> _entities;
+    std::vector<DownloadJob> _jobs;
+};
+
+struct ProgressRecord
+{
+    std::string fileId;
+    ADUC_DownloadProgressState state;
+    uint64_t bytesTransferred;
+    uint64_t bytesTotal;
+};
+
+std::mutex g_progressMutex;
+std::vector<ProgressRecord> g_progress;
+
+void RecordProgress(
+    const char* workflowId, const char* fileId, ADUC_DownloadProgressState state, uint64_t transferred, uint64_t total)
+{
+    CHECK(std::string{ workflowId } == "workflow");
+    std::lock_guard<std::mutex> lock{ g_progressMutex };
+    g_progress.push_back(ProgressRecord{ fileId, state, transferred, total });
+}
+
+bool g_cancelRequested = false;
+
+bool IsCancelRequested(void* cancelContext)
+{
+    return *static_cast<bool*>(cancelContext);
+}
+
+/**
+ * @brief Waits up to @p delay, returning early with false if the scheduler cancels the file.
+ */
+bool SimulateTransfer(ExtensionManager_Download_Options* options, std::chrono::milliseconds delay)
+{
+    const auto deadline = std::chrono::steady_clock::now() + delay;
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        if (options->isCancelRequested(options->cancelContext))
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return true;
+}
+
+const ADUC_Result successResult = { .ResultCode = ADUC_Result_Download_Success, .ExtendedResultCode = 0 };
+const ADUC_Result cancelledResult = { .ResultCode = ADUC_Result_Failure_Cancelled, .ExtendedResultCode = 0 };
+
+} // namespace
+
+TEST_CASE("DownloadScheduler - concurrency is clamped")
+{
+    CHECK(DownloadScheduler{ 0 }.GetMaxConcurrency() == 1);
+    CHECK(DownloadScheduler{ 4 }.GetMaxConcurrency() == 4);
+    CHECK(DownloadScheduler{ 1000 }.GetMaxConcurrency() == ADUC_DOWNLOAD_SCHEDULER_MAX_CONCURRENCY);
+}
+
+TEST_CASE("DownloadScheduler - downloads every file with bounded concurrency")
+{
+    const unsigned int width = GENERATE(1u, 3u);
+    FileSet files{ 10, 100 };
+    ExtensionManager_Download_Options options = {};
+
+    std::atomic<int> inFlight{ 0 };
+    std::atomic<int> maxInFlight{ 0 };
+    std::mutex doneMutex;
+    std::vector<std::string> done;
+
+    DownloadScheduler scheduler{ width };
+    ADUC_Result result = scheduler.Run(
+        files.Jobs(), &options, nullptr, [&](const DownloadJob& job, ExtensionManager_Download_Options* fileOptions) {
+            const int now = ++inFlight;
+            int seen = maxInFlight.load();
+            while (now > seen && !maxInFlight.compare_exchange_weak(seen, now))
+            {
+            }
+
+            SimulateTransfer(fileOptions, std::chrono::milliseconds(20));
+            --inFlight;
+
+            std::lock_guard<std::mutex> lock{ doneMutex };
+            done.push_back(job.entity->FileId);
+            return successResult;
+        });
+
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    CHECK(done.size() == 10);
+    CHECK(maxInFlight <= static_cast<int>(width));
+
+    if (width == 1)
+    {
+        // One worker downloads in manifest order.
+        for (size_t i = 0; i < done.size(); ++i)
+        {
+            CHECK(done[i] == "file" + std::to_string(i));
+        }
+    }
+    else
+    {
+        CHECK(maxInFlight > 1);
+    }
+}
+
+TEST_CASE("DownloadScheduler - reports aggregated progress")
+{
+    FileSet files{ 4, 250 };
+    ExtensionManager_Download_Options options = {};
+    g_progress.clear();
+
+    DownloadScheduler scheduler{ 2 };
+    ADUC_Result result = scheduler.Run(
+        files.Jobs(), &options, RecordProgress, [](const DownloadJob&, ExtensionManager_Download_Options*) {
+            return successResult;
+        });
+
+    REQUIRE(result.ResultCode == ADUC_Result_Download_Success);
+    REQUIRE(g_progress.size() == 4);
+    for (size_t i = 0; i < g_progress.size(); ++i)
+    {
+        CHECK(g_progress[i].state == ADUC_DownloadProgressState_Completed);
+        CHECK(g_progress[i].bytesTransferred == 250 * (i + 1));
+        CHECK(g_progress[i].bytesTotal == 1000);
+    }
+}
+
+TEST_CASE("DownloadScheduler - first failure cancels the rest")
+{
+    FileSet files{ 8, 100 };
+    ExtensionManager_Download_Options options = {};
+    g_progress.clear();
+
+    std::atomic<int> started{ 0 };
+
+    DownloadScheduler scheduler{ 2 };
+    ADUC_Result result = scheduler.Run(
+        files.Jobs(),
+        &options,
+        RecordProgress,
+        [&](const DownloadJob& job, ExtensionManager_Download_Options* fileOptions) {
+            ++started;
+            if (std::string{ job.entity->FileId } == "file1")
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                return ADUC_Result{ .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 42 };
+            }
+
+            // Long enough that only cancellation ends it within the test.
+            return SimulateTransfer(fileOptions, std::chrono::seconds(10)) ? successResult : cancelledResult;
+        });
+
+    CHECK(result.ResultCode == ADUC_Result_Failure);
+    CHECK(result.ExtendedResultCode == 42);
+
+    // file0 was cancelled in flight, and no new file was started after the failure.
+    CHECK(started == 2);
+    REQUIRE(g_progress.size() == 2);
+    for (const ProgressRecord& record : g_progress)
+    {
+        CHECK(
+            record.state
+            == (record.fileId == "file1" ? ADUC_DownloadProgressState_Error : ADUC_DownloadProgressState_Cancelled));
+        CHECK(record.bytesTransferred == 0);
+    }
+}
+
+TEST_CASE("DownloadScheduler - caller can cancel")
+{
+    FileSet files{ 6, 100 };
+    ExtensionManager_Download_Options options = {};
+    g_cancelRequested = false;
+    options.isCancelRequested = IsCancelRequested;
+    options.cancelContext = &g_cancelRequested;
+
+    std::thread canceller{ []() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        g_cancelRequested = true;
+    } };
+
+    const auto start = std::chrono::steady_clock::now();
+
+    DownloadScheduler scheduler{ 3 };
+    ADUC_Result result = scheduler.Run(
+        files.Jobs(), &options, nullptr, [](const DownloadJob&, ExtensionManager_Download_Options* fileOptions) {
+            return SimulateTransfer(fileOptions, std::chrono::seconds(10)) ? successResult : cancelledResult;
+        });
+
+    canceller.join();
+
+    CHECK(result.ResultCode == ADUC_Result_Failure_Cancelled);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+}
+
+TEST_CASE("DownloadScheduler - exception is a failure")
+{
+    FileSet files{ 3, 100 };
+    ExtensionManager_Download_Options options = {};
+
+    DownloadScheduler scheduler{ 1 };
+    ADUC_Result result = scheduler.Run(
+        files.Jobs(), &options, nullptr, [](const DownloadJob& job, ExtensionManager_Download_Options*) {
+            if (std::string{ job.entity->FileId } == "file0")
+            {
+                throw std::runtime_error("boom");
+            }
+            return successResult;
+        });
+
+    CHECK(result.ResultCode == ADUC_Result_Failure);
+}
+
+TEST_CASE("DownloadScheduler - empty set succeeds")
+{
+    ExtensionManager_Download_Options options = {};
+
+    DownloadScheduler scheduler{ 4 };
+    ADUC_Result result = scheduler.Run(
+        {}, &options, nullptr, [](const DownloadJob&, ExtensionManager_Download_Options*) { return successResult; });
+
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+}
@@ -10,6 +10,12 @@
 
 #include "aduc/adu_core_exports.h"
 
+/**
+ * @brief Suffix of the sidecar file a content downloader keeps next to a partial download it can resume.
+ * @details A target file with this sidecar is left for the downloader, which resumes or discards it.
+ */
+#define ADUC_CONTENT_DOWNLOADER_RESUME_FILE_SUFFIX ".resume"
+
 EXTERN_C_BEGIN
 
 typedef ADUC_Result (*InitializeProc)(const char* initializeData);
@@ -21,6 +27,14 @@ typedef ADUC_Result (*DownloadProc)(
     unsigned int retryTimeout,
     ADUC_DownloadProgressCallback downloadProgressCallback);
 
+typedef ADUC_Result (*DownloadV2Proc)(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    const ADUC_DownloadDataSink* dataSink);
+
 EXTERN_C_END
 
 #endif // ADUC_CONTENT_DOWNLOADER_EXTENSION_HPP
@@ -45,4 +45,31 @@ ADUC_Result Download(
  */
 #define CONTENT_DOWNLOADER__Download__EXPORT_SYMBOL "Download"
 
+//
+// Content Downloader Extension export V2 symbols.
+// A V2 content downloader reports contract 2.0 from GetContractInfo, still exports all V1 symbols,
+// and additionally exports the following.
+//
+
+/**
+ * @brief The streaming download export.
+ *
+ * @param entity The file entity.
+ * @param workflowId The workflow id.
+ * @param workFolder The work folder for the update payloads.
+ * @param retryTimeout The retry timeout.
+ * @param downloadProgressCallback The download progress callback function.
+ * @param dataSink Receives every byte written to the target file, in file order, as it arrives.
+ * @return ADUC_Result The result.
+ * @details
+ADUC_Result DownloadV2(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    const ADUC_DownloadDataSink* dataSink)
+ */
+#define CONTENT_DOWNLOADER__DownloadV2__EXPORT_SYMBOL "DownloadV2"
+
 #endif // EXTENSION_CONTENT_DOWNLOADER_EXPORT_SYMBOLS_H
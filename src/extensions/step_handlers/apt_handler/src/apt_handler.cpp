@@ -19,7 +19,7 @@
 #include "aduc/installed_criteria_utils.hpp"
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h" // ADUC_FileEntity_Uninit
-#include "aduc/process_utils.hpp"
+#include "aduc/process_broker.hpp"
 #include "aduc/string_c_utils.h"
 #include "aduc/types/update_content.h"
 #include "aduc/workflow_data_utils.h"
@@ -210,7 +210,7 @@ ADUC_Result AptHandlerImpl::Download(const ADUC_WorkflowData* workflowData)
                                                     adushconst::update_action_opt,
                                                     adushconst::update_action_initialize };
 
-            aptExitCode = ADUC_LaunchChildProcess(adushconst::adu_shell, args, aptOutput);
+            aptExitCode = ADUC_LaunchBrokeredChildProcess(adushconst::adu_shell, args, aptOutput);
 
             if (!aptOutput.empty())
             {
@@ -249,7 +249,7 @@ ADUC_Result AptHandlerImpl::Download(const ADUC_WorkflowData* workflowData)
             args.emplace_back(adushconst::target_data_opt);
             args.emplace_back(data.str());
 
-            aptExitCode = ADUC_LaunchChildProcess(adushconst::adu_shell, args, aptOutput);
+            aptExitCode = ADUC_LaunchBrokeredChildProcess(adushconst::adu_shell, args, aptOutput);
 
             if (!aptOutput.empty())
             {
@@ -344,7 +344,7 @@ ADUC_Result AptHandlerImpl::Install(const ADUC_WorkflowData* workflowData)
         args.emplace_back(adushconst::target_data_opt);
         args.emplace_back(data.str());
 
-        aptExitCode = ADUC_LaunchChildProcess(adushconst::adu_shell, args, aptOutput);
+        aptExitCode = ADUC_LaunchBrokeredChildProcess(adushconst::adu_shell, args, aptOutput);
 
         if (!aptOutput.empty())
         {
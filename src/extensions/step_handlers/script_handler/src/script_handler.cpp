@@ -9,7 +9,7 @@
 #include "aduc/extension_manager.hpp"
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h" // ADUC_FileEntity_Uninit
-#include "aduc/process_utils.hpp" // ADUC_LaunchChildProcess
+#include "aduc/process_broker.hpp" // ADUC_LaunchBrokeredChildProcess
 #include "aduc/string_c_utils.h" // IsNullOrEmpty
 #include "aduc/string_utils.hpp" // ADUC::StringUtils::Split
 #include "aduc/system_utils.h" // ADUC_SystemUtils_MkSandboxDirRecursive
@@ -579,7 +579,7 @@ static ADUC_Result ScriptHandler_PerformAction(const std::string& action, const
         Log_Debug("##########\n# ADU-SHELL ARGS:\n##########\n %s", ss.str().c_str());
     }
 
-    exitCode = ADUC_LaunchChildProcess(adushconst::adu_shell, aduShellArgs, scriptOutput);
+    exitCode = ADUC_LaunchBrokeredChildProcess(adushconst::adu_shell, aduShellArgs, scriptOutput);
 
     if (!scriptOutput.empty())
     {
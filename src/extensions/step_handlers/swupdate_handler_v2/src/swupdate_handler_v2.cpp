@@ -16,7 +16,7 @@
 #include "aduc/extension_manager.hpp"
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h" // ADUC_FileEntity_Uninit
-#include "aduc/process_utils.hpp"
+#include "aduc/process_broker.hpp"
 #include "aduc/string_c_utils.h"
 #include "aduc/string_utils.hpp"
 #include "aduc/system_utils.h"
@@ -29,6 +29,7 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <parson.h>
 
@@ -40,6 +41,16 @@ namespace adushconst = Adu::Shell::Const;
 /* external linkage */
 extern ExtensionManager_Download_Options Default_ExtensionManager_Download_Options;
 
+/**
+ * @brief ExtensionManager_Download_Options::isCancelRequested for a workflow.
+ * @param cancelContext The ADUC_WorkflowHandle.
+ * @return bool true if the workflow has been cancelled.
+ */
+static bool IsWorkflowCancelRequested(void* cancelContext)
+{
+    return workflow_is_cancel_requested(static_cast<ADUC_WorkflowHandle>(cancelContext));
+}
+
 struct JSONValueDeleter
 {
     void operator()(JSON_Value* value)
@@ -219,7 +230,7 @@ ADUC_Result SWUpdateHandler_PerformAction(
         goto done;
     }
 
-    exitCode = ADUC_LaunchChildProcess(adushconst::adu_shell, aduShellArgs, scriptOutput);
+    exitCode = ADUC_LaunchBrokeredChildProcess(adushconst::adu_shell, aduShellArgs, scriptOutput);
     if (exitCode != 0)
     {
         int extendedCode = ADUC_ERC_SWUPDATE_HANDLER_CHILD_FAILURE_PROCESS_EXITCODE(exitCode);
@@ -296,9 +307,10 @@ ADUC_Result SWUpdateHandlerImpl::Download(const tagADUC_WorkflowData* workflowDa
     ADUC_WorkflowHandle workflowHandle = workflowData->WorkflowHandle;
     char* installedCriteria = nullptr;
     char* workFolder = workflow_get_workfolder(workflowData->WorkflowHandle);
-    ADUC_FileEntity fileEntity;
-    memset(&fileEntity, 0, sizeof(fileEntity));
     int fileCount = workflow_get_update_files_count(workflowHandle);
+    std::vector<ADUC_FileEntity> fileEntities;
+    std::vector<ADUC::DownloadJob> downloadJobs;
+    ExtensionManager_Download_Options downloadOptions = Default_ExtensionManager_Download_Options;
     ADUC_Result result = SWUpdate_Handler_DownloadScriptFile(workflowHandle);
 
     if (IsAducResultCodeFailure(result.ResultCode))
@@ -318,34 +330,39 @@ ADUC_Result SWUpdateHandlerImpl::Download(const tagADUC_WorkflowData* workflowDa
 
     result = { ADUC_Result_Download_Success };
 
+    fileEntities.resize(fileCount > 0 ? fileCount : 0);
     for (int i = 0; i < fileCount; i++)
     {
-        Log_Info("Downloading file #%d", i);
-
-        if (!workflow_get_update_file(workflowHandle, i, &fileEntity))
+        memset(&fileEntities[i], 0, sizeof(fileEntities[i]));
+        if (!workflow_get_update_file(workflowHandle, i, &fileEntities[i]))
         {
             result = { .ResultCode = ADUC_Result_Failure,
                        .ExtendedResultCode = ADUC_ERC_SWUPDATE_HANDLER_DOWNLOAD_FAILURE_GET_PAYLOAD_FILE_ENTITY };
             goto done;
         }
 
-        try
-        {
-            result = ExtensionManager::Download(
-                &fileEntity, workflowHandle, &Default_ExtensionManager_Download_Options, nullptr);
-        }
-        catch (...)
-        {
-            result = { .ResultCode = ADUC_Result_Failure,
-                       .ExtendedResultCode =
-                           ADUC_ERC_SWUPDATE_HANDLER_DOWNLOAD_PAYLOAD_FILE_FAILURE_UNKNOWNEXCEPTION };
-        }
+        downloadJobs.push_back(
+            ADUC::DownloadJob{ &fileEntities[i], workflowHandle, workflow_peek_id(workflowHandle) });
+    }
 
-        if (IsAducResultCodeFailure(result.ResultCode))
-        {
-            Log_Error("Cannot download payload file#%d. (0x%X)", i, result.ExtendedResultCode);
-            goto done;
-        }
+    // The payload files are independent, so download them in parallel.
+    downloadOptions.isCancelRequested = IsWorkflowCancelRequested;
+    downloadOptions.cancelContext = workflowHandle;
+
+    try
+    {
+        result = ExtensionManager::DownloadFiles(downloadJobs, &downloadOptions, nullptr);
+    }
+    catch (...)
+    {
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_SWUPDATE_HANDLER_DOWNLOAD_PAYLOAD_FILE_FAILURE_UNKNOWNEXCEPTION };
+    }
+
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        Log_Error("Cannot download payload files. (0x%X)", result.ExtendedResultCode);
+        goto done;
     }
 
     // Invoke primary script to download additional files, if required.
@@ -353,7 +370,10 @@ ADUC_Result SWUpdateHandlerImpl::Download(const tagADUC_WorkflowData* workflowDa
 
 done:
     workflow_free_string(workFolder);
-    ADUC_FileEntity_Uninit(&fileEntity);
+    for (ADUC_FileEntity& fileEntity : fileEntities)
+    {
+        ADUC_FileEntity_Uninit(&fileEntity);
+    }
     workflow_free_string(installedCriteria);
     Log_Info("SWUpdate_Handler download task end.");
     return result;
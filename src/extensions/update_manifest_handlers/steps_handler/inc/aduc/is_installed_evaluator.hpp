@@ -0,0 +1,89 @@
+/**
+ * @file is_installed_evaluator.hpp
+ * @brief Evaluates a set of ordered IsInstalled checks with bounded concurrency.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#ifndef ADUC_IS_INSTALLED_EVALUATOR_HPP
+#define ADUC_IS_INSTALLED_EVALUATOR_HPP
+
+#include <aduc/result.h> // ADUC_Result
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief The upper bound for the number of IsInstalled checks evaluated in parallel.
+ */
+#define ADUC_IS_INSTALLED_EVALUATOR_MAX_CONCURRENCY 16
+
+namespace ADUC
+{
+/**
+ * @brief The indices, in increasing order, of checks that must be evaluated one after another.
+ * e.g. the checks of steps that share a work folder.
+ */
+using IsInstalledLane = std::vector<size_t>;
+
+/**
+ * @brief Evaluates one check. Checks of different lanes may be evaluated at the same time.
+ */
+using IsInstalledFunction = std::function<ADUC_Result(size_t check)>;
+
+/**
+ * @brief Runs IsInstalled checks on up to N worker threads, and finds the first check, in check order, that is not
+ * installed.
+ *
+ * @details Lanes are started in the order of their first check, and no check after a known 'not installed' one is
+ * started, so every check before the first 'not installed' one is evaluated, and the outcome is the same as
+ * evaluating the checks one by one, whatever the concurrency and timing. Checks after it may have been evaluated too;
+ * their results are to be ignored.
+ *
+ * A Run on one of the worker threads, e.g. for a nested workflow, evaluates its checks on that thread, one by one.
+ */
+class IsInstalledEvaluator
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param maxConcurrency The number of checks to evaluate at once.
+     * Clamped to [1, ADUC_IS_INSTALLED_EVALUATOR_MAX_CONCURRENCY].
+     */
+    explicit IsInstalledEvaluator(unsigned int maxConcurrency);
+
+    /**
+     * @brief Evaluates the checks of @p lanes until one is not installed.
+     *
+     * @param checkCount The number of checks. Checks that are in no lane are not evaluated.
+     * @param lanes The checks to evaluate. Each check is in at most one lane.
+     * @param isInstalled The function that evaluates one check. An exception means 'not installed'.
+     * @param[out] results Resized to @p checkCount. Receives the result of each evaluated check. The others are
+     * ADUC_Result_Failure_Cancelled.
+     * @return size_t The index of the first check whose result is a failure or ADUC_Result_IsInstalled_NotInstalled,
+     * or @p checkCount if there is none.
+     */
+    size_t Run(
+        size_t checkCount,
+        const std::vector<IsInstalledLane>& lanes,
+        const IsInstalledFunction& isInstalled,
+        std::vector<ADUC_Result>* results);
+
+    /**
+     * @brief Gets the effective concurrency.
+     * @return unsigned int The number of checks evaluated at once.
+     */
+    unsigned int GetMaxConcurrency() const
+    {
+        return _maxConcurrency;
+    }
+
+private:
+    unsigned int _maxConcurrency;
+};
+
+} // namespace ADUC
+
+#endif // ADUC_IS_INSTALLED_EVALUATOR_HPP
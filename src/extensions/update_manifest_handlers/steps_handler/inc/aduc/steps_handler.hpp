@@ -20,6 +20,13 @@ class StepsHandlerImpl : public ContentHandler
 public:
     static ContentHandler* CreateContentHandler();
 
+    /**
+     * @brief Overrides the maxConcurrentInstalledChecks of du-config.json, e.g. in tests.
+     * @param maxConcurrentInstalledChecks The number of is-installed checks to evaluate in parallel, or 0 to use
+     * du-config.json again.
+     */
+    static void SetMaxConcurrentInstalledChecks(unsigned int maxConcurrentInstalledChecks);
+
     // Delete copy ctor, copy assignment, move ctor and move assignment operators.
     StepsHandlerImpl(const StepsHandlerImpl&) = delete;
     StepsHandlerImpl& operator=(const StepsHandlerImpl&) = delete;
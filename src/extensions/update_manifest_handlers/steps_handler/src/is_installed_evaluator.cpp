@@ -0,0 +1,189 @@
+/**
+ * @file is_installed_evaluator.cpp
+ * @brief Implements the bounded-concurrency IsInstalled evaluator.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/is_installed_evaluator.hpp"
+
+#include <aduc/logging.h>
+#include <aduc/types/adu_core.h> // ADUC_Result_*
+
+#include <algorithm> // std::min, std::sort
+#include <atomic>
+#include <system_error>
+#include <thread>
+
+namespace ADUC
+{
+/**
+ * @brief Whether the current thread is a worker of an IsInstalledEvaluator::Run.
+ */
+static thread_local bool t_isEvaluatorWorker = false;
+
+/**
+ * @brief State shared by the worker threads of one IsInstalledEvaluator::Run.
+ */
+struct IsInstalledEvaluatorState
+{
+    IsInstalledEvaluatorState(
+        const std::vector<IsInstalledLane>& lanesIn,
+        const IsInstalledFunction& isInstalledIn,
+        std::vector<ADUC_Result>* resultsIn,
+        size_t checkCount) :
+        lanes(lanesIn),
+        isInstalled(isInstalledIn), results(resultsIn), firstNotInstalled(checkCount)
+    {
+    }
+
+    const std::vector<IsInstalledLane>& lanes;
+    const IsInstalledFunction& isInstalled;
+
+    // Each check's result is written by the one worker that evaluates it, and read after the workers are joined.
+    std::vector<ADUC_Result>* results;
+
+    std::vector<size_t> laneOrder; // Lane indices, in the order of their first check.
+    std::atomic<size_t> nextLane{ 0 };
+    std::atomic<size_t> firstNotInstalled;
+};
+
+/**
+ * @brief Whether @p result stops the evaluation.
+ */
+static bool IsNotInstalledResult(const ADUC_Result& result)
+{
+    return IsAducResultCodeFailure(result.ResultCode) || result.ResultCode == ADUC_Result_IsInstalled_NotInstalled;
+}
+
+/**
+ * @brief Evaluates lanes until none are left, or no check that is left can come before a 'not installed' one.
+ * @param state The shared state.
+ */
+static void EvaluatorWorker(IsInstalledEvaluatorState* state)
+{
+    for (;;)
+    {
+        const size_t order = state->nextLane++;
+        if (order >= state->laneOrder.size())
+        {
+            break;
+        }
+
+        for (size_t check : state->lanes[state->laneOrder[order]])
+        {
+            if (check >= state->firstNotInstalled)
+            {
+                break;
+            }
+
+            ADUC_Result result;
+            try
+            {
+                result = state->isInstalled(check);
+            }
+            catch (...)
+            {
+                // Cannot determine whether the check is satisfied, so, let's assume that it's not installed.
+                Log_Error("Exception while evaluating is-installed check #%zu.", check);
+                result = { ADUC_Result_IsInstalled_NotInstalled, 0 };
+            }
+
+            (*state->results)[check] = result;
+
+            if (IsNotInstalledResult(result))
+            {
+                size_t first = state->firstNotInstalled;
+                while (check < first && !state->firstNotInstalled.compare_exchange_weak(first, check))
+                {
+                }
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief EvaluatorWorker for a worker thread.
+ * @param state The shared state.
+ */
+static void EvaluatorWorkerThread(IsInstalledEvaluatorState* state)
+{
+    t_isEvaluatorWorker = true;
+    EvaluatorWorker(state);
+}
+
+IsInstalledEvaluator::IsInstalledEvaluator(unsigned int maxConcurrency) :
+    _maxConcurrency{ std::min<unsigned int>(
+        std::max(maxConcurrency, 1u), ADUC_IS_INSTALLED_EVALUATOR_MAX_CONCURRENCY) }
+{
+}
+
+size_t IsInstalledEvaluator::Run(
+    size_t checkCount,
+    const std::vector<IsInstalledLane>& lanes,
+    const IsInstalledFunction& isInstalled,
+    std::vector<ADUC_Result>* results)
+{
+    results->assign(checkCount, ADUC_Result{ ADUC_Result_Failure_Cancelled, 0 });
+
+    IsInstalledEvaluatorState state{ lanes, isInstalled, results, checkCount };
+
+    for (size_t i = 0; i < lanes.size(); ++i)
+    {
+        if (!lanes[i].empty())
+        {
+            state.laneOrder.push_back(i);
+        }
+    }
+
+    std::sort(state.laneOrder.begin(), state.laneOrder.end(), [&lanes](size_t a, size_t b) {
+        return lanes[a].front() < lanes[b].front();
+    });
+
+    // Nested evaluations stay on their worker, so that the outer concurrency bounds the threads in use.
+    const unsigned int workerCount = t_isEvaluatorWorker
+        ? 1
+        : static_cast<unsigned int>(std::min<size_t>(_maxConcurrency, state.laneOrder.size()));
+
+    Log_Debug(
+        "Evaluating %zu is-installed check(s) in %zu lane(s), %u at a time.",
+        checkCount,
+        state.laneOrder.size(),
+        workerCount);
+
+    std::vector<std::thread> workers;
+
+    if (workerCount > 1)
+    {
+        workers.reserve(workerCount);
+
+        for (unsigned int i = 0; i < workerCount; ++i)
+        {
+            try
+            {
+                workers.emplace_back(EvaluatorWorkerThread, &state);
+            }
+            catch (const std::system_error& e)
+            {
+                // Carry on with the workers we have; the calling thread evaluates if there are none.
+                Log_Warn("Cannot start is-installed worker #%u: %s", i, e.what());
+                break;
+            }
+        }
+    }
+
+    if (workers.empty())
+    {
+        EvaluatorWorker(&state);
+    }
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    return state.firstNotInstalled;
+}
+
+} // namespace ADUC
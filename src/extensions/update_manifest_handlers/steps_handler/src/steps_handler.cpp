@@ -9,8 +9,10 @@
 
 #include "aduc/calloc_wrapper.hpp" // cstr_wrapper
 #include "aduc/component_enumerator_extension.hpp"
+#include "aduc/config_utils.h" // ADUC_ConfigInfo
 #include "aduc/extension_manager.hpp"
 #include "aduc/extension_manager_download_options.h"
+#include "aduc/is_installed_evaluator.hpp"
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h" // ADUC_FileEntity_Uninit
 #include "aduc/string_c_utils.h" // IsNullOrEmpty
@@ -20,17 +22,27 @@
 
 #include <azure_c_shared_utility/crt_abstractions.h> // mallocAndStrcpy
 #include <azure_c_shared_utility/strings.h> // STRING_*
+#include <atomic>
 #include <parson.h>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 // Note: this requires ${CMAKE_DL_LIBS}
 #include <dlfcn.h>
 
 using ADUC::StringUtils::cstr_wrapper;
 
+/* external linkage */
+extern ExtensionManager_Download_Options Default_ExtensionManager_Download_Options;
+
 #define DEFAULT_REF_STEP_HANDLER "microsoft/steps:1"
 
+// The folder, under the workflow's work folder and suffixed with the component index, where inline steps are evaluated
+// for each selected component but the first.
+#define IS_INSTALLED_COMPONENT_FOLDER_PREFIX ".isinstalled-component-"
+
 /**
  * @brief Check whether to show additional debug logs.
  *
@@ -49,19 +61,156 @@ StepsHandlerImpl::~StepsHandlerImpl() // override
     ADUC_Logging_Uninit();
 }
 
+/**
+ * @brief ExtensionManager_Download_Options::isCancelRequested for a workflow.
+ * @param cancelContext The ADUC_WorkflowHandle.
+ * @return bool true if the workflow has been cancelled.
+ */
+static bool IsWorkflowCancelRequested(void* cancelContext)
+{
+    return workflow_is_cancel_requested(static_cast<ADUC_WorkflowHandle>(cancelContext));
+}
+
+/**
+ * @brief Gets a key that identifies the content of @p entity by all of its hashes.
+ *
+ * @param entity The file entity.
+ * @return std::string The hash types and values of @p entity, in manifest order.
+ */
+static std::string GetFileEntityHashKey(const ADUC_FileEntity& entity)
+{
+    std::string key;
+    for (size_t i = 0; i < entity.HashCount; i++)
+    {
+        key += entity.Hash[i].type == nullptr ? "" : entity.Hash[i].type;
+        key += ':';
+        key += entity.Hash[i].value == nullptr ? "" : entity.Hash[i].value;
+        key += ';';
+    }
+    return key;
+}
+
+/**
+ * @brief Downloads the detached manifest files of all reference steps in parallel, up to the maxConcurrentDownloads
+ * set in du-config.json. Each file is checked against its hash as it is downloaded.
+ * @details Stops at the first failure. Steps that reference the same manifest file, with the same hashes, share one
+ * download. Steps that reference the same target file with different hashes fail the download, since each would read
+ * the other's manifest.
+ *
+ * @param handle The steps workflow handle.
+ * @param stepCount The number of steps.
+ * @param[out] manifestEntities Receives the detached manifest file entity of each reference step, indexed by step.
+ * Inline steps get an empty entity. The caller must uninit each entity, even on failure.
+ * @return ADUC_Result
+ */
+static ADUC_Result DownloadDetachedManifests(
+    ADUC_WorkflowHandle handle, unsigned int stepCount, std::vector<ADUC_FileEntity>* manifestEntities)
+{
+    ADUC_Result result = { .ResultCode = ADUC_Result_Success, .ExtendedResultCode = 0 };
+    int workflowLevel = workflow_get_level(handle);
+    std::vector<ADUC::DownloadJob> downloadJobs;
+    // Target file name to the hash key of the file downloaded to it.
+    std::unordered_map<std::string, std::string> targetFileHashKeys;
+
+    ADUC_FileEntity emptyEntity;
+    memset(&emptyEntity, 0, sizeof(emptyEntity));
+    manifestEntities->assign(stepCount, emptyEntity);
+
+    // Workflow data is not thread-safe, so read all file entities before fanning out.
+    for (unsigned int i = 0; i < stepCount; i++)
+    {
+        if (workflow_is_inline_step(handle, i))
+        {
+            continue;
+        }
+
+        ADUC_FileEntity& entity = (*manifestEntities)[i];
+        if (!workflow_get_step_detached_manifest_file(handle, i, &entity))
+        {
+            Log_Error("Cannot get a detached Update manifest file entity for level#%d step#%d", workflowLevel, i);
+            return { .ResultCode = ADUC_Result_Failure,
+                     .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_GET_FILE_ENTITY_FAILURE };
+        }
+
+        // Each download needs a distinct target file.
+        const std::string hashKey = GetFileEntityHashKey(entity);
+        const auto inserted = targetFileHashKeys.emplace(entity.TargetFilename, hashKey);
+        if (!inserted.second)
+        {
+            if (inserted.first->second == hashKey)
+            {
+                continue;
+            }
+
+            Log_Error(
+                "Detached Update manifest file '%s' of level#%d step#%d has a different hash than an earlier step's.",
+                entity.TargetFilename,
+                workflowLevel,
+                i);
+            workflow_set_result_details(
+                handle, "Conflicting hashes for detached manifest file '%s' (step #%d)", entity.TargetFilename, i);
+            return { .ResultCode = ADUC_Result_Failure,
+                     .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DETACHED_MANIFEST_HASH_CONFLICT };
+        }
+
+        Log_Info(
+            "Downloading a detached Update manifest file for level#%d step#%d (file id:%s).",
+            workflowLevel,
+            i,
+            entity.FileId);
+
+        downloadJobs.push_back(ADUC::DownloadJob{ &entity, handle, workflow_peek_id(handle) });
+    }
+
+    if (downloadJobs.empty())
+    {
+        return result;
+    }
+
+    try
+    {
+        ExtensionManager_Download_Options downloadOptions = {
+            .retryTimeout = DO_RETRY_TIMEOUT_DEFAULT,
+        };
+        downloadOptions.isCancelRequested = IsWorkflowCancelRequested;
+        downloadOptions.cancelContext = handle;
+
+        result = ExtensionManager::DownloadFiles(downloadJobs, &downloadOptions, nullptr);
+    }
+    catch (...)
+    {
+        Log_Error(
+            "Exception occurred while downloading the detached Update Manifest files for level#%d.", workflowLevel);
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_FAILURE_UNKNOWNEXCEPTION };
+    }
+
+    // For 'microsoft/steps:1' implementation, abort download task as soon as an error occurs.
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        Log_Error(
+            "An error occurred while downloading the detached manifest files for level#%d (erc:%d)",
+            workflowLevel,
+            result.ExtendedResultCode);
+    }
+
+    return result;
+}
+
 /**
  * @brief Ensure all steps' workflow data objects are created.
  *
  * Algorithm:
  *    Start from a given parent workflow ( @p handle )
  *
+ *       download all reference steps' detached-manifest files, in parallel
+ *
  *       foreach step in steps {
  *
  *          if in-line step {
  *              - create child workflow for this step (inherit some file entities from parent workflow )
  *              - copy parent workflow's selected components into child workflow
  *          } else {
- *              - download this reference step detached-manifest file
  *              - create child workflow for this step from manifest file (inherit some file entities from parent workflow)
  *              - select target components based on this step workflow's compatibilities
  *                  Note: components-enumerator extension is not registered, the reference step will be applied to host device (selected component is empty)
@@ -81,7 +230,7 @@ ADUC_Result PrepareStepsWorkflowDataObject(ADUC_WorkflowHandle handle)
     auto stepCount = static_cast<unsigned int>(workflow_get_instructions_steps_count(handle));
     char* workFolder = workflow_get_workfolder(handle);
     unsigned int childWorkflowCount = workflow_get_children_count(handle);
-    ADUC_FileEntity* entity = nullptr;
+    std::vector<ADUC_FileEntity> manifestEntities;
     int workflowLevel = workflow_get_level(handle);
 
     // Child workflow should be either 0 (resuming install phase after agent restarted),
@@ -95,13 +244,17 @@ ADUC_Result PrepareStepsWorkflowDataObject(ADUC_WorkflowHandle handle)
             workflow_free(child);
         }
 
+        result = DownloadDetachedManifests(handle, stepCount, &manifestEntities);
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            goto done;
+        }
+
         Log_Debug("Creating workflow for %d step(s). Parent's level: %d", stepCount, workflowLevel);
         for (unsigned int i = 0; i < stepCount; i++)
         {
             STRING_HANDLE childId = nullptr;
             childHandle = nullptr;
-            ADUC_FileEntity entity;
-            memset(&entity, 0, sizeof(entity));
 
             if (workflow_is_inline_step(handle, i))
             {
@@ -126,52 +279,8 @@ ADUC_Result PrepareStepsWorkflowDataObject(ADUC_WorkflowHandle handle)
             }
             else
             {
-                // Download detached update manifest file.
-                if (!workflow_get_step_detached_manifest_file(handle, i, &entity))
-                {
-                    result = { .ResultCode = ADUC_Result_Failure,
-                               .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_GET_FILE_ENTITY_FAILURE };
-                    Log_Error(
-                        "Cannot get a detached Update manifest file entity for level#%d step#%d", workflowLevel, i);
-                    goto done;
-                }
-
-                Log_Info(
-                    "Downloading a detached Update manifest file for level#%d step#%d (file id:%s).",
-                    workflowLevel,
-                    i,
-                    entity.FileId);
-
-                try
-                {
-                    ExtensionManager_Download_Options downloadOptions = {
-                        .retryTimeout = DO_RETRY_TIMEOUT_DEFAULT,
-                    };
-
-                    result = ExtensionManager::Download(&entity, handle, &downloadOptions, nullptr);
-                }
-                catch (...)
-                {
-                    Log_Error(
-                        "Exception occurred while downloading a detached Update Manifest file for level#%d step#%d (file id:%s).",
-                        workflowLevel,
-                        i,
-                        entity.FileId);
-                    result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_FAILURE_UNKNOWNEXCEPTION;
-                }
-
                 std::stringstream childManifestFile;
-                childManifestFile << workFolder << "/" << entity.TargetFilename;
-
-                // For 'microsoft/steps:1' implementation, abort download task as soon as an error occurs.
-                if (IsAducResultCodeFailure(result.ResultCode))
-                {
-                    Log_Error(
-                        "An error occurred while downloading manifest file for step#%d (erc:%d)",
-                        i,
-                        result.ExtendedResultCode);
-                    goto done;
-                }
+                childManifestFile << workFolder << "/" << manifestEntities[i].TargetFilename;
 
                 // Create child workflow from file.
                 result = workflow_init_from_file(childManifestFile.str().c_str(), false, &childHandle);
@@ -258,7 +367,10 @@ ADUC_Result PrepareStepsWorkflowDataObject(ADUC_WorkflowHandle handle)
 
 done:
     workflow_free_string(workFolder);
-    ADUC_FileEntity_Uninit(entity);
+    for (ADUC_FileEntity& entity : manifestEntities)
+    {
+        ADUC_FileEntity_Uninit(&entity);
+    }
 
     if (IsAducResultCodeFailure(result.ResultCode))
     {
@@ -300,7 +412,9 @@ static char* CreateComponentSerializedString(JSON_Array* components, size_t inde
     JSON_Array* array = json_array(json_value_init_array());
     json_array_append_value(array, componentClone);
     json_object_set_value(json_object(root), "components", json_array_get_wrapping_value(array));
-    return json_serialize_to_string_pretty(root);
+    char* serializedComponents = json_serialize_to_string_pretty(root);
+    json_value_free(root);
+    return serializedComponents;
 }
 
 /**
@@ -354,25 +468,141 @@ done:
     return result;
 }
 
-static ADUC_Result DoV1DownloadWork(
-    ADUC_WorkflowData* stepWorkflow,
-    ContentHandler* contentHandler,
-    ADUC_WorkflowHandle handle,
-    ADUC_WorkflowHandle stepHandle)
+/**
+ * @brief Calls the step handler's IsInstalled.
+ *
+ * @param stepWorkflow The step workflow data.
+ * @param contentHandler The step handler.
+ * @return ADUC_Result ADUC_Result_IsInstalled_NotInstalled if the handler could not tell.
+ */
+static ADUC_Result StepIsInstalled(ADUC_WorkflowData* stepWorkflow, ContentHandler* contentHandler)
 {
-    ADUC_Result result{};
-
-    // If this item is already installed, skip to the next one.
     try
     {
-        result = contentHandler->IsInstalled(stepWorkflow);
+        return contentHandler->IsInstalled(stepWorkflow);
     }
     catch (...)
     {
         // Cannot determine whether the step has been applied, so, we'll try to process the step.
-        result = { .ResultCode = ADUC_Result_IsInstalled_NotInstalled, .ExtendedResultCode = 0 };
+        return { .ResultCode = ADUC_Result_IsInstalled_NotInstalled, .ExtendedResultCode = 0 };
+    }
+}
+
+/**
+ * @brief Whether @p result is the outcome of an IsInstalled call.
+ */
+static bool IsIsInstalledResult(const ADUC_Result& result)
+{
+    return result.ResultCode == ADUC_Result_IsInstalled_Installed
+        || result.ResultCode == ADUC_Result_IsInstalled_NotInstalled;
+}
+
+// The override set by StepsHandlerImpl::SetMaxConcurrentInstalledChecks, or 0.
+static std::atomic<unsigned int> s_maxConcurrentInstalledChecksOverride{ 0 };
+
+void StepsHandlerImpl::SetMaxConcurrentInstalledChecks(unsigned int maxConcurrentInstalledChecks)
+{
+    s_maxConcurrentInstalledChecksOverride = maxConcurrentInstalledChecks;
+}
+
+/**
+ * @brief Gets the number of step is-installed checks to evaluate in parallel, as configured in du-config.json.
+ * @return unsigned int The override, the configured value, or ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_INSTALLED_CHECKS.
+ */
+static unsigned int GetMaxConcurrentInstalledChecks()
+{
+    unsigned int maxConcurrentInstalledChecks = s_maxConcurrentInstalledChecksOverride;
+    if (maxConcurrentInstalledChecks != 0)
+    {
+        return maxConcurrentInstalledChecks;
+    }
+
+    maxConcurrentInstalledChecks = ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_INSTALLED_CHECKS;
+
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config != nullptr)
+    {
+        maxConcurrentInstalledChecks = config->maxConcurrentInstalledChecks;
+    }
+    ADUC_ConfigInfo_ReleaseInstance(config);
+
+    return maxConcurrentInstalledChecks;
+}
+
+/**
+ * @brief The IsInstalled check of a child step, for a selected component.
+ */
+struct StepIsInstalledCheck
+{
+    int step; /**< The child step index. */
+    int component; /**< The selected component index. */
+    size_t sameAs; /**< The index of the identical, earlier check whose result this one reuses, or its own index. */
+    ADUC_WorkflowHandle stepHandle; /**< The step workflow to evaluate. */
+    bool ownsStepHandle; /**< Whether stepHandle is a copy of the child workflow, to be freed. */
+    const char* updateType; /**< The step handler type. */
+    ContentHandler* contentHandler; /**< The step handler. */
+    ADUC_Result loadResult; /**< The result of loading the step handler. */
+};
+
+/**
+ * @brief Creates a copy of an inline step's child workflow, for evaluating the step on another component.
+ * @details The inline steps of a workflow share its work folder, and handlers keep files there under fixed names, so
+ * the copy gets a work folder of its own.
+ *
+ * @param handle The workflow that has the step.
+ * @param stepIndex The step index.
+ * @param serializedComponent The component, as a serialized 'components' json string.
+ * @param workFolder The work folder of the copy.
+ * @param[out] stepHandle The copy. Caller must free it with workflow_free().
+ * @return ADUC_Result ADUC_Result_Success on success.
+ */
+static ADUC_Result CreateComponentStepWorkflow(
+    ADUC_WorkflowHandle handle,
+    int stepIndex,
+    const char* serializedComponent,
+    const char* workFolder,
+    ADUC_WorkflowHandle* stepHandle)
+{
+    ADUC_WorkflowHandle copy = nullptr;
+
+    ADUC_Result result = workflow_create_from_inline_step(handle, stepIndex, &copy);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
+
+    workflow_set_step_index(copy, stepIndex);
+    workflow_set_parent(copy, handle);
+
+    if (!workflow_set_id(copy, workflow_peek_id(workflow_get_child(handle, stepIndex)))
+        || !workflow_set_workfolder(copy, "%s", workFolder)
+        || !workflow_set_selected_components(copy, serializedComponent))
+    {
+        result = { .ResultCode = ADUC_Result_Failure,
+                   .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_CHILD_WORKFLOW_CREATE_FAILED };
+        goto done;
     }
 
+    *stepHandle = copy;
+    copy = nullptr;
+    result = { .ResultCode = ADUC_Result_Success, .ExtendedResultCode = 0 };
+
+done:
+    workflow_free(copy);
+    return result;
+}
+
+static ADUC_Result DoV1DownloadWork(
+    ADUC_WorkflowData* stepWorkflow,
+    ContentHandler* contentHandler,
+    ADUC_WorkflowHandle handle,
+    ADUC_WorkflowHandle stepHandle,
+    const ADUC_Result& isInstalledResult)
+{
+    // If this item is already installed, skip to the next one.
+    ADUC_Result result =
+        IsIsInstalledResult(isInstalledResult) ? isInstalledResult : StepIsInstalled(stepWorkflow, contentHandler);
+
     if (IsAducResultCodeSuccess(result.ResultCode) && result.ResultCode == ADUC_Result_IsInstalled_Installed)
     {
         result.ResultCode = ADUC_Result_Install_Skipped_UpdateAlreadyInstalled;
@@ -477,6 +707,113 @@ done:
     return result;
 }
 
+/**
+ * @brief Downloads the payload files of all inline steps that are not installed yet, in parallel, so that each
+ * step handler's Download finds its files already in place instead of fetching them one at a time.
+ * @details Best effort: a file that cannot be prefetched is downloaded, and its failure reported, by the step
+ * handler. Reference steps are skipped, since their payloads are known only once their detached manifest is read.
+ *
+ * @param handle The steps workflow handle.
+ * @param stepsCount The number of steps.
+ * @param serializedComponentString The selected component for the inline steps, or nullptr.
+ * @param[out] isInstalledResults Receives each step's IsInstalled result. Steps that were not checked keep
+ * ADUC_Result_Failure.
+ */
+static void PrefetchInlineStepPayloads(
+    ADUC_WorkflowHandle handle,
+    int stepsCount,
+    const char* serializedComponentString,
+    std::vector<ADUC_Result>* isInstalledResults)
+{
+    std::vector<ADUC_FileEntity> fileEntities;
+    std::vector<ADUC_WorkflowHandle> fileOwners;
+    std::vector<ADUC::DownloadJob> downloadJobs;
+
+    isInstalledResults->assign(stepsCount, ADUC_Result{ .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 });
+
+    for (int i = 0; i < stepsCount; i++)
+    {
+        ADUC_WorkflowHandle stepHandle = workflow_get_child(handle, i);
+        if (stepHandle == nullptr || !workflow_is_inline_step(handle, i))
+        {
+            continue;
+        }
+
+        if (serializedComponentString != nullptr
+            && !workflow_set_selected_components(stepHandle, serializedComponentString))
+        {
+            continue;
+        }
+
+        ContentHandler* contentHandler = nullptr;
+        ADUC_Result result = ExtensionManager::LoadUpdateContentHandlerExtension(
+            workflow_peek_update_manifest_step_handler(handle, i), &contentHandler);
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            continue;
+        }
+
+        ADUC_ExtensionContractInfo contractInfo = contentHandler->GetContractInfo();
+        if (!ADUC_ContractUtils_IsV1Contract(&contractInfo))
+        {
+            continue;
+        }
+
+        ADUC_WorkflowData stepWorkflow = {};
+        stepWorkflow.WorkflowHandle = stepHandle;
+        (*isInstalledResults)[i] = StepIsInstalled(&stepWorkflow, contentHandler);
+        if ((*isInstalledResults)[i].ResultCode == ADUC_Result_IsInstalled_Installed)
+        {
+            continue;
+        }
+
+        for (size_t iFile = 0, fileCount = workflow_get_update_files_count(stepHandle); iFile < fileCount; iFile++)
+        {
+            ADUC_FileEntity entity = {};
+            if (workflow_get_update_file(stepHandle, iFile, &entity))
+            {
+                fileEntities.push_back(entity);
+                fileOwners.push_back(stepHandle);
+            }
+        }
+    }
+
+    // A single file gains nothing from being fetched ahead of its handler.
+    if (fileEntities.size() > 1 && !workflow_is_cancel_requested(handle))
+    {
+        for (size_t i = 0; i < fileEntities.size(); i++)
+        {
+            downloadJobs.push_back(
+                ADUC::DownloadJob{ &fileEntities[i], fileOwners[i], workflow_peek_id(fileOwners[i]) });
+        }
+
+        ExtensionManager_Download_Options downloadOptions = Default_ExtensionManager_Download_Options;
+        downloadOptions.isCancelRequested = IsWorkflowCancelRequested;
+        downloadOptions.cancelContext = handle;
+
+        Log_Info("Prefetching %zu payload file(s) of the inline steps.", fileEntities.size());
+
+        try
+        {
+            ADUC_Result result = ExtensionManager::DownloadFiles(downloadJobs, &downloadOptions, nullptr);
+            if (IsAducResultCodeFailure(result.ResultCode))
+            {
+                Log_Warn(
+                    "Payload prefetch failed (0x%X). Steps will download their own files.", result.ExtendedResultCode);
+            }
+        }
+        catch (...)
+        {
+            Log_Warn("Payload prefetch failed. Steps will download their own files.");
+        }
+    }
+
+    for (ADUC_FileEntity& entity : fileEntities)
+    {
+        ADUC_FileEntity_Uninit(&entity);
+    }
+}
+
 /**
  * @brief Performs 'Download' task by iterating through all steps and invoke each step's handler
  * to download file(s), if needed.
@@ -502,6 +839,7 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
     char* serializedComponentString = nullptr;
     bool isComponentsEnumeratorRegistered = ExtensionManager::IsComponentsEnumeratorRegistered();
     int createResult = 0;
+    std::vector<ADUC_Result> isInstalledResults;
 
     if (workflow_is_cancel_requested(handle))
     {
@@ -549,6 +887,8 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
     {
         serializedComponentString = CreateComponentSerializedString(selectedComponentsArray, iCom);
 
+        PrefetchInlineStepPayloads(handle, stepsCount, serializedComponentString, &isInstalledResults);
+
         //
         // For each step (child workflow), invoke backup, install and apply actions.
         // if install or apply fails, invoke restore action.
@@ -611,7 +951,7 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
             ADUC_ExtensionContractInfo contractInfo = contentHandler->GetContractInfo();
             if (ADUC_ContractUtils_IsV1Contract(&contractInfo))
             {
-                result = DoV1DownloadWork(&stepWorkflow, contentHandler, handle, stepHandle);
+                result = DoV1DownloadWork(&stepWorkflow, contentHandler, handle, stepHandle, isInstalledResults[i]);
 
                 if (IsAducResultCodeFailure(result.ResultCode))
                 {
@@ -1223,6 +1563,8 @@ ADUC_Result StepsHandlerImpl::Cancel(const tagADUC_WorkflowData* workflowData)
  *
  *   Algorithm:
  *        - Iterate through child steps collection and call IsInstalled() on each step's handler to determine the step's 'IsInstalled' state.
+ *            - Steps are evaluated in order, or concurrently up to the maxConcurrentInstalledChecks opted into in du-config.json with the outcome of evaluating them in order.
+ *            - An inline step evaluated for the same component, with the same handler, files, and handlerProperties (installedCriteria) as an earlier step, reuses its result.
  *            - For a step that has already been 'Installed', ensure that the step's WorkflowData cached-result is set accordingly.
  *        - If one or more steps is not 'Installed', return ADUC_Result_IsInstalled_NotInstalled
  *        - If all steps are 'Installed', return ADUC_Result_IsInstalled_Installed
@@ -1247,6 +1589,13 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
     char* serializedComponentString = nullptr;
     bool isComponentsEnumeratorRegistered = ExtensionManager::IsComponentsEnumeratorRegistered();
 
+    std::vector<StepIsInstalledCheck> checks;
+    std::vector<ADUC::IsInstalledLane> lanes;
+    std::vector<ADUC_Result> checkResults;
+    std::unordered_map<std::string, size_t> inlineChecks; // Index of the first check of each key.
+    std::vector<std::string> componentFolders;
+    size_t firstNotInstalled = 0;
+
     Log_Debug("Evaluating is-installed state of the workflow (level %d, step %d).", workflowLevel, workflowStep);
 
     int createResult = ADUC_SystemUtils_MkSandboxDirRecursive(workFolder);
@@ -1308,109 +1657,223 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
         }
     }
 
-    // For each selected component, check whether the update has been installed.
+    // For each selected component, plan the IsInstalled() check of each step (child workflow), in the order that
+    // they would be evaluated one by one.
     for (int iCom = 0, stepsCount = workflow_get_children_count(handle); iCom < selectedComponentsCount; iCom++)
     {
         serializedComponentString = CreateComponentSerializedString(selectedComponentsArray, iCom);
 
-        // For each step (child workflow), invoke IsInstalled().
+        // The inline steps of a workflow share its work folder, so a component's inline steps are evaluated in order,
+        // in a work folder of that component.
+        int inlineLane = -1;
+
         for (int i = 0; i < stepsCount; i++)
         {
             if (IsStepsHandlerExtraDebugLogsEnabled())
             {
                 Log_Debug(
-                    "Evaluating child step #%d on component #%d.\n#### Component ####\n%s\n###################\n",
+                    "Planning child step #%d on component #%d.\n#### Component ####\n%s\n###################\n",
                     i,
                     iCom,
                     serializedComponentString);
             }
 
-            // Use a wrapper workflow to hold a stepHandle.
-            ADUC_WorkflowData stepWorkflow = {};
-
             stepHandle = workflow_get_child(handle, i);
             if (stepHandle == nullptr)
             {
                 const char* errorFmt = "Cannot process child step #%d due to missing (child) workflow data.";
                 Log_Error(errorFmt, i);
-                result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_ISINSTALLED_FAILURE_MISSING_CHILD_WORKFLOW;
+                result = { .ResultCode = ADUC_Result_Failure,
+                           .ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_ISINSTALLED_FAILURE_MISSING_CHILD_WORKFLOW };
                 workflow_set_result_details(handle, errorFmt, i);
                 goto done;
             }
-            stepWorkflow.WorkflowHandle = stepHandle;
 
-            // For inline step - set current component info on the workflow.
-            if (serializedComponentString != nullptr && workflow_is_inline_step(handle, i))
+            StepIsInstalledCheck check = {};
+            check.step = i;
+            check.component = iCom;
+            check.sameAs = checks.size();
+            check.stepHandle = stepHandle;
+
+            if (!workflow_is_inline_step(handle, i))
             {
-                if (!workflow_set_selected_components(stepHandle, serializedComponentString))
+                // A reference step has its own work folder, and its selected components don't depend on this
+                // workflow's, so evaluate it once, alongside the other steps.
+                check.updateType = DEFAULT_REF_STEP_HANDLER;
+                if (iCom == 0)
                 {
-                    result.ResultCode = ADUC_Result_Failure;
-                    result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_SET_SELECTED_COMPONENTS_FAILURE;
-                    workflow_set_result_details(handle, "Cannot set target component(s) for child step #%d", i);
-                    goto done;
+                    lanes.push_back({ checks.size() });
+                }
+                else
+                {
+                    check.sameAs = i;
                 }
             }
+            else
+            {
+                check.updateType = workflow_peek_update_manifest_step_handler(handle, i);
 
-            ContentHandler* contentHandler = nullptr;
-            const char* stepUpdateType = workflow_is_inline_step(handle, i)
-                ? workflow_peek_update_manifest_step_handler(handle, i)
-                : DEFAULT_REF_STEP_HANDLER;
+                cstr_wrapper serializedStep{ workflow_get_serialized_step(handle, i) };
+                std::string key = std::string{ serializedStep.get() == nullptr ? "" : serializedStep.get() } + "\n"
+                    + (serializedComponentString == nullptr ? "" : serializedComponentString);
 
-            Log_Debug("Loading handler for child step #%d (handler: '%s')", i, stepUpdateType);
+                auto inserted = inlineChecks.emplace(key, checks.size());
+                if (!inserted.second)
+                {
+                    check.sameAs = inserted.first->second;
+                }
+                else if (iCom == 0)
+                {
+                    // For inline step - set current component info on the workflow.
+                    if (serializedComponentString != nullptr
+                        && !workflow_set_selected_components(stepHandle, serializedComponentString))
+                    {
+                        result.ResultCode = ADUC_Result_Failure;
+                        result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_SET_SELECTED_COMPONENTS_FAILURE;
+                        workflow_set_result_details(handle, "Cannot set target component(s) for child step #%d", i);
+                        goto done;
+                    }
+                }
+                else
+                {
+                    if (componentFolders.size() < static_cast<size_t>(iCom))
+                    {
+                        componentFolders.resize(iCom);
+                    }
 
-            result = ExtensionManager::LoadUpdateContentHandlerExtension(stepUpdateType, &contentHandler);
+                    std::string& componentFolder = componentFolders[iCom - 1];
+                    if (componentFolder.empty())
+                    {
+                        componentFolder = std::string{ workFolder } + "/" + IS_INSTALLED_COMPONENT_FOLDER_PREFIX
+                            + std::to_string(iCom);
 
-            if (IsAducResultCodeFailure(result.ResultCode))
-            {
-                const char* errorFmt = "Cannot load a handler for child step #%d (handler :%s)";
-                Log_Error(errorFmt, i, stepUpdateType);
-                workflow_set_result_details(handle, errorFmt, i, stepUpdateType == nullptr ? "NULL" : stepUpdateType);
-                goto done;
-            }
+                        createResult = ADUC_SystemUtils_MkSandboxDirRecursive(componentFolder.c_str());
+                        if (createResult != 0)
+                        {
+                            Log_Error("Unable to create folder %s, error %d", componentFolder.c_str(), createResult);
+                            result = { ADUC_Result_Failure, ADUC_ERC_STEPS_HANDLER_CREATE_SANDBOX_FAILURE };
+                            goto done;
+                        }
+                    }
 
-            // If this step is already installed, skip to the next one.
-            try
-            {
-                result = contentHandler->IsInstalled(&stepWorkflow);
+                    result = CreateComponentStepWorkflow(
+                        handle, i, serializedComponentString, componentFolder.c_str(), &check.stepHandle);
+                    if (IsAducResultCodeFailure(result.ResultCode))
+                    {
+                        workflow_set_result_details(
+                            handle, "Cannot create child step #%d workflow for component #%d", i, iCom);
+                        goto done;
+                    }
 
-                // If step is already installed, we should make sure that the current step's result is set correctly.
-                if (result.ResultCode == ADUC_Result_IsInstalled_Installed)
+                    check.ownsStepHandle = true;
+                }
+
+                if (check.sameAs == checks.size())
                 {
-                    // Note: the step's workflow result will be reported to the IoT Hub when the workflow is finished.
-                    // If the step is 'Installed', its workflow result should not be 'Failure'.
-                    // We're setting the result code to ADUC_Result_Install_Skipped_UpdateAlreadyInstalled here
-                    // to avoid potential confusion when customer viewing the twin data.
-                    ADUC_Result stepWorkflowResult = workflow_get_result(stepWorkflow.WorkflowHandle);
-                    if (stepWorkflowResult.ResultCode == ADUC_Result_Failure
-                        || stepWorkflowResult.ResultCode == ADUC_Result_Failure_Cancelled)
+                    if (inlineLane < 0)
                     {
-                        workflow_set_result(
-                            stepWorkflow.WorkflowHandle,
-                            { .ResultCode = ADUC_Result_Install_Skipped_UpdateAlreadyInstalled });
+                        inlineLane = static_cast<int>(lanes.size());
+                        lanes.emplace_back();
                     }
+                    lanes[inlineLane].push_back(checks.size());
                 }
             }
-            catch (...)
+
+            if (check.sameAs == checks.size())
             {
-                // Cannot determine whether the step is installed, so, let's assume that it's not install.
-                result = { .ResultCode = ADUC_Result_IsInstalled_NotInstalled, .ExtendedResultCode = 0 };
+                Log_Debug("Loading handler for child step #%d (handler: '%s')", i, check.updateType);
+
+                check.loadResult = ExtensionManager::LoadUpdateContentHandlerExtension(
+                    check.updateType == nullptr ? "" : check.updateType, &check.contentHandler);
             }
 
-            if (IsAducResultCodeFailure(result.ResultCode)
-                || result.ResultCode == ADUC_Result_IsInstalled_NotInstalled)
+            checks.push_back(check);
+        }
+
+        json_free_serialized_string(serializedComponentString);
+        serializedComponentString = nullptr;
+    }
+
+    {
+        ADUC::IsInstalledEvaluator evaluator{ GetMaxConcurrentInstalledChecks() };
+
+        Log_Debug(
+            "Evaluating %zu is-installed check(s) of workflow lvl %d step #%d, %u at a time.",
+            checks.size(),
+            workflowLevel,
+            workflowStep,
+            evaluator.GetMaxConcurrency());
+
+        firstNotInstalled = evaluator.Run(
+            checks.size(),
+            lanes,
+            [&checks](size_t index) -> ADUC_Result {
+                const StepIsInstalledCheck& check = checks[index];
+                if (IsAducResultCodeFailure(check.loadResult.ResultCode))
+                {
+                    return check.loadResult;
+                }
+
+                // Use a wrapper workflow to hold a stepHandle.
+                ADUC_WorkflowData stepWorkflow = {};
+                stepWorkflow.WorkflowHandle = check.stepHandle;
+                return StepIsInstalled(&stepWorkflow, check.contentHandler);
+            },
+            &checkResults);
+    }
+
+    // Every step before the first that is not installed is 'Installed'. Apply that in step order, as evaluating the
+    // steps one by one would have. Steps after it may have been evaluated too; their results are ignored.
+    for (size_t i = 0; i < firstNotInstalled; i++)
+    {
+        if (checkResults[checks[i].sameAs].ResultCode == ADUC_Result_IsInstalled_Installed)
+        {
+            // Note: the step's workflow result will be reported to the IoT Hub when the workflow is finished.
+            // If the step is 'Installed', its workflow result should not be 'Failure'.
+            // We're setting the result code to ADUC_Result_Install_Skipped_UpdateAlreadyInstalled here
+            // to avoid potential confusion when customer viewing the twin data.
+            stepHandle = workflow_get_child(handle, checks[i].step);
+            ADUC_Result stepWorkflowResult = workflow_get_result(stepHandle);
+            if (stepWorkflowResult.ResultCode == ADUC_Result_Failure
+                || stepWorkflowResult.ResultCode == ADUC_Result_Failure_Cancelled)
             {
-                Log_Info(
-                    "Workflow lvl %d, step #%d, child step #%d, component #%d is not installed.",
-                    workflowLevel,
-                    workflowStep,
-                    i,
-                    iCom);
-                // We can stop here if we found one component that not installed.
-                goto done;
+                workflow_set_result(stepHandle, { .ResultCode = ADUC_Result_Install_Skipped_UpdateAlreadyInstalled });
             }
+        }
+    }
 
-        } // steps
-    } // components
+    if (firstNotInstalled < checks.size())
+    {
+        // The first check that is not installed is never a reuse of an earlier one.
+        const StepIsInstalledCheck& check = checks[firstNotInstalled];
+        result = checkResults[firstNotInstalled];
+
+        if (IsAducResultCodeFailure(check.loadResult.ResultCode))
+        {
+            const char* errorFmt = "Cannot load a handler for child step #%d (handler :%s)";
+            Log_Error(errorFmt, check.step, check.updateType);
+            workflow_set_result_details(
+                handle, errorFmt, check.step, check.updateType == nullptr ? "NULL" : check.updateType);
+        }
+        else if (check.ownsStepHandle)
+        {
+            // Report the outcome on the step, as if it had been evaluated in place.
+            stepHandle = workflow_get_child(handle, check.step);
+            workflow_set_result(stepHandle, workflow_get_result(check.stepHandle));
+            // The details are data, not a format; a NULL format clears them, as it would have in place.
+            const char* details = workflow_peek_result_details(check.stepHandle);
+            workflow_set_result_details(stepHandle, details == nullptr ? nullptr : "%s", details);
+        }
+
+        Log_Info(
+            "Workflow lvl %d, step #%d, child step #%d, component #%d is not installed.",
+            workflowLevel,
+            workflowStep,
+            check.step,
+            check.component);
+        // We can stop here if we found one component that not installed.
+        goto done;
+    }
 
     result = { .ResultCode = ADUC_Result_IsInstalled_Installed, .ExtendedResultCode = 0 };
 
@@ -1427,6 +1890,21 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
     }
 
 done:
+    for (const StepIsInstalledCheck& check : checks)
+    {
+        if (check.ownsStepHandle)
+        {
+            workflow_free(check.stepHandle);
+        }
+    }
+
+    for (const std::string& componentFolder : componentFolders)
+    {
+        if (!componentFolder.empty())
+        {
+            ADUC_SystemUtils_RmDirRecursive(componentFolder.c_str());
+        }
+    }
 
     json_free_serialized_string(serializedComponentString);
     workflow_free_string(workFolder);
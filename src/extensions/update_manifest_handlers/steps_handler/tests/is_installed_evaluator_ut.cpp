@@ -0,0 +1,307 @@
+/**
+ * @file is_installed_evaluator_ut.cpp
+ * @brief Unit Tests for the IsInstalled evaluator.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/is_installed_evaluator.hpp>
+#include <aduc/types/adu_core.h> // ADUC_Result_*
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using ADUC::IsInstalledEvaluator;
+using ADUC::IsInstalledLane;
+
+namespace
+{
+const ADUC_Result Installed = { ADUC_Result_IsInstalled_Installed, 0 };
+const ADUC_Result NotInstalled = { ADUC_Result_IsInstalled_NotInstalled, 0 };
+
+/**
+ * @brief One lane per check.
+ */
+std::vector<IsInstalledLane> SeparateLanes(size_t count)
+{
+    std::vector<IsInstalledLane> lanes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        lanes.push_back({ i });
+    }
+    return lanes;
+}
+
+/**
+ * @brief Records which checks were evaluated, and how many were evaluated at once.
+ */
+class EvaluationRecorder
+{
+public:
+    explicit EvaluationRecorder(size_t count) : _evaluated(count)
+    {
+    }
+
+    void Begin(size_t check)
+    {
+        _evaluated[check] = true;
+        const unsigned int running = ++_running;
+        unsigned int peak = _peak;
+        while (running > peak && !_peak.compare_exchange_weak(peak, running))
+        {
+        }
+    }
+
+    void End()
+    {
+        --_running;
+    }
+
+    bool WasEvaluated(size_t check) const
+    {
+        return _evaluated[check];
+    }
+
+    unsigned int Peak() const
+    {
+        return _peak;
+    }
+
+private:
+    std::vector<std::atomic<bool>> _evaluated;
+    std::atomic<unsigned int> _running{ 0 };
+    std::atomic<unsigned int> _peak{ 0 };
+};
+} // namespace
+
+TEST_CASE("IsInstalledEvaluator clamps concurrency")
+{
+    CHECK(IsInstalledEvaluator{ 0 }.GetMaxConcurrency() == 1);
+    CHECK(IsInstalledEvaluator{ 4 }.GetMaxConcurrency() == 4);
+    CHECK(IsInstalledEvaluator{ 1000 }.GetMaxConcurrency() == ADUC_IS_INSTALLED_EVALUATOR_MAX_CONCURRENCY);
+}
+
+TEST_CASE("IsInstalledEvaluator evaluates every check when all are installed")
+{
+    const size_t count = 20;
+    EvaluationRecorder recorder{ count };
+    std::vector<ADUC_Result> results;
+
+    IsInstalledEvaluator evaluator{ 4 };
+    const size_t first = evaluator.Run(
+        count,
+        SeparateLanes(count),
+        [&recorder](size_t check) -> ADUC_Result {
+            recorder.Begin(check);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            recorder.End();
+            return Installed;
+        },
+        &results);
+
+    CHECK(first == count);
+    REQUIRE(results.size() == count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        CHECK(recorder.WasEvaluated(i));
+        CHECK(results[i].ResultCode == ADUC_Result_IsInstalled_Installed);
+    }
+    CHECK(recorder.Peak() > 1);
+    CHECK(recorder.Peak() <= 4);
+}
+
+TEST_CASE("IsInstalledEvaluator one at a time stops at the first not installed check")
+{
+    const size_t count = 10;
+    EvaluationRecorder recorder{ count };
+    std::vector<ADUC_Result> results;
+
+    IsInstalledEvaluator evaluator{ 1 };
+    const size_t first = evaluator.Run(
+        count,
+        SeparateLanes(count),
+        [&recorder](size_t check) -> ADUC_Result {
+            recorder.Begin(check);
+            recorder.End();
+            return check == 3 || check == 7 ? NotInstalled : Installed;
+        },
+        &results);
+
+    CHECK(first == 3);
+    for (size_t i = 0; i < count; ++i)
+    {
+        CHECK(recorder.WasEvaluated(i) == (i <= 3));
+    }
+    CHECK(results[3].ResultCode == ADUC_Result_IsInstalled_NotInstalled);
+    CHECK(results[4].ResultCode == ADUC_Result_Failure_Cancelled);
+}
+
+TEST_CASE("IsInstalledEvaluator finds the same first not installed check whatever the timing")
+{
+    const size_t count = 24;
+
+    for (unsigned int round = 0; round < 5; ++round)
+    {
+        EvaluationRecorder recorder{ count };
+        std::vector<ADUC_Result> results;
+
+        // Checks take different times, and several are not installed, or fail.
+        IsInstalledEvaluator evaluator{ 8 };
+        const size_t first = evaluator.Run(
+            count,
+            SeparateLanes(count),
+            [&recorder, round](size_t check) -> ADUC_Result {
+                recorder.Begin(check);
+                std::this_thread::sleep_for(std::chrono::milliseconds((count - check + round) % 7));
+                recorder.End();
+                if (check == 9)
+                {
+                    return { ADUC_Result_Failure, 42 };
+                }
+                return check == 14 || check == 20 ? NotInstalled : Installed;
+            },
+            &results);
+
+        CHECK(first == 9);
+        CHECK(results[9].ExtendedResultCode == 42);
+        for (size_t i = 0; i < first; ++i)
+        {
+            CHECK(recorder.WasEvaluated(i));
+            CHECK(results[i].ResultCode == ADUC_Result_IsInstalled_Installed);
+        }
+    }
+}
+
+TEST_CASE("IsInstalledEvaluator evaluates the checks of a lane in order, one at a time")
+{
+    const size_t count = 12;
+    std::vector<ADUC_Result> results;
+    std::mutex mutex;
+    std::vector<size_t> laneOrder[3];
+    std::atomic<int> inLane[3] = {};
+    std::atomic<bool> overlapped{ false };
+
+    // Lanes are interleaved: 0, 3, 6, 9 / 1, 4, 7, 10 / 2, 5, 8, 11.
+    std::vector<IsInstalledLane> lanes(3);
+    for (size_t i = 0; i < count; ++i)
+    {
+        lanes[i % 3].push_back(i);
+    }
+
+    IsInstalledEvaluator evaluator{ 3 };
+    const size_t first = evaluator.Run(
+        count,
+        lanes,
+        [&](size_t check) -> ADUC_Result {
+            const size_t lane = check % 3;
+            if (++inLane[lane] > 1)
+            {
+                overlapped = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            {
+                std::lock_guard<std::mutex> lock{ mutex };
+                laneOrder[lane].push_back(check);
+            }
+            --inLane[lane];
+            return Installed;
+        },
+        &results);
+
+    CHECK(first == count);
+    CHECK_FALSE(overlapped);
+    for (size_t lane = 0; lane < 3; ++lane)
+    {
+        CHECK(laneOrder[lane] == lanes[lane]);
+    }
+}
+
+TEST_CASE("IsInstalledEvaluator does not evaluate checks in no lane")
+{
+    std::vector<ADUC_Result> results;
+    EvaluationRecorder recorder{ 4 };
+
+    IsInstalledEvaluator evaluator{ 2 };
+    const size_t first = evaluator.Run(
+        4,
+        { { 0 }, { 2 } },
+        [&recorder](size_t check) -> ADUC_Result {
+            recorder.Begin(check);
+            recorder.End();
+            return Installed;
+        },
+        &results);
+
+    CHECK(first == 4);
+    CHECK(recorder.WasEvaluated(0));
+    CHECK_FALSE(recorder.WasEvaluated(1));
+    CHECK(recorder.WasEvaluated(2));
+    CHECK_FALSE(recorder.WasEvaluated(3));
+}
+
+TEST_CASE("IsInstalledEvaluator treats an exception as not installed")
+{
+    std::vector<ADUC_Result> results;
+
+    IsInstalledEvaluator evaluator{ 2 };
+    const size_t first = evaluator.Run(
+        3,
+        SeparateLanes(3),
+        [](size_t check) -> ADUC_Result {
+            if (check == 1)
+            {
+                throw std::runtime_error("IsInstalled");
+            }
+            return Installed;
+        },
+        &results);
+
+    CHECK(first == 1);
+    CHECK(results[1].ResultCode == ADUC_Result_IsInstalled_NotInstalled);
+}
+
+TEST_CASE("IsInstalledEvaluator evaluates a nested run on the calling worker")
+{
+    const size_t outerCount = 4;
+    const size_t innerCount = 4;
+    std::atomic<unsigned int> nestedPeak{ 0 };
+    std::vector<ADUC_Result> results;
+
+    IsInstalledEvaluator evaluator{ 4 };
+    const size_t first = evaluator.Run(
+        outerCount,
+        SeparateLanes(outerCount),
+        [&](size_t) -> ADUC_Result {
+            EvaluationRecorder recorder{ innerCount };
+            std::vector<ADUC_Result> innerResults;
+
+            IsInstalledEvaluator inner{ 4 };
+            const size_t innerFirst = inner.Run(
+                innerCount,
+                SeparateLanes(innerCount),
+                [&recorder](size_t check) -> ADUC_Result {
+                    recorder.Begin(check);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    recorder.End();
+                    return Installed;
+                },
+                &innerResults);
+
+            unsigned int peak = nestedPeak;
+            while (recorder.Peak() > peak && !nestedPeak.compare_exchange_weak(peak, recorder.Peak()))
+            {
+            }
+            return innerFirst == innerCount ? Installed : NotInstalled;
+        },
+        &results);
+
+    CHECK(first == outerCount);
+    CHECK(nestedPeak == 1);
+}
@@ -0,0 +1,396 @@
+/**
+ * @file steps_handler_perf.cpp
+ * @brief Benchmarks for preparing and evaluating the child workflows of an update with many steps.
+ *
+ * The benchmarks are hidden from the default run. Use: steps_handler_unit_tests "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/content_store.h"
+#include "aduc/extension_manager.hpp"
+#include "aduc/hash_utils.h"
+#include "aduc/steps_handler.hpp"
+#include "aduc/system_utils.h"
+#include "aduc/workflow_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <parson.h>
+#include <string>
+#include <thread>
+
+ADUC_Result PrepareStepsWorkflowDataObject(ADUC_WorkflowHandle handle);
+
+namespace
+{
+std::string g_serverFolder;
+
+// Time to first byte of a small file on a high-latency link.
+constexpr std::chrono::milliseconds requestLatency{ 100 };
+
+std::atomic<unsigned int> g_requests{ 0 };
+
+/**
+ * @brief A detached manifest file, with one inline step of @p handler, for the component named @p name.
+ */
+std::string ChildManifestFile(const std::string& name, const std::string& handler)
+{
+    const std::string manifest = R"({"manifestVersion":"4","updateId":{"provider":"contoso","name":")" + name
+        + R"(","version":"1.0"},"compatibility":[{"group":"motors"}],"instructions":{"steps":[{"handler":")"
+        + handler
+        + R"(","files":["f0"],"handlerProperties":{"installedCriteria":"1.0"}}]},"files":)"
+          R"({"f0":{"fileName":"install.sh","sizeInBytes":1024,"hashes":{"sha256":)"
+          R"("47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU="}}},"createdDateTime":"2022-01-27T13:45:05Z"})";
+
+    JSON_Value* fileValue = json_value_init_object();
+    json_object_set_string(json_object(fileValue), "updateManifest", manifest.c_str());
+    char* serialized = json_serialize_to_string(fileValue);
+    std::string content{ serialized };
+    json_free_serialized_string(serialized);
+    json_value_free(fileValue);
+    return content;
+}
+
+// Time for a handler to check a step's installed criteria, e.g. by querying a package manager.
+constexpr std::chrono::milliseconds isInstalledLatency{ 50 };
+
+std::atomic<unsigned int> g_isInstalledCalls{ 0 };
+
+/**
+ * @brief A step handler whose steps are all installed, and that takes isInstalledLatency to tell.
+ */
+class SlowIsInstalledHandler : public ContentHandler
+{
+public:
+    ADUC_Result Download(const tagADUC_WorkflowData* /*workflowData*/) override
+    {
+        return { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
+    }
+
+    ADUC_Result Backup(const tagADUC_WorkflowData* /*workflowData*/) override
+    {
+        return { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
+    }
+
+    ADUC_Result Install(const tagADUC_WorkflowData* /*workflowData*/) override
+    {
+        return { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
+    }
+
+    ADUC_Result Apply(const tagADUC_WorkflowData* /*workflowData*/) override
+    {
+        return { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
+    }
+
+    ADUC_Result Restore(const tagADUC_WorkflowData* /*workflowData*/) override
+    {
+        return { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
+    }
+
+    ADUC_Result Cancel(const tagADUC_WorkflowData* /*workflowData*/) override
+    {
+        return { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
+    }
+
+    ADUC_Result IsInstalled(const tagADUC_WorkflowData* /*workflowData*/) override
+    {
+        ++g_isInstalledCalls;
+        std::this_thread::sleep_for(isInstalledLatency);
+        return { .ResultCode = ADUC_Result_IsInstalled_Installed, .ExtendedResultCode = 0 };
+    }
+};
+} // namespace
+
+/**
+ * @brief The content downloader for this test, exported so that ExtensionManager finds it with dlsym.
+ * Stands in for a file server: it waits out the request latency, then copies the file from g_serverFolder.
+ */
+extern "C" ADUC_Result Download(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int retryTimeout,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    (void)workflowId;
+    (void)retryTimeout;
+    (void)downloadProgressCallback;
+
+    ++g_requests;
+    std::this_thread::sleep_for(requestLatency);
+
+    std::ifstream source{ g_serverFolder + "/" + entity->TargetFilename, std::ios::binary };
+    std::ofstream target{ std::string{ workFolder } + "/" + entity->TargetFilename, std::ios::binary };
+    target << source.rdbuf();
+
+    return ADUC_Result{ .ResultCode = source && target ? ADUC_Result_Download_Success : ADUC_Result_Failure,
+                        .ExtendedResultCode = 0 };
+}
+
+/**
+ * @brief Publishes an update with @p stepCount reference steps, each with one inline step of @p childHandler, and
+ * creates its workflow, with a work folder in @p testFolder.
+ * If @p sameFileName, the detached manifests all have the same file name, but different content.
+ */
+static ADUC_WorkflowHandle CreateReferenceStepsWorkflow(
+    const std::string& testFolder, unsigned int stepCount, const std::string& childHandler, bool sameFileName = false)
+{
+    g_serverFolder = testFolder + "/server";
+    const std::string workFolder = testFolder + "/work";
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(g_serverFolder.c_str()) == 0);
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(workFolder.c_str()) == 0);
+
+    // Keep earlier runs' manifests from being reused instead of downloaded.
+    REQUIRE(ADUC_ContentStore_SetFolder((testFolder + "/store").c_str()));
+
+    // Publish the detached manifests, and a parent manifest that references each of them.
+    JSON_Value* manifestValue = json_parse_string(
+        R"({"manifestVersion":"4","updateId":{"provider":"contoso","name":"motors","version":"1.0"},)"
+        R"("compatibility":[{"deviceManufacturer":"contoso","deviceModel":"toaster"}],)"
+        R"("instructions":{"steps":[]},"files":{},"createdDateTime":"2022-01-27T13:45:05Z"})");
+    JSON_Value* workflowValue = json_parse_string(R"({"workflow":{"action":3,"id":"stepsperf"},"fileUrls":{}})");
+    REQUIRE(manifestValue != nullptr);
+    REQUIRE(workflowValue != nullptr);
+
+    JSON_Object* manifest = json_object(manifestValue);
+    JSON_Array* steps = json_object_dotget_array(manifest, "instructions.steps");
+    JSON_Object* files = json_object_get_object(manifest, "files");
+    JSON_Object* fileUrls = json_object_get_object(json_object(workflowValue), "fileUrls");
+
+    for (unsigned int i = 0; i < stepCount; i++)
+    {
+        const std::string fileId = "f" + std::to_string(i);
+        const std::string fileName =
+            sameFileName ? "motor.importmanifest.json" : "motor-" + std::to_string(i) + ".importmanifest.json";
+        const std::string filePath = g_serverFolder + "/" + fileName;
+        const std::string content = ChildManifestFile("motor-" + std::to_string(i), childHandler);
+
+        std::ofstream{ filePath } << content;
+
+        char* hash = nullptr;
+        REQUIRE(ADUC_HashUtils_GetFileHash(filePath.c_str(), SHA256, &hash));
+
+        JSON_Value* stepValue = json_value_init_object();
+        json_object_set_string(json_object(stepValue), "type", "reference");
+        json_object_set_string(json_object(stepValue), "detachedManifestFileId", fileId.c_str());
+        json_array_append_value(steps, stepValue);
+
+        JSON_Value* fileValue = json_value_init_object();
+        json_object_set_string(json_object(fileValue), "fileName", fileName.c_str());
+        json_object_set_number(json_object(fileValue), "sizeInBytes", static_cast<double>(content.size()));
+        json_object_dotset_string(json_object(fileValue), "hashes.sha256", hash);
+        json_object_set_value(files, fileId.c_str(), fileValue);
+        free(hash);
+
+        json_object_set_string(fileUrls, fileId.c_str(), ("http://localhost/" + fileName).c_str());
+    }
+
+    char* manifestString = json_serialize_to_string(manifestValue);
+    json_object_set_string(json_object(workflowValue), "updateManifest", manifestString);
+    json_free_serialized_string(manifestString);
+    json_value_free(manifestValue);
+
+    char* workflowString = json_serialize_to_string(workflowValue);
+    json_value_free(workflowValue);
+
+    ADUC_WorkflowHandle handle = nullptr;
+    ADUC_Result result = workflow_init(workflowString, false, &handle);
+    json_free_serialized_string(workflowString);
+    REQUIRE(IsAducResultCodeSuccess(result.ResultCode));
+    REQUIRE(workflow_set_workfolder(handle, "%s", workFolder.c_str()));
+
+    return handle;
+}
+
+TEST_CASE("PrepareStepsWorkflowDataObject with many reference steps", "[.][perf]")
+{
+    constexpr unsigned int stepCount = 50;
+
+    char folderTemplate[] = "/tmp/stepsperfXXXXXX";
+    REQUIRE(mkdtemp(folderTemplate) != nullptr);
+    const std::string testFolder{ folderTemplate };
+
+    ADUC_WorkflowHandle handle = CreateReferenceStepsWorkflow(testFolder, stepCount, "microsoft/script:1");
+
+    ExtensionManager::SetContentDownloaderLibrary(dlopen(nullptr, RTLD_NOW));
+
+    g_requests = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const ADUC_Result result = PrepareStepsWorkflowDataObject(handle);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    CHECK(IsAducResultCodeSuccess(result.ResultCode));
+    CHECK(g_requests == stepCount);
+
+    // Children are inserted in step order.
+    REQUIRE(workflow_get_children_count(handle) == static_cast<int>(stepCount));
+    for (unsigned int i = 0; i < stepCount; i++)
+    {
+        ADUC_WorkflowHandle child = workflow_get_child(handle, i);
+        CHECK(workflow_get_step_index(child) == static_cast<int>(i));
+        CHECK(std::string{ workflow_peek_id(child) } == std::to_string(i));
+    }
+
+    const double serialMs = static_cast<double>(stepCount * requestLatency.count());
+    std::cout << "reference steps: " << stepCount << "\tlatency: " << requestLatency.count()
+              << " ms\telapsed: " << (elapsed.count() * 1000.0) << " ms\tone at a time: " << serialMs << " ms"
+              << std::endl;
+
+    CHECK(elapsed.count() * 1000.0 < serialMs);
+
+    workflow_free(handle);
+    ExtensionManager::SetContentDownloaderLibrary(nullptr);
+    ADUC_ContentStore_SetFolder(nullptr);
+    ADUC_SystemUtils_RmDirRecursive(testFolder.c_str());
+}
+
+TEST_CASE("PrepareStepsWorkflowDataObject fails for one manifest file name with different hashes")
+{
+    char folderTemplate[] = "/tmp/stepsperfXXXXXX";
+    REQUIRE(mkdtemp(folderTemplate) != nullptr);
+    const std::string testFolder{ folderTemplate };
+
+    ADUC_WorkflowHandle handle = CreateReferenceStepsWorkflow(testFolder, 2, "microsoft/script:1", true);
+
+    ExtensionManager::SetContentDownloaderLibrary(dlopen(nullptr, RTLD_NOW));
+
+    g_requests = 0;
+    const ADUC_Result result = PrepareStepsWorkflowDataObject(handle);
+
+    CHECK(result.ResultCode == ADUC_Result_Failure);
+    CHECK(result.ExtendedResultCode == ADUC_ERC_STEPS_HANDLER_DETACHED_MANIFEST_HASH_CONFLICT);
+    CHECK(g_requests == 0);
+    CHECK(workflow_get_children_count(handle) == 0);
+
+    workflow_free(handle);
+    ExtensionManager::SetContentDownloaderLibrary(nullptr);
+    ADUC_ContentStore_SetFolder(nullptr);
+    ADUC_SystemUtils_RmDirRecursive(testFolder.c_str());
+}
+
+TEST_CASE("StepsHandler IsInstalled with many inline steps", "[.][perf]")
+{
+    constexpr unsigned int stepCount = 40;
+    constexpr unsigned int criteriaCount = 20; // Each installed criteria is used by two steps.
+
+    char folderTemplate[] = "/tmp/stepsperfXXXXXX";
+    REQUIRE(mkdtemp(folderTemplate) != nullptr);
+    const std::string workFolder{ folderTemplate };
+
+    JSON_Value* manifestValue = json_parse_string(
+        R"({"manifestVersion":"4","updateId":{"provider":"contoso","name":"toaster","version":"1.0"},)"
+        R"("compatibility":[{"deviceManufacturer":"contoso","deviceModel":"toaster"}],)"
+        R"("instructions":{"steps":[]},"files":{},"createdDateTime":"2022-01-27T13:45:05Z"})");
+    JSON_Value* workflowValue = json_parse_string(R"({"workflow":{"action":3,"id":"stepsperf"},"fileUrls":{}})");
+    REQUIRE(manifestValue != nullptr);
+    REQUIRE(workflowValue != nullptr);
+
+    JSON_Array* steps = json_object_dotget_array(json_object(manifestValue), "instructions.steps");
+    for (unsigned int i = 0; i < stepCount; i++)
+    {
+        JSON_Value* stepValue = json_value_init_object();
+        json_object_set_string(json_object(stepValue), "handler", "contoso/slow:1");
+        json_object_set_value(json_object(stepValue), "files", json_value_init_array());
+        json_object_dotset_string(
+            json_object(stepValue),
+            "handlerProperties.installedCriteria",
+            ("1." + std::to_string(i % criteriaCount)).c_str());
+        json_array_append_value(steps, stepValue);
+    }
+
+    char* manifestString = json_serialize_to_string(manifestValue);
+    json_object_set_string(json_object(workflowValue), "updateManifest", manifestString);
+    json_free_serialized_string(manifestString);
+    json_value_free(manifestValue);
+
+    char* workflowString = json_serialize_to_string(workflowValue);
+    json_value_free(workflowValue);
+
+    ADUC_WorkflowHandle handle = nullptr;
+    ADUC_Result result = workflow_init(workflowString, false, &handle);
+    json_free_serialized_string(workflowString);
+    REQUIRE(IsAducResultCodeSuccess(result.ResultCode));
+    REQUIRE(workflow_set_workfolder(handle, "%s", workFolder.c_str()));
+
+    // ExtensionManager owns the handler.
+    ExtensionManager::SetUpdateContentHandlerExtension("contoso/slow:1", new SlowIsInstalledHandler{});
+    std::unique_ptr<ContentHandler> stepsHandler{ StepsHandlerImpl::CreateContentHandler() };
+    StepsHandlerImpl::SetMaxConcurrentInstalledChecks(4);
+
+    ADUC_WorkflowData workflowData = {};
+    workflowData.WorkflowHandle = handle;
+
+    g_isInstalledCalls = 0;
+    const auto start = std::chrono::steady_clock::now();
+    result = stepsHandler->IsInstalled(&workflowData);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    CHECK(result.ResultCode == ADUC_Result_IsInstalled_Installed);
+    CHECK(g_isInstalledCalls == criteriaCount);
+
+    const double serialMs = static_cast<double>(stepCount * isInstalledLatency.count());
+    std::cout << "inline steps: " << stepCount << "\tinstalled criteria: " << criteriaCount
+              << "\tlatency: " << isInstalledLatency.count() << " ms\telapsed: " << (elapsed.count() * 1000.0)
+              << " ms\tone at a time: " << serialMs << " ms" << std::endl;
+
+    CHECK(elapsed.count() * 1000.0 < serialMs);
+
+    workflow_free(handle);
+    StepsHandlerImpl::SetMaxConcurrentInstalledChecks(0);
+    ExtensionManager::Uninit();
+    ADUC_SystemUtils_RmDirRecursive(workFolder.c_str());
+}
+
+TEST_CASE("StepsHandler IsInstalled with many reference steps", "[.][perf]")
+{
+    constexpr unsigned int stepCount = 16;
+
+    char folderTemplate[] = "/tmp/stepsperfXXXXXX";
+    REQUIRE(mkdtemp(folderTemplate) != nullptr);
+    const std::string testFolder{ folderTemplate };
+
+    ADUC_WorkflowHandle handle = CreateReferenceStepsWorkflow(testFolder, stepCount, "contoso/slow:1");
+
+    // ExtensionManager owns the handlers.
+    ContentHandler* stepsHandler = StepsHandlerImpl::CreateContentHandler();
+    ExtensionManager::SetUpdateContentHandlerExtension("microsoft/steps:1", stepsHandler);
+    ExtensionManager::SetUpdateContentHandlerExtension("contoso/slow:1", new SlowIsInstalledHandler{});
+    ExtensionManager::SetContentDownloaderLibrary(dlopen(nullptr, RTLD_NOW));
+    StepsHandlerImpl::SetMaxConcurrentInstalledChecks(4);
+
+    // Download the detached manifests first; only the is-installed checks are timed.
+    REQUIRE(IsAducResultCodeSuccess(PrepareStepsWorkflowDataObject(handle).ResultCode));
+
+    ADUC_WorkflowData workflowData = {};
+    workflowData.WorkflowHandle = handle;
+
+    g_isInstalledCalls = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const ADUC_Result result = stepsHandler->IsInstalled(&workflowData);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    CHECK(result.ResultCode == ADUC_Result_IsInstalled_Installed);
+    CHECK(g_isInstalledCalls == stepCount);
+
+    const double serialMs = static_cast<double>(stepCount * isInstalledLatency.count());
+    std::cout << "reference steps: " << stepCount << "\tlatency: " << isInstalledLatency.count()
+              << " ms\telapsed: " << (elapsed.count() * 1000.0) << " ms\tone at a time: " << serialMs << " ms"
+              << std::endl;
+
+    CHECK(elapsed.count() * 1000.0 < serialMs);
+
+    workflow_free(handle);
+    StepsHandlerImpl::SetMaxConcurrentInstalledChecks(0);
+    ExtensionManager::SetContentDownloaderLibrary(nullptr);
+    ExtensionManager::Uninit();
+    ADUC_ContentStore_SetFolder(nullptr);
+    ADUC_SystemUtils_RmDirRecursive(testFolder.c_str());
+}
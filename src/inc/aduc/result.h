@@ -926,6 +926,11 @@ static inline ADUC_Result_t MAKE_ADUC_EXTENDEDRESULTCODE_FOR_FACILITY_ADUC_FACIL
  */
  #define ADUC_ERC_STEPS_HANDLER_CREATE_SANDBOX_FAILURE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_HANDLER_STEPS(11)
 
+/**
+ * @brief ADUC_ERC_STEPS_HANDLER_DETACHED_MANIFEST_HASH_CONFLICT, ERC Value: 809500684 (0x3040000c)
+ */
+ #define ADUC_ERC_STEPS_HANDLER_DETACHED_MANIFEST_HASH_CONFLICT MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_HANDLER_STEPS(12)
+
 /**
  * @brief ADUC_ERC_STEPS_HANDLER_DOWNLOAD_FAILURE_UNKNOWNEXCEPTION, ERC Value: 809500928 (0x30400100)
  */
@@ -1166,6 +1171,36 @@ static inline ADUC_Result_t MAKE_ADUC_EXTENDEDRESULTCODE_FOR_FACILITY_ADUC_FACIL
  */
  #define ADUC_ERROR_CURL_DOWNLOADER_INVALID_FILE_HASH MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(1)
 
+/**
+ * @brief ADUC_ERROR_CURL_DOWNLOADER_CANNOT_OPEN_TARGET_FILE, ERC Value: 1076887554 (0x40300002)
+ */
+ #define ADUC_ERROR_CURL_DOWNLOADER_CANNOT_OPEN_TARGET_FILE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(2)
+
+/**
+ * @brief ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE, ERC Value: 1076887555 (0x40300003)
+ */
+ #define ADUC_ERROR_CURL_DOWNLOADER_WRITE_FAILURE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(3)
+
+/**
+ * @brief ADUC_ERROR_CURL_DOWNLOADER_LAUNCH_FAILURE, ERC Value: 1076887556 (0x40300004)
+ */
+ #define ADUC_ERROR_CURL_DOWNLOADER_LAUNCH_FAILURE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(4)
+
+/**
+ * @brief ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED, ERC Value: 1076887557 (0x40300005)
+ */
+ #define ADUC_ERROR_CURL_DOWNLOADER_DATA_SINK_ABORTED MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(5)
+
+/**
+ * @brief ADUC_ERROR_CURL_DOWNLOADER_INIT_FAILURE, ERC Value: 1076887558 (0x40300006)
+ */
+ #define ADUC_ERROR_CURL_DOWNLOADER_INIT_FAILURE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(6)
+
+/**
+ * @brief ADUC_ERROR_CURL_DOWNLOADER_RESUME_MISMATCH, ERC Value: 1076887559 (0x40300007)
+ */
+ #define ADUC_ERROR_CURL_DOWNLOADER_RESUME_MISMATCH MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(7)
+
 /**
  * @brief ADUC_ERC_COMPONENT_ENUMERATOR_GETALLCOMPONENTS_NOTIMP, ERC Value: 1879048193 (0x70000001)
  */
@@ -1461,6 +1496,11 @@ static inline ADUC_Result_t MAKE_ADUC_EXTENDEDRESULTCODE_FOR_FACILITY_ADUC_FACIL
  */
  #define ADUC_ERC_DDH_SOURCE_UPDATE_CACHE_MISS MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_COMPONENT_DELTA_DOWNLOAD_HANDLER_COMMON(8)
 
+/**
+ * @brief ADUC_ERC_DDH_SOURCE_UPDATE_HASH_MISMATCH, ERC Value: 2424307721 (0x90800009)
+ */
+ #define ADUC_ERC_DDH_SOURCE_UPDATE_HASH_MISMATCH MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_COMPONENT_DELTA_DOWNLOAD_HANDLER_COMMON(9)
+
 /**
  * @brief ADUC_ERC_MOVE_PREPURGE, ERC Value: 2425356289 (0x90900001)
  */
@@ -16,6 +16,7 @@
 // #define ZLOG_FORCE_FLUSH_BUFFER
 
 #define ZLOG_BUFFER_LINE_MAXCHARS 512
+// Must be a power of 2.
 #define ZLOG_BUFFER_MAXLINES 1024
 
 #define ZLOG_FLUSH_INTERVAL_SEC 30
@@ -23,6 +24,17 @@
 // In practice: flush size < .8 * BUFFER_SIZE
 #define ZLOG_BUFFER_FLUSH_MAXLINES (0.8 * ZLOG_BUFFER_MAXLINES)
 
+// How long a warning or error waits for the writer thread to free a buffer line before it is dropped.
+// Debug and info lines are dropped as soon as the buffer is full.
+#define ZLOG_ENQUEUE_MAX_WAIT_MS 20
+
+// Maximum number of lines the writer thread writes with one writev call.
+#define ZLOG_WRITE_BATCH_MAXLINES 64
+
+// Maximum number of distinct format strings and function pairs in a binary log. Must be a power of 2.
+// Once full, new ones are formatted when logged.
+#define ZLOG_FORMAT_TABLE_MAXENTRIES 4096
+
 // Maximum number of log files to keep
 #define ZLOG_MAX_FILE_COUNT 3
 
@@ -23,6 +23,12 @@ enum ZLOG_SEVERITY
     ZLOG_ERROR
 };
 
+enum ZLOG_FILE_FORMAT
+{
+    ZLOG_FILE_FORMAT_TEXT, // Formatted lines in <prefix>.<time>.log files.
+    ZLOG_FILE_FORMAT_BINARY, // Unformatted records in <prefix>.<time>.zlog files. Read with zlog-decode.
+};
+
 // Start API
 // clang-format off
 #define log_debug(...) zlog_log(ZLOG_DEBUG, __FUNCTION__, __VA_ARGS__) // NOLINT(misc-lambda-function-name)
@@ -51,12 +57,16 @@ int zlog_init(
     int file_enable,
     enum ZLOG_SEVERITY console_level,
     enum ZLOG_SEVERITY file_level);
+// select the log file format of the next zlog_init; text by default
+void zlog_set_file_format(enum ZLOG_FILE_FORMAT format);
 // finish using the zlog; clean up
 void zlog_finish(void);
 // explicitly flush the buffer in memory
 void zlog_flush_buffer(void);
-// request to flush the buffer.
+// request to flush the buffer, without waiting for it.
 void zlog_request_flush_buffer(void);
+// number of lines dropped because the buffer was full
+unsigned long zlog_get_dropped_line_count(void);
 // log an entry with the function scope and timestamp
 void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, const char* fmt, ...);
 
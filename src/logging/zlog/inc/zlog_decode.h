@@ -0,0 +1,25 @@
+/**
+ * @file zlog_decode.h
+ * @brief Decodes zlog binary log files to text.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#ifndef ZLOG_DECODE_H
+#define ZLOG_DECODE_H
+
+#include <stdio.h>
+
+#include "zlog.h"
+
+EXTERN_C_BEGIN
+
+// Decodes a log file written with ZLOG_FILE_FORMAT_BINARY into the lines ZLOG_FILE_FORMAT_TEXT would have written.
+// The file must have been written on a device with the same byte order.
+// Returns 0 on success, or -1 if in is not a binary log file or is corrupt. A file cut short is not corrupt.
+int zlog_decode(FILE* in, FILE* out);
+
+EXTERN_C_END
+
+#endif // ZLOG_DECODE_H
@@ -80,6 +80,10 @@ void ADUC_Logging_Init(ADUC_LOG_SEVERITY logLevel, const char* filePrefix)
         }
     }
 
+#ifdef ADUC_LOG_FILE_FORMAT_BINARY
+    zlog_set_file_format(ZLOG_FILE_FORMAT_BINARY);
+#endif
+
     if (zlog_init(
             ADUC_LOG_FOLDER,
             filePrefix == NULL ? "aduc" : filePrefix,
@@ -10,9 +10,12 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h> // for open
 #include <pthread.h>
+#include <signal.h> // for sigfillset
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> // for strcmp, memset, strlen, etc.
@@ -20,11 +23,13 @@
 #include <sys/syscall.h> // for SYS_gettid
 #include <sys/time.h> // for gettimeofday
 #include <sys/types.h>
+#include <sys/uio.h> // for writev
 #include <time.h>
 #include <unistd.h> // isatty
 
 #include "zlog-config.h"
 #include "zlog.h"
+#include "zlog_binary.h"
 
 typedef enum tagCONSOLE_LOGGING_MODE
 {
@@ -45,37 +50,132 @@ static struct
 
 static const char level_names[] = { 'D', 'I', 'W', 'E' }; // Must align with ZLOG_SEVERITY enum in zlog.h
 
-static FILE* zlog_fout = NULL;
+static enum ZLOG_FILE_FORMAT zlog_requested_file_format = ZLOG_FILE_FORMAT_TEXT;
+static enum ZLOG_FILE_FORMAT zlog_file_format = ZLOG_FILE_FORMAT_TEXT; // Set by zlog_init.
+static int zlog_fd = -1; // Only used by zlog_init, zlog_finish, and the writer thread.
+static bool zlog_file_log_enabled = false;
+static off_t zlog_file_size = 0;
 static char* zlog_file_log_dir = NULL;
 static char* zlog_file_log_prefix = NULL;
-static time_t zlog_last_flushed = 0;
 
-char _zlog_buffer[ZLOG_BUFFER_MAXLINES][ZLOG_BUFFER_LINE_MAXCHARS];
-static int _zlog_buffer_count = 0;
-static pthread_mutex_t _zlog_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+// File log lines go through a bounded multi-producer, single-consumer ring buffer.
+// Logging threads claim a line with a compare-and-swap on _zlog_buffer_tail, fill it, and publish it by advancing
+// its sequence number; they never block on the writer thread, which alone does file I/O and roll over.
+// A line at position p is free when its sequence is p, and published when its sequence is p + 1.
+typedef struct tagZLOG_BUFFER_LINE
+{
+    unsigned long sequence;
+    size_t length;
+    char* overflow; // A heap copy of a line or binary record too long for text, or NULL.
+    char text[ZLOG_BUFFER_LINE_MAXCHARS];
+} ZLOG_BUFFER_LINE;
+
+static ZLOG_BUFFER_LINE _zlog_buffer[ZLOG_BUFFER_MAXLINES];
+static unsigned long _zlog_buffer_tail = 0; // The next position to claim.
+static unsigned long _zlog_buffer_head = 0; // The next position to write. Only advanced by the writer thread.
+static unsigned long _zlog_dropped_lines = 0;
+
+static pthread_t _zlog_writer_thread;
+static bool _zlog_writer_running = false;
+static bool _zlog_writer_stop = false;
+static unsigned long _zlog_flush_target = 0; // Write at least up to here before sleeping again.
+static pthread_mutex_t _zlog_writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _zlog_writer_cond; // Wakes the writer thread.
+static pthread_cond_t _zlog_flushed_cond; // Wakes zlog_flush_buffer callers.
+static pthread_once_t _zlog_writer_cond_once = PTHREAD_ONCE_INIT;
+
+// Binary log records refer to the format string and function of a log call by their index in this table.
+// Entries are added under _zlog_formats_mutex, and published by setting fmt. They are never removed.
+// Entries own copies of the strings, and are matched by content: callers may pass a format that is not a literal,
+// and the writer thread reads the entry after the caller returns.
+typedef struct tagZLOG_FORMAT_ENTRY
+{
+    char* fmt;
+    char* func;
+    uint32_t hash;
+} ZLOG_FORMAT_ENTRY;
+
+static ZLOG_FORMAT_ENTRY _zlog_formats[ZLOG_FORMAT_TABLE_MAXENTRIES];
+static pthread_mutex_t _zlog_formats_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Formats defined in the current log file. Only used by whoever owns zlog_fd.
+static unsigned char _zlog_formats_defined[ZLOG_FORMAT_TABLE_MAXENTRIES / 8];
 
-struct tm* get_current_utctime();
 bool get_current_utctime_filename(char* fullpath, size_t fullpath_len);
-static inline void _zlog_buffer_lock(void);
-static inline void _zlog_buffer_unlock(void);
-static void _zlog_roll_over_if_file_size_too_large(int additional_log_len);
-static void _zlog_flush_buffer(void);
-static inline char* zlog_lock_and_get_buffer(void);
-static inline void zlog_finish_buffer_and_unlock(void);
+static void _zlog_roll_over_if_file_size_too_large(size_t additional_log_len);
+static bool _zlog_start_writer(void);
+static void _zlog_stop_writer(void);
+static void _zlog_enqueue(enum ZLOG_SEVERITY msg_level, const char* text, size_t length, char* overflow);
 void zlog_ensure_at_most_n_logfiles(int max_num);
 
 static bool zlog_is_file_log_open()
 {
-    return zlog_fout != NULL;
+    return zlog_fd >= 0;
+}
+
+// Whether logging threads should buffer lines for the log file.
+static bool zlog_is_file_log_enabled()
+{
+    return __atomic_load_n(&zlog_file_log_enabled, __ATOMIC_RELAXED);
 }
 
 static void zlog_close_file_log()
 {
     if (zlog_is_file_log_open())
     {
-        fclose(zlog_fout);
-        zlog_fout = NULL;
+        close(zlog_fd);
+        zlog_fd = -1;
+    }
+}
+
+static bool zlog_open_file_log(const char* fullpath)
+{
+    // Same mode as fopen: 0666 masked by the umask.
+    zlog_fd = open(
+        fullpath,
+        O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+    if (zlog_fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    zlog_file_size = (fstat(zlog_fd, &st) == 0) ? st.st_size : 0;
+
+    if (zlog_file_format == ZLOG_FILE_FORMAT_BINARY)
+    {
+        // Formats are defined again in each file, so that each can be decoded alone.
+        memset(_zlog_formats_defined, 0, sizeof(_zlog_formats_defined));
+
+        unsigned char header[ZLOG_BINARY_FILE_HEADER_SIZE + ZLOG_RECORD_HEADER_SIZE + sizeof(int32_t)];
+        unsigned char* p = header;
+        const uint32_t byte_order_mark = ZLOG_BINARY_BYTE_ORDER_MARK;
+        const uint16_t process_record_len = ZLOG_RECORD_HEADER_SIZE + sizeof(int32_t);
+        const int32_t pid = getpid();
+
+        if (zlog_file_size == 0)
+        {
+            memcpy(p, ZLOG_BINARY_MAGIC, ZLOG_BINARY_MAGIC_SIZE);
+            p += ZLOG_BINARY_MAGIC_SIZE;
+            memcpy(p, &byte_order_mark, sizeof(byte_order_mark));
+            p += sizeof(byte_order_mark);
+        }
+
+        // The file may have been written by another process before.
+        memcpy(p, &process_record_len, sizeof(process_record_len));
+        p += sizeof(process_record_len);
+        *p++ = ZLOG_RECORD_PROCESS;
+        *p++ = ZLOG_INFO;
+        memcpy(p, &pid, sizeof(pid));
+        p += sizeof(pid);
+
+        if (write(zlog_fd, header, p - header) == p - header)
+        {
+            zlog_file_size += p - header;
+        }
     }
+
+    return true;
 }
 
 static bool zlog_is_stdout_a_tty()
@@ -114,7 +214,7 @@ static bool zlog_term_supports_color()
 
 // Initialize zlog logging settings:
 // Return true when the settings are initialized exactly as specified
-// Otherwise leave zlog_fout = NULL and return false
+// Otherwise leave the log file closed and return false
 int zlog_init(
     char const* log_dir,
     char const* log_file,
@@ -123,9 +223,7 @@ int zlog_init(
     enum ZLOG_SEVERITY console_level,
     enum ZLOG_SEVERITY file_level)
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    zlog_last_flushed = tv.tv_sec;
+    zlog_file_format = zlog_requested_file_format;
 
     memset(&log_setting, 0, sizeof(log_setting));
     log_setting.console_level = console_level;
@@ -176,11 +274,17 @@ int zlog_init(
             return -1;
         }
 
-        zlog_fout = fopen(zlog_file_log_fullpath, "a+");
-        if (zlog_fout == NULL)
+        if (!zlog_open_file_log(zlog_file_log_fullpath))
         {
             return -1;
         }
+
+        if (!_zlog_start_writer())
+        {
+            zlog_close_file_log();
+            return -1;
+        }
+        __atomic_store_n(&zlog_file_log_enabled, true, __ATOMIC_RELAXED);
         log_debug("Log file created: %s", zlog_file_log_fullpath);
 
         zlog_ensure_at_most_n_logfiles(ZLOG_MAX_FILE_COUNT);
@@ -188,23 +292,74 @@ int zlog_init(
     return 0;
 }
 
-// Caller should NOT hold the lock
+// Waits until every line logged before the call is written.
 void zlog_flush_buffer(void)
 {
-    _zlog_buffer_lock();
-    _zlog_flush_buffer();
-    _zlog_buffer_unlock();
+    const unsigned long target = __atomic_load_n(&_zlog_buffer_tail, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&_zlog_writer_mutex);
+    if (!_zlog_writer_running)
+    {
+        pthread_mutex_unlock(&_zlog_writer_mutex);
+        return;
+    }
+
+    if ((long)(target - _zlog_flush_target) > 0)
+    {
+        _zlog_flush_target = target;
+    }
+    pthread_cond_signal(&_zlog_writer_cond);
+
+    while (_zlog_writer_running && (long)(target - __atomic_load_n(&_zlog_buffer_head, __ATOMIC_ACQUIRE)) > 0)
+    {
+        pthread_cond_wait(&_zlog_flushed_cond, &_zlog_writer_mutex);
+    }
+    pthread_mutex_unlock(&_zlog_writer_mutex);
+}
+
+// Asks the writer thread to write every line logged before the call, without waiting for it.
+void zlog_request_flush_buffer(void)
+{
+    const unsigned long target = __atomic_load_n(&_zlog_buffer_tail, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&_zlog_writer_mutex);
+    if (!_zlog_writer_running)
+    {
+        pthread_mutex_unlock(&_zlog_writer_mutex);
+        return;
+    }
+
+    if ((long)(target - _zlog_flush_target) > 0)
+    {
+        _zlog_flush_target = target;
+    }
+    pthread_cond_signal(&_zlog_writer_cond);
+    pthread_mutex_unlock(&_zlog_writer_mutex);
+}
+
+void zlog_set_file_format(enum ZLOG_FILE_FORMAT format)
+{
+    zlog_requested_file_format = format;
+}
+
+unsigned long zlog_get_dropped_line_count(void)
+{
+    return __atomic_load_n(&_zlog_dropped_lines, __ATOMIC_RELAXED);
 }
 
-// Caller should NOT hold the lock
 void zlog_finish(void)
 {
-    zlog_flush_buffer();
+    __atomic_store_n(&zlog_file_log_enabled, false, __ATOMIC_RELAXED);
+
+    // The writer thread writes every buffered line before it exits.
+    _zlog_stop_writer();
 
     zlog_close_file_log();
 
     free(zlog_file_log_dir);
+    zlog_file_log_dir = NULL;
     free(zlog_file_log_prefix);
+    zlog_file_log_prefix = NULL;
 }
 
 #define MAX_FUNCTION_NAME 64
@@ -229,19 +384,10 @@ void zlog_finish(void)
 #define MULTILINE_BEGIN_FORMAT "\n\n%s [%c] [%s] ==== MULTI-LINE LOG BEGIN ====\n"
 #define MULTILINE_END_FORMAT "%s [%c] [%s] ==== MULTI-LINE LOG END ====\n\n"
 
-void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, const char* fmt, ...)
+// Formats the date, time, process and thread of a log line.
+// Returns false if the prelude cannot be formatted.
+static bool _zlog_format_prelude(char* prelude_buffer)
 {
-    const bool console_log_needed =
-        (log_setting.console_logging_mode != ZLOG_CLM_DISABLED) && (msg_level >= log_setting.console_level);
-    const bool file_log_needed = zlog_is_file_log_open() && (msg_level >= log_setting.file_level);
-
-    if (!console_log_needed && !file_log_needed)
-    {
-        // If we're not logging to console or file, there's nothing to do.
-        return;
-    }
-
-    char prelude_buffer[PRELUDE_BUFFER_SIZE];
     prelude_buffer[0] = '\0';
 
     struct timespec curtime;
@@ -271,10 +417,255 @@ void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, const char* fmt, .
 
         if (ret < 0)
         {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Writes the length, type and severity of a record, and the current time and thread.
+static void _zlog_put_timed_record_header(
+    unsigned char* record, size_t length, ZLOG_RECORD_TYPE type, enum ZLOG_SEVERITY msg_level)
+{
+    const uint16_t record_len = (uint16_t)length;
+    struct timespec curtime;
+    clock_gettime(CLOCK_REALTIME, &curtime);
+    const int64_t time_ns = (int64_t)curtime.tv_sec * 1000000000 + curtime.tv_nsec;
+    const int32_t tid = (int32_t)syscall(SYS_gettid) /* cannot call gettid() directly */;
+
+    memcpy(record, &record_len, sizeof(record_len));
+    record[2] = (unsigned char)type;
+    record[3] = (unsigned char)msg_level;
+    memcpy(record + ZLOG_RECORD_HEADER_SIZE, &time_ns, sizeof(time_ns));
+    memcpy(record + ZLOG_RECORD_HEADER_SIZE + sizeof(time_ns), &tid, sizeof(tid));
+}
+
+// Encodes an already formatted message as a ZLOG_RECORD_TEXT, cutting text short to fit capacity.
+// Returns the length of the record.
+static size_t _zlog_encode_text_record(
+    unsigned char* record, size_t capacity, enum ZLOG_SEVERITY msg_level, const char* func, const char* text)
+{
+    const size_t func_len = strnlen(func, MAX_FUNCTION_NAME);
+    size_t length = ZLOG_RECORD_TIMED_HEADER_SIZE;
+
+    memcpy(record + length, func, func_len);
+    length += func_len;
+    record[length++] = '\0';
+
+    const size_t text_len = strnlen(text, capacity - length - 1);
+    memcpy(record + length, text, text_len);
+    length += text_len;
+    record[length++] = '\0';
+
+    _zlog_put_timed_record_header(record, length, ZLOG_RECORD_TEXT, msg_level);
+    return length;
+}
+
+// FNV-1a hash of the format string and function.
+static uint32_t _zlog_hash_format(const char* fmt, const char* func)
+{
+    uint32_t hash = 2166136261U;
+
+    for (const char* p = fmt; *p != '\0'; ++p)
+    {
+        hash = (hash ^ (unsigned char)*p) * 16777619U;
+    }
+
+    hash = (hash ^ 0xffU) * 16777619U;
+
+    for (const char* p = func; *p != '\0'; ++p)
+    {
+        hash = (hash ^ (unsigned char)*p) * 16777619U;
+    }
+
+    return hash;
+}
+
+// Looks up the id of a format string and function, adding copies of them if insert is true.
+// Returns false if it is not in the table, the table is full, or the copies cannot be allocated.
+static bool _zlog_find_format(const char* fmt, const char* func, uint32_t hash, bool insert, uint32_t* id)
+{
+    size_t index = hash & (ZLOG_FORMAT_TABLE_MAXENTRIES - 1);
+
+    for (size_t probes = 0; probes < ZLOG_FORMAT_TABLE_MAXENTRIES; ++probes)
+    {
+        ZLOG_FORMAT_ENTRY* entry = &_zlog_formats[index];
+        const char* entry_fmt = __atomic_load_n(&entry->fmt, __ATOMIC_ACQUIRE);
+
+        if (entry_fmt == NULL)
+        {
+            if (!insert)
+            {
+                return false;
+            }
+
+            char* fmt_copy = strdup(fmt);
+            char* func_copy = strdup(func);
+            if (fmt_copy == NULL || func_copy == NULL)
+            {
+                free(fmt_copy);
+                free(func_copy);
+                return false;
+            }
+
+            entry->func = func_copy;
+            entry->hash = hash;
+            __atomic_store_n(&entry->fmt, fmt_copy, __ATOMIC_RELEASE);
+            *id = (uint32_t)index;
+            return true;
+        }
+
+        if (entry->hash == hash && strcmp(entry_fmt, fmt) == 0 && strcmp(entry->func, func) == 0)
+        {
+            *id = (uint32_t)index;
+            return true;
+        }
+
+        index = (index + 1) & (ZLOG_FORMAT_TABLE_MAXENTRIES - 1);
+    }
+
+    return false;
+}
+
+static bool _zlog_get_format_id(const char* fmt, const char* func, uint32_t* id)
+{
+    const uint32_t hash = _zlog_hash_format(fmt, func);
+
+    if (_zlog_find_format(fmt, func, hash, false /* insert */, id))
+    {
+        return true;
+    }
+
+    pthread_mutex_lock(&_zlog_formats_mutex);
+    const bool found = _zlog_find_format(fmt, func, hash, true /* insert */, id);
+    pthread_mutex_unlock(&_zlog_formats_mutex);
+
+    return found;
+}
+
+// Buffers a ZLOG_RECORD_TEXT of an already formatted message.
+// Messages too long for a buffer line go in a heap record, of up to UINT16_MAX bytes.
+static void _zlog_log_binary_text(enum ZLOG_SEVERITY msg_level, const char* func, const char* text, size_t text_len)
+{
+    const size_t needed = ZLOG_RECORD_TIMED_HEADER_SIZE + strnlen(func, MAX_FUNCTION_NAME) + text_len + 2;
+    unsigned char record[ZLOG_BUFFER_LINE_MAXCHARS];
+
+    if (needed > sizeof(record))
+    {
+        const size_t capacity = (needed < UINT16_MAX) ? needed : UINT16_MAX;
+        unsigned char* overflow = malloc(capacity);
+        if (overflow != NULL)
+        {
+            const size_t length = _zlog_encode_text_record(overflow, capacity, msg_level, func, text);
+            _zlog_enqueue(msg_level, NULL, length, (char*)overflow);
+            return;
+        }
+    }
+
+    const size_t length = _zlog_encode_text_record(record, sizeof(record), msg_level, func, text);
+    _zlog_enqueue(msg_level, (const char*)record, length, NULL);
+}
+
+// Buffers a binary log record of the format string id and the raw arguments, without formatting them.
+// Records too long for a buffer line go in a heap record, of up to UINT16_MAX bytes. Arguments that still do not
+// fit are cut short, and zlog-decode marks the message as truncated.
+static void _zlog_log_binary(enum ZLOG_SEVERITY msg_level, const char* func, const char* fmt, va_list va)
+{
+    unsigned char record[ZLOG_BUFFER_LINE_MAXCHARS];
+    size_t length;
+    uint32_t id;
+    bool complete;
+
+    if (strchr(fmt, '%') == NULL)
+    {
+        // Without conversions, there is nothing to leave unformatted.
+        // This also keeps messages passed as the format, such as process output, out of the format table.
+        _zlog_log_binary_text(msg_level, func, fmt, strlen(fmt));
+        return;
+    }
+
+    if (!_zlog_get_format_id(fmt, func, &id))
+    {
+        // The format table is full.
+        char va_buffer[LOG_CONTENT_BUFFER_SIZE];
+        const int text_len = vsnprintf(va_buffer, sizeof(va_buffer), fmt, va);
+        if (text_len >= 0)
+        {
+            _zlog_log_binary_text(msg_level, func, va_buffer, strlen(va_buffer));
+        }
+        return;
+    }
+
+    va_list va_retry;
+    va_copy(va_retry, va);
+
+    length = ZLOG_RECORD_TIMED_HEADER_SIZE;
+    memcpy(record + length, &id, sizeof(id));
+    length += sizeof(id);
+    length += zlog_binary_encode_args(fmt, va, record + length, sizeof(record) - length, &complete);
+
+    if (!complete)
+    {
+        unsigned char* overflow = malloc(UINT16_MAX);
+        if (overflow != NULL)
+        {
+            memcpy(overflow, record, ZLOG_RECORD_TIMED_HEADER_SIZE + sizeof(id));
+            length = ZLOG_RECORD_TIMED_HEADER_SIZE + sizeof(id);
+            length += zlog_binary_encode_args(fmt, va_retry, overflow + length, UINT16_MAX - length, &complete);
+            va_end(va_retry);
+
+            _zlog_put_timed_record_header(overflow, length, ZLOG_RECORD_LOG, msg_level);
+            _zlog_enqueue(msg_level, NULL, length, (char*)overflow);
             return;
         }
     }
 
+    va_end(va_retry);
+
+    _zlog_put_timed_record_header(record, length, ZLOG_RECORD_LOG, msg_level);
+    _zlog_enqueue(msg_level, (const char*)record, length, NULL);
+}
+
+// Clamps the return value of snprintf to the length it wrote to a buffer of size max_len.
+static size_t _zlog_clamp_len(int len, size_t max_len)
+{
+    if (len < 0)
+    {
+        return 0;
+    }
+
+    return ((size_t)len < max_len) ? (size_t)len : max_len - 1;
+}
+
+void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, const char* fmt, ...)
+{
+    const bool console_log_needed =
+        (log_setting.console_logging_mode != ZLOG_CLM_DISABLED) && (msg_level >= log_setting.console_level);
+    bool file_log_needed = zlog_is_file_log_enabled() && (msg_level >= log_setting.file_level);
+
+    if (file_log_needed && zlog_file_format == ZLOG_FILE_FORMAT_BINARY)
+    {
+        // Formatting is left to zlog-decode.
+        va_list va;
+        va_start(va, fmt);
+        _zlog_log_binary(msg_level, func, fmt, va);
+        va_end(va);
+        file_log_needed = false;
+    }
+
+    if (!console_log_needed && !file_log_needed)
+    {
+        // If we're not logging to console or file, there's nothing to do.
+        return;
+    }
+
+    char prelude_buffer[PRELUDE_BUFFER_SIZE];
+    if (!_zlog_format_prelude(prelude_buffer))
+    {
+        return;
+    }
+
     char va_buffer[LOG_CONTENT_BUFFER_SIZE];
     va_list va;
     va_start(va, fmt);
@@ -334,45 +725,49 @@ void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, const char* fmt, .
         if ((full_log_len + RESERVED_INFO_SIZE) < ZLOG_BUFFER_LINE_MAXCHARS)
         {
             // The log can fit in one line. Just add to zlog buffer.
-            char* buffer = zlog_lock_and_get_buffer();
+            char line[ZLOG_BUFFER_LINE_MAXCHARS];
+            const int line_len = snprintf(
+                line, sizeof(line), LOG_FORMAT, prelude_buffer, level_names[msg_level], va_buffer, func);
 
-            (void)snprintf(
-                buffer,
-                ZLOG_BUFFER_LINE_MAXCHARS,
-                LOG_FORMAT,
-                prelude_buffer,
-                level_names[msg_level],
-                va_buffer,
-                func);
-
-            zlog_finish_buffer_and_unlock();
+            if (line_len > 0)
+            {
+                _zlog_enqueue(msg_level, line, (size_t)line_len, NULL);
+            }
         }
         else
         {
-            // The log is too long, let's flush the buffer then write to log file directly.
-            _zlog_buffer_lock();
-            _zlog_flush_buffer();
-
-            _zlog_roll_over_if_file_size_too_large(
-                full_log_len + sizeof(MULTILINE_BEGIN_FORMAT) + sizeof(MULTILINE_END_FORMAT)
-                + (PRELUDE_BUFFER_SIZE + MAX_FUNCTION_NAME) * 2);
-            fprintf(zlog_fout, MULTILINE_BEGIN_FORMAT, prelude_buffer, level_names[msg_level], func);
-            va_list va;
-            va_start(va, fmt);
-            (void)vfprintf(zlog_fout, fmt, va);
-            va_end(va);
-            fprintf(zlog_fout, MULTILINE_END_FORMAT, prelude_buffer, level_names[msg_level], func);
-            fflush(zlog_fout);
+            // The log is too long for a buffer line. Format it on the heap, between multi-line markers.
+            const size_t max_len = full_log_len + sizeof(MULTILINE_BEGIN_FORMAT) + sizeof(MULTILINE_END_FORMAT)
+                + (PRELUDE_BUFFER_SIZE + MAX_FUNCTION_NAME) * 2;
+            char* overflow = malloc(max_len);
 
-            _zlog_buffer_unlock();
+            if (overflow == NULL)
+            {
+                __atomic_add_fetch(&_zlog_dropped_lines, 1, __ATOMIC_RELAXED);
+            }
+            else
+            {
+                // snprintf returns the length it would have written, so clamp each part to the space left.
+                size_t len = _zlog_clamp_len(
+                    snprintf(overflow, max_len, MULTILINE_BEGIN_FORMAT, prelude_buffer, level_names[msg_level], func),
+                    max_len);
+                va_start(va, fmt);
+                len += _zlog_clamp_len(vsnprintf(overflow + len, max_len - len, fmt, va), max_len - len);
+                va_end(va);
+                len += _zlog_clamp_len(
+                    snprintf(
+                        overflow + len,
+                        max_len - len,
+                        MULTILINE_END_FORMAT,
+                        prelude_buffer,
+                        level_names[msg_level],
+                        func),
+                    max_len - len);
+
+                _zlog_enqueue(msg_level, NULL, len, overflow);
+            }
         }
     }
-
-    if (msg_level == ZLOG_ERROR || (seconds - zlog_last_flushed) >= ZLOG_FLUSH_INTERVAL_SEC)
-    {
-        zlog_flush_buffer();
-        zlog_last_flushed = seconds;
-    }
 }
 
 // ------------------------- Helper Functions ---------------------------
@@ -382,16 +777,6 @@ static int file_select(const struct dirent* logfile)
     return (logfile->d_type == DT_REG && strstr(logfile->d_name, zlog_file_log_prefix) != NULL);
 }
 
-static inline void _zlog_buffer_lock(void)
-{
-    pthread_mutex_lock(&_zlog_buffer_mutex);
-}
-
-static inline void _zlog_buffer_unlock(void)
-{
-    pthread_mutex_unlock(&_zlog_buffer_mutex);
-}
-
 bool get_current_utctime_filename(char* fullpath, size_t fullpath_len)
 {
     // Timestamp the log file
@@ -400,7 +785,14 @@ bool get_current_utctime_filename(char* fullpath, size_t fullpath_len)
     const struct tm* tm = gmtime(&current_time);
 
     strftime(timebuf, sizeof(timebuf), "%Y%m%d-%H%M%S", tm);
-    int res = snprintf(fullpath, fullpath_len, "%s/%s%s.log", zlog_file_log_dir, zlog_file_log_prefix, timebuf);
+    int res = snprintf(
+        fullpath,
+        fullpath_len,
+        "%s/%s%s.%s",
+        zlog_file_log_dir,
+        zlog_file_log_prefix,
+        timebuf,
+        zlog_file_format == ZLOG_FILE_FORMAT_BINARY ? "zlog" : "log");
     if (res < 0 || res >= fullpath_len)
     {
         // When error occurs to snprintf filepath, return false
@@ -410,7 +802,8 @@ bool get_current_utctime_filename(char* fullpath, size_t fullpath_len)
 }
 
 // Roll over to a new log file if the current file size + additional_log_len exceeds ZLOG_FILE_MAX_SIZE_KB * 1024.
-static void _zlog_roll_over_if_file_size_too_large(int additional_log_len)
+// Only called by the writer thread.
+static void _zlog_roll_over_if_file_size_too_large(size_t additional_log_len)
 {
     if (!zlog_is_file_log_open())
     {
@@ -418,7 +811,7 @@ static void _zlog_roll_over_if_file_size_too_large(int additional_log_len)
     }
 
     // Roll over to new log file once the current file size exceeds the limit
-    if ((ftell(zlog_fout) + additional_log_len) > (ZLOG_FILE_MAX_SIZE_KB * 1024))
+    if ((zlog_file_size + additional_log_len) > (ZLOG_FILE_MAX_SIZE_KB * 1024))
     {
         zlog_close_file_log();
 
@@ -432,59 +825,403 @@ static void _zlog_roll_over_if_file_size_too_large(int additional_log_len)
             return;
         }
 
-        // INVARIANT: zlog_fout == NULL due to zlog_close_file_log() call above.
-        zlog_fout = fopen(zlog_file_log_fullpath, "a");
+        // INVARIANT: zlog_fd == -1 due to zlog_close_file_log() call above.
+        (void)zlog_open_file_log(zlog_file_log_fullpath);
     }
 }
 
-// Caller should hold the lock
-static void _zlog_flush_buffer()
+static inline void _zlog_wake_writer(void)
 {
-    if (!zlog_is_file_log_open())
+    // Signaling without the mutex is fine: the writer also wakes up every ZLOG_FLUSH_INTERVAL_SEC.
+    pthread_cond_signal(&_zlog_writer_cond);
+}
+
+// Waits a millisecond for the writer thread to free a line.
+// Returns false once ZLOG_ENQUEUE_MAX_WAIT_MS have passed since *deadline was set.
+static bool _zlog_wait_for_space(struct timespec* deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (deadline->tv_sec == 0 && deadline->tv_nsec == 0)
     {
-        return;
+        *deadline = now;
+        deadline->tv_nsec += ZLOG_ENQUEUE_MAX_WAIT_MS * 1000000L;
+        deadline->tv_sec += deadline->tv_nsec / 1000000000L;
+        deadline->tv_nsec %= 1000000000L;
+    }
+    else if (now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec))
+    {
+        return false;
+    }
+
+    const struct timespec pause = { 0, 1000000L };
+    nanosleep(&pause, NULL);
+    return true;
+}
+
+// Adds a line to the buffer without blocking on the writer thread.
+// Exactly one of text or overflow is set. The buffer takes ownership of overflow.
+static void _zlog_enqueue(enum ZLOG_SEVERITY msg_level, const char* text, size_t length, char* overflow)
+{
+    struct timespec deadline = { 0, 0 };
+    unsigned long pos = __atomic_load_n(&_zlog_buffer_tail, __ATOMIC_RELAXED);
+    ZLOG_BUFFER_LINE* line;
+
+    for (;;)
+    {
+        line = &_zlog_buffer[pos & (ZLOG_BUFFER_MAXLINES - 1)];
+        const long diff = (long)(__atomic_load_n(&line->sequence, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0)
+        {
+            // On failure, pos is updated to the current tail.
+            if (__atomic_compare_exchange_n(
+                    &_zlog_buffer_tail, &pos, pos + 1, true /* weak */, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The buffer is full. Only warnings and errors are worth waiting for.
+            _zlog_wake_writer();
+            if (msg_level < ZLOG_WARN || !_zlog_wait_for_space(&deadline))
+            {
+                __atomic_add_fetch(&_zlog_dropped_lines, 1, __ATOMIC_RELAXED);
+                free(overflow);
+                return;
+            }
+            pos = __atomic_load_n(&_zlog_buffer_tail, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            // Another thread claimed this line first.
+            pos = __atomic_load_n(&_zlog_buffer_tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (overflow == NULL)
+    {
+        memcpy(line->text, text, length);
     }
+    line->overflow = overflow;
+    line->length = length;
+    __atomic_store_n(&line->sequence, pos + 1, __ATOMIC_RELEASE);
 
-    // Flush buffer to file
-    int i = 0;
-    for (i = 0; i < _zlog_buffer_count; i++)
+    const unsigned long pending = pos + 1 - __atomic_load_n(&_zlog_buffer_head, __ATOMIC_RELAXED);
+    if (msg_level == ZLOG_ERROR || pending >= ZLOG_BUFFER_FLUSH_MAXLINES)
     {
-        _zlog_roll_over_if_file_size_too_large(strlen(_zlog_buffer[i]));
-        fputs(_zlog_buffer[i], zlog_fout);
+        _zlog_wake_writer();
     }
-    fflush(zlog_fout);
 
-    _zlog_buffer_count = 0;
+#ifdef ZLOG_FORCE_FLUSH_BUFFER
+    zlog_flush_buffer();
+#endif
+}
+
+// Writes all iovcnt buffers, continuing after partial writes.
+static void _zlog_write_all(struct iovec* iov, int iovcnt)
+{
+    while (iovcnt > 0 && zlog_is_file_log_open())
+    {
+        ssize_t written = writev(zlog_fd, iov, iovcnt);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // e.g. ENOSPC. Nothing else can be done with these lines.
+            return;
+        }
+
+        zlog_file_size += written;
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
 
-    _zlog_roll_over_if_file_size_too_large(0);
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
 }
 
-// Caller should NOT hold the lock
-static inline char* zlog_lock_and_get_buffer(void)
+// Formats the notice of lines dropped since the last one, as a line or a binary record.
+// Returns its length, or 0 if no lines were dropped.
+static size_t _zlog_format_dropped_notice(char* notice, size_t notice_size, unsigned long* reported_dropped_lines)
 {
-    _zlog_buffer_lock();
-    // Flush the buffer if it is full
-    if (_zlog_buffer_count == ZLOG_BUFFER_MAXLINES)
+    const unsigned long dropped_lines = zlog_get_dropped_line_count();
+    char text[64];
+    int len = -1;
+
+    if (dropped_lines == *reported_dropped_lines)
+    {
+        return 0;
+    }
+
+    (void)snprintf(
+        text, sizeof(text), "zlog buffer full: dropped %lu line(s)", dropped_lines - *reported_dropped_lines);
+    *reported_dropped_lines = dropped_lines;
+
+    if (zlog_file_format == ZLOG_FILE_FORMAT_BINARY)
     {
-        _zlog_flush_buffer();
+        return _zlog_encode_text_record((unsigned char*)notice, notice_size, ZLOG_WARN, __func__, text);
     }
 
-    // allocate buffer
-    _zlog_buffer_count++;
-    return _zlog_buffer[_zlog_buffer_count - 1];
+    char prelude_buffer[PRELUDE_BUFFER_SIZE];
+    if (_zlog_format_prelude(prelude_buffer))
+    {
+        len = snprintf(notice, notice_size, LOG_FORMAT, prelude_buffer, level_names[ZLOG_WARN], text, __func__);
+    }
+
+    return (len > 0 && (size_t)len < notice_size) ? (size_t)len : 0;
 }
 
-// Caller should hold the lock
-static inline void zlog_finish_buffer_and_unlock()
+// Adds a ZLOG_RECORD_FORMAT to iov if line is a binary log record whose format is not yet defined in the file.
+// header holds the start of the record. Returns the new iovcnt.
+static int
+_zlog_add_format_definition(const ZLOG_BUFFER_LINE* line, struct iovec* iov, int iovcnt, unsigned char* header)
 {
-#ifdef ZLOG_FORCE_FLUSH_BUFFER
-    _zlog_flush_buffer();
-#endif
-    _zlog_buffer_unlock();
+    const char* record = (line->overflow != NULL) ? line->overflow : line->text;
+    uint32_t id;
+
+    if (zlog_file_format != ZLOG_FILE_FORMAT_BINARY || line->length < ZLOG_RECORD_TIMED_HEADER_SIZE + sizeof(id)
+        || record[2] != ZLOG_RECORD_LOG)
+    {
+        return iovcnt;
+    }
+
+    memcpy(&id, record + ZLOG_RECORD_TIMED_HEADER_SIZE, sizeof(id));
+    if (id >= ZLOG_FORMAT_TABLE_MAXENTRIES || (_zlog_formats_defined[id / 8] & (1U << (id % 8))) != 0)
+    {
+        return iovcnt;
+    }
+
+    const char* fmt = __atomic_load_n(&_zlog_formats[id].fmt, __ATOMIC_ACQUIRE);
+    const char* func = _zlog_formats[id].func;
+    const size_t func_len = strlen(func) + 1;
+    const size_t fmt_len = strlen(fmt) + 1;
+    const size_t length = ZLOG_RECORD_HEADER_SIZE + sizeof(id) + func_len + fmt_len;
+    if (length > UINT16_MAX)
+    {
+        // zlog-decode shows the records as of an unknown format.
+        return iovcnt;
+    }
+
+    const uint16_t record_len = (uint16_t)length;
+    memcpy(header, &record_len, sizeof(record_len));
+    header[2] = ZLOG_RECORD_FORMAT;
+    header[3] = ZLOG_INFO;
+    memcpy(header + ZLOG_RECORD_HEADER_SIZE, &id, sizeof(id));
+
+    iov[iovcnt].iov_base = header;
+    iov[iovcnt].iov_len = ZLOG_RECORD_HEADER_SIZE + sizeof(id);
+    iov[iovcnt + 1].iov_base = (void*)func;
+    iov[iovcnt + 1].iov_len = func_len;
+    iov[iovcnt + 2].iov_base = (void*)fmt;
+    iov[iovcnt + 2].iov_len = fmt_len;
+
+    _zlog_formats_defined[id / 8] |= (unsigned char)(1U << (id % 8));
+    return iovcnt + 3;
+}
+
+// Writes every published line, in batches of up to ZLOG_WRITE_BATCH_MAXLINES.
+// Stops at the first line that is claimed but not yet published.
+// Only called by the writer thread.
+static void _zlog_write_buffered_lines(unsigned long* reported_dropped_lines)
+{
+    // Each line may need a format definition, of three buffers, before it.
+    struct iovec iov[1 + ZLOG_WRITE_BATCH_MAXLINES * 4];
+    unsigned char format_headers[ZLOG_WRITE_BATCH_MAXLINES][ZLOG_RECORD_HEADER_SIZE + sizeof(uint32_t)];
+    char dropped_notice[ZLOG_BUFFER_LINE_MAXCHARS];
+
+    for (;;)
+    {
+        const unsigned long head = __atomic_load_n(&_zlog_buffer_head, __ATOMIC_RELAXED);
+        unsigned long count = 0;
+        size_t batch_len = 0;
+        int iovcnt = 0;
+
+        while (count < ZLOG_WRITE_BATCH_MAXLINES)
+        {
+            const ZLOG_BUFFER_LINE* line = &_zlog_buffer[(head + count) & (ZLOG_BUFFER_MAXLINES - 1)];
+            if (__atomic_load_n(&line->sequence, __ATOMIC_ACQUIRE) != head + count + 1)
+            {
+                break;
+            }
+
+            batch_len += line->length;
+            ++count;
+        }
+
+        const size_t notice_len =
+            _zlog_format_dropped_notice(dropped_notice, sizeof(dropped_notice), reported_dropped_lines);
+
+        if (count == 0 && notice_len == 0)
+        {
+            return;
+        }
+
+        _zlog_roll_over_if_file_size_too_large(batch_len + notice_len);
+
+        if (notice_len > 0)
+        {
+            iov[iovcnt].iov_base = dropped_notice;
+            iov[iovcnt].iov_len = notice_len;
+            ++iovcnt;
+        }
+
+        for (unsigned long i = 0; i < count; ++i)
+        {
+            const ZLOG_BUFFER_LINE* line = &_zlog_buffer[(head + i) & (ZLOG_BUFFER_MAXLINES - 1)];
+
+            iovcnt = _zlog_add_format_definition(line, iov, iovcnt, format_headers[i]);
+
+            iov[iovcnt].iov_base = (line->overflow != NULL) ? line->overflow : (char*)line->text;
+            iov[iovcnt].iov_len = line->length;
+            ++iovcnt;
+        }
+
+        _zlog_write_all(iov, iovcnt);
+
+        // Hand the lines back to the logging threads.
+        for (unsigned long i = 0; i < count; ++i)
+        {
+            ZLOG_BUFFER_LINE* line = &_zlog_buffer[(head + i) & (ZLOG_BUFFER_MAXLINES - 1)];
+            free(line->overflow);
+            line->overflow = NULL;
+            __atomic_store_n(&line->sequence, head + i + ZLOG_BUFFER_MAXLINES, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&_zlog_buffer_head, head + count, __ATOMIC_RELEASE);
+    }
+}
+
+static void* _zlog_writer_main(void* arg)
+{
+    (void)arg;
+    unsigned long reported_dropped_lines = zlog_get_dropped_line_count();
+
+    pthread_mutex_lock(&_zlog_writer_mutex);
+    for (;;)
+    {
+        const unsigned long head = __atomic_load_n(&_zlog_buffer_head, __ATOMIC_RELAXED);
+        const unsigned long pending = __atomic_load_n(&_zlog_buffer_tail, __ATOMIC_RELAXED) - head;
+        const bool flush_pending = (long)(_zlog_flush_target - head) > 0;
+
+        if (!_zlog_writer_stop && pending < ZLOG_BUFFER_FLUSH_MAXLINES)
+        {
+            struct timespec wakeup;
+            clock_gettime(CLOCK_MONOTONIC, &wakeup);
+            if (flush_pending)
+            {
+                // A line that is claimed but not yet published holds up the flush. Check again shortly.
+                wakeup.tv_nsec += 1000000L;
+                wakeup.tv_sec += wakeup.tv_nsec / 1000000000L;
+                wakeup.tv_nsec %= 1000000000L;
+            }
+            else
+            {
+                wakeup.tv_sec += ZLOG_FLUSH_INTERVAL_SEC;
+            }
+            (void)pthread_cond_timedwait(&_zlog_writer_cond, &_zlog_writer_mutex, &wakeup);
+        }
+
+        const bool stopping = _zlog_writer_stop;
+        const unsigned long tail = __atomic_load_n(&_zlog_buffer_tail, __ATOMIC_ACQUIRE);
+        pthread_mutex_unlock(&_zlog_writer_mutex);
+
+        _zlog_write_buffered_lines(&reported_dropped_lines);
+
+        pthread_mutex_lock(&_zlog_writer_mutex);
+        pthread_cond_broadcast(&_zlog_flushed_cond);
+
+        // Lines claimed before the stop request but not yet published are still written before exiting.
+        if (stopping && (long)(tail - __atomic_load_n(&_zlog_buffer_head, __ATOMIC_RELAXED)) <= 0)
+        {
+            break;
+        }
+    }
+    _zlog_writer_running = false;
+    pthread_cond_broadcast(&_zlog_flushed_cond);
+    pthread_mutex_unlock(&_zlog_writer_mutex);
+
+    return NULL;
+}
+
+static void _zlog_init_writer_conds(void)
+{
+    pthread_condattr_t attr;
+
+    // Never destroyed: logging threads may still signal the writer while zlog_finish runs.
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_zlog_writer_cond, &attr);
+    pthread_cond_init(&_zlog_flushed_cond, NULL);
+    pthread_condattr_destroy(&attr);
+}
+
+static bool _zlog_start_writer(void)
+{
+    sigset_t all_signals;
+    sigset_t old_signals;
+    int err;
+
+    if (_zlog_writer_running)
+    {
+        return true;
+    }
+
+    // Positions keep counting up across restarts. Free every line for the next ZLOG_BUFFER_MAXLINES positions.
+    for (unsigned long pos = _zlog_buffer_tail; pos != _zlog_buffer_tail + ZLOG_BUFFER_MAXLINES; ++pos)
+    {
+        _zlog_buffer[pos & (ZLOG_BUFFER_MAXLINES - 1)].sequence = pos;
+    }
+    _zlog_buffer_head = _zlog_buffer_tail;
+    _zlog_flush_target = _zlog_buffer_tail;
+    _zlog_writer_stop = false;
+
+    pthread_once(&_zlog_writer_cond_once, _zlog_init_writer_conds);
+
+    // Signals are for the threads of the process that handle them, not the writer thread.
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    err = pthread_create(&_zlog_writer_thread, NULL, _zlog_writer_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (err != 0)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&_zlog_writer_mutex);
+    _zlog_writer_running = true;
+    pthread_mutex_unlock(&_zlog_writer_mutex);
+    return true;
+}
+
+static void _zlog_stop_writer(void)
+{
+    pthread_mutex_lock(&_zlog_writer_mutex);
+    if (!_zlog_writer_running)
+    {
+        pthread_mutex_unlock(&_zlog_writer_mutex);
+        return;
+    }
+    _zlog_writer_stop = true;
+    pthread_cond_signal(&_zlog_writer_cond);
+    pthread_mutex_unlock(&_zlog_writer_mutex);
+
+    pthread_join(_zlog_writer_thread, NULL);
 }
 
 // Clean up until max of num old log files left
-// Caller should hold the lock
+// Called from zlog_init and the writer thread
 void zlog_ensure_at_most_n_logfiles(int max_num)
 {
     struct dirent** logfiles;
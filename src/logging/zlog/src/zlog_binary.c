@@ -0,0 +1,328 @@
+/**
+ * @file zlog_binary.c
+ * @brief Encodes printf arguments for the zlog binary log file format.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "zlog_binary.h"
+
+#include <stddef.h> // for ptrdiff_t
+#include <stdint.h> // for intmax_t, uintptr_t
+#include <string.h> // for strchr, strnlen
+#include <sys/types.h> // for ssize_t
+
+bool zlog_binary_next_conversion(const char* fmt, ZLOG_CONVERSION* conversion)
+{
+    const char* p = fmt;
+
+    for (;;)
+    {
+        p = strchr(p, '%');
+        if (p == NULL)
+        {
+            return false;
+        }
+
+        if (p[1] != '%')
+        {
+            break;
+        }
+        p += 2;
+    }
+
+    memset(conversion, 0, sizeof(*conversion));
+    conversion->start = p++;
+
+    // Flags, width, precision.
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL)
+    {
+        ++p;
+    }
+
+    if (*p == '*')
+    {
+        conversion->width_arg = true;
+        ++p;
+    }
+    else
+    {
+        while (*p >= '0' && *p <= '9')
+        {
+            ++p;
+        }
+    }
+
+    if (*p == '.')
+    {
+        ++p;
+        if (*p == '*')
+        {
+            conversion->precision_arg = true;
+            ++p;
+        }
+        else
+        {
+            while (*p >= '0' && *p <= '9')
+            {
+                ++p;
+            }
+        }
+    }
+
+    conversion->flags_end = p;
+
+    // Length modifier.
+    switch (*p)
+    {
+    case 'h':
+        conversion->length = (p[1] == 'h') ? ZLOG_ARG_LENGTH_HH : ZLOG_ARG_LENGTH_H;
+        p += (p[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        conversion->length = (p[1] == 'l') ? ZLOG_ARG_LENGTH_LL : ZLOG_ARG_LENGTH_L;
+        p += (p[1] == 'l') ? 2 : 1;
+        break;
+    case 'q':
+        conversion->length = ZLOG_ARG_LENGTH_LL;
+        ++p;
+        break;
+    case 'j':
+        conversion->length = ZLOG_ARG_LENGTH_J;
+        ++p;
+        break;
+    case 'z':
+        conversion->length = ZLOG_ARG_LENGTH_Z;
+        ++p;
+        break;
+    case 't':
+        conversion->length = ZLOG_ARG_LENGTH_T;
+        ++p;
+        break;
+    case 'L':
+        conversion->length = ZLOG_ARG_LENGTH_LONG_DOUBLE;
+        ++p;
+        break;
+    default:
+        break;
+    }
+
+    conversion->conversion = *p;
+
+    switch (*p)
+    {
+    case 'd':
+    case 'i':
+        conversion->type = ZLOG_ARG_SIGNED;
+        break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        conversion->type = ZLOG_ARG_UNSIGNED;
+        break;
+    case 'c':
+        // Wide characters are not supported.
+        conversion->type = (conversion->length == ZLOG_ARG_LENGTH_DEFAULT) ? ZLOG_ARG_CHAR : ZLOG_ARG_INVALID;
+        break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        conversion->type = ZLOG_ARG_DOUBLE;
+        break;
+    case 's':
+        // Wide strings are not supported.
+        conversion->type = (conversion->length == ZLOG_ARG_LENGTH_DEFAULT) ? ZLOG_ARG_STRING : ZLOG_ARG_INVALID;
+        break;
+    case 'p':
+        conversion->type = ZLOG_ARG_POINTER;
+        break;
+    case 'n':
+        conversion->type = ZLOG_ARG_NONE;
+        break;
+    default:
+        // Includes positional arguments ("%1$d") and the end of the string.
+        conversion->type = ZLOG_ARG_INVALID;
+        break;
+    }
+
+    conversion->end = (*p != '\0') ? p + 1 : p;
+    return true;
+}
+
+// Appends size bytes at *out, unless that would pass end.
+static bool zlog_binary_put(unsigned char** out, const unsigned char* end, const void* value, size_t size)
+{
+    if ((size_t)(end - *out) < size)
+    {
+        return false;
+    }
+
+    memcpy(*out, value, size);
+    *out += size;
+    return true;
+}
+
+size_t zlog_binary_encode_args(const char* fmt, va_list va, unsigned char* out, size_t capacity, bool* complete)
+{
+    unsigned char* p = out;
+    const unsigned char* const end = out + capacity;
+    ZLOG_CONVERSION conversion;
+    bool fits = true;
+
+    while (fits && zlog_binary_next_conversion(fmt, &conversion) && conversion.type != ZLOG_ARG_INVALID)
+    {
+        fmt = conversion.end;
+
+        if (conversion.width_arg)
+        {
+            const int64_t width = va_arg(va, int);
+            fits = zlog_binary_put(&p, end, &width, sizeof(width));
+        }
+
+        if (fits && conversion.precision_arg)
+        {
+            const int64_t precision = va_arg(va, int);
+            fits = zlog_binary_put(&p, end, &precision, sizeof(precision));
+        }
+
+        if (!fits)
+        {
+            break;
+        }
+
+        switch (conversion.type)
+        {
+        case ZLOG_ARG_SIGNED:
+        {
+            int64_t value;
+            switch (conversion.length)
+            {
+            case ZLOG_ARG_LENGTH_HH:
+                value = (signed char)va_arg(va, int);
+                break;
+            case ZLOG_ARG_LENGTH_H:
+                value = (short)va_arg(va, int);
+                break;
+            case ZLOG_ARG_LENGTH_L:
+                value = va_arg(va, long);
+                break;
+            case ZLOG_ARG_LENGTH_LL:
+                value = va_arg(va, long long);
+                break;
+            case ZLOG_ARG_LENGTH_J:
+                value = va_arg(va, intmax_t);
+                break;
+            case ZLOG_ARG_LENGTH_Z:
+                value = va_arg(va, ssize_t);
+                break;
+            case ZLOG_ARG_LENGTH_T:
+                value = va_arg(va, ptrdiff_t);
+                break;
+            default:
+                value = va_arg(va, int);
+                break;
+            }
+            fits = zlog_binary_put(&p, end, &value, sizeof(value));
+            break;
+        }
+
+        case ZLOG_ARG_UNSIGNED:
+        {
+            uint64_t value;
+            switch (conversion.length)
+            {
+            case ZLOG_ARG_LENGTH_HH:
+                value = (unsigned char)va_arg(va, unsigned int);
+                break;
+            case ZLOG_ARG_LENGTH_H:
+                value = (unsigned short)va_arg(va, unsigned int);
+                break;
+            case ZLOG_ARG_LENGTH_L:
+                value = va_arg(va, unsigned long);
+                break;
+            case ZLOG_ARG_LENGTH_LL:
+                value = va_arg(va, unsigned long long);
+                break;
+            case ZLOG_ARG_LENGTH_J:
+                value = va_arg(va, uintmax_t);
+                break;
+            case ZLOG_ARG_LENGTH_Z:
+                value = va_arg(va, size_t);
+                break;
+            case ZLOG_ARG_LENGTH_T:
+                value = (size_t)va_arg(va, ptrdiff_t);
+                break;
+            default:
+                value = va_arg(va, unsigned int);
+                break;
+            }
+            fits = zlog_binary_put(&p, end, &value, sizeof(value));
+            break;
+        }
+
+        case ZLOG_ARG_CHAR:
+        {
+            const int64_t value = va_arg(va, int);
+            fits = zlog_binary_put(&p, end, &value, sizeof(value));
+            break;
+        }
+
+        case ZLOG_ARG_DOUBLE:
+        {
+            // long double is narrowed to double.
+            const double value = (conversion.length == ZLOG_ARG_LENGTH_LONG_DOUBLE) ? (double)va_arg(va, long double)
+                                                                                     : va_arg(va, double);
+            fits = zlog_binary_put(&p, end, &value, sizeof(value));
+            break;
+        }
+
+        case ZLOG_ARG_STRING:
+        {
+            const char* value = va_arg(va, const char*);
+            if (value == NULL)
+            {
+                value = "(null)";
+            }
+
+            // Cut the string short to what fits.
+            size_t available = (size_t)(end - p);
+            if (available < sizeof(uint16_t))
+            {
+                fits = false;
+                break;
+            }
+            available -= sizeof(uint16_t);
+
+            const uint16_t length = (uint16_t)strnlen(value, (available < UINT16_MAX) ? available : UINT16_MAX);
+            fits = zlog_binary_put(&p, end, &length, sizeof(length)) && zlog_binary_put(&p, end, value, length)
+                && value[length] == '\0';
+            break;
+        }
+
+        case ZLOG_ARG_POINTER:
+        {
+            const uint64_t value = (uintptr_t)va_arg(va, void*);
+            fits = zlog_binary_put(&p, end, &value, sizeof(value));
+            break;
+        }
+
+        case ZLOG_ARG_NONE:
+            (void)va_arg(va, void*);
+            break;
+
+        default:
+            fits = false;
+            break;
+        }
+    }
+
+    *complete = fits;
+    return (size_t)(p - out);
+}
@@ -0,0 +1,100 @@
+/**
+ * @file zlog_binary.h
+ * @brief Internal definitions of the zlog binary log file format, shared by zlog and zlog-decode.
+ *
+ * A binary log file starts with ZLOG_BINARY_MAGIC and ZLOG_BINARY_BYTE_ORDER_MARK, followed by records.
+ * Every record starts with a 16-bit length, covering the whole record, a type and a severity.
+ * Numbers are in the byte order of the device that wrote the file.
+ *
+ * ZLOG_RECORD_PROCESS     int32 pid. Written each time the file is opened.
+ * ZLOG_RECORD_FORMAT      uint32 format id, function name, format string. Both strings are NUL terminated.
+ *                         Written before the first record of the file that uses the format id.
+ * ZLOG_RECORD_LOG         int64 realtime ns, int32 tid, uint32 format id, then the encoded arguments.
+ * ZLOG_RECORD_TEXT        int64 realtime ns, int32 tid, function name, message. Both strings are NUL terminated.
+ *                         Used for messages without conversions, and when the format table is full.
+ *
+ * Records are at most UINT16_MAX bytes. Arguments of a longer ZLOG_RECORD_LOG are cut short, and zlog-decode marks
+ * the message as truncated; the message of a longer ZLOG_RECORD_TEXT is cut short.
+ *
+ * Each argument of a ZLOG_RECORD_LOG, including '*' widths and precisions, is 8 bytes: an integer converted to
+ * 64 bits according to its length modifier, a double, or a pointer; except strings, which are a uint16 length and
+ * the characters without a NUL.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ZLOG_BINARY_H
+#define ZLOG_BINARY_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ZLOG_BINARY_MAGIC "ZLOGBIN1"
+#define ZLOG_BINARY_MAGIC_SIZE (sizeof(ZLOG_BINARY_MAGIC) - 1)
+#define ZLOG_BINARY_BYTE_ORDER_MARK 0x01020304U
+#define ZLOG_BINARY_FILE_HEADER_SIZE (ZLOG_BINARY_MAGIC_SIZE + sizeof(uint32_t))
+
+// Record length, type, severity.
+#define ZLOG_RECORD_HEADER_SIZE (sizeof(uint16_t) + 2)
+// Record header, time, tid.
+#define ZLOG_RECORD_TIMED_HEADER_SIZE (ZLOG_RECORD_HEADER_SIZE + sizeof(int64_t) + sizeof(int32_t))
+
+typedef enum tagZLOG_RECORD_TYPE
+{
+    ZLOG_RECORD_PROCESS = 1,
+    ZLOG_RECORD_FORMAT = 2,
+    ZLOG_RECORD_LOG = 3,
+    ZLOG_RECORD_TEXT = 4,
+} ZLOG_RECORD_TYPE;
+
+typedef enum tagZLOG_ARG_TYPE
+{
+    ZLOG_ARG_INVALID, // Not a conversion zlog can encode. The rest of the format is not encoded.
+    ZLOG_ARG_NONE, // %n. Consumes an argument, but prints nothing.
+    ZLOG_ARG_SIGNED,
+    ZLOG_ARG_UNSIGNED,
+    ZLOG_ARG_CHAR,
+    ZLOG_ARG_DOUBLE,
+    ZLOG_ARG_STRING,
+    ZLOG_ARG_POINTER,
+} ZLOG_ARG_TYPE;
+
+typedef enum tagZLOG_ARG_LENGTH
+{
+    ZLOG_ARG_LENGTH_DEFAULT,
+    ZLOG_ARG_LENGTH_HH,
+    ZLOG_ARG_LENGTH_H,
+    ZLOG_ARG_LENGTH_L,
+    ZLOG_ARG_LENGTH_LL,
+    ZLOG_ARG_LENGTH_J,
+    ZLOG_ARG_LENGTH_Z,
+    ZLOG_ARG_LENGTH_T,
+    ZLOG_ARG_LENGTH_LONG_DOUBLE,
+} ZLOG_ARG_LENGTH;
+
+// One printf conversion of a format string.
+typedef struct tagZLOG_CONVERSION
+{
+    const char* start; // The '%'.
+    const char* flags_end; // End of the flags, width and precision; start of the length modifier.
+    const char* end; // Just past the conversion character.
+    bool width_arg; // Width is '*'.
+    bool precision_arg; // Precision is '*'.
+    ZLOG_ARG_LENGTH length;
+    ZLOG_ARG_TYPE type;
+    char conversion;
+} ZLOG_CONVERSION;
+
+// Finds the next conversion in fmt, skipping "%%".
+// Returns false at the end of fmt.
+bool zlog_binary_next_conversion(const char* fmt, ZLOG_CONVERSION* conversion);
+
+// Encodes the arguments of fmt into out, as described above.
+// Strings are cut short, and arguments that do not fit are left out, so that the result fits capacity.
+// Sets *complete to false if anything was cut or left out.
+// Returns the number of bytes written.
+size_t zlog_binary_encode_args(const char* fmt, va_list va, unsigned char* out, size_t capacity, bool* complete);
+
+#endif // ZLOG_BINARY_H
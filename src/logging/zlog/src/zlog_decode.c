@@ -0,0 +1,409 @@
+/**
+ * @file zlog_decode.c
+ * @brief Decodes zlog binary log files to text.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "zlog_decode.h"
+#include "zlog_binary.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct tagZLOG_DECODE_FORMAT
+{
+    char* func;
+    char* fmt;
+} ZLOG_DECODE_FORMAT;
+
+typedef struct tagZLOG_DECODE_STATE
+{
+    ZLOG_DECODE_FORMAT* formats;
+    size_t format_count;
+    int32_t pid;
+    char* string; // Holds one string argument, NUL terminated.
+} ZLOG_DECODE_STATE;
+
+static const char level_names[] = { 'D', 'I', 'W', 'E' }; // Must align with ZLOG_SEVERITY enum in zlog.h
+
+#define ZLOG_PRINT_WITH_STARS(out, spec, star_count, stars, value)                       \
+    ((star_count) == 0       ? fprintf((out), (spec), (value))                           \
+         : (star_count) == 1 ? fprintf((out), (spec), (stars)[0], (value))               \
+                             : fprintf((out), (spec), (stars)[0], (stars)[1], (value)))
+
+// Reads a value of size bytes at *p, unless that would pass end.
+static bool zlog_decode_get(const unsigned char** p, const unsigned char* end, void* value, size_t size)
+{
+    if ((size_t)(end - *p) < size)
+    {
+        return false;
+    }
+
+    memcpy(value, *p, size);
+    *p += size;
+    return true;
+}
+
+// Reads a NUL terminated string at *p, unless it is not terminated before end.
+static const char* zlog_decode_get_string(const unsigned char** p, const unsigned char* end)
+{
+    const unsigned char* nul = memchr(*p, '\0', end - *p);
+    if (nul == NULL)
+    {
+        return NULL;
+    }
+
+    const char* value = (const char*)*p;
+    *p = nul + 1;
+    return value;
+}
+
+// Writes the date, time, process and thread, like the text log prelude.
+static void zlog_decode_write_prelude(FILE* out, int64_t time_ns, int32_t pid, int32_t tid, uint8_t level)
+{
+    const time_t seconds = (time_t)(time_ns / 1000000000);
+    const int fraction = (int)((time_ns % 1000000000) / 100000);
+    struct tm gmtval;
+
+    if (gmtime_r(&seconds, &gmtval) != NULL)
+    {
+        fprintf(
+            out,
+            "%04d-%02d-%02dT%02d:%02d:%02d.%04dZ ",
+            gmtval.tm_year + 1900,
+            gmtval.tm_mon + 1,
+            gmtval.tm_mday % 100,
+            gmtval.tm_hour % 100,
+            gmtval.tm_min % 100,
+            gmtval.tm_sec % 100,
+            fraction);
+    }
+
+    fprintf(out, "%d[%d] [%c] ", pid, tid, (level < sizeof(level_names)) ? level_names[level] : '?');
+}
+
+// Writes the text of a format string between begin and end, with "%%" as '%'.
+static void zlog_decode_write_literal(FILE* out, const char* begin, const char* end)
+{
+    while (begin < end)
+    {
+        const char* percent = memchr(begin, '%', end - begin);
+        if (percent == NULL)
+        {
+            fwrite(begin, 1, end - begin, out);
+            return;
+        }
+
+        fwrite(begin, 1, percent - begin + 1, out);
+        begin = (percent + 1 < end && percent[1] == '%') ? percent + 2 : percent + 1;
+    }
+}
+
+// Writes the message of a ZLOG_RECORD_LOG, formatting fmt with the encoded arguments.
+static void zlog_decode_write_message(
+    FILE* out, ZLOG_DECODE_STATE* state, const char* fmt, const unsigned char* p, const unsigned char* end)
+{
+    ZLOG_CONVERSION conversion;
+    char spec[64];
+
+    while (zlog_binary_next_conversion(fmt, &conversion))
+    {
+        zlog_decode_write_literal(out, fmt, conversion.start);
+
+        const size_t flags_len = conversion.flags_end - conversion.start;
+        if (conversion.type == ZLOG_ARG_INVALID || flags_len + 4 > sizeof(spec))
+        {
+            // Not encoded. Show the rest of the format as is.
+            fputs(conversion.start, out);
+            return;
+        }
+
+        int stars[2];
+        int star_count = 0;
+        int64_t star = 0;
+        bool complete = true;
+
+        if (conversion.width_arg)
+        {
+            complete = zlog_decode_get(&p, end, &star, sizeof(star));
+            stars[star_count++] = (int)star;
+        }
+
+        if (complete && conversion.precision_arg)
+        {
+            complete = zlog_decode_get(&p, end, &star, sizeof(star));
+            stars[star_count++] = (int)star;
+        }
+
+        // Integers were widened to 64 bits, and long double narrowed to double.
+        memcpy(spec, conversion.start, flags_len);
+        spec[flags_len] = '\0';
+        if (conversion.type == ZLOG_ARG_SIGNED || conversion.type == ZLOG_ARG_UNSIGNED)
+        {
+            strcat(spec, "ll"); // NOLINT(clang-analyzer-security.insecureAPI.strcpy)
+        }
+        strncat(spec, &conversion.conversion, 1);
+
+        switch (complete ? conversion.type : ZLOG_ARG_INVALID)
+        {
+        case ZLOG_ARG_SIGNED:
+        case ZLOG_ARG_CHAR:
+        {
+            int64_t value;
+            complete = zlog_decode_get(&p, end, &value, sizeof(value));
+            if (complete && conversion.type == ZLOG_ARG_CHAR)
+            {
+                ZLOG_PRINT_WITH_STARS(out, spec, star_count, stars, (int)value);
+            }
+            else if (complete)
+            {
+                ZLOG_PRINT_WITH_STARS(out, spec, star_count, stars, (long long)value);
+            }
+            break;
+        }
+
+        case ZLOG_ARG_UNSIGNED:
+        {
+            uint64_t value;
+            complete = zlog_decode_get(&p, end, &value, sizeof(value));
+            if (complete)
+            {
+                ZLOG_PRINT_WITH_STARS(out, spec, star_count, stars, (unsigned long long)value);
+            }
+            break;
+        }
+
+        case ZLOG_ARG_DOUBLE:
+        {
+            double value;
+            complete = zlog_decode_get(&p, end, &value, sizeof(value));
+            if (complete)
+            {
+                ZLOG_PRINT_WITH_STARS(out, spec, star_count, stars, value);
+            }
+            break;
+        }
+
+        case ZLOG_ARG_STRING:
+        {
+            uint16_t length;
+            complete = zlog_decode_get(&p, end, &length, sizeof(length))
+                && zlog_decode_get(&p, end, state->string, length);
+            if (complete)
+            {
+                state->string[length] = '\0';
+                ZLOG_PRINT_WITH_STARS(out, spec, star_count, stars, state->string);
+            }
+            break;
+        }
+
+        case ZLOG_ARG_POINTER:
+        {
+            uint64_t value;
+            complete = zlog_decode_get(&p, end, &value, sizeof(value));
+            if (complete)
+            {
+                ZLOG_PRINT_WITH_STARS(out, spec, star_count, stars, (void*)(uintptr_t)value);
+            }
+            break;
+        }
+
+        case ZLOG_ARG_NONE:
+            break;
+
+        default:
+            complete = false;
+            break;
+        }
+
+        if (!complete)
+        {
+            // The arguments did not fit in the record.
+            fputs("<truncated>", out);
+            return;
+        }
+
+        fmt = conversion.end;
+    }
+
+    zlog_decode_write_literal(out, fmt, fmt + strlen(fmt));
+}
+
+// Decodes one record. Returns false if it is corrupt.
+static bool zlog_decode_record(FILE* out, ZLOG_DECODE_STATE* state, const unsigned char* record, size_t length)
+{
+    const unsigned char* p = record + sizeof(uint16_t);
+    const unsigned char* end = record + length;
+    uint8_t type;
+    uint8_t level;
+
+    if (!zlog_decode_get(&p, end, &type, sizeof(type)) || !zlog_decode_get(&p, end, &level, sizeof(level)))
+    {
+        return false;
+    }
+
+    switch (type)
+    {
+    case ZLOG_RECORD_PROCESS:
+        return zlog_decode_get(&p, end, &state->pid, sizeof(state->pid));
+
+    case ZLOG_RECORD_FORMAT:
+    {
+        uint32_t id;
+        const char* func;
+        const char* fmt;
+
+        if (!zlog_decode_get(&p, end, &id, sizeof(id)) || (func = zlog_decode_get_string(&p, end)) == NULL
+            || (fmt = zlog_decode_get_string(&p, end)) == NULL)
+        {
+            return false;
+        }
+
+        if (id >= state->format_count)
+        {
+            const size_t count = (size_t)id + 1;
+            ZLOG_DECODE_FORMAT* formats = realloc(state->formats, count * sizeof(*formats));
+            if (formats == NULL)
+            {
+                return false;
+            }
+            memset(formats + state->format_count, 0, (count - state->format_count) * sizeof(*formats));
+            state->formats = formats;
+            state->format_count = count;
+        }
+
+        // A later process may have used the id for another format.
+        free(state->formats[id].func);
+        free(state->formats[id].fmt);
+        state->formats[id].func = strdup(func);
+        state->formats[id].fmt = strdup(fmt);
+        return state->formats[id].func != NULL && state->formats[id].fmt != NULL;
+    }
+
+    case ZLOG_RECORD_LOG:
+    case ZLOG_RECORD_TEXT:
+    {
+        int64_t time_ns;
+        int32_t tid;
+
+        if (!zlog_decode_get(&p, end, &time_ns, sizeof(time_ns)) || !zlog_decode_get(&p, end, &tid, sizeof(tid)))
+        {
+            return false;
+        }
+
+        if (type == ZLOG_RECORD_TEXT)
+        {
+            const char* func;
+            const char* text;
+            if ((func = zlog_decode_get_string(&p, end)) == NULL || (text = zlog_decode_get_string(&p, end)) == NULL)
+            {
+                return false;
+            }
+
+            zlog_decode_write_prelude(out, time_ns, state->pid, tid, level);
+            fprintf(out, "%s [%.64s]\n", text, func);
+            return true;
+        }
+
+        uint32_t id;
+        if (!zlog_decode_get(&p, end, &id, sizeof(id)))
+        {
+            return false;
+        }
+
+        zlog_decode_write_prelude(out, time_ns, state->pid, tid, level);
+        if (id >= state->format_count || state->formats[id].fmt == NULL)
+        {
+            fprintf(out, "<unknown format %u> [?]\n", id);
+            return true;
+        }
+
+        zlog_decode_write_message(out, state, state->formats[id].fmt, p, end);
+        fprintf(out, " [%.64s]\n", state->formats[id].func);
+        return true;
+    }
+
+    default:
+        // Skip records of later versions.
+        return true;
+    }
+}
+
+int zlog_decode(FILE* in, FILE* out)
+{
+    int ret = -1;
+    ZLOG_DECODE_STATE state;
+    unsigned char header[ZLOG_BINARY_FILE_HEADER_SIZE];
+    uint32_t byte_order_mark;
+    unsigned char* record = NULL;
+
+    memset(&state, 0, sizeof(state));
+
+    if (fread(header, 1, sizeof(header), in) != sizeof(header)
+        || memcmp(header, ZLOG_BINARY_MAGIC, ZLOG_BINARY_MAGIC_SIZE) != 0)
+    {
+        fprintf(stderr, "Not a zlog binary log file.\n");
+        goto done;
+    }
+
+    memcpy(&byte_order_mark, header + ZLOG_BINARY_MAGIC_SIZE, sizeof(byte_order_mark));
+    if (byte_order_mark != ZLOG_BINARY_BYTE_ORDER_MARK)
+    {
+        fprintf(stderr, "The log file was written with another byte order.\n");
+        goto done;
+    }
+
+    record = malloc(UINT16_MAX);
+    state.string = malloc(UINT16_MAX + 1);
+    if (record == NULL || state.string == NULL)
+    {
+        goto done;
+    }
+
+    for (;;)
+    {
+        uint16_t length;
+
+        if (fread(&length, 1, sizeof(length), in) != sizeof(length))
+        {
+            // The end of the file, or a record cut short by a crash.
+            break;
+        }
+
+        if (length < ZLOG_RECORD_HEADER_SIZE)
+        {
+            fprintf(stderr, "Corrupt record of length %u.\n", length);
+            goto done;
+        }
+
+        memcpy(record, &length, sizeof(length));
+        if (fread(record + sizeof(length), 1, length - sizeof(length), in) != length - sizeof(length))
+        {
+            break;
+        }
+
+        if (!zlog_decode_record(out, &state, record, length))
+        {
+            fprintf(stderr, "Corrupt record.\n");
+            goto done;
+        }
+    }
+
+    ret = 0;
+
+done:
+    for (size_t i = 0; i < state.format_count; ++i)
+    {
+        free(state.formats[i].func);
+        free(state.formats[i].fmt);
+    }
+    free(state.formats);
+    free(state.string);
+    free(record);
+
+    return ret;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file zlog_perf.cpp
+ * @brief Benchmarks for logging to a file from many threads at once, and for the cost of a log call.
+ *
+ * Hidden from the default run. Use: zlog_unit_tests "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "zlog.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("zlog - concurrent logging throughput and latency", "[.][perf]")
+{
+    constexpr int linesPerThread = 20000;
+
+    char dirTemplate[] = "/tmp/zlogperfXXXXXX";
+    REQUIRE(mkdtemp(dirTemplate) != nullptr);
+    const std::string dir = dirTemplate;
+
+    for (int threadCount : { 1, 4, 16 })
+    {
+        REQUIRE(zlog_init(dir.c_str(), "zlogperf", ZLOG_DISABLED, ZLOG_ENABLED, ZLOG_ERROR, ZLOG_DEBUG) == 0);
+        const unsigned long droppedBefore = zlog_get_dropped_line_count();
+
+        std::vector<std::vector<double>> latencies(threadCount);
+        std::vector<std::thread> threads;
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([t, &latencies]() {
+                std::vector<double>& threadLatencies = latencies[t];
+                threadLatencies.reserve(linesPerThread);
+                for (int i = 0; i < linesPerThread; ++i)
+                {
+                    const auto before = std::chrono::steady_clock::now();
+                    log_info("benchmark line %d from thread %d with a typical amount of detail", i, t);
+                    const std::chrono::duration<double, std::micro> elapsed =
+                        std::chrono::steady_clock::now() - before;
+                    threadLatencies.push_back(elapsed.count());
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        zlog_finish();
+
+        std::vector<double> all;
+        for (const std::vector<double>& threadLatencies : latencies)
+        {
+            all.insert(all.end(), threadLatencies.begin(), threadLatencies.end());
+        }
+        std::sort(all.begin(), all.end());
+
+        const double lines = static_cast<double>(threadCount) * linesPerThread;
+        std::cout << threadCount << " thread(s)\t" << (lines / elapsed.count()) << " lines/s\tp50 "
+                  << all[all.size() / 2] << " us\tp99 " << all[all.size() * 99 / 100] << " us\tmax " << all.back()
+                  << " us\tdropped " << (zlog_get_dropped_line_count() - droppedBefore) << std::endl;
+    }
+
+    const std::string command = "rm -rf " + dir;
+    CHECK(system(command.c_str()) == 0);
+}
+
+TEST_CASE("zlog - per call cost in text and binary modes", "[.][perf]")
+{
+    // Fewer lines than the buffer holds, so that no line is dropped.
+    constexpr int linesPerBatch = 512;
+    constexpr int batches = 400;
+
+    char dirTemplate[] = "/tmp/zlogperfXXXXXX";
+    REQUIRE(mkdtemp(dirTemplate) != nullptr);
+    const std::string dir = dirTemplate;
+    const std::string workflowId = "8a3f2c1d-5b7e-4e8a-9c2d-1f0e3b4a5c6d";
+
+    for (ZLOG_FILE_FORMAT format : { ZLOG_FILE_FORMAT_TEXT, ZLOG_FILE_FORMAT_BINARY })
+    {
+        zlog_set_file_format(format);
+        REQUIRE(zlog_init(dir.c_str(), "zlogperf", ZLOG_DISABLED, ZLOG_ENABLED, ZLOG_ERROR, ZLOG_DEBUG) == 0);
+
+        std::chrono::duration<double, std::nano> logging{ 0 };
+        for (int batch = 0; batch < batches; ++batch)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < linesPerBatch; ++i)
+            {
+                log_debug(
+                    "Workflow %s step %d of %d: downloaded %zu of %zu bytes (%.1f%%)",
+                    workflowId.c_str(),
+                    i % 8,
+                    8,
+                    static_cast<size_t>(i) * 4096,
+                    static_cast<size_t>(linesPerBatch) * 4096,
+                    100.0 * i / linesPerBatch);
+            }
+            logging += std::chrono::steady_clock::now() - start;
+
+            // Not timed: keeps the buffer from filling up.
+            zlog_flush_buffer();
+        }
+
+        zlog_finish();
+
+        std::cout << (format == ZLOG_FILE_FORMAT_TEXT ? "text" : "binary") << "\t"
+                  << (logging.count() / (static_cast<double>(linesPerBatch) * batches)) << " ns/call" << std::endl;
+    }
+
+    zlog_set_file_format(ZLOG_FILE_FORMAT_TEXT);
+
+    const std::string command = "rm -rf " + dir;
+    CHECK(system(command.c_str()) == 0);
+}
@@ -0,0 +1,320 @@
+/**
+ * @file zlog_ut.cpp
+ * @brief Unit Tests for the zlog file writer.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "zlog.h"
+#include "zlog_decode.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h> // for opendir, readdir
+
+namespace
+{
+/**
+ * @brief A temp log folder with file logging started in it.
+ */
+class ZlogFixture
+{
+public:
+    ZlogFixture(const ZlogFixture&) = delete;
+    ZlogFixture& operator=(const ZlogFixture&) = delete;
+    ZlogFixture(ZlogFixture&&) = delete;
+    ZlogFixture& operator=(ZlogFixture&&) = delete;
+
+    explicit ZlogFixture(ZLOG_SEVERITY fileLevel = ZLOG_DEBUG, ZLOG_FILE_FORMAT format = ZLOG_FILE_FORMAT_TEXT)
+    {
+        zlog_set_file_format(format);
+        char dirTemplate[] = "/tmp/zlogXXXXXX";
+        REQUIRE(mkdtemp(dirTemplate) != nullptr);
+        _dir = dirTemplate;
+        REQUIRE(zlog_init(_dir.c_str(), "zlogtest", ZLOG_DISABLED, ZLOG_ENABLED, ZLOG_ERROR, fileLevel) == 0);
+    }
+
+    ~ZlogFixture()
+    {
+        zlog_finish();
+        zlog_set_file_format(ZLOG_FILE_FORMAT_TEXT);
+        std::string command = "rm -rf " + _dir;
+        CHECK(system(command.c_str()) == 0);
+    }
+
+    /**
+     * @brief Reads all log files in the folder.
+     */
+    std::string ReadLogs() const
+    {
+        std::string content;
+        DIR* dir = opendir(_dir.c_str());
+        REQUIRE(dir != nullptr);
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr)
+        {
+            if (entry->d_name[0] != '.')
+            {
+                std::ifstream file{ _dir + "/" + entry->d_name, std::ios::binary };
+                content.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            }
+        }
+
+        closedir(dir);
+        return content;
+    }
+
+    /**
+     * @brief Decodes all binary log files in the folder.
+     */
+    std::string DecodeLogs() const
+    {
+        const std::string binary = ReadLogs();
+        FILE* in = fmemopen(const_cast<char*>(binary.data()), binary.size(), "rb");
+        REQUIRE(in != nullptr);
+
+        char* text = nullptr;
+        size_t textSize = 0;
+        FILE* out = open_memstream(&text, &textSize);
+        REQUIRE(out != nullptr);
+
+        CHECK(zlog_decode(in, out) == 0);
+
+        fclose(in);
+        fclose(out);
+        std::string decoded{ text, textSize };
+        free(text);
+        return decoded;
+    }
+
+    static size_t CountOccurrences(const std::string& content, const std::string& text)
+    {
+        size_t count = 0;
+        for (size_t pos = content.find(text); pos != std::string::npos; pos = content.find(text, pos + text.size()))
+        {
+            ++count;
+        }
+        return count;
+    }
+
+private:
+    std::string _dir;
+};
+} // namespace
+
+TEST_CASE("zlog - flush writes every line logged before it")
+{
+    ZlogFixture fixture;
+
+    log_info("first line");
+    log_debug("second line");
+
+    zlog_flush_buffer();
+
+    const std::string logs = fixture.ReadLogs();
+    const size_t first = logs.find("[I] first line [");
+    const size_t second = logs.find("[D] second line [");
+    REQUIRE(first != std::string::npos);
+    REQUIRE(second != std::string::npos);
+    CHECK(first < second);
+}
+
+TEST_CASE("zlog - lines below the file level are not written")
+{
+    ZlogFixture fixture{ ZLOG_WARN };
+
+    log_info("not written");
+    log_warn("written");
+
+    zlog_flush_buffer();
+
+    const std::string logs = fixture.ReadLogs();
+    CHECK(logs.find("not written") == std::string::npos);
+    CHECK(logs.find("[W] written [") != std::string::npos);
+}
+
+TEST_CASE("zlog - a long log is written between multi-line markers")
+{
+    ZlogFixture fixture;
+    const std::string longText(2000, 'x');
+
+    log_info("before");
+    log_info("%s", longText.c_str());
+    log_info("after");
+
+    zlog_flush_buffer();
+
+    const std::string logs = fixture.ReadLogs();
+    const size_t begin = logs.find("==== MULTI-LINE LOG BEGIN ====");
+    const size_t text = logs.find(longText);
+    const size_t end = logs.find("==== MULTI-LINE LOG END ====");
+    REQUIRE(begin != std::string::npos);
+    REQUIRE(text != std::string::npos);
+    REQUIRE(end != std::string::npos);
+    CHECK(logs.find("before") < begin);
+    CHECK(begin < text);
+    CHECK(text < end);
+    CHECK(end < logs.find("after"));
+}
+
+TEST_CASE("zlog - every line from concurrent threads is written or counted as dropped")
+{
+    constexpr int threadCount = 4;
+    constexpr int linesPerThread = 75;
+
+    const unsigned long droppedBefore = zlog_get_dropped_line_count();
+    std::string logs;
+
+    {
+        ZlogFixture fixture;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([t]() {
+                for (int i = 0; i < linesPerThread; ++i)
+                {
+                    log_debug("concurrent line %d-%d", t, i);
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        // zlog_finish writes the remaining lines.
+        zlog_finish();
+        logs = fixture.ReadLogs();
+    }
+
+    const unsigned long dropped = zlog_get_dropped_line_count() - droppedBefore;
+    const size_t written = ZlogFixture::CountOccurrences(logs, "concurrent line ");
+    CHECK(written + dropped == threadCount * linesPerThread);
+
+    if (dropped > 0)
+    {
+        CHECK(logs.find("zlog buffer full: dropped") != std::string::npos);
+    }
+}
+
+TEST_CASE("zlog - request flush does not wait for the writer")
+{
+    ZlogFixture fixture;
+
+    log_info("requested");
+    zlog_request_flush_buffer();
+
+    // The line is written without another flush or zlog_finish.
+    bool written = false;
+    for (int i = 0; i < 100 && !written; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        written = fixture.ReadLogs().find("requested") != std::string::npos;
+    }
+    CHECK(written);
+}
+
+TEST_CASE("zlog - binary log decodes to the text log message")
+{
+    std::string decoded;
+    const std::string longText(1000, 'y');
+    const char* nullString = nullptr;
+
+    {
+        ZlogFixture fixture{ ZLOG_DEBUG, ZLOG_FILE_FORMAT_BINARY };
+
+        log_info("int %d %i %5d|%-4u| %hhx %hd %ld %lld %zu %jd %x %#o", 42, -7, 3, 9U, 0x1ff, (short)-2, -3L, 4LL,
+                 static_cast<size_t>(5), static_cast<intmax_t>(-6), 255U, 8U);
+        log_warn("str '%s' '%.3s' '%*s' %s 100%% %c", "hello", "abcdef", 6, "pad", nullString, 'z');
+        log_error("double %.2f %e %g %*.*f", 3.5, 1e-3, 0.25, 8, 3, 2.0);
+        log_debug("no arguments");
+        log_info("long %s end %d", longText.c_str(), 1);
+
+        zlog_finish();
+        decoded = fixture.DecodeLogs();
+    }
+
+    CHECK(decoded.find("[I] int 42 -7     3|9   | ff -2 -3 4 5 -6 ff 010 [") != std::string::npos);
+    CHECK(decoded.find("[W] str 'hello' 'abc' '   pad' (null) 100% z [") != std::string::npos);
+    CHECK(decoded.find("[E] double 3.50 1.000000e-03 0.25    2.000 [") != std::string::npos);
+    CHECK(decoded.find("[D] no arguments [") != std::string::npos);
+    CHECK(decoded.find("[I] long " + longText + " end 1 [") != std::string::npos);
+    CHECK(decoded.find("<truncated>") == std::string::npos);
+
+    // The debug line of zlog_init, and the five above.
+    CHECK(ZlogFixture::CountOccurrences(decoded, "\n") == 6);
+}
+
+TEST_CASE("zlog - binary log defines each format once per file")
+{
+    std::string binary;
+    std::string decoded;
+
+    {
+        ZlogFixture fixture{ ZLOG_DEBUG, ZLOG_FILE_FORMAT_BINARY };
+
+        for (int i = 0; i < 10; ++i)
+        {
+            log_info("repeated format %d", i);
+        }
+
+        zlog_finish();
+        binary = fixture.ReadLogs();
+        decoded = fixture.DecodeLogs();
+    }
+
+    CHECK(ZlogFixture::CountOccurrences(binary, "repeated format %d") == 1);
+    CHECK(decoded.find("[I] repeated format 0 [") != std::string::npos);
+    CHECK(decoded.find("[I] repeated format 9 [") != std::string::npos);
+}
+
+TEST_CASE("zlog - binary log copies formats that are not literals")
+{
+    std::string decoded;
+
+    {
+        ZlogFixture fixture{ ZLOG_DEBUG, ZLOG_FILE_FORMAT_BINARY };
+
+        for (int i = 0; i < 3; ++i)
+        {
+            // Freed before the writer thread reads the format table.
+            std::string fmt = "heap format " + std::to_string(i) + " %d";
+            log_info(fmt.c_str(), i);
+            std::string message = "heap message " + std::to_string(i);
+            log_info(message.c_str());
+        }
+
+        zlog_finish();
+        decoded = fixture.DecodeLogs();
+    }
+
+    CHECK(decoded.find("[I] heap format 0 0 [") != std::string::npos);
+    CHECK(decoded.find("[I] heap format 2 2 [") != std::string::npos);
+    CHECK(decoded.find("[I] heap message 1 [") != std::string::npos);
+}
+
+TEST_CASE("zlog - decode rejects a text log")
+{
+    char text[] = "2020-07-01T18:21:26.1234Z 1[1] [I] hello [main]\n";
+    FILE* in = fmemopen(text, sizeof(text) - 1, "rb");
+    REQUIRE(in != nullptr);
+
+    FILE* out = fopen("/dev/null", "w");
+    REQUIRE(out != nullptr);
+
+    CHECK(zlog_decode(in, out) == -1);
+
+    fclose(in);
+    fclose(out);
+}
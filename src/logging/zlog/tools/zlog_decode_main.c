@@ -0,0 +1,45 @@
+/**
+ * @file zlog_decode_main.c
+ * @brief zlog-decode: writes binary zlog log files as text, for reading off the device.
+ *
+ * Usage: zlog-decode <file.zlog>...
+ * With no files, decodes standard input.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "zlog_decode.h"
+
+#include <stdio.h>
+
+int main(int argc, char** argv)
+{
+    int ret = 0;
+
+    if (argc < 2)
+    {
+        return zlog_decode(stdin, stdout) == 0 ? 0 : 1;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        FILE* in = fopen(argv[i], "rb");
+        if (in == NULL)
+        {
+            fprintf(stderr, "Cannot open '%s'.\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+
+        if (zlog_decode(in, stdout) != 0)
+        {
+            fprintf(stderr, "Cannot decode '%s'.\n", argv[i]);
+            ret = 1;
+        }
+
+        fclose(in);
+    }
+
+    return ret;
+}
@@ -48,10 +48,10 @@ static char* DeviceInfo_GetManufacturer()
 
     char* result = nullptr;
 
-    ADUC_ConfigInfo config = {};
-    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH) && config.manufacturer != nullptr)
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config != nullptr && config->manufacturer != nullptr)
     {
-        result = strdup(config.manufacturer);
+        result = strdup(config->manufacturer);
     }
     else
     {
@@ -60,7 +60,7 @@ static char* DeviceInfo_GetManufacturer()
     }
 
     valueIsDirty = false;
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
     return result;
 }
 
@@ -81,10 +81,10 @@ static char* DeviceInfo_GetModel()
     }
 
     char* result = nullptr;
-    ADUC_ConfigInfo config = {};
-    if (ADUC_ConfigInfo_Init(&config, ADUC_CONF_FILE_PATH) && config.model != nullptr)
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config != nullptr && config->model != nullptr)
     {
-        result = strdup(config.model);
+        result = strdup(config->model);
     }
     else
     {
@@ -93,7 +93,7 @@ static char* DeviceInfo_GetModel()
     }
 
     valueIsDirty = false;
-    ADUC_ConfigInfo_UnInit(&config);
+    ADUC_ConfigInfo_ReleaseInstance(config);
     return result;
 }
 
@@ -29,6 +29,42 @@
 
 EXTERN_C_BEGIN
 
+/**
+ * @brief The number of payload files downloaded in parallel when du-config.json has no maxConcurrentDownloads.
+ */
+#define ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_DOWNLOADS 4
+
+/**
+ * @brief The number of step is-installed checks evaluated in parallel when du-config.json has no
+ * maxConcurrentInstalledChecks.
+ * @details Checks run one at a time by default, since a content handler may not be safe to call from several threads.
+ * Parallel checks are opt-in.
+ */
+#define ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_INSTALLED_CHECKS 1
+
+/**
+ * @brief The number of byte ranges a large payload is downloaded in when du-config.json has no downloadSegmentCount.
+ */
+#define ADUC_CONFIG_DEFAULT_DOWNLOAD_SEGMENT_COUNT 1
+
+/**
+ * @brief The size, in MiB, the delta source update cache is kept within when du-config.json has no
+ * sourceUpdateCacheMaxMegabytes.
+ */
+#define ADUC_CONFIG_DEFAULT_SOURCE_UPDATE_CACHE_MAX_MEGABYTES 1024
+
+/**
+ * @brief The free space, in MiB, the delta source update cache leaves on its file system when du-config.json has no
+ * sourceUpdateCacheMinFreeMegabytes. An explicit 0 leaves no floor.
+ */
+#define ADUC_CONFIG_DEFAULT_SOURCE_UPDATE_CACHE_MIN_FREE_MEGABYTES 256
+
+/**
+ * @brief The size, in MiB, the content store of verified payloads is kept within when du-config.json has no
+ * contentStoreMaxMegabytes.
+ */
+#define ADUC_CONFIG_DEFAULT_CONTENT_STORE_MAX_MEGABYTES 1024
+
 typedef struct tagADUC_AgentInfo
 {
     char* name; /**< The name of the agent. */
@@ -70,6 +106,22 @@ typedef struct tagADUC_ConfigInfo
     char* compatPropertyNames; /**< Compat property names. */
 
     char* iotHubProtocol; /**< The IotHub transport protocol to use. */
+
+    unsigned int maxConcurrentDownloads; /**< Max number of payload files downloaded in parallel. 1 disables. */
+
+    unsigned int maxConcurrentInstalledChecks; /**< Max number of step is-installed checks in parallel. 1 disables. */
+
+    unsigned int downloadSegmentCount; /**< Number of byte ranges a large payload is downloaded in. 1 disables. */
+
+    unsigned int sourceUpdateCacheMaxMegabytes; /**< Max size of the delta source update cache, in MiB. */
+
+    unsigned int sourceUpdateCacheMinFreeMegabytes; /**< Free space the source update cache leaves, in MiB. */
+
+    unsigned int contentStoreMaxMegabytes; /**< Max size of the content store, in MiB. 0 disables the store. */
+
+    bool enableD2COutbox; /**< Keep D2C messages in an outbox file, so they are sent after the agent restarts. */
+
+    JSON_Value* rootJsonValue; /**< The parsed configuration file. */
 } ADUC_ConfigInfo;
 
 /**
@@ -87,6 +139,25 @@ bool ADUC_ConfigInfo_Init(ADUC_ConfigInfo* config, const char* configFilePath);
  */
 void ADUC_ConfigInfo_UnInit(ADUC_ConfigInfo* config);
 
+/**
+ * @brief Gets the configuration read from ADUC_CONF_FILE_PATH, without reading the file again.
+ *
+ * The file is read on the first call. Later calls return the same configuration until the file is written or
+ * replaced, and then the configuration read from the new file; if the new file cannot be read, the previous
+ * configuration is kept. A returned configuration does not change, and stays valid until it is released.
+ *
+ * @return const ADUC_ConfigInfo* The configuration, or NULL if the file cannot be read.
+ * Must be released with ADUC_ConfigInfo_ReleaseInstance.
+ */
+const ADUC_ConfigInfo* ADUC_ConfigInfo_GetInstance(void);
+
+/**
+ * @brief Releases a configuration returned by ADUC_ConfigInfo_GetInstance.
+ *
+ * @param configInfo The configuration. May be NULL.
+ */
+void ADUC_ConfigInfo_ReleaseInstance(const ADUC_ConfigInfo* configInfo);
+
 /**
  * @brief Get the agent information of the desired index from the ADUC_ConfigInfo object
  *
@@ -94,7 +165,7 @@ void ADUC_ConfigInfo_UnInit(ADUC_ConfigInfo* config);
  * @param index
  * @return const ADUC_AgentInfo*, NULL if failure
  */
-const ADUC_AgentInfo* ADUC_ConfigInfo_GetAgent(ADUC_ConfigInfo* config, unsigned int index);
+const ADUC_AgentInfo* ADUC_ConfigInfo_GetAgent(const ADUC_ConfigInfo* config, unsigned int index);
 
 /**
  * @brief Get the adu trusted user list
@@ -13,11 +13,15 @@
 #include <aduc/string_c_utils.h>
 #include <azure_c_shared_utility/crt_abstractions.h>
 #include <azure_c_shared_utility/strings_types.h>
+#include <errno.h>
+#include <limits.h> // PATH_MAX
 #include <parson.h>
 #include <parson_json_utils.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <unistd.h>
 
 static void ADUC_AgentInfo_Free(ADUC_AgentInfo* agent);
@@ -253,6 +257,9 @@ bool ADUC_ConfigInfo_Init(ADUC_ConfigInfo* config, const char* configFilePath)
         goto done;
     }
 
+    // Owns aduShellTrustedUsers and the agents' additionalDeviceProperties.
+    config->rootJsonValue = root_value;
+
     if (!ADUC_Json_GetAgents(root_value, &(config->agentCount), &(config->agents)))
     {
         goto done;
@@ -324,6 +331,49 @@ bool ADUC_ConfigInfo_Init(ADUC_ConfigInfo* config, const char* configFilePath)
         }
     }
 
+    if (!ADUC_JSON_GetUnsignedIntegerField(root_value, "maxConcurrentDownloads", &(config->maxConcurrentDownloads))
+        || config->maxConcurrentDownloads == 0)
+    {
+        config->maxConcurrentDownloads = ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_DOWNLOADS;
+    }
+
+    if (!ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "maxConcurrentInstalledChecks", &(config->maxConcurrentInstalledChecks))
+        || config->maxConcurrentInstalledChecks == 0)
+    {
+        config->maxConcurrentInstalledChecks = ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_INSTALLED_CHECKS;
+    }
+
+    if (!ADUC_JSON_GetUnsignedIntegerField(root_value, "downloadSegmentCount", &(config->downloadSegmentCount))
+        || config->downloadSegmentCount == 0)
+    {
+        config->downloadSegmentCount = ADUC_CONFIG_DEFAULT_DOWNLOAD_SEGMENT_COUNT;
+    }
+
+    if (!ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "sourceUpdateCacheMaxMegabytes", &(config->sourceUpdateCacheMaxMegabytes))
+        || config->sourceUpdateCacheMaxMegabytes == 0)
+    {
+        config->sourceUpdateCacheMaxMegabytes = ADUC_CONFIG_DEFAULT_SOURCE_UPDATE_CACHE_MAX_MEGABYTES;
+    }
+
+    // An explicit 0 leaves no free space floor.
+    if (!ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "sourceUpdateCacheMinFreeMegabytes", &(config->sourceUpdateCacheMinFreeMegabytes)))
+    {
+        config->sourceUpdateCacheMinFreeMegabytes = ADUC_CONFIG_DEFAULT_SOURCE_UPDATE_CACHE_MIN_FREE_MEGABYTES;
+    }
+
+    // An explicit 0 disables the content store.
+    if (!ADUC_JSON_GetUnsignedIntegerField(
+            root_value, "contentStoreMaxMegabytes", &(config->contentStoreMaxMegabytes)))
+    {
+        config->contentStoreMaxMegabytes = ADUC_CONFIG_DEFAULT_CONTENT_STORE_MAX_MEGABYTES;
+    }
+
+    // Optional, and off unless set to true.
+    config->enableD2COutbox = json_object_get_boolean(root_object, "enableD2COutbox") == 1;
+
     succeeded = true;
 
 done:
@@ -346,14 +396,204 @@ void ADUC_ConfigInfo_UnInit(ADUC_ConfigInfo* config)
         return;
     }
 
+    free(config->schemaVersion);
     free(config->manufacturer);
     free(config->model);
+    free(config->edgegatewayCertPath);
+    free(config->compatPropertyNames);
     free(config->iotHubProtocol);
     ADUC_AgentInfoArray_Free(config->agentCount, config->agents);
+    json_value_free(config->rootJsonValue);
 
     memset(config, 0, sizeof(*config));
 }
 
+/**
+ * @brief The shared configuration, and the number of its holders.
+ */
+typedef struct tagADUC_ConfigInfoInstance
+{
+    ADUC_ConfigInfo configInfo; /**< Must be first: holders are given a pointer to it. */
+
+    unsigned int refCount; /**< Unreleased ADUC_ConfigInfo_GetInstance calls, plus one while it is current. */
+} ADUC_ConfigInfoInstance;
+
+static pthread_mutex_t s_configInstanceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ADUC_ConfigInfoInstance* s_configInstance = NULL; /**< The current configuration; NULL until read. */
+
+static int s_configWatchFd = -1; /**< The inotify instance watching the configuration file, or -1. */
+
+static bool s_configWatchStarted = false;
+
+/**
+ * @brief Drops a reference to @p instance, and frees it when it was the last one.
+ * Must be called with s_configInstanceMutex held.
+ *
+ * @param instance The instance.
+ */
+static void ADUC_ConfigInfoInstance_Release(ADUC_ConfigInfoInstance* instance)
+{
+    if (--instance->refCount == 0)
+    {
+        ADUC_ConfigInfo_UnInit(&instance->configInfo);
+        free(instance);
+    }
+}
+
+/**
+ * @brief Gets the name of the configuration file, without its directory.
+ */
+static const char* ADUC_ConfigInfo_GetFileName(void)
+{
+    const char* slash = strrchr(ADUC_CONF_FILE_PATH, '/');
+    return slash == NULL ? ADUC_CONF_FILE_PATH : slash + 1;
+}
+
+/**
+ * @brief Starts watching the configuration file for changes.
+ *
+ * Watches the directory of the file rather than the file, so that a file replaced by renaming another one over
+ * it is noticed too. Without a watch, the configuration is read once and never reloaded.
+ * Must be called with s_configInstanceMutex held.
+ */
+static void ADUC_ConfigInfo_StartWatch(void)
+{
+    char dirPath[PATH_MAX] = ".";
+
+    s_configWatchStarted = true;
+
+    // Keeps the trailing slash of the directory.
+    const size_t dirLength = (size_t)(ADUC_ConfigInfo_GetFileName() - ADUC_CONF_FILE_PATH);
+    if (dirLength >= sizeof(dirPath))
+    {
+        return;
+    }
+
+    if (dirLength > 0)
+    {
+        memcpy(dirPath, ADUC_CONF_FILE_PATH, dirLength);
+        dirPath[dirLength] = '\0';
+    }
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1)
+    {
+        Log_Warn("Cannot watch '%s' for changes, errno %d", ADUC_CONF_FILE_PATH, errno);
+        return;
+    }
+
+    if (inotify_add_watch(fd, dirPath, IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+    {
+        Log_Warn("Cannot watch '%s' for changes, errno %d", dirPath, errno);
+        close(fd);
+        return;
+    }
+
+    s_configWatchFd = fd;
+}
+
+/**
+ * @brief Reads the pending events of the configuration file watch.
+ * Must be called with s_configInstanceMutex held.
+ *
+ * @return true if the configuration file was written or replaced since the last call.
+ */
+static bool ADUC_ConfigInfo_HasFileChanged(void)
+{
+    bool changed = false;
+    const char* fileName = ADUC_ConfigInfo_GetFileName();
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length = 0;
+
+    while ((length = read(s_configWatchFd, buffer, sizeof(buffer))) > 0)
+    {
+        const char* next = buffer;
+        while (next < buffer + length)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)next;
+            if ((event->mask & IN_Q_OVERFLOW) != 0 || (event->len > 0 && strcmp(event->name, fileName) == 0))
+            {
+                changed = true;
+            }
+
+            next += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * @brief Gets the configuration read from ADUC_CONF_FILE_PATH.
+ *
+ * @return const ADUC_ConfigInfo* The configuration, or NULL if it cannot be read.
+ */
+const ADUC_ConfigInfo* ADUC_ConfigInfo_GetInstance(void)
+{
+    const ADUC_ConfigInfo* configInfo = NULL;
+
+    pthread_mutex_lock(&s_configInstanceMutex);
+
+    // Watch before the first read, so that a change made while reading is not missed.
+    if (!s_configWatchStarted)
+    {
+        ADUC_ConfigInfo_StartWatch();
+    }
+
+    bool changed = s_configWatchFd != -1 && ADUC_ConfigInfo_HasFileChanged();
+    if (s_configInstance == NULL || changed)
+    {
+        ADUC_ConfigInfoInstance* instance = calloc(1, sizeof(*instance));
+        if (instance != NULL && ADUC_ConfigInfo_Init(&instance->configInfo, ADUC_CONF_FILE_PATH))
+        {
+            instance->refCount = 1;
+            if (s_configInstance != NULL)
+            {
+                Log_Info("Reloaded the changed configuration file '%s'", ADUC_CONF_FILE_PATH);
+                ADUC_ConfigInfoInstance_Release(s_configInstance);
+            }
+
+            s_configInstance = instance;
+        }
+        else
+        {
+            free(instance);
+            if (s_configInstance != NULL)
+            {
+                Log_Warn("Cannot reload '%s', keeping the previous configuration", ADUC_CONF_FILE_PATH);
+            }
+        }
+    }
+
+    if (s_configInstance != NULL)
+    {
+        ++s_configInstance->refCount;
+        configInfo = &s_configInstance->configInfo;
+    }
+
+    pthread_mutex_unlock(&s_configInstanceMutex);
+
+    return configInfo;
+}
+
+/**
+ * @brief Releases a configuration returned by ADUC_ConfigInfo_GetInstance.
+ *
+ * @param configInfo The configuration. May be NULL.
+ */
+void ADUC_ConfigInfo_ReleaseInstance(const ADUC_ConfigInfo* configInfo)
+{
+    if (configInfo == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&s_configInstanceMutex);
+    ADUC_ConfigInfoInstance_Release((ADUC_ConfigInfoInstance*)configInfo);
+    pthread_mutex_unlock(&s_configInstanceMutex);
+}
+
 /**
  * @brief Get the agent information of the desired index from the ADUC_ConfigInfo object
  *
@@ -361,7 +601,7 @@ void ADUC_ConfigInfo_UnInit(ADUC_ConfigInfo* config)
  * @param index the index of the Agent array in config that we want to access
  * @return const ADUC_AgentInfo*, NULL if failure
  */
-const ADUC_AgentInfo* ADUC_ConfigInfo_GetAgent(ADUC_ConfigInfo* config, unsigned int index)
+const ADUC_AgentInfo* ADUC_ConfigInfo_GetAgent(const ADUC_ConfigInfo* config, unsigned int index)
 {
     if (config == NULL)
     {
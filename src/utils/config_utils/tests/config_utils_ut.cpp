@@ -16,6 +16,7 @@
 #include <azure_c_shared_utility/crt_abstractions.h>
 #include <parson.h>
 #include <string.h>
+#include <string>
 
 #define ENABLE_MOCKS
 #include "aduc/config_utils.h"
@@ -117,6 +118,43 @@ static const char* validConfigContentMqttIotHubProtocol =
         R"(])"
     R"(})";
 
+static const char* validConfigContentDownloadTuning =
+    R"({)"
+        R"("schemaVersion": "1.1",)"
+        R"("aduShellTrustedUsers": ["adu","do"],)"
+        R"("manufacturer": "device_info_manufacturer",)"
+        R"("model": "device_info_model",)"
+        R"("maxConcurrentDownloads": 8,)"
+        R"("maxConcurrentInstalledChecks": 12,)"
+        R"("downloadSegmentCount": 6,)"
+        R"("sourceUpdateCacheMaxMegabytes": 2048,)"
+        R"("sourceUpdateCacheMinFreeMegabytes": 128,)"
+        R"("contentStoreMaxMegabytes": 0,)"
+        R"("enableD2COutbox": true,)"
+        R"("agents": [)"
+            R"({ )"
+            R"("name": "host-update",)"
+            R"("runas": "adu",)"
+            R"("connectionSource": {)"
+                R"("connectionType": "AIS",)"
+                R"("connectionData": "iotHubDeviceUpdate")"
+            R"(},)"
+            R"("manufacturer": "Contoso",)"
+            R"("model": "Smart-Box")"
+            R"(},)"
+            R"({)"
+            R"("name": "leaf-update",)"
+            R"("runas": "adu",)"
+            R"("connectionSource": {)"
+                R"("connectionType": "string",)"
+                R"("connectionData": "HOSTNAME=...")"
+            R"(},)"
+            R"("manufacturer": "Fabrikam",)"
+            R"("model": "Camera")"
+            R"(})"
+        R"(])"
+    R"(})";
+
 static const char* validConfigContentMqttWebSocketsIotHubProtocol =
     R"({)"
         R"("schemaVersion": "1.1",)"
@@ -284,6 +322,14 @@ static JSON_Value* MockParse_JSON_File(const char* configFilePath)
     return json_parse_string(g_configContentString);
 }
 
+static int g_parseCount = 0;
+
+static JSON_Value* MockParse_JSON_File_Counted(const char* configFilePath)
+{
+    ++g_parseCount;
+    return MockParse_JSON_File(configFilePath);
+}
+
 class GlobalMockHookTestCaseFixture
 {
 public:
@@ -334,6 +380,13 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "ADUC_ConfigInfo_Init Functional
         CHECK_THAT(second_agent_info->connectionType, Equals("string"));
         CHECK_THAT(second_agent_info->connectionData, Equals("HOSTNAME=..."));
         CHECK(first_agent_info->additionalDeviceProperties == nullptr);
+        CHECK(config.maxConcurrentDownloads == ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_DOWNLOADS);
+        CHECK(config.maxConcurrentInstalledChecks == ADUC_CONFIG_DEFAULT_MAX_CONCURRENT_INSTALLED_CHECKS);
+        CHECK(config.downloadSegmentCount == ADUC_CONFIG_DEFAULT_DOWNLOAD_SEGMENT_COUNT);
+        CHECK(config.sourceUpdateCacheMaxMegabytes == ADUC_CONFIG_DEFAULT_SOURCE_UPDATE_CACHE_MAX_MEGABYTES);
+        CHECK(config.sourceUpdateCacheMinFreeMegabytes == ADUC_CONFIG_DEFAULT_SOURCE_UPDATE_CACHE_MIN_FREE_MEGABYTES);
+        CHECK(config.contentStoreMaxMegabytes == ADUC_CONFIG_DEFAULT_CONTENT_STORE_MAX_MEGABYTES);
+        CHECK_FALSE(config.enableD2COutbox);
 
         ADUC_ConfigInfo_UnInit(&config);
     }
@@ -440,6 +493,41 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "ADUC_ConfigInfo_Init Functional
         ADUC_ConfigInfo_UnInit(&config);
     }
 
+    SECTION("Valid config content, download and source update cache tuning")
+    {
+        REQUIRE(mallocAndStrcpy_s(&g_configContentString, validConfigContentDownloadTuning) == 0);
+        cstr_wrapper configStr{ g_configContentString };
+
+        ADUC_ConfigInfo config = {};
+
+        CHECK(ADUC_ConfigInfo_Init(&config, "/etc/adu/du-config.json"));
+        CHECK(config.maxConcurrentDownloads == 8);
+        CHECK(config.maxConcurrentInstalledChecks == 12);
+        CHECK(config.downloadSegmentCount == 6);
+        CHECK(config.sourceUpdateCacheMaxMegabytes == 2048);
+        CHECK(config.sourceUpdateCacheMinFreeMegabytes == 128);
+        CHECK(config.contentStoreMaxMegabytes == 0);
+        CHECK(config.enableD2COutbox);
+
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
+    SECTION("Valid config content, explicit 0 source update cache free space floor")
+    {
+        std::string content = validConfigContentDownloadTuning;
+        const std::string minFree = R"("sourceUpdateCacheMinFreeMegabytes": 128)";
+        content.replace(content.find(minFree), minFree.size(), R"("sourceUpdateCacheMinFreeMegabytes": 0)");
+        REQUIRE(mallocAndStrcpy_s(&g_configContentString, content.c_str()) == 0);
+        cstr_wrapper configStr{ g_configContentString };
+
+        ADUC_ConfigInfo config = {};
+
+        CHECK(ADUC_ConfigInfo_Init(&config, "/etc/adu/du-config.json"));
+        CHECK(config.sourceUpdateCacheMinFreeMegabytes == 0);
+
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
     SECTION("Valid config content, missing iotHubProtocol defaults to mqtt.")
     {
         REQUIRE(mallocAndStrcpy_s(&g_configContentString, validConfigContentMissingIotHubProtocol) == 0);
@@ -453,3 +541,27 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "ADUC_ConfigInfo_Init Functional
         ADUC_ConfigInfo_UnInit(&config);
     }
 }
+
+TEST_CASE("ADUC_ConfigInfo_GetInstance reads the config file once")
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast): clang-tidy can't handle the way that UMock expands macro's so we're suppressing
+    REGISTER_GLOBAL_MOCK_HOOK(Parse_JSON_File, MockParse_JSON_File_Counted);
+    REQUIRE(mallocAndStrcpy_s(&g_configContentString, validConfigContentStr) == 0);
+    cstr_wrapper configStr{ g_configContentString };
+    g_parseCount = 0;
+
+    const ADUC_ConfigInfo* first = ADUC_ConfigInfo_GetInstance();
+    REQUIRE(first != nullptr);
+    const ADUC_ConfigInfo* second = ADUC_ConfigInfo_GetInstance();
+    CHECK(second == first);
+    CHECK(g_parseCount == 1);
+    CHECK_THAT(second->manufacturer, Equals("device_info_manufacturer"));
+    CHECK_THAT(json_array_get_string(second->aduShellTrustedUsers, 1), Equals("do"));
+    ADUC_ConfigInfo_ReleaseInstance(second);
+
+    // Still valid while it is held.
+    CHECK_THAT(ADUC_ConfigInfo_GetAgent(first, 1)->name, Equals("leaf-update"));
+    ADUC_ConfigInfo_ReleaseInstance(first);
+
+    ADUC_ConfigInfo_ReleaseInstance(nullptr);
+}
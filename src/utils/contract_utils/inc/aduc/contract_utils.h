@@ -16,6 +16,9 @@
 #define ADUC_V1_CONTRACT_MAJOR_VER 1
 #define ADUC_V1_CONTRACT_MINOR_VER 0
 
+#define ADUC_V2_CONTRACT_MAJOR_VER 2
+#define ADUC_V2_CONTRACT_MINOR_VER 0
+
 typedef struct tagADUC_ExtensionContractInfo
 {
     unsigned int majorVer;
@@ -26,6 +29,8 @@ EXTERN_C_BEGIN
 
 bool ADUC_ContractUtils_IsV1Contract(ADUC_ExtensionContractInfo* contractInfo);
 
+bool ADUC_ContractUtils_IsV2Contract(ADUC_ExtensionContractInfo* contractInfo);
+
 EXTERN_C_END
 
 #endif // ADUC_CONTRACT_UTILS
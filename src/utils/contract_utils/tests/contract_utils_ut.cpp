@@ -45,3 +45,34 @@ TEST_CASE("ADUC_ContractUtils_IsV1Contract")
         CHECK(ADUC_ContractUtils_IsV1Contract(&contractInfo));
     }
 }
+
+TEST_CASE("ADUC_ContractUtils_IsV2Contract")
+{
+    SECTION("NULL contractInfo")
+    {
+        CHECK_FALSE(ADUC_ContractUtils_IsV2Contract(nullptr));
+    }
+
+    SECTION("Not 2.0")
+    {
+        ADUC_ExtensionContractInfo contractInfo{};
+        CHECK_FALSE(ADUC_ContractUtils_IsV2Contract(&contractInfo));
+
+        contractInfo.majorVer = 1;
+        contractInfo.minorVer = 0;
+        CHECK_FALSE(ADUC_ContractUtils_IsV2Contract(&contractInfo));
+
+        contractInfo.majorVer = 2;
+        contractInfo.minorVer = 1;
+        CHECK_FALSE(ADUC_ContractUtils_IsV2Contract(&contractInfo));
+    }
+
+    SECTION("Is 2.0")
+    {
+        ADUC_ExtensionContractInfo contractInfo{};
+        contractInfo.majorVer = 2;
+        contractInfo.minorVer = 0;
+
+        CHECK(ADUC_ContractUtils_IsV2Contract(&contractInfo));
+    }
+}
@@ -43,6 +43,8 @@ CryptoKeyHandle GetRootKeyForKeyID(const char* kid);
 
 void FreeCryptoKeyHandle(CryptoKeyHandle key);
 
+CryptoKeyHandle DuplicateCryptoKeyHandle(CryptoKeyHandle key);
+
 EXTERN_C_END
 
 #endif // CRYPTO_LIB_H
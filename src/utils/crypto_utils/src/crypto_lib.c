@@ -365,6 +365,23 @@ void FreeCryptoKeyHandle(CryptoKeyHandle key)
     EVP_PKEY_free(CryptoKeyHandleToEVP_PKEY(key));
 }
 
+/**
+ * @brief Returns another reference to @p key
+ * @details Both @p key and the returned key must be freed with FreeCryptoKeyHandle(). The key is not copied, so a
+ * key can be shared this way between threads that only use it to verify signatures.
+ * @param key the key
+ * @returns NULL on failure and the key on success
+ */
+CryptoKeyHandle DuplicateCryptoKeyHandle(CryptoKeyHandle key)
+{
+    if (key == NULL || EVP_PKEY_up_ref(CryptoKeyHandleToEVP_PKEY(key)) != 1)
+    {
+        return NULL;
+    }
+
+    return key;
+}
+
 /**
  * @brief Returns the master key for the provided kid
  * @details this cals into the master_key_utility to get the key
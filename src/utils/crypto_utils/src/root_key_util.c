@@ -8,6 +8,7 @@
  * Licensed under the MIT License.
  */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -176,25 +177,48 @@ static const RSARootKey RSARootKeyList[] =
 };
 // clang-format on
 
+#define RSA_ROOT_KEY_COUNT (sizeof(RSARootKeyList) / sizeof(RSARootKey))
+
+/**
+ * @brief The keys built from RSARootKeyList, by index, on first use. They are kept for the life of the process.
+ */
+static CryptoKeyHandle RSARootKeyCache[RSA_ROOT_KEY_COUNT];
+static pthread_mutex_t RSARootKeyCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @brief Helper function that returns a CryptoKeyHandle associated with the kid
- * @details The caller must free the returned Key with the FreeCryptoKeyHandle() function
+ * @details The caller must free the returned Key with the FreeCryptoKeyHandle() function.
+ * The key is built once; later calls return another reference to it.
  * @param kid the key identifier associated with the key
  * @returns the CryptoKeyHandle on success, null on failure
  */
 CryptoKeyHandle GetKeyForKid(const char* kid)
 {
+    CryptoKeyHandle key = NULL;
+
     //
     // Iterate through the RSA Root Keys
     //
-    const unsigned numberKeys = (sizeof(RSARootKeyList) / sizeof(RSARootKey));
-    for (unsigned i = 0; i < numberKeys; ++i)
+    for (unsigned i = 0; i < RSA_ROOT_KEY_COUNT; ++i)
     {
         if (strcmp(RSARootKeyList[i].kid, kid) == 0)
         {
-            return RSAKey_ObjFromStrings(RSARootKeyList[i].N, RSARootKeyList[i].e);
+            pthread_mutex_lock(&RSARootKeyCacheMutex);
+
+            if (RSARootKeyCache[i] == NULL)
+            {
+                RSARootKeyCache[i] = RSAKey_ObjFromStrings(RSARootKeyList[i].N, RSARootKeyList[i].e);
+            }
+
+            if (RSARootKeyCache[i] != NULL)
+            {
+                key = DuplicateCryptoKeyHandle(RSARootKeyCache[i]);
+            }
+
+            pthread_mutex_unlock(&RSARootKeyCacheMutex);
+            break;
         }
     }
 
-    return NULL;
+    return key;
 }
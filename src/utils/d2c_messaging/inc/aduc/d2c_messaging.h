@@ -118,6 +118,8 @@ typedef struct _tagADUC_D2C_Message
     void* cloudServiceHandle; /**< The cloud service handle. e.g. ADUC_ClientHandle */
     const char* originalContent; /**< The original content (message) */
     char* content; /**< The copy of the original content (message) */
+    char* patch; /**< The changes in content since the last acknowledged reported properties, sent instead of content.
+                      NULL to send content */
     time_t contentSubmitTime; /**< Submit time */
     ADUC_D2C_MESSAGE_HTTP_RESPONSE_CALLBACK
     responseCallback; /**< A callback that is called when received a http response from the cloud */
@@ -148,6 +150,7 @@ typedef struct _tagADUC_D2C_Message_Processing_Context
     ADUC_D2C_RetryStrategy* retryStrategy; /**< Retry strategy information */
     unsigned int retries; /**< Number of retries */
     time_t nextRetryTimeStampEpoch; /**< The next retry time stamp. This is the time since epoch, in seconds */
+    unsigned int coalescingWindowMs; /**< How long a new message waits for later ones to be merged into it (in ms) */
 } ADUC_D2C_Message_Processing_Context;
 
 /**
@@ -165,13 +168,23 @@ void ADUC_D2C_Messaging_Uninit();
 /**
  * @brief Performs messaging processing tasks.
  *
- * Note: must call this function every 100ms - 200ms to ensure that the Device to Cloud messages are processed in timely manner.
+ * Note: must call this function whenever the event loop wakes, and every 100ms - 200ms while
+ *       ADUC_D2C_Messaging_IsWaitingForResponse() returns true, to ensure that the Device to Cloud messages are
+ *       processed in timely manner.
  *
  **/
 void ADUC_D2C_Messaging_DoWork();
 
+/**
+ * @brief Gets whether a message is queued or waiting for a response from the cloud.
+ *
+ * @return Returns true if any message is queued or waiting for a response.
+ */
+bool ADUC_D2C_Messaging_IsWaitingForResponse();
+
 /**
  * @brief Submits the message to messaging utility queue. If the message for specified @p type already exist, it will be replaced by the latest message.
+ *        When both are JSON objects, the replaced message is merged into the new one, so no change is lost.
  *
  *        IMPORTANT: The implementation of @p responseCallback, @p completedCallback, and @p statusChangedCallback MUST NOT
  *        call any ADUC_D2C_* functions. Otherwise, a dead-lock may occurs.
@@ -216,6 +229,36 @@ void ADUC_D2C_Messaging_Set_Transport(ADUC_D2C_Message_Type type, ADUC_D2C_MESSA
  */
 void ADUC_D2C_Messaging_Set_Retry_Strategy(ADUC_D2C_Message_Type type, ADUC_D2C_RetryStrategy* strategy);
 
+/**
+ * @brief Sets how long a new message of the specified @p type waits before it is sent, so that messages submitted
+ *        meanwhile are merged into one twin update. By default, messages are sent as soon as possible.
+ *
+ * @param type The message type.
+ * @param windowMs The coalescing window, in milliseconds.
+ */
+void ADUC_D2C_Messaging_Set_Coalescing_Window(ADUC_D2C_Message_Type type, unsigned int windowMs);
+
+/**
+ * @brief Forgets the reported properties acknowledged so far, so that the next message of each type is sent in full.
+ *        Messages otherwise only send what changed since, which is only correct while reporting to the same twin.
+ */
+void ADUC_D2C_Messaging_Reset_Reported_Properties();
+
+/**
+ * @brief Keeps messages, and their retry state, in an append-only outbox file until they are no longer processed, so
+ *        that messages not yet delivered when the agent stops are sent by the next run. The messages a previous run
+ *        left in the file are queued again, without their callbacks and user data.
+ *
+ *        Must be called after ADUC_D2C_Messaging_Init(), before any message is sent. The outbox is closed by
+ *        ADUC_D2C_Messaging_Uninit(), which keeps the messages it cancels in the file.
+ *
+ * @param filePath The outbox file. Created if it does not exist.
+ * @param cloudServiceHandles The cloud service handle of each message type, ADUC_D2C_Message_Type_Max entries, given
+ *                            to the messages read back from the file.
+ * @return bool true if the outbox is enabled. Otherwise, messages are only kept in memory.
+ */
+bool ADUC_D2C_Messaging_Enable_Outbox(const char* filePath, void* const* cloudServiceHandles);
+
 /**
  * @brief The default message transport function.
  *
@@ -7,11 +7,15 @@
  */
 #include "aduc/d2c_messaging.h"
 #include "aduc/client_handle_helper.h"
+#include "aduc/event_loop_utils.h"
 #include "aduc/retry_utils.h"
+#include "d2c_outbox.h"
 
 #include <limits.h>
 #include <math.h>
+#include <parson.h>
 #include <stdbool.h>
+#include <stdint.h> // uint64_t
 #include <sys/param.h> // MIN/MAX
 #include <time.h> // clock_gettime
 #include <unistd.h>
@@ -23,12 +27,24 @@
 #define FATAL_ERROR_WAIT_TIME_SEC 10 // 10 seconds
 #define ONE_DAY_IN_SECONDS (1 * 24 * 60 * 60)
 
+/**
+ * @brief The member IoT Plug and Play adds to an object to mark it as a component.
+ */
+#define PNP_COMPONENT_MARKER "__t"
+
 static pthread_mutex_t s_pendingMessageStoreMutex = PTHREAD_MUTEX_INITIALIZER;
 static bool s_core_initialized = false;
 
 static ADUC_D2C_Message s_pendingMessageStore[ADUC_D2C_Message_Type_Max] = {};
 static ADUC_D2C_Message_Processing_Context s_messageProcessingContext[ADUC_D2C_Message_Type_Max] = {};
 
+// When the message in s_pendingMessageStore was first submitted, before any message replaced it (monotonic, in ms).
+static uint64_t s_pendingMessageSubmitTimeMs[ADUC_D2C_Message_Type_Max] = {};
+
+// The reported properties of all message types, as acknowledged by the cloud.
+static pthread_mutex_t s_reportedPropertiesMutex = PTHREAD_MUTEX_INITIALIZER;
+static JSON_Value* s_reportedProperties = NULL;
+
 static void ProcessMessage(ADUC_D2C_Message_Processing_Context* context);
 
 static time_t GetTimeSinceEpochInSeconds()
@@ -132,9 +148,275 @@ static void DestroyMessageData(ADUC_D2C_Message* message)
         return;
     }
     free(message->content);
+    free(message->patch);
     memset(message, 0, sizeof(ADUC_D2C_Message));
 }
 
+/**
+ * @brief Gets the monotonic time, in milliseconds.
+ */
+static uint64_t GetMonotonicTimeInMilliseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Merges @p patch into @p target, the way the IoT Hub merges a reported properties update into the twin.
+ *
+ * @param target The object to update.
+ * @param patch The reported properties update.
+ * @param keepNulls When false, a null member removes the member from @p target, as it does from the twin.
+ *                  When true, nulls are copied, so that @p target becomes one update equivalent to two.
+ * @return bool Returns false if out of memory, or if @p keepNulls is true and the two updates cannot be expressed
+ *              as one, because the first removes an object the second then sets members of.
+ */
+static bool MergeReportedProperties(JSON_Object* target, const JSON_Object* patch, bool keepNulls)
+{
+    const size_t count = json_object_get_count(patch);
+    for (size_t i = 0; i < count; i++)
+    {
+        const char* name = json_object_get_name(patch, i);
+        JSON_Value* value = json_object_get_value_at(patch, i);
+        JSON_Value* targetValue = json_object_get_value(target, name);
+
+        if (json_value_get_type(value) == JSONObject)
+        {
+            if (keepNulls && json_value_get_type(targetValue) == JSONNull)
+            {
+                return false;
+            }
+
+            if (json_value_get_type(targetValue) != JSONObject)
+            {
+                targetValue = json_value_init_object();
+                if (targetValue == NULL || json_object_set_value(target, name, targetValue) != JSONSuccess)
+                {
+                    json_value_free(targetValue);
+                    return false;
+                }
+            }
+
+            if (!MergeReportedProperties(json_value_get_object(targetValue), json_value_get_object(value), keepNulls))
+            {
+                return false;
+            }
+        }
+        else if (json_value_get_type(value) == JSONNull && !keepNulls)
+        {
+            json_object_remove(target, name);
+        }
+        else
+        {
+            JSON_Value* copy = json_value_deep_copy(value);
+            if (copy == NULL || json_object_set_value(target, name, copy) != JSONSuccess)
+            {
+                json_value_free(copy);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Creates the smallest reported properties update that changes @p reported the way @p content does.
+ *
+ * @param reported The reported properties the cloud has acknowledged. May be NULL.
+ * @param content The reported properties update to be sent.
+ * @return JSON_Value* An object holding each member of @p content whose value differs from @p reported, recursing
+ *         into objects. NULL if out of memory. Caller must call json_value_free().
+ */
+static JSON_Value* CreateReportedPropertiesPatch(const JSON_Object* reported, const JSON_Object* content)
+{
+    JSON_Value* patchValue = json_value_init_object();
+    JSON_Object* patch = json_value_get_object(patchValue);
+    if (patch == NULL)
+    {
+        goto fail;
+    }
+
+    const size_t count = json_object_get_count(content);
+    for (size_t i = 0; i < count; i++)
+    {
+        const char* name = json_object_get_name(content, i);
+        JSON_Value* value = json_object_get_value_at(content, i);
+        JSON_Value* reportedValue = reported == NULL ? NULL : json_object_get_value(reported, name);
+        JSON_Value* change = NULL;
+
+        if (json_value_get_type(value) == JSONObject && json_value_get_type(reportedValue) == JSONObject)
+        {
+            change = CreateReportedPropertiesPatch(json_value_get_object(reportedValue), json_value_get_object(value));
+            if (change == NULL)
+            {
+                goto fail;
+            }
+
+            JSON_Object* changeObject = json_value_get_object(change);
+            if (json_object_get_count(changeObject) == 0)
+            {
+                json_value_free(change);
+                continue;
+            }
+
+            // A component update must keep its marker, even though the marker itself never changes.
+            JSON_Value* marker = json_object_get_value(json_value_get_object(value), PNP_COMPONENT_MARKER);
+            if (marker != NULL
+                && json_object_set_value(changeObject, PNP_COMPONENT_MARKER, json_value_deep_copy(marker))
+                    != JSONSuccess)
+            {
+                json_value_free(change);
+                goto fail;
+            }
+        }
+        else if (
+            reportedValue == NULL ? json_value_get_type(value) == JSONNull : json_value_equals(reportedValue, value))
+        {
+            // Already reported, or removing a property that is not there.
+            continue;
+        }
+        else
+        {
+            change = json_value_deep_copy(value);
+        }
+
+        if (change == NULL || json_object_set_value(patch, name, change) != JSONSuccess)
+        {
+            json_value_free(change);
+            goto fail;
+        }
+    }
+
+    return patchValue;
+
+fail:
+    json_value_free(patchValue);
+    return NULL;
+}
+
+/**
+ * @brief Merges @p content, a message about to be replaced, into @p newContent, the message replacing it.
+ *
+ * @return char* The merged content. NULL if either is not a JSON object or they cannot be merged, in which case the
+ *         replaced message is dropped as is. Caller must call free().
+ */
+static char* CoalesceMessageContent(const char* content, const char* newContent)
+{
+    char* coalesced = NULL;
+    JSON_Value* value = json_parse_string(content);
+    JSON_Value* newValue = json_parse_string(newContent);
+
+    if (json_value_get_type(value) != JSONObject || json_value_get_type(newValue) != JSONObject)
+    {
+        goto done;
+    }
+
+    if (!MergeReportedProperties(json_value_get_object(value), json_value_get_object(newValue), true /* keepNulls */))
+    {
+        Log_Debug("Cannot merge D2C message into its replacement.");
+        goto done;
+    }
+
+    char* serialized = json_serialize_to_string(value);
+    if (serialized != NULL)
+    {
+        mallocAndStrcpy_s(&coalesced, serialized);
+        json_free_serialized_string(serialized);
+    }
+
+done:
+    json_value_free(value);
+    json_value_free(newValue);
+    return coalesced;
+}
+
+/**
+ * @brief Replaces @p message patch with the changes in its content since the last acknowledged reported properties.
+ *
+ * @param message The message about to be sent.
+ * @return bool Returns false if the content changes nothing, so the message need not be sent.
+ */
+static bool UpdateMessagePatch(ADUC_D2C_Message* message)
+{
+    bool changed = true;
+    JSON_Value* contentValue = json_parse_string(message->content);
+    JSON_Value* patchValue = NULL;
+    char* serialized = NULL;
+
+    free(message->patch);
+    message->patch = NULL;
+
+    // Content that is not a JSON object is sent as is.
+    if (json_value_get_type(contentValue) != JSONObject)
+    {
+        goto done;
+    }
+
+    pthread_mutex_lock(&s_reportedPropertiesMutex);
+    patchValue = CreateReportedPropertiesPatch(
+        json_value_get_object(s_reportedProperties), json_value_get_object(contentValue));
+    pthread_mutex_unlock(&s_reportedPropertiesMutex);
+
+    if (patchValue == NULL)
+    {
+        goto done;
+    }
+
+    if (json_object_get_count(json_value_get_object(patchValue)) == 0)
+    {
+        changed = false;
+        goto done;
+    }
+
+    serialized = json_serialize_to_string(patchValue);
+    if (serialized != NULL && strlen(serialized) < strlen(message->content))
+    {
+        mallocAndStrcpy_s(&message->patch, serialized);
+    }
+
+done:
+    json_free_serialized_string(serialized);
+    json_value_free(patchValue);
+    json_value_free(contentValue);
+    return changed;
+}
+
+/**
+ * @brief Records that the cloud has acknowledged @p content, so later messages need only send what differs from it.
+ *
+ * @param content The acknowledged message content.
+ */
+static void OnReportedPropertiesAcknowledged(const char* content)
+{
+    JSON_Value* contentValue = json_parse_string(content);
+    if (json_value_get_type(contentValue) != JSONObject)
+    {
+        json_value_free(contentValue);
+        return;
+    }
+
+    pthread_mutex_lock(&s_reportedPropertiesMutex);
+    if (s_reportedProperties == NULL)
+    {
+        s_reportedProperties = json_value_init_object();
+    }
+
+    if (s_reportedProperties != NULL
+        && !MergeReportedProperties(
+            json_value_get_object(s_reportedProperties), json_value_get_object(contentValue), false /* keepNulls */))
+    {
+        // Without a faithful copy of the reported properties, later messages must be sent in full.
+        Log_Warn("Failed to record acknowledged reported properties.");
+        json_value_free(s_reportedProperties);
+        s_reportedProperties = NULL;
+    }
+    pthread_mutex_unlock(&s_reportedPropertiesMutex);
+
+    json_value_free(contentValue);
+}
+
 /**
  * @brief Set the message status, then call the message.statusChangedCallback (if supplied).
  *
@@ -225,6 +507,10 @@ static void DefaultIoTHubSendReportedStateCompletedCallback(int http_status_code
             message_processing_context->type,
             message_processing_context->retries,
             message_processing_context->message.content);
+        if (http_status_code >= 200 && http_status_code < 300)
+        {
+            OnReportedPropertiesAcknowledged(message_processing_context->message.content);
+        }
         OnMessageProcessingCompleted(&message_processing_context->message, ADUC_D2C_Message_Status_Success);
         goto done;
     }
@@ -306,16 +592,61 @@ done:
 /**
  * @brief Performs messages processing tasks.
  *
- * Note: must call this function every 100ms - 200ms to ensure that the Device to Cloud messages
+ * Note: must call this function whenever the event loop wakes, and every 100ms - 200ms while
+ *       ADUC_D2C_Messaging_IsWaitingForResponse() returns true, to ensure that the Device to Cloud messages
  *       are processed in timely manner.
+ *       New messages signal the event loop, and the earliest retry time is set as its wakeup time.
  *
  **/
 void ADUC_D2C_Messaging_DoWork()
 {
+    time_t nextRetryTimeStampEpoch = 0;
+
     for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
     {
-        ProcessMessage(&s_messageProcessingContext[i]);
+        ADUC_D2C_Message_Processing_Context* context = &s_messageProcessingContext[i];
+        ProcessMessage(context);
+
+        pthread_mutex_lock(&context->mutex);
+        ADUC_D2C_Outbox_Update_Active(
+            context->type, context->message.content != NULL, context->retries, context->nextRetryTimeStampEpoch);
+
+        if (context->message.content != NULL && context->message.status == ADUC_D2C_Message_Status_In_Progress
+            && (nextRetryTimeStampEpoch == 0 || context->nextRetryTimeStampEpoch < nextRetryTimeStampEpoch))
+        {
+            nextRetryTimeStampEpoch = context->nextRetryTimeStampEpoch;
+        }
+        pthread_mutex_unlock(&context->mutex);
     }
+
+    ADUC_EventLoop_SetWakeupTime(nextRetryTimeStampEpoch);
+
+    // One sync covers every message that changed in this pass.
+    ADUC_D2C_Outbox_Flush();
+}
+
+/**
+ * @brief Gets whether a message is queued or waiting for a response from the cloud.
+ *
+ * @remark Responses are received by the cloud service client's DoWork, so the caller must keep calling it regularly
+ *         while this returns true.
+ *
+ * @return Returns true if any message is queued or waiting for a response.
+ */
+bool ADUC_D2C_Messaging_IsWaitingForResponse()
+{
+    bool waiting = false;
+    pthread_mutex_lock(&s_pendingMessageStoreMutex);
+    for (int i = 0; s_core_initialized && i < ADUC_D2C_Message_Type_Max && !waiting; i++)
+    {
+        pthread_mutex_lock(&s_messageProcessingContext[i].mutex);
+        waiting = s_pendingMessageStore[i].content != NULL
+            || (s_messageProcessingContext[i].message.content != NULL
+                && s_messageProcessingContext[i].message.status == ADUC_D2C_Message_Status_Waiting_For_Response);
+        pthread_mutex_unlock(&s_messageProcessingContext[i].mutex);
+    }
+    pthread_mutex_unlock(&s_pendingMessageStoreMutex);
+    return waiting;
 }
 
 static void ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processing_context)
@@ -325,14 +656,33 @@ static void ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processi
     pthread_mutex_lock(&s_pendingMessageStoreMutex);
     pthread_mutex_lock(&message_processing_context->mutex);
 
-    if (s_pendingMessageStore[message_processing_context->type].content != NULL)
+    ADUC_D2C_Message* pendingMessage = &s_pendingMessageStore[message_processing_context->type];
+
+    if (pendingMessage->content != NULL)
     {
+        if (message_processing_context->message.content != NULL
+            && message_processing_context->message.status == ADUC_D2C_Message_Status_Waiting_For_Response)
+        {
+            // Let's wait to see what the response is.
+            goto done;
+        }
+
+        if (GetMonotonicTimeInMilliseconds() - s_pendingMessageSubmitTimeMs[message_processing_context->type]
+            < message_processing_context->coalescingWindowMs)
+        {
+            // Give later messages a chance to be merged into this one.
+            goto done;
+        }
+
         if (message_processing_context->message.content != NULL)
         {
-            if (message_processing_context->message.status == ADUC_D2C_Message_Status_Waiting_For_Response)
+            // The old message was not acknowledged, so carry its changes over to the new one.
+            char* coalesced =
+                CoalesceMessageContent(message_processing_context->message.content, pendingMessage->content);
+            if (coalesced != NULL)
             {
-                // Let's wait to see what the response is.
-                goto done;
+                free(pendingMessage->content);
+                pendingMessage->content = coalesced;
             }
 
             // Discard old message.
@@ -354,6 +704,16 @@ static void ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processi
         memset(&s_pendingMessageStore[message_processing_context->type], 0, sizeof(ADUC_D2C_Message));
         shouldSend = message_processing_context->message.content != NULL;
 
+        if (shouldSend)
+        {
+            ADUC_D2C_Outbox_Put_Active(
+                message_processing_context->type,
+                message_processing_context->message.content,
+                message_processing_context->message.contentSubmitTime,
+                message_processing_context->retries,
+                message_processing_context->nextRetryTimeStampEpoch);
+        }
+
         SetMessageStatus(&message_processing_context->message, ADUC_D2C_Message_Status_In_Progress);
     }
     else if (
@@ -374,13 +734,21 @@ static void ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processi
                 message_processing_context->type);
             message_processing_context->nextRetryTimeStampEpoch += FATAL_ERROR_WAIT_TIME_SEC;
         }
+        else if (!UpdateMessagePatch(&message_processing_context->message))
+        {
+            // The cloud has already acknowledged every property in the message.
+            Log_Debug(
+                "D2C message changes no reported property. Not sending. (t:%d)", message_processing_context->type);
+            OnMessageProcessingCompleted(&message_processing_context->message, ADUC_D2C_Message_Status_Success);
+        }
         else
         {
             message_processing_context->message.attempts++;
             Log_Debug(
-                "Sending D2C message (t:%d, retries:%d).",
+                "Sending D2C message (t:%d, retries:%d, patch:%d).",
                 message_processing_context->type,
-                message_processing_context->retries);
+                message_processing_context->retries,
+                message_processing_context->message.patch != NULL);
             if (message_processing_context->transportFunc(
                     message_processing_context->message.cloudServiceHandle,
                     message_processing_context,
@@ -445,6 +813,9 @@ void ADUC_D2C_Messaging_Uninit()
     pthread_mutex_lock(&s_pendingMessageStoreMutex);
     if (s_core_initialized)
     {
+        // Close the outbox first, so that the messages canceled below are kept in it for the next run.
+        ADUC_D2C_Outbox_Close();
+
         // Cancel pending messages
         for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
         {
@@ -462,6 +833,7 @@ void ADUC_D2C_Messaging_Uninit()
             pthread_mutex_destroy(&s_messageProcessingContext[i].mutex);
             s_messageProcessingContext[i].initialized = false;
         }
+        ADUC_D2C_Messaging_Reset_Reported_Properties();
         s_core_initialized = false;
     }
     pthread_mutex_unlock(&s_pendingMessageStoreMutex);
@@ -469,6 +841,7 @@ void ADUC_D2C_Messaging_Uninit()
 
 /**
  * @brief Submits the message to pending messages store. If the message for specified @p type already exist, it will be replaced by the new message.
+ *        When both are JSON objects, the replaced message is merged into the new one, so no change is lost.
  *
  * @param type The message type.
  * @param cloudServiceHandle An opaque pointer to the underlying cloud service handle.
@@ -504,13 +877,22 @@ bool ADUC_D2C_Message_SendAsync(
     pthread_mutex_lock(&s_pendingMessageStoreMutex);
 
     // Replace pending message if exist.
-    if (s_pendingMessageStore[type].content != NULL)
+    if (s_pendingMessageStore[type].content == NULL)
+    {
+        s_pendingMessageSubmitTimeMs[type] = GetMonotonicTimeInMilliseconds();
+    }
+    else
     {
-        if (s_pendingMessageStore[type].completedCallback != NULL)
+        char* coalesced = CoalesceMessageContent(s_pendingMessageStore[type].content, messageToSend);
+        if (coalesced != NULL)
         {
-            Log_Debug("Replacing existing pending message. (t:%d, s:%s)", type, s_pendingMessageStore[type].content);
-            OnMessageProcessingCompleted(&s_pendingMessageStore[type], ADUC_D2C_Message_Status_Replaced);
+            free(messageToSend);
+            messageToSend = coalesced;
         }
+
+        // Free the replaced message even if it has no completedCallback, e.g. one read back from the outbox.
+        Log_Debug("Replacing existing pending message. (t:%d, s:%s)", type, s_pendingMessageStore[type].content);
+        OnMessageProcessingCompleted(&s_pendingMessageStore[type], ADUC_D2C_Message_Status_Replaced);
     }
 
     Log_Debug("Queueing message (t:%d, c:0x%x, m:%s)", type, message, message);
@@ -524,7 +906,11 @@ bool ADUC_D2C_Message_SendAsync(
     s_pendingMessageStore[type].contentSubmitTime = GetTimeSinceEpochInSeconds();
     s_pendingMessageStore[type].userData = userData;
     SetMessageStatus(&s_pendingMessageStore[type], ADUC_D2C_Message_Status_Pending);
+    ADUC_D2C_Outbox_Put_Pending(type, messageToSend, s_pendingMessageStore[type].contentSubmitTime);
     pthread_mutex_unlock(&s_pendingMessageStoreMutex);
+
+    // Wake the main loop, so the message is sent now rather than on its next poll.
+    ADUC_EventLoop_Signal();
     return true;
 }
 
@@ -564,13 +950,16 @@ int ADUC_D2C_Default_Message_Transport_Function(
     }
     else
     {
-        // Send content.
-        Log_Debug("Sending D2C message:\n%s", (const char*)message_processing_context->message.content);
+        // Send content, or only what changed in it if possible.
+        const char* content = message_processing_context->message.patch != NULL
+            ? message_processing_context->message.patch
+            : message_processing_context->message.content;
+        Log_Debug("Sending D2C message:\n%s", content);
 
         IOTHUB_CLIENT_RESULT iotHubClientResult = (IOTHUB_CLIENT_RESULT)ClientHandle_SendReportedState(
             *((ADUC_ClientHandle*)message_processing_context->message.cloudServiceHandle),
-            (const unsigned char*)message_processing_context->message.content,
-            strlen(message_processing_context->message.content),
+            (const unsigned char*)content,
+            strlen(content),
             c2dResponseHandlerFunc,
             message_processing_context);
 
@@ -600,3 +989,115 @@ void ADUC_D2C_Messaging_Set_Retry_Strategy(ADUC_D2C_Message_Type type, ADUC_D2C_
     s_messageProcessingContext[type].retryStrategy = strategy;
     pthread_mutex_unlock(&s_messageProcessingContext[type].mutex);
 }
+
+/**
+ * @brief Sets how long a new message of the specified @p type waits before it is sent, so that messages submitted
+ *        meanwhile are merged into one twin update.
+ *
+ * @param type The message type.
+ * @param windowMs The coalescing window, in milliseconds.
+ */
+void ADUC_D2C_Messaging_Set_Coalescing_Window(ADUC_D2C_Message_Type type, unsigned int windowMs)
+{
+    pthread_mutex_lock(&s_messageProcessingContext[type].mutex);
+    s_messageProcessingContext[type].coalescingWindowMs = windowMs;
+    pthread_mutex_unlock(&s_messageProcessingContext[type].mutex);
+}
+
+/**
+ * @brief Forgets the reported properties acknowledged so far, so that the next message of each type is sent in full.
+ */
+void ADUC_D2C_Messaging_Reset_Reported_Properties()
+{
+    pthread_mutex_lock(&s_reportedPropertiesMutex);
+    json_value_free(s_reportedProperties);
+    s_reportedProperties = NULL;
+    pthread_mutex_unlock(&s_reportedPropertiesMutex);
+}
+
+/**
+ * @brief Keeps messages, and their retry state, in an outbox file until they are no longer processed, and queues
+ *        the messages a previous run left in it.
+ *
+ * @param filePath The outbox file.
+ * @param cloudServiceHandles The cloud service handle of each message type, given to the messages read back.
+ * @return bool true if the outbox is enabled.
+ */
+bool ADUC_D2C_Messaging_Enable_Outbox(const char* filePath, void* const* cloudServiceHandles)
+{
+    bool success = false;
+    ADUC_D2C_Outbox_Entry entries[ADUC_D2C_Message_Type_Max] = {};
+    const time_t now = GetTimeSinceEpochInSeconds();
+    int replayed = 0;
+
+    pthread_mutex_lock(&s_pendingMessageStoreMutex);
+
+    if (!s_core_initialized)
+    {
+        Log_Error("D2C messaging is not initialized.");
+        goto done;
+    }
+
+    for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+    {
+        if (s_pendingMessageStore[i].content != NULL || s_messageProcessingContext[i].message.content != NULL)
+        {
+            Log_Error("The D2C outbox must be enabled before any message is sent.");
+            goto done;
+        }
+    }
+
+    if (!ADUC_D2C_Outbox_Open(filePath, entries))
+    {
+        goto done;
+    }
+
+    for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+    {
+        ADUC_D2C_Message_Processing_Context* context = &s_messageProcessingContext[i];
+        pthread_mutex_lock(&context->mutex);
+
+        if (entries[i].active.content != NULL)
+        {
+            // Resume the retries where the previous run left them, but not later than the longest retry delay, in
+            // case the clock changed meanwhile.
+            memset(&context->message, 0, sizeof(context->message));
+            context->message.cloudServiceHandle = cloudServiceHandles[i];
+            context->message.content = entries[i].active.content;
+            context->message.contentSubmitTime = entries[i].active.contentSubmitTime;
+            context->retries = entries[i].active.retries;
+            context->nextRetryTimeStampEpoch =
+                MIN(entries[i].active.nextRetryTimeStampEpoch, now + (time_t)context->retryStrategy->maxDelaySecs);
+            entries[i].active.content = NULL;
+            SetMessageStatus(&context->message, ADUC_D2C_Message_Status_In_Progress);
+            replayed++;
+        }
+
+        if (entries[i].pending.content != NULL)
+        {
+            memset(&s_pendingMessageStore[i], 0, sizeof(s_pendingMessageStore[i]));
+            s_pendingMessageStore[i].cloudServiceHandle = cloudServiceHandles[i];
+            s_pendingMessageStore[i].content = entries[i].pending.content;
+            s_pendingMessageStore[i].contentSubmitTime = entries[i].pending.contentSubmitTime;
+            s_pendingMessageSubmitTimeMs[i] = GetMonotonicTimeInMilliseconds();
+            entries[i].pending.content = NULL;
+            SetMessageStatus(&s_pendingMessageStore[i], ADUC_D2C_Message_Status_Pending);
+            replayed++;
+        }
+
+        pthread_mutex_unlock(&context->mutex);
+    }
+
+    Log_Info("D2C outbox enabled (%s). %d message(s) carried over from the previous run.", filePath, replayed);
+    success = true;
+
+done:
+    pthread_mutex_unlock(&s_pendingMessageStoreMutex);
+    ADUC_D2C_Outbox_Entries_Uninit(entries);
+
+    if (replayed > 0)
+    {
+        ADUC_EventLoop_Signal();
+    }
+    return success;
+}
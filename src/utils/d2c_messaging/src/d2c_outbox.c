@@ -0,0 +1,767 @@
+/**
+ * @file d2c_outbox.c
+ * @brief Implements the on-disk outbox that keeps Device-to-Cloud messages across agent restarts.
+ *
+ * The outbox file starts with OUTBOX_FILE_MAGIC, followed by an append-only log of records:
+ *
+ *     uint32 crc32 | uint32 payload size | uint8 kind | uint8 message type | uint16 reserved | payload
+ *
+ * The checksum covers everything after it. Numbers are in host byte order, as the file never leaves the device.
+ *
+ * Records are written as messages change, so they survive the agent process ending at any point, and are synced to
+ * disk once per ADUC_D2C_Outbox_Flush(), i.e. once per pass of the main loop. A record torn by a crash fails its
+ * checksum, and it and anything after it are dropped when the outbox is read back. Once the log has grown past
+ * OUTBOX_COMPACTION_THRESHOLD_BYTES, it is rewritten with only the messages still held, and atomically replaces
+ * the old file.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "d2c_outbox.h"
+#include "aduc/logging.h"
+
+#include <azure_c_shared_utility/crt_abstractions.h> // mallocAndStrcpy_s
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h> // dirname
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h> // snprintf
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OUTBOX_FILE_MAGIC "ADUD2CO1"
+#define OUTBOX_FILE_MAGIC_SIZE (sizeof(OUTBOX_FILE_MAGIC) - 1)
+#define OUTBOX_RECORD_HEADER_SIZE 12
+#define OUTBOX_COMPACTION_THRESHOLD_BYTES (64 * 1024)
+
+//
+// Record kinds, and their payloads.
+//
+#define OUTBOX_RECORD_PENDING 'P' // A message was queued: int64 submit time, content.
+#define OUTBOX_RECORD_ACTIVE 'A' // A message replaced the active one: int64 submit time, uint32 retries,
+                                 // int64 next retry, content.
+#define OUTBOX_RECORD_ACTIVATE 'M' // The pending message replaced the active one: uint32 retries, int64 next retry.
+#define OUTBOX_RECORD_RETRY 'R' // The retry state of the active message changed: uint32 retries, int64 next retry.
+#define OUTBOX_RECORD_DONE 'D' // The active message is no longer processed. No payload.
+
+/**
+ * @brief A growable byte buffer that records are encoded into.
+ */
+typedef struct tagOutboxBuffer
+{
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    bool failed; /**< Set when an allocation failed */
+} OutboxBuffer;
+
+static pthread_mutex_t s_outboxMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_outboxFd = -1;
+static char* s_outboxFilePath = NULL;
+static size_t s_outboxFileSize = 0;
+static bool s_outboxUnsynced = false;
+
+// The messages held by the outbox file, kept in step with it to be written out by compaction.
+static ADUC_D2C_Outbox_Entry s_outboxEntries[ADUC_D2C_Message_Type_Max] = {};
+
+static uint32_t Crc32(const uint8_t* data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void Buffer_Append(OutboxBuffer* buffer, const void* data, size_t size)
+{
+    if (buffer->failed)
+    {
+        return;
+    }
+
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity == 0 ? 256 : buffer->capacity;
+        while (capacity < buffer->size + size)
+        {
+            capacity *= 2;
+        }
+
+        uint8_t* grown = realloc(buffer->data, capacity);
+        if (grown == NULL)
+        {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static void Buffer_AppendUInt32(OutboxBuffer* buffer, uint32_t value)
+{
+    Buffer_Append(buffer, &value, sizeof(value));
+}
+
+static void Buffer_AppendInt64(OutboxBuffer* buffer, int64_t value)
+{
+    Buffer_Append(buffer, &value, sizeof(value));
+}
+
+/**
+ * @brief Appends a record of @p kind to @p buffer, with the fields of @p message that kind carries.
+ */
+static void AppendRecord(
+    OutboxBuffer* buffer, char kind, ADUC_D2C_Message_Type type, const ADUC_D2C_Outbox_Message* message)
+{
+    const size_t start = buffer->size;
+    const uint8_t header[OUTBOX_RECORD_HEADER_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 0, (uint8_t)kind, (uint8_t)type, 0, 0 };
+    Buffer_Append(buffer, header, sizeof(header));
+
+    switch (kind)
+    {
+    case OUTBOX_RECORD_PENDING:
+        Buffer_AppendInt64(buffer, message->contentSubmitTime);
+        Buffer_Append(buffer, message->content, strlen(message->content));
+        break;
+
+    case OUTBOX_RECORD_ACTIVE:
+        Buffer_AppendInt64(buffer, message->contentSubmitTime);
+        Buffer_AppendUInt32(buffer, message->retries);
+        Buffer_AppendInt64(buffer, message->nextRetryTimeStampEpoch);
+        Buffer_Append(buffer, message->content, strlen(message->content));
+        break;
+
+    case OUTBOX_RECORD_ACTIVATE:
+    case OUTBOX_RECORD_RETRY:
+        Buffer_AppendUInt32(buffer, message->retries);
+        Buffer_AppendInt64(buffer, message->nextRetryTimeStampEpoch);
+        break;
+
+    default:
+        break;
+    }
+
+    if (!buffer->failed)
+    {
+        const uint32_t payloadSize = (uint32_t)(buffer->size - start - OUTBOX_RECORD_HEADER_SIZE);
+        memcpy(buffer->data + start + 4, &payloadSize, sizeof(payloadSize));
+        const uint32_t crc = Crc32(buffer->data + start + 4, buffer->size - start - 4);
+        memcpy(buffer->data + start, &crc, sizeof(crc));
+    }
+}
+
+static void OutboxMessage_Uninit(ADUC_D2C_Outbox_Message* message)
+{
+    free(message->content);
+    memset(message, 0, sizeof(*message));
+}
+
+/**
+ * @brief Reads a message content of @p size bytes that are not NUL terminated.
+ */
+static char* CopyContent(const uint8_t* data, size_t size)
+{
+    char* content = malloc(size + 1);
+    if (content != NULL)
+    {
+        memcpy(content, data, size);
+        content[size] = '\0';
+    }
+    return content;
+}
+
+/**
+ * @brief Applies a record to @p entries.
+ *
+ * @return bool false if the record is not valid, or out of memory.
+ */
+static bool ApplyRecord(ADUC_D2C_Outbox_Entry* entries, char kind, uint8_t type, const uint8_t* payload, size_t size)
+{
+    const size_t timeSize = sizeof(int64_t);
+    const size_t retryStateSize = sizeof(uint32_t) + sizeof(int64_t);
+    int64_t time = 0;
+    uint32_t retries = 0;
+    int64_t nextRetry = 0;
+
+    if (type >= ADUC_D2C_Message_Type_Max)
+    {
+        return false;
+    }
+
+    ADUC_D2C_Outbox_Entry* entry = &entries[type];
+
+    switch (kind)
+    {
+    case OUTBOX_RECORD_PENDING:
+    {
+        if (size < timeSize)
+        {
+            return false;
+        }
+
+        char* content = CopyContent(payload + timeSize, size - timeSize);
+        if (content == NULL)
+        {
+            return false;
+        }
+
+        memcpy(&time, payload, sizeof(time));
+        OutboxMessage_Uninit(&entry->pending);
+        entry->pending.content = content;
+        entry->pending.contentSubmitTime = (time_t)time;
+        return true;
+    }
+
+    case OUTBOX_RECORD_ACTIVE:
+    {
+        if (size < timeSize + retryStateSize)
+        {
+            return false;
+        }
+
+        char* content = CopyContent(payload + timeSize + retryStateSize, size - timeSize - retryStateSize);
+        if (content == NULL)
+        {
+            return false;
+        }
+
+        memcpy(&time, payload, sizeof(time));
+        memcpy(&retries, payload + timeSize, sizeof(retries));
+        memcpy(&nextRetry, payload + timeSize + sizeof(retries), sizeof(nextRetry));
+        OutboxMessage_Uninit(&entry->active);
+        OutboxMessage_Uninit(&entry->pending);
+        entry->active.content = content;
+        entry->active.contentSubmitTime = (time_t)time;
+        entry->active.retries = retries;
+        entry->active.nextRetryTimeStampEpoch = (time_t)nextRetry;
+        return true;
+    }
+
+    case OUTBOX_RECORD_ACTIVATE:
+    case OUTBOX_RECORD_RETRY:
+        if (size != retryStateSize)
+        {
+            return false;
+        }
+
+        memcpy(&retries, payload, sizeof(retries));
+        memcpy(&nextRetry, payload + sizeof(retries), sizeof(nextRetry));
+
+        if (kind == OUTBOX_RECORD_ACTIVATE)
+        {
+            if (entry->pending.content == NULL)
+            {
+                return false;
+            }
+
+            OutboxMessage_Uninit(&entry->active);
+            entry->active = entry->pending;
+            memset(&entry->pending, 0, sizeof(entry->pending));
+        }
+
+        if (entry->active.content != NULL)
+        {
+            entry->active.retries = retries;
+            entry->active.nextRetryTimeStampEpoch = (time_t)nextRetry;
+        }
+        return true;
+
+    case OUTBOX_RECORD_DONE:
+        OutboxMessage_Uninit(&entry->active);
+        return size == 0;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Applies the records in @p data, the contents of an outbox file, to @p entries, up to the first record that is
+ * torn or corrupt.
+ */
+static void ReplayRecords(ADUC_D2C_Outbox_Entry* entries, const uint8_t* data, size_t size)
+{
+    size_t offset = OUTBOX_FILE_MAGIC_SIZE;
+    unsigned int records = 0;
+
+    if (size == 0)
+    {
+        return;
+    }
+
+    if (size < OUTBOX_FILE_MAGIC_SIZE || memcmp(data, OUTBOX_FILE_MAGIC, OUTBOX_FILE_MAGIC_SIZE) != 0)
+    {
+        Log_Warn("Unknown D2C outbox file format. Discarding %zu bytes.", size);
+        return;
+    }
+
+    while (size - offset >= OUTBOX_RECORD_HEADER_SIZE)
+    {
+        uint32_t crc = 0;
+        uint32_t payloadSize = 0;
+        memcpy(&crc, data + offset, sizeof(crc));
+        memcpy(&payloadSize, data + offset + 4, sizeof(payloadSize));
+
+        if (payloadSize > size - offset - OUTBOX_RECORD_HEADER_SIZE
+            || Crc32(data + offset + 4, OUTBOX_RECORD_HEADER_SIZE - 4 + payloadSize) != crc
+            || !ApplyRecord(
+                entries,
+                (char)data[offset + 8],
+                data[offset + 9],
+                data + offset + OUTBOX_RECORD_HEADER_SIZE,
+                payloadSize))
+        {
+            break;
+        }
+
+        offset += OUTBOX_RECORD_HEADER_SIZE + payloadSize;
+        records++;
+    }
+
+    Log_Info("Read %u record(s) from the D2C outbox.", records);
+
+    if (offset != size)
+    {
+        Log_Warn("Dropping %zu byte(s) of torn or corrupt records at the end of the D2C outbox.", size - offset);
+    }
+}
+
+static bool WriteAll(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the whole file at @p filePath. A file that does not exist reads as empty.
+ */
+static bool ReadOutboxFile(const char* filePath, uint8_t** outData, size_t* outSize)
+{
+    bool success = false;
+    uint8_t* data = NULL;
+    size_t size = 0;
+    struct stat st;
+
+    const int fd = open(filePath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        success = (errno == ENOENT);
+        if (!success)
+        {
+            Log_Error("Cannot open D2C outbox %s (errno:%d)", filePath, errno);
+        }
+        goto done;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        Log_Error("Cannot stat D2C outbox %s (errno:%d)", filePath, errno);
+        goto done;
+    }
+
+    data = malloc((size_t)st.st_size + 1);
+    if (data == NULL)
+    {
+        goto done;
+    }
+
+    while (size < (size_t)st.st_size)
+    {
+        const ssize_t bytesRead = read(fd, data + size, (size_t)st.st_size - size);
+        if (bytesRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesRead <= 0)
+        {
+            break;
+        }
+        size += (size_t)bytesRead;
+    }
+
+    success = true;
+
+done:
+    if (fd != -1)
+    {
+        close(fd);
+    }
+
+    if (!success)
+    {
+        free(data);
+        data = NULL;
+        size = 0;
+    }
+
+    *outData = data;
+    *outSize = size;
+    return success;
+}
+
+/**
+ * @brief Syncs the directory holding @p filePath, so that a rename into it survives a power loss.
+ */
+static void SyncParentDirectory(const char* filePath)
+{
+    char* path = NULL;
+    if (mallocAndStrcpy_s(&path, filePath) != 0)
+    {
+        return;
+    }
+
+    const int fd = open(dirname(path), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    free(path);
+}
+
+/**
+ * @brief Closes the outbox file. Must be called with s_outboxMutex held.
+ */
+static void CloseOutboxFile()
+{
+    if (s_outboxFd != -1)
+    {
+        close(s_outboxFd);
+        s_outboxFd = -1;
+    }
+    s_outboxFileSize = 0;
+    s_outboxUnsynced = false;
+}
+
+/**
+ * @brief Replaces the outbox file with one holding only s_outboxEntries, and reopens it for appending.
+ *        Must be called with s_outboxMutex held. On failure, the old file and its descriptor are left as they were.
+ */
+static bool CompactOutbox()
+{
+    bool success = false;
+    OutboxBuffer buffer = {};
+    char* tempFilePath = NULL;
+    int fd = -1;
+
+    Buffer_Append(&buffer, OUTBOX_FILE_MAGIC, OUTBOX_FILE_MAGIC_SIZE);
+    for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+    {
+        if (s_outboxEntries[i].active.content != NULL)
+        {
+            AppendRecord(&buffer, OUTBOX_RECORD_ACTIVE, i, &s_outboxEntries[i].active);
+        }
+
+        if (s_outboxEntries[i].pending.content != NULL)
+        {
+            AppendRecord(&buffer, OUTBOX_RECORD_PENDING, i, &s_outboxEntries[i].pending);
+        }
+    }
+
+    const size_t tempFilePathSize = strlen(s_outboxFilePath) + sizeof(".tmp");
+    tempFilePath = malloc(tempFilePathSize);
+    if (buffer.failed || tempFilePath == NULL)
+    {
+        goto done;
+    }
+    snprintf(tempFilePath, tempFilePathSize, "%s.tmp", s_outboxFilePath);
+
+    fd = open(tempFilePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1 || !WriteAll(fd, buffer.data, buffer.size) || fsync(fd) != 0)
+    {
+        Log_Error("Cannot write D2C outbox %s (errno:%d)", tempFilePath, errno);
+        goto done;
+    }
+
+    close(fd);
+    fd = -1;
+
+    if (rename(tempFilePath, s_outboxFilePath) != 0)
+    {
+        Log_Error("Cannot replace D2C outbox %s (errno:%d)", s_outboxFilePath, errno);
+        goto done;
+    }
+
+    SyncParentDirectory(s_outboxFilePath);
+
+    CloseOutboxFile();
+    s_outboxFd = open(s_outboxFilePath, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (s_outboxFd == -1)
+    {
+        Log_Error("Cannot open D2C outbox %s (errno:%d)", s_outboxFilePath, errno);
+        goto done;
+    }
+
+    s_outboxFileSize = buffer.size;
+    success = true;
+
+done:
+    if (fd != -1)
+    {
+        close(fd);
+        unlink(tempFilePath);
+    }
+
+    free(tempFilePath);
+    free(buffer.data);
+    return success;
+}
+
+/**
+ * @brief Appends a record to the outbox file, and applies it to s_outboxEntries.
+ *        Must be called with s_outboxMutex held. If the record cannot be written, the outbox is closed.
+ */
+static void WriteRecord(char kind, ADUC_D2C_Message_Type type, const ADUC_D2C_Outbox_Message* message)
+{
+    OutboxBuffer record = {};
+
+    if (s_outboxFd == -1)
+    {
+        return;
+    }
+
+    AppendRecord(&record, kind, type, message);
+
+    if (record.failed || !WriteAll(s_outboxFd, record.data, record.size)
+        || !ApplyRecord(
+            s_outboxEntries,
+            kind,
+            (uint8_t)type,
+            record.data + OUTBOX_RECORD_HEADER_SIZE,
+            record.size - OUTBOX_RECORD_HEADER_SIZE))
+    {
+        // Drop a partly written record, so that the file still reads back up to the last complete one.
+        Log_Error("Cannot write D2C outbox record (t:%d, errno:%d). Closing the outbox.", type, errno);
+        if (ftruncate(s_outboxFd, (off_t)s_outboxFileSize) != 0)
+        {
+            Log_Warn("Cannot truncate D2C outbox (errno:%d)", errno);
+        }
+        CloseOutboxFile();
+        goto done;
+    }
+
+    s_outboxFileSize += record.size;
+    s_outboxUnsynced = true;
+
+done:
+    free(record.data);
+}
+
+static void Entries_Uninit(ADUC_D2C_Outbox_Entry* entries)
+{
+    for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+    {
+        OutboxMessage_Uninit(&entries[i].active);
+        OutboxMessage_Uninit(&entries[i].pending);
+    }
+}
+
+static bool CopyOutboxMessage(ADUC_D2C_Outbox_Message* target, const ADUC_D2C_Outbox_Message* source)
+{
+    *target = *source;
+    target->content = NULL;
+    return source->content == NULL || mallocAndStrcpy_s(&target->content, source->content) == 0;
+}
+
+bool ADUC_D2C_Outbox_Open(const char* filePath, ADUC_D2C_Outbox_Entry* entries)
+{
+    bool success = false;
+    bool alreadyOpen = false;
+    uint8_t* data = NULL;
+    size_t size = 0;
+
+    memset(entries, 0, sizeof(*entries) * ADUC_D2C_Message_Type_Max);
+
+    pthread_mutex_lock(&s_outboxMutex);
+
+    if (s_outboxFilePath != NULL)
+    {
+        Log_Error("D2C outbox is already open.");
+        alreadyOpen = true;
+        goto done;
+    }
+
+    if (!ReadOutboxFile(filePath, &data, &size))
+    {
+        goto done;
+    }
+
+    ReplayRecords(s_outboxEntries, data, size);
+
+    if (mallocAndStrcpy_s(&s_outboxFilePath, filePath) != 0)
+    {
+        goto done;
+    }
+
+    // Start over from a file without the records that are no longer needed, nor a torn tail.
+    if (!CompactOutbox())
+    {
+        goto done;
+    }
+
+    for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+    {
+        if (!CopyOutboxMessage(&entries[i].active, &s_outboxEntries[i].active)
+            || !CopyOutboxMessage(&entries[i].pending, &s_outboxEntries[i].pending))
+        {
+            goto done;
+        }
+    }
+
+    success = true;
+
+done:
+    if (!success)
+    {
+        Entries_Uninit(entries);
+        if (!alreadyOpen)
+        {
+            CloseOutboxFile();
+            Entries_Uninit(s_outboxEntries);
+            free(s_outboxFilePath);
+            s_outboxFilePath = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&s_outboxMutex);
+    free(data);
+    return success;
+}
+
+void ADUC_D2C_Outbox_Close()
+{
+    pthread_mutex_lock(&s_outboxMutex);
+    if (s_outboxFd != -1 && s_outboxUnsynced && fdatasync(s_outboxFd) != 0)
+    {
+        Log_Warn("Cannot sync D2C outbox (errno:%d)", errno);
+    }
+    CloseOutboxFile();
+    Entries_Uninit(s_outboxEntries);
+    free(s_outboxFilePath);
+    s_outboxFilePath = NULL;
+    pthread_mutex_unlock(&s_outboxMutex);
+}
+
+void ADUC_D2C_Outbox_Entries_Uninit(ADUC_D2C_Outbox_Entry* entries)
+{
+    Entries_Uninit(entries);
+}
+
+void ADUC_D2C_Outbox_Put_Pending(ADUC_D2C_Message_Type type, const char* content, time_t contentSubmitTime)
+{
+    ADUC_D2C_Outbox_Message message = { .content = (char*)content, .contentSubmitTime = contentSubmitTime };
+
+    pthread_mutex_lock(&s_outboxMutex);
+    WriteRecord(OUTBOX_RECORD_PENDING, type, &message);
+    pthread_mutex_unlock(&s_outboxMutex);
+}
+
+void ADUC_D2C_Outbox_Put_Active(
+    ADUC_D2C_Message_Type type,
+    const char* content,
+    time_t contentSubmitTime,
+    unsigned int retries,
+    time_t nextRetryTimeStampEpoch)
+{
+    ADUC_D2C_Outbox_Message message = { .content = (char*)content,
+                                        .contentSubmitTime = contentSubmitTime,
+                                        .retries = retries,
+                                        .nextRetryTimeStampEpoch = nextRetryTimeStampEpoch };
+
+    pthread_mutex_lock(&s_outboxMutex);
+
+    // Usually the pending message is sent as it is, so the record only needs to say so.
+    const ADUC_D2C_Outbox_Message* pending = &s_outboxEntries[type].pending;
+    if (pending->content != NULL && pending->contentSubmitTime == contentSubmitTime
+        && strcmp(pending->content, content) == 0)
+    {
+        WriteRecord(OUTBOX_RECORD_ACTIVATE, type, &message);
+    }
+    else
+    {
+        WriteRecord(OUTBOX_RECORD_ACTIVE, type, &message);
+    }
+
+    pthread_mutex_unlock(&s_outboxMutex);
+}
+
+void ADUC_D2C_Outbox_Update_Active(
+    ADUC_D2C_Message_Type type, bool hasMessage, unsigned int retries, time_t nextRetryTimeStampEpoch)
+{
+    ADUC_D2C_Outbox_Message message = { .retries = retries, .nextRetryTimeStampEpoch = nextRetryTimeStampEpoch };
+
+    pthread_mutex_lock(&s_outboxMutex);
+
+    const ADUC_D2C_Outbox_Message* active = &s_outboxEntries[type].active;
+    if (active->content != NULL)
+    {
+        if (!hasMessage)
+        {
+            WriteRecord(OUTBOX_RECORD_DONE, type, &message);
+        }
+        else if (active->retries != retries || active->nextRetryTimeStampEpoch != nextRetryTimeStampEpoch)
+        {
+            WriteRecord(OUTBOX_RECORD_RETRY, type, &message);
+        }
+    }
+
+    pthread_mutex_unlock(&s_outboxMutex);
+}
+
+void ADUC_D2C_Outbox_Flush()
+{
+    pthread_mutex_lock(&s_outboxMutex);
+
+    if (s_outboxFd == -1)
+    {
+        goto done;
+    }
+
+    if (s_outboxFileSize > OUTBOX_COMPACTION_THRESHOLD_BYTES)
+    {
+        // Compaction syncs the new file; if it fails, the log is still intact, and is synced below.
+        if (CompactOutbox())
+        {
+            goto done;
+        }
+    }
+
+    if (s_outboxFd != -1 && s_outboxUnsynced)
+    {
+        if (fdatasync(s_outboxFd) != 0)
+        {
+            Log_Warn("Cannot sync D2C outbox (errno:%d)", errno);
+        }
+        s_outboxUnsynced = false;
+    }
+
+done:
+    pthread_mutex_unlock(&s_outboxMutex);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file d2c_outbox.h
+ * @brief The on-disk outbox that keeps Device-to-Cloud messages across agent restarts.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_D2C_OUTBOX_H
+#define ADUC_D2C_OUTBOX_H
+
+#include "aduc/c_utils.h"
+#include "aduc/d2c_messaging.h"
+#include <stdbool.h>
+#include <time.h> // time_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief A message kept in the outbox.
+ */
+typedef struct tagADUC_D2C_Outbox_Message
+{
+    char* content; /**< The message content. NULL if there is no message */
+    time_t contentSubmitTime; /**< Submit time */
+    unsigned int retries; /**< Number of retries. Only kept for the active message */
+    time_t nextRetryTimeStampEpoch; /**< The next retry time stamp. Only kept for the active message */
+} ADUC_D2C_Outbox_Message;
+
+/**
+ * @brief The messages of one type kept in the outbox.
+ */
+typedef struct tagADUC_D2C_Outbox_Entry
+{
+    ADUC_D2C_Outbox_Message active; /**< The message being processed */
+    ADUC_D2C_Outbox_Message pending; /**< The message waiting in the pending messages store */
+} ADUC_D2C_Outbox_Entry;
+
+/**
+ * @brief Opens the outbox at @p filePath, and reads back the messages it holds.
+ * @details The file is created if it does not exist. A record torn by a crash, and anything after it, is dropped.
+ *
+ * @param filePath The outbox file.
+ * @param[out] entries The messages of each type, ADUC_D2C_Message_Type_Max entries. Free with
+ *                     ADUC_D2C_Outbox_Entries_Uninit().
+ * @return bool true on success.
+ */
+bool ADUC_D2C_Outbox_Open(const char* filePath, ADUC_D2C_Outbox_Entry* entries);
+
+/**
+ * @brief Syncs the outbox to disk and closes it. Messages are kept in the file, to be read back by the next open.
+ */
+void ADUC_D2C_Outbox_Close();
+
+/**
+ * @brief Frees the contents of the ADUC_D2C_Message_Type_Max @p entries returned by ADUC_D2C_Outbox_Open().
+ */
+void ADUC_D2C_Outbox_Entries_Uninit(ADUC_D2C_Outbox_Entry* entries);
+
+/**
+ * @brief Records the message queued in the pending messages store, replacing the one queued before.
+ */
+void ADUC_D2C_Outbox_Put_Pending(ADUC_D2C_Message_Type type, const char* content, time_t contentSubmitTime);
+
+/**
+ * @brief Records the message that replaced the active one, and clears the pending message it came from.
+ */
+void ADUC_D2C_Outbox_Put_Active(
+    ADUC_D2C_Message_Type type,
+    const char* content,
+    time_t contentSubmitTime,
+    unsigned int retries,
+    time_t nextRetryTimeStampEpoch);
+
+/**
+ * @brief Records the retry state of the active message, or that it is no longer processed. Nothing is written if
+ *        neither changed since the last call.
+ *
+ * @param type The message type.
+ * @param hasMessage Whether the active message is still processed.
+ * @param retries Number of retries.
+ * @param nextRetryTimeStampEpoch The next retry time stamp.
+ */
+void ADUC_D2C_Outbox_Update_Active(
+    ADUC_D2C_Message_Type type, bool hasMessage, unsigned int retries, time_t nextRetryTimeStampEpoch);
+
+/**
+ * @brief Syncs the records written since the last flush to disk, and compacts the outbox once it has grown.
+ */
+void ADUC_D2C_Outbox_Flush();
+
+EXTERN_C_END
+
+#endif // ADUC_D2C_OUTBOX_H
@@ -0,0 +1,240 @@
+/**
+ * @file d2c_messaging_perf.cpp
+ * @brief Counts the bytes D2C messaging sends, and writes to its outbox, over a scripted deployment.
+ *
+ * Hidden from the default run. Use: d2c_messaging_unit_test "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/client_handle.h"
+#include "aduc/d2c_messaging.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+size_t g_sentBytes = 0;
+void* g_context = nullptr;
+ADUC_C2D_RESPONSE_HANDLER_FUNCTION g_responseHandlerFunc = nullptr;
+
+/**
+ * A mock transport function that counts the bytes sent, and leaves the response to the test.
+ */
+int CountingMessageTransportFunc(
+    void* cloudServiceHandle, void* context, ADUC_C2D_RESPONSE_HANDLER_FUNCTION c2dResponseHandlerFunc)
+{
+    (void)cloudServiceHandle;
+    auto message_processing_context = static_cast<ADUC_D2C_Message_Processing_Context*>(context);
+    const ADUC_D2C_Message& message = message_processing_context->message;
+    g_sentBytes += strlen(message.patch != nullptr ? message.patch : message.content);
+    g_context = context;
+    g_responseHandlerFunc = c2dResponseHandlerFunc;
+    message_processing_context->message.status = ADUC_D2C_Message_Status_Waiting_For_Response;
+    return 0;
+}
+
+/**
+ * @brief A reported property message of the scripted deployment.
+ */
+struct ScriptedMessage
+{
+    ADUC_D2C_Message_Type type;
+    std::string content;
+};
+
+std::string DeviceProperties()
+{
+    return R"({"deviceUpdate":{"__t":"c","agent":{"deviceProperties":{"manufacturer":"contoso","model":"toaster",)"
+           R"("interfaceId":"dtmi:azure:iot:deviceUpdateModel;2","aduVer":"DU;agent/1.0.0","doVer":"DU;lib/v1.0.0"},)"
+           R"("compatPropertyNames":"manufacturer,model"}}})";
+}
+
+/**
+ * @brief An 'agent' report, shaped like the output of GetReportingJsonValue for a three step update.
+ *
+ * @param state The ADUCITF_State.
+ * @param resultCode The result code of the update and of each step. 0 clears the step results.
+ */
+std::string AgentReport(int state, int resultCode, const std::string& workflowId, const std::string& installedUpdateId)
+{
+    std::string stepResults = "null";
+    if (resultCode != 0)
+    {
+        stepResults = "{";
+        for (int i = 0; i < 3; ++i)
+        {
+            stepResults += (i == 0 ? "" : ",");
+            stepResults += R"("step_)" + std::to_string(i) + R"(":{"resultCode":)" + std::to_string(resultCode)
+                + R"(,"extendedResultCode":0,"resultDetails":""})";
+        }
+        stepResults += "}";
+    }
+
+    return R"({"deviceUpdate":{"__t":"c","agent":{"lastInstallResult":{"resultCode":)" + std::to_string(resultCode)
+        + R"(,"extendedResultCode":0,"resultDetails":"","stepResults":)" + stepResults + R"(},"state":)"
+        + std::to_string(state) + R"(,"workflow":{"action":3,"id":")" + workflowId + R"("},"installedUpdateId":")"
+        + installedUpdateId + R"("}}})";
+}
+
+/**
+ * @brief A 'service' acknowledgement, which echoes the update action with its manifest.
+ */
+std::string ServiceAck(const std::string& workflowId, const std::string& updateId, int version)
+{
+    std::string manifest = R"({\"manifestVersion\":\"5\",\"updateId\":)" + updateId
+        + R"(,\"compatibility\":[{\"manufacturer\":\"contoso\",\"model\":\"toaster\"}],\"instructions\":{\"steps\":[)";
+    for (int i = 0; i < 3; ++i)
+    {
+        manifest += (i == 0 ? "" : ",");
+        manifest += R"({\"handler\":\"microsoft/script:1\",\"files\":[\"f)" + std::to_string(i)
+            + R"(\"],\"handlerProperties\":{\"scriptFileName\":\"install.sh\",\"arguments\":\"--action-install\"}})";
+    }
+    manifest += R"(]},\"files\":{\"f0\":{\"fileName\":\"install.sh\",\"sizeInBytes\":1024,\"hashes\":{\"sha256\":)"
+                R"(\"47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=\"}}},\"createdDateTime\":\"2022-01-27T13:45:05Z\"})";
+
+    return R"({"deviceUpdate":{"__t":"c","service":{"value":{"workflow":{"action":3,"id":")" + workflowId
+        + R"("},"updateManifest":")" + manifest + R"(","updateManifestSignature":null,"fileUrls":null},)"
+        + R"("ac":200,"ad":"","av":)" + std::to_string(version) + "}}}";
+}
+
+/**
+ * @brief Startup, then a deployment through each state the workflow reports: DeploymentInProgress,
+ * DownloadStarted, DownloadSucceeded, InstallStarted, InstallSucceeded, ApplyStarted and Idle.
+ */
+std::vector<ScriptedMessage> DeploymentScript()
+{
+    const std::string previousUpdate = R"({\"provider\":\"contoso\",\"name\":\"toaster\",\"version\":\"1.0\"})";
+    const std::string update = R"({\"provider\":\"contoso\",\"name\":\"toaster\",\"version\":\"1.1\"})";
+
+    return {
+        { ADUC_D2C_Message_Type_Device_Properties, DeviceProperties() },
+        { ADUC_D2C_Message_Type_Device_Update_Result, AgentReport(0, 700, "w0", previousUpdate) },
+        { ADUC_D2C_Message_Type_Device_Update_ACK, ServiceAck("w1", update, 2) },
+        { ADUC_D2C_Message_Type_Device_Update_Result, AgentReport(6, 0, "w1", previousUpdate) },
+        { ADUC_D2C_Message_Type_Device_Update_Result, AgentReport(1, 0, "w1", previousUpdate) },
+        { ADUC_D2C_Message_Type_Device_Update_Result, AgentReport(2, 500, "w1", previousUpdate) },
+        { ADUC_D2C_Message_Type_Device_Update_Result, AgentReport(3, 500, "w1", previousUpdate) },
+        { ADUC_D2C_Message_Type_Device_Update_Result, AgentReport(4, 600, "w1", previousUpdate) },
+        { ADUC_D2C_Message_Type_Device_Update_Result, AgentReport(5, 600, "w1", previousUpdate) },
+        { ADUC_D2C_Message_Type_Device_Update_Result, AgentReport(0, 700, "w1", update) },
+    };
+}
+
+size_t FileSize(const std::string& path)
+{
+    struct stat st = {};
+    REQUIRE(stat(path.c_str(), &st) == 0);
+    return static_cast<size_t>(st.st_size);
+}
+} // namespace
+
+TEST_CASE("D2C bytes sent over a scripted deployment", "[.][perf]")
+{
+    auto handle = reinterpret_cast<ADUC_ClientHandle>(-1); // We don't need real handle.
+    const std::vector<ScriptedMessage> script = DeploymentScript();
+
+    ADUC_D2C_Messaging_Init();
+
+    size_t fullBytes = 0;
+    g_sentBytes = 0;
+
+    std::cout << "type\tfull\tsent" << std::endl;
+    for (const ScriptedMessage& message : script)
+    {
+        const size_t sentBytesBefore = g_sentBytes;
+
+        ADUC_D2C_Messaging_Set_Transport(message.type, CountingMessageTransportFunc);
+        REQUIRE(ADUC_D2C_Message_SendAsync(
+            message.type, &handle, message.content.c_str(), nullptr, nullptr, nullptr, nullptr));
+
+        g_responseHandlerFunc = nullptr;
+        ADUC_D2C_Messaging_DoWork();
+        if (g_responseHandlerFunc != nullptr)
+        {
+            g_responseHandlerFunc(200, g_context);
+        }
+
+        fullBytes += message.content.size();
+        std::cout << message.type << '\t' << message.content.size() << '\t' << (g_sentBytes - sentBytesBefore)
+                  << std::endl;
+    }
+
+    ADUC_D2C_Messaging_Uninit();
+
+    std::cout << "messages: " << script.size() << "\tfull documents: " << fullBytes
+              << " bytes\tsent: " << g_sentBytes << " bytes (" << (100.0 * g_sentBytes / fullBytes) << "%)"
+              << std::endl;
+
+    CHECK(g_sentBytes < fullBytes);
+}
+
+TEST_CASE("D2C outbox bytes written over a scripted deployment", "[.][perf]")
+{
+    auto handle = reinterpret_cast<ADUC_ClientHandle>(-1); // We don't need real handle.
+    const std::vector<ScriptedMessage> script = DeploymentScript();
+
+    char dirTemplate[] = "/tmp/d2coutboxperfXXXXXX";
+    REQUIRE(mkdtemp(dirTemplate) != nullptr);
+    const std::string outboxPath = std::string{ dirTemplate } + "/outbox";
+
+    void* handles[ADUC_D2C_Message_Type_Max];
+    ADUC_D2C_Messaging_Init();
+    for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+    {
+        ADUC_D2C_Messaging_Set_Transport(static_cast<ADUC_D2C_Message_Type>(i), CountingMessageTransportFunc);
+        handles[i] = &handle;
+    }
+    REQUIRE(ADUC_D2C_Messaging_Enable_Outbox(outboxPath.c_str(), handles));
+
+    size_t contentBytes = 0;
+    unsigned int syncs = 0;
+    const size_t initialSize = FileSize(outboxPath);
+
+    // Each message is queued, sent on the next pass of the main loop, and acknowledged before the pass after.
+    std::cout << "type\tcontent\toutbox" << std::endl;
+    for (const ScriptedMessage& message : script)
+    {
+        const size_t sizeBefore = FileSize(outboxPath);
+
+        REQUIRE(ADUC_D2C_Message_SendAsync(
+            message.type, &handle, message.content.c_str(), nullptr, nullptr, nullptr, nullptr));
+
+        // Records written between two passes are synced by the second.
+        size_t sizeSynced = FileSize(outboxPath);
+        g_responseHandlerFunc = nullptr;
+        ADUC_D2C_Messaging_DoWork();
+        syncs += FileSize(outboxPath) != sizeSynced ? 1 : 0;
+
+        sizeSynced = FileSize(outboxPath);
+        if (g_responseHandlerFunc != nullptr)
+        {
+            g_responseHandlerFunc(200, g_context);
+        }
+        ADUC_D2C_Messaging_DoWork();
+        syncs += FileSize(outboxPath) != sizeSynced ? 1 : 0;
+
+        contentBytes += message.content.size();
+        std::cout << message.type << '\t' << message.content.size() << '\t' << (FileSize(outboxPath) - sizeBefore)
+                  << std::endl;
+    }
+
+    const size_t outboxBytes = FileSize(outboxPath) - initialSize;
+    ADUC_D2C_Messaging_Uninit();
+
+    std::cout << "messages: " << script.size() << "\tcontent: " << contentBytes << " bytes\toutbox: " << outboxBytes
+              << " bytes (write amplification " << (static_cast<double>(outboxBytes) / contentBytes) << ")\tsyncs: "
+              << syncs << std::endl;
+
+    (void)unlink(outboxPath.c_str());
+    rmdir(dirTemplate);
+
+    CHECK(outboxBytes < 2 * contentBytes);
+}
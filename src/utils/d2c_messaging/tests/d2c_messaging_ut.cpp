@@ -4,7 +4,9 @@
 #include "aduc/retry_utils.h"
 
 #include <catch2/catch.hpp>
+#include <parson.h>
 #include <stdexcept> // runtime_error
+#include <string>
 #include <string.h>
 #include <sys/param.h> // *_MIN/*_MAX
 #include <sys/time.h> // nanosleep
@@ -389,14 +391,17 @@ TEST_CASE("Deinitialization - in progress message", "[.][functional]")
 
     // Message should be in pending state.
     CHECK(resultMessage.status == ADUC_D2C_Message_Status_Pending);
+    CHECK(ADUC_D2C_Messaging_IsWaitingForResponse());
 
     // Explicitly call DoWork() once to start processing pending message.
     ADUC_D2C_Messaging_DoWork();
 
     CHECK(resultMessage.status == ADUC_D2C_Message_Status_Waiting_For_Response);
+    CHECK(ADUC_D2C_Messaging_IsWaitingForResponse());
 
     // Un-init.
     ADUC_D2C_Messaging_Uninit();
+    CHECK_FALSE(ADUC_D2C_Messaging_IsWaitingForResponse());
 
     // Expected 1 attempt since DoWork() already cause the message to send,
     // and state should be 'canceled'
@@ -781,3 +786,153 @@ TEST_CASE("30 retries - httpStatus 401", "[.][functional]")
     ADUC_D2C_Messaging_Uninit();
     g_testCaseSyncMutex.unlock();
 }
+
+/**
+ * @brief What the capturing transport function sent, and how to respond to it.
+ */
+static struct
+{
+    std::string sent;
+    int sendCount;
+    void* context;
+    ADUC_C2D_RESPONSE_HANDLER_FUNCTION responseHandlerFunc;
+} g_captured;
+
+/**
+ * A mock transport function that captures what is sent, and leaves the response to the test.
+ */
+static int CapturingMessageTransportFunc(
+    void* cloudServiceHandle, void* context, ADUC_C2D_RESPONSE_HANDLER_FUNCTION c2dResponseHandlerFunc)
+{
+    UNREFERENCED_PARAMETER(cloudServiceHandle);
+    auto message_processing_context = static_cast<ADUC_D2C_Message_Processing_Context*>(context);
+    const ADUC_D2C_Message& message = message_processing_context->message;
+    g_captured.sent = message.patch != nullptr ? message.patch : message.content;
+    g_captured.sendCount++;
+    g_captured.context = context;
+    g_captured.responseHandlerFunc = c2dResponseHandlerFunc;
+    MockSetMessageStatus(&message_processing_context->message, ADUC_D2C_Message_Status_Waiting_For_Response);
+    return 0;
+}
+
+/**
+ * @brief Checks that @p actual is the same JSON as @p expected, regardless of member order.
+ */
+static void CheckSameJson(const std::string& actual, const char* expected)
+{
+    INFO("actual: " << actual);
+    INFO("expected: " << expected);
+    JSON_Value* actualValue = json_parse_string(actual.c_str());
+    JSON_Value* expectedValue = json_parse_string(expected);
+    REQUIRE(actualValue != nullptr);
+    REQUIRE(expectedValue != nullptr);
+    CHECK(json_value_equals(actualValue, expectedValue));
+    json_value_free(actualValue);
+    json_value_free(expectedValue);
+}
+
+TEST_CASE("Reported property patches")
+{
+    g_testCaseSyncMutex.lock();
+
+    auto handle = reinterpret_cast<ADUC_ClientHandle>(-1); // We don't need real handle.
+    const ADUC_D2C_Message_Type type = ADUC_D2C_Message_Type_Device_Update_Result;
+    ADUC_D2C_Message_Status status = ADUC_D2C_Message_Status_Pending;
+
+    ADUC_D2C_Messaging_Init();
+    ADUC_D2C_Messaging_Set_Transport(type, CapturingMessageTransportFunc);
+    g_captured = {};
+
+    const auto send = [&](const char* content) {
+        status = ADUC_D2C_Message_Status_Pending;
+        REQUIRE(ADUC_D2C_Message_SendAsync(
+            type,
+            &handle,
+            content,
+            nullptr /* responseCallback */,
+            OnMessageProcessCompleted_SaveStatus,
+            nullptr /* statusChangedCallback */,
+            &status));
+    };
+
+    const auto acknowledge = [&]() {
+        REQUIRE(g_captured.responseHandlerFunc != nullptr);
+        g_captured.responseHandlerFunc(200, g_captured.context);
+        g_captured.responseHandlerFunc = nullptr;
+        CHECK(status == ADUC_D2C_Message_Status_Success);
+    };
+
+    const char* idle = R"({"deviceUpdate":{"__t":"c","agent":{"state":0,"workflow":{"action":3,"id":"abc"},)"
+                       R"("lastInstallResult":{"resultCode":700,"stepResults":{"step_0":{"resultCode":700}}}}}})";
+
+    // Nothing has been acknowledged, so the first message is sent in full.
+    send(idle);
+    ADUC_D2C_Messaging_DoWork();
+    CHECK(g_captured.sendCount == 1);
+    CheckSameJson(g_captured.sent, idle);
+    acknowledge();
+
+    SECTION("Only changed properties are sent, with the component marker")
+    {
+        send(R"({"deviceUpdate":{"__t":"c","agent":{"state":6,"workflow":{"action":3,"id":"abc"},)"
+             R"("lastInstallResult":{"resultCode":700,"stepResults":null}}}})");
+        ADUC_D2C_Messaging_DoWork();
+        CHECK(g_captured.sendCount == 2);
+        CheckSameJson(
+            g_captured.sent,
+            R"({"deviceUpdate":{"__t":"c","agent":{"state":6,"lastInstallResult":{"stepResults":null}}}})");
+        acknowledge();
+
+        // Removed properties are not removed again.
+        send(R"({"deviceUpdate":{"__t":"c","agent":{"state":0,"lastInstallResult":{"stepResults":null}}}})");
+        ADUC_D2C_Messaging_DoWork();
+        CHECK(g_captured.sendCount == 3);
+        CheckSameJson(g_captured.sent, R"({"deviceUpdate":{"__t":"c","agent":{"state":0}}})");
+        acknowledge();
+    }
+
+    SECTION("Message that changes nothing is not sent")
+    {
+        send(idle);
+        ADUC_D2C_Messaging_DoWork();
+        CHECK(g_captured.sendCount == 1);
+        CHECK(status == ADUC_D2C_Message_Status_Success);
+    }
+
+    SECTION("Messages queued together are merged into one")
+    {
+        send(R"({"deviceUpdate":{"__t":"c","agent":{"state":1}}})");
+        send(R"({"deviceUpdate":{"__t":"c","agent":{"workflow":{"action":3,"id":"def"}}}})");
+        ADUC_D2C_Messaging_DoWork();
+        CHECK(g_captured.sendCount == 2);
+        CheckSameJson(g_captured.sent, R"({"deviceUpdate":{"__t":"c","agent":{"state":1,"workflow":{"id":"def"}}}})");
+        acknowledge();
+    }
+
+    SECTION("Message waits for the coalescing window")
+    {
+        ADUC_D2C_Messaging_Set_Coalescing_Window(type, 60 * 1000);
+        send(R"({"deviceUpdate":{"__t":"c","agent":{"state":1}}})");
+        ADUC_D2C_Messaging_DoWork();
+        CHECK(g_captured.sendCount == 1);
+        CHECK(ADUC_D2C_Messaging_IsWaitingForResponse());
+
+        ADUC_D2C_Messaging_Set_Coalescing_Window(type, 0);
+        ADUC_D2C_Messaging_DoWork();
+        CHECK(g_captured.sendCount == 2);
+        acknowledge();
+    }
+
+    SECTION("Everything is sent again after a reset")
+    {
+        ADUC_D2C_Messaging_Reset_Reported_Properties();
+        send(idle);
+        ADUC_D2C_Messaging_DoWork();
+        CHECK(g_captured.sendCount == 2);
+        CheckSameJson(g_captured.sent, idle);
+        acknowledge();
+    }
+
+    ADUC_D2C_Messaging_Uninit();
+    g_testCaseSyncMutex.unlock();
+}
@@ -0,0 +1,453 @@
+/**
+ * @file d2c_outbox_ut.cpp
+ * @brief Unit Tests for the D2C messaging outbox, including crashes at any point of a write.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/client_handle.h"
+#include "aduc/d2c_messaging.h"
+
+#include <algorithm>
+#include <catch2/catch.hpp>
+#include <climits> // INT_MAX
+#include <csignal>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+ADUC_ClientHandle g_handle = reinterpret_cast<ADUC_ClientHandle>(-1); // We don't need real handle.
+
+struct
+{
+    std::vector<std::string> sent;
+    std::map<int, void*> contexts;
+    ADUC_C2D_RESPONSE_HANDLER_FUNCTION responseHandlerFunc;
+    unsigned int retries;
+} g_captured;
+
+/**
+ * A mock transport function that captures what is sent, and leaves the response to the test.
+ */
+int CapturingMessageTransportFunc(
+    void* cloudServiceHandle, void* context, ADUC_C2D_RESPONSE_HANDLER_FUNCTION c2dResponseHandlerFunc)
+{
+    (void)cloudServiceHandle;
+    auto message_processing_context = static_cast<ADUC_D2C_Message_Processing_Context*>(context);
+    const ADUC_D2C_Message& message = message_processing_context->message;
+    g_captured.sent.emplace_back(message.patch != nullptr ? message.patch : message.content);
+    g_captured.contexts[message_processing_context->type] = context;
+    g_captured.responseHandlerFunc = c2dResponseHandlerFunc;
+    g_captured.retries = message_processing_context->retries;
+    message_processing_context->message.status = ADUC_D2C_Message_Status_Waiting_For_Response;
+    return 0;
+}
+
+void Respond(ADUC_D2C_Message_Type type, int httpStatusCode)
+{
+    REQUIRE(g_captured.contexts.count(type) == 1);
+    g_captured.responseHandlerFunc(httpStatusCode, g_captured.contexts[type]);
+    g_captured.contexts.erase(type);
+}
+
+std::vector<std::string> Sorted(std::vector<std::string> contents)
+{
+    std::sort(contents.begin(), contents.end());
+    return contents;
+}
+
+void SendAsync(ADUC_D2C_Message_Type type, const char* content)
+{
+    REQUIRE(ADUC_D2C_Message_SendAsync(type, &g_handle, content, nullptr, nullptr, nullptr, nullptr));
+}
+
+/**
+ * @brief Starts D2C messaging with the outbox at @p outboxPath, as the agent does, and stops it on destruction.
+ */
+class AgentRun
+{
+public:
+    AgentRun(const AgentRun&) = delete;
+    AgentRun& operator=(const AgentRun&) = delete;
+    AgentRun(AgentRun&&) = delete;
+    AgentRun& operator=(AgentRun&&) = delete;
+
+    explicit AgentRun(const std::string& outboxPath)
+    {
+        g_captured = {};
+        REQUIRE(ADUC_D2C_Messaging_Init());
+
+        void* handles[ADUC_D2C_Message_Type_Max];
+        for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+        {
+            ADUC_D2C_Messaging_Set_Transport(static_cast<ADUC_D2C_Message_Type>(i), CapturingMessageTransportFunc);
+            handles[i] = &g_handle;
+        }
+
+        REQUIRE(ADUC_D2C_Messaging_Enable_Outbox(outboxPath.c_str(), handles));
+    }
+
+    ~AgentRun()
+    {
+        ADUC_D2C_Messaging_Uninit();
+    }
+};
+
+/**
+ * @brief A temporary directory for outbox files, removed with its files on destruction.
+ */
+class OutboxDir
+{
+public:
+    OutboxDir(const OutboxDir&) = delete;
+    OutboxDir& operator=(const OutboxDir&) = delete;
+    OutboxDir(OutboxDir&&) = delete;
+    OutboxDir& operator=(OutboxDir&&) = delete;
+
+    OutboxDir()
+    {
+        char dirTemplate[] = "/tmp/d2coutboxXXXXXX";
+        REQUIRE(mkdtemp(dirTemplate) != nullptr);
+        _dir = dirTemplate;
+    }
+
+    ~OutboxDir()
+    {
+        for (const char* name : { "outbox", "outbox.tmp", "copy", "copy.tmp" })
+        {
+            (void)unlink((_dir + "/" + name).c_str());
+        }
+        rmdir(_dir.c_str());
+    }
+
+    std::string Path(const char* name) const
+    {
+        return _dir + "/" + name;
+    }
+
+private:
+    std::string _dir;
+};
+
+std::string ReadFile(const std::string& path)
+{
+    std::ifstream file{ path, std::ios::binary };
+    return std::string{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+void WriteFile(const std::string& path, const std::string& content)
+{
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    file << content;
+}
+
+/**
+ * @brief Starts a run on the outbox file @p path, and returns what its first pass sends.
+ */
+std::vector<std::string> SentAfterRestart(const std::string& path)
+{
+    AgentRun run{ path };
+    ADUC_D2C_Messaging_DoWork();
+    return Sorted(g_captured.sent);
+}
+
+time_t RetryInAnHour(int, unsigned int, long, long, double)
+{
+    return time(nullptr) + 3600;
+}
+
+time_t RetryAtOnce(int, unsigned int, long, long, double)
+{
+    return time(nullptr) - 1;
+}
+
+ADUC_D2C_HttpStatus_Retry_Info g_retryInAnHourInfo[] = {
+    { .httpStatusMin = 200,
+      .httpStatusMax = 299,
+      .additionalDelaySecs = 0,
+      .retryTimestampCalcFunc = nullptr,
+      .maxRetry = 0 },
+
+    { .httpStatusMin = 0,
+      .httpStatusMax = INT_MAX,
+      .additionalDelaySecs = 0,
+      .retryTimestampCalcFunc = RetryInAnHour,
+      .maxRetry = INT_MAX },
+};
+
+ADUC_D2C_HttpStatus_Retry_Info g_retryAtOnceInfo[] = {
+    { .httpStatusMin = 200,
+      .httpStatusMax = 299,
+      .additionalDelaySecs = 0,
+      .retryTimestampCalcFunc = nullptr,
+      .maxRetry = 0 },
+
+    { .httpStatusMin = 0,
+      .httpStatusMax = INT_MAX,
+      .additionalDelaySecs = 0,
+      .retryTimestampCalcFunc = RetryAtOnce,
+      .maxRetry = INT_MAX },
+};
+
+ADUC_D2C_RetryStrategy MakeRetryStrategy(ADUC_D2C_HttpStatus_Retry_Info* info)
+{
+    ADUC_D2C_RetryStrategy strategy = {};
+    strategy.httpStatusRetryInfo = info;
+    strategy.httpStatusRetryInfoSize = 2;
+    strategy.maxRetries = INT_MAX;
+    strategy.maxDelaySecs = 24 * 60 * 60;
+    strategy.fallbackWaitTimeSec = 1;
+    strategy.initialDelayUnitMilliSecs = 10;
+    return strategy;
+}
+} // namespace
+
+TEST_CASE("D2C outbox sends the messages a previous run did not deliver")
+{
+    OutboxDir dir;
+    const std::string path = dir.Path("outbox");
+
+    SECTION("Queued message")
+    {
+        {
+            AgentRun run{ path };
+            SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r1");
+        }
+
+        {
+            AgentRun run{ path };
+            ADUC_D2C_Messaging_DoWork();
+            CHECK(g_captured.sent == std::vector<std::string>{ "r1" });
+            Respond(ADUC_D2C_Message_Type_Device_Update_Result, 200);
+            ADUC_D2C_Messaging_DoWork();
+        }
+
+        // Delivered, so not sent again.
+        CHECK(SentAfterRestart(path).empty());
+    }
+
+    SECTION("Message waiting for a response")
+    {
+        {
+            AgentRun run{ path };
+            SendAsync(ADUC_D2C_Message_Type_Device_Update_ACK, "a1");
+            ADUC_D2C_Messaging_DoWork();
+            CHECK(g_captured.sent.size() == 1);
+        }
+
+        CHECK(SentAfterRestart(path) == std::vector<std::string>{ "a1" });
+    }
+
+    SECTION("Message replaced by a later one")
+    {
+        {
+            AgentRun run{ path };
+            SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r1");
+            ADUC_D2C_Messaging_DoWork();
+            SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r2");
+        }
+
+        // The message waiting for a response is replaced by the queued one on the first pass.
+        CHECK(SentAfterRestart(path) == std::vector<std::string>{ "r2" });
+    }
+
+    SECTION("Message completed without a response")
+    {
+        {
+            AgentRun run{ path };
+            SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r1");
+            ADUC_D2C_Messaging_DoWork();
+            Respond(ADUC_D2C_Message_Type_Device_Update_Result, 200);
+            ADUC_D2C_Messaging_DoWork();
+        }
+
+        CHECK(SentAfterRestart(path).empty());
+    }
+}
+
+TEST_CASE("D2C outbox keeps the retry state of a message")
+{
+    OutboxDir dir;
+    const std::string path = dir.Path("outbox");
+
+    SECTION("A retry scheduled later is not sent early")
+    {
+        ADUC_D2C_RetryStrategy strategy = MakeRetryStrategy(g_retryInAnHourInfo);
+        {
+            AgentRun run{ path };
+            ADUC_D2C_Messaging_Set_Retry_Strategy(ADUC_D2C_Message_Type_Device_Update_Result, &strategy);
+            SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r1");
+            ADUC_D2C_Messaging_DoWork();
+            Respond(ADUC_D2C_Message_Type_Device_Update_Result, 500);
+            ADUC_D2C_Messaging_DoWork();
+            CHECK(g_captured.sent.size() == 1);
+        }
+
+        CHECK(SentAfterRestart(path).empty());
+    }
+
+    SECTION("Retries carry on from where they were")
+    {
+        ADUC_D2C_RetryStrategy strategy = MakeRetryStrategy(g_retryAtOnceInfo);
+        {
+            AgentRun run{ path };
+            ADUC_D2C_Messaging_Set_Retry_Strategy(ADUC_D2C_Message_Type_Device_Update_Result, &strategy);
+            SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r1");
+            ADUC_D2C_Messaging_DoWork();
+            Respond(ADUC_D2C_Message_Type_Device_Update_Result, 500);
+            ADUC_D2C_Messaging_DoWork();
+            Respond(ADUC_D2C_Message_Type_Device_Update_Result, 503);
+            ADUC_D2C_Messaging_DoWork();
+            CHECK(g_captured.sent.size() == 3);
+            CHECK(g_captured.retries == 2);
+        }
+
+        CHECK(SentAfterRestart(path) == std::vector<std::string>{ "r1" });
+        CHECK(g_captured.retries == 2);
+    }
+}
+
+TEST_CASE("D2C outbox survives the agent process being killed")
+{
+    OutboxDir dir;
+    const std::string path = dir.Path("outbox");
+
+    const pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0)
+    {
+        // The agent: send one message, queue another, and get killed before the outbox is synced or closed.
+        void* handles[ADUC_D2C_Message_Type_Max];
+        std::fill(std::begin(handles), std::end(handles), &g_handle);
+        ADUC_D2C_Messaging_Init();
+        ADUC_D2C_Messaging_Set_Transport(ADUC_D2C_Message_Type_Device_Update_Result, CapturingMessageTransportFunc);
+        if (!ADUC_D2C_Messaging_Enable_Outbox(path.c_str(), handles))
+        {
+            _exit(1);
+        }
+        ADUC_D2C_Message_SendAsync(
+            ADUC_D2C_Message_Type_Device_Update_Result, &g_handle, "r1", nullptr, nullptr, nullptr, nullptr);
+        ADUC_D2C_Messaging_DoWork();
+        ADUC_D2C_Message_SendAsync(
+            ADUC_D2C_Message_Type_Device_Update_ACK, &g_handle, "a1", nullptr, nullptr, nullptr, nullptr);
+        kill(getpid(), SIGKILL);
+        _exit(1);
+    }
+
+    int status = 0;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFSIGNALED(status));
+    CHECK(WTERMSIG(status) == SIGKILL);
+
+    CHECK(SentAfterRestart(path) == (std::vector<std::string>{ "a1", "r1" }));
+}
+
+TEST_CASE("D2C outbox reads back the complete records before a crash")
+{
+    OutboxDir dir;
+    const std::string path = dir.Path("outbox");
+    const std::string copyPath = dir.Path("copy");
+
+    // The file size after each step, which ends on a record boundary, and what a restart then sends.
+    std::vector<std::pair<size_t, std::vector<std::string>>> steps;
+    const auto step = [&](std::vector<std::string> expected) {
+        struct stat st = {};
+        REQUIRE(stat(path.c_str(), &st) == 0);
+        steps.emplace_back(static_cast<size_t>(st.st_size), Sorted(std::move(expected)));
+    };
+
+    {
+        AgentRun run{ path };
+        step({});
+        SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r1");
+        step({ "r1" });
+        ADUC_D2C_Messaging_DoWork();
+        step({ "r1" });
+        Respond(ADUC_D2C_Message_Type_Device_Update_Result, 200);
+        ADUC_D2C_Messaging_DoWork();
+        step({});
+        SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r2");
+        step({ "r2" });
+        SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, "r3");
+        step({ "r3" });
+        SendAsync(ADUC_D2C_Message_Type_Device_Update_ACK, "a1");
+        step({ "r3", "a1" });
+        ADUC_D2C_Messaging_DoWork();
+        step({ "r3", "a1" });
+        Respond(ADUC_D2C_Message_Type_Device_Update_ACK, 200);
+        ADUC_D2C_Messaging_DoWork();
+        step({ "r3" });
+    }
+
+    const std::string records = ReadFile(path);
+    REQUIRE(records.size() == steps.back().first);
+
+    SECTION("Torn at every byte")
+    {
+        size_t k = 0;
+        for (size_t size = 0; size <= records.size(); size++)
+        {
+            while (k + 1 < steps.size() && steps[k + 1].first <= size)
+            {
+                k++;
+            }
+
+            INFO("size: " << size);
+            WriteFile(copyPath, records.substr(0, size));
+            CHECK(SentAfterRestart(copyPath) == steps[k].second);
+        }
+    }
+
+    SECTION("Corrupt in any record")
+    {
+        for (size_t k = 0; k + 1 < steps.size(); k++)
+        {
+            INFO("step: " << k);
+            std::string corrupt = records;
+            corrupt[steps[k].first + 10] ^= 0x40;
+            WriteFile(copyPath, corrupt);
+            CHECK(SentAfterRestart(copyPath) == steps[k].second);
+        }
+    }
+
+    SECTION("Unknown format")
+    {
+        WriteFile(copyPath, "not an outbox");
+        CHECK(SentAfterRestart(copyPath).empty());
+        CHECK(SentAfterRestart(copyPath).empty());
+    }
+}
+
+TEST_CASE("D2C outbox is compacted once it has grown")
+{
+    OutboxDir dir;
+    const std::string path = dir.Path("outbox");
+    const std::string content(1000, 'x');
+    std::string last;
+
+    {
+        AgentRun run{ path };
+        for (int i = 0; i < 200; i++)
+        {
+            last = content + std::to_string(i);
+            SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, last.c_str());
+            ADUC_D2C_Messaging_DoWork();
+            Respond(ADUC_D2C_Message_Type_Device_Update_Result, 200);
+        }
+        SendAsync(ADUC_D2C_Message_Type_Device_Update_Result, last.c_str());
+        ADUC_D2C_Messaging_DoWork();
+    }
+
+    struct stat st = {};
+    REQUIRE(stat(path.c_str(), &st) == 0);
+    CHECK(st.st_size < 100 * 1024);
+
+    CHECK(SentAfterRestart(path) == std::vector<std::string>{ last });
+}
@@ -0,0 +1,67 @@
+/**
+ * @file event_loop_utils.h
+ * @brief Utilities for waking the agent main loop only when there is work to do.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_EVENT_LOOP_UTILS_H
+#define ADUC_EVENT_LOOP_UTILS_H
+
+#include "aduc/c_utils.h"
+#include <stdbool.h>
+#include <time.h> // time_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief The reason ADUC_EventLoop_Wait() returned.
+ */
+typedef enum tagADUC_EventLoop_WaitResult
+{
+    ADUC_EventLoop_WaitResult_Error = 0, /**< The wait failed, or was interrupted by a signal */
+    ADUC_EventLoop_WaitResult_Timeout = 1, /**< The timeout elapsed without any event */
+    ADUC_EventLoop_WaitResult_Signaled = 2, /**< ADUC_EventLoop_Signal() was called */
+    ADUC_EventLoop_WaitResult_WakeupTime = 3, /**< The time set with ADUC_EventLoop_SetWakeupTime() was reached */
+} ADUC_EventLoop_WaitResult;
+
+/**
+ * @brief Creates the eventfd, timerfd and epoll instance the main loop waits on.
+ * @details Until this is called, or if it fails, ADUC_EventLoop_Wait() sleeps for its whole timeout, as the main
+ * loop did before.
+ *
+ * @return bool true on success.
+ */
+bool ADUC_EventLoop_Init();
+
+/**
+ * @brief Closes the file descriptors created by ADUC_EventLoop_Init().
+ */
+void ADUC_EventLoop_Uninit();
+
+/**
+ * @brief Wakes the thread blocked in ADUC_EventLoop_Wait(), or makes its next wait return at once.
+ * @details Safe to call from any thread, e.g. when a worker thread has queued a message for the main loop to send.
+ * Signals raised before the wait are coalesced.
+ */
+void ADUC_EventLoop_Signal();
+
+/**
+ * @brief Sets the time at which ADUC_EventLoop_Wait() returns even if nothing signals it, replacing any time set
+ * before.
+ *
+ * @param wakeupTimeEpoch The time since epoch, in seconds. 0 clears the wakeup time.
+ */
+void ADUC_EventLoop_SetWakeupTime(time_t wakeupTimeEpoch);
+
+/**
+ * @brief Blocks until ADUC_EventLoop_Signal() is called, the wakeup time is reached, or @p timeoutMs elapses.
+ *
+ * @param timeoutMs The maximum time to wait, in milliseconds.
+ * @return ADUC_EventLoop_WaitResult The reason the wait returned.
+ */
+ADUC_EventLoop_WaitResult ADUC_EventLoop_Wait(unsigned int timeoutMs);
+
+EXTERN_C_END
+
+#endif // ADUC_EVENT_LOOP_UTILS_H
@@ -0,0 +1,195 @@
+/**
+ * @file event_loop_utils.c
+ * @brief Implements utilities for waking the agent main loop only when there is work to do.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/event_loop_utils.h"
+#include "aduc/logging.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h> // uint64_t
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/**
+ * @brief Maximum number of events returned by a single epoll_wait.
+ */
+#define EVENT_LOOP_MAX_EVENTS 2
+
+static pthread_mutex_t s_eventLoopMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_epollFd = -1;
+static int s_eventFd = -1;
+static int s_timerFd = -1;
+
+/**
+ * @brief Closes @p fd if it is open, and marks it closed.
+ */
+static void CloseFd(int* fd)
+{
+    if (*fd != -1)
+    {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/**
+ * @brief Adds @p fd to the epoll instance, for read events.
+ */
+static bool WatchFd(int epollFd, int fd)
+{
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+/**
+ * @brief Reads the 8 byte counter of an eventfd or timerfd, which rearms it for the next event.
+ */
+static void DrainFd(int fd)
+{
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) != sizeof(count) && errno != EAGAIN)
+    {
+        Log_Warn("Failed to drain event loop fd %d (errno:%d)", fd, errno);
+    }
+}
+
+bool ADUC_EventLoop_Init()
+{
+    bool success = false;
+
+    pthread_mutex_lock(&s_eventLoopMutex);
+
+    if (s_epollFd != -1)
+    {
+        success = true;
+        goto done;
+    }
+
+    s_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    s_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    // The wakeup time is a time since epoch, so use the clock that time() reads.
+    s_timerFd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (s_epollFd == -1 || s_eventFd == -1 || s_timerFd == -1)
+    {
+        Log_Error("Failed to create event loop fds (errno:%d)", errno);
+        goto done;
+    }
+
+    if (!WatchFd(s_epollFd, s_eventFd) || !WatchFd(s_epollFd, s_timerFd))
+    {
+        Log_Error("Failed to add event loop fds to epoll (errno:%d)", errno);
+        goto done;
+    }
+
+    success = true;
+
+done:
+    if (!success)
+    {
+        CloseFd(&s_timerFd);
+        CloseFd(&s_eventFd);
+        CloseFd(&s_epollFd);
+    }
+
+    pthread_mutex_unlock(&s_eventLoopMutex);
+    return success;
+}
+
+void ADUC_EventLoop_Uninit()
+{
+    pthread_mutex_lock(&s_eventLoopMutex);
+    CloseFd(&s_timerFd);
+    CloseFd(&s_eventFd);
+    CloseFd(&s_epollFd);
+    pthread_mutex_unlock(&s_eventLoopMutex);
+}
+
+void ADUC_EventLoop_Signal()
+{
+    pthread_mutex_lock(&s_eventLoopMutex);
+    if (s_eventFd != -1)
+    {
+        const uint64_t one = 1;
+        // EAGAIN only when the counter is about to overflow, in which case the loop is already signaled.
+        if (write(s_eventFd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN)
+        {
+            Log_Warn("Failed to signal event loop (errno:%d)", errno);
+        }
+    }
+    pthread_mutex_unlock(&s_eventLoopMutex);
+}
+
+void ADUC_EventLoop_SetWakeupTime(time_t wakeupTimeEpoch)
+{
+    pthread_mutex_lock(&s_eventLoopMutex);
+    if (s_timerFd != -1)
+    {
+        // An all zero it_value disarms the timer; a time already passed fires it at once.
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = wakeupTimeEpoch;
+        if (timerfd_settime(s_timerFd, TFD_TIMER_ABSTIME, &spec, NULL) != 0)
+        {
+            Log_Warn("Failed to set event loop wakeup time %ld (errno:%d)", (long)wakeupTimeEpoch, errno);
+        }
+    }
+    pthread_mutex_unlock(&s_eventLoopMutex);
+}
+
+ADUC_EventLoop_WaitResult ADUC_EventLoop_Wait(unsigned int timeoutMs)
+{
+    ADUC_EventLoop_WaitResult result = ADUC_EventLoop_WaitResult_Timeout;
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+
+    pthread_mutex_lock(&s_eventLoopMutex);
+    const int epollFd = s_epollFd;
+    const int eventFd = s_eventFd;
+    const int timerFd = s_timerFd;
+    pthread_mutex_unlock(&s_eventLoopMutex);
+
+    if (epollFd == -1)
+    {
+        struct timespec delay = { .tv_sec = timeoutMs / 1000, .tv_nsec = (long)(timeoutMs % 1000) * 1000000 };
+        nanosleep(&delay, NULL);
+        return ADUC_EventLoop_WaitResult_Timeout;
+    }
+
+    const int count = epoll_wait(epollFd, events, EVENT_LOOP_MAX_EVENTS, (int)timeoutMs);
+
+    if (count < 0)
+    {
+        // EINTR is expected when a shutdown or restart signal arrives.
+        if (errno != EINTR)
+        {
+            Log_Error("epoll_wait failed (errno:%d)", errno);
+        }
+        return ADUC_EventLoop_WaitResult_Error;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (events[i].data.fd == eventFd)
+        {
+            DrainFd(eventFd);
+            result = ADUC_EventLoop_WaitResult_Signaled;
+        }
+        else if (events[i].data.fd == timerFd)
+        {
+            DrainFd(timerFd);
+            if (result != ADUC_EventLoop_WaitResult_Signaled)
+            {
+                result = ADUC_EventLoop_WaitResult_WakeupTime;
+            }
+        }
+    }
+
+    return result;
+}
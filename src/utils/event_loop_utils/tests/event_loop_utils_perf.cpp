@@ -0,0 +1,97 @@
+/**
+ * @file event_loop_utils_perf.cpp
+ * @brief Compares waking the main loop through the event loop with the 100 ms polling sleep it replaces.
+ *
+ * Hidden from the default run. Use: event_loop_utils_unit_test "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/event_loop_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using std::chrono::steady_clock;
+
+namespace
+{
+/**
+ * @brief Runs a main loop for @p duration while a worker completes @p completions pieces of work, and reports the
+ * loop's wakeups and the delay between each completion and the pass of the loop that would report it.
+ *
+ * @param name The name printed for the loop.
+ * @param duration How long the loop runs.
+ * @param completions How many completions the worker signals, evenly spread over @p duration.
+ * @param wait Blocks the loop between passes.
+ */
+template<typename WaitFunc>
+void MeasureLoop(const char* name, std::chrono::milliseconds duration, int completions, WaitFunc wait)
+{
+    std::atomic<bool> stop{ false };
+    std::atomic<int64_t> completedAt{ 0 };
+    std::vector<double> latenciesMs;
+    int wakeups = 0;
+
+    std::thread worker{ [&] {
+        const auto interval = duration / (completions + 1);
+        for (int i = 0; i < completions && !stop; ++i)
+        {
+            std::this_thread::sleep_for(interval);
+            completedAt = steady_clock::now().time_since_epoch().count();
+            ADUC_EventLoop_Signal();
+        }
+    } };
+
+    const auto end = steady_clock::now() + duration;
+    while (steady_clock::now() < end)
+    {
+        const int64_t completed = completedAt.exchange(0);
+        if (completed != 0)
+        {
+            const auto latency = steady_clock::now().time_since_epoch() - steady_clock::duration(completed);
+            latenciesMs.push_back(std::chrono::duration<double, std::milli>(latency).count());
+        }
+
+        wait();
+        ++wakeups;
+    }
+
+    stop = true;
+    worker.join();
+
+    std::sort(latenciesMs.begin(), latenciesMs.end());
+    const double minutes = std::chrono::duration<double>(duration).count() / 60.0;
+
+    std::cout << name << "\twakeups/min: " << wakeups / minutes;
+    if (!latenciesMs.empty())
+    {
+        std::cout << "\tcompletion latency ms p50: " << latenciesMs[latenciesMs.size() / 2]
+                  << " max: " << latenciesMs.back();
+    }
+    std::cout << std::endl;
+}
+} // namespace
+
+TEST_CASE("Main loop wakeups and completion latency", "[.][perf]")
+{
+    const std::chrono::milliseconds duration{ 10000 };
+    const int completions = 20;
+
+    MeasureLoop("sleep(100)", duration, completions, [] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    });
+
+    REQUIRE(ADUC_EventLoop_Init());
+
+    MeasureLoop("wait(1000)", duration, completions, [] { ADUC_EventLoop_Wait(1000); });
+    MeasureLoop("wait(1000) idle", duration, 0, [] { ADUC_EventLoop_Wait(1000); });
+
+    ADUC_EventLoop_Uninit();
+}
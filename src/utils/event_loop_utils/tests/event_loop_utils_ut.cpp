@@ -0,0 +1,110 @@
+/**
+ * @file event_loop_utils_ut.cpp
+ * @brief Unit Tests for event_loop_utils library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/event_loop_utils.h"
+
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <thread>
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace
+{
+/**
+ * @brief Initializes the event loop for the duration of a test.
+ */
+class EventLoop
+{
+public:
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+    EventLoop(EventLoop&&) = delete;
+    EventLoop& operator=(EventLoop&&) = delete;
+
+    EventLoop()
+    {
+        REQUIRE(ADUC_EventLoop_Init());
+    }
+
+    ~EventLoop()
+    {
+        ADUC_EventLoop_Uninit();
+    }
+};
+} // namespace
+
+TEST_CASE("ADUC_EventLoop_Wait")
+{
+    EventLoop eventLoop;
+
+    SECTION("Times out when nothing happens")
+    {
+        const auto start = steady_clock::now();
+        CHECK(ADUC_EventLoop_Wait(50) == ADUC_EventLoop_WaitResult_Timeout);
+        CHECK(steady_clock::now() - start >= milliseconds(40));
+    }
+
+    SECTION("Signal from another thread ends the wait")
+    {
+        std::thread worker{ [] {
+            std::this_thread::sleep_for(milliseconds(50));
+            ADUC_EventLoop_Signal();
+        } };
+
+        const auto start = steady_clock::now();
+        CHECK(ADUC_EventLoop_Wait(10000) == ADUC_EventLoop_WaitResult_Signaled);
+        CHECK(steady_clock::now() - start < milliseconds(5000));
+        worker.join();
+    }
+
+    SECTION("Signals before the wait are coalesced")
+    {
+        ADUC_EventLoop_Signal();
+        ADUC_EventLoop_Signal();
+        ADUC_EventLoop_Signal();
+
+        CHECK(ADUC_EventLoop_Wait(0) == ADUC_EventLoop_WaitResult_Signaled);
+        CHECK(ADUC_EventLoop_Wait(0) == ADUC_EventLoop_WaitResult_Timeout);
+    }
+
+    SECTION("Wakeup time already passed ends the wait at once")
+    {
+        ADUC_EventLoop_SetWakeupTime(time(nullptr) - 1);
+
+        const auto start = steady_clock::now();
+        CHECK(ADUC_EventLoop_Wait(10000) == ADUC_EventLoop_WaitResult_WakeupTime);
+        CHECK(steady_clock::now() - start < milliseconds(5000));
+
+        // The timer fires once.
+        CHECK(ADUC_EventLoop_Wait(0) == ADUC_EventLoop_WaitResult_Timeout);
+    }
+
+    SECTION("Wakeup time ends the wait when it is reached")
+    {
+        ADUC_EventLoop_SetWakeupTime(time(nullptr) + 1);
+        CHECK(ADUC_EventLoop_Wait(10000) == ADUC_EventLoop_WaitResult_WakeupTime);
+    }
+
+    SECTION("Cleared wakeup time does not end the wait")
+    {
+        ADUC_EventLoop_SetWakeupTime(time(nullptr) + 1);
+        ADUC_EventLoop_SetWakeupTime(0);
+        CHECK(ADUC_EventLoop_Wait(1500) == ADUC_EventLoop_WaitResult_Timeout);
+    }
+}
+
+TEST_CASE("ADUC_EventLoop_Wait without ADUC_EventLoop_Init sleeps for the timeout")
+{
+    // Signal is a no-op until the loop is initialized.
+    ADUC_EventLoop_Signal();
+
+    const auto start = steady_clock::now();
+    CHECK(ADUC_EventLoop_Wait(50) == ADUC_EventLoop_WaitResult_Timeout);
+    CHECK(steady_clock::now() - start >= milliseconds(40));
+}
@@ -43,7 +43,7 @@ void findFilesInDir(const std::string& dirPath, std::vector<std::string>* outPat
             }
 
             std::stringstream ss;
-            ss << dirPath << "/" << file->d_name;
+            ss << nextDir << "/" << file->d_name;
             std::string path{ ss.str() };
 
             if (SystemUtils_IsDir(path.c_str(), nullptr))
@@ -0,0 +1,95 @@
+/**
+ * @file content_store.h
+ * @brief A content-addressed store of verified payload files, keyed by hash.
+ *
+ * Blobs live in one folder on the same file system as the workflow sandboxes, and are read-only. Files go in and out
+ * as reflinks where the file system supports them, and as hard links otherwise; the store never copies a payload, so
+ * it costs no disk space while a sandbox still holds the file. A payload that is already on the device is not
+ * fetched again. The store is kept within contentStoreMaxMegabytes of du-config.json.
+ *
+ * Each workflow sandbox that uses a blob holds a reference to it. Sweeping the store when a workflow sandbox is
+ * removed releases the references of the sandbox, and removes blobs that no sandbox references.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_CONTENT_STORE_H
+#define ADUC_CONTENT_STORE_H
+
+#include "aduc/c_utils.h"
+
+#include "azure_c_shared_utility/sha.h" // for SHAversion
+
+#include <stdbool.h> // for bool
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Links the blob with hash @p hashBase64 to @p targetPath, and adds a reference to it from
+ * @p referencingFolder.
+ * @details The caller must still verify the file before trusting it, and call ADUC_ContentStore_Remove if it does
+ * not match. A hard-linked file is read-only.
+ *
+ * @param hashBase64 The base64 encoded hash of the content.
+ * @param algorithm The hashing algorithm of @p hashBase64.
+ * @param targetPath The path to copy the blob to. Must not exist.
+ * @param referencingFolder The sandbox of the workflow that uses the copy. May be NULL.
+ * @return bool True if @p targetPath now has the blob's content; false if there is no such blob or it cannot be
+ * linked.
+ */
+bool ADUC_ContentStore_CopyOut(
+    const char* hashBase64, SHAversion algorithm, const char* targetPath, const char* referencingFolder);
+
+/**
+ * @brief Links the file at @p filePath into the store, if the store has no blob with that hash yet and has room for
+ * it, and adds a reference to the blob from @p referencingFolder.
+ * @details Only call this after the content of @p filePath was verified to have hash @p hashBase64. If the file is
+ * hard-linked, it becomes read-only.
+ *
+ * @param filePath The verified file.
+ * @param hashBase64 The base64 encoded hash of the file.
+ * @param algorithm The hashing algorithm of @p hashBase64.
+ * @param referencingFolder The sandbox of the workflow that uses the file. May be NULL.
+ * @return bool True if the store holds a blob with that hash on return.
+ */
+bool ADUC_ContentStore_Insert(
+    const char* filePath, const char* hashBase64, SHAversion algorithm, const char* referencingFolder);
+
+/**
+ * @brief Removes the blob with hash @p hashBase64 and its references, e.g. after it failed verification.
+ *
+ * @param hashBase64 The base64 encoded hash of the content.
+ * @param algorithm The hashing algorithm of @p hashBase64.
+ */
+void ADUC_ContentStore_Remove(const char* hashBase64, SHAversion algorithm);
+
+/**
+ * @brief Releases the references held by @p releasedFolder and its subfolders, and by sandboxes that no longer
+ * exist, then removes every blob that has no references left.
+ * @details Call this whenever a workflow sandbox is removed, passing the sandbox.
+ *
+ * @param releasedFolder A folder whose references no longer count. May be NULL.
+ * @return size_t The number of blobs removed.
+ */
+size_t ADUC_ContentStore_Sweep(const char* releasedFolder);
+
+/**
+ * @brief Sets the store folder.
+ *
+ * @param folderPath The folder. NULL restores the default, ADUC_CONTENT_STORE_FOLDER.
+ * @return bool True on success.
+ */
+bool ADUC_ContentStore_SetFolder(const char* folderPath);
+
+/**
+ * @brief Sets the maximum size of the store, in place of contentStoreMaxMegabytes of du-config.json.
+ *
+ * @param maxSize The size in bytes; 0 disables the store. NULL restores the size from du-config.json.
+ */
+void ADUC_ContentStore_SetMaxSize(const uint64_t* maxSize);
+
+EXTERN_C_END
+
+#endif // ADUC_CONTENT_STORE_H
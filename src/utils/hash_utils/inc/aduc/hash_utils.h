@@ -15,9 +15,30 @@
 
 #include <stdbool.h> // for bool
 #include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint64_t
 
 EXTERN_C_BEGIN
 
+/**
+ * @brief The default number of bytes read from a file per digest update.
+ */
+#define ADUC_HASH_UTILS_DEFAULT_READ_BLOCK_SIZE (256 * 1024)
+
+/**
+ * @brief The digest implementations available for hashing.
+ */
+typedef enum tagADUC_HashUtils_Backend
+{
+    ADUC_HashUtils_Backend_Default = 0, /**< OpenSSL EVP, falling back to USHA if EVP is unusable. */
+    ADUC_HashUtils_Backend_USHA = 1, /**< The portable USHA reference implementation. */
+    ADUC_HashUtils_Backend_EVP = 2, /**< OpenSSL EVP, which uses SHA-NI/ARMv8 crypto extensions when present. */
+} ADUC_HashUtils_Backend;
+
+/**
+ * @brief Opaque handle to an incremental digest, for hashing content as it streams in.
+ */
+typedef struct tagADUC_HashUtils_DigestContext* ADUC_HashUtils_DigestHandle;
+
 bool ADUC_HashUtils_IsValidFileHash(
     const char* path, const char* hashBase64, SHAversion algorithm, bool suppressErrorLog);
 
@@ -28,6 +49,83 @@ bool ADUC_HashUtils_GetShaVersionForTypeString(const char* hashTypeStr, SHAversi
 
 bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** hash);
 
+/**
+ * @brief Calculates the hash of the file at @p path using the given digest backend and read block size.
+ *
+ * @param path The path to the file.
+ * @param algorithm The hashing algorithm to use to calculate the hash.
+ * @param backend The digest backend.
+ * @param readBlockSize The number of bytes per read. 0 maps the file if it can, and otherwise reads it
+ * ADUC_HASH_UTILS_DEFAULT_READ_BLOCK_SIZE bytes at a time.
+ * @param hash [out] The base64 encoded hash. Caller must call free() when done with the returned buffer.
+ * @return bool True if the hash data is successfully generated.
+ */
+bool ADUC_HashUtils_GetFileHashEx(
+    const char* path, SHAversion algorithm, ADUC_HashUtils_Backend backend, size_t readBlockSize, char** hash);
+
+/**
+ * @brief Creates an incremental digest for @p algorithm.
+ *
+ * @param algorithm The hashing algorithm.
+ * @return ADUC_HashUtils_DigestHandle The digest handle, or NULL on failure. Caller must call
+ * ADUC_HashUtils_DigestFree() when done.
+ */
+ADUC_HashUtils_DigestHandle ADUC_HashUtils_DigestCreate(SHAversion algorithm);
+
+/**
+ * @brief Feeds the next @p length bytes of content into the digest.
+ *
+ * @param handle The digest handle.
+ * @param data The content.
+ * @param length The length of @p data.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_DigestUpdate(ADUC_HashUtils_DigestHandle handle, const uint8_t* data, size_t length);
+
+/**
+ * @brief Discards all content fed so far, e.g. when a download restarts from the beginning.
+ *
+ * @param handle The digest handle.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_DigestReset(ADUC_HashUtils_DigestHandle handle);
+
+/**
+ * @brief Gets the number of bytes fed into the digest since it was created or last reset.
+ *
+ * @param handle The digest handle.
+ * @return uint64_t The byte count.
+ */
+uint64_t ADUC_HashUtils_DigestGetBytesConsumed(ADUC_HashUtils_DigestHandle handle);
+
+/**
+ * @brief Finalizes the digest and checks whether it matches @p hashBase64.
+ * @details The digest cannot be updated afterwards, unless it is reset.
+ *
+ * @param handle The digest handle.
+ * @param hashBase64 The expected base64 encoded hash.
+ * @param suppressErrorLog Whether to suppress error logging.
+ * @return bool true if the hash matches @p hashBase64.
+ */
+bool ADUC_HashUtils_DigestIsValid(ADUC_HashUtils_DigestHandle handle, const char* hashBase64, bool suppressErrorLog);
+
+/**
+ * @brief Finalizes the digest and returns the base64 encoded hash.
+ * @details The digest cannot be updated afterwards, unless it is reset.
+ *
+ * @param handle The digest handle.
+ * @param hashBase64 [out] The base64 encoded hash. Caller must call free() when done with the returned buffer.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_DigestGetHash(ADUC_HashUtils_DigestHandle handle, char** hashBase64);
+
+/**
+ * @brief Frees the digest.
+ *
+ * @param handle The digest handle. May be NULL.
+ */
+void ADUC_HashUtils_DigestFree(ADUC_HashUtils_DigestHandle handle);
+
 /**
  * @brief Get file hash type at specified index.
  * @param hashArray The ADUC_Hash array.
@@ -70,6 +168,18 @@ void ADUC_Hash_UnInit(ADUC_Hash* hash);
  */
 void ADUC_Hash_FreeArray(size_t hashCount, ADUC_Hash* hashArray);
 
+/**
+ * @brief Finds the hash with the strongest algorithm that is valid for file digests.
+ *
+ * @param hashes The array of ADUC_Hash objects.
+ * @param hashCount The length of the array.
+ * @param outIndexStrongestAlgorithm [out] The index of the strongest hash.
+ * @param outBestShaVersion [out] The algorithm of the strongest hash.
+ * @return bool false if there is no hash with a valid algorithm, or a hash has an unsupported algorithm.
+ */
+bool ADUC_HashUtils_GetIndexStrongestValidHash(
+    const ADUC_Hash* hashes, size_t hashCount, size_t* outIndexStrongestAlgorithm, SHAversion* outBestShaVersion);
+
 /**
  * @brief For the given array of ADUC_Hash, it will verify that the hash of the file contents matches the strongest hash in the array.
  *
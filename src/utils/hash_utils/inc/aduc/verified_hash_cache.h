@@ -0,0 +1,81 @@
+/**
+ * @file verified_hash_cache.h
+ * @brief A persistent cache of file hashes that have already been verified.
+ *
+ * Entries are keyed by path and hash algorithm, and are only trusted while the file's
+ * device, inode, size, mtime and ctime are unchanged, so an unchanged payload is not re-hashed
+ * after an agent restart or workflow retry.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_VERIFIED_HASH_CACHE_H
+#define ADUC_VERIFIED_HASH_CACHE_H
+
+#include "aduc/c_utils.h"
+#include "aduc/types/hash.h" // for ADUC_Hash
+
+#include "azure_c_shared_utility/sha.h" // for SHAversion
+
+#include <stdbool.h> // for bool
+#include <stddef.h> // for size_t
+
+/**
+ * @brief The maximum number of entries kept. The least recently recorded entries are dropped first.
+ */
+#define ADUC_VERIFIED_HASH_CACHE_MAX_ENTRIES 512
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Checks if the hash of the file at @p path matches @p hashBase64, using the cache when the file is unchanged
+ * since it was last verified. A successful full hash check is recorded in the cache.
+ *
+ * @param path The path to the file to check.
+ * @param hashBase64 The expected hash of the file at @p path.
+ * @param algorithm The hashing algorithm to use to calculate the hash.
+ * @param suppressErrorLog A boolean indicates whether to log error message inside this function.
+ * @return bool True if the hash is valid and matches @p hashBase64.
+ */
+bool ADUC_VerifiedHashCache_IsValidFileHash(
+    const char* path, const char* hashBase64, SHAversion algorithm, bool suppressErrorLog);
+
+/**
+ * @brief Like ADUC_HashUtils_VerifyWithStrongestHash, but uses and updates the cache.
+ *
+ * @param path The path to the file to check.
+ * @param hashes The array of ADUC_Hash objects.
+ * @param hashCount The length of the array.
+ * @return bool True if the hash with the strongest valid algorithm matches the file at @p path.
+ */
+bool ADUC_VerifiedHashCache_VerifyWithStrongestHash(const char* path, const ADUC_Hash* hashes, size_t hashCount);
+
+/**
+ * @brief Records that the current content of the file at @p path has hash @p hashBase64.
+ * @details Only call this after the content was verified, e.g. with a streaming digest.
+ *
+ * @param path The path to the file.
+ * @param hashBase64 The verified hash.
+ * @param algorithm The hashing algorithm.
+ * @return bool True if recorded.
+ */
+bool ADUC_VerifiedHashCache_Record(const char* path, const char* hashBase64, SHAversion algorithm);
+
+/**
+ * @brief Removes all entries for the file at @p path.
+ *
+ * @param path The path to the file.
+ */
+void ADUC_VerifiedHashCache_Remove(const char* path);
+
+/**
+ * @brief Sets the file that the cache is persisted to, and drops the in-memory copy so it is reloaded.
+ *
+ * @param filePath The cache file path. NULL restores the default, ADUC_VERIFIED_HASH_CACHE_FILE_PATH.
+ * @return bool True on success.
+ */
+bool ADUC_VerifiedHashCache_SetFilePath(const char* filePath);
+
+EXTERN_C_END
+
+#endif // ADUC_VERIFIED_HASH_CACHE_H
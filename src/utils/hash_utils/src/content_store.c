@@ -0,0 +1,625 @@
+/**
+ * @file content_store.c
+ * @brief Implements a content-addressed store of verified payload files.
+ *
+ * Each blob is a read-only file named "<alg>-<hash>" in the store folder, where <hash> is the base64 hash with '/'
+ * and '+' replaced by '_' and '-'. Files go in and out of the store as reflinks where the file system supports them,
+ * and as hard links otherwise, so that the store never copies a payload. A hard-linked sandbox file is the blob, so it
+ * is read-only too; a change to it is caught by the verification that follows every copy out.
+ *
+ * The references to a blob are files in ".refs/<alg>-<hash>/", one per referencing workflow sandbox, named by a hash
+ * of the sandbox path and holding that path. A reference whose sandbox no longer exists is dropped by the next
+ * sweep, so references left behind by a crash do not keep blobs forever.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/content_store.h"
+
+#include <aduc/config_utils.h> // for ADUC_ConfigInfo
+#include <aduc/logging.h>
+#include <aduc/string_c_utils.h> // for IsNullOrEmpty
+#include <aduc/system_utils.h> // for ADUC_SystemUtils_CloneFile
+
+#include <azure_c_shared_utility/crt_abstractions.h> // for mallocAndStrcpy_s
+
+#include <dirent.h> // for opendir, readdir
+#include <errno.h>
+#include <inttypes.h> // for PRIx64
+#include <limits.h> // for PATH_MAX
+#include <pthread.h>
+#include <stdint.h> // for uint64_t
+#include <stdio.h> // for snprintf, fopen, rename
+#include <stdlib.h> // for free
+#include <string.h> // for strlen, strcmp, strncmp
+#include <sys/stat.h> // for stat, mkdir, chmod
+#include <unistd.h> // for access, getpid, unlink, rmdir
+
+#ifndef ADUC_CONTENT_STORE_FOLDER
+#    define ADUC_CONTENT_STORE_FOLDER "/var/lib/adu/downloads/.blobs"
+#endif
+
+/**
+ * @brief The longest base64 hash accepted as a key. SHA512 is 88 characters.
+ */
+#define MAX_HASH_LENGTH 128
+
+/**
+ * @brief The folder, under the store folder, that holds the references of each blob.
+ */
+#define REFS_FOLDER_NAME ".refs"
+
+/**
+ * @brief The mode of a blob, and of the sandbox files linked to it. Blobs are only ever replaced, never written in
+ * place. Readable by all, as the downloaded file was.
+ */
+#define BLOB_MODE (S_IRUSR | S_IRGRP | S_IROTH)
+
+/**
+ * @brief The mode of a file cloned out of the store, as a freshly downloaded file would have.
+ */
+#define COPY_OUT_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+/**
+ * @brief Makes the temp file names of concurrent inserts unique within the process.
+ */
+static unsigned int s_insertCounter = 0;
+
+static pthread_mutex_t s_storeMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief The store folder. NULL means ADUC_CONTENT_STORE_FOLDER.
+ */
+static char* s_storeFolder = NULL;
+
+/**
+ * @brief The maximum size of the store set by ADUC_ContentStore_SetMaxSize. Only used if s_hasMaxSize.
+ */
+static uint64_t s_maxSize = 0;
+static bool s_hasMaxSize = false;
+
+/**
+ * @brief Gets the name of a hash algorithm for use in a blob name.
+ * @param algorithm The hash algorithm.
+ * @return const char* The name, or NULL if not supported.
+ */
+static const char* GetAlgorithmName(SHAversion algorithm)
+{
+    switch (algorithm)
+    {
+    case SHA1:
+        return "sha1";
+    case SHA224:
+        return "sha224";
+    case SHA256:
+        return "sha256";
+    case SHA384:
+        return "sha384";
+    case SHA512:
+        return "sha512";
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief Copies the store folder path to @p folder.
+ * @param folder The output buffer, PATH_MAX bytes.
+ */
+static void GetStoreFolder(char* folder)
+{
+    pthread_mutex_lock(&s_storeMutex);
+    snprintf(folder, PATH_MAX, "%s", (s_storeFolder != NULL) ? s_storeFolder : ADUC_CONTENT_STORE_FOLDER);
+    pthread_mutex_unlock(&s_storeMutex);
+}
+
+/**
+ * @brief Gets the maximum size of the store: the one set by ADUC_ContentStore_SetMaxSize, or else
+ * contentStoreMaxMegabytes from du-config.json.
+ * @return uint64_t The size in bytes. 0 if the store is disabled.
+ */
+static uint64_t GetMaxStoreSize(void)
+{
+    const uint64_t megabyte = 1024ULL * 1024ULL;
+    uint64_t maxSize = ADUC_CONFIG_DEFAULT_CONTENT_STORE_MAX_MEGABYTES * megabyte;
+
+    pthread_mutex_lock(&s_storeMutex);
+    const bool hasMaxSize = s_hasMaxSize;
+    if (hasMaxSize)
+    {
+        maxSize = s_maxSize;
+    }
+    pthread_mutex_unlock(&s_storeMutex);
+
+    if (!hasMaxSize)
+    {
+        const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+        if (config != NULL)
+        {
+            maxSize = config->contentStoreMaxMegabytes * megabyte;
+        }
+        ADUC_ConfigInfo_ReleaseInstance(config);
+    }
+
+    return maxSize;
+}
+
+/**
+ * @brief Builds the name of the blob with hash @p hashBase64.
+ * @param hashBase64 The base64 encoded hash.
+ * @param algorithm The hash algorithm.
+ * @param name The output buffer, NAME_MAX + 1 bytes.
+ * @return bool False if the hash is not valid base64 or the algorithm is not supported.
+ */
+static bool MakeBlobName(const char* hashBase64, SHAversion algorithm, char* name)
+{
+    const char* algorithmName = GetAlgorithmName(algorithm);
+    char key[MAX_HASH_LENGTH + 1];
+    size_t length = 0;
+
+    if (algorithmName == NULL || IsNullOrEmpty(hashBase64))
+    {
+        return false;
+    }
+
+    for (; hashBase64[length] != '\0'; ++length)
+    {
+        char c = hashBase64[length];
+        if (length == MAX_HASH_LENGTH)
+        {
+            return false;
+        }
+
+        if (c == '/')
+        {
+            c = '_';
+        }
+        else if (c == '+')
+        {
+            c = '-';
+        }
+        else if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '='))
+        {
+            return false;
+        }
+
+        key[length] = c;
+    }
+    key[length] = '\0';
+
+    const int written = snprintf(name, NAME_MAX + 1, "%s-%s", algorithmName, key);
+    return written > 0 && written <= NAME_MAX;
+}
+
+/**
+ * @brief Joins up to three path segments. @p c may be NULL.
+ * @param path The output buffer, PATH_MAX bytes.
+ * @return bool False if the path is too long.
+ */
+static bool JoinPath(char* path, const char* a, const char* b, const char* c)
+{
+    const int written = (c == NULL) ? snprintf(path, PATH_MAX, "%s/%s", a, b)
+                                    : snprintf(path, PATH_MAX, "%s/%s/%s", a, b, c);
+    return written > 0 && written < PATH_MAX;
+}
+
+/**
+ * @brief Creates @p folder if it does not exist. Its parent must exist.
+ * @return bool True if the folder exists on return.
+ */
+static bool EnsureFolder(const char* folder)
+{
+    return mkdir(folder, S_IRWXU | S_IRWXG) == 0 || errno == EEXIST;
+}
+
+/**
+ * @brief Gets the total size of the blobs in the store.
+ * @param storeFolder The store folder.
+ * @return uint64_t The size in bytes.
+ */
+static uint64_t GetStoreSize(const char* storeFolder)
+{
+    uint64_t size = 0;
+    char blobPath[PATH_MAX];
+    struct dirent* entry = NULL;
+
+    DIR* dir = opendir(storeFolder);
+    if (dir == NULL)
+    {
+        return 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+
+        // Skips the references folder and temp files.
+        if (entry->d_name[0] != '.' && JoinPath(blobPath, storeFolder, entry->d_name, NULL)
+            && lstat(blobPath, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            size += (uint64_t)st.st_size;
+        }
+    }
+
+    closedir(dir);
+    return size;
+}
+
+/**
+ * @brief Adds a reference from @p referencingFolder to the blob @p blobName, unless it has one already.
+ * @param storeFolder The store folder.
+ * @param blobName The blob name.
+ * @param referencingFolder The workflow sandbox that uses the blob.
+ * @return bool True if the reference exists on return.
+ */
+static bool AddReference(const char* storeFolder, const char* blobName, const char* referencingFolder)
+{
+    char refsFolder[PATH_MAX];
+    char refsBlobFolder[PATH_MAX];
+    char refPath[PATH_MAX];
+    char refName[sizeof(uint64_t) * 2 + 1];
+    bool succeeded = false;
+
+    // FNV-1a of the path. A collision merely merges two references.
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* p = referencingFolder; *p != '\0'; ++p)
+    {
+        hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    snprintf(refName, sizeof(refName), "%016" PRIx64, hash);
+
+    if (!JoinPath(refsFolder, storeFolder, REFS_FOLDER_NAME, NULL)
+        || !JoinPath(refsBlobFolder, storeFolder, REFS_FOLDER_NAME, blobName)
+        || !JoinPath(refPath, refsBlobFolder, refName, NULL))
+    {
+        return false;
+    }
+
+    if (access(refPath, F_OK) == 0)
+    {
+        return true;
+    }
+
+    if (!EnsureFolder(refsFolder) || !EnsureFolder(refsBlobFolder))
+    {
+        return false;
+    }
+
+    FILE* file = fopen(refPath, "w");
+    if (file != NULL)
+    {
+        succeeded = fputs(referencingFolder, file) >= 0;
+        succeeded = (fclose(file) == 0) && succeeded;
+    }
+
+    if (!succeeded)
+    {
+        Log_Debug("Cannot add reference '%s', errno %d.", refPath, errno);
+        (void)unlink(refPath);
+    }
+
+    return succeeded;
+}
+
+/**
+ * @brief Checks whether @p path is @p folder or is under it.
+ */
+static bool IsPathUnderFolder(const char* path, const char* folder)
+{
+    const size_t folderLength = strlen(folder);
+    return strncmp(path, folder, folderLength) == 0 && (path[folderLength] == '\0' || path[folderLength] == '/');
+}
+
+/**
+ * @brief Drops the references of a blob held by @p releasedFolder, or by sandboxes that no longer exist.
+ * @param refsBlobFolder The references folder of the blob.
+ * @param releasedFolder A folder whose references no longer count. May be NULL.
+ * @return size_t The number of references left.
+ */
+static size_t ReleaseReferences(const char* refsBlobFolder, const char* releasedFolder)
+{
+    size_t remaining = 0;
+    char refPath[PATH_MAX];
+    char referencingFolder[PATH_MAX];
+    struct dirent* entry = NULL;
+
+    DIR* dir = opendir(refsBlobFolder);
+    if (dir == NULL)
+    {
+        return 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.' || !JoinPath(refPath, refsBlobFolder, entry->d_name, NULL))
+        {
+            continue;
+        }
+
+        bool read = false;
+        FILE* file = fopen(refPath, "r");
+        if (file != NULL)
+        {
+            read = fgets(referencingFolder, sizeof(referencingFolder), file) != NULL;
+            fclose(file);
+        }
+
+        if (!read || access(referencingFolder, F_OK) != 0
+            || (!IsNullOrEmpty(releasedFolder) && IsPathUnderFolder(referencingFolder, releasedFolder)))
+        {
+            (void)unlink(refPath);
+        }
+        else
+        {
+            ++remaining;
+        }
+    }
+
+    closedir(dir);
+    return remaining;
+}
+
+/**
+ * @brief Removes all references of the blob @p blobName.
+ */
+static void RemoveReferences(const char* storeFolder, const char* blobName)
+{
+    char refsBlobFolder[PATH_MAX];
+    char refPath[PATH_MAX];
+    struct dirent* entry = NULL;
+
+    if (!JoinPath(refsBlobFolder, storeFolder, REFS_FOLDER_NAME, blobName))
+    {
+        return;
+    }
+
+    DIR* dir = opendir(refsBlobFolder);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.' && JoinPath(refPath, refsBlobFolder, entry->d_name, NULL))
+        {
+            (void)unlink(refPath);
+        }
+    }
+
+    closedir(dir);
+    (void)rmdir(refsBlobFolder);
+}
+
+/**
+ * @brief Creates @p destPath as a reflink of @p srcPath, or else as a hard link to it.
+ * @param srcPath The existing file.
+ * @param destPath The new file. Must not exist.
+ * @param[out] linked Set to true if @p destPath is a hard link, which shares the inode and mode of @p srcPath.
+ * @return bool True on success; false with errno set if neither is possible, e.g. EXDEV across file systems.
+ */
+static bool LinkOrClone(const char* srcPath, const char* destPath, bool* linked)
+{
+    *linked = false;
+
+    if (ADUC_SystemUtils_CloneFile(srcPath, destPath) == 0)
+    {
+        return true;
+    }
+
+    if (errno == ENOENT || errno == EEXIST)
+    {
+        return false;
+    }
+
+    if (link(srcPath, destPath) != 0)
+    {
+        return false;
+    }
+
+    *linked = true;
+    return true;
+}
+
+bool ADUC_ContentStore_CopyOut(
+    const char* hashBase64, SHAversion algorithm, const char* targetPath, const char* referencingFolder)
+{
+    char storeFolder[PATH_MAX];
+    char blobName[NAME_MAX + 1];
+    char blobPath[PATH_MAX];
+
+    GetStoreFolder(storeFolder);
+
+    if (IsNullOrEmpty(targetPath) || !MakeBlobName(hashBase64, algorithm, blobName)
+        || !JoinPath(blobPath, storeFolder, blobName, NULL))
+    {
+        return false;
+    }
+
+    // A reflink shares the blob's extents until either file is written. A hard link keeps the blob's read-only mode.
+    bool linked = false;
+    if (!LinkOrClone(blobPath, targetPath, &linked))
+    {
+        if (errno != ENOENT)
+        {
+            Log_Debug("Cannot link blob '%s' to '%s', errno %d.", blobPath, targetPath, errno);
+        }
+        return false;
+    }
+
+    if (!linked && chmod(targetPath, COPY_OUT_MODE) != 0)
+    {
+        Log_Debug("Cannot chmod '%s', errno %d.", targetPath, errno);
+        (void)unlink(targetPath);
+        return false;
+    }
+
+    if (!IsNullOrEmpty(referencingFolder))
+    {
+        (void)AddReference(storeFolder, blobName, referencingFolder);
+    }
+
+    Log_Info("Reusing '%s' for '%s'.", blobPath, targetPath);
+    return true;
+}
+
+bool ADUC_ContentStore_Insert(
+    const char* filePath, const char* hashBase64, SHAversion algorithm, const char* referencingFolder)
+{
+    char storeFolder[PATH_MAX];
+    char blobName[NAME_MAX + 1];
+    char blobPath[PATH_MAX];
+    char tempPath[PATH_MAX];
+
+    GetStoreFolder(storeFolder);
+
+    if (IsNullOrEmpty(filePath) || !MakeBlobName(hashBase64, algorithm, blobName)
+        || !JoinPath(blobPath, storeFolder, blobName, NULL))
+    {
+        return false;
+    }
+
+    if (access(blobPath, F_OK) != 0)
+    {
+        struct stat st;
+        const uint64_t maxSize = GetMaxStoreSize();
+        if (stat(filePath, &st) != 0 || GetStoreSize(storeFolder) + (uint64_t)st.st_size > maxSize)
+        {
+            Log_Debug("Not adding '%s' to the content store, which is full or disabled.", filePath);
+            return false;
+        }
+
+        // Link to a temp name first, so that a blob is always complete. Temp names start with '.', which sweeps skip.
+        const unsigned int counter = __atomic_add_fetch(&s_insertCounter, 1, __ATOMIC_RELAXED);
+        const int written =
+            snprintf(tempPath, sizeof(tempPath), "%s/.%s.%d.%u.tmp", storeFolder, blobName, (int)getpid(), counter);
+        if (written <= 0 || written >= (int)sizeof(tempPath))
+        {
+            return false;
+        }
+
+        // The store folder may not exist yet. Its parent, the downloads folder, must.
+        // A hard link makes the sandbox file read-only too.
+        bool linked = false;
+        if (!EnsureFolder(storeFolder) || !LinkOrClone(filePath, tempPath, &linked) || chmod(tempPath, BLOB_MODE) != 0
+            || rename(tempPath, blobPath) != 0)
+        {
+            // e.g. EXDEV. The store is only an optimization, and never copies a payload.
+            Log_Debug("Cannot add '%s' to the content store, errno %d.", filePath, errno);
+            (void)unlink(tempPath);
+            return false;
+        }
+
+        // rename does nothing if a concurrent insert already linked the blob to the same file.
+        (void)unlink(tempPath);
+    }
+
+    if (!IsNullOrEmpty(referencingFolder))
+    {
+        (void)AddReference(storeFolder, blobName, referencingFolder);
+    }
+
+    return true;
+}
+
+void ADUC_ContentStore_Remove(const char* hashBase64, SHAversion algorithm)
+{
+    char storeFolder[PATH_MAX];
+    char blobName[NAME_MAX + 1];
+    char blobPath[PATH_MAX];
+
+    GetStoreFolder(storeFolder);
+
+    if (MakeBlobName(hashBase64, algorithm, blobName) && JoinPath(blobPath, storeFolder, blobName, NULL))
+    {
+        if (unlink(blobPath) == 0)
+        {
+            Log_Warn("Removed blob '%s'.", blobPath);
+        }
+        RemoveReferences(storeFolder, blobName);
+    }
+}
+
+size_t ADUC_ContentStore_Sweep(const char* releasedFolder)
+{
+    size_t removed = 0;
+    char storeFolder[PATH_MAX];
+    char blobPath[PATH_MAX];
+    char refsBlobFolder[PATH_MAX];
+    struct dirent* entry = NULL;
+
+    GetStoreFolder(storeFolder);
+
+    DIR* dir = opendir(storeFolder);
+    if (dir == NULL)
+    {
+        return 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+
+        // Skips the references folder and temp files.
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        if (!JoinPath(blobPath, storeFolder, entry->d_name, NULL)
+            || !JoinPath(refsBlobFolder, storeFolder, REFS_FOLDER_NAME, entry->d_name) || lstat(blobPath, &st) != 0
+            || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+
+        if (ReleaseReferences(refsBlobFolder, releasedFolder) > 0)
+        {
+            continue;
+        }
+
+        if (unlink(blobPath) == 0)
+        {
+            ++removed;
+            RemoveReferences(storeFolder, entry->d_name);
+        }
+        else
+        {
+            Log_Warn("Cannot remove blob '%s', errno %d.", blobPath, errno);
+        }
+    }
+
+    closedir(dir);
+
+    if (removed > 0)
+    {
+        Log_Info("Removed %zu unreferenced blob(s) from '%s'.", removed, storeFolder);
+    }
+
+    return removed;
+}
+
+bool ADUC_ContentStore_SetFolder(const char* folderPath)
+{
+    char* newFolder = NULL;
+
+    if (folderPath != NULL && mallocAndStrcpy_s(&newFolder, folderPath) != 0)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&s_storeMutex);
+    free(s_storeFolder);
+    s_storeFolder = newFolder;
+    pthread_mutex_unlock(&s_storeMutex);
+
+    return true;
+}
+
+void ADUC_ContentStore_SetMaxSize(const uint64_t* maxSize)
+{
+    pthread_mutex_lock(&s_storeMutex);
+    s_hasMaxSize = (maxSize != NULL);
+    s_maxSize = (maxSize != NULL) ? *maxSize : 0;
+    pthread_mutex_unlock(&s_storeMutex);
+}
@@ -7,9 +7,15 @@
  */
 #include "aduc/hash_utils.h"
 
-#include <stdio.h> // for FILE
-#include <stdlib.h> // for calloc
+#include <errno.h> // for errno
+#include <fcntl.h> // for open, posix_fadvise
+#include <stdint.h> // for UINT32_MAX
+#include <stdlib.h> // for calloc, posix_memalign
+#include <string.h> // for memset
 #include <strings.h> // for strcasecmp
+#include <sys/mman.h> // for mmap, madvise
+#include <sys/stat.h> // for fstat
+#include <unistd.h> // for read, close
 
 #include <azure_c_shared_utility/azure_base64.h>
 #include <azure_c_shared_utility/buffer_.h>
@@ -18,6 +24,326 @@
 
 #include <aduc/logging.h>
 
+#include <openssl/evp.h>
+
+/**
+ * @brief Alignment of the buffer that file content is read into.
+ * @details Page alignment lets the kernel copy straight into the buffer and keeps SIMD digest loads aligned.
+ */
+#define HASH_UTILS_READ_BUFFER_ALIGNMENT 4096
+
+/**
+ * @brief The digest state for one hash computation, backed by either OpenSSL EVP or USHA.
+ */
+typedef struct tagADUC_HashUtils_DigestContext
+{
+    ADUC_HashUtils_Backend backend; //!< The backend actually in use. Never ADUC_HashUtils_Backend_Default.
+    SHAversion algorithm; //!< The hash algorithm.
+    USHAContext ushaContext; //!< The USHA state, when backend is ADUC_HashUtils_Backend_USHA.
+    EVP_MD_CTX* evpContext; //!< The EVP state, when backend is ADUC_HashUtils_Backend_EVP.
+    uint64_t bytesConsumed; //!< The number of bytes fed into the digest so far.
+} ADUC_HashUtils_DigestContext;
+
+/**
+ * @brief Maps a SHAversion to the corresponding OpenSSL message digest.
+ * @param algorithm The hash algorithm.
+ * @return const EVP_MD* The digest, or NULL if not supported.
+ */
+static const EVP_MD* GetEvpMessageDigest(SHAversion algorithm)
+{
+    switch (algorithm)
+    {
+    case SHA1:
+        return EVP_sha1();
+    case SHA224:
+        return EVP_sha224();
+    case SHA256:
+        return EVP_sha256();
+    case SHA384:
+        return EVP_sha384();
+    case SHA512:
+        return EVP_sha512();
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief Releases resources held by the digest context.
+ * @param context The digest context.
+ */
+static void DigestContext_UnInit(ADUC_HashUtils_DigestContext* context)
+{
+    if (context->evpContext != NULL)
+    {
+        EVP_MD_CTX_free(context->evpContext);
+        context->evpContext = NULL;
+    }
+}
+
+/**
+ * @brief Initializes the digest context for @p algorithm.
+ * @details For ADUC_HashUtils_Backend_Default, OpenSSL EVP is tried first, and USHA is used if EVP is not usable
+ * (e.g. the digest is disabled by the OpenSSL configuration). An explicitly requested backend does not fall back.
+ *
+ * @param context The digest context to initialize.
+ * @param algorithm The hash algorithm.
+ * @param backend The requested backend.
+ * @param suppressErrorLog Whether to suppress error logging.
+ * @return bool true on success.
+ */
+static bool DigestContext_Init(
+    ADUC_HashUtils_DigestContext* context,
+    SHAversion algorithm,
+    ADUC_HashUtils_Backend backend,
+    bool suppressErrorLog)
+{
+    memset(context, 0, sizeof(*context));
+    context->algorithm = algorithm;
+
+    if (backend != ADUC_HashUtils_Backend_USHA)
+    {
+        const EVP_MD* md = GetEvpMessageDigest(algorithm);
+        if (md != NULL)
+        {
+            context->evpContext = EVP_MD_CTX_new();
+            if (context->evpContext != NULL && EVP_DigestInit_ex(context->evpContext, md, NULL) == 1)
+            {
+                context->backend = ADUC_HashUtils_Backend_EVP;
+                return true;
+            }
+
+            DigestContext_UnInit(context);
+        }
+
+        if (backend == ADUC_HashUtils_Backend_EVP)
+        {
+            if (!suppressErrorLog)
+            {
+                Log_Error("Error in EVP digest init, SHAversion: %d", algorithm);
+            }
+            return false;
+        }
+
+        Log_Debug("EVP digest unavailable for SHAversion: %d, using USHA.", algorithm);
+    }
+
+    if (USHAReset(&context->ushaContext, algorithm) != 0)
+    {
+        if (!suppressErrorLog)
+        {
+            Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
+        }
+        return false;
+    }
+
+    context->backend = ADUC_HashUtils_Backend_USHA;
+    return true;
+}
+
+/**
+ * @brief Feeds @p length bytes of @p data into the digest.
+ * @param context The digest context.
+ * @param data The data.
+ * @param length The length of @p data.
+ * @return bool true on success.
+ */
+static bool DigestContext_Update(ADUC_HashUtils_DigestContext* context, const uint8_t* data, size_t length)
+{
+    if (context->backend == ADUC_HashUtils_Backend_EVP)
+    {
+        if (EVP_DigestUpdate(context->evpContext, data, length) != 1)
+        {
+            return false;
+        }
+
+        context->bytesConsumed += length;
+        return true;
+    }
+
+    // USHAInput takes an unsigned int length, so feed very large buffers in pieces.
+    while (length > 0)
+    {
+        const unsigned int chunk = (length > UINT32_MAX) ? UINT32_MAX : (unsigned int)length;
+        if (USHAInput(&context->ushaContext, data, chunk) != 0)
+        {
+            return false;
+        }
+        data += chunk;
+        length -= chunk;
+        context->bytesConsumed += chunk;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Finalizes the digest.
+ * @param context The digest context.
+ * @param digest The output buffer, at least USHAMaxHashSize bytes.
+ * @param digestLength [out] The number of bytes written to @p digest.
+ * @return bool true on success.
+ */
+static bool DigestContext_Final(ADUC_HashUtils_DigestContext* context, uint8_t* digest, size_t* digestLength)
+{
+    if (context->backend == ADUC_HashUtils_Backend_EVP)
+    {
+        unsigned int evpLength = 0;
+        if (EVP_DigestFinal_ex(context->evpContext, digest, &evpLength) != 1)
+        {
+            return false;
+        }
+        *digestLength = evpLength;
+        return true;
+    }
+
+    if (USHAResult(&context->ushaContext, digest) != 0)
+    {
+        return false;
+    }
+
+    *digestLength = (size_t)USHAHashSize(context->algorithm);
+    return true;
+}
+
+/**
+ * @brief Feeds the whole regular file open on @p fd to the digest through a read-only mapping of it, which saves
+ * copying the content into a read buffer.
+ * @details The file must not be truncated while it is hashed, as reading a mapped page past the end of the file
+ * raises SIGBUS. Payloads and extensions are replaced by writing a new file, not by truncating the old one.
+ * @param fd The file descriptor.
+ * @param context The initialized digest context.
+ * @param[out] mapped Set to false if the file was not mapped, e.g. it is empty or not a regular file.
+ * @param suppressErrorLog Whether to suppress error logging.
+ * @return bool false if the digest failed.
+ */
+static bool DigestMappedFile(int fd, ADUC_HashUtils_DigestContext* context, bool* mapped, bool suppressErrorLog)
+{
+    struct stat st;
+
+    *mapped = false;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || (uint64_t)st.st_size > SIZE_MAX)
+    {
+        return true;
+    }
+
+    const size_t size = (size_t)st.st_size;
+    uint8_t* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return true;
+    }
+
+    *mapped = true;
+
+    // Advisory only; widens readahead like POSIX_FADV_SEQUENTIAL does for reads.
+    (void)madvise(data, size, MADV_SEQUENTIAL);
+
+    bool success = true;
+    for (size_t offset = 0; offset < size; offset += ADUC_HASH_UTILS_DEFAULT_READ_BLOCK_SIZE)
+    {
+        const size_t remaining = size - offset;
+        const size_t length =
+            (remaining > ADUC_HASH_UTILS_DEFAULT_READ_BLOCK_SIZE) ? ADUC_HASH_UTILS_DEFAULT_READ_BLOCK_SIZE : remaining;
+        if (!DigestContext_Update(context, data + offset, length))
+        {
+            if (!suppressErrorLog)
+            {
+                Log_Error("Error in SHA Input, SHAversion: %d", context->algorithm);
+            }
+            success = false;
+            break;
+        }
+    }
+
+    munmap(data, size);
+    return success;
+}
+
+/**
+ * @brief Reads the file open on @p fd to the end, feeding it to the digest in @p readBlockSize chunks.
+ * @param fd The file descriptor.
+ * @param context The initialized digest context.
+ * @param readBlockSize The read size. 0 maps the file if it can, and otherwise reads it in
+ * ADUC_HASH_UTILS_DEFAULT_READ_BLOCK_SIZE chunks.
+ * @param suppressErrorLog Whether to suppress error logging.
+ * @return bool true on success.
+ */
+static bool DigestFileDescriptor(
+    int fd, ADUC_HashUtils_DigestContext* context, size_t readBlockSize, bool suppressErrorLog)
+{
+    bool success = false;
+    uint8_t* buffer = NULL;
+
+    if (readBlockSize == 0)
+    {
+        bool mapped = false;
+        if (!DigestMappedFile(fd, context, &mapped, suppressErrorLog))
+        {
+            return false;
+        }
+
+        if (mapped)
+        {
+            return true;
+        }
+
+        readBlockSize = ADUC_HASH_UTILS_DEFAULT_READ_BLOCK_SIZE;
+    }
+
+    if (posix_memalign((void**)&buffer, HASH_UTILS_READ_BUFFER_ALIGNMENT, readBlockSize) != 0)
+    {
+        if (!suppressErrorLog)
+        {
+            Log_Error("Cannot allocate %zu byte read buffer.", readBlockSize);
+        }
+        goto done;
+    }
+
+    // Advisory only; the kernel widens readahead for the whole file.
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (;;)
+    {
+        const ssize_t readSize = read(fd, buffer, readBlockSize);
+        if (readSize < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (!suppressErrorLog)
+            {
+                Log_Error("Error reading file content, errno: %d", errno);
+            }
+            goto done;
+        }
+
+        if (readSize == 0)
+        {
+            // At the end of file. We're done here.
+            break;
+        }
+
+        if (!DigestContext_Update(context, buffer, (size_t)readSize))
+        {
+            if (!suppressErrorLog)
+            {
+                Log_Error("Error in SHA Input, SHAversion: %d", context->algorithm);
+            }
+            goto done;
+        }
+    }
+
+    success = true;
+
+done:
+    free(buffer);
+    return success;
+}
+
 /**
  * @brief Helper function gets the calculated hash from the @p context, compares it to @p hashBase64, and returns the appropriate value
  * @param context Context in which the hash was calculated and stored
@@ -27,14 +353,19 @@
  * @returns bool True if the hash is valid and equals @p hashBase64
  */
 static bool GetResultAndCompareHashes(
-    USHAContext* context, const char* hashBase64, SHAversion algorithm, bool suppressErrorLog, char** outputHash)
+    ADUC_HashUtils_DigestContext* context,
+    const char* hashBase64,
+    SHAversion algorithm,
+    bool suppressErrorLog,
+    char** outputHash)
 {
     bool success = false;
     // "USHAHashSize(algorithm)" is more precise, but requires a variable length array, or heap allocation.
     uint8_t buffer_hash[USHAMaxHashSize];
+    size_t buffer_hash_length = 0;
     STRING_HANDLE encoded_file_hash = NULL;
 
-    if (USHAResult(context, (uint8_t*)buffer_hash) != 0)
+    if (!DigestContext_Final(context, buffer_hash, &buffer_hash_length))
     {
         if (!suppressErrorLog)
         {
@@ -43,7 +374,7 @@ static bool GetResultAndCompareHashes(
         goto done;
     }
 
-    encoded_file_hash = Azure_Base64_Encode_Bytes((unsigned char*)buffer_hash, USHAHashSize(algorithm));
+    encoded_file_hash = Azure_Base64_Encode_Bytes((unsigned char*)buffer_hash, buffer_hash_length);
     if (encoded_file_hash == NULL)
     {
         if (!suppressErrorLog)
@@ -92,7 +423,16 @@ static inline bool IsValidFileHashCheckAlgorithm(SHAversion sha)
     return sha >= SHA256;
 }
 
-static bool ADUC_HashUtils_GetIndexStrongestValidHash(
+/**
+ * @brief Finds the hash with the strongest algorithm that is valid for file digests.
+ *
+ * @param hashes The array of ADUC_Hash objects.
+ * @param hashCount The length of the array.
+ * @param outIndexStrongestAlgorithm [out] The index of the strongest hash.
+ * @param outBestShaVersion [out] The algorithm of the strongest hash.
+ * @return bool false if there is no hash with a valid algorithm, or a hash has an unsupported algorithm.
+ */
+bool ADUC_HashUtils_GetIndexStrongestValidHash(
     const ADUC_Hash* hashes, size_t hashCount, size_t* outIndexStrongestAlgorithm, SHAversion* outBestShaVersion)
 {
     if (outIndexStrongestAlgorithm == NULL || outBestShaVersion == NULL)
@@ -100,7 +440,8 @@ static bool ADUC_HashUtils_GetIndexStrongestValidHash(
         return false;
     }
 
-    size_t strongestIndex = -1; // Assume hashes array is not sorted by strength ordering.
+    bool found = false;
+    size_t strongestIndex = 0; // Assume hashes array is not sorted by strength ordering.
     SHAversion curBestAlg = SHA1;
 
     for (size_t i = 0; i < hashCount; ++i)
@@ -123,12 +464,13 @@ static bool ADUC_HashUtils_GetIndexStrongestValidHash(
 
         if (algVersion > curBestAlg)
         {
+            found = true;
             strongestIndex = i;
             curBestAlg = algVersion;
         }
     }
 
-    if (strongestIndex >= 0)
+    if (found)
     {
         *outIndexStrongestAlgorithm = strongestIndex;
         *outBestShaVersion = curBestAlg;
@@ -176,9 +518,28 @@ bool ADUC_HashUtils_VerifyWithStrongestHash(const char* filePath, const ADUC_Has
  * @return bool True if the hash data is successfully generated.
  */
 bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** hash)
+{
+    return ADUC_HashUtils_GetFileHashEx(path, algorithm, ADUC_HashUtils_Backend_Default, 0 /* readBlockSize */, hash);
+}
+
+/**
+ * @brief Calculates the hash of the file at @p path using the given digest backend and read block size.
+ *
+ * @param path The path to the file.
+ * @param algorithm The hashing algorithm to use to calculate the hash.
+ * @param backend The digest backend.
+ * @param readBlockSize The number of bytes per read. 0 maps the file if it can, and otherwise reads it
+ * ADUC_HASH_UTILS_DEFAULT_READ_BLOCK_SIZE bytes at a time.
+ * @param hash [out] The base64 encoded hash. Caller must call free() when done with the returned buffer.
+ * @return bool True if the hash data is successfully generated.
+ */
+bool ADUC_HashUtils_GetFileHashEx(
+    const char* path, SHAversion algorithm, ADUC_HashUtils_Backend backend, size_t readBlockSize, char** hash)
 {
     bool success = false;
-    FILE* file = NULL;
+    bool contextInitialized = false;
+    int fd = -1;
+    ADUC_HashUtils_DigestContext context;
 
     if (hash == NULL)
     {
@@ -188,8 +549,8 @@ bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** h
 
     *hash = NULL;
 
-    file = fopen(path, "rb");
-    if (file == NULL)
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
     {
         // Sometime we call this function to check whether the file is already exist.
         // So, log info here instead of error.
@@ -197,45 +558,29 @@ bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** h
         goto done;
     }
 
-    USHAContext context;
-
-    if (USHAReset(&context, algorithm) != 0)
+    if (!DigestContext_Init(&context, algorithm, backend, false /* suppressErrorLog */))
     {
-        Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
         goto done;
-    };
-
-    // Repeatedly read and hash chunks of the file
-    while (!feof(file))
-    {
-        uint8_t buffer[USHA_Max_Message_Block_Size];
-        const size_t readSize = fread(buffer, sizeof(buffer[0]), ARRAY_SIZE(buffer), file);
-        if (readSize == 0)
-        {
-            if (ferror(file))
-            {
-                Log_Error("Error reading file content.");
-                goto done;
-            }
+    }
 
-            // At the end of file. We're done here.
-            break;
-        }
+    contextInitialized = true;
 
-        if (USHAInput(&context, buffer, readSize) != 0)
-        {
-            Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
-            goto done;
-        };
+    if (!DigestFileDescriptor(fd, &context, readBlockSize, false /* suppressErrorLog */))
+    {
+        goto done;
     }
 
     success = GetResultAndCompareHashes(&context, NULL, algorithm, true, hash);
 
 done:
+    if (contextInitialized)
+    {
+        DigestContext_UnInit(&context);
+    }
 
-    if (file != NULL)
+    if (fd != -1)
     {
-        fclose(file);
+        close(fd);
     }
 
     return success;
@@ -292,9 +637,11 @@ bool ADUC_HashUtils_IsValidFileHash(
     const char* path, const char* hashBase64, SHAversion algorithm, bool suppressErrorLog)
 {
     bool success = false;
+    bool contextInitialized = false;
+    ADUC_HashUtils_DigestContext context;
 
-    FILE* file = fopen(path, "rb");
-    if (file == NULL)
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
     {
         if (!suppressErrorLog)
         {
@@ -303,57 +650,29 @@ bool ADUC_HashUtils_IsValidFileHash(
         goto done;
     }
 
-    USHAContext context;
-
-    if (USHAReset(&context, algorithm) != 0)
+    if (!DigestContext_Init(&context, algorithm, ADUC_HashUtils_Backend_Default, suppressErrorLog))
     {
-        if (!suppressErrorLog)
-        {
-            Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
-        }
         goto done;
-    };
-
-    // Repeatedly read and hash chunks of the file
-    while (!feof(file))
-    {
-        uint8_t buffer[USHA_Max_Message_Block_Size];
-        const size_t readSize = fread(buffer, sizeof(buffer[0]), ARRAY_SIZE(buffer), file);
-        if (readSize == 0)
-        {
-            if (ferror(file))
-            {
-                if (!suppressErrorLog)
-                {
-                    Log_Error("Error reading file content.");
-                }
-                goto done;
-            }
+    }
 
-            // At the end of file. We're done here.
-            break;
-        }
+    contextInitialized = true;
 
-        if (USHAInput(&context, buffer, readSize) != 0)
-        {
-            if (!suppressErrorLog)
-            {
-                Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
-            }
-            goto done;
-        };
+    if (!DigestFileDescriptor(fd, &context, 0 /* readBlockSize */, suppressErrorLog))
+    {
+        goto done;
     }
 
     success = GetResultAndCompareHashes(&context, hashBase64, algorithm, suppressErrorLog, NULL /* outputHash */);
-    if (!success)
+
+done:
+    if (contextInitialized)
     {
-        goto done;
+        DigestContext_UnInit(&context);
     }
 
-done:
-    if (file != NULL)
+    if (fd != -1)
     {
-        fclose(file);
+        close(fd);
     }
 
     return success;
@@ -370,21 +689,150 @@ done:
 bool ADUC_HashUtils_IsValidBufferHash(
     const uint8_t* buffer, size_t bufferLen, const char* hashBase64, SHAversion algorithm)
 {
-    USHAContext context;
+    bool success = false;
+    ADUC_HashUtils_DigestContext context;
 
-    if (USHAReset(&context, algorithm) != 0)
+    if (!DigestContext_Init(&context, algorithm, ADUC_HashUtils_Backend_Default, false /* suppressErrorLog */))
     {
-        Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
         return false;
     }
 
-    if (USHAInput(&context, buffer, bufferLen) != 0)
+    if (!DigestContext_Update(&context, buffer, bufferLen))
     {
         Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
+        goto done;
+    }
+
+    success = GetResultAndCompareHashes(&context, hashBase64, algorithm, true, NULL);
+
+done:
+    DigestContext_UnInit(&context);
+    return success;
+}
+
+/**
+ * @brief Creates an incremental digest for @p algorithm.
+ *
+ * @param algorithm The hashing algorithm.
+ * @return ADUC_HashUtils_DigestHandle The digest handle, or NULL on failure. Caller must call
+ * ADUC_HashUtils_DigestFree() when done.
+ */
+ADUC_HashUtils_DigestHandle ADUC_HashUtils_DigestCreate(SHAversion algorithm)
+{
+    ADUC_HashUtils_DigestContext* context = calloc(1, sizeof(*context));
+    if (context == NULL)
+    {
+        return NULL;
+    }
+
+    if (!DigestContext_Init(context, algorithm, ADUC_HashUtils_Backend_Default, false /* suppressErrorLog */))
+    {
+        free(context);
+        return NULL;
+    }
+
+    return context;
+}
+
+/**
+ * @brief Feeds the next @p length bytes of content into the digest.
+ *
+ * @param handle The digest handle.
+ * @param data The content.
+ * @param length The length of @p data.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_DigestUpdate(ADUC_HashUtils_DigestHandle handle, const uint8_t* data, size_t length)
+{
+    if (handle == NULL || (data == NULL && length != 0))
+    {
         return false;
     }
 
-    return GetResultAndCompareHashes(&context, hashBase64, algorithm, true, NULL);
+    return DigestContext_Update(handle, data, length);
+}
+
+/**
+ * @brief Discards all content fed so far, e.g. when a download restarts from the beginning.
+ *
+ * @param handle The digest handle.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_DigestReset(ADUC_HashUtils_DigestHandle handle)
+{
+    if (handle == NULL)
+    {
+        return false;
+    }
+
+    const SHAversion algorithm = handle->algorithm;
+    const ADUC_HashUtils_Backend backend = handle->backend;
+
+    DigestContext_UnInit(handle);
+    return DigestContext_Init(handle, algorithm, backend, false /* suppressErrorLog */);
+}
+
+/**
+ * @brief Gets the number of bytes fed into the digest since it was created or last reset.
+ *
+ * @param handle The digest handle.
+ * @return uint64_t The byte count.
+ */
+uint64_t ADUC_HashUtils_DigestGetBytesConsumed(ADUC_HashUtils_DigestHandle handle)
+{
+    return (handle == NULL) ? 0 : handle->bytesConsumed;
+}
+
+/**
+ * @brief Finalizes the digest and checks whether it matches @p hashBase64.
+ * @details The digest cannot be updated afterwards, unless it is reset.
+ *
+ * @param handle The digest handle.
+ * @param hashBase64 The expected base64 encoded hash.
+ * @param suppressErrorLog Whether to suppress error logging.
+ * @return bool true if the hash matches @p hashBase64.
+ */
+bool ADUC_HashUtils_DigestIsValid(ADUC_HashUtils_DigestHandle handle, const char* hashBase64, bool suppressErrorLog)
+{
+    if (handle == NULL || hashBase64 == NULL)
+    {
+        return false;
+    }
+
+    return GetResultAndCompareHashes(handle, hashBase64, handle->algorithm, suppressErrorLog, NULL /* outputHash */);
+}
+
+/**
+ * @brief Finalizes the digest and returns the base64 encoded hash.
+ * @details The digest cannot be updated afterwards, unless it is reset.
+ *
+ * @param handle The digest handle.
+ * @param hashBase64 [out] The base64 encoded hash. Caller must call free() when done with the returned buffer.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_DigestGetHash(ADUC_HashUtils_DigestHandle handle, char** hashBase64)
+{
+    if (handle == NULL || hashBase64 == NULL)
+    {
+        return false;
+    }
+
+    *hashBase64 = NULL;
+    return GetResultAndCompareHashes(handle, NULL, handle->algorithm, false /* suppressErrorLog */, hashBase64);
+}
+
+/**
+ * @brief Frees the digest.
+ *
+ * @param handle The digest handle. May be NULL.
+ */
+void ADUC_HashUtils_DigestFree(ADUC_HashUtils_DigestHandle handle)
+{
+    if (handle != NULL)
+    {
+        DigestContext_UnInit(handle);
+        free(handle);
+    }
 }
 
 /**
@@ -0,0 +1,504 @@
+/**
+ * @file verified_hash_cache.c
+ * @brief Implements a persistent cache of file hashes that have already been verified.
+ *
+ * The cache file is a small JSON document:
+ *
+ *   { "entries": [ { "path": "...", "alg": 2, "hash": "...", "stat": "dev:ino:size:mtime:ctime", "recorded": 1700000000000000 } ] }
+ *
+ * An entry is trusted only when a fresh stat() of the file produces the same "stat" key and the
+ * file's ctime is older than the "recorded" time (in microseconds) by at least the file system's timestamp
+ * granularity. Without the second rule, a write landing in the same timestamp tick as the recording would
+ * not change the key, so such a "racy" entry is re-verified once and recorded again.
+ *
+ * The key and "recorded" time are taken before the file is hashed, and the result is recorded only if the key is
+ * unchanged after hashing, so a hash of content written during the check is never recorded.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/verified_hash_cache.h"
+#include "aduc/hash_utils.h"
+
+#include <aduc/logging.h>
+#include <aduc/string_c_utils.h> // for IsNullOrEmpty
+
+#include <azure_c_shared_utility/crt_abstractions.h> // for mallocAndStrcpy_s
+#include <parson.h>
+
+#include <errno.h>
+#include <fcntl.h> // for open
+#include <inttypes.h> // for PRIu64
+#include <pthread.h>
+#include <stdio.h> // for snprintf, rename
+#include <stdlib.h> // for free
+#include <string.h> // for strcmp, strlen
+#include <sys/stat.h> // for stat
+#include <time.h> // for clock_gettime
+#include <unistd.h> // for write, fsync, close, geteuid
+
+#ifndef ADUC_VERIFIED_HASH_CACHE_FILE_PATH
+#    define ADUC_VERIFIED_HASH_CACHE_FILE_PATH "/var/lib/adu/verified-hashes.json"
+#endif
+
+/**
+ * @brief Big enough for "dev:ino:size:mtime_s.mtime_ns:ctime_s.ctime_ns" with 64-bit fields.
+ */
+#define STAT_KEY_BUFFER_SIZE 128
+
+/**
+ * @brief How much older than the recording a file's ctime must be for the entry to be trusted, for file systems with
+ * sub-second timestamps. The kernel stamps files from a coarse clock that ticks once per jiffy.
+ */
+#define RACY_MARGIN_FINE_US (20 * 1000)
+
+/**
+ * @brief As RACY_MARGIN_FINE_US, for file systems that only keep whole seconds.
+ */
+#define RACY_MARGIN_COARSE_US (1000 * 1000)
+
+static pthread_mutex_t s_cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief The in-memory cache document. NULL until first use.
+ */
+static JSON_Value* s_cacheRoot = NULL;
+
+/**
+ * @brief The cache file path. NULL means ADUC_VERIFIED_HASH_CACHE_FILE_PATH.
+ */
+static char* s_cacheFilePath = NULL;
+
+static const char* GetCacheFilePath(void)
+{
+    return (s_cacheFilePath != NULL) ? s_cacheFilePath : ADUC_VERIFIED_HASH_CACHE_FILE_PATH;
+}
+
+/**
+ * @brief Builds the stat key that identifies one version of a file.
+ * @param st The stat of the file.
+ * @param key The output buffer, STAT_KEY_BUFFER_SIZE bytes.
+ */
+static void MakeStatKey(const struct stat* st, char* key)
+{
+    snprintf(
+        key,
+        STAT_KEY_BUFFER_SIZE,
+        "%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%" PRId64 ".%09ld:%" PRId64 ".%09ld",
+        (uint64_t)st->st_dev,
+        (uint64_t)st->st_ino,
+        (uint64_t)st->st_size,
+        (int64_t)st->st_mtim.tv_sec,
+        (long)st->st_mtim.tv_nsec,
+        (int64_t)st->st_ctim.tv_sec,
+        (long)st->st_ctim.tv_nsec);
+}
+
+/**
+ * @brief Checks whether two stats of a file have the same stat key.
+ * @param a The first stat.
+ * @param b The second stat.
+ * @return bool True if the file did not change between the two stats, as far as the stat key can tell.
+ */
+static bool IsSameFileVersion(const struct stat* a, const struct stat* b)
+{
+    char keyA[STAT_KEY_BUFFER_SIZE];
+    char keyB[STAT_KEY_BUFFER_SIZE];
+
+    MakeStatKey(a, keyA);
+    MakeStatKey(b, keyB);
+
+    return strcmp(keyA, keyB) == 0;
+}
+
+/**
+ * @brief Converts a timespec to microseconds since the epoch. Exactly representable in a JSON number.
+ * @param ts The timespec.
+ * @return double The microseconds.
+ */
+static double ToMicroseconds(const struct timespec* ts)
+{
+    return (double)ts->tv_sec * 1000000.0 + (double)(ts->tv_nsec / 1000);
+}
+
+/**
+ * @brief Gets the entries array, loading the cache file on first use. Must hold s_cacheMutex.
+ * @return JSON_Array* The entries, or NULL on out of memory.
+ */
+static JSON_Array* GetEntries(void)
+{
+    if (s_cacheRoot == NULL)
+    {
+        const char* filePath = GetCacheFilePath();
+        struct stat st;
+
+        // Only trust a cache file that we own; anyone able to write it could vouch for arbitrary content.
+        if (stat(filePath, &st) == 0)
+        {
+            if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+            {
+                Log_Warn("Ignoring verified hash cache '%s' with unexpected owner or mode.", filePath);
+            }
+            else
+            {
+                s_cacheRoot = json_parse_file(filePath);
+                if (s_cacheRoot == NULL || json_object_get_array(json_object(s_cacheRoot), "entries") == NULL)
+                {
+                    Log_Warn("Ignoring malformed verified hash cache '%s'.", filePath);
+                    json_value_free(s_cacheRoot);
+                    s_cacheRoot = NULL;
+                }
+            }
+        }
+
+        if (s_cacheRoot == NULL)
+        {
+            s_cacheRoot = json_value_init_object();
+            if (s_cacheRoot == NULL
+                || json_object_set_value(json_object(s_cacheRoot), "entries", json_value_init_array()) != JSONSuccess)
+            {
+                json_value_free(s_cacheRoot);
+                s_cacheRoot = NULL;
+                return NULL;
+            }
+        }
+    }
+
+    return json_object_get_array(json_object(s_cacheRoot), "entries");
+}
+
+/**
+ * @brief Writes the cache to a temp file, then renames it over the cache file. Must hold s_cacheMutex.
+ * @return bool True on success.
+ */
+static bool PersistCache(void)
+{
+    bool success = false;
+    char* serialized = NULL;
+    char* tempFilePath = NULL;
+    int fd = -1;
+
+    const char* filePath = GetCacheFilePath();
+    const size_t tempFilePathSize = strlen(filePath) + sizeof(".tmp");
+
+    serialized = json_serialize_to_string(s_cacheRoot);
+    tempFilePath = malloc(tempFilePathSize);
+    if (serialized == NULL || tempFilePath == NULL)
+    {
+        goto done;
+    }
+
+    snprintf(tempFilePath, tempFilePathSize, "%s.tmp", filePath);
+
+    fd = open(tempFilePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+    {
+        Log_Warn("Cannot open '%s', errno: %d", tempFilePath, errno);
+        goto done;
+    }
+
+    const size_t length = strlen(serialized);
+    size_t offset = 0;
+    while (offset < length)
+    {
+        const ssize_t written = write(fd, serialized + offset, length - offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            Log_Warn("Cannot write '%s', errno: %d", tempFilePath, errno);
+            goto done;
+        }
+        offset += (size_t)written;
+    }
+
+    if (fsync(fd) != 0)
+    {
+        Log_Warn("Cannot fsync '%s', errno: %d", tempFilePath, errno);
+        goto done;
+    }
+
+    close(fd);
+    fd = -1;
+
+    if (rename(tempFilePath, filePath) != 0)
+    {
+        Log_Warn("Cannot rename '%s', errno: %d", tempFilePath, errno);
+        goto done;
+    }
+
+    success = true;
+
+done:
+    if (fd != -1)
+    {
+        close(fd);
+    }
+
+    if (!success && tempFilePath != NULL)
+    {
+        (void)unlink(tempFilePath);
+    }
+
+    free(tempFilePath);
+    json_free_serialized_string(serialized);
+    return success;
+}
+
+/**
+ * @brief Removes entries for @p path, optionally only those for @p algorithm. Must hold s_cacheMutex.
+ * @param entries The entries.
+ * @param path The file path.
+ * @param algorithm The algorithm to match, or -1 for any.
+ * @return bool True if any entry was removed.
+ */
+static bool RemoveEntries(JSON_Array* entries, const char* path, int algorithm)
+{
+    bool removed = false;
+    size_t i = json_array_get_count(entries);
+    while (i-- > 0)
+    {
+        const JSON_Object* entry = json_array_get_object(entries, i);
+        const char* entryPath = json_object_get_string(entry, "path");
+        if (entryPath != NULL && strcmp(entryPath, path) == 0
+            && (algorithm < 0 || (int)json_object_get_number(entry, "alg") == algorithm))
+        {
+            json_array_remove(entries, i);
+            removed = true;
+        }
+    }
+    return removed;
+}
+
+/**
+ * @brief Looks up whether the current version of the file was verified to have @p hashBase64.
+ * @param path The file path.
+ * @param hashBase64 The expected hash.
+ * @param algorithm The algorithm.
+ * @return bool True on a trusted cache hit.
+ */
+static bool Lookup(const char* path, const char* hashBase64, SHAversion algorithm)
+{
+    bool hit = false;
+    struct stat st;
+    char statKey[STAT_KEY_BUFFER_SIZE];
+
+    if (stat(path, &st) != 0)
+    {
+        return false;
+    }
+
+    MakeStatKey(&st, statKey);
+
+    pthread_mutex_lock(&s_cacheMutex);
+
+    JSON_Array* entries = GetEntries();
+    const size_t count = (entries == NULL) ? 0 : json_array_get_count(entries);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const JSON_Object* entry = json_array_get_object(entries, i);
+        const char* entryPath = json_object_get_string(entry, "path");
+        if (entryPath == NULL || strcmp(entryPath, path) != 0
+            || (int)json_object_get_number(entry, "alg") != (int)algorithm)
+        {
+            continue;
+        }
+
+        const char* entryStatKey = json_object_get_string(entry, "stat");
+        const char* entryHash = json_object_get_string(entry, "hash");
+        const double recorded = json_object_get_number(entry, "recorded");
+        const double racyMargin = (st.st_ctim.tv_nsec == 0) ? RACY_MARGIN_COARSE_US : RACY_MARGIN_FINE_US;
+
+        hit = entryStatKey != NULL && strcmp(entryStatKey, statKey) == 0 && entryHash != NULL
+            && strcmp(entryHash, hashBase64) == 0 && ToMicroseconds(&st.st_ctim) + racyMargin <= recorded;
+        break;
+    }
+
+    pthread_mutex_unlock(&s_cacheMutex);
+
+    return hit;
+}
+
+/**
+ * @brief Records that the version of the file with stat @p st has hash @p hashBase64.
+ * @param path The file path.
+ * @param hashBase64 The verified hash.
+ * @param algorithm The algorithm.
+ * @param st The stat of the file, taken before its content was verified.
+ * @param verifiedAt The time @p st was taken, or earlier.
+ * @return bool True if recorded.
+ */
+static bool RecordStat(
+    const char* path,
+    const char* hashBase64,
+    SHAversion algorithm,
+    const struct stat* st,
+    const struct timespec* verifiedAt)
+{
+    bool success = false;
+    char statKey[STAT_KEY_BUFFER_SIZE];
+    JSON_Value* entryValue = NULL;
+
+    if (path[0] != '/' || !S_ISREG(st->st_mode))
+    {
+        return false;
+    }
+
+    MakeStatKey(st, statKey);
+
+    pthread_mutex_lock(&s_cacheMutex);
+
+    JSON_Array* entries = GetEntries();
+    if (entries == NULL)
+    {
+        goto done;
+    }
+
+    (void)RemoveEntries(entries, path, (int)algorithm);
+
+    // Drop the oldest entries; new entries are appended.
+    while (json_array_get_count(entries) >= ADUC_VERIFIED_HASH_CACHE_MAX_ENTRIES)
+    {
+        json_array_remove(entries, 0);
+    }
+
+    entryValue = json_value_init_object();
+    JSON_Object* entry = json_object(entryValue);
+    if (entry == NULL || json_object_set_string(entry, "path", path) != JSONSuccess
+        || json_object_set_number(entry, "alg", (double)algorithm) != JSONSuccess
+        || json_object_set_string(entry, "hash", hashBase64) != JSONSuccess
+        || json_object_set_string(entry, "stat", statKey) != JSONSuccess
+        || json_object_set_number(entry, "recorded", ToMicroseconds(verifiedAt)) != JSONSuccess)
+    {
+        goto done;
+    }
+
+    if (json_array_append_value(entries, entryValue) != JSONSuccess)
+    {
+        goto done;
+    }
+
+    entryValue = NULL; // Owned by the array now.
+
+    success = PersistCache();
+
+done:
+    pthread_mutex_unlock(&s_cacheMutex);
+
+    json_value_free(entryValue);
+    return success;
+}
+
+bool ADUC_VerifiedHashCache_IsValidFileHash(
+    const char* path, const char* hashBase64, SHAversion algorithm, bool suppressErrorLog)
+{
+    if (IsNullOrEmpty(path) || IsNullOrEmpty(hashBase64))
+    {
+        return false;
+    }
+
+    if (Lookup(path, hashBase64, algorithm))
+    {
+        Log_Debug("Verified hash cache hit for '%s'.", path);
+        return true;
+    }
+
+    // Take the key of the version about to be hashed. The hash result is only recorded if the file still has that
+    // key afterwards; otherwise it was written while being hashed, and the result may not be of either version.
+    struct timespec verifiedAt;
+    struct stat before;
+    const bool canRecord = clock_gettime(CLOCK_REALTIME, &verifiedAt) == 0 && stat(path, &before) == 0;
+
+    if (!ADUC_HashUtils_IsValidFileHash(path, hashBase64, algorithm, suppressErrorLog))
+    {
+        ADUC_VerifiedHashCache_Remove(path);
+        return false;
+    }
+
+    struct stat after;
+    if (canRecord && stat(path, &after) == 0 && IsSameFileVersion(&before, &after))
+    {
+        (void)RecordStat(path, hashBase64, algorithm, &before, &verifiedAt);
+    }
+    else
+    {
+        Log_Debug("'%s' changed while it was hashed. Not recording it.", path);
+        ADUC_VerifiedHashCache_Remove(path);
+    }
+
+    return true;
+}
+
+bool ADUC_VerifiedHashCache_VerifyWithStrongestHash(const char* path, const ADUC_Hash* hashes, size_t hashCount)
+{
+    size_t index = 0;
+    SHAversion algorithm = SHA256;
+    if (!ADUC_HashUtils_GetIndexStrongestValidHash(hashes, hashCount, &index, &algorithm))
+    {
+        // There is no hash with a valid algorithm.
+        return false;
+    }
+
+    return ADUC_VerifiedHashCache_IsValidFileHash(
+        path, ADUC_HashUtils_GetHashValue(hashes, hashCount, index), algorithm, false /* suppressErrorLog */);
+}
+
+bool ADUC_VerifiedHashCache_Record(const char* path, const char* hashBase64, SHAversion algorithm)
+{
+    struct stat st;
+    struct timespec now;
+
+    if (IsNullOrEmpty(path) || IsNullOrEmpty(hashBase64))
+    {
+        return false;
+    }
+
+    if (clock_gettime(CLOCK_REALTIME, &now) != 0 || stat(path, &st) != 0)
+    {
+        return false;
+    }
+
+    return RecordStat(path, hashBase64, algorithm, &st, &now);
+}
+
+void ADUC_VerifiedHashCache_Remove(const char* path)
+{
+    if (IsNullOrEmpty(path))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&s_cacheMutex);
+
+    JSON_Array* entries = GetEntries();
+    if (entries != NULL && RemoveEntries(entries, path, -1))
+    {
+        (void)PersistCache();
+    }
+
+    pthread_mutex_unlock(&s_cacheMutex);
+}
+
+bool ADUC_VerifiedHashCache_SetFilePath(const char* filePath)
+{
+    char* newFilePath = NULL;
+
+    if (filePath != NULL && mallocAndStrcpy_s(&newFilePath, filePath) != 0)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&s_cacheMutex);
+
+    free(s_cacheFilePath);
+    s_cacheFilePath = newFilePath;
+
+    json_value_free(s_cacheRoot);
+    s_cacheRoot = NULL;
+
+    pthread_mutex_unlock(&s_cacheMutex);
+
+    return true;
+}
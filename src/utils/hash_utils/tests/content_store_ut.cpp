@@ -0,0 +1,259 @@
+/**
+ * @file content_store_ut.cpp
+ * @brief Unit Tests for the content-addressed store.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/content_store.h>
+#include <aduc/hash_utils.h>
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h> // for mkdir, stat
+#include <unistd.h> // for access
+
+// "hello" with SHA256.
+static const char* const helloHash = "LPJNul+wow4m6DsqxbninhsWHlwfp0JecwQzYpOLmCQ=";
+
+namespace
+{
+/**
+ * @brief A temp downloads folder with the store pointed at its ".blobs" subfolder.
+ */
+class StoreFixture
+{
+public:
+    StoreFixture(const StoreFixture&) = delete;
+    StoreFixture& operator=(const StoreFixture&) = delete;
+    StoreFixture(StoreFixture&&) = delete;
+    StoreFixture& operator=(StoreFixture&&) = delete;
+
+    StoreFixture()
+    {
+        char dirTemplate[] = "/tmp/contentstoreXXXXXX";
+        REQUIRE(mkdtemp(dirTemplate) != nullptr);
+        _dir = dirTemplate;
+        REQUIRE(ADUC_ContentStore_SetFolder(StoreFolder().c_str()));
+
+        const uint64_t maxSize = 1024 * 1024;
+        ADUC_ContentStore_SetMaxSize(&maxSize);
+    }
+
+    ~StoreFixture()
+    {
+        ADUC_ContentStore_SetFolder(nullptr);
+        ADUC_ContentStore_SetMaxSize(nullptr);
+        std::string command = "rm -rf " + _dir;
+        CHECK(system(command.c_str()) == 0);
+    }
+
+    std::string StoreFolder() const
+    {
+        return _dir + "/.blobs";
+    }
+
+    std::string BlobPath() const
+    {
+        return StoreFolder() + "/sha256-LPJNul-wow4m6DsqxbninhsWHlwfp0JecwQzYpOLmCQ=";
+    }
+
+    /**
+     * @brief Creates a sandbox folder, and returns its path.
+     */
+    std::string MakeSandbox(const std::string& workflowId) const
+    {
+        const std::string path = _dir + "/" + workflowId;
+        REQUIRE(mkdir(path.c_str(), S_IRWXU) == 0);
+        return path;
+    }
+
+    static void WriteFile(const std::string& path, const std::string& content)
+    {
+        std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+        file << content;
+    }
+
+    static std::string ReadFile(const std::string& path)
+    {
+        std::ifstream file{ path, std::ios::binary };
+        return std::string{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    }
+
+    static mode_t Mode(const std::string& path)
+    {
+        struct stat st = {};
+        return stat(path.c_str(), &st) == 0 ? (st.st_mode & 0777) : 0;
+    }
+
+    static ino_t Inode(const std::string& path)
+    {
+        struct stat st = {};
+        return stat(path.c_str(), &st) == 0 ? st.st_ino : 0;
+    }
+
+private:
+    std::string _dir;
+};
+} // namespace
+
+TEST_CASE("ADUC_ContentStore - a verified file is shared with later workflows")
+{
+    StoreFixture fixture;
+    const std::string sandbox1 = fixture.MakeSandbox("workflow1");
+    const std::string sandbox2 = fixture.MakeSandbox("workflow2");
+    const std::string first = sandbox1 + "/hello.txt";
+    const std::string second = sandbox2 + "/copy-of-hello.txt";
+
+    CHECK_FALSE(ADUC_ContentStore_CopyOut(helloHash, SHA256, second.c_str(), sandbox2.c_str()));
+
+    StoreFixture::WriteFile(first, "hello");
+    REQUIRE(ADUC_ContentStore_Insert(first.c_str(), helloHash, SHA256, sandbox1.c_str()));
+    CHECK(StoreFixture::ReadFile(fixture.BlobPath()) == "hello");
+    CHECK((StoreFixture::Mode(fixture.BlobPath()) & 0222) == 0);
+
+    // Inserting the same content again keeps the existing blob.
+    CHECK(ADUC_ContentStore_Insert(first.c_str(), helloHash, SHA256, sandbox1.c_str()));
+
+    REQUIRE(ADUC_ContentStore_CopyOut(helloHash, SHA256, second.c_str(), sandbox2.c_str()));
+    CHECK(StoreFixture::ReadFile(second) == "hello");
+    CHECK((StoreFixture::Mode(second) & S_IROTH) != 0);
+
+    CHECK(ADUC_HashUtils_IsValidFileHash(second.c_str(), helloHash, SHA256, false));
+
+    // The hash is a key only for the algorithm that produced it.
+    const std::string third = fixture.MakeSandbox("workflow3") + "/hello.txt";
+    CHECK_FALSE(ADUC_ContentStore_CopyOut(helloHash, SHA512, third.c_str(), nullptr));
+}
+
+TEST_CASE("ADUC_ContentStore - sandbox files share the blob instead of copying it")
+{
+    StoreFixture fixture;
+    const std::string sandbox1 = fixture.MakeSandbox("workflow1");
+    const std::string sandbox2 = fixture.MakeSandbox("workflow2");
+    const std::string first = sandbox1 + "/hello.txt";
+    const std::string second = sandbox2 + "/hello.txt";
+
+    StoreFixture::WriteFile(first, "hello");
+    REQUIRE(ADUC_ContentStore_Insert(first.c_str(), helloHash, SHA256, sandbox1.c_str()));
+    REQUIRE(ADUC_ContentStore_CopyOut(helloHash, SHA256, second.c_str(), sandbox2.c_str()));
+
+    CHECK(StoreFixture::ReadFile(fixture.BlobPath()) == "hello");
+    CHECK((StoreFixture::Mode(fixture.BlobPath()) & 0222) == 0);
+
+    // Without reflinks, the files are hard links to the blob, and so read-only.
+    if (StoreFixture::Inode(first) == StoreFixture::Inode(fixture.BlobPath()))
+    {
+        CHECK(StoreFixture::Inode(second) == StoreFixture::Inode(fixture.BlobPath()));
+        CHECK((StoreFixture::Mode(first) & 0222) == 0);
+        CHECK((StoreFixture::Mode(second) & 0222) == 0);
+    }
+}
+
+TEST_CASE("ADUC_ContentStore - stays within its maximum size")
+{
+    StoreFixture fixture;
+    const std::string sandbox = fixture.MakeSandbox("workflow1");
+    const std::string file = sandbox + "/hello.txt";
+    StoreFixture::WriteFile(file, "hello");
+
+    SECTION("Full")
+    {
+        const uint64_t maxSize = 9;
+        ADUC_ContentStore_SetMaxSize(&maxSize);
+
+        CHECK(ADUC_ContentStore_Insert(file.c_str(), helloHash, SHA256, sandbox.c_str()));
+        CHECK_FALSE(ADUC_ContentStore_Insert(file.c_str(), "AAAA", SHA256, sandbox.c_str()));
+
+        // A blob that is already stored is still referenced.
+        CHECK(ADUC_ContentStore_Insert(file.c_str(), helloHash, SHA256, sandbox.c_str()));
+    }
+
+    SECTION("Disabled")
+    {
+        const uint64_t maxSize = 0;
+        ADUC_ContentStore_SetMaxSize(&maxSize);
+
+        CHECK_FALSE(ADUC_ContentStore_Insert(file.c_str(), helloHash, SHA256, sandbox.c_str()));
+        CHECK(access(fixture.BlobPath().c_str(), F_OK) != 0);
+    }
+}
+
+TEST_CASE("ADUC_ContentStore - rejects keys that are not base64")
+{
+    StoreFixture fixture;
+    const std::string file = fixture.MakeSandbox("workflow1") + "/hello.txt";
+    StoreFixture::WriteFile(file, "hello");
+
+    CHECK_FALSE(ADUC_ContentStore_Insert(file.c_str(), "../../etc/passwd", SHA256, nullptr));
+    CHECK_FALSE(ADUC_ContentStore_Insert(file.c_str(), "", SHA256, nullptr));
+    CHECK_FALSE(ADUC_ContentStore_Insert(file.c_str(), nullptr, SHA256, nullptr));
+    CHECK_FALSE(ADUC_ContentStore_Insert(file.c_str(), std::string(200, 'A').c_str(), SHA256, nullptr));
+}
+
+TEST_CASE("ADUC_ContentStore - sweep removes only unreferenced blobs")
+{
+    StoreFixture fixture;
+    const std::string sandbox1 = fixture.MakeSandbox("workflow1");
+    const std::string sandbox2 = fixture.MakeSandbox("workflow2");
+
+    StoreFixture::WriteFile(sandbox1 + "/hello.txt", "hello");
+    REQUIRE(ADUC_ContentStore_Insert((sandbox1 + "/hello.txt").c_str(), helloHash, SHA256, sandbox1.c_str()));
+
+    SECTION("Referenced by another sandbox")
+    {
+        REQUIRE(ADUC_ContentStore_CopyOut(helloHash, SHA256, (sandbox2 + "/hello.txt").c_str(), sandbox2.c_str()));
+
+        CHECK(ADUC_ContentStore_Sweep(sandbox1.c_str()) == 0);
+        CHECK(access(fixture.BlobPath().c_str(), F_OK) == 0);
+
+        CHECK(ADUC_ContentStore_Sweep(sandbox2.c_str()) == 1);
+        CHECK(access(fixture.BlobPath().c_str(), F_OK) != 0);
+
+        // The released sandboxes keep their own files.
+        CHECK(StoreFixture::ReadFile(sandbox1 + "/hello.txt") == "hello");
+        CHECK(StoreFixture::ReadFile(sandbox2 + "/hello.txt") == "hello");
+    }
+
+    SECTION("Only referenced by the released sandbox, from a child workflow folder")
+    {
+        const std::string child = sandbox1 + "/child";
+        REQUIRE(mkdir(child.c_str(), S_IRWXU) == 0);
+        REQUIRE(ADUC_ContentStore_CopyOut(helloHash, SHA256, (child + "/hello.txt").c_str(), child.c_str()));
+
+        CHECK(ADUC_ContentStore_Sweep(sandbox2.c_str()) == 0);
+        CHECK(ADUC_ContentStore_Sweep(sandbox1.c_str()) == 1);
+    }
+
+    SECTION("Referenced by a sandbox that no longer exists")
+    {
+        const std::string command = "rm -rf " + sandbox1;
+        REQUIRE(system(command.c_str()) == 0);
+        CHECK(ADUC_ContentStore_Sweep(nullptr) == 1);
+    }
+}
+
+TEST_CASE("ADUC_ContentStore - a removed blob is not copied out")
+{
+    StoreFixture fixture;
+    const std::string sandbox = fixture.MakeSandbox("workflow1");
+
+    StoreFixture::WriteFile(sandbox + "/hello.txt", "hello");
+    REQUIRE(ADUC_ContentStore_Insert((sandbox + "/hello.txt").c_str(), helloHash, SHA256, sandbox.c_str()));
+
+    ADUC_ContentStore_Remove(helloHash, SHA256);
+
+    CHECK_FALSE(ADUC_ContentStore_CopyOut(helloHash, SHA256, (sandbox + "/again.txt").c_str(), sandbox.c_str()));
+    CHECK(StoreFixture::ReadFile(sandbox + "/hello.txt") == "hello");
+    CHECK(ADUC_ContentStore_Sweep(nullptr) == 0);
+}
+
+TEST_CASE("ADUC_ContentStore - sweep without a store folder")
+{
+    StoreFixture fixture;
+    CHECK(ADUC_ContentStore_Sweep(nullptr) == 0);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file hash_utils_perf.cpp
+ * @brief Throughput microbenchmark for hash_utils digest backends.
+ *
+ * Hidden from the default run. Use: hash_utils_unit_test "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/hash_utils.h>
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <unistd.h> // for unlink
+
+TEST_CASE("ADUC_HashUtils_GetFileHashEx throughput", "[.][perf]")
+{
+    constexpr size_t fileSize = 256 * 1024 * 1024;
+
+    char filePath[] = "/tmp/hashperfXXXXXX";
+    const int fd = mkstemp(filePath);
+    REQUIRE(fd != -1);
+    close(fd);
+
+    {
+        std::vector<char> block(1024 * 1024);
+        for (size_t i = 0; i < block.size(); ++i)
+        {
+            block[i] = static_cast<char>(i * 31 + 7);
+        }
+
+        std::ofstream file{ filePath, std::ios::binary | std::ios::trunc };
+        for (size_t written = 0; written < fileSize; written += block.size())
+        {
+            file.write(block.data(), block.size());
+        }
+    }
+
+    const SHAversion versions[] = { SHAversion::SHA256, SHAversion::SHA384, SHAversion::SHA512 };
+    const ADUC_HashUtils_Backend backends[] = { ADUC_HashUtils_Backend_USHA, ADUC_HashUtils_Backend_EVP };
+    // 0 hashes a mapping of the file.
+    const size_t blockSizes[] = { 0, 128, 4 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
+
+    std::cout << "file size: " << (fileSize / (1024 * 1024)) << " MiB" << std::endl;
+    std::cout << "sha\tbackend\tblock\tMiB/s" << std::endl;
+
+    for (const SHAversion version : versions)
+    {
+        for (const ADUC_HashUtils_Backend backend : backends)
+        {
+            for (const size_t blockSize : blockSizes)
+            {
+                char* hash = nullptr;
+
+                const auto start = std::chrono::steady_clock::now();
+                REQUIRE(ADUC_HashUtils_GetFileHashEx(filePath, version, backend, blockSize, &hash));
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+                free(hash);
+
+                std::cout << version << '\t' << (backend == ADUC_HashUtils_Backend_EVP ? "evp" : "usha") << '\t'
+                          << blockSize << '\t' << (fileSize / (1024.0 * 1024.0)) / elapsed.count() << std::endl;
+            }
+        }
+    }
+
+    REQUIRE(unlink(filePath) == 0);
+}
@@ -10,6 +10,7 @@
 #include <catch2/catch.hpp>
 using Catch::Matchers::Equals;
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 #include <unordered_map>
@@ -309,3 +310,139 @@ TEST_CASE("ADUC_HashUtils_GetFileHash - LargeFile")
         hash = nullptr;
     }
 }
+
+TEST_CASE("ADUC_HashUtils_GetFileHashEx - backends agree")
+{
+    LargeFile testFile;
+
+    // clang-format off
+    auto version = GENERATE( // NOLINT(google-build-using-namespace)
+        SHAversion::SHA1,
+        SHAversion::SHA224,
+        SHAversion::SHA256,
+        SHAversion::SHA384,
+        SHAversion::SHA512);
+
+    auto backend = GENERATE( // NOLINT(google-build-using-namespace)
+        ADUC_HashUtils_Backend_Default,
+        ADUC_HashUtils_Backend_USHA,
+        ADUC_HashUtils_Backend_EVP);
+
+    // 0 hashes a mapping of the file; odd sizes make sure a short final read is handled.
+    auto readBlockSize = GENERATE( // NOLINT(google-build-using-namespace)
+        static_cast<size_t>(0),
+        static_cast<size_t>(4093),
+        static_cast<size_t>(64 * 1024),
+        static_cast<size_t>(1024 * 1024));
+    // clang-format on
+
+    INFO("SHAversion: " << version << ", backend: " << backend << ", readBlockSize: " << readBlockSize);
+    char* hash = nullptr;
+    REQUIRE(ADUC_HashUtils_GetFileHashEx(testFile.Filename(), version, backend, readBlockSize, &hash));
+    CHECK_THAT(hash, Equals(testFile.GetDataHashBase64(version)));
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+    free(hash);
+}
+
+TEST_CASE("ADUC_HashUtils_Digest - incremental")
+{
+    LargeFile testFile;
+
+    // clang-format off
+    auto version = GENERATE( // NOLINT(google-build-using-namespace)
+        SHAversion::SHA256,
+        SHAversion::SHA384,
+        SHAversion::SHA512);
+    // clang-format on
+
+    INFO("SHAversion: " << version);
+
+    ADUC_HashUtils_DigestHandle digest = ADUC_HashUtils_DigestCreate(version);
+    REQUIRE(digest != nullptr);
+
+    SECTION("Uneven chunks match the whole-file hash")
+    {
+        const uint8_t* data = testFile.GetData();
+        size_t remaining = testFile.GetDataByteLen();
+        size_t chunk = 1;
+        while (remaining > 0)
+        {
+            const size_t len = std::min(chunk, remaining);
+            REQUIRE(ADUC_HashUtils_DigestUpdate(digest, data, len));
+            data += len;
+            remaining -= len;
+            chunk = chunk * 3 + 1;
+        }
+
+        CHECK(ADUC_HashUtils_DigestGetBytesConsumed(digest) == testFile.GetDataByteLen());
+        CHECK(ADUC_HashUtils_DigestIsValid(digest, testFile.GetDataHashBase64(version), true));
+    }
+
+    SECTION("Reset discards earlier content")
+    {
+        const uint8_t garbage[] = { 0xde, 0xad, 0xbe, 0xef };
+        REQUIRE(ADUC_HashUtils_DigestUpdate(digest, garbage, sizeof(garbage)));
+        REQUIRE(ADUC_HashUtils_DigestReset(digest));
+        CHECK(ADUC_HashUtils_DigestGetBytesConsumed(digest) == 0);
+
+        REQUIRE(ADUC_HashUtils_DigestUpdate(digest, testFile.GetData(), testFile.GetDataByteLen()));
+
+        char* hash = nullptr;
+        REQUIRE(ADUC_HashUtils_DigestGetHash(digest, &hash));
+        CHECK_THAT(hash, Equals(testFile.GetDataHashBase64(version)));
+        // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+        free(hash);
+    }
+
+    SECTION("Mismatch")
+    {
+        REQUIRE(ADUC_HashUtils_DigestUpdate(digest, testFile.GetData(), testFile.GetDataByteLen() - 1));
+        CHECK_FALSE(ADUC_HashUtils_DigestIsValid(digest, testFile.GetDataHashBase64(version), true));
+    }
+
+    ADUC_HashUtils_DigestFree(digest);
+}
+
+TEST_CASE("ADUC_HashUtils_VerifyWithStrongestHash")
+{
+    SmallFile testFile;
+
+    // clang-format off
+    ADUC_Hash hashes[2] =
+    {
+        { const_cast<char*>("sha1"), const_cast<char*>("sha1") },
+        { const_cast<char*>("sha256"), const_cast<char*>("sha256") }
+    };
+    // clang-format on
+
+    SECTION("Strongest hash matches")
+    {
+        hashes[0].value = const_cast<char*>(testFile.GetDataHashBase64(SHAversion::SHA1));
+        hashes[1].value = const_cast<char*>(testFile.GetDataHashBase64(SHAversion::SHA256));
+
+        size_t index = 0;
+        SHAversion version = SHAversion::SHA1;
+        REQUIRE(ADUC_HashUtils_GetIndexStrongestValidHash(hashes, 2, &index, &version));
+        CHECK(index == 1);
+        CHECK(version == SHAversion::SHA256);
+        CHECK(ADUC_HashUtils_VerifyWithStrongestHash(testFile.Filename(), hashes, 2));
+    }
+
+    SECTION("Only a weaker hash matches")
+    {
+        hashes[0].value = const_cast<char*>(testFile.GetDataHashBase64(SHAversion::SHA1));
+        hashes[1].value = const_cast<char*>("GFwFfnO+4hAqGZZWATWrAeej+KYKN6Gadwo7ovAGzeQ=");
+
+        CHECK_FALSE(ADUC_HashUtils_VerifyWithStrongestHash(testFile.Filename(), hashes, 2));
+    }
+
+    SECTION("No hash with a valid algorithm")
+    {
+        hashes[0].value = const_cast<char*>(testFile.GetDataHashBase64(SHAversion::SHA1));
+
+        size_t index = 0;
+        SHAversion version = SHAversion::SHA1;
+        CHECK_FALSE(ADUC_HashUtils_GetIndexStrongestValidHash(hashes, 1, &index, &version));
+        CHECK_FALSE(ADUC_HashUtils_VerifyWithStrongestHash(testFile.Filename(), hashes, 1));
+    }
+}
@@ -0,0 +1,84 @@
+/**
+ * @file verified_hash_cache_perf.cpp
+ * @brief Benchmark for re-verifying an already downloaded payload after an agent restart.
+ *
+ * Hidden from the default run. Use: hash_utils_unit_test "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/hash_utils.h>
+#include <aduc/verified_hash_cache.h>
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("ADUC_VerifiedHashCache resume throughput", "[.][perf]")
+{
+    constexpr size_t fileSize = 256 * 1024 * 1024;
+    constexpr int iterations = 5;
+
+    char dirTemplate[] = "/tmp/hashcacheperfXXXXXX";
+    REQUIRE(mkdtemp(dirTemplate) != nullptr);
+    const std::string dir = dirTemplate;
+    const std::string filePath = dir + "/payload.bin";
+    const std::string cacheFilePath = dir + "/verified-hashes.json";
+
+    {
+        std::vector<char> block(1024 * 1024);
+        for (size_t i = 0; i < block.size(); ++i)
+        {
+            block[i] = static_cast<char>(i * 31 + 7);
+        }
+
+        std::ofstream file{ filePath, std::ios::binary | std::ios::trunc };
+        for (size_t written = 0; written < fileSize; written += block.size())
+        {
+            file.write(block.data(), block.size());
+        }
+    }
+
+    // Let the payload's ctime fall into an earlier second than the record, so the entry is trusted.
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    char* hash = nullptr;
+    REQUIRE(ADUC_HashUtils_GetFileHash(filePath.c_str(), SHA256, &hash));
+    const std::string expectedHash = hash;
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc, hicpp-no-malloc)
+    free(hash);
+
+    REQUIRE(ADUC_VerifiedHashCache_SetFilePath(cacheFilePath.c_str()));
+    REQUIRE(ADUC_VerifiedHashCache_Record(filePath.c_str(), expectedHash.c_str(), SHA256));
+
+    std::chrono::duration<double> uncached{ 0 };
+    std::chrono::duration<double> cached{ 0 };
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE(ADUC_HashUtils_IsValidFileHash(filePath.c_str(), expectedHash.c_str(), SHA256, false));
+        uncached += std::chrono::steady_clock::now() - start;
+
+        // Drop the in-memory copy, as a restarted agent would, so the cache file is reloaded.
+        REQUIRE(ADUC_VerifiedHashCache_SetFilePath(cacheFilePath.c_str()));
+
+        start = std::chrono::steady_clock::now();
+        REQUIRE(ADUC_VerifiedHashCache_IsValidFileHash(filePath.c_str(), expectedHash.c_str(), SHA256, false));
+        cached += std::chrono::steady_clock::now() - start;
+    }
+
+    std::cout << "file size: " << (fileSize / (1024 * 1024)) << " MiB" << std::endl;
+    std::cout << "re-hash\t" << (uncached.count() * 1000.0 / iterations) << " ms" << std::endl;
+    std::cout << "cached\t" << (cached.count() * 1000.0 / iterations) << " ms" << std::endl;
+
+    ADUC_VerifiedHashCache_SetFilePath(nullptr);
+    REQUIRE(std::remove(filePath.c_str()) == 0);
+    REQUIRE(std::remove(cacheFilePath.c_str()) == 0);
+    REQUIRE(std::remove(dir.c_str()) == 0);
+}
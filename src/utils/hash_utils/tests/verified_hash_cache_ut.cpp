@@ -0,0 +1,252 @@
+/**
+ * @file verified_hash_cache_ut.cpp
+ * @brief Unit Tests for the verified hash cache.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/hash_utils.h>
+#include <aduc/verified_hash_cache.h>
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h> // for chmod, stat
+
+// A hash that no content has; a cache hit is the only way it can be reported valid.
+static const char* const bogusHash = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=";
+
+// "hello" with SHA256.
+static const char* const helloHash = "LPJNul+wow4m6DsqxbninhsWHlwfp0JecwQzYpOLmCQ=";
+
+namespace
+{
+/**
+ * @brief A temp directory holding a payload file and a cache file, with the cache pointed at it.
+ */
+class CacheFixture
+{
+public:
+    CacheFixture(const CacheFixture&) = delete;
+    CacheFixture& operator=(const CacheFixture&) = delete;
+    CacheFixture(CacheFixture&&) = delete;
+    CacheFixture& operator=(CacheFixture&&) = delete;
+
+    CacheFixture()
+    {
+        char dirTemplate[] = "/tmp/hashcacheXXXXXX";
+        REQUIRE(mkdtemp(dirTemplate) != nullptr);
+        _dir = dirTemplate;
+        REQUIRE(ADUC_VerifiedHashCache_SetFilePath(CacheFilePath().c_str()));
+    }
+
+    ~CacheFixture()
+    {
+        ADUC_VerifiedHashCache_SetFilePath(nullptr);
+        std::remove(PayloadFilePath().c_str());
+        std::remove(CacheFilePath().c_str());
+        std::remove(_dir.c_str());
+    }
+
+    std::string PayloadFilePath() const
+    {
+        return _dir + "/payload.bin";
+    }
+
+    std::string CacheFilePath() const
+    {
+        return _dir + "/verified-hashes.json";
+    }
+
+    void WritePayload(const std::string& content) const
+    {
+        std::ofstream file{ PayloadFilePath(), std::ios::binary | std::ios::trunc };
+        file << content;
+    }
+
+    /**
+     * @brief Writes the payload, then waits until a record would no longer be "racy".
+     */
+    void WritePayloadAndSettle(const std::string& content) const
+    {
+        WritePayload(content);
+
+        struct stat st = {};
+        REQUIRE(stat(PayloadFilePath().c_str(), &st) == 0);
+
+        // Whole-second timestamps need a full second; otherwise a few clock ticks are enough.
+        std::this_thread::sleep_for(
+            st.st_ctim.tv_nsec == 0 ? std::chrono::milliseconds(1100) : std::chrono::milliseconds(50));
+    }
+
+private:
+    std::string _dir;
+};
+} // namespace
+
+TEST_CASE("ADUC_VerifiedHashCache - verified file is recorded and reused")
+{
+    CacheFixture fixture;
+    fixture.WritePayloadAndSettle("hello");
+    const std::string path = fixture.PayloadFilePath();
+
+    CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    CHECK(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), helloHash, SHA256, true));
+
+    // Swap the recorded hash for the bogus one; reporting it valid proves the file was not re-hashed.
+    REQUIRE(ADUC_VerifiedHashCache_Record(path.c_str(), bogusHash, SHA256));
+    CHECK(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+
+    SECTION("Survives a reload from disk")
+    {
+        REQUIRE(ADUC_VerifiedHashCache_SetFilePath(fixture.CacheFilePath().c_str()));
+        CHECK(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    }
+
+    SECTION("Different expected hash is re-verified")
+    {
+        CHECK(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), helloHash, SHA256, true));
+    }
+
+    SECTION("Different algorithm is not a hit")
+    {
+        CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA512, true));
+    }
+
+    SECTION("Rewritten content is re-verified")
+    {
+        fixture.WritePayload("hellO");
+        CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    }
+
+    SECTION("Replaced file is re-verified")
+    {
+        const std::string otherPath = path + ".new";
+        {
+            std::ofstream file{ otherPath, std::ios::binary | std::ios::trunc };
+            file << "hello";
+        }
+        REQUIRE(std::rename(otherPath.c_str(), path.c_str()) == 0);
+        CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    }
+
+    SECTION("Metadata change is re-verified")
+    {
+        REQUIRE(chmod(path.c_str(), 0600) == 0);
+        CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    }
+
+    SECTION("Strongest hash is checked against the cache")
+    {
+        // clang-format off
+        ADUC_Hash hashes[2] =
+        {
+            { const_cast<char*>(helloHash), const_cast<char*>("sha1") },
+            { const_cast<char*>(bogusHash), const_cast<char*>("sha256") }
+        };
+        // clang-format on
+        CHECK(ADUC_VerifiedHashCache_VerifyWithStrongestHash(path.c_str(), hashes, 2));
+        CHECK_FALSE(ADUC_VerifiedHashCache_VerifyWithStrongestHash(path.c_str(), hashes, 1));
+    }
+
+    SECTION("Removed entry is re-verified")
+    {
+        ADUC_VerifiedHashCache_Remove(path.c_str());
+        CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    }
+}
+
+TEST_CASE("ADUC_VerifiedHashCache - racy record is re-verified")
+{
+    CacheFixture fixture;
+    fixture.WritePayload("hello");
+    const std::string path = fixture.PayloadFilePath();
+
+    // Recorded within the file's last timestamp tick, so a later write in that tick could go unnoticed.
+    REQUIRE(ADUC_VerifiedHashCache_Record(path.c_str(), bogusHash, SHA256));
+
+    struct timespec afterRecord = {};
+    REQUIRE(clock_gettime(CLOCK_REALTIME, &afterRecord) == 0);
+
+    struct stat st = {};
+    REQUIRE(stat(path.c_str(), &st) == 0);
+
+    const auto sinceChange = std::chrono::seconds(afterRecord.tv_sec - st.st_ctim.tv_sec)
+        + std::chrono::nanoseconds(afterRecord.tv_nsec - st.st_ctim.tv_nsec);
+    if (sinceChange < std::chrono::milliseconds(20))
+    {
+        CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    }
+}
+
+TEST_CASE("ADUC_VerifiedHashCache - corrupt cache file is ignored")
+{
+    CacheFixture fixture;
+    fixture.WritePayloadAndSettle("hello");
+    const std::string path = fixture.PayloadFilePath();
+
+    {
+        std::ofstream file{ fixture.CacheFilePath(), std::ios::trunc };
+        file << "{ \"entries\": [ not json";
+    }
+    REQUIRE(ADUC_VerifiedHashCache_SetFilePath(fixture.CacheFilePath().c_str()));
+
+    CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    CHECK(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), helloHash, SHA256, true));
+
+    // The rewritten cache file is usable again.
+    REQUIRE(ADUC_VerifiedHashCache_Record(path.c_str(), bogusHash, SHA256));
+    REQUIRE(ADUC_VerifiedHashCache_SetFilePath(fixture.CacheFilePath().c_str()));
+    CHECK(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+}
+
+TEST_CASE("ADUC_VerifiedHashCache - writable-by-others cache file is ignored")
+{
+    CacheFixture fixture;
+    fixture.WritePayloadAndSettle("hello");
+    const std::string path = fixture.PayloadFilePath();
+
+    REQUIRE(ADUC_VerifiedHashCache_Record(path.c_str(), bogusHash, SHA256));
+    REQUIRE(chmod(fixture.CacheFilePath().c_str(), 0666) == 0);
+    REQUIRE(ADUC_VerifiedHashCache_SetFilePath(fixture.CacheFilePath().c_str()));
+
+    CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+}
+
+TEST_CASE("ADUC_VerifiedHashCache - entry count is bounded")
+{
+    CacheFixture fixture;
+    fixture.WritePayload("hello");
+    const std::string path = fixture.PayloadFilePath();
+
+    std::vector<std::string> otherPaths;
+    for (int i = 0; i < ADUC_VERIFIED_HASH_CACHE_MAX_ENTRIES; ++i)
+    {
+        otherPaths.push_back(path + "." + std::to_string(i));
+        std::ofstream file{ otherPaths.back(), std::ios::binary | std::ios::trunc };
+        file << "hello";
+    }
+    fixture.WritePayloadAndSettle("hello");
+
+    REQUIRE(ADUC_VerifiedHashCache_Record(path.c_str(), bogusHash, SHA256));
+    for (const std::string& otherPath : otherPaths)
+    {
+        REQUIRE(ADUC_VerifiedHashCache_Record(otherPath.c_str(), bogusHash, SHA256));
+    }
+
+    // The oldest entry was dropped; the newest is kept.
+    CHECK_FALSE(ADUC_VerifiedHashCache_IsValidFileHash(path.c_str(), bogusHash, SHA256, true));
+    CHECK(ADUC_VerifiedHashCache_IsValidFileHash(otherPaths.back().c_str(), bogusHash, SHA256, true));
+
+    for (const std::string& otherPath : otherPaths)
+    {
+        std::remove(otherPath.c_str());
+    }
+}
@@ -63,6 +63,8 @@ bool GetPayloadFromJWT(const char* blob, char** destBuff);
 
 void* GetKeyFromBase64EncodedJWK(const char* blob);
 
+void ClearVerifiedSJWKCache(void);
+
 EXTERN_C_END
 
 #endif // JWS_UTILS_H
@@ -11,7 +11,9 @@
 #include "crypto_lib.h"
 #include <azure_c_shared_utility/azure_base64.h>
 #include <azure_c_shared_utility/crt_abstractions.h>
+#include <azure_c_shared_utility/sha.h>
 #include <parson.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +21,114 @@
 // Internal Functions
 //
 
+/**
+ * @brief The number of verified Signed JSON Web Keys whose keys are kept.
+ * @details Each update manifest is signed with a key from one SJWK, so a few cover a device's deployments.
+ */
+#define VERIFIED_SJWK_CACHE_MAXENTRIES 8
+
+/**
+ * @brief A Signed JSON Web Key that was verified against its root key, and the key it holds.
+ */
+typedef struct tagVerifiedSJWK
+{
+    uint8_t digest[SHA256HashSize]; /**< SHA-256 of the base64URL encoded SJWK */
+    CryptoKeyHandle key; /**< The key from the SJWK, or NULL if the entry is not used */
+    unsigned long lastUsed; /**< When the entry was last used, for evicting the least recently used entry */
+} VerifiedSJWK;
+
+static VerifiedSJWK VerifiedSJWKCache[VERIFIED_SJWK_CACHE_MAXENTRIES];
+static unsigned long VerifiedSJWKCacheClock;
+static pthread_mutex_t VerifiedSJWKCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Computes the SHA-256 digest that identifies @p sjwk in the verified SJWK cache
+ * @param sjwk the base64URL encoded Signed JSON Web Key
+ * @param digest buffer of SHA256HashSize bytes for the digest
+ * @returns true on success
+ */
+static bool ComputeSJWKDigest(const char* sjwk, uint8_t* digest)
+{
+    USHAContext context;
+
+    return USHAReset(&context, SHA256) == 0
+        && USHAInput(&context, (const uint8_t*)sjwk, (unsigned int)strlen(sjwk)) == 0
+        && USHAResult(&context, digest) == 0;
+}
+
+/**
+ * @brief Returns the key of an already verified SJWK
+ * @details Caller is expected to free the returned key with FreeCryptoKeyHandle()
+ * @param digest the digest of the SJWK
+ * @returns the key, or NULL if the SJWK is not in the cache
+ */
+static CryptoKeyHandle FindVerifiedSJWKKey(const uint8_t* digest)
+{
+    CryptoKeyHandle key = NULL;
+
+    pthread_mutex_lock(&VerifiedSJWKCacheMutex);
+
+    for (size_t i = 0; i < VERIFIED_SJWK_CACHE_MAXENTRIES; ++i)
+    {
+        VerifiedSJWK* entry = &VerifiedSJWKCache[i];
+        if (entry->key != NULL && memcmp(entry->digest, digest, SHA256HashSize) == 0)
+        {
+            entry->lastUsed = ++VerifiedSJWKCacheClock;
+            key = DuplicateCryptoKeyHandle(entry->key);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&VerifiedSJWKCacheMutex);
+
+    return key;
+}
+
+/**
+ * @brief Adds the key of a verified SJWK to the cache, evicting the least recently used entry if it is full
+ * @param digest the digest of the SJWK
+ * @param key the key from the SJWK. The cache keeps its own reference.
+ */
+static void AddVerifiedSJWKKey(const uint8_t* digest, CryptoKeyHandle key)
+{
+    CryptoKeyHandle cachedKey = DuplicateCryptoKeyHandle(key);
+    if (cachedKey == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&VerifiedSJWKCacheMutex);
+
+    VerifiedSJWK* victim = &VerifiedSJWKCache[0];
+    for (size_t i = 0; i < VERIFIED_SJWK_CACHE_MAXENTRIES; ++i)
+    {
+        VerifiedSJWK* entry = &VerifiedSJWKCache[i];
+        if (entry->key != NULL && memcmp(entry->digest, digest, SHA256HashSize) == 0)
+        {
+            // Another thread verified the same SJWK meanwhile.
+            victim = entry;
+            break;
+        }
+
+        if (entry->key == NULL || (victim->key != NULL && entry->lastUsed < victim->lastUsed))
+        {
+            victim = entry;
+        }
+    }
+
+    CryptoKeyHandle evictedKey = victim->key;
+    memcpy(victim->digest, digest, SHA256HashSize);
+    victim->key = cachedKey;
+    victim->lastUsed = ++VerifiedSJWKCacheClock;
+
+    pthread_mutex_unlock(&VerifiedSJWKCacheMutex);
+
+    if (evictedKey != NULL)
+    {
+        FreeCryptoKeyHandle(evictedKey);
+    }
+}
+
 // Find the position of the period and return the next character
 
 /**
@@ -318,6 +428,7 @@ done:
 /**
  * @brief Verifies the BASE64URL encoded @p blob JSON Web Signature (JWS) using the key held within the Signed JSON Web Key header parameter
  * @details Verifies the Signed JSON Web Key (SJWK) and uses the key from the SJWK to validate the JSON Web Signature @p blob
+ * The keys of verified SJWKs are cached by the SHA-256 of the SJWK, so that an SJWK seen before is not verified again.
  * @param jws a Base64URL encoded JSON Web Token in JSON Web Signature format with a Signed JSON Web Key within the header
  * @returns a value of JWSResult
  */
@@ -329,6 +440,8 @@ JWSResult VerifyJWSWithSJWK(const char* jws)
     char* jsonHeader = NULL;
     char* sjwk = NULL;
     CryptoKeyHandle key = NULL;
+    uint8_t digest[SHA256HashSize];
+    bool hasDigest = false;
 
     if (!ExtractJWSHeader(jws, &header))
     {
@@ -352,17 +465,32 @@ JWSResult VerifyJWSWithSJWK(const char* jws)
         goto done;
     }
 
-    result = VerifySJWK(sjwk);
-    if (result != JWSResult_Success)
+    // An SJWK that was verified before need not be verified against its root key again.
+    hasDigest = ComputeSJWKDigest(sjwk, digest);
+    if (hasDigest)
     {
-        goto done;
+        key = FindVerifiedSJWKKey(digest);
     }
 
-    key = GetKeyFromBase64EncodedJWK(sjwk);
     if (key == NULL)
     {
-        result = JWSResult_BadStructure;
-        goto done;
+        result = VerifySJWK(sjwk);
+        if (result != JWSResult_Success)
+        {
+            goto done;
+        }
+
+        key = GetKeyFromBase64EncodedJWK(sjwk);
+        if (key == NULL)
+        {
+            result = JWSResult_BadStructure;
+            goto done;
+        }
+
+        if (hasDigest)
+        {
+            AddVerifiedSJWKKey(digest, key);
+        }
     }
 
     result = VerifyJWSWithKey(jws, key);
@@ -622,3 +750,22 @@ done:
 
     return key;
 }
+
+/**
+ * @brief Forgets the Signed JSON Web Keys verified by VerifyJWSWithSJWK(), so that they are verified again
+ */
+void ClearVerifiedSJWKCache(void)
+{
+    pthread_mutex_lock(&VerifiedSJWKCacheMutex);
+
+    for (size_t i = 0; i < VERIFIED_SJWK_CACHE_MAXENTRIES; ++i)
+    {
+        if (VerifiedSJWKCache[i].key != NULL)
+        {
+            FreeCryptoKeyHandle(VerifiedSJWKCache[i].key);
+            VerifiedSJWKCache[i].key = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&VerifiedSJWKCacheMutex);
+}
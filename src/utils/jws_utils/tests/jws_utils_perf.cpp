@@ -0,0 +1,44 @@
+/**
+ * @file jws_utils_perf.cpp
+ * @brief Benchmarks for verifying update manifest signatures.
+ *
+ * Hidden from the default run. Use: jws_utils_unit_test "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "jws_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <iostream>
+
+// Defined in jws_utils_ut.cpp.
+extern const char* const jwsWithSJWK;
+
+TEST_CASE("VerifyJWSWithSJWK - repeated manifest validations", "[.][perf]")
+{
+    constexpr int validations = 500;
+
+    for (bool cached : { false, true })
+    {
+        ClearVerifiedSJWKCache();
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < validations; ++i)
+        {
+            if (!cached)
+            {
+                ClearVerifiedSJWKCache();
+            }
+            REQUIRE(VerifyJWSWithSJWK(jwsWithSJWK) == JWSResult_Success);
+        }
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << (cached ? "SJWK cached" : "SJWK verified each time") << "\t" << (elapsed.count() / validations)
+                  << " us/validation" << std::endl;
+    }
+
+    ClearVerifiedSJWKCache();
+}
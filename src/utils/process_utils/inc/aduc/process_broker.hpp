@@ -0,0 +1,132 @@
+/**
+ * @file process_broker.hpp
+ * @brief Runs commands through a long-lived child process (a broker) instead of starting a process per command.
+ *
+ * A broker is started once as "<command> --broker-fd <fd>", where fd is its end of a socketpair.
+ * It answers with a ready frame, then runs each request it is sent as if it was started with the request's
+ * arguments, streams what the request writes to stdout and stderr back as output frames, and ends each request
+ * with an exit status frame. It exits when the socket is closed.
+ *
+ * Every frame is a uint32 payload size and a uint8 frame type, in host byte order, then the payload.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_PROCESS_BROKER_HPP
+#define ADUC_PROCESS_BROKER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "aduc/process_utils.hpp" // ADUC_ChildProcessOptions
+
+/**
+ * @brief The option a broker is started with, followed by the number of its socket.
+ */
+#define ADUC_BROKER_FD_OPT "--broker-fd"
+
+/**
+ * @brief The largest frame payload a broker or its client accepts.
+ */
+#define ADUC_BROKER_MAX_FRAME_SIZE (1024 * 1024)
+
+/**
+ * @brief The types of the frames exchanged with a broker.
+ */
+typedef enum tagADUC_BrokerFrameType
+{
+    ADUC_BrokerFrameType_Ready = 'R', /**< Broker to client, once at start. No payload. */
+    ADUC_BrokerFrameType_Request = 'Q', /**< Client to broker. The arguments, each NUL terminated. */
+    ADUC_BrokerFrameType_Output = 'O', /**< Broker to client. Some of the output of the request. */
+    ADUC_BrokerFrameType_ExitStatus = 'X', /**< Broker to client. The int32 exit status; ends the request. */
+} ADUC_BrokerFrameType;
+
+/**
+ * @brief Writes a frame to a broker socket.
+ *
+ * @param fd The socket.
+ * @param type The frame type.
+ * @param payload The payload. May be nullptr if @p size is 0.
+ * @param size The size of @p payload.
+ * @return true if the whole frame was written.
+ */
+bool ADUC_Broker_WriteFrame(int fd, ADUC_BrokerFrameType type, const void* payload, size_t size);
+
+/**
+ * @brief Reads a frame from a broker socket.
+ *
+ * @param fd The socket.
+ * @param[out] type The frame type.
+ * @param[out] payload The payload.
+ * @return true if a whole frame was read; false at the end of the stream, on error, or if the frame is too large.
+ */
+bool ADUC_Broker_ReadFrame(int fd, ADUC_BrokerFrameType* type, std::string& payload);
+
+/**
+ * @brief Writes a request frame for @p args.
+ *
+ * @param fd The socket.
+ * @param args The arguments, not including the command name.
+ * @return true if the whole frame was written.
+ */
+bool ADUC_Broker_WriteRequest(int fd, const std::vector<std::string>& args);
+
+/**
+ * @brief Reads the output and exit status frames that answer a request.
+ *
+ * @param fd The socket.
+ * @param[out] output Appended with the output of the request.
+ * @param[out] exitStatus The exit status of the request.
+ * @param timeout How long to wait for the whole response. Zero for no limit.
+ * @param[out] timedOut Optional. Set to true if the response did not end within @p timeout.
+ * @return true if the request ended with an exit status frame.
+ */
+bool ADUC_Broker_ReadResponse(
+    int fd,
+    std::string& output,
+    int* exitStatus,
+    std::chrono::milliseconds timeout = std::chrono::milliseconds{ 0 },
+    bool* timedOut = nullptr);
+
+/**
+ * @brief Serves broker requests on @p fd until the client closes it.
+ *
+ * Writes the ready frame, then calls @p handler for each request. What the handler writes to stdout and stderr,
+ * including what child processes it starts write there, is sent back while the handler runs.
+ * Requests are served one at a time, on the calling thread.
+ *
+ * @param fd The socket.
+ * @param handler Runs a request, given its arguments, and returns its exit status.
+ * Only the low 8 bits of the status are sent back, as for a process exit status.
+ * @return 0 when the client closed the socket; -1 on error.
+ */
+int ADUC_Broker_Serve(int fd, const std::function<int(const std::vector<std::string>& args)>& handler);
+
+/**
+ * @brief Runs @p command with @p args through a broker, like ADUC_LaunchChildProcess does in a new process.
+ *
+ * The broker for @p command is started on first use and kept for later calls.
+ * The command runs in a new process with ADUC_LaunchChildProcess instead when @p command does not start as a
+ * broker, when its broker is busy with a request from another thread, or when the request cannot be sent.
+ * A request is never run twice: if the broker stops while running it, the request fails.
+ * A request that runs past options.timeout fails too, and its broker is stopped as a timed out child process is,
+ * then started again by the next call.
+ *
+ * @param command The command that serves as the broker.
+ * @param args List of arguments for the command.
+ * @param output The standard output and error from the command.
+ * @param options The timeout and kill grace period, and for a process per command, the output kept.
+ *
+ * @return An exit code from the command.
+ */
+int ADUC_LaunchBrokeredChildProcess(
+    const std::string& command,
+    const std::vector<std::string>& args,
+    std::string& output,
+    const ADUC_ChildProcessOptions& options = ADUC_ChildProcessOptions());
+
+#endif // ADUC_PROCESS_BROKER_HPP
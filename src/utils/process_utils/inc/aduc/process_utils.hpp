@@ -9,26 +9,119 @@
 #define ADUC_PROCESS_UTILS_HPP
 
 #include <azure_c_shared_utility/vector.h>
+#include <chrono>
 #include <functional>
 #include <grp.h>
 #include <pwd.h>
+#include <stdlib.h>
 #include <string>
 #include <sys/types.h>
 #include <unistd.h>
 #include <vector>
 
+/**
+ * @brief The output ADUC_LaunchChildProcess keeps. Only the newest output is kept beyond this.
+ */
+#define ADUC_CHILD_PROCESS_DEFAULT_MAX_OUTPUT_SIZE (1024 * 1024)
+
+/**
+ * @brief The longest line passed to ADUC_ChildProcessOptions::onLine. Longer lines are passed in parts.
+ */
+#define ADUC_CHILD_PROCESS_MAX_LINE_SIZE 4096
+
+/**
+ * @brief The stream of a child process that output came from.
+ */
+typedef enum tagADUC_ChildProcessStream
+{
+    ADUC_ChildProcessStream_Output, /**< Standard output. */
+    ADUC_ChildProcessStream_Error, /**< Standard error. */
+} ADUC_ChildProcessStream;
+
+/**
+ * @brief Options for ADUC_SpawnChildProcess.
+ */
+typedef struct tagADUC_ChildProcessOptions
+{
+    /**
+     * @brief Optional. Called with each line of output, without its newline, as the child writes it.
+     */
+    std::function<void(ADUC_ChildProcessStream stream, const std::string& line)> onLine;
+
+    /**
+     * @brief Send standard error to the output stream too, in the order it is written.
+     */
+    bool mergeError{ false };
+
+    /**
+     * @brief The output kept per stream, in bytes. Only the newest output is kept beyond this. 0 keeps none.
+     */
+    size_t maxOutputSize{ ADUC_CHILD_PROCESS_DEFAULT_MAX_OUTPUT_SIZE };
+
+    /**
+     * @brief How long the child may run. Zero for no limit.
+     * When the time is up, the child is sent SIGTERM, and SIGKILL if it is still running after killGracePeriod.
+     */
+    std::chrono::milliseconds timeout{ 0 };
+
+    /**
+     * @brief How long the child may take to exit after SIGTERM.
+     */
+    std::chrono::milliseconds killGracePeriod{ 5000 };
+} ADUC_ChildProcessOptions;
+
+/**
+ * @brief The result of ADUC_SpawnChildProcess.
+ */
+typedef struct tagADUC_ChildProcessResult
+{
+    int exitStatus{ EXIT_FAILURE }; /**< The exit code, or the number of the signal that ended the child. */
+    bool timedOut{ false }; /**< Whether the child was killed for running longer than the timeout. */
+    std::string output; /**< The newest standard output, and standard error if merged. */
+    std::string error; /**< The newest standard error, unless merged. */
+    size_t droppedOutputSize{ 0 }; /**< Bytes of standard output not kept in output. */
+    size_t droppedErrorSize{ 0 }; /**< Bytes of standard error not kept in error. */
+} ADUC_ChildProcessResult;
+
+/**
+ * @brief Runs specified command in a new process, and captures its output and exit code.
+ *
+ * The process is started with posix_spawn, which does not copy the address space of the agent, and polls
+ * standard output and standard error separately until both are closed.
+ *
+ * @param command Name of a command to run. If command doesn't contain '/', this function will
+ *                search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param options How to capture the output, and how long the command may run.
+ * @param[out] result The exit code and captured output.
+ *
+ * @return true if the command was started.
+ */
+bool ADUC_SpawnChildProcess(
+    const std::string& command,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    ADUC_ChildProcessResult* result);
+
 /**
  * @brief Runs specified command in a new process and captures output, error messages, and exit code.
- *        The captured output and error messages will be written to ADUC_LOG_FILE.
+ *
+ * Standard error is captured with standard output. Only the newest ADUC_CHILD_PROCESS_DEFAULT_MAX_OUTPUT_SIZE bytes
+ * are kept, after a line telling how much was dropped.
  *
  * @param comman Name of a command to run. If command doesn't contain '/', this function will
  *               search for the specified command in PATH.
  * @param args List of arguments for the command.
- * @param output A standard output from the command.
+ * @param output Appended with the standard output and error from the command.
+ * @param options How long the command may run, and how much of its output is kept. mergeError is always set.
  *
  * @return An exit code from the command.
  */
-int ADUC_LaunchChildProcess(const std::string& command, std::vector<std::string> args, std::string& output);
+int ADUC_LaunchChildProcess(
+    const std::string& command,
+    std::vector<std::string> args,
+    std::string& output,
+    const ADUC_ChildProcessOptions& options = ADUC_ChildProcessOptions());
 
 /**
  * @brief Ensure that the effective group of the process is the given group (or is root).
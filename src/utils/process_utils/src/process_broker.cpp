@@ -0,0 +1,635 @@
+/**
+ * @file process_broker.cpp
+ * @brief Runs commands through a long-lived child process (a broker) instead of starting a process per command.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/process_broker.hpp"
+#include "aduc/process_utils.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <aduc/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief The descriptor of the broker end of the socket in the broker process.
+ */
+constexpr int BrokerChildFd = STDERR_FILENO + 1;
+
+/**
+ * @brief Moves @p fd to a close-on-exec descriptor above @p minFd, unless it is already above it.
+ * @return bool false if the descriptor cannot be duplicated; @p fd is unchanged then.
+ */
+bool MoveFdAbove(int& fd, int minFd)
+{
+    if (fd > minFd)
+    {
+        return true;
+    }
+
+    const int moved = fcntl(fd, F_DUPFD_CLOEXEC, minFd + 1);
+    if (moved == -1)
+    {
+        return false;
+    }
+
+    close(fd);
+    fd = moved;
+    return true;
+}
+
+bool WriteAll(int fd, const void* data, size_t size)
+{
+    const char* p = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        // MSG_NOSIGNAL: a closed peer is an error, not a SIGPIPE.
+        const ssize_t count = send(fd, p, size, MSG_NOSIGNAL);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        p += count;
+        size -= count;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads @p size bytes, waiting until @p deadline at most. Clock::time_point::max() waits for ever.
+ * @param[out] timedOut Optional. Set to true if the deadline passed first.
+ */
+bool ReadAll(int fd, void* data, size_t size, Clock::time_point deadline, bool* timedOut)
+{
+    char* p = static_cast<char*>(data);
+    while (size > 0)
+    {
+        if (deadline != Clock::time_point::max())
+        {
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+            struct pollfd pollFd = { fd, POLLIN, 0 };
+            const int ready =
+                poll(&pollFd, 1, static_cast<int>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0)));
+            if (ready < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (ready == 0 && timedOut != nullptr)
+            {
+                *timedOut = true;
+            }
+            if (ready <= 0)
+            {
+                return false;
+            }
+        }
+
+        const ssize_t count = read(fd, p, size);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        p += count;
+        size -= count;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a frame, like ADUC_Broker_ReadFrame, waiting until @p deadline at most.
+ */
+bool ReadFrame(int fd, ADUC_BrokerFrameType* type, std::string& payload, Clock::time_point deadline, bool* timedOut)
+{
+    char header[sizeof(uint32_t) + sizeof(uint8_t)];
+    if (!ReadAll(fd, header, sizeof(header), deadline, timedOut))
+    {
+        return false;
+    }
+
+    uint32_t size;
+    uint8_t type8;
+    memcpy(&size, header, sizeof(size));
+    memcpy(&type8, header + sizeof(size), sizeof(type8));
+    if (size > ADUC_BROKER_MAX_FRAME_SIZE)
+    {
+        Log_Error("Broker frame of %u bytes is too large.", size);
+        return false;
+    }
+
+    *type = static_cast<ADUC_BrokerFrameType>(type8);
+    payload.resize(size);
+    return size == 0 || ReadAll(fd, &payload[0], size, deadline, timedOut);
+}
+
+/**
+ * @brief Copies what a request writes to the pipe at @p readFd to output frames, until the pipe is closed.
+ * Keeps draining the pipe after the client is gone, so that the request does not block on a full pipe.
+ */
+void PumpOutput(int readFd, int socketFd, bool* clientGone)
+{
+    char buffer[4096];
+    for (;;)
+    {
+        const ssize_t count = read(readFd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        if (!*clientGone && !ADUC_Broker_WriteFrame(socketFd, ADUC_BrokerFrameType_Output, buffer, count))
+        {
+            *clientGone = true;
+        }
+    }
+}
+
+/**
+ * @brief Runs @p handler with stdout and stderr sent to the client as output frames.
+ */
+int RunWithOutputSentTo(
+    int socketFd, const std::function<int(const std::vector<std::string>& args)>& handler,
+    const std::vector<std::string>& args, bool* clientGone)
+{
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) != 0)
+    {
+        Log_Error("Cannot create output pipe. %s (errno %d).", strerror(errno), errno);
+        return EXIT_FAILURE;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    const int savedStdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    const int savedStderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (savedStdout == -1 || savedStderr == -1)
+    {
+        Log_Error("Cannot save stdout and stderr. %s (errno %d).", strerror(errno), errno);
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        if (savedStdout != -1)
+        {
+            close(savedStdout);
+        }
+        if (savedStderr != -1)
+        {
+            close(savedStderr);
+        }
+        return EXIT_FAILURE;
+    }
+
+    dup2(pipeFds[1], STDOUT_FILENO);
+    dup2(pipeFds[1], STDERR_FILENO);
+    close(pipeFds[1]);
+
+    std::thread pump{ PumpOutput, pipeFds[0], socketFd, clientGone };
+
+    const int exitStatus = handler(args);
+
+    // Closing the last write end of the pipe ends the pump.
+    fflush(stdout);
+    fflush(stderr);
+    dup2(savedStdout, STDOUT_FILENO);
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStdout);
+    close(savedStderr);
+
+    pump.join();
+    close(pipeFds[0]);
+
+    return exitStatus;
+}
+
+/**
+ * @brief A broker child process, and the client end of its socket.
+ */
+class BrokerProcess
+{
+public:
+    BrokerProcess(const BrokerProcess&) = delete;
+    BrokerProcess& operator=(const BrokerProcess&) = delete;
+    BrokerProcess(BrokerProcess&&) = delete;
+    BrokerProcess& operator=(BrokerProcess&&) = delete;
+
+    BrokerProcess() = default;
+
+    ~BrokerProcess()
+    {
+        Stop();
+    }
+
+    std::mutex& Mutex()
+    {
+        return _mutex;
+    }
+
+    bool IsRunning() const
+    {
+        return _fd != -1;
+    }
+
+    /**
+     * @brief Whether the command was found not to start as a broker. It is not tried again.
+     */
+    bool IsUnsupported() const
+    {
+        return _unsupported;
+    }
+
+    int Fd() const
+    {
+        return _fd;
+    }
+
+    /**
+     * @brief Starts @p command as a broker, and waits for its ready frame.
+     */
+    bool Start(const std::string& command)
+    {
+        int socketFds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socketFds) != 0)
+        {
+            Log_Error("Cannot create broker socket. %s (errno %d).", strerror(errno), errno);
+            return false;
+        }
+
+        int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (devNull == -1)
+        {
+            Log_Error("Cannot open /dev/null. %s (errno %d).", strerror(errno), errno);
+            close(socketFds[0]);
+            close(socketFds[1]);
+            return false;
+        }
+
+        pid_t pid = -1;
+        int err = 0;
+        posix_spawn_file_actions_t fileActions;
+        posix_spawnattr_t attributes;
+        bool fileActionsInitialized = false;
+        bool attributesInitialized = false;
+
+        const std::string brokerFd = std::to_string(BrokerChildFd);
+        std::vector<char*> argv;
+        argv.emplace_back(const_cast<char*>(command.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        argv.emplace_back(const_cast<char*>(ADUC_BROKER_FD_OPT)); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        argv.emplace_back(const_cast<char*>(brokerFd.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        argv.emplace_back(nullptr);
+
+        // The file actions below must not overwrite a descriptor before it is duplicated.
+        if (!MoveFdAbove(devNull, BrokerChildFd) || !MoveFdAbove(socketFds[1], BrokerChildFd))
+        {
+            Log_Error("Cannot move the broker descriptors. %s (errno %d).", strerror(errno), errno);
+            goto done;
+        }
+
+        err = posix_spawn_file_actions_init(&fileActions);
+        if (err != 0)
+        {
+            Log_Error("posix_spawn_file_actions_init failed, error %d", err);
+            goto done;
+        }
+        fileActionsInitialized = true;
+
+        // Between requests, the broker has no one to write to. The duplicate of the broker end of the socket is
+        // kept across exec.
+        if ((err = posix_spawn_file_actions_adddup2(&fileActions, devNull, STDOUT_FILENO)) != 0
+            || (err = posix_spawn_file_actions_adddup2(&fileActions, devNull, STDERR_FILENO)) != 0
+            || (err = posix_spawn_file_actions_adddup2(&fileActions, socketFds[1], BrokerChildFd)) != 0)
+        {
+            Log_Error("posix_spawn_file_actions_adddup2 failed, error %d", err);
+            goto done;
+        }
+
+        err = posix_spawnattr_init(&attributes);
+        if (err != 0)
+        {
+            Log_Error("posix_spawnattr_init failed, error %d", err);
+            goto done;
+        }
+        attributesInitialized = true;
+
+        {
+            // Don't pass on the signal mask of the calling thread, or an ignored SIGPIPE.
+            sigset_t signals;
+            sigemptyset(&signals);
+            posix_spawnattr_setsigmask(&attributes, &signals);
+            sigaddset(&signals, SIGPIPE);
+            posix_spawnattr_setsigdefault(&attributes, &signals);
+            posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+        }
+
+        err = posix_spawnp(&pid, command.c_str(), &fileActions, &attributes, &argv[0], environ);
+        if (err != 0)
+        {
+            Log_Error("Cannot start broker %s, error %d", command.c_str(), err);
+            pid = -1;
+        }
+
+    done:
+        if (attributesInitialized)
+        {
+            posix_spawnattr_destroy(&attributes);
+        }
+
+        if (fileActionsInitialized)
+        {
+            posix_spawn_file_actions_destroy(&fileActions);
+        }
+
+        close(devNull);
+        close(socketFds[1]);
+
+        if (pid == -1)
+        {
+            close(socketFds[0]);
+            return false;
+        }
+
+        _pid = pid;
+        _fd = socketFds[0];
+
+        ADUC_BrokerFrameType type;
+        std::string payload;
+        if (!ADUC_Broker_ReadFrame(_fd, &type, payload) || type != ADUC_BrokerFrameType_Ready)
+        {
+            Log_Info("%s does not run as a broker. Starting a process per command instead.", command.c_str());
+            Stop();
+            _unsupported = true;
+            return false;
+        }
+
+        Log_Info("Started broker %s, pid %d.", command.c_str(), _pid);
+        return true;
+    }
+
+    /**
+     * @brief Stops a broker that is not answering, as a child process that runs past its timeout is stopped:
+     * SIGTERM, then SIGKILL if it is still running after @p killGracePeriod.
+     */
+    void Kill(std::chrono::milliseconds killGracePeriod)
+    {
+        if (_pid != -1)
+        {
+            Log_Error("Sending SIGTERM to broker pid %d.", _pid);
+            kill(_pid, SIGTERM);
+
+            const Clock::time_point deadline = Clock::now() + killGracePeriod;
+            int wstatus;
+            pid_t waited;
+            while ((waited = waitpid(_pid, &wstatus, WNOHANG)) == 0 && Clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            if (waited == 0)
+            {
+                Log_Error("Broker did not exit after SIGTERM. Sending SIGKILL to pid %d.", _pid);
+                kill(_pid, SIGKILL);
+            }
+            else
+            {
+                _pid = -1;
+            }
+        }
+
+        Stop();
+    }
+
+    /**
+     * @brief Closes the socket, which ends the broker, and waits for it to exit.
+     */
+    void Stop()
+    {
+        if (_fd != -1)
+        {
+            close(_fd);
+            _fd = -1;
+        }
+
+        if (_pid != -1)
+        {
+            int wstatus;
+            while (waitpid(_pid, &wstatus, 0) == -1 && errno == EINTR)
+            {
+            }
+            _pid = -1;
+        }
+    }
+
+private:
+    std::mutex _mutex;
+    pid_t _pid{ -1 };
+    int _fd{ -1 };
+    bool _unsupported{ false };
+};
+
+std::mutex brokersMutex;
+std::map<std::string, std::unique_ptr<BrokerProcess>> brokers;
+
+BrokerProcess& GetBroker(const std::string& command)
+{
+    std::lock_guard<std::mutex> lock{ brokersMutex };
+    std::unique_ptr<BrokerProcess>& broker = brokers[command];
+    if (!broker)
+    {
+        broker.reset(new BrokerProcess());
+    }
+    return *broker;
+}
+} // namespace
+
+bool ADUC_Broker_WriteFrame(int fd, ADUC_BrokerFrameType type, const void* payload, size_t size)
+{
+    if (size > ADUC_BROKER_MAX_FRAME_SIZE)
+    {
+        return false;
+    }
+
+    char header[sizeof(uint32_t) + sizeof(uint8_t)];
+    const uint32_t size32 = static_cast<uint32_t>(size);
+    const uint8_t type8 = static_cast<uint8_t>(type);
+    memcpy(header, &size32, sizeof(size32));
+    memcpy(header + sizeof(size32), &type8, sizeof(type8));
+
+    return WriteAll(fd, header, sizeof(header)) && (size == 0 || WriteAll(fd, payload, size));
+}
+
+bool ADUC_Broker_ReadFrame(int fd, ADUC_BrokerFrameType* type, std::string& payload)
+{
+    return ReadFrame(fd, type, payload, Clock::time_point::max(), nullptr);
+}
+
+bool ADUC_Broker_WriteRequest(int fd, const std::vector<std::string>& args)
+{
+    std::string payload;
+    for (const std::string& arg : args)
+    {
+        payload.append(arg.c_str(), arg.size() + 1);
+    }
+
+    return ADUC_Broker_WriteFrame(fd, ADUC_BrokerFrameType_Request, payload.data(), payload.size());
+}
+
+bool ADUC_Broker_ReadResponse(
+    int fd, std::string& output, int* exitStatus, std::chrono::milliseconds timeout, bool* timedOut)
+{
+    ADUC_BrokerFrameType type;
+    std::string payload;
+    const Clock::time_point deadline = timeout.count() > 0 ? Clock::now() + timeout : Clock::time_point::max();
+
+    if (timedOut != nullptr)
+    {
+        *timedOut = false;
+    }
+
+    while (ReadFrame(fd, &type, payload, deadline, timedOut))
+    {
+        if (type == ADUC_BrokerFrameType_Output)
+        {
+            output += payload;
+        }
+        else if (type == ADUC_BrokerFrameType_ExitStatus && payload.size() == sizeof(int32_t))
+        {
+            int32_t status;
+            memcpy(&status, payload.data(), sizeof(status));
+            *exitStatus = status;
+            return true;
+        }
+        else
+        {
+            Log_Error("Unexpected broker frame type %d.", type);
+            return false;
+        }
+    }
+
+    return false;
+}
+
+int ADUC_Broker_Serve(int fd, const std::function<int(const std::vector<std::string>& args)>& handler)
+{
+    if (!ADUC_Broker_WriteFrame(fd, ADUC_BrokerFrameType_Ready, nullptr, 0))
+    {
+        return -1;
+    }
+
+    // Send output as it is written, not when the request ends.
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    ADUC_BrokerFrameType type;
+    std::string payload;
+    while (ADUC_Broker_ReadFrame(fd, &type, payload))
+    {
+        if (type != ADUC_BrokerFrameType_Request)
+        {
+            Log_Error("Unexpected broker frame type %d.", type);
+            return -1;
+        }
+
+        std::vector<std::string> args;
+        for (size_t begin = 0; begin < payload.size();)
+        {
+            const size_t end = payload.find('\0', begin);
+            if (end == std::string::npos)
+            {
+                Log_Error("Broker request argument is not terminated.");
+                return -1;
+            }
+            args.emplace_back(payload, begin, end - begin);
+            begin = end + 1;
+        }
+
+        bool clientGone = false;
+        const int32_t exitStatus = RunWithOutputSentTo(fd, handler, args, &clientGone) & 0xff;
+
+        if (clientGone
+            || !ADUC_Broker_WriteFrame(fd, ADUC_BrokerFrameType_ExitStatus, &exitStatus, sizeof(exitStatus)))
+        {
+            return -1;
+        }
+    }
+
+    // The client closed the socket, or it failed.
+    return 0;
+}
+
+int ADUC_LaunchBrokeredChildProcess(
+    const std::string& command,
+    const std::vector<std::string>& args,
+    std::string& output,
+    const ADUC_ChildProcessOptions& options)
+{
+    BrokerProcess& broker = GetBroker(command);
+
+    std::unique_lock<std::mutex> lock{ broker.Mutex(), std::try_to_lock };
+    if (!lock.owns_lock())
+    {
+        // Busy with another thread's request; don't wait for it.
+        return ADUC_LaunchChildProcess(command, args, output, options);
+    }
+
+    if (!broker.IsRunning() && (broker.IsUnsupported() || !broker.Start(command)))
+    {
+        return ADUC_LaunchChildProcess(command, args, output, options);
+    }
+
+    if (!ADUC_Broker_WriteRequest(broker.Fd(), args))
+    {
+        // The broker did not get the request, so it is safe to run it another way.
+        Log_Warn("Broker %s stopped. Restarting it for the next command.", command.c_str());
+        broker.Stop();
+        return ADUC_LaunchChildProcess(command, args, output, options);
+    }
+
+    int exitStatus;
+    bool timedOut;
+    if (!ADUC_Broker_ReadResponse(broker.Fd(), output, &exitStatus, options.timeout, &timedOut))
+    {
+        if (timedOut)
+        {
+            Log_Error("Broker %s timed out while running a command. Restarting it.", command.c_str());
+            broker.Kill(options.killGracePeriod);
+        }
+        else
+        {
+            Log_Error("Broker %s stopped while running a command.", command.c_str());
+            broker.Stop();
+        }
+        return EXIT_FAILURE;
+    }
+
+    return exitStatus;
+}
@@ -17,6 +17,7 @@
 #include <aduc/c_utils.h>
 #include <aduc/config_utils.h>
 #include <aduc/logging.h>
+#include <aduc/process_utils.hpp>
 #include <aduc/string_utils.hpp>
 #include <azure_c_shared_utility/strings.h>
 #include <azure_c_shared_utility/vector.h>
@@ -26,96 +27,139 @@
 #include <sstream>
 #include <string>
 
+#include <algorithm> // for std::min
 #include <chrono>
+#include <thread> // for std::this_thread::sleep_for
 
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
+namespace
+{
 /**
- * @brief Runs specified command in a new process and captures output, error messages, and exit code.
- *        The captured output and error messages will be written to ADUC_LOG_FILE.
- *
- * @param comman Name of a command to run. If command doesn't contain '/', this function will
- *               search for the specified command in PATH.
- * @param args List of arguments for the command.
- * @param output A standard output from the command.
- *
- * @return An exit code from the command.
+ * @brief How often a child that has closed its output is checked for exit, while it has a timeout.
  */
-int ADUC_LaunchChildProcess(const std::string& command, std::vector<std::string> args, std::string& output) // NOLINT(google-runtime-references)
-{
-#define READ_END 0
-#define WRITE_END 1
+constexpr std::chrono::milliseconds ChildExitPollInterval{ 10 };
 
-    int filedes[2];
-    const int ret = pipe(filedes);
-    if (ret != 0)
+/**
+ * @brief Keeps the newest bytes appended to it, up to a capacity, in a ring.
+ */
+class OutputTail
+{
+public:
+    explicit OutputTail(size_t capacity) : _capacity(capacity)
     {
-        Log_Error("Cannot create output and error pipes. %s (errno %d).", strerror(errno), errno);
-        return ret;
     }
 
-    const int pid = fork();
-
-    if (pid == 0)
+    void Append(const char* data, size_t size)
     {
-        // Running inside child process.
+        _total += size;
+        if (_capacity == 0)
+        {
+            return;
+        }
 
-        // Redirect stdout and stderr to WRITE_END
-        dup2(filedes[WRITE_END], STDOUT_FILENO);
-        dup2(filedes[WRITE_END], STDERR_FILENO);
+        if (size >= _capacity)
+        {
+            _buffer.assign(data + size - _capacity, _capacity);
+            _start = 0;
+            return;
+        }
 
-        close(filedes[READ_END]);
-        close(filedes[WRITE_END]);
+        if (_buffer.size() + size <= _capacity)
+        {
+            _buffer.append(data, size);
+            return;
+        }
 
-        std::vector<char*> argv;
-        argv.reserve(args.size() + 2);
-        argv.emplace_back(const_cast<char*>(command.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
-        for (const std::string& arg : args)
+        // Full: overwrite the oldest bytes.
+        if (_buffer.size() < _capacity)
         {
-            argv.emplace_back(const_cast<char*>(arg.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+            const size_t fill = _capacity - _buffer.size();
+            _buffer.append(data, fill);
+            data += fill;
+            size -= fill;
         }
-        argv.emplace_back(nullptr);
 
-        // The exec() functions only return if an error has occurred.
-        // The return value is -1, and errno is set to indicate the error.
-        int status = execvp(command.c_str(), &argv[0]);
+        while (size > 0)
+        {
+            const size_t count = std::min(size, _capacity - _start);
+            _buffer.replace(_start, count, data, count);
+            _start = (_start + count) % _capacity;
+            data += count;
+            size -= count;
+        }
+    }
 
-        fprintf(stderr, "execvp failed, returned %d, error %d\n", status, errno);
+    /**
+     * @brief The kept bytes, oldest first.
+     */
+    std::string Contents() const
+    {
+        return _buffer.substr(_start) + _buffer.substr(0, _start);
+    }
 
-        _exit(EXIT_FAILURE);
+    size_t DroppedSize() const
+    {
+        return _total - _buffer.size();
     }
 
-    close(filedes[WRITE_END]);
+private:
+    size_t _capacity;
+    std::string _buffer;
+    size_t _start{ 0 };
+    size_t _total{ 0 };
+};
 
-    for (;;)
+/**
+ * @brief One captured stream of a child process.
+ */
+struct CapturedStream
+{
+    CapturedStream(ADUC_ChildProcessStream stream, size_t capacity) : stream(stream), tail(capacity)
     {
-        char buffer[1024];
-        ssize_t count;
-        count = read(filedes[READ_END], buffer, sizeof(buffer));
+    }
 
-        if (count == -1)
-        {
-            Log_Error("Read failed, error %d", errno);
-            break;
-        }
+    ADUC_ChildProcessStream stream;
+    int fd{ -1 };
+    OutputTail tail;
+    std::string partialLine;
+};
 
-        if (count <= 0)
+/**
+ * @brief Passes the complete lines of @p data to @p onLine, and keeps a partial last line for later.
+ */
+void SplitLines(
+    CapturedStream& captured,
+    const char* data,
+    size_t size,
+    const std::function<void(ADUC_ChildProcessStream stream, const std::string& line)>& onLine)
+{
+    const char* end = data + size;
+    while (data < end)
+    {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+        const char* lineEnd = (newline != nullptr) ? newline : end;
+        captured.partialLine.append(data, lineEnd - data);
+
+        if (newline != nullptr || captured.partialLine.size() >= ADUC_CHILD_PROCESS_MAX_LINE_SIZE)
         {
-            break;
+            onLine(captured.stream, captured.partialLine);
+            captured.partialLine.clear();
         }
 
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
-        buffer[count] = 0;
-        output += buffer;
+        data = (newline != nullptr) ? newline + 1 : end;
     }
+}
 
-    int wstatus;
+int ExitStatusFromWaitStatus(int wstatus)
+{
     int childExitStatus;
 
-    waitpid(pid, &wstatus, 0);
-
     // Get the child process exit code.
     if (WIFEXITED(wstatus))
     {
@@ -144,10 +188,353 @@ int ADUC_LaunchChildProcess(const std::string& command, std::vector<std::string>
         Log_Error("Child process terminated abnormally.", childExitStatus);
     }
 
-    close(filedes[READ_END]);
-
     return childExitStatus;
 }
+} // namespace
+
+/**
+ * @brief Runs specified command in a new process, and captures its output and exit code.
+ *
+ * The process is started with posix_spawn, which does not copy the address space of the agent, and polls
+ * standard output and standard error separately until both are closed.
+ *
+ * @param command Name of a command to run. If command doesn't contain '/', this function will
+ *                search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param options How to capture the output, and how long the command may run.
+ * @param[out] result The exit code and captured output.
+ *
+ * @return true if the command was started.
+ */
+bool ADUC_SpawnChildProcess(
+    const std::string& command,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    ADUC_ChildProcessResult* result)
+{
+#define READ_END 0
+#define WRITE_END 1
+
+    bool started = false;
+    CapturedStream captured[2] = { { ADUC_ChildProcessStream_Output, options.maxOutputSize },
+                                   { ADUC_ChildProcessStream_Error, options.maxOutputSize } };
+    const size_t streamCount = options.mergeError ? 1 : 2;
+    int writeFds[2] = { -1, -1 };
+    posix_spawn_file_actions_t fileActions;
+    posix_spawnattr_t attributes;
+    bool fileActionsInitialized = false;
+    bool attributesInitialized = false;
+    pid_t pid = -1;
+    int err;
+
+    *result = ADUC_ChildProcessResult{};
+
+    for (size_t i = 0; i < streamCount; ++i)
+    {
+        int filedes[2];
+        if (pipe2(filedes, O_CLOEXEC) != 0)
+        {
+            Log_Error("Cannot create output and error pipes. %s (errno %d).", strerror(errno), errno);
+            goto done;
+        }
+        captured[i].fd = filedes[READ_END];
+        writeFds[i] = filedes[WRITE_END];
+    }
+
+    err = posix_spawn_file_actions_init(&fileActions);
+    if (err != 0)
+    {
+        Log_Error("posix_spawn_file_actions_init failed, error %d", err);
+        goto done;
+    }
+    fileActionsInitialized = true;
+
+    // The pipes are close-on-exec; their duplicates on stdout and stderr are not.
+    if ((err = posix_spawn_file_actions_adddup2(&fileActions, writeFds[0], STDOUT_FILENO)) != 0
+        || (err = posix_spawn_file_actions_adddup2(&fileActions, writeFds[streamCount - 1], STDERR_FILENO)) != 0)
+    {
+        Log_Error("posix_spawn_file_actions_adddup2 failed, error %d", err);
+        goto done;
+    }
+
+    err = posix_spawnattr_init(&attributes);
+    if (err != 0)
+    {
+        Log_Error("posix_spawnattr_init failed, error %d", err);
+        goto done;
+    }
+    attributesInitialized = true;
+
+    {
+        // Don't pass on the signal mask of the calling thread, or an ignored SIGPIPE.
+        sigset_t signals;
+        sigemptyset(&signals);
+        posix_spawnattr_setsigmask(&attributes, &signals);
+        sigaddset(&signals, SIGPIPE);
+        posix_spawnattr_setsigdefault(&attributes, &signals);
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+        std::vector<char*> argv;
+        argv.reserve(args.size() + 2);
+        argv.emplace_back(const_cast<char*>(command.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        for (const std::string& arg : args)
+        {
+            argv.emplace_back(const_cast<char*>(arg.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        }
+        argv.emplace_back(nullptr);
+
+        err = posix_spawnp(&pid, command.c_str(), &fileActions, &attributes, &argv[0], environ);
+    }
+
+    if (err != 0)
+    {
+        Log_Error("Cannot start %s, error %d", command.c_str(), err);
+        errno = err;
+        goto done;
+    }
+
+    started = true;
+
+    // Only the child may write now, so that the pipes are closed when it exits.
+    for (int& writeFd : writeFds)
+    {
+        if (writeFd != -1)
+        {
+            close(writeFd);
+            writeFd = -1;
+        }
+    }
+
+    {
+        using Clock = std::chrono::steady_clock;
+        const bool hasTimeout = options.timeout.count() > 0;
+        Clock::time_point deadline = Clock::now() + options.timeout;
+        bool termSent = false;
+        int wstatus = 0;
+        bool reaped = false;
+
+        // Called when the deadline passes. Returns true once the child has been killed and reaped.
+        const auto stopChild = [&]() {
+            if (!termSent)
+            {
+                Log_Error("%s timed out. Sending SIGTERM to pid %d.", command.c_str(), pid);
+                result->timedOut = true;
+                kill(pid, SIGTERM);
+                termSent = true;
+                deadline = Clock::now() + options.killGracePeriod;
+                return false;
+            }
+
+            Log_Error("%s did not exit after SIGTERM. Sending SIGKILL to pid %d.", command.c_str(), pid);
+            kill(pid, SIGKILL);
+            while (waitpid(pid, &wstatus, 0) == -1 && errno == EINTR)
+            {
+            }
+            return true;
+        };
+
+        for (;;)
+        {
+            struct pollfd pollFds[2];
+            nfds_t pollCount = 0;
+            for (size_t i = 0; i < streamCount; ++i)
+            {
+                if (captured[i].fd != -1)
+                {
+                    pollFds[pollCount].fd = captured[i].fd;
+                    pollFds[pollCount].events = POLLIN;
+                    pollFds[pollCount].revents = 0;
+                    ++pollCount;
+                }
+            }
+
+            if (pollCount == 0)
+            {
+                break;
+            }
+
+            int waitMs = -1;
+            if (hasTimeout)
+            {
+                const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+                waitMs = static_cast<int>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+            }
+
+            const int ready = poll(pollFds, pollCount, waitMs);
+            if (ready < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                Log_Error("poll failed, error %d", errno);
+                break;
+            }
+
+            if (ready == 0)
+            {
+                if (!stopChild())
+                {
+                    continue;
+                }
+
+                reaped = true;
+
+                // Processes the child started may still hold the pipes. Don't wait for them.
+                break;
+            }
+
+            for (nfds_t p = 0; p < pollCount; ++p)
+            {
+                if (pollFds[p].revents == 0)
+                {
+                    continue;
+                }
+
+                CapturedStream& stream = (pollFds[p].fd == captured[0].fd) ? captured[0] : captured[1];
+                char buffer[4096];
+                const ssize_t count = read(stream.fd, buffer, sizeof(buffer));
+                if (count < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+
+                if (count <= 0)
+                {
+                    if (count < 0)
+                    {
+                        Log_Error("Read failed, error %d", errno);
+                    }
+                    close(stream.fd);
+                    stream.fd = -1;
+                    continue;
+                }
+
+                stream.tail.Append(buffer, count);
+                if (options.onLine)
+                {
+                    SplitLines(stream, buffer, count, options.onLine);
+                }
+            }
+        }
+
+        // The child may close its output and keep running, so the deadline still holds.
+        while (!reaped)
+        {
+            const pid_t waited = waitpid(pid, &wstatus, hasTimeout ? WNOHANG : 0);
+            if (waited == pid)
+            {
+                break;
+            }
+
+            if (waited == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                Log_Error("waitpid failed, error %d", errno);
+                break;
+            }
+
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+            if (remaining.count() <= 0)
+            {
+                reaped = stopChild();
+                continue;
+            }
+
+            std::this_thread::sleep_for(std::min(remaining, ChildExitPollInterval));
+        }
+
+        result->exitStatus = ExitStatusFromWaitStatus(wstatus);
+    }
+
+    if (options.onLine)
+    {
+        for (size_t i = 0; i < streamCount; ++i)
+        {
+            if (!captured[i].partialLine.empty())
+            {
+                options.onLine(captured[i].stream, captured[i].partialLine);
+            }
+        }
+    }
+
+    result->output = captured[0].tail.Contents();
+    result->droppedOutputSize = captured[0].tail.DroppedSize();
+    if (!options.mergeError)
+    {
+        result->error = captured[1].tail.Contents();
+        result->droppedErrorSize = captured[1].tail.DroppedSize();
+    }
+
+done:
+    for (size_t i = 0; i < 2; ++i)
+    {
+        if (captured[i].fd != -1)
+        {
+            close(captured[i].fd);
+        }
+        if (writeFds[i] != -1)
+        {
+            close(writeFds[i]);
+        }
+    }
+
+    if (attributesInitialized)
+    {
+        posix_spawnattr_destroy(&attributes);
+    }
+
+    if (fileActionsInitialized)
+    {
+        posix_spawn_file_actions_destroy(&fileActions);
+    }
+
+    return started;
+}
+
+/**
+ * @brief Runs specified command in a new process and captures output, error messages, and exit code.
+ *
+ * Standard error is captured with standard output. Only the newest ADUC_CHILD_PROCESS_DEFAULT_MAX_OUTPUT_SIZE bytes
+ * are kept, after a line telling how much was dropped.
+ *
+ * @param comman Name of a command to run. If command doesn't contain '/', this function will
+ *               search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param output Appended with the standard output and error from the command.
+ * @param options How long the command may run, and how much of its output is kept. mergeError is always set.
+ *
+ * @return An exit code from the command.
+ */
+int ADUC_LaunchChildProcess(
+    const std::string& command,
+    std::vector<std::string> args,
+    std::string& output, // NOLINT(google-runtime-references)
+    const ADUC_ChildProcessOptions& options)
+{
+    ADUC_ChildProcessOptions mergedOptions = options;
+    mergedOptions.mergeError = true;
+
+    ADUC_ChildProcessResult result;
+    if (!ADUC_SpawnChildProcess(command, args, mergedOptions, &result))
+    {
+        // As the child used to report a failed exec.
+        output += "Cannot start " + command + ", error " + std::to_string(errno) + "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (result.droppedOutputSize > 0)
+    {
+        Log_Warn("Kept the last %zu bytes of output from %s.", result.output.size(), command.c_str());
+        output += "[" + std::to_string(result.droppedOutputSize) + " bytes of output dropped]\n";
+    }
+
+    output += result.output;
+    return result.exitStatus;
+}
 
 /**
  * @brief Ensure that the effective group of the process is the given group (or is root).
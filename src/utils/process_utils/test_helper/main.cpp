@@ -10,19 +10,19 @@
 #include <getopt.h>
 #include <sstream>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aduc/process_broker.hpp"
 
 /**
- * @brief Main method.
+ * @brief Runs the options, as a process or as a broker request.
  *
  * @param argc Count of arguments in @p argv.
  * @param argv Arguments, first is the process name.
- * @return int Return value. 0 for succeeded.
- *
- * @note argv[0]: process name
- * @note argv[1]: connection string.
- * @note argv[2..n]: optional parameters for upper layer.
+ * @return int The exit status.
  */
-int main(int argc, char** argv)
+int RunOptions(int argc, char** argv)
 {
     int exitStatus = EXIT_SUCCESS;
     int exitErrno = 0;
@@ -37,6 +37,9 @@ int main(int argc, char** argv)
             { "errno",              required_argument,   nullptr, 'n' },
             { "exit-status",        required_argument,   nullptr, 'x' },
             { "segfault",           no_argument,         nullptr, 's' },
+            { "pid",                no_argument,         nullptr, 'p' },
+            { "exit-now",           no_argument,         nullptr, 'q' },
+            { "wait",               required_argument,   nullptr, 'w' },
             { nullptr, 0, nullptr, 0 }
         };
         // clang-format on
@@ -44,7 +47,7 @@ int main(int argc, char** argv)
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        int option = getopt_long(argc, argv, "o:e:n:x:sd", long_options, &option_index);
+        int option = getopt_long(argc, argv, "o:e:n:x:sdpqw:", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (option == -1)
@@ -98,6 +101,20 @@ int main(int argc, char** argv)
         }
         break;
 
+        case 'p':
+            printf("pid %d\n", getpid());
+            break;
+
+        case 'q':
+            // Ends the process, even when serving a broker request.
+            fflush(stdout);
+            _exit(exitStatus);
+
+        case 'w':
+            // Milliseconds.
+            usleep(static_cast<useconds_t>(atoi(optarg)) * 1000);
+            break;
+
         default:
             printf("Unknown argument.");
             exitStatus = EXIT_FAILURE;
@@ -112,3 +129,33 @@ int main(int argc, char** argv)
 
     return exitStatus;
 }
+
+/**
+ * @brief Main method.
+ *
+ * @param argc Count of arguments in @p argv.
+ * @param argv Arguments, first is the process name.
+ * @return int Return value. 0 for succeeded.
+ *
+ * @note "--broker-fd <fd>" serves the options of each broker request instead.
+ */
+int main(int argc, char** argv)
+{
+    if (argc == 3 && strcmp(argv[1], ADUC_BROKER_FD_OPT) == 0)
+    {
+        return ADUC_Broker_Serve(atoi(argv[2]), [](const std::vector<std::string>& args) {
+            std::vector<char*> requestArgv;
+            requestArgv.emplace_back(const_cast<char*>("process_utils_tests_helper")); // NOLINT
+            for (const std::string& arg : args)
+            {
+                requestArgv.emplace_back(const_cast<char*>(arg.c_str())); // NOLINT
+            }
+            requestArgv.emplace_back(nullptr);
+
+            optind = 0;
+            return RunOptions(static_cast<int>(requestArgv.size() - 1), &requestArgv[0]);
+        });
+    }
+
+    return RunOptions(argc, argv);
+}
@@ -0,0 +1,246 @@
+/**
+ * @file process_broker_ut.cpp
+ * @brief Unit Tests for running commands through a broker process.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Catch::Matchers::Contains;
+
+#include "aduc/process_broker.hpp"
+
+namespace
+{
+/**
+ * @brief A connected socketpair, closed on destruction.
+ */
+class SocketPair
+{
+public:
+    SocketPair(const SocketPair&) = delete;
+    SocketPair& operator=(const SocketPair&) = delete;
+    SocketPair(SocketPair&&) = delete;
+    SocketPair& operator=(SocketPair&&) = delete;
+
+    SocketPair()
+    {
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, _fds) == 0);
+    }
+
+    ~SocketPair()
+    {
+        CloseClient();
+        CloseBroker();
+    }
+
+    int Client() const
+    {
+        return _fds[0];
+    }
+
+    int Broker() const
+    {
+        return _fds[1];
+    }
+
+    void CloseClient()
+    {
+        Close(0);
+    }
+
+    void CloseBroker()
+    {
+        Close(1);
+    }
+
+private:
+    void Close(int index)
+    {
+        if (_fds[index] != -1)
+        {
+            close(_fds[index]);
+            _fds[index] = -1;
+        }
+    }
+
+    int _fds[2];
+};
+} // namespace
+
+const char* brokerCommand = "process_utils_tests_helper";
+
+TEST_CASE("Broker request frame holds the arguments")
+{
+    SocketPair sockets;
+    const std::vector<std::string> args{ "--update-type", "microsoft/script", "", "--target-data", "a b" };
+
+    REQUIRE(ADUC_Broker_WriteRequest(sockets.Client(), args));
+
+    ADUC_BrokerFrameType type;
+    std::string payload;
+    REQUIRE(ADUC_Broker_ReadFrame(sockets.Broker(), &type, payload));
+    CHECK(type == ADUC_BrokerFrameType_Request);
+    CHECK(payload == std::string("--update-type\0microsoft/script\0\0--target-data\0a b\0", 50));
+}
+
+TEST_CASE("Broker response is the output frames up to the exit status")
+{
+    SocketPair sockets;
+    const int32_t status = 42;
+
+    REQUIRE(ADUC_Broker_WriteFrame(sockets.Broker(), ADUC_BrokerFrameType_Output, "first ", 6));
+    REQUIRE(ADUC_Broker_WriteFrame(sockets.Broker(), ADUC_BrokerFrameType_Output, "second", 6));
+    REQUIRE(ADUC_Broker_WriteFrame(sockets.Broker(), ADUC_BrokerFrameType_ExitStatus, &status, sizeof(status)));
+
+    std::string output;
+    int exitStatus = 0;
+    REQUIRE(ADUC_Broker_ReadResponse(sockets.Client(), output, &exitStatus));
+    CHECK(output == "first second");
+    CHECK(exitStatus == 42);
+}
+
+TEST_CASE("Broker response without an exit status is an error")
+{
+    SocketPair sockets;
+
+    REQUIRE(ADUC_Broker_WriteFrame(sockets.Broker(), ADUC_BrokerFrameType_Output, "cut", 3));
+    sockets.CloseBroker();
+
+    std::string output;
+    int exitStatus = 0;
+    CHECK_FALSE(ADUC_Broker_ReadResponse(sockets.Client(), output, &exitStatus));
+    CHECK(output == "cut");
+}
+
+TEST_CASE("Broker response that does not end in time is an error")
+{
+    SocketPair sockets;
+
+    REQUIRE(ADUC_Broker_WriteFrame(sockets.Broker(), ADUC_BrokerFrameType_Output, "slow", 4));
+
+    std::string output;
+    int exitStatus = 0;
+    bool timedOut = false;
+    CHECK_FALSE(
+        ADUC_Broker_ReadResponse(sockets.Client(), output, &exitStatus, std::chrono::milliseconds(100), &timedOut));
+    CHECK(timedOut);
+    CHECK(output == "slow");
+}
+
+TEST_CASE("Broker serves each request with its output and exit status")
+{
+    SocketPair sockets;
+    std::vector<std::vector<std::string>> requests;
+
+    int serveResult = -1;
+    std::thread broker{ [&]() {
+        serveResult = ADUC_Broker_Serve(sockets.Broker(), [&](const std::vector<std::string>& args) {
+            requests.push_back(args);
+            printf("out %s\n", args[0].c_str());
+            fprintf(stderr, "err %s\n", args[0].c_str());
+            return 256 + 7;
+        });
+    } };
+
+    ADUC_BrokerFrameType type;
+    std::string payload;
+    REQUIRE(ADUC_Broker_ReadFrame(sockets.Client(), &type, payload));
+    CHECK(type == ADUC_BrokerFrameType_Ready);
+
+    for (const char* name : { "one", "two" })
+    {
+        REQUIRE(ADUC_Broker_WriteRequest(sockets.Client(), { name, "x" }));
+
+        std::string output;
+        int exitStatus = 0;
+        REQUIRE(ADUC_Broker_ReadResponse(sockets.Client(), output, &exitStatus));
+        CHECK_THAT(output, Contains(std::string("out ") + name + "\n"));
+        CHECK_THAT(output, Contains(std::string("err ") + name + "\n"));
+        // Only the low 8 bits, as for a process.
+        CHECK(exitStatus == 7);
+    }
+
+    sockets.CloseClient();
+    broker.join();
+
+    CHECK(serveResult == 0);
+    REQUIRE(requests.size() == 2);
+    CHECK(requests[1] == std::vector<std::string>{ "two", "x" });
+}
+
+TEST_CASE("Brokered command falls back to a process per command")
+{
+    // hostname does not run as a broker.
+    const char* bogusOption = "--bogus-param-abc";
+    std::vector<std::string> args;
+    args.emplace_back(bogusOption);
+    std::string output;
+
+    const int exitCode = ADUC_LaunchBrokeredChildProcess("hostname", args, output);
+
+    CHECK(exitCode != EXIT_SUCCESS);
+    CHECK_THAT(output.c_str(), Contains(bogusOption));
+}
+
+TEST_CASE("Brokered command reuses the broker", "[!hide][functional_test]")
+{
+    std::string first;
+    std::string second;
+
+    CHECK(ADUC_LaunchBrokeredChildProcess(brokerCommand, { "-p" }, first) == EXIT_SUCCESS);
+    CHECK(ADUC_LaunchBrokeredChildProcess(brokerCommand, { "-p" }, second) == EXIT_SUCCESS);
+
+    CHECK_THAT(first, Contains("pid "));
+    CHECK_THAT(first, !Contains("pid " + std::to_string(getpid())));
+    CHECK(first == second);
+}
+
+TEST_CASE("Brokered command captures output and exit status", "[!hide][functional_test]")
+{
+    std::string output;
+    const int exitCode = ADUC_LaunchBrokeredChildProcess(
+        brokerCommand, { "-o", "This is a normal output string.", "-e", "An error string.", "-x", "200" }, output);
+
+    CHECK(exitCode == 200);
+    CHECK_THAT(output, Contains("This is a normal output string.\n"));
+    CHECK_THAT(output, Contains("An error string.\n"));
+}
+
+TEST_CASE("Brokered command fails when the broker stops, and the broker restarts", "[!hide][functional_test]")
+{
+    std::string output;
+    CHECK(ADUC_LaunchBrokeredChildProcess(brokerCommand, { "-q" }, output) == EXIT_FAILURE);
+
+    output.clear();
+    CHECK(ADUC_LaunchBrokeredChildProcess(brokerCommand, { "-o", "restarted" }, output) == EXIT_SUCCESS);
+    CHECK_THAT(output, Contains("restarted\n"));
+}
+
+TEST_CASE("Brokered command that runs past the timeout fails, and the broker restarts", "[!hide][functional_test]")
+{
+    std::string first;
+    REQUIRE(ADUC_LaunchBrokeredChildProcess(brokerCommand, { "-p" }, first) == EXIT_SUCCESS);
+
+    ADUC_ChildProcessOptions options;
+    options.timeout = std::chrono::milliseconds(200);
+    options.killGracePeriod = std::chrono::milliseconds(100);
+
+    std::string output;
+    const auto start = std::chrono::steady_clock::now();
+    CHECK(ADUC_LaunchBrokeredChildProcess(brokerCommand, { "-w", "60000" }, output, options) == EXIT_FAILURE);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+    std::string second;
+    CHECK(ADUC_LaunchBrokeredChildProcess(brokerCommand, { "-p" }, second) == EXIT_SUCCESS);
+    CHECK_THAT(second, Contains("pid "));
+    CHECK(first != second);
+}
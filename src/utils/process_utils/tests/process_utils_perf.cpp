@@ -0,0 +1,66 @@
+/**
+ * @file process_utils_perf.cpp
+ * @brief Benchmarks for starting child processes and capturing their output.
+ *
+ * Hidden from the default run. Use: process_utils_unit_tests "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/process_utils.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+namespace
+{
+long PeakRssKiB()
+{
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+} // namespace
+
+TEST_CASE("ADUC_LaunchChildProcess - peak RSS with large output", "[.][perf]")
+{
+    // Runs before the spawn latency case, whose large heap would hide the growth.
+    const long before = PeakRssKiB();
+
+    std::string output;
+    CHECK(ADUC_LaunchChildProcess("sh", { "-c", "yes 'a line of apt or swupdate output' | head -c 268435456" }, output)
+          == EXIT_SUCCESS);
+
+    std::cout << "256 MiB of output\tkept " << (output.size() >> 10) << " KiB\tpeak RSS grew "
+              << (PeakRssKiB() - before) << " KiB" << std::endl;
+    CHECK(output.size() <= ADUC_CHILD_PROCESS_DEFAULT_MAX_OUTPUT_SIZE + 64);
+}
+
+TEST_CASE("ADUC_LaunchChildProcess - spawn latency", "[.][perf]")
+{
+    constexpr int launches = 200;
+
+    // A large heap makes copying the address space, as fork does, more costly.
+    std::vector<char> heap(256 * 1024 * 1024, 1);
+
+    std::vector<double> latencies;
+    latencies.reserve(launches);
+    for (int i = 0; i < launches; ++i)
+    {
+        std::string output;
+        const auto start = std::chrono::steady_clock::now();
+        CHECK(ADUC_LaunchChildProcess("true", {}, output) == EXIT_SUCCESS);
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        latencies.push_back(elapsed.count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "spawn\tp50 " << latencies[launches / 2] << " us\tp99 " << latencies[launches * 99 / 100]
+              << " us\t(heap " << (heap.size() >> 20) << " MiB)" << std::endl;
+}
@@ -8,6 +8,8 @@
 #include <azure_c_shared_utility/strings.h>
 #include <azure_c_shared_utility/vector.h>
 #include <catch2/catch.hpp>
+#include <chrono>
+#include <signal.h>
 #include <unistd.h>
 #include <vector>
 
@@ -92,6 +94,95 @@ TEST_CASE("Invalid option - cp -1")
     CHECK_THAT(output.c_str(), Contains("invalid option -- '1'"));
 }
 
+TEST_CASE("Spawn captures standard output and error separately")
+{
+    ADUC_ChildProcessOptions options;
+    ADUC_ChildProcessResult result;
+
+    REQUIRE(ADUC_SpawnChildProcess("sh", { "-c", "echo out; echo err >&2; exit 3" }, options, &result));
+
+    CHECK(result.exitStatus == 3);
+    CHECK(result.output == "out\n");
+    CHECK(result.error == "err\n");
+    CHECK_FALSE(result.timedOut);
+}
+
+TEST_CASE("Spawn passes each line to the callback")
+{
+    std::vector<std::string> lines;
+    ADUC_ChildProcessOptions options;
+    options.mergeError = true;
+    options.onLine = [&lines](ADUC_ChildProcessStream stream, const std::string& line) {
+        CHECK(stream == ADUC_ChildProcessStream_Output);
+        lines.push_back(line);
+    };
+    ADUC_ChildProcessResult result;
+
+    REQUIRE(ADUC_SpawnChildProcess("sh", { "-c", "echo one; echo two >&2; printf three" }, options, &result));
+
+    CHECK(lines == std::vector<std::string>{ "one", "two", "three" });
+    CHECK(result.output == "one\ntwo\nthree");
+}
+
+TEST_CASE("Spawn keeps the newest output up to the limit")
+{
+    ADUC_ChildProcessOptions options;
+    options.maxOutputSize = 4;
+    ADUC_ChildProcessResult result;
+
+    REQUIRE(ADUC_SpawnChildProcess("sh", { "-c", "printf 0123; printf 456; printf 789" }, options, &result));
+
+    CHECK(result.output == "6789");
+    CHECK(result.droppedOutputSize == 6);
+}
+
+TEST_CASE("Spawn stops a child that runs past the timeout")
+{
+    ADUC_ChildProcessOptions options;
+    options.timeout = std::chrono::milliseconds(100);
+    options.killGracePeriod = std::chrono::milliseconds(100);
+    ADUC_ChildProcessResult result;
+
+    SECTION("with SIGTERM")
+    {
+        const auto start = std::chrono::steady_clock::now();
+        REQUIRE(ADUC_SpawnChildProcess("sleep", { "10" }, options, &result));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+        CHECK(result.timedOut);
+        CHECK(result.exitStatus == SIGTERM);
+    }
+
+    SECTION("with SIGKILL if SIGTERM is ignored")
+    {
+        const auto start = std::chrono::steady_clock::now();
+        REQUIRE(ADUC_SpawnChildProcess("sh", { "-c", "trap '' TERM; exec sleep 10" }, options, &result));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+        CHECK(result.timedOut);
+        CHECK(result.exitStatus == SIGKILL);
+    }
+
+    SECTION("after it closes its output")
+    {
+        const auto start = std::chrono::steady_clock::now();
+        REQUIRE(ADUC_SpawnChildProcess("sh", { "-c", "exec >&- 2>&-; exec sleep 10" }, options, &result));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+        CHECK(result.timedOut);
+        CHECK(result.exitStatus == SIGTERM);
+    }
+}
+
+TEST_CASE("Launching a missing command fails")
+{
+    std::vector<std::string> args;
+    std::string output;
+
+    CHECK(ADUC_LaunchChildProcess("/nonexistent/command", args, output) == EXIT_FAILURE);
+    CHECK_THAT(output.c_str(), Contains("Cannot start /nonexistent/command"));
+}
+
 TEST_CASE("VerifyProcessEffectiveGroup")
 {
     SECTION("it should return false when gegrnam returns nullptr and sets errno")
@@ -44,8 +44,12 @@ int ADUC_SystemUtils_MkDirRecursiveAduUser(const char* path);
 
 int ADUC_SystemUtils_RmDirRecursive(const char* path);
 
+int ADUC_SystemUtils_CopyFile(const char* srcFilePath, const char* destFilePath, bool overwriteExistingFile);
+
 int ADUC_SystemUtils_CopyFileToDir(const char* filePath, const char* dirPath, bool overwriteExistingFile);
 
+int ADUC_SystemUtils_CloneFile(const char* srcFilePath, const char* destFilePath);
+
 int ADUC_SystemUtils_RemoveFile(const char* path);
 
 int ADUC_SystemUtils_WriteStringToFile(const char* path, const char* buff);
@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <fcntl.h> // for O_CLOEXEC
 #include <ftw.h> // for nftw
+#include <linux/fs.h> // for FICLONE
 #include <grp.h> // for getgrnam
 #include <limits.h> // for PATH_MAX
 #include <pwd.h> // for getpwnam
@@ -24,7 +25,10 @@
 #include <stdlib.h> // for getenv
 #include <string.h> // for strncpy, strlen
 #include <sys/file.h>
+#include <sys/ioctl.h> // for ioctl
+#include <sys/sendfile.h> // for sendfile
 #include <sys/stat.h>
+#include <sys/syscall.h> // for __NR_copy_file_range
 #include <sys/types.h>
 #include <sys/wait.h> // for waitpid
 #include <unistd.h>
@@ -449,98 +453,410 @@ done:
 }
 
 /**
- * @brief Copies the file at @p filePath to @p dirPath with the same name
- * @details Preserves the ownership and filemode bit permissions
- * @param filePath path to the file
- * @param dirPath path to the directory
- * @param overwriteExistingFile if set to true will overwrite the existing file in @p dirPath named with the filename in @p fileName if it exists
- * @returns the result of the operation
+ * @brief Size of the buffer used when the kernel cannot copy the file for us.
  */
-int ADUC_SystemUtils_CopyFileToDir(const char* filePath, const char* dirPath, const bool overwriteExistingFile)
+#define COPY_FILE_BUFFER_SIZE (1024 * 1024)
+
+/**
+ * @brief Largest chunk requested from copy_file_range and sendfile per call.
+ * @details sendfile transfers at most 0x7ffff000 bytes per call anyway.
+ */
+#define COPY_FILE_MAX_CHUNK_SIZE (1024 * 1024 * 1024)
+
+/**
+ * @brief Whether a kernel copy primitive failed because it cannot handle this pair of files, rather than
+ * because of an I/O error, so the next copy method should be tried.
+ * @param err The errno.
+ * @return true if a fallback should be attempted.
+ */
+static bool IsCopyMethodUnsupported(int err)
 {
+    return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP || err == ENOTSUP || err == EPERM
+        || err == ETXTBSY || err == EBADF;
+}
+
+/**
+ * @brief Gets the number of bytes to request from one copy_file_range or sendfile call.
+ * @param size The size of the source file.
+ * @param offset The number of bytes copied so far.
+ * @return size_t The chunk size.
+ */
+static size_t GetCopyChunkSize(off_t size, off_t offset)
+{
+    return (size - offset > COPY_FILE_MAX_CHUNK_SIZE) ? COPY_FILE_MAX_CHUNK_SIZE : (size_t)(size - offset);
+}
+
+/**
+ * @brief Copies @p size bytes from the start of @p srcFd to @p destFd.
+ * @details Tries, in order, a reflink (FICLONE) of the whole file, copy_file_range, sendfile and finally a
+ * read/write loop through a large buffer. Only the last is pure user space; the others avoid copying the data
+ * through user space, and a reflink avoids copying it at all.
+ *
+ * @param srcFd The source file descriptor.
+ * @param destFd The destination file descriptor, empty and positioned at 0.
+ * @param size The size of the source file.
+ * @param[out] copiedSize The number of bytes copied, which differs from @p size if the source changed size.
+ * @return int 0 on success, -1 on failure with errno set.
+ */
+static int CopyFileContent(int srcFd, int destFd, off_t size, off_t* copiedSize)
+{
+    off_t offset = 0;
+    *copiedSize = 0;
+
+#ifdef FICLONE
+    // Shares the extents on file systems such as btrfs and XFS. Fails immediately with EXDEV across mounts.
+    if (ioctl(destFd, FICLONE, srcFd) == 0)
+    {
+        struct stat destStat;
+        if (fstat(destFd, &destStat) != 0)
+        {
+            return -1;
+        }
+
+        *copiedSize = destStat.st_size;
+        return 0;
+    }
+#endif
+
+#ifdef __NR_copy_file_range
+    // Called via syscall() since glibc only wraps copy_file_range from 2.27.
+    bool tryCopyFileRange = true;
+    while (tryCopyFileRange && offset < size)
+    {
+        const size_t chunk = GetCopyChunkSize(size, offset);
+        loff_t inOffset = offset;
+        const ssize_t copied = syscall(__NR_copy_file_range, srcFd, &inOffset, destFd, NULL, chunk, 0);
+        if (copied > 0)
+        {
+            offset += copied;
+        }
+        else if (copied == 0)
+        {
+            // Source shrank underneath us.
+            break;
+        }
+        else if (errno == EINTR)
+        {
+            continue;
+        }
+        else if (offset == 0 && IsCopyMethodUnsupported(errno))
+        {
+            tryCopyFileRange = false;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (offset > 0)
+    {
+        *copiedSize = offset;
+        return 0;
+    }
+#endif
+
+    bool trySendFile = true;
+    while (trySendFile && offset < size)
+    {
+        const size_t chunk = GetCopyChunkSize(size, offset);
+        const ssize_t copied = sendfile(destFd, srcFd, &offset, chunk);
+        if (copied == 0)
+        {
+            break;
+        }
+        else if (copied < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (offset != 0 || !IsCopyMethodUnsupported(errno))
+            {
+                return -1;
+            }
+            trySendFile = false;
+        }
+    }
+
+    if (offset > 0 || size == 0)
+    {
+        *copiedSize = offset;
+        return 0;
+    }
+
     int result = -1;
-    STRING_HANDLE destFilePath = NULL;
+    void* buffer = malloc(COPY_FILE_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        errno = ENOMEM;
+        goto done;
+    }
 
-    FILE* sourceFile = NULL;
-    FILE* destFile = NULL;
-    const size_t readMaxBuffSize = 1024;
-    unsigned char readBuff[readMaxBuffSize];
+    for (;;)
+    {
+        const ssize_t readBytes = pread(srcFd, buffer, COPY_FILE_BUFFER_SIZE, offset);
+        if (readBytes == 0)
+        {
+            break;
+        }
 
-    memset(readBuff, 0, readMaxBuffSize);
+        if (readBytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            goto done;
+        }
 
-    if (filePath == NULL || dirPath == NULL)
+        ssize_t writtenBytes = 0;
+        while (writtenBytes < readBytes)
+        {
+            const ssize_t written = write(destFd, (char*)buffer + writtenBytes, (size_t)(readBytes - writtenBytes));
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                goto done;
+            }
+            writtenBytes += written;
+        }
+
+        offset += readBytes;
+    }
+
+    *copiedSize = offset;
+    result = 0;
+
+done:
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief Copies the file at @p srcFilePath to @p destFilePath.
+ * @details Uses the fastest copy the kernel and file systems support, preserves the filemode bit permissions,
+ * and flushes the copy to storage before returning. Fails if the source changes size during the copy. A partial
+ * destination file is removed on failure.
+ * @param srcFilePath path to the source file
+ * @param destFilePath path to the destination file
+ * @param overwriteExistingFile if set to true will overwrite an existing file at @p destFilePath; otherwise the copy
+ * fails if it exists.
+ * @returns 0 on success; -1 on failure with errno set.
+ */
+int ADUC_SystemUtils_CopyFile(const char* srcFilePath, const char* destFilePath, const bool overwriteExistingFile)
+{
+    int result = -1;
+    int srcFd = -1;
+    int destFd = -1;
+    bool createdDestFile = false;
+    int savedErrno = 0;
+    off_t copiedSize = 0;
+
+    if (srcFilePath == NULL || destFilePath == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    srcFd = open(srcFilePath, O_RDONLY | O_CLOEXEC);
+    if (srcFd == -1)
     {
         goto done;
     }
 
-    if (!ADUC_SystemUtils_FormatFilePathHelper(&destFilePath, filePath, dirPath))
+    struct stat srcStat;
+    if (fstat(srcFd, &srcStat) != 0)
+    {
+        goto done;
+    }
+
+    if (!S_ISREG(srcStat.st_mode))
     {
+        errno = EINVAL;
         goto done;
     }
 
-    sourceFile = fopen(filePath, "rb");
+    (void)posix_fadvise(srcFd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-    if (sourceFile == NULL)
+    destFd = open(
+        destFilePath,
+        O_WRONLY | O_CREAT | O_CLOEXEC | (overwriteExistingFile ? O_TRUNC : O_EXCL),
+        S_IRUSR | S_IWUSR);
+    if (destFd == -1)
     {
         goto done;
     }
+    createdDestFile = true;
 
-    if (overwriteExistingFile)
+    if (CopyFileContent(srcFd, destFd, srcStat.st_size, &copiedSize) != 0)
     {
-        destFile = fopen(STRING_c_str(destFilePath), "wb+");
+        Log_Error("copy '%s' -> '%s' failed, errno: %d", srcFilePath, destFilePath, errno);
+        goto done;
     }
-    else
+
+    if (copiedSize != srcStat.st_size)
+    {
+        Log_Error(
+            "copy '%s' -> '%s' failed, copied %lld of %lld bytes. Source changed during copy.",
+            srcFilePath,
+            destFilePath,
+            (long long)copiedSize,
+            (long long)srcStat.st_size);
+        errno = EIO;
+        goto done;
+    }
+
+    if (fchmod(destFd, srcStat.st_mode & ALL_PERMS) != 0)
     {
-        destFile = fopen(STRING_c_str(destFilePath), "wb");
+        goto done;
     }
 
-    if (destFile == NULL)
+    if (fsync(destFd) != 0)
     {
         goto done;
     }
 
-    size_t readBytes = fread(readBuff, readMaxBuffSize, sizeof(readBuff[0]), sourceFile);
+    result = 0;
+
+done:
+    savedErrno = errno;
+
+    if (srcFd != -1)
+    {
+        close(srcFd);
+    }
+
+    if (destFd != -1 && close(destFd) != 0 && result == 0)
+    {
+        savedErrno = errno;
+        result = -1;
+    }
 
-    while (readBytes != 0 && feof(sourceFile) != 0)
+    if (result != 0 && createdDestFile)
     {
-        const size_t writtenBytes = fwrite(readBuff, readBytes, sizeof(readBuff[0]), destFile);
+        (void)unlink(destFilePath);
+    }
 
-        result = ferror(destFile);
-        if (writtenBytes != readBytes || result != 0)
-        {
-            goto done;
-        }
+    errno = savedErrno;
+    return result;
+}
 
-        readBytes = fread(readBuff, readMaxBuffSize, sizeof(readBuff[0]), sourceFile);
-        result = ferror(sourceFile);
-        if (result != 0)
-        {
-            goto done;
-        }
+/**
+ * @brief Creates @p destFilePath as a reflink of @p srcFilePath, which shares its extents instead of copying them.
+ * @details Never copies the content. The new file has the permissions of the source.
+ * @param srcFilePath path to the source file
+ * @param destFilePath path to the destination file, which must not exist
+ * @returns 0 on success; -1 on failure with errno set, e.g. EOPNOTSUPP or EXDEV if the file system cannot reflink.
+ */
+int ADUC_SystemUtils_CloneFile(const char* srcFilePath, const char* destFilePath)
+{
+    int result = -1;
+    int srcFd = -1;
+    int destFd = -1;
+    bool createdDestFile = false;
+    int savedErrno = 0;
+
+    if (srcFilePath == NULL || destFilePath == NULL)
+    {
+        errno = EINVAL;
+        return -1;
     }
 
-    struct stat buff;
-    if (stat(filePath, &buff) != 0)
+    srcFd = open(srcFilePath, O_RDONLY | O_CLOEXEC);
+    if (srcFd == -1)
     {
         goto done;
     }
 
-    if (chmod(STRING_c_str(destFilePath), buff.st_mode) != 0)
+    struct stat srcStat;
+    if (fstat(srcFd, &srcStat) != 0)
+    {
+        goto done;
+    }
+
+    if (!S_ISREG(srcStat.st_mode))
+    {
+        errno = EINVAL;
+        goto done;
+    }
+
+    destFd = open(destFilePath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (destFd == -1)
+    {
+        goto done;
+    }
+    createdDestFile = true;
+
+#ifdef FICLONE
+    if (ioctl(destFd, FICLONE, srcFd) != 0)
+    {
+        goto done;
+    }
+#else
+    errno = EOPNOTSUPP;
+    goto done;
+#endif
+
+    if (fchmod(destFd, srcStat.st_mode & ALL_PERMS) != 0)
     {
         goto done;
     }
 
     result = 0;
+
 done:
+    savedErrno = errno;
+
+    if (srcFd != -1)
+    {
+        close(srcFd);
+    }
 
-    fclose(sourceFile);
-    fclose(destFile);
+    if (destFd != -1 && close(destFd) != 0 && result == 0)
+    {
+        savedErrno = errno;
+        result = -1;
+    }
 
-    if (result != 0)
+    if (result != 0 && createdDestFile)
     {
-        remove(STRING_c_str(destFilePath));
+        (void)unlink(destFilePath);
     }
 
+    errno = savedErrno;
+    return result;
+}
+
+/**
+ * @brief Copies the file at @p filePath to @p dirPath with the same name
+ * @details Preserves the filemode bit permissions. See ADUC_SystemUtils_CopyFile.
+ * @param filePath path to the file
+ * @param dirPath path to the directory
+ * @param overwriteExistingFile if set to true will overwrite the existing file in @p dirPath named with the filename in @p fileName if it exists
+ * @returns the result of the operation
+ */
+int ADUC_SystemUtils_CopyFileToDir(const char* filePath, const char* dirPath, const bool overwriteExistingFile)
+{
+    int result = -1;
+    STRING_HANDLE destFilePath = NULL;
+
+    if (filePath == NULL || dirPath == NULL)
+    {
+        goto done;
+    }
+
+    if (!ADUC_SystemUtils_FormatFilePathHelper(&destFilePath, filePath, dirPath))
+    {
+        goto done;
+    }
+
+    result = ADUC_SystemUtils_CopyFile(filePath, STRING_c_str(destFilePath), overwriteExistingFile);
+
+done:
     STRING_delete(destFilePath);
     return result;
 }
@@ -0,0 +1,113 @@
+/**
+ * @file system_utils_perf.cpp
+ * @brief Benchmark for ADUC_SystemUtils_CopyFileToDir against the stdio copy loop it replaced.
+ *
+ * Hidden from the default run. Use: system_utils_unit_tests "[perf]"
+ * Set ADUC_COPY_PERF_DEST_DIR to a directory on another file system to measure the cross-mount case.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/system_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h> // for fsync
+
+/**
+ * @brief The previous copy: fread/fwrite through a 1 KiB stack buffer.
+ *
+ * @param srcPath The source file.
+ * @param destPath The destination file.
+ * @return bool true on success.
+ */
+static bool LegacyCopy(const std::string& srcPath, const std::string& destPath)
+{
+    FILE* src = fopen(srcPath.c_str(), "rb");
+    FILE* dest = fopen(destPath.c_str(), "wb");
+    bool success = src != nullptr && dest != nullptr;
+
+    unsigned char buffer[1024];
+    size_t readBytes = 0;
+    while (success && (readBytes = fread(buffer, 1, sizeof(buffer), src)) != 0)
+    {
+        success = fwrite(buffer, 1, readBytes, dest) == readBytes;
+    }
+
+    success = success && fflush(dest) == 0 && fsync(fileno(dest)) == 0;
+
+    if (src != nullptr)
+    {
+        fclose(src);
+    }
+
+    if (dest != nullptr)
+    {
+        fclose(dest);
+    }
+
+    return success;
+}
+
+TEST_CASE("ADUC_SystemUtils_CopyFileToDir throughput", "[.][perf]")
+{
+    constexpr size_t fileSize = 512 * 1024 * 1024;
+
+    const std::string testDir{ std::string{ ADUC_SystemUtils_GetTemporaryPathName() } + "/system_utils_perf" };
+    const char* destDirEnv = getenv("ADUC_COPY_PERF_DEST_DIR");
+    const std::string destDir{ destDirEnv != nullptr ? destDirEnv : testDir + "/dest" };
+
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(testDir.c_str()) == 0);
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(destDir.c_str()) == 0);
+
+    const std::string srcFile{ testDir + "/payload.bin" };
+    const std::string destFile{ destDir + "/payload.bin" };
+
+    {
+        std::vector<char> block(1024 * 1024);
+        for (size_t i = 0; i < block.size(); ++i)
+        {
+            block[i] = static_cast<char>(i * 31 + 7);
+        }
+
+        std::ofstream file{ srcFile, std::ios::binary | std::ios::trunc };
+        for (size_t written = 0; written < fileSize; written += block.size())
+        {
+            file.write(block.data(), block.size());
+        }
+    }
+
+    std::cout << "file size: " << (fileSize / (1024 * 1024)) << " MiB, dest: " << destDir << std::endl;
+    std::cout << "method\tMiB/s" << std::endl;
+
+    {
+        (void)ADUC_SystemUtils_RemoveFile(destFile.c_str());
+
+        const auto start = std::chrono::steady_clock::now();
+        REQUIRE(LegacyCopy(srcFile, destFile));
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << "stdio-1KiB\t" << (fileSize / (1024.0 * 1024.0)) / elapsed.count() << std::endl;
+    }
+
+    {
+        (void)ADUC_SystemUtils_RemoveFile(destFile.c_str());
+
+        const auto start = std::chrono::steady_clock::now();
+        REQUIRE(ADUC_SystemUtils_CopyFileToDir(srcFile.c_str(), destDir.c_str(), false) == 0);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << "engine\t" << (fileSize / (1024.0 * 1024.0)) / elapsed.count() << std::endl;
+    }
+
+    CHECK(ADUC_SystemUtils_RemoveFile(destFile.c_str()) == 0);
+    CHECK(ADUC_SystemUtils_RmDirRecursive(testDir.c_str()) == 0);
+}
@@ -10,6 +10,8 @@ using Catch::Matchers::Equals;
 
 #include "aduc/system_utils.h"
 #include <aduc/auto_opendir.hpp>
+#include <fstream>
+#include <iterator>
 #include <sys/stat.h>
 #include <vector>
 
@@ -464,3 +466,144 @@ TEST_CASE_METHOD(TestCaseFixture, "SystemUtils_ForEachDir")
             });
     }
 }
+
+/**
+ * @brief Writes @p size bytes of a non-repeating-per-block pattern to @p path.
+ *
+ * @param path The file path.
+ * @param size The number of bytes.
+ * @return std::string The content written.
+ */
+static std::string WritePatternFile(const std::string& path, size_t size)
+{
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+    {
+        content[i] = static_cast<char>((i * 131) ^ (i >> 11));
+    }
+
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    file << content;
+    return content;
+}
+
+/**
+ * @brief Reads the whole file at @p path.
+ *
+ * @param path The file path.
+ * @return std::string The content.
+ */
+static std::string ReadFileContent(const std::string& path)
+{
+    std::ifstream file{ path, std::ios::binary };
+    return std::string{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+}
+
+TEST_CASE_METHOD(TestCaseFixture, "ADUC_SystemUtils_CopyFileToDir")
+{
+    const std::string srcDir{ std::string{ TestPath() } + "/src" };
+    const std::string destDir{ std::string{ TestPath() } + "/dest" };
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(srcDir.c_str()) == 0);
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(destDir.c_str()) == 0);
+
+    const std::string srcFile{ srcDir + "/payload.bin" };
+    const std::string destFile{ destDir + "/payload.bin" };
+
+    SECTION("Copies content and mode")
+    {
+        // Not a multiple of any copy chunk or buffer size.
+        const std::string content = WritePatternFile(srcFile, 3 * 1024 * 1024 + 17);
+        REQUIRE(chmod(srcFile.c_str(), 0750) == 0);
+
+        REQUIRE(ADUC_SystemUtils_CopyFileToDir(srcFile.c_str(), destDir.c_str(), false) == 0);
+
+        CHECK(ReadFileContent(destFile) == content);
+
+        struct stat st = {};
+        REQUIRE(stat(destFile.c_str(), &st) == 0);
+        CHECK((st.st_mode & 07777) == 0750);
+    }
+
+    SECTION("Copies an empty file")
+    {
+        WritePatternFile(srcFile, 0);
+
+        REQUIRE(ADUC_SystemUtils_CopyFileToDir(srcFile.c_str(), destDir.c_str(), false) == 0);
+
+        CHECK(SystemUtils_IsFile(destFile.c_str(), nullptr));
+        CHECK(ReadFileContent(destFile).empty());
+    }
+
+    SECTION("Existing file is kept unless overwrite")
+    {
+        const std::string content = WritePatternFile(srcFile, 1000);
+        const std::string existing = WritePatternFile(destFile, 5000);
+
+        CHECK(ADUC_SystemUtils_CopyFileToDir(srcFile.c_str(), destDir.c_str(), false) != 0);
+        CHECK(ReadFileContent(destFile) == existing);
+
+        // The longer existing file must be truncated.
+        REQUIRE(ADUC_SystemUtils_CopyFileToDir(srcFile.c_str(), destDir.c_str(), true) == 0);
+        CHECK(ReadFileContent(destFile) == content);
+    }
+
+    SECTION("Missing source fails without creating destination")
+    {
+        CHECK(ADUC_SystemUtils_CopyFileToDir(srcFile.c_str(), destDir.c_str(), false) != 0);
+        CHECK_FALSE(SystemUtils_IsFile(destFile.c_str(), nullptr));
+    }
+
+    SECTION("Copies across file systems")
+    {
+        // /dev/shm is usually a tmpfs, so this exercises the fallbacks used when rename fails with EXDEV.
+        if (SystemUtils_IsDir("/dev/shm", nullptr))
+        {
+            const std::string content = WritePatternFile(srcFile, 2 * 1024 * 1024 + 1);
+            const std::string shmFile{ "/dev/shm/system_utils_ut_copy.bin" };
+            (void)ADUC_SystemUtils_RemoveFile(shmFile.c_str());
+
+            REQUIRE(ADUC_SystemUtils_CopyFile(srcFile.c_str(), shmFile.c_str(), false) == 0);
+            CHECK(ReadFileContent(shmFile) == content);
+            CHECK(ADUC_SystemUtils_RemoveFile(shmFile.c_str()) == 0);
+        }
+    }
+}
+
+TEST_CASE_METHOD(TestCaseFixture, "ADUC_SystemUtils_CloneFile")
+{
+    const std::string srcFile{ std::string{ TestPath() } + "/payload.bin" };
+    const std::string destFile{ std::string{ TestPath() } + "/clone.bin" };
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(TestPath()) == 0);
+
+    SECTION("Clones, or fails without copying")
+    {
+        const std::string content = WritePatternFile(srcFile, 64 * 1024 + 3);
+        REQUIRE(chmod(srcFile.c_str(), 0640) == 0);
+
+        if (ADUC_SystemUtils_CloneFile(srcFile.c_str(), destFile.c_str()) == 0)
+        {
+            CHECK(ReadFileContent(destFile) == content);
+
+            struct stat st = {};
+            REQUIRE(stat(destFile.c_str(), &st) == 0);
+            CHECK((st.st_mode & 07777) == 0640);
+        }
+        else
+        {
+            // e.g. ext4 or tmpfs, which cannot reflink.
+            CHECK_FALSE(SystemUtils_IsFile(destFile.c_str(), nullptr));
+        }
+    }
+
+    SECTION("Existing destination is kept")
+    {
+        WritePatternFile(srcFile, 1000);
+        const std::string existing = WritePatternFile(destFile, 10);
+
+        const int result = ADUC_SystemUtils_CloneFile(srcFile.c_str(), destFile.c_str());
+        const int err = errno;
+        CHECK(result != 0);
+        CHECK(err == EEXIST);
+        CHECK(ReadFileContent(destFile) == existing);
+    }
+}
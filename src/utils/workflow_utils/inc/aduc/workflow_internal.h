@@ -15,6 +15,11 @@
 #include <azure_c_shared_utility/strings.h>
 #include <parson.h>
 
+/**
+ * @brief The update files of a workflow, indexed for lookups. Private to workflow_utils.c.
+ */
+typedef struct tagADUC_WorkflowFileIndex ADUC_WorkflowFileIndex;
+
 /**
  * @brief A struct containing data needed for an update workflow.
  *
@@ -64,6 +69,8 @@ typedef struct tagADUC_Workflow
     //
     ino_t* UpdateFileInodes;
 
+    ADUC_WorkflowFileIndex* UpdateFileIndex; /**< Built on the first lookup of an update file. */
+
     bool ForceUpdate; /**< Always process this workflow, even when the previous update was successful. */
 } ADUC_Workflow;
 
@@ -248,6 +248,16 @@ bool workflow_get_update_file(ADUC_WorkflowHandle handle, size_t index, ADUC_Fil
  */
 bool workflow_get_update_file_by_name(ADUC_WorkflowHandle handle, const char* fileName, ADUC_FileEntity* entity);
 
+/**
+ * @brief Gets a read-only download handler id of the update file at the specified index.
+ * Cheaper than workflow_get_update_file when only the download handler id is needed.
+ *
+ * @param handle A workflow data object handle.
+ * @param index An index of the file.
+ * @return const char* The download handler id, or NULL if the file has none or does not exist.
+ */
+const char* workflow_peek_update_file_download_handler_id(ADUC_WorkflowHandle handle, size_t index);
+
 /**
  * @brief Gets the inode associated with the update file entity at the specified index.
  *
@@ -401,6 +411,16 @@ ADUC_WorkflowHandle workflow_get_root(ADUC_WorkflowHandle handle);
  */
 ADUC_WorkflowHandle workflow_get_parent(ADUC_WorkflowHandle handle);
 
+/**
+ * @brief Set workflow parent, without adding @p handle to the @p parent's children.
+ *
+ * The @p handle's level will be set to ( @p parent's level + 1 ).
+ *
+ * @param handle A child workflow object handle.
+ * @param parent A parent workflow object handle.
+ */
+void workflow_set_parent(ADUC_WorkflowHandle handle, ADUC_WorkflowHandle parent);
+
 /**
  * @brief Get child workflow count. For example, for Bundle Update, this is a count of
  * Leaf (Components) Updates. For Leaf (Components) Update, this is a count of 'InstallItems'.
@@ -721,6 +741,16 @@ workflow_peek_update_manifest_handler_properties_string(ADUC_WorkflowHandle hand
  */
 bool workflow_get_step_detached_manifest_file(ADUC_WorkflowHandle handle, size_t stepIndex, ADUC_FileEntity* entity);
 
+/**
+ * @brief Gets a serialized json string of the specified instructions step.
+ *
+ * @param handle A workflow data object handle.
+ * @param stepIndex A step index.
+ * @return char* An output json string, or NULL if the step doesn't exist.
+ * Caller must free the string with workflow_free_string().
+ */
+char* workflow_get_serialized_step(ADUC_WorkflowHandle handle, size_t stepIndex);
+
 /**
  * @brief Gets a serialized json string of the specified workflow's Update Manifest.
  *
@@ -24,6 +24,7 @@
 #include <azure_c_shared_utility/crt_abstractions.h> // for mallocAndStrcpy_s
 #include <azure_c_shared_utility/strings.h> // for STRING_*
 #include <parson.h>
+#include <pthread.h>
 #include <stdarg.h> // for va_*
 #include <stdlib.h> // for malloc, atoi
 #include <string.h>
@@ -47,6 +48,7 @@
 
 // V4 and later.
 #define DEFAULT_STEP_TYPE "reference"
+#define WORKFLOW_PROPERTY_FIELD_INSTRUCTIONS "instructions"
 #define WORKFLOW_PROPERTY_FIELD_INSTRUCTIONS_DOT_STEPS "instructions.steps"
 #define UPDATE_MANIFEST_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID "detachedManifestFileId"
 #define STEP_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID UPDATE_MANIFEST_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID
@@ -69,6 +71,8 @@ extern ExtensionManager_Download_Options Default_ExtensionManager_Download_Optio
 
 // forward decls
 const JSON_Object* _workflow_get_fileurls_map(ADUC_WorkflowHandle handle);
+const JSON_Object* _workflow_get_update_manifest_files_map(ADUC_WorkflowHandle handle);
+void _workflow_free_updatemanifest(ADUC_WorkflowHandle handle);
 
 //
 // Private functions - this is an adapter for the underlying ADUC_Workflow object.
@@ -370,6 +374,334 @@ static bool workflow_init_update_file_inodes(ADUC_Workflow* wf)
     return true;
 }
 
+/**
+ * @brief An update file in a workflow's file index.
+ * The strings and the JSON object are borrowed from the workflow's update manifest.
+ */
+typedef struct tagADUC_WorkflowFileIndexEntry
+{
+    const char* FileId; /**< The file id. */
+    const char* FileName; /**< The file name. May be NULL. */
+    const JSON_Object* File; /**< The file entry of the update manifest. */
+    ADUC_Hash* Hashes; /**< The parsed hashes. NULL if the file has none, or they cannot be parsed. */
+    size_t HashCount; /**< The count of @p Hashes. */
+} ADUC_WorkflowFileIndexEntry;
+
+/**
+ * @brief A download URL in a workflow's file index, borrowed from the workflow's 'fileUrls' map.
+ */
+typedef struct tagADUC_WorkflowFileUrl
+{
+    const char* FileId; /**< The file id. */
+    const char* Url; /**< The download URL. NULL if the value is not a string. */
+} ADUC_WorkflowFileUrl;
+
+/**
+ * @brief The update files and download URLs of one workflow, indexed for lookups.
+ *
+ * Built on the first lookup and not changed after, so a lookup by index takes O(1), and a lookup by file id or
+ * file name O(log n), instead of a scan of the JSON. Freed when the update action or manifest is replaced.
+ */
+struct tagADUC_WorkflowFileIndex
+{
+    size_t FileCount; /**< The count of update files. */
+    ADUC_WorkflowFileIndexEntry* Files; /**< The update files, in update manifest order. */
+    ADUC_WorkflowFileIndexEntry** FilesById; /**< The update files, by file id. */
+    ADUC_WorkflowFileIndexEntry** FilesByName; /**< The update files that have a name, by name, then order. */
+    size_t NamedFileCount; /**< The count of @p FilesByName. */
+    ADUC_WorkflowFileUrl* FileUrls; /**< The 'fileUrls' of this workflow, by file id. */
+    size_t FileUrlCount; /**< The count of @p FileUrls. */
+};
+
+static int workflow_compare_file_index_entries_by_id(const void* a, const void* b)
+{
+    const ADUC_WorkflowFileIndexEntry* left = *(ADUC_WorkflowFileIndexEntry* const*)a;
+    const ADUC_WorkflowFileIndexEntry* right = *(ADUC_WorkflowFileIndexEntry* const*)b;
+    return strcmp(left->FileId, right->FileId);
+}
+
+static int workflow_compare_file_index_entries_by_name(const void* a, const void* b)
+{
+    const ADUC_WorkflowFileIndexEntry* left = *(ADUC_WorkflowFileIndexEntry* const*)a;
+    const ADUC_WorkflowFileIndexEntry* right = *(ADUC_WorkflowFileIndexEntry* const*)b;
+    int diff = strcasecmp(left->FileName, right->FileName);
+    if (diff != 0)
+    {
+        return diff;
+    }
+
+    // Files are in one array, so this keeps the update manifest order of files with the same name.
+    return (left > right) - (left < right);
+}
+
+static int workflow_compare_file_urls(const void* a, const void* b)
+{
+    return strcmp(((const ADUC_WorkflowFileUrl*)a)->FileId, ((const ADUC_WorkflowFileUrl*)b)->FileId);
+}
+
+static void workflow_free_file_index(ADUC_WorkflowFileIndex* index)
+{
+    if (index == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < index->FileCount; i++)
+    {
+        if (index->Files[i].Hashes != NULL)
+        {
+            ADUC_Hash_FreeArray(index->Files[i].HashCount, index->Files[i].Hashes);
+        }
+    }
+
+    free(index->Files);
+    free(index->FilesById);
+    free(index->FilesByName);
+    free(index->FileUrls);
+    free(index);
+}
+
+/**
+ * @brief Guards the lazy build of the workflow file indexes, since the parallel IsInstalled lanes of the
+ * child workflows of a step all look up files through their shared parent workflow.
+ */
+static pthread_mutex_t s_fileIndexMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void _workflow_free_update_file_index(ADUC_Workflow* wf)
+{
+    if (wf != NULL)
+    {
+        pthread_mutex_lock(&s_fileIndexMutex);
+        workflow_free_file_index(wf->UpdateFileIndex);
+        wf->UpdateFileIndex = NULL;
+        pthread_mutex_unlock(&s_fileIndexMutex);
+    }
+}
+
+/**
+ * @brief Builds the file index of a workflow.
+ *
+ * @param handle A workflow object handle.
+ * @return ADUC_WorkflowFileIndex* The index, to be freed with workflow_free_file_index; or NULL on failure.
+ */
+static ADUC_WorkflowFileIndex* workflow_build_update_file_index(ADUC_WorkflowHandle handle)
+{
+    const JSON_Object* files = _workflow_get_update_manifest_files_map(handle);
+    const JSON_Object* fileUrls = _workflow_get_fileurls_map(handle);
+
+    ADUC_WorkflowFileIndex* index = calloc(1, sizeof(*index));
+    if (index == NULL)
+    {
+        goto fail;
+    }
+
+    index->FileCount = json_object_get_count(files);
+    index->FileUrlCount = json_object_get_count(fileUrls);
+
+    if (index->FileCount > 0)
+    {
+        index->Files = calloc(index->FileCount, sizeof(*index->Files));
+        index->FilesById = calloc(index->FileCount, sizeof(*index->FilesById));
+        index->FilesByName = calloc(index->FileCount, sizeof(*index->FilesByName));
+        if (index->Files == NULL || index->FilesById == NULL || index->FilesByName == NULL)
+        {
+            goto fail;
+        }
+    }
+
+    if (index->FileUrlCount > 0 && (index->FileUrls = calloc(index->FileUrlCount, sizeof(*index->FileUrls))) == NULL)
+    {
+        goto fail;
+    }
+
+    for (size_t i = 0; i < index->FileCount; i++)
+    {
+        ADUC_WorkflowFileIndexEntry* entry = index->Files + i;
+        entry->FileId = json_object_get_name(files, i);
+        entry->File = json_value_get_object(json_object_get_value_at(files, i));
+        entry->FileName = json_object_get_string(entry->File, ADUCITF_FIELDNAME_FILENAME);
+
+        const JSON_Object* hashObj = json_object_get_object(entry->File, ADUCITF_FIELDNAME_HASHES);
+        if (json_object_get_count(hashObj) > 0)
+        {
+            entry->Hashes = ADUC_HashArray_AllocAndInit(hashObj, &entry->HashCount);
+        }
+
+        index->FilesById[i] = entry;
+        if (entry->FileName != NULL)
+        {
+            index->FilesByName[index->NamedFileCount++] = entry;
+        }
+    }
+
+    for (size_t i = 0; i < index->FileUrlCount; i++)
+    {
+        index->FileUrls[i].FileId = json_object_get_name(fileUrls, i);
+        index->FileUrls[i].Url = json_value_get_string(json_object_get_value_at(fileUrls, i));
+    }
+
+    if (index->FileCount > 0)
+    {
+        qsort(
+            index->FilesById, index->FileCount, sizeof(*index->FilesById), workflow_compare_file_index_entries_by_id);
+    }
+
+    if (index->NamedFileCount > 0)
+    {
+        qsort(
+            index->FilesByName,
+            index->NamedFileCount,
+            sizeof(*index->FilesByName),
+            workflow_compare_file_index_entries_by_name);
+    }
+
+    if (index->FileUrlCount > 0)
+    {
+        qsort(index->FileUrls, index->FileUrlCount, sizeof(*index->FileUrls), workflow_compare_file_urls);
+    }
+
+    return index;
+
+fail:
+    Log_Error("Cannot index the update files.");
+    workflow_free_file_index(index);
+    return NULL;
+}
+
+/**
+ * @brief Gets the file index of a workflow, building it on first use.
+ *
+ * @param handle A workflow object handle.
+ * @return const ADUC_WorkflowFileIndex* The index, owned by the workflow; or NULL if it cannot be built.
+ */
+static const ADUC_WorkflowFileIndex* workflow_get_update_file_index(ADUC_WorkflowHandle handle)
+{
+    ADUC_Workflow* wf = (ADUC_Workflow*)handle;
+    if (wf == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&s_fileIndexMutex);
+
+    if (wf->UpdateFileIndex == NULL)
+    {
+        wf->UpdateFileIndex = workflow_build_update_file_index(handle);
+    }
+
+    const ADUC_WorkflowFileIndex* index = wf->UpdateFileIndex;
+
+    pthread_mutex_unlock(&s_fileIndexMutex);
+
+    return index;
+}
+
+/**
+ * @brief Finds an update file of a workflow by its id.
+ *
+ * @param handle A workflow object handle.
+ * @param fileId The file id.
+ * @return const ADUC_WorkflowFileIndexEntry* The file, or NULL if not found.
+ */
+static const ADUC_WorkflowFileIndexEntry*
+workflow_find_update_file_by_id(ADUC_WorkflowHandle handle, const char* fileId)
+{
+    const ADUC_WorkflowFileIndex* index = workflow_get_update_file_index(handle);
+    if (index == NULL || index->FileCount == 0 || fileId == NULL)
+    {
+        return NULL;
+    }
+
+    ADUC_WorkflowFileIndexEntry key = { .FileId = fileId };
+    const ADUC_WorkflowFileIndexEntry* keyPtr = &key;
+    ADUC_WorkflowFileIndexEntry* const* found = bsearch(
+        &keyPtr,
+        index->FilesById,
+        index->FileCount,
+        sizeof(*index->FilesById),
+        workflow_compare_file_index_entries_by_id);
+    return found == NULL ? NULL : *found;
+}
+
+/**
+ * @brief Finds the first update file of a workflow, in update manifest order, with a case insensitive name.
+ *
+ * @param handle A workflow object handle.
+ * @param fileName The file name.
+ * @return const ADUC_WorkflowFileIndexEntry* The file, or NULL if not found.
+ */
+static const ADUC_WorkflowFileIndexEntry*
+workflow_find_update_file_by_name(ADUC_WorkflowHandle handle, const char* fileName)
+{
+    const ADUC_WorkflowFileIndex* index = workflow_get_update_file_index(handle);
+    if (index == NULL || fileName == NULL)
+    {
+        return NULL;
+    }
+
+    // The first of the files with the name, since files with the same name are in update manifest order.
+    size_t low = 0;
+    size_t high = index->NamedFileCount;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (strcasecmp(index->FilesByName[middle]->FileName, fileName) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (low == index->NamedFileCount || strcasecmp(index->FilesByName[low]->FileName, fileName) != 0)
+    {
+        return NULL;
+    }
+
+    return index->FilesByName[low];
+}
+
+/**
+ * @brief Finds the download URL of a file in the 'fileUrls' of a workflow, or else of its enclosing workflow(s).
+ *
+ * @param handle A workflow object handle.
+ * @param fileId The file id.
+ * @return const char* The URL, owned by the workflow that has it; or NULL if not found.
+ */
+static const char* workflow_find_file_url(ADUC_WorkflowHandle handle, const char* fileId)
+{
+    if (fileId == NULL)
+    {
+        return NULL;
+    }
+
+    for (ADUC_WorkflowHandle h = handle; h != NULL; h = workflow_get_parent(h))
+    {
+        const ADUC_WorkflowFileIndex* index = workflow_get_update_file_index(h);
+        if (index == NULL)
+        {
+            return NULL;
+        }
+
+        if (index->FileUrlCount == 0)
+        {
+            continue;
+        }
+
+        ADUC_WorkflowFileUrl key = { .FileId = fileId };
+        const ADUC_WorkflowFileUrl* url =
+            bsearch(&key, index->FileUrls, index->FileUrlCount, sizeof(key), workflow_compare_file_urls);
+        if (url != NULL && url->Url != NULL)
+        {
+            return url->Url;
+        }
+    }
+
+    return NULL;
+}
+
 /**
  * @brief Frees an array of ADUC_RelatedFile of size @p relatedFileCount
  * @param relatedFileCount the size of @p relatedFileArray
@@ -408,7 +740,6 @@ ADUC_RelatedFile* ADUC_RelatedFileArray_AllocAndInit(
     bool success = false;
 
     ADUC_RelatedFile* tempRelatedFileArray = NULL;
-    const JSON_Object* fileUrls = NULL;
 
     if (relatedFileObj == NULL || relatedFileCount == NULL)
     {
@@ -459,16 +790,7 @@ ADUC_RelatedFile* ADUC_RelatedFileArray_AllocAndInit(
         }
 
         // downloadUri
-        ADUC_WorkflowHandle h = handle;
-        do
-        {
-            if ((fileUrls = _workflow_get_fileurls_map(h)) != NULL)
-            {
-                uri = json_object_get_string(fileUrls, fileId);
-            }
-            h = workflow_get_parent(h);
-        } while (uri == NULL && h != NULL);
-
+        uri = workflow_find_file_url(handle, fileId);
         if (uri == NULL)
         {
             Log_Error("Cannot find URL for fileId '%s'", fileId);
@@ -902,8 +1224,8 @@ ADUC_Result _workflow_parse(bool isFile, const char* source, bool validateManife
             JSON_Value* v = json_object_get_value(wf->UpdateActionObject, ADUCITF_FIELDNAME_UPDATEMANIFEST);
             if (v != NULL)
             {
-                char* s = json_serialize_to_string(v);
-                wf->UpdateManifestObject = json_value_get_object(json_parse_string(s));
+                // Copy the value as is, rather than serializing and parsing it again.
+                wf->UpdateManifestObject = json_value_get_object(json_value_deep_copy(v));
             }
         }
 
@@ -967,8 +1289,8 @@ ADUC_Result _workflow_parse(bool isFile, const char* source, bool validateManife
                     goto done;
                 }
 
-                // Free old manifest value.
-                json_value_free(json_object_get_wrapping_value(wf->UpdateManifestObject));
+                // Free old manifest value, and the file index that refers to it.
+                _workflow_free_updatemanifest(handle_from_workflow(wf));
                 wf->UpdateManifestObject = detachedManifest;
             }
         }
@@ -1023,6 +1345,7 @@ void _workflow_free_updateaction(ADUC_WorkflowHandle handle)
     ADUC_Workflow* wf = workflow_from_handle(handle);
     if (wf != NULL && wf->UpdateActionObject != NULL)
     {
+        _workflow_free_update_file_index(wf);
         json_value_free(json_object_get_wrapping_value(wf->UpdateActionObject));
         wf->UpdateActionObject = NULL;
     }
@@ -1038,6 +1361,7 @@ void _workflow_free_updatemanifest(ADUC_WorkflowHandle handle)
     ADUC_Workflow* wf = workflow_from_handle(handle);
     if (wf != NULL && wf->UpdateManifestObject != NULL)
     {
+        _workflow_free_update_file_index(wf);
         json_value_free(json_object_get_wrapping_value(wf->UpdateManifestObject));
         wf->UpdateManifestObject = NULL;
     }
@@ -1733,216 +2057,114 @@ size_t workflow_get_update_files_count(ADUC_WorkflowHandle handle)
     return files == NULL ? 0 : json_object_get_count(files);
 }
 
-bool workflow_get_update_file(ADUC_WorkflowHandle handle, size_t index, ADUC_FileEntity* entity)
+/**
+ * @brief Initializes @p entity with a copy of an update file.
+ *
+ * @param handle The workflow that has the file.
+ * @param file The file.
+ * @param uri The download URL of the file. May be NULL.
+ * @param copyArguments Whether to copy the 'arguments' of the file.
+ * @param entity The file entity to initialize. Left empty on failure.
+ * @return true on success.
+ */
+static bool workflow_init_file_entity(
+    ADUC_WorkflowHandle handle,
+    const ADUC_WorkflowFileIndexEntry* file,
+    const char* uri,
+    bool copyArguments,
+    ADUC_FileEntity* entity)
 {
-    if (entity == NULL)
+    if (file->Hashes == NULL)
     {
+        Log_Error("Unable to parse hashes for fileId '%s'", file->FileId);
         return false;
     }
 
-    size_t count = workflow_get_update_files_count(handle);
-    if (index >= count)
-    {
-        return false;
-    }
-
-    bool succeeded = false;
-    const JSON_Object* files = NULL;
-    const JSON_Object* file = NULL;
-    const JSON_Object* fileUrls = NULL;
-    const char* uri = NULL;
-    const char* fileId = NULL;
-    const char* name = NULL;
-    const char* arguments = NULL;
-    size_t tempHashCount = 0;
-    ADUC_Hash* tempHash = NULL;
-
-    if ((files = _workflow_get_update_manifest_files_map(handle)) == NULL)
-    {
-        goto done;
-    }
-
-    fileId = json_object_get_name(files, index);
-
-    if ((file = json_value_get_object(json_object_get_value_at(files, index))) == NULL)
-    {
-        goto done;
-    }
-
-    // Find fileurls map in this workflow, and its enclosing workflow(s).
-    ADUC_WorkflowHandle h = handle;
-
-    do
-    {
-        if ((fileUrls = _workflow_get_fileurls_map(h)) != NULL)
-        {
-            uri = json_object_get_string(fileUrls, fileId);
-        }
-        h = workflow_get_parent(h);
-    } while (uri == NULL && h != NULL);
-
-    if (uri == NULL)
-    {
-        Log_Error("Cannot find URL for fileId '%s'", fileId);
-        goto done;
-    }
-
-    name = json_object_get_string(file, ADUCITF_FIELDNAME_FILENAME);
-    arguments = json_object_get_string(file, ADUCITF_FIELDNAME_ARGUMENTS);
-
-    const JSON_Object* hashObj = json_object_get_object(file, ADUCITF_FIELDNAME_HASHES);
-
-    tempHash = ADUC_HashArray_AllocAndInit(hashObj, &tempHashCount);
-    if (tempHash == NULL)
-    {
-        Log_Error("Unable to parse hashes for file @ %zu", index);
-        goto done;
-    }
-
     size_t sizeInBytes = 0;
-    if (json_object_has_value(file, ADUCITF_FIELDNAME_SIZEINBYTES))
+    if (json_object_has_value(file->File, ADUCITF_FIELDNAME_SIZEINBYTES))
     {
-        sizeInBytes = json_object_get_number(file, ADUCITF_FIELDNAME_SIZEINBYTES);
+        sizeInBytes = json_object_get_number(file->File, ADUCITF_FIELDNAME_SIZEINBYTES);
     }
 
-    if (!ADUC_FileEntity_Init(entity, fileId, name, uri, arguments, tempHash, tempHashCount, sizeInBytes))
-    {
-        Log_Error("Invalid file entity arguments");
-        goto done;
-    }
+    const char* arguments = copyArguments ? json_object_get_string(file->File, ADUCITF_FIELDNAME_ARGUMENTS) : NULL;
 
-    // ADUC_FileEntity_Init makes a deep copy of the hash so must free tempHash to avoid memory leak.
-    ADUC_Hash_FreeArray(tempHashCount, tempHash);
-    tempHash = NULL;
-
-    if (!ParseFileEntityDownloadHandler(handle, file, entity))
+    // ADUC_FileEntity_Init makes a deep copy of the hashes, so the index keeps its own.
+    if (!ADUC_FileEntity_Init(
+            entity, file->FileId, file->FileName, uri, arguments, file->Hashes, file->HashCount, sizeInBytes))
     {
-        goto done;
+        Log_Error("Invalid file entity arguments");
+        return false;
     }
 
-    succeeded = true;
-
-done:
-    if (!succeeded)
+    if (!ParseFileEntityDownloadHandler(handle, file->File, entity))
     {
-        entity->Hash = NULL; // Manually free hash array below that is pointed to by tempHash...
         ADUC_FileEntity_Uninit(entity);
+        return false;
     }
 
-    if (tempHash != NULL)
-    {
-        ADUC_Hash_FreeArray(tempHashCount, tempHash);
-    }
-
-    return succeeded;
+    return true;
 }
 
-bool workflow_get_update_file_by_name(ADUC_WorkflowHandle handle, const char* fileName, ADUC_FileEntity* entity)
+bool workflow_get_update_file(ADUC_WorkflowHandle handle, size_t index, ADUC_FileEntity* entity)
 {
     if (entity == NULL)
     {
         return false;
     }
 
-    size_t count = workflow_get_update_files_count(handle);
-    if (count == 0)
+    const ADUC_WorkflowFileIndex* fileIndex = workflow_get_update_file_index(handle);
+    if (fileIndex == NULL || index >= fileIndex->FileCount || fileIndex->Files[index].File == NULL)
     {
         return false;
     }
 
-    bool succeeded = false;
-    const JSON_Object* files = NULL;
-    const JSON_Object* file = NULL;
-    const JSON_Object* fileUrls = NULL;
-    const char* uri = NULL;
-    const char* fileId = NULL;
-    const char* name = NULL;
-    const char* arguments = NULL;
-    size_t tempHashCount = 0;
-    ADUC_Hash* tempHash = NULL;
-
-    if ((files = _workflow_get_update_manifest_files_map(handle)) == NULL)
-    {
-        goto done;
-    }
-
-    // Find file by name.
-    for (int i = 0; i < count; i++)
-    {
-        if ((file = json_value_get_object(json_object_get_value_at(files, i))) != NULL
-            && strcasecmp(json_object_get_string(file, "fileName"), fileName) == 0)
-        {
-            fileId = json_object_get_name(files, i);
-            break;
-        }
-    }
-
-    if (fileId == NULL)
-    {
-        goto done;
-    }
-
-    // Find fileurls map in this workflow, and its enclosing workflow(s).
-    ADUC_WorkflowHandle h = handle;
-
-    do
-    {
-        if ((fileUrls = _workflow_get_fileurls_map(h)) != NULL)
-        {
-            uri = json_object_get_string(fileUrls, fileId);
-        }
-        h = workflow_get_parent(h);
-    } while (uri == NULL && h != NULL);
+    const ADUC_WorkflowFileIndexEntry* file = fileIndex->Files + index;
 
+    // Find the URL in this workflow, and its enclosing workflow(s).
+    const char* uri = workflow_find_file_url(handle, file->FileId);
     if (uri == NULL)
     {
-        Log_Error("Cannot find URL for fileId '%s'", fileId);
+        Log_Error("Cannot find URL for fileId '%s'", file->FileId);
+        return false;
     }
 
-    name = json_object_get_string(file, ADUCITF_FIELDNAME_FILENAME);
-    arguments = json_object_get_string(file, ADUCITF_FIELDNAME_ARGUMENTS);
-
-    const JSON_Object* hashObj = json_object_get_object(file, ADUCITF_FIELDNAME_HASHES);
-
-    tempHash = ADUC_HashArray_AllocAndInit(hashObj, &tempHashCount);
-    if (tempHash == NULL)
-    {
-        Log_Error("Unable to parse hashes for fileId", fileId);
-        goto done;
-    }
+    return workflow_init_file_entity(handle, file, uri, true /* copyArguments */, entity);
+}
 
-    size_t sizeInBytes = 0;
-    if (json_object_has_value(file, ADUCITF_FIELDNAME_SIZEINBYTES))
+bool workflow_get_update_file_by_name(ADUC_WorkflowHandle handle, const char* fileName, ADUC_FileEntity* entity)
+{
+    if (entity == NULL)
     {
-        sizeInBytes = json_object_get_number(file, ADUCITF_FIELDNAME_SIZEINBYTES);
+        return false;
     }
 
-    if (!ADUC_FileEntity_Init(entity, fileId, name, uri, arguments, tempHash, tempHashCount, sizeInBytes))
+    const ADUC_WorkflowFileIndexEntry* file = workflow_find_update_file_by_name(handle, fileName);
+    if (file == NULL || file->File == NULL)
     {
-        Log_Error("Invalid file entity arguments");
-        goto done;
+        return false;
     }
 
-    if (!ParseFileEntityDownloadHandler(handle, file, entity))
+    // Find the URL in this workflow, and its enclosing workflow(s).
+    const char* uri = workflow_find_file_url(handle, file->FileId);
+    if (uri == NULL)
     {
-        goto done;
+        Log_Error("Cannot find URL for fileId '%s'", file->FileId);
     }
 
-    succeeded = true;
+    return workflow_init_file_entity(handle, file, uri, true /* copyArguments */, entity);
+}
 
-done:
-    if (!succeeded)
+const char* workflow_peek_update_file_download_handler_id(ADUC_WorkflowHandle handle, size_t index)
+{
+    const ADUC_WorkflowFileIndex* fileIndex = workflow_get_update_file_index(handle);
+    if (fileIndex == NULL || index >= fileIndex->FileCount)
     {
-        entity->Hash = NULL; // will be freed with tempHash below
-        ADUC_FileEntity_Uninit(entity);
-
-        if (tempHash != NULL)
-        {
-            ADUC_Hash_FreeArray(tempHashCount, tempHash);
-        }
+        return NULL;
     }
 
-    return succeeded;
+    const JSON_Object* downloadHandler =
+        json_object_get_object(fileIndex->Files[index].File, ADUCITF_FIELDNAME_DOWNLOADHANDLER);
+    return json_object_get_string(downloadHandler, ADUCITF_FIELDNAME_DOWNLOADHANDLER_ID);
 }
 
 /**
@@ -2173,6 +2395,69 @@ static JSON_Array* workflow_get_instructions_steps_array(ADUC_WorkflowHandle han
     return json_object_dotget_array(o, WORKFLOW_PROPERTY_FIELD_INSTRUCTIONS_DOT_STEPS);
 }
 
+/**
+ * @brief Copies an update manifest for a child workflow, leaving out its 'files' map.
+ * The caller adds the files the child needs, so the files of the other children are never copied.
+ *
+ * @param manifest The update manifest of the base workflow.
+ * @param copyInstructions Whether to copy the 'instructions' too.
+ * @return JSON_Value* The copy, or NULL on failure. Caller must free it with json_value_free.
+ */
+static JSON_Value* workflow_copy_update_manifest_for_child(const JSON_Object* manifest, bool copyInstructions)
+{
+    JSON_Value* copyValue = json_value_init_object();
+    JSON_Object* copy = json_object(copyValue);
+    size_t count = json_object_get_count(manifest);
+
+    if (copy == NULL || manifest == NULL)
+    {
+        goto fail;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char* name = json_object_get_name(manifest, i);
+        if (strcmp(name, ADUCITF_FIELDNAME_FILES) == 0
+            || (!copyInstructions && strcmp(name, WORKFLOW_PROPERTY_FIELD_INSTRUCTIONS) == 0))
+        {
+            continue;
+        }
+
+        JSON_Value* value = json_value_deep_copy(json_object_get_value_at(manifest, i));
+        if (value == NULL || json_object_set_value(copy, name, value) == JSONFailure)
+        {
+            json_value_free(value);
+            goto fail;
+        }
+    }
+
+    return copyValue;
+
+fail:
+    json_value_free(copyValue);
+    return NULL;
+}
+
+/**
+ * @brief Adds a copy of a file of @p baseFiles to @p files, under the same file id.
+ *
+ * @param files The files map of a child update manifest.
+ * @param baseFiles The files map of the base update manifest.
+ * @param index The index of the file in @p baseFiles.
+ * @return JSON_Object* The copy, or NULL on failure.
+ */
+static JSON_Object* workflow_copy_update_file_for_child(JSON_Object* files, const JSON_Object* baseFiles, size_t index)
+{
+    JSON_Value* file = json_value_deep_copy(json_object_get_value_at(baseFiles, index));
+    if (file == NULL || json_object_set_value(files, json_object_get_name(baseFiles, index), file) == JSONFailure)
+    {
+        json_value_free(file);
+        return NULL;
+    }
+
+    return json_object(file);
+}
+
 /**
  * @brief Create a new workflow data handler using specified step data from base workflow.
  * Note: The 'workfolder' of the returned workflow data object will be the same as the base's.
@@ -2233,7 +2518,8 @@ ADUC_Result workflow_create_from_inline_step(ADUC_WorkflowHandle base, int stepI
 
     JSON_Object* updateActionObject = json_object(updateActionValue);
 
-    updateManifestValue = json_value_deep_copy(json_object_get_wrapping_value(wfBase->UpdateManifestObject));
+    updateManifestValue =
+        workflow_copy_update_manifest_for_child(wfBase->UpdateManifestObject, false /* copyInstructions */);
     if (updateManifestValue == NULL)
     {
         Log_Error("Cannot copy Update Manifest json from base");
@@ -2244,9 +2530,12 @@ ADUC_Result workflow_create_from_inline_step(ADUC_WorkflowHandle base, int stepI
     JSON_Object* updateManifestObject = json_object(updateManifestValue);
     JSON_Object* stepObject = json_object(stepValue);
 
-    char* currentStepData = json_serialize_to_string_pretty(stepValue);
-    Log_Debug("Processing current step:\n%s", currentStepData);
-    json_free_serialized_string(currentStepData);
+    if (ADUC_Logging_GetLevel() == ADUC_LOG_DEBUG)
+    {
+        char* currentStepData = json_serialize_to_string_pretty(stepValue);
+        Log_Debug("Processing current step:\n%s", currentStepData);
+        json_free_serialized_string(currentStepData);
+    }
 
     // Replace 'updateType' with step's handler type.
     const char* updateType = json_object_get_string(stepObject, STEP_PROPERTY_FIELD_HANDLER);
@@ -2278,42 +2567,44 @@ ADUC_Result workflow_create_from_inline_step(ADUC_WorkflowHandle base, int stepI
         goto done;
     }
 
-    // Keep only file needed by this step entry. Remove the rest.
-    JSON_Array* stepFiles = json_object_get_array(stepObject, ADUCITF_FIELDNAME_FILES);
-    JSON_Object* baseFiles = json_object_get_object(updateManifestObject, ADUCITF_FIELDNAME_FILES);
-    int fileCount = json_object_get_count(baseFiles);
-    for (int b = fileCount - 1; b >= 0; b--)
+    // Copy only the files needed by this step entry, in the order of the base files.
+    JSON_Array* stepFiles = json_object_get_array(stepObject, STEP_PROPERTY_FIELD_FILES);
+    JSON_Object* baseFiles = json_object_get_object(wfBase->UpdateManifestObject, ADUCITF_FIELDNAME_FILES);
+    if (baseFiles != NULL)
     {
-        const char* baseFileId = json_object_get_name(baseFiles, b);
-
-        // If file is in the instruction, merge their properties.
-        bool fileRequired = false;
-        int stepFilesCount = json_array_get_count(stepFiles);
-        for (int i = stepFilesCount - 1; i >= 0; i--)
+        JSON_Value* filesValue = json_value_init_object();
+        if (json_object_set_value(updateManifestObject, ADUCITF_FIELDNAME_FILES, filesValue) == JSONFailure)
         {
-            // Note: step's files is an array of file ids.
-            const char* stepFileId = json_array_get_string(stepFiles, i);
-
-            if (baseFileId != NULL && stepFileId != NULL && strcmp(baseFileId, stepFileId) == 0)
-            {
-                // Found.
-                fileRequired = true;
-
-                // Done with this file, remove it (and free).
-                json_array_remove(stepFiles, i);
-                break;
-            }
+            json_value_free(filesValue);
+            result.ExtendedResultCode = ADUC_ERC_NOMEM;
+            goto done;
         }
 
-        // Remove file from base files list, if no longer needed.
-        if (!fileRequired)
+        JSON_Object* files = json_object(filesValue);
+        size_t fileCount = json_object_get_count(baseFiles);
+        size_t stepFilesCount = json_array_get_count(stepFiles);
+        for (size_t b = 0; b < fileCount; b++)
         {
-            json_object_remove(baseFiles, json_object_get_name(baseFiles, b));
+            const char* baseFileId = json_object_get_name(baseFiles, b);
+            for (size_t i = 0; i < stepFilesCount; i++)
+            {
+                // Note: step's files is an array of file ids.
+                const char* stepFileId = json_array_get_string(stepFiles, i);
+                if (stepFileId != NULL && strcmp(baseFileId, stepFileId) == 0)
+                {
+                    if (workflow_copy_update_file_for_child(files, baseFiles, b) == NULL)
+                    {
+                        result.ExtendedResultCode = ADUC_ERC_NOMEM;
+                        goto done;
+                    }
+                    break;
+                }
+            }
         }
     }
 
     // Remove 'instructions' list...
-    json_object_set_null(updateManifestObject, "instructions");
+    json_object_set_null(updateManifestObject, WORKFLOW_PROPERTY_FIELD_INSTRUCTIONS);
 
     wf->UpdateActionObject = updateActionObject;
     wf->UpdateManifestObject = updateManifestObject;
@@ -2362,7 +2653,10 @@ bool workflow_transfer_data(ADUC_WorkflowHandle targetHandle, ADUC_WorkflowHandl
     // Needs to be done before transferring parsed JSON obj below.
     workflow_set_workfolder(targetHandle, "%s/%s", ADUC_DOWNLOADS_FOLDER, workflow_peek_id(sourceHandle));
 
-    // Transfer over the parsed JSON objects
+    // Transfer over the parsed JSON objects. The file indexes refer to them, so rebuild those on next use.
+    _workflow_free_update_file_index(wfTarget);
+    _workflow_free_update_file_index(wfSource);
+
     wfTarget->UpdateActionObject = wfSource->UpdateActionObject;
     wfSource->UpdateActionObject = NULL;
 
@@ -2568,6 +2862,7 @@ void workflow_uninit(ADUC_WorkflowHandle handle)
     _workflow_free_results_object(handle);
 
     _workflow_free_update_file_inodes(wf);
+    _workflow_free_update_file_index(wf);
 
     // This should have been transferred, but free it if it's still around.
     if (wf != NULL && wf->DeferredReplacementWorkflow != NULL)
@@ -2596,6 +2891,8 @@ void workflow_free(ADUC_WorkflowHandle handle)
         workflow_free(child);
     }
 
+    free(workflow_from_handle(handle)->Children);
+
     workflow_uninit(handle);
     free(handle);
 }
@@ -2769,7 +3066,7 @@ ADUC_WorkflowHandle workflow_remove_child(ADUC_WorkflowHandle handle, int index)
 
     if (index < wf->ChildCount - 1)
     {
-        int bytes = sizeof(ADUC_Workflow*) * wf->ChildCount - (index + 1);
+        size_t bytes = sizeof(ADUC_Workflow*) * (wf->ChildCount - (index + 1));
         memmove(wf->Children + index, wf->Children + (index + 1), bytes);
     }
 
@@ -3265,7 +3562,8 @@ workflow_create_from_instruction_value(ADUC_WorkflowHandle base, JSON_Value* ins
 
     JSON_Object* updateActionObject = json_object(updateActionValue);
 
-    updateManifestValue = json_value_deep_copy(json_object_get_wrapping_value(wfBase->UpdateManifestObject));
+    updateManifestValue =
+        workflow_copy_update_manifest_for_child(wfBase->UpdateManifestObject, true /* copyInstructions */);
     if (updateManifestValue == NULL)
     {
         Log_Error("Cannot copy Update Manifest json from base");
@@ -3276,9 +3574,12 @@ workflow_create_from_instruction_value(ADUC_WorkflowHandle base, JSON_Value* ins
     JSON_Object* updateManifestObject = json_object(updateManifestValue);
     JSON_Object* instructionObject = json_object(instruction);
 
-    char* currentInstructionData = json_serialize_to_string_pretty(instruction);
-    Log_Debug("Processing current instruction:\n%s", currentInstructionData);
-    json_free_serialized_string(currentInstructionData);
+    if (ADUC_Logging_GetLevel() == ADUC_LOG_DEBUG)
+    {
+        char* currentInstructionData = json_serialize_to_string_pretty(instruction);
+        Log_Debug("Processing current instruction:\n%s", currentInstructionData);
+        json_free_serialized_string(currentInstructionData);
+    }
 
     // Replace 'updateType'.
     const char* updateType = json_object_get_string(instructionObject, ADUCITF_FIELDNAME_UPDATETYPE);
@@ -3296,46 +3597,59 @@ workflow_create_from_instruction_value(ADUC_WorkflowHandle base, JSON_Value* ins
         goto done;
     }
 
-    // Keep only file needed by this entry. Remove the rest.
+    // Copy only the files needed by this entry, in the order of the base files, and merge their properties.
     JSON_Array* instFiles = json_object_get_array(instructionObject, ADUCITF_FIELDNAME_FILES);
-    JSON_Object* baseFiles = json_object_get_object(updateManifestObject, ADUCITF_FIELDNAME_FILES);
-    int fileCount = json_object_get_count(baseFiles);
-    for (int b = fileCount - 1; b >= 0; b--)
+    JSON_Object* baseFiles = json_object_get_object(wfBase->UpdateManifestObject, ADUCITF_FIELDNAME_FILES);
+    if (baseFiles != NULL)
     {
-        JSON_Object* baseFile = json_object(json_object_get_value_at(baseFiles, b));
+        JSON_Value* filesValue = json_value_init_object();
+        if (json_object_set_value(updateManifestObject, ADUCITF_FIELDNAME_FILES, filesValue) == JSONFailure)
+        {
+            json_value_free(filesValue);
+            result.ExtendedResultCode = ADUC_ERC_NOMEM;
+            goto done;
+        }
 
-        // If file is in the instruction, merge their properties.
-        bool fileRequired = false;
-        int instFilesCount = json_array_get_count(instFiles);
-        for (int i = instFilesCount - 1; i >= 0; i--)
+        JSON_Object* files = json_object(filesValue);
+        size_t fileCount = json_object_get_count(baseFiles);
+        size_t instFilesCount = json_array_get_count(instFiles);
+        for (size_t b = 0; b < fileCount; b++)
         {
+            JSON_Object* baseFile = json_object(json_object_get_value_at(baseFiles, b));
             const char* baseFilename = json_object_get_string(baseFile, ADUCITF_FIELDNAME_FILENAME);
+            if (baseFilename == NULL)
+            {
+                continue;
+            }
 
-            JSON_Object* instFile = json_array_get_object(instFiles, i);
-            const char* instFilename = json_object_get_string(instFile, ADUCITF_FIELDNAME_FILENAME);
-
-            if (baseFilename != NULL && instFilename != NULL && strcmp(baseFilename, instFilename) == 0)
+            for (size_t i = 0; i < instFilesCount; i++)
             {
-                // Found.
-                fileRequired = true;
-                int valuesCount = json_object_get_count(instFile);
-                for (int v = valuesCount - 1; v >= 0; v--)
+                JSON_Object* instFile = json_array_get_object(instFiles, i);
+                const char* instFilename = json_object_get_string(instFile, ADUCITF_FIELDNAME_FILENAME);
+                if (instFilename != NULL && strcmp(baseFilename, instFilename) == 0)
                 {
-                    const char* key = json_object_get_name(instFile, v);
-                    JSON_Value* val = json_value_deep_copy(json_object_get_value_at(instFile, v));
-                    json_object_set_value(baseFile, key, val);
+                    JSON_Object* file = workflow_copy_update_file_for_child(files, baseFiles, b);
+                    if (file == NULL)
+                    {
+                        result.ExtendedResultCode = ADUC_ERC_NOMEM;
+                        goto done;
+                    }
+
+                    size_t valuesCount = json_object_get_count(instFile);
+                    for (size_t v = 0; v < valuesCount; v++)
+                    {
+                        JSON_Value* val = json_value_deep_copy(json_object_get_value_at(instFile, v));
+                        if (json_object_set_value(file, json_object_get_name(instFile, v), val) == JSONFailure)
+                        {
+                            json_value_free(val);
+                            result.ExtendedResultCode = ADUC_ERC_NOMEM;
+                            goto done;
+                        }
+                    }
+                    break;
                 }
-                // Done with this file, remove it (and free).
-                json_array_remove(instFiles, i);
-                break;
             }
         }
-
-        // Remove file from base files list, if no longer needed.
-        if (!fileRequired)
-        {
-            json_object_remove(baseFiles, json_object_get_name(baseFiles, b));
-        }
     }
 
     wf->UpdateActionObject = updateActionObject;
@@ -3477,78 +3791,42 @@ bool workflow_get_step_detached_manifest_file(ADUC_WorkflowHandle handle, size_t
         return false;
     }
 
-    bool succeeded = false;
-    bool fileEntityInited = false;
     JSON_Object* step = json_array_get_object(workflow_get_instructions_steps_array(handle), stepIndex);
     const char* fileId = json_object_get_string(step, STEP_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID);
-    const JSON_Object* files = _workflow_get_update_manifest_files_map(handle);
-    const JSON_Object* file = json_object_get_object(files, fileId);
-    const JSON_Object* fileUrls = NULL;
-    const char* uri = NULL;
-    const char* name = NULL;
-    size_t tempHashCount = 0;
-    ADUC_Hash* tempHash = NULL;
-
-    // Find fileurls map in this workflow, and its enclosing workflow(s).
-    ADUC_WorkflowHandle h = handle;
-
-    do
-    {
-        if ((fileUrls = _workflow_get_fileurls_map(h)) == NULL)
-        {
-            Log_Warn("'fileUrls' property not found.");
-        }
-        else
-        {
-            uri = json_object_get_string(fileUrls, fileId);
-        }
-        h = workflow_get_parent(h);
-    } while (uri == NULL && h != NULL);
-
-    if (uri == NULL)
-    {
-        goto done;
-    }
-
-    name = json_object_get_string(file, ADUCITF_FIELDNAME_FILENAME);
-    const JSON_Object* hashObj = json_object_get_object(file, ADUCITF_FIELDNAME_HASHES);
-
-    tempHash = ADUC_HashArray_AllocAndInit(hashObj, &tempHashCount);
-    if (tempHash == NULL)
-    {
-        Log_Error("Unable to parse hashes for file @ %zu", stepIndex);
-        goto done;
-    }
-
-    size_t sizeInBytes = 0;
-    if (json_object_has_value(file, ADUCITF_FIELDNAME_SIZEINBYTES))
-    {
-        sizeInBytes = json_object_get_number(file, ADUCITF_FIELDNAME_SIZEINBYTES);
-    }
 
-    if (!ADUC_FileEntity_Init(entity, fileId, name, uri, NULL /*arguments*/, tempHash, tempHashCount, sizeInBytes))
+    const ADUC_WorkflowFileIndexEntry* file = workflow_find_update_file_by_id(handle, fileId);
+    if (file == NULL)
     {
-        Log_Error("Invalid file entity arguments");
-        goto done;
+        return false;
     }
 
-    fileEntityInited = true;
-
-    if (!ParseFileEntityDownloadHandler(handle, file, entity))
+    // Find the URL in this workflow, and its enclosing workflow(s).
+    const char* uri = workflow_find_file_url(handle, fileId);
+    if (uri == NULL)
     {
-        goto done;
+        return false;
     }
 
-    succeeded = true;
-
-done:
+    return workflow_init_file_entity(handle, file, uri, false /* copyArguments */, entity);
+}
 
-    if (!succeeded && fileEntityInited)
+/**
+ * @brief Gets a serialized json string of the specified instructions step.
+ *
+ * @param handle A workflow data object handle.
+ * @param stepIndex A step index.
+ * @return char* An output json string, or NULL if the step doesn't exist.
+ * Caller must free the string with workflow_free_string().
+ */
+char* workflow_get_serialized_step(ADUC_WorkflowHandle handle, size_t stepIndex)
+{
+    JSON_Value* step = json_array_get_value(workflow_get_instructions_steps_array(handle), stepIndex);
+    if (step == NULL)
     {
-        ADUC_FileEntity_Uninit(entity);
+        return NULL;
     }
 
-    return succeeded;
+    return json_serialize_to_string(step);
 }
 
 /**
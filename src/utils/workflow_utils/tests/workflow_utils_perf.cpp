@@ -0,0 +1,174 @@
+/**
+ * @file workflow_utils_perf.cpp
+ * @brief Benchmarks for large bundle update manifests: parsing, child workflows and update file lookups.
+ *
+ * Hidden from the default run. Use: workflow_utils_unit_test "[perf]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/parser_utils.h"
+#include "aduc/result.h"
+#include "aduc/workflow_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+/**
+ * @brief Returns an update manifest with @p count files and one inline step per file.
+ */
+std::string MakeBundleManifest(int count)
+{
+    std::ostringstream manifest;
+    manifest << R"({"manifestVersion":"5",)"
+             << R"("updateId":{"provider":"Contoso","name":"Large-Bundle","version":"1.0"},)"
+             << R"("compatibility":[{"deviceManufacturer":"contoso","deviceModel":"large-bundle-v1"}],)"
+             << R"("instructions":{"steps":[)";
+    for (int i = 0; i < count; i++)
+    {
+        manifest << (i == 0 ? "" : ",") << R"({"handler":"microsoft/script:1","files":["f)" << i << R"("],)"
+                 << R"("handlerProperties":{"scriptFileName":"install-)" << i << R"(.sh",)"
+                 << R"("arguments":"--component-name --component-name-val",)"
+                 << R"("installedCriteria":"large-bundle-1.0-step-)" << i << R"("}})";
+    }
+    manifest << R"(]},"files":{)";
+    for (int i = 0; i < count; i++)
+    {
+        manifest << (i == 0 ? "" : ",") << R"("f)" << i << R"(":{"fileName":"install-)" << i
+                 << R"(.sh","sizeInBytes":27030,"hashes":{"sha256":"DYb4/+P3mq2yjq6n987msufTo3GUb5tpMtk+f7IeHx0="}})";
+    }
+    manifest << R"(},"createdDateTime":"2022-01-27T13:45:05.8993329Z"})";
+    return manifest.str();
+}
+
+/**
+ * @brief Returns an update action with @p manifest, either as a JSON string or as a JSON object.
+ */
+std::string MakeUpdateAction(const std::string& manifest, int count, bool manifestAsString)
+{
+    std::ostringstream action;
+    action << R"({"workflow":{"action":3,"id":"dcb112da-bfc9-47b7-b7ed-617feba1e6c4"},"updateManifest":)";
+    if (manifestAsString)
+    {
+        action << '"';
+        for (char c : manifest)
+        {
+            if (c == '"' || c == '\\')
+            {
+                action << '\\';
+            }
+            action << c;
+        }
+        action << '"';
+    }
+    else
+    {
+        action << manifest;
+    }
+
+    action << R"(,"fileUrls":{)";
+    for (int i = 0; i < count; i++)
+    {
+        action << (i == 0 ? "" : ",") << R"("f)" << i << R"(":"http://contoso.example/large-bundle/install-)" << i
+               << R"(.sh")";
+    }
+    action << "}}";
+    return action.str();
+}
+} // namespace
+
+TEST_CASE("workflow_init and inline step children of large bundle manifests", "[.][perf]")
+{
+    constexpr int repeats = 5;
+
+    for (int count : { 100, 400 })
+    {
+        const std::string manifest = MakeBundleManifest(count);
+
+        for (bool manifestAsString : { true, false })
+        {
+            const std::string action = MakeUpdateAction(manifest, count, manifestAsString);
+
+            std::chrono::duration<double, std::milli> parsing{ 0 };
+            std::chrono::duration<double, std::milli> children{ 0 };
+            for (int r = 0; r < repeats; r++)
+            {
+                ADUC_WorkflowHandle bundle = nullptr;
+
+                auto start = std::chrono::steady_clock::now();
+                ADUC_Result result = workflow_init(action.c_str(), false /* validateManifest */, &bundle);
+                parsing += std::chrono::steady_clock::now() - start;
+                REQUIRE(result.ResultCode != 0);
+                REQUIRE(workflow_get_instructions_steps_count(bundle) == static_cast<size_t>(count));
+
+                start = std::chrono::steady_clock::now();
+                for (int i = 0; i < count; i++)
+                {
+                    ADUC_WorkflowHandle child = nullptr;
+                    result = workflow_create_from_inline_step(bundle, i, &child);
+                    REQUIRE(result.ResultCode != 0);
+                    workflow_free(child);
+                }
+                children += std::chrono::steady_clock::now() - start;
+
+                workflow_free(bundle);
+            }
+
+            std::cout << count << " files and steps, manifest as " << (manifestAsString ? "string" : "object")
+                      << "\tworkflow_init " << (parsing.count() / repeats) << " ms\tall children "
+                      << (children.count() / repeats) << " ms" << std::endl;
+        }
+    }
+}
+
+TEST_CASE("Update file lookups in large bundle manifests", "[.][perf]")
+{
+    constexpr int repeats = 5;
+
+    for (int count : { 100, 1000 })
+    {
+        const std::string manifest = MakeBundleManifest(count);
+        const std::string action = MakeUpdateAction(manifest, count, false /* manifestAsString */);
+
+        std::chrono::duration<double, std::milli> byIndex{ 0 };
+        std::chrono::duration<double, std::milli> byName{ 0 };
+        for (int r = 0; r < repeats; r++)
+        {
+            ADUC_WorkflowHandle bundle = nullptr;
+            ADUC_Result result = workflow_init(action.c_str(), false /* validateManifest */, &bundle);
+            REQUIRE(result.ResultCode != 0);
+
+            ADUC_FileEntity file;
+            memset(&file, 0, sizeof(file));
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; i++)
+            {
+                REQUIRE(workflow_get_update_file(bundle, i, &file));
+                ADUC_FileEntity_Uninit(&file);
+            }
+            byIndex += std::chrono::steady_clock::now() - start;
+
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; i++)
+            {
+                const std::string fileName = "install-" + std::to_string(i) + ".sh";
+                REQUIRE(workflow_get_update_file_by_name(bundle, fileName.c_str(), &file));
+                ADUC_FileEntity_Uninit(&file);
+            }
+            byName += std::chrono::steady_clock::now() - start;
+
+            workflow_free(bundle);
+        }
+
+        std::cout << count << " files\tall by index " << (byIndex.count() / repeats) << " ms\tall by name "
+                  << (byName.count() / repeats) << " ms" << std::endl;
+    }
+}
@@ -10,6 +10,7 @@
 #include "aduc/workflow_utils.h"
 
 #include <catch2/catch.hpp>
+using Catch::Matchers::Contains;
 using Catch::Matchers::Equals;
 
 #include <sstream>
@@ -701,3 +702,150 @@ TEST_CASE("Request workflow cancellation")
 
     workflow_free(handle);
 }
+
+TEST_CASE("Child workflow from an inline step has only the files of the step")
+{
+    ADUC_WorkflowHandle bundle = nullptr;
+    ADUC_Result result = workflow_init(action_parent_update, false /* validateManifest */, &bundle);
+    REQUIRE(result.ResultCode != 0);
+    REQUIRE(workflow_get_update_files_count(bundle) == 2);
+
+    // Creating the child must leave the base as it was, so do it twice.
+    for (int i = 0; i < 2; i++)
+    {
+        ADUC_WorkflowHandle step0 = nullptr;
+        result = workflow_create_from_inline_step(bundle, 0, &step0);
+        REQUIRE(result.ResultCode != 0);
+
+        CHECK_THAT(workflow_peek_update_type(step0), Equals("microsoft/apt:1"));
+        CHECK_THAT(
+            workflow_peek_update_manifest_handler_properties_string(step0, "installedCriteria"),
+            Equals("apt-update-tree-1.0"));
+        CHECK(workflow_get_instructions_steps_count(step0) == 0);
+
+        REQUIRE(workflow_get_update_files_count(step0) == 1);
+        ADUC_FileEntity file;
+        memset(&file, 0, sizeof(file));
+        REQUIRE(workflow_get_update_file(step0, 0, &file));
+        CHECK_THAT(file.FileId, Equals("f483750ebb885d32c"));
+        CHECK_THAT(file.TargetFilename, Equals("apt-manifest-tree-1.0.json"));
+        ADUC_FileEntity_Uninit(&file);
+
+        workflow_free(step0);
+    }
+
+    CHECK(workflow_get_update_files_count(bundle) == 2);
+    CHECK(workflow_get_instructions_steps_count(bundle) == 2);
+
+    workflow_free(bundle);
+}
+
+TEST_CASE("Serialized step")
+{
+    ADUC_WorkflowHandle bundle = nullptr;
+    ADUC_Result result = workflow_init(action_parent_update, false /* validateManifest */, &bundle);
+    REQUIRE(result.ResultCode != 0);
+
+    char* step = workflow_get_serialized_step(bundle, 0);
+    REQUIRE(step != nullptr);
+    CHECK_THAT(step, Contains(R"("files":["f483750ebb885d32c"])"));
+    CHECK_THAT(step, Contains(R"("handlerProperties":{"installedCriteria":"apt-update-tree-1.0"})"));
+    workflow_free_string(step);
+
+    step = workflow_get_serialized_step(bundle, 1);
+    REQUIRE(step != nullptr);
+    CHECK_THAT(step, Contains(R"("detachedManifestFileId":"f222b9ffefaaac577")"));
+    workflow_free_string(step);
+
+    CHECK(workflow_get_serialized_step(bundle, 2) == nullptr);
+
+    workflow_free(bundle);
+}
+
+TEST_CASE("Child workflow from an instruction merges the properties of its files")
+{
+    ADUC_WorkflowHandle bundle = nullptr;
+    ADUC_Result result = workflow_init(action_parent_update, false /* validateManifest */, &bundle);
+    REQUIRE(result.ResultCode != 0);
+
+    ADUC_WorkflowHandle instance = nullptr;
+    result = workflow_create_from_instruction(
+        bundle,
+        R"({"updateType":"microsoft/script:1","files":[{"fileName":"apt-manifest-tree-1.0.json","arguments":"-a"}]})",
+        &instance);
+    REQUIRE(result.ResultCode != 0);
+
+    CHECK_THAT(workflow_peek_update_type(instance), Equals("microsoft/script:1"));
+    CHECK(workflow_get_instructions_steps_count(instance) == 2);
+    REQUIRE(workflow_get_update_files_count(instance) == 1);
+
+    char* manifest = workflow_get_serialized_update_manifest(instance, false /* pretty */);
+    REQUIRE(manifest != nullptr);
+    CHECK_THAT(manifest, Contains(R"("arguments":"-a")"));
+    CHECK_THAT(manifest, !Contains("f222b9ffefaaac577\":{"));
+    workflow_free_string(manifest);
+
+    workflow_free(instance);
+    workflow_free(bundle);
+}
+
+TEST_CASE("Update files are found by index, id and name in manifest order")
+{
+    // clang-format off
+    const char* action =
+        R"({"workflow":{"action":3,"id":"dcb112da-bfc9-47b7-b7ed-617feba1e6c4"},)"
+        R"("updateManifest":{"manifestVersion":"5",)"
+        R"("updateId":{"provider":"Contoso","name":"Virtual-Vacuum","version":"20.0"},)"
+        R"("compatibility":[{"deviceManufacturer":"contoso","deviceModel":"virtual-vacuum-v1"}],)"
+        R"("instructions":{"steps":[{"handler":"microsoft/script:1","files":["fz","fa","fm"]}]},)"
+        R"("files":{)"
+        R"("fz":{"fileName":"Payload.bin","sizeInBytes":1,"hashes":{"sha256":"AA=="}},)"
+        R"("fa":{"fileName":"payload.bin","sizeInBytes":2,"hashes":{"sha256":"AQ=="},)"
+        R"("downloadHandler":{"id":"microsoft/delta:1"}},)"
+        R"("fm":{"fileName":"script.sh","sizeInBytes":3,"hashes":{"sha256":"Ag=="}}}},)"
+        R"("fileUrls":{"fz":"http://contoso.example/fz","fa":"http://contoso.example/fa","fm":"http://contoso.example/fm"}})";
+    // clang-format on
+
+    ADUC_WorkflowHandle handle = nullptr;
+    ADUC_Result result = workflow_init(action, false /* validateManifest */, &handle);
+    REQUIRE(result.ResultCode != 0);
+    REQUIRE(workflow_get_update_files_count(handle) == 3);
+
+    // Looking up a file more than once gives the same entity.
+    const char* expectedIds[] = { "fz", "fa", "fm" };
+    for (int repeat = 0; repeat < 2; repeat++)
+    {
+        for (size_t i = 0; i < 3; i++)
+        {
+            ADUC_FileEntity file;
+            memset(&file, 0, sizeof(file));
+            REQUIRE(workflow_get_update_file(handle, i, &file));
+            CHECK_THAT(file.FileId, Equals(expectedIds[i]));
+            CHECK_THAT(file.DownloadUri, Equals(std::string("http://contoso.example/") + expectedIds[i]));
+            CHECK(file.SizeInBytes == i + 1);
+            CHECK(file.HashCount == 1);
+            ADUC_FileEntity_Uninit(&file);
+        }
+    }
+
+    ADUC_FileEntity file;
+    memset(&file, 0, sizeof(file));
+    CHECK_FALSE(workflow_get_update_file(handle, 3, &file));
+
+    // Names match regardless of case, and the first file in the manifest wins.
+    REQUIRE(workflow_get_update_file_by_name(handle, "PAYLOAD.BIN", &file));
+    CHECK_THAT(file.FileId, Equals("fz"));
+    ADUC_FileEntity_Uninit(&file);
+
+    REQUIRE(workflow_get_update_file_by_name(handle, "script.sh", &file));
+    CHECK_THAT(file.FileId, Equals("fm"));
+    ADUC_FileEntity_Uninit(&file);
+
+    CHECK_FALSE(workflow_get_update_file_by_name(handle, "missing.bin", &file));
+
+    CHECK(workflow_peek_update_file_download_handler_id(handle, 0) == nullptr);
+    CHECK_THAT(workflow_peek_update_file_download_handler_id(handle, 1), Equals("microsoft/delta:1"));
+    CHECK(workflow_peek_update_file_download_handler_id(handle, 3) == nullptr);
+
+    workflow_free(handle);
+}